@@ -0,0 +1,156 @@
+#include "pch.h"
+#include "BenchmarkResults.h"
+
+static std::string EscapeJSONString(const std::string& string)
+{
+	std::string out;
+	out.reserve(string.size() + 2);
+
+	out += '"';
+	for (char ch : string)
+	{
+		if (ch == '"' || ch == '\\')
+			out += '\\';
+		out += ch;
+	}
+	out += '"';
+
+	return out;
+}
+static std::string EscapeCSVString(const std::string& string)
+{
+	if (string.find_first_of(",\"\n") == std::string::npos)
+		return string;
+
+	std::string out = "\"";
+	for (char ch : string)
+	{
+		if (ch == '"')
+			out += '"';
+		out += ch;
+	}
+	out += '"';
+
+	return out;
+}
+
+BenchmarkResults::Value::Value(const char* text)
+	: text(text), numeric(false)
+{
+}
+BenchmarkResults::Value::Value(const std::string& text)
+	: text(text), numeric(false)
+{
+}
+BenchmarkResults::Value::Value(double value)
+	: numeric(std::isfinite(value))
+{
+	char buffer[64];
+	snprintf(buffer, sizeof(buffer), "%.6g", value);
+	text = buffer;
+}
+BenchmarkResults::Value::Value(uint64 value)
+	: text(std::to_string(value)), numeric(true)
+{
+}
+BenchmarkResults::Value::Value(uint32 value)
+	: text(std::to_string(value)), numeric(true)
+{
+}
+BenchmarkResults::Value::Value(int value)
+	: text(std::to_string(value)), numeric(true)
+{
+}
+
+BenchmarkResults::BenchmarkResults(std::vector<std::string> columns)
+	: columns(std::move(columns)), failed(false)
+{
+}
+void BenchmarkResults::AddRow(std::vector<Value> row)
+{
+	if (row.size() != columns.size())
+	{
+		Debug::Logger::LogError("SPH Benchmark", "Benchmark result row has a different number of values than there are columns");
+		return;
+	}
+
+	rows.push_back(std::move(row));
+}
+bool BenchmarkResults::WriteToFile(const std::string& path) const
+{
+	bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+	std::string content = json ? ToJSON() : ToCSV();
+
+	FILE* file = fopen(path.c_str(), "wb");
+
+	if (file == nullptr)
+	{
+		Debug::Logger::LogError("SPH Benchmark", "Failed to open output file \"" + StringView(path.data(), path.size()) + "\"");
+		return false;
+	}
+
+	fwrite(content.data(), 1, content.size(), file);
+	fclose(file);
+
+	return true;
+}
+void BenchmarkResults::Print() const
+{
+	std::vector<uintMem> widths(columns.size());
+
+	for (uintMem i = 0; i < columns.size(); ++i)
+	{
+		widths[i] = columns[i].size();
+		for (auto& row : rows)
+			widths[i] = std::max(widths[i], row[i].text.size());
+	}
+
+	for (uintMem i = 0; i < columns.size(); ++i)
+		printf(i + 1 == columns.size() ? "%-*s\n" : "%-*s  ", (int)widths[i], columns[i].c_str());
+
+	for (auto& row : rows)
+	{
+		for (uintMem i = 0; i < columns.size(); ++i)
+		{
+			printf(row[i].numeric ? "%*s" : "%-*s", (int)widths[i], row[i].text.c_str());
+			printf(i + 1 == columns.size() ? "\n" : "  ");
+		}
+	}
+
+	fflush(stdout);
+}
+std::string BenchmarkResults::ToCSV() const
+{
+	std::string out;
+
+	for (uintMem i = 0; i < columns.size(); ++i)
+		out += (i == 0 ? "" : ",") + EscapeCSVString(columns[i]);
+	out += '\n';
+
+	for (auto& row : rows)
+	{
+		for (uintMem i = 0; i < columns.size(); ++i)
+			out += (i == 0 ? "" : ",") + EscapeCSVString(row[i].text);
+		out += '\n';
+	}
+
+	return out;
+}
+std::string BenchmarkResults::ToJSON() const
+{
+	std::string out = "[\n";
+
+	for (uintMem rowIndex = 0; rowIndex < rows.size(); ++rowIndex)
+	{
+		out += "  { ";
+		for (uintMem i = 0; i < columns.size(); ++i)
+		{
+			const Value& value = rows[rowIndex][i];
+			out += (i == 0 ? "" : ", ") + EscapeJSONString(columns[i]) + ": " + (value.numeric ? value.text : EscapeJSONString(value.text));
+		}
+		out += rowIndex + 1 == rows.size() ? " }\n" : " },\n";
+	}
+
+	out += "]\n";
+	return out;
+}
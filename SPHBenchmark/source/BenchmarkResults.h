@@ -0,0 +1,47 @@
+#pragma once
+
+/*
+	Table of benchmark measurements. Every row has a value for each column, numeric values are written
+	unquoted into JSON.
+*/
+class BenchmarkResults
+{
+public:
+	struct Value
+	{
+		std::string text;
+		bool numeric;
+
+		Value(const char* text);
+		Value(const std::string& text);
+		Value(double value);
+		Value(uint64 value);
+		Value(uint32 value);
+		Value(int value);
+	};
+
+	BenchmarkResults(std::vector<std::string> columns);
+
+	void AddRow(std::vector<Value> row);
+
+	/*
+		Marks the benchmark as failed, for example when a validation didn't pass. The program then exits
+		with a non-zero code after the results are written.
+	*/
+	inline void SetFailed() { failed = true; }
+	inline bool Failed() const { return failed; }
+
+	/*
+		Writes the results into a file. The format is chosen by the file extension, '.json' writes an
+		array of objects and anything else writes CSV.
+	*/
+	bool WriteToFile(const std::string& path) const;
+	void Print() const;
+
+	std::string ToCSV() const;
+	std::string ToJSON() const;
+private:
+	std::vector<std::string> columns;
+	std::vector<std::vector<Value>> rows;
+	bool failed;
+};
@@ -0,0 +1,145 @@
+#include "pch.h"
+#include "Benchmarks/Benchmarks.h"
+#include "SPH/Core/SceneBlueprint.h"
+#include "SPH/SimulationEngines/SimulationEngineCPU.h"
+#include "SPH/ParticleBufferManagers/OfflineCPUParticleBufferManager.h"
+#include <new>
+
+using namespace SPH;
+
+//The replaced global allocation functions below count the allocations of every thread while this is set
+static std::atomic_bool countAllocations = false;
+static std::atomic_uint64_t allocationCount = 0;
+
+static void* AllocateCounted(std::size_t size, std::size_t alignment)
+{
+	if (countAllocations.load(std::memory_order_relaxed))
+		allocationCount.fetch_add(1, std::memory_order_relaxed);
+
+	size = std::max<std::size_t>(size, 1);
+
+	void* ptr;
+	if (alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+		ptr = std::malloc(size);
+	else
+#ifdef _WIN32
+		ptr = _aligned_malloc(size, alignment);
+#else
+		ptr = std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+#endif
+
+	if (ptr == nullptr)
+		throw std::bad_alloc();
+
+	return ptr;
+}
+static void FreeCounted(void* ptr, std::size_t alignment)
+{
+#ifdef _WIN32
+	if (alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+	{
+		_aligned_free(ptr);
+		return;
+	}
+#endif
+	std::free(ptr);
+}
+
+void* operator new(std::size_t size) { return AllocateCounted(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__); }
+void* operator new(std::size_t size, std::align_val_t alignment) { return AllocateCounted(size, (std::size_t)alignment); }
+void operator delete(void* ptr) noexcept { FreeCounted(ptr, __STDCPP_DEFAULT_NEW_ALIGNMENT__); }
+void operator delete(void* ptr, std::size_t) noexcept { FreeCounted(ptr, __STDCPP_DEFAULT_NEW_ALIGNMENT__); }
+void operator delete(void* ptr, std::align_val_t alignment) noexcept { FreeCounted(ptr, (std::size_t)alignment); }
+void operator delete(void* ptr, std::size_t, std::align_val_t alignment) noexcept { FreeCounted(ptr, (std::size_t)alignment); }
+
+/*
+	Checks that the updates of the CPU engine don't allocate once it reached its steady state. The global operator new
+	is replaced in the benchmark and counts the allocations of all threads while the engine is updated. The engine is
+	updated 'warmupSteps' times before counting, because the per thread scratch arrays of the Verlet lists, the cell
+	blocked traversal and the half neighbourhood contributions only grow to the size a scene needs during its first
+	steps. Every configuration runs the scene with the engine parameters of the scene file and the parameters listed
+	next to it. A run fails when any allocation is counted.
+
+	Options:
+		--scene <path>            - scene file, required
+		--steps <n>               - counted simulation steps, default 20
+		--warmupSteps <n>         - simulation steps before counting, default 5
+		--threads <n,m,...>       - thread counts, default 1 and the hardware thread count
+		--deltaTime <x>           - time step, default 0.01
+*/
+BenchmarkResults RunAllocationBenchmark(const CommandLineArguments& arguments)
+{
+	BenchmarkResults results{ { "configuration", "threadCount", "steps", "allocations", "allocationsPerStep", "validation" } };
+
+	std::string scenePath = arguments.Get("scene", "");
+	uintMem steps = std::max<uint64>(1, arguments.GetUInt("steps", 20));
+	uintMem warmupSteps = arguments.GetUInt("warmupSteps", 5);
+	std::vector<uint64> threadCounts = arguments.GetUIntList("threads", { 1, std::max(1u, std::thread::hardware_concurrency()) });
+	float deltaTime = (float)arguments.GetDouble("deltaTime", 0.01);
+
+	struct Configuration
+	{
+		const char* name;
+		std::vector<std::pair<const char*, const char*>> parameters;
+	};
+	const Configuration configurations[]{
+		{ "scene", { } },
+		{ "structOfArrays", { { "structOfArrays", "true" } } },
+		{ "sortParticles", { { "sortParticles", "true" }, { "incrementalSort", "true" } } },
+		{ "adaptiveReorder", { { "adaptiveReorder", "true" } } },
+		{ "verletLists", { { "verletLists", "true" } } },
+		{ "halfNeighbourhood", { { "structOfArrays", "true" }, { "halfNeighbourhood", "true" } } },
+		{ "cellBlocked", { { "structOfArrays", "true" }, { "cellBlockedNeighbours", "true" } } },
+		{ "dynamicScheduling", { { "structOfArrays", "true" }, { "dynamicScheduling", "true" } } },
+		{ "integrityCheck", { { "integrityCheckInterval", "1" } } },
+	};
+
+	for (const Configuration& configuration : configurations)
+		for (uint64 threadCount : threadCounts)
+		{
+			threadCount = std::max<uint64>(1, threadCount);
+
+			SceneBlueprint scene;
+			if (scenePath.empty() || !scene.LoadScene(Path(scenePath.c_str())))
+			{
+				Debug::Logger::LogError("SPH Benchmark", "The allocation benchmark needs a valid scene file given with \"--scene\"");
+				results.SetFailed();
+				return results;
+			}
+
+			for (auto& [name, value] : configuration.parameters)
+				scene.SetOtherParameter(name, value);
+
+			OfflineCPUParticleBufferManager dynamicParticlesBufferManager;
+			OfflineCPUParticleBufferManager staticParticlesBufferManager;
+
+			SimulationEngineCPU engine{ threadCount };
+			engine.Initialize(scene, dynamicParticlesBufferManager, staticParticlesBufferManager);
+			engine.FinishUpdates();
+
+			for (uintMem i = 0; i < warmupSteps; ++i)
+			{
+				engine.Update(deltaTime, 1);
+				engine.FinishUpdates();
+			}
+
+			allocationCount = 0;
+			countAllocations = true;
+
+			for (uintMem i = 0; i < steps; ++i)
+			{
+				engine.Update(deltaTime, 1);
+				engine.FinishUpdates();
+			}
+
+			countAllocations = false;
+			uint64 allocations = allocationCount;
+
+			if (allocations != 0)
+				results.SetFailed();
+
+			results.AddRow({ configuration.name, threadCount, (uint64)steps, allocations, (double)allocations / steps, allocations == 0 ? "passed" : "failed" });
+		}
+
+	return results;
+}
\ No newline at end of file
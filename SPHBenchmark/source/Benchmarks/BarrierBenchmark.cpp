@@ -0,0 +1,98 @@
+#include "pch.h"
+#include "Benchmarks/Benchmarks.h"
+#include "SPH/Concurrency/ThreadParallelTaskManager.h"
+
+using namespace SPH;
+
+struct BarrierBenchmarkTask
+{
+	uintMem iterations;
+	double* elapsedSeconds;
+};
+
+static void BarrierBenchmarkTaskFunction(const ThreadContext& context, BarrierBenchmarkTask& task)
+{
+	//Make sure all threads have picked up the task before starting the measurement
+	context.SyncThreads();
+
+	auto start = std::chrono::steady_clock::now();
+
+	for (uintMem i = 0; i < task.iterations; ++i)
+		context.SyncThreads();
+
+	if (context.GetThreadIndex() == 0)
+		*task.elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static double MeasureBarrierLatency(ThreadParallelTaskManager& threadManager, uintMem iterations)
+{
+	double elapsedSeconds = 0;
+
+	threadManager.EnqueueTask(BarrierBenchmarkTaskFunction, BarrierBenchmarkTask{
+		.iterations = iterations,
+		.elapsedSeconds = &elapsedSeconds
+		});
+	threadManager.FinishTasks();
+
+	return elapsedSeconds / iterations;
+}
+
+/*
+	Measures the average time of ThreadContext::SyncThreads() for every barrier type and thread count.
+
+	Options:
+		--threads <list>     - comma separated thread counts, defaults to powers of two up to the hardware thread count
+		--iterations <n>     - barriers per measurement, default 100000
+		--repetitions <n>    - the best of this many measurements is reported, default 5
+*/
+BenchmarkResults RunBarrierBenchmark(const CommandLineArguments& arguments)
+{
+	uintMem hardwareThreadCount = std::max(1u, std::thread::hardware_concurrency());
+
+	std::vector<uint64> defaultThreadCounts;
+	for (uintMem threadCount = 1; threadCount < hardwareThreadCount; threadCount *= 2)
+		defaultThreadCounts.push_back(threadCount);
+	defaultThreadCounts.push_back(hardwareThreadCount);
+
+	std::vector<uint64> threadCounts = arguments.GetUIntList("threads", defaultThreadCounts);
+	uintMem iterations = std::max<uint64>(1, arguments.GetUInt("iterations", 100000));
+	uintMem repetitions = std::max<uint64>(1, arguments.GetUInt("repetitions", 5));
+
+	struct BarrierTypeInfo
+	{
+		ThreadBarrierType type;
+		const char* name;
+	};
+	BarrierTypeInfo barrierTypes[]{
+		{ ThreadBarrierType::ConditionVariable, "conditionVariable" },
+		{ ThreadBarrierType::SpinAndWait, "spinAndWait" },
+	};
+
+	BenchmarkResults results{ { "barrierType", "threadCount", "iterations", "bestNanosecondsPerBarrier", "meanNanosecondsPerBarrier" } };
+
+	for (uint64 threadCount : threadCounts)
+	{
+		for (auto& barrierType : barrierTypes)
+		{
+			ThreadParallelTaskManager threadManager;
+			threadManager.AllocateThreads(threadCount);
+			threadManager.SetBarrierType(barrierType.type);
+
+			//Warm up, the threads might not be running yet
+			MeasureBarrierLatency(threadManager, std::min<uintMem>(iterations, 1000));
+
+			double bestLatency = DBL_MAX;
+			double latencySum = 0;
+			for (uintMem i = 0; i < repetitions; ++i)
+			{
+				double latency = MeasureBarrierLatency(threadManager, iterations);
+				bestLatency = std::min(bestLatency, latency);
+				latencySum += latency;
+			}
+
+			results.AddRow({ barrierType.name, threadCount, (uint64)iterations, bestLatency * 1e9, latencySum / repetitions * 1e9 });
+		}
+	}
+
+	return results;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include "CommandLineArguments.h"
+#include "BenchmarkResults.h"
+
+/*
+	Each benchmark reads its options from the command line arguments and returns a table with its measurements
+*/
+
+BenchmarkResults RunSceneBenchmark(const CommandLineArguments& arguments);
+BenchmarkResults RunBarrierBenchmark(const CommandLineArguments& arguments);
+BenchmarkResults RunKernelBenchmark(const CommandLineArguments& arguments);
+BenchmarkResults RunNeighbourGridBenchmark(const CommandLineArguments& arguments);
+BenchmarkResults RunHalfNeighbourhoodBenchmark(const CommandLineArguments& arguments);
+BenchmarkResults RunVerletListBenchmark(const CommandLineArguments& arguments);
+BenchmarkResults RunIntegrityCheckBenchmark(const CommandLineArguments& arguments);
+BenchmarkResults RunPrefixSumBenchmark(const CommandLineArguments& arguments);
+BenchmarkResults RunHashHistogramBenchmark(const CommandLineArguments& arguments);
+BenchmarkResults RunParticleSortBenchmark(const CommandLineArguments& arguments);
+BenchmarkResults RunReorderScheduleBenchmark(const CommandLineArguments& arguments);
+BenchmarkResults RunCellBlockedBenchmark(const CommandLineArguments& arguments);
+BenchmarkResults RunDynamicSchedulingBenchmark(const CommandLineArguments& arguments);
+BenchmarkResults RunThreadAffinityBenchmark(const CommandLineArguments& arguments);
+BenchmarkResults RunPageSizeBenchmark(const CommandLineArguments& arguments);
+BenchmarkResults RunAllocationBenchmark(const CommandLineArguments& arguments);
+BenchmarkResults RunGPUTilingBenchmark(const CommandLineArguments& arguments);
+BenchmarkResults RunGPUSortBenchmark(const CommandLineArguments& arguments);
+BenchmarkResults RunGPUProgramCacheBenchmark(const CommandLineArguments& arguments);
\ No newline at end of file
@@ -0,0 +1,98 @@
+#include "pch.h"
+#include "Benchmarks/Benchmarks.h"
+#include "Benchmarks/SceneRun.h"
+
+using namespace SPH;
+
+/*
+	Runs a scene with the particles evaluated one by one with the scalar and the vectorized functions and cell by cell
+	with the cell blocked traversal, for every thread count. Besides the step time the neighbour candidates per particle after
+	the last step are reported, which the one by one traversal loads through the particle map for every particle and
+	the cell blocked traversal once per cell. It gives the same results as the scalar functions on one
+	thread, which is checked for a few steps, the benchmark fails otherwise. The dynamic particles are put into the
+	StructOfArrays layout and the Verlet lists and the half neighbourhood traversal are turned off.
+
+	Options:
+		--scene <path>            - scene file, required
+		--steps <n>               - timed simulation steps, default 20
+		--threads <n,m,...>       - thread counts, default 1 and the hardware thread count
+		--deltaTime <x>           - time step, default 0.01
+		--validationSteps <n>     - steps compared with the scalar functions, default 10
+*/
+BenchmarkResults RunCellBlockedBenchmark(const CommandLineArguments& arguments)
+{
+	BenchmarkResults results{ { "traversal", "threadCount", "steps", "bestMillisecondsPerStep", "meanMillisecondsPerStep", "speedup", "candidatesPerParticle", "validationError", "validation" } };
+
+	std::string scenePath = arguments.Get("scene", "");
+	uintMem steps = std::max<uint64>(1, arguments.GetUInt("steps", 20));
+	std::vector<uint64> threadCounts = arguments.GetUIntList("threads", { 1, std::max(1u, std::thread::hardware_concurrency()) });
+	float deltaTime = (float)arguments.GetDouble("deltaTime", 0.01);
+	uintMem validationSteps = std::max<uint64>(1, arguments.GetUInt("validationSteps", 10));
+
+	SceneBlueprint scene;
+	if (scenePath.empty() || !scene.LoadScene(Path(scenePath.c_str())))
+	{
+		Debug::Logger::LogError("SPH Benchmark", "The cell blocked benchmark needs a valid scene file given with \"--scene\"");
+		results.SetFailed();
+		return results;
+	}
+
+	scene.SetOtherParameter("structOfArrays", "true");
+	scene.SetOtherParameter("verletLists", "false");
+	scene.SetOtherParameter("halfNeighbourhood", "false");
+
+	auto useScalar = [](SimulationEngineCPU& engine) { engine.SetInstructionSet(CPUInstructionSet::Scalar); };
+
+	scene.SetOtherParameter("cellBlockedNeighbours", "false");
+	SceneRunResult validationReference = RunSceneCPU(scene, 1, validationSteps, deltaTime, useScalar);
+
+	scene.SetOtherParameter("cellBlockedNeighbours", "true");
+	double validationError = MaxParticleError(RunSceneCPU(scene, 1, validationSteps, deltaTime).particles, validationReference.particles);
+
+	if (validationError != 0)
+		results.SetFailed();
+
+	struct Traversal
+	{
+		const char* name;
+		bool cellBlocked;
+		bool scalar;
+	};
+	const Traversal traversals[]{
+		{ "scalar", false, true },
+		{ "instructionSet", false, false },
+		{ "cellBlocked", true, false },
+	};
+
+	for (uint64 threadCount : threadCounts)
+	{
+		threadCount = std::max<uint64>(1, threadCount);
+
+		double referenceSecondsPerStep = 0;
+
+		for (const Traversal& traversal : traversals)
+		{
+			scene.SetOtherParameter("cellBlockedNeighbours", traversal.cellBlocked ? "true" : "false");
+
+			NeighbourSearchStatistics statistics;
+			SceneRunResult run = RunSceneCPU(scene, threadCount, steps, deltaTime, traversal.scalar ? useScalar : std::function<void(SimulationEngineCPU&)>(), [&](SimulationEngineCPU& engine) { statistics = engine.ComputeNeighbourSearchStatistics(); });
+
+			if (referenceSecondsPerStep == 0)
+				referenceSecondsPerStep = run.meanSecondsPerStep;
+
+			results.AddRow({
+				traversal.name,
+				threadCount,
+				(uint64)steps,
+				run.bestSecondsPerStep * 1e3,
+				run.meanSecondsPerStep * 1e3,
+				referenceSecondsPerStep / run.meanSecondsPerStep,
+				statistics.dynamicParticleCount == 0 ? 0.0 : (double)statistics.dynamicCandidateCount / statistics.dynamicParticleCount,
+				traversal.cellBlocked ? validationError : 0.0,
+				traversal.cellBlocked ? (validationError == 0 ? "passed" : "failed") : "reference"
+				});
+		}
+	}
+
+	return results;
+}
\ No newline at end of file
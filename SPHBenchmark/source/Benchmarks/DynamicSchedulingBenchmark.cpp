@@ -0,0 +1,100 @@
+#include "pch.h"
+#include "Benchmarks/Benchmarks.h"
+#include "Benchmarks/SceneRun.h"
+
+using namespace SPH;
+
+/*
+	Runs a scene with the pressure and dynamics passes split statically between the threads and scheduled dynamically
+	with every chunk size, for every thread count. Besides the step time the work of the threads in the two passes is
+	reported from the ParallelForStatistics of the dynamically scheduled runs: the busiest thread relative to the mean,
+	the fraction of the time the threads spent idle waiting for the slowest one and the chunks taken from other threads
+	per step. Each run is compared with the statically split one, which must give the same particles. The particles are
+	sorted every step, so they are in the same order in every run, the order of the particles of a bucket of the hash
+	map built with atomics would differ between the runs with more than one thread.
+
+	Options:
+		--scene <path>            - scene file, required
+		--steps <n>               - timed simulation steps, default 20
+		--threads <n,m,...>       - thread counts, default 1 and the hardware thread count
+		--chunkSizes <n,m,...>    - particles per chunk, default 16, 64 and 256
+		--deltaTime <x>           - time step, default 0.01
+		--tolerance <x>           - largest allowed error relative to max(1, |static value|), default 1e-5
+*/
+BenchmarkResults RunDynamicSchedulingBenchmark(const CommandLineArguments& arguments)
+{
+	BenchmarkResults results{ { "scheduling", "threadCount", "chunkSize", "steps", "bestMillisecondsPerStep", "meanMillisecondsPerStep", "speedup", "busyImbalance", "idleFraction", "stolenChunksPerStep", "validationError", "validation" } };
+
+	std::string scenePath = arguments.Get("scene", "");
+	uintMem steps = std::max<uint64>(1, arguments.GetUInt("steps", 20));
+	std::vector<uint64> threadCounts = arguments.GetUIntList("threads", { 1, std::max(1u, std::thread::hardware_concurrency()) });
+	std::vector<uint64> chunkSizes = arguments.GetUIntList("chunkSizes", { 16, 64, 256 });
+	float deltaTime = (float)arguments.GetDouble("deltaTime", 0.01);
+	double tolerance = arguments.GetDouble("tolerance", 1e-5);
+
+	SceneBlueprint scene;
+	if (scenePath.empty() || !scene.LoadScene(Path(scenePath.c_str())))
+	{
+		Debug::Logger::LogError("SPH Benchmark", "The dynamic scheduling benchmark needs a valid scene file given with \"--scene\"");
+		results.SetFailed();
+		return results;
+	}
+
+	scene.SetOtherParameter("sortParticles", "true");
+
+	for (uint64 threadCount : threadCounts)
+	{
+		threadCount = std::max<uint64>(1, threadCount);
+
+		scene.SetOtherParameter("dynamicScheduling", "false");
+		SceneRunResult staticRun = RunSceneCPU(scene, threadCount, steps, deltaTime);
+
+		results.AddRow({ "static", threadCount, (uint64)0, (uint64)steps, staticRun.bestSecondsPerStep * 1e3, staticRun.meanSecondsPerStep * 1e3, 1.0, 0.0, 0.0, 0.0, 0.0, "reference" });
+
+		for (uint64 chunkSize : chunkSizes)
+		{
+			scene.SetOtherParameter("dynamicScheduling", "true");
+			scene.SetOtherParameter("dynamicSchedulingChunkSize", std::to_string(chunkSize).c_str());
+
+			ParallelForStatistics statistics;
+			SceneRunResult dynamicRun = RunSceneCPU(scene, threadCount, steps, deltaTime, { }, [&](SimulationEngineCPU& engine) {
+				statistics = engine.GetParallelForStatistics();
+				});
+
+			double busySum = 0;
+			double busyMax = 0;
+			double idleSum = 0;
+			uint64 stolenChunkCount = 0;
+			for (uintMem i = 0; i < statistics.threadBusySeconds.Count(); ++i)
+			{
+				busySum += statistics.threadBusySeconds[i];
+				busyMax = std::max(busyMax, statistics.threadBusySeconds[i]);
+				idleSum += statistics.threadIdleSeconds[i];
+				stolenChunkCount += statistics.threadStolenChunkCount[i];
+			}
+
+			double busyMean = statistics.threadBusySeconds.Empty() ? 0 : busySum / statistics.threadBusySeconds.Count();
+			double validationError = MaxParticleError(dynamicRun.particles, staticRun.particles);
+
+			if (validationError > tolerance)
+				results.SetFailed();
+
+			results.AddRow({
+				"dynamic",
+				threadCount,
+				chunkSize,
+				(uint64)steps,
+				dynamicRun.bestSecondsPerStep * 1e3,
+				dynamicRun.meanSecondsPerStep * 1e3,
+				staticRun.meanSecondsPerStep / dynamicRun.meanSecondsPerStep,
+				busyMean == 0 ? 1.0 : busyMax / busyMean,
+				busySum + idleSum == 0 ? 0.0 : idleSum / (busySum + idleSum),
+				(double)stolenChunkCount / steps,
+				validationError,
+				validationError <= tolerance ? "passed" : "failed"
+				});
+		}
+	}
+
+	return results;
+}
\ No newline at end of file
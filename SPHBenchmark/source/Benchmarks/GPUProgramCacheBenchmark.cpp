@@ -0,0 +1,62 @@
+#include "pch.h"
+#include "Benchmarks/Benchmarks.h"
+#include "SPH/OpenCL/OpenCLContext.h"
+#include "SPH/SimulationEngines/SimulationEngineGPUKernels.h"
+#include "CL/cl.h"
+#include <filesystem>
+
+using namespace SPH;
+
+/*
+	Measures the startup cost of the GPU engine kernels with and without the program cache, see
+	SimulationEngineGPUKernels::ProgramCacheDirectory. The cache directory is removed first, so the first load builds
+	the program from the source and stores its binary, the following loads create it from the binary. The speedup is
+	the time of the build from the source over the time of the load. The benchmark fails when there is no OpenCL device
+	or a load after the first one isn't served by the cache.
+
+	Options:
+		--loads <n>               - loads from the cache, default 3
+*/
+BenchmarkResults RunGPUProgramCacheBenchmark(const CommandLineArguments& arguments)
+{
+	BenchmarkResults results{ { "load", "fromCache", "milliseconds", "speedup" } };
+
+	uintMem loadCount = std::max<uint64>(1, arguments.GetUInt("loads", 3));
+
+	OpenCLContext clContext;
+	if (clContext.context == nullptr)
+	{
+		Debug::Logger::LogError("SPH Benchmark", "The GPU program cache benchmark needs an OpenCL device");
+		results.SetFailed();
+		return results;
+	}
+
+	std::error_code error;
+	std::filesystem::remove_all(SimulationEngineGPUKernels::ProgramCacheDirectory, error);
+
+	double sourceBuildSeconds = 0;
+
+	for (uintMem i = 0; i < loadCount + 1; ++i)
+	{
+		ProgramLoadStatistics statistics;
+		{
+			SimulationEngineGPUKernels kernels{ clContext.context, clContext.device };
+			statistics = kernels.GetProgramLoadStatistics();
+		}
+
+		if (i == 0)
+			sourceBuildSeconds = statistics.loadSeconds;
+
+		if (statistics.loadedFromCache != (i != 0))
+			results.SetFailed();
+
+		results.AddRow({
+			i == 0 ? std::string("source") : "cached " + std::to_string(i),
+			statistics.loadedFromCache ? "yes" : "no",
+			statistics.loadSeconds * 1e3,
+			statistics.loadSeconds != 0 ? sourceBuildSeconds / statistics.loadSeconds : 0.0
+			});
+	}
+
+	return results;
+}
\ No newline at end of file
@@ -0,0 +1,93 @@
+#include "pch.h"
+#include "Benchmarks/Benchmarks.h"
+#include "Benchmarks/SceneRun.h"
+#include "CL/cl.h"
+
+using namespace SPH;
+
+static BenchmarkResults::Value PhaseMillisecondsPerStep(const SimulationStatistics& statistics, StringView phaseName)
+{
+	for (auto& phase : statistics.phases)
+		if (phase.name == phaseName && statistics.stepCount != 0)
+			return phase.MaxThreadSeconds() / statistics.stepCount * 1e3;
+
+	return "-";
+}
+
+/*
+	Runs a scene with the GPU engine with the hash map built by atomic counting and scattering and with the particles
+	sorted by the radix sort, see the "radixSort" parameter of SimulationEngineGPU. Each of them is run twice for the
+	checked steps with an integrity check after every step, and the two runs are compared particle by particle, then
+	the steps are timed in a third run. The radix sort keeps the particles of a bucket in a fixed order, so both of its
+	runs must be identical. The atomics put them in the order they happen to run in, so their difference is only
+	reported. The sort column has the execution time of the sort kernels per step when the engine is compiled with
+	PROFILE_PHASES_GPU, "-" otherwise. The benchmark fails when there is no OpenCL device, the radix sort runs differ or
+	an integrity check finds an invalid hash map.
+
+	Options:
+		--scene <path>            - scene file, required
+		--checkSteps <n>          - steps run before the runs are compared, default 20
+		--steps <n>               - timed simulation steps, default 50
+		--deltaTime <x>           - time step, default 0.01
+*/
+BenchmarkResults RunGPUSortBenchmark(const CommandLineArguments& arguments)
+{
+	BenchmarkResults results{ { "hashMap", "particleCount", "steps", "bestMillisecondsPerStep", "meanMillisecondsPerStep", "sortMilliseconds", "integrityErrors", "runDifference", "reproducible" } };
+
+	std::string scenePath = arguments.Get("scene", "");
+	uintMem checkSteps = std::max<uint64>(1, arguments.GetUInt("checkSteps", 20));
+	uintMem steps = std::max<uint64>(1, arguments.GetUInt("steps", 50));
+	float deltaTime = (float)arguments.GetDouble("deltaTime", 0.01);
+
+	SceneBlueprint scene;
+	if (scenePath.empty() || !scene.LoadScene(Path(scenePath.c_str())))
+	{
+		Debug::Logger::LogError("SPH Benchmark", "The GPU sort benchmark needs a valid scene file given with \"--scene\"");
+		results.SetFailed();
+		return results;
+	}
+
+	OpenCLContext clContext;
+	if (clContext.context == nullptr)
+	{
+		Debug::Logger::LogError("SPH Benchmark", "The GPU sort benchmark needs an OpenCL device");
+		results.SetFailed();
+		return results;
+	}
+
+	cl_command_queue clCommandQueue = clContext.GetCommandQueue(true, true);
+
+	for (bool radixSort : { false, true })
+	{
+		scene.SetOtherParameter("radixSort", radixSort ? "true" : "false");
+
+		scene.SetOtherParameter("integrityCheckInterval", "1");
+		GPUSceneRunResult firstRun = RunSceneGPU(scene, clContext, clCommandQueue, checkSteps, 0, deltaTime);
+		GPUSceneRunResult secondRun = RunSceneGPU(scene, clContext, clCommandQueue, checkSteps, 0, deltaTime);
+
+		scene.SetOtherParameter("integrityCheckInterval", "0");
+		GPUSceneRunResult timedRun = RunSceneGPU(scene, clContext, clCommandQueue, 1, steps, deltaTime);
+
+		uint64 integrityErrorCount = firstRun.integrityCheckStatistics.errorCount + secondRun.integrityCheckStatistics.errorCount;
+		double runDifference = MaxParticleError(secondRun.particles, firstRun.particles);
+
+		if (integrityErrorCount != 0 || (radixSort && runDifference != 0))
+			results.SetFailed();
+
+		results.AddRow({
+			radixSort ? "radixSort" : "atomics",
+			(uint64)timedRun.particles.Count(),
+			(uint64)steps,
+			timedRun.bestSecondsPerStep * 1e3,
+			timedRun.meanSecondsPerStep * 1e3,
+			PhaseMillisecondsPerStep(timedRun.statistics, "sort"),
+			integrityErrorCount,
+			runDifference,
+			runDifference == 0 ? "yes" : "no"
+			});
+	}
+
+	clReleaseCommandQueue(clCommandQueue);
+
+	return results;
+}
\ No newline at end of file
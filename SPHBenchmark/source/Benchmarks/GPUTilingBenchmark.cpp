@@ -0,0 +1,149 @@
+#include "pch.h"
+#include "Benchmarks/Benchmarks.h"
+#include "Benchmarks/SceneRun.h"
+#include "SPH/SimulationEngines/SimulationEngineGPU.h"
+#include "CL/cl.h"
+
+using namespace SPH;
+
+//The GPU engine puts the particles of a bucket in the order its atomics happen to run in, so two runs of the same scene
+//don't keep the particles at the same indices. Every particle is matched with the nearest reference particle instead,
+//'maxDistance' is far below the particle spacing. Particles without a match are their own reference, their count is
+//returned
+static uintMem MatchReferenceParticles(const Array<DynamicParticle>& particles, const Array<DynamicParticle>& referenceParticles, float maxDistance, Array<DynamicParticle>& matched)
+{
+	Array<uint32> order{ referenceParticles.Count() };
+	for (uintMem i = 0; i < order.Count(); ++i)
+		order[i] = (uint32)i;
+	std::sort(order.Ptr(), order.Ptr() + order.Count(), [&](uint32 a, uint32 b) {
+		return referenceParticles[a].position.x < referenceParticles[b].position.x;
+		});
+
+	uintMem unmatchedCount = 0;
+	matched.Resize(particles.Count());
+	for (uintMem i = 0; i < particles.Count(); ++i)
+	{
+		Vec3f position = particles[i].position;
+
+		uint32* it = std::lower_bound(order.Ptr(), order.Ptr() + order.Count(), position.x - maxDistance, [&](uint32 index, float x) {
+			return referenceParticles[index].position.x < x;
+			});
+
+		float bestDistanceSqr = maxDistance * maxDistance;
+		const DynamicParticle* best = nullptr;
+		for (; it != order.Ptr() + order.Count() && referenceParticles[*it].position.x <= position.x + maxDistance; ++it)
+		{
+			Vec3f dir = referenceParticles[*it].position - position;
+			float distanceSqr = dir.DotProduct(dir);
+
+			if (distanceSqr <= bestDistanceSqr)
+			{
+				bestDistanceSqr = distanceSqr;
+				best = &referenceParticles[*it];
+			}
+		}
+
+		if (best != nullptr)
+			matched[i] = *best;
+		else
+		{
+			matched[i] = particles[i];
+			++unmatchedCount;
+		}
+	}
+
+	return unmatchedCount;
+}
+
+static BenchmarkResults::Value KernelMillisecondsPerStep(const SimulationStatistics& statistics, StringView phaseName)
+{
+	for (auto& phase : statistics.phases)
+		if (phase.name == phaseName && phase.callCount != 0)
+			return phase.MaxThreadSeconds() / phase.callCount * 1e3;
+
+	return "-";
+}
+
+/*
+	Runs a scene with the GPU engine with the per particle pressure and dynamics kernels and with the tiled ones that
+	stage the neighbours in local memory, see the "localMemoryTiling" parameter of SimulationEngineGPU. Both runs are
+	first compared after the checked steps, the tiled particles against the untiled ones, then the steps are timed.
+	The kernel columns have the kernel execution times per step when the engine is compiled with PROFILE_PHASES_GPU,
+	"-" otherwise. The benchmark fails when there is no OpenCL device, the error is above the tolerance or a scene
+	with "integrityCheckInterval" finds an invalid hash map.
+
+	Options:
+		--scene <path>            - scene file, required
+		--checkSteps <n>          - steps run before the particles are compared, default 1. The simulation is chaotic,
+		                            so the different summation orders grow apart with more steps
+		--steps <n>               - timed simulation steps, default 50
+		--deltaTime <x>           - time step, default 0.01
+		--tolerance <x>           - largest allowed error, relative to values larger than 1, default 0.001
+*/
+BenchmarkResults RunGPUTilingBenchmark(const CommandLineArguments& arguments)
+{
+	BenchmarkResults results{ { "tiling", "particleCount", "steps", "bestMillisecondsPerStep", "meanMillisecondsPerStep", "occupiedBucketsMilliseconds", "pressureMilliseconds", "dynamicsMilliseconds", "maxErrorAgainstUntiled" } };
+
+	std::string scenePath = arguments.Get("scene", "");
+	uintMem checkSteps = std::max<uint64>(1, arguments.GetUInt("checkSteps", 1));
+	uintMem steps = std::max<uint64>(1, arguments.GetUInt("steps", 50));
+	float deltaTime = (float)arguments.GetDouble("deltaTime", 0.01);
+	double tolerance = arguments.GetDouble("tolerance", 0.001);
+
+	SceneBlueprint scene;
+	if (scenePath.empty() || !scene.LoadScene(Path(scenePath.c_str())))
+	{
+		Debug::Logger::LogError("SPH Benchmark", "The GPU tiling benchmark needs a valid scene file given with \"--scene\"");
+		results.SetFailed();
+		return results;
+	}
+
+	OpenCLContext clContext;
+	if (clContext.context == nullptr)
+	{
+		Debug::Logger::LogError("SPH Benchmark", "The GPU tiling benchmark needs an OpenCL device");
+		results.SetFailed();
+		return results;
+	}
+
+	cl_command_queue clCommandQueue = clContext.GetCommandQueue(true, true);
+
+	scene.SetOtherParameter("localMemoryTiling", "false");
+	GPUSceneRunResult untiledRun = RunSceneGPU(scene, clContext, clCommandQueue, checkSteps, steps, deltaTime);
+
+	scene.SetOtherParameter("localMemoryTiling", "true");
+	GPUSceneRunResult tiledRun = RunSceneGPU(scene, clContext, clCommandQueue, checkSteps, steps, deltaTime);
+
+	clReleaseCommandQueue(clCommandQueue);
+
+	float maxMatchDistance = scene.GetSystemParameters().particleBehaviourParameters.maxInteractionDistance * 0.01f;
+	Array<DynamicParticle> referenceParticles;
+	uintMem unmatchedCount = MatchReferenceParticles(tiledRun.particles, untiledRun.particles, maxMatchDistance, referenceParticles);
+	double maxError = MaxParticleError(tiledRun.particles, referenceParticles);
+
+	if (unmatchedCount != 0 || maxError > tolerance)
+	{
+		Debug::Logger::LogError("SPH Benchmark", "The tiled GPU kernels don't match the untiled ones");
+		results.SetFailed();
+	}
+
+	for (const GPUSceneRunResult* run : { &untiledRun, &tiledRun })
+	{
+		if (run->integrityCheckStatistics.errorCount != 0)
+			results.SetFailed();
+
+		results.AddRow({
+			run == &tiledRun ? "on" : "off",
+			(uint64)run->particles.Count(),
+			(uint64)steps,
+			run->bestSecondsPerStep * 1e3,
+			run->meanSecondsPerStep * 1e3,
+			KernelMillisecondsPerStep(run->statistics, "occupiedBuckets"),
+			KernelMillisecondsPerStep(run->statistics, "pressure"),
+			KernelMillisecondsPerStep(run->statistics, "dynamics"),
+			run == &tiledRun ? maxError : 0.0
+			});
+	}
+
+	return results;
+}
\ No newline at end of file
@@ -0,0 +1,115 @@
+#include "pch.h"
+#include "Benchmarks/Benchmarks.h"
+#include "Benchmarks/SceneRun.h"
+
+using namespace SPH;
+
+/*
+	Runs a scene with the full and with the half neighbourhood traversal of the dynamic particles and counts the
+	dynamic particle distance evaluations of each after the last step. The half traversal visits every pair once so it
+	should need about half of them. The half traversal is scalar, so the full traversal is timed with the scalar
+	kernels and again with the best instruction set when the CPU supports a vectorized one. The half traversal is
+	first run for a few steps on one thread and compared with the full one, the benchmark fails if the difference is
+	larger than the tolerance. The dynamic particles are always in the StructOfArrays layout because the half
+	traversal is only implemented for it.
+
+	Options:
+		--scene <path>            - scene file, required
+		--steps <n>               - timed simulation steps, default 20
+		--threads <n>             - threads used for the timed runs, default the hardware thread count
+		--deltaTime <x>           - time step, default 0.01
+		--validationSteps <n>     - steps compared between the traversals, default 1
+		--tolerance <x>           - largest allowed error relative to max(1, |full traversal value|), default 1e-4
+*/
+BenchmarkResults RunHalfNeighbourhoodBenchmark(const CommandLineArguments& arguments)
+{
+	BenchmarkResults results{ { "traversal", "instructionSet", "threadCount", "steps", "bestMillisecondsPerStep", "meanMillisecondsPerStep", "speedup", "dynamicCandidatesPerParticle", "dynamicNeighboursPerParticle", "validationError", "validation" } };
+
+	std::string scenePath = arguments.Get("scene", "");
+	uintMem steps = std::max<uint64>(1, arguments.GetUInt("steps", 20));
+	uintMem threadCount = std::max<uint64>(1, arguments.GetUInt("threads", std::max(1u, std::thread::hardware_concurrency())));
+	float deltaTime = (float)arguments.GetDouble("deltaTime", 0.01);
+	uintMem validationSteps = std::max<uint64>(1, arguments.GetUInt("validationSteps", 1));
+	double tolerance = arguments.GetDouble("tolerance", 1e-4);
+
+	SceneBlueprint scene;
+	if (scenePath.empty() || !scene.LoadScene(Path(scenePath.c_str())))
+	{
+		Debug::Logger::LogError("SPH Benchmark", "The half neighbourhood benchmark needs a valid scene file given with \"--scene\"");
+		results.SetFailed();
+		return results;
+	}
+
+	scene.SetOtherParameter("structOfArrays", "true");
+
+	struct TraversalRun
+	{
+		bool halfNeighbourhood;
+		CPUInstructionSet instructionSet;
+		const char* instructionSetName;
+	};
+	std::vector<TraversalRun> traversalRuns{ { false, CPUInstructionSet::Scalar, "scalar" } };
+
+	switch (SimulationEngineCPU::GetBestSupportedInstructionSet())
+	{
+	case CPUInstructionSet::AVX2: traversalRuns.push_back({ false, CPUInstructionSet::AVX2, "avx2" }); break;
+	case CPUInstructionSet::AVX512: traversalRuns.push_back({ false, CPUInstructionSet::AVX512, "avx512" }); break;
+	default: break;
+	}
+
+	traversalRuns.push_back({ true, CPUInstructionSet::Scalar, "scalar" });
+
+	auto useInstructionSet = [](CPUInstructionSet instructionSet) {
+		return [instructionSet](SimulationEngineCPU& engine) { engine.SetInstructionSet(instructionSet); };
+		};
+
+	scene.SetOtherParameter("halfNeighbourhood", "false");
+	SceneRunResult validationReference = RunSceneCPU(scene, 1, validationSteps, deltaTime, useInstructionSet(CPUInstructionSet::Scalar));
+
+	double fullSecondsPerStep = 0;
+
+	for (auto& traversalRun : traversalRuns)
+	{
+		bool halfNeighbourhood = traversalRun.halfNeighbourhood;
+		scene.SetOtherParameter("halfNeighbourhood", halfNeighbourhood ? "true" : "false");
+
+		double validationError = 0;
+		//The vectorized kernels are validated by the kernels benchmark
+		const char* validation = traversalRun.instructionSet == CPUInstructionSet::Scalar ? "reference" : "-";
+
+		if (halfNeighbourhood)
+		{
+			validationError = MaxParticleError(RunSceneCPU(scene, 1, validationSteps, deltaTime).particles, validationReference.particles);
+			validation = validationError <= tolerance ? "passed" : "failed";
+
+			if (validationError > tolerance)
+				results.SetFailed();
+		}
+
+		NeighbourSearchStatistics statistics;
+		SceneRunResult run = RunSceneCPU(scene, threadCount, steps, deltaTime, useInstructionSet(traversalRun.instructionSet), [&](SimulationEngineCPU& engine) {
+			statistics = engine.ComputeNeighbourSearchStatistics();
+			});
+
+		if (!halfNeighbourhood && traversalRun.instructionSet == CPUInstructionSet::Scalar)
+			fullSecondsPerStep = run.meanSecondsPerStep;
+
+		double particleCount = (double)std::max<uint64>(1, statistics.dynamicParticleCount);
+
+		results.AddRow({
+			halfNeighbourhood ? "half" : "full",
+			traversalRun.instructionSetName,
+			(uint64)threadCount,
+			(uint64)steps,
+			run.bestSecondsPerStep * 1e3,
+			run.meanSecondsPerStep * 1e3,
+			fullSecondsPerStep / run.meanSecondsPerStep,
+			statistics.dynamicCandidateCount / particleCount,
+			statistics.dynamicNeighbourCount / particleCount,
+			validationError,
+			validation
+			});
+	}
+
+	return results;
+}
\ No newline at end of file
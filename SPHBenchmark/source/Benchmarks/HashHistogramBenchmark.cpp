@@ -0,0 +1,89 @@
+#include "pch.h"
+#include "Benchmarks/Benchmarks.h"
+#include "Benchmarks/SceneRun.h"
+
+using namespace SPH;
+
+/*
+	Runs a scene with the dynamic hash map built with atomics and then from the private hash histograms, for every
+	thread count. The hash map always has 2 buckets per particle, the dense grid is turned off. Besides the step time
+	the modelled memory traffic of one hash map rebuild is reported, counting 4 bytes for every hash map, histogram,
+	particle map and hash access and twice that for a read and write of the same value:
+
+		atomics    - clearing 4B, counting 12N, scan 12B, particle map 16N
+		histograms - counting 8N in the dynamics pass, merging 4TB + 4N + 4B, scan 12B, particle map 16N
+
+	for N particles, B buckets and T threads. The histograms save the clear pass and the second read of the hashes,
+	but the merge reads every histogram. Each thread count is first run for a few steps on one thread with both and
+	compared, the particles of a bucket are in a different order so the sums differ slightly.
+
+	Options:
+		--scene <path>            - scene file, required
+		--steps <n>               - timed simulation steps, default 20
+		--threads <n,m,...>       - thread counts, default 1 and the hardware thread count
+		--deltaTime <x>           - time step, default 0.01
+		--validationSteps <n>     - steps compared with the atomics, default 10
+		--tolerance <x>           - largest allowed error relative to max(1, |atomics value|), default 1e-3
+*/
+BenchmarkResults RunHashHistogramBenchmark(const CommandLineArguments& arguments)
+{
+	BenchmarkResults results{ { "hashMap", "threadCount", "steps", "bestMillisecondsPerStep", "meanMillisecondsPerStep", "speedup", "modelledMegabytesPerRebuild", "validationError", "validation" } };
+
+	std::string scenePath = arguments.Get("scene", "");
+	uintMem steps = std::max<uint64>(1, arguments.GetUInt("steps", 20));
+	std::vector<uint64> threadCounts = arguments.GetUIntList("threads", { 1, std::max(1u, std::thread::hardware_concurrency()) });
+	float deltaTime = (float)arguments.GetDouble("deltaTime", 0.01);
+	uintMem validationSteps = std::max<uint64>(1, arguments.GetUInt("validationSteps", 10));
+	double tolerance = arguments.GetDouble("tolerance", 1e-3);
+
+	SceneBlueprint scene;
+	if (scenePath.empty() || !scene.LoadScene(Path(scenePath.c_str())))
+	{
+		Debug::Logger::LogError("SPH Benchmark", "The hash histogram benchmark needs a valid scene file given with \"--scene\"");
+		results.SetFailed();
+		return results;
+	}
+
+	scene.SetOtherParameter("denseGrid", "false");
+
+	scene.SetOtherParameter("privateHashHistograms", "false");
+	SceneRunResult validationReference = RunSceneCPU(scene, 1, validationSteps, deltaTime);
+
+	scene.SetOtherParameter("privateHashHistograms", "true");
+	double validationError = MaxParticleError(RunSceneCPU(scene, 1, validationSteps, deltaTime).particles, validationReference.particles);
+
+	if (validationError > tolerance)
+		results.SetFailed();
+
+	double particleCount = (double)validationReference.particles.Count();
+	double bucketCount = particleCount * 2;
+
+	for (uint64 threadCount : threadCounts)
+	{
+		threadCount = std::max<uint64>(1, threadCount);
+
+		scene.SetOtherParameter("privateHashHistograms", "false");
+		SceneRunResult atomicsRun = RunSceneCPU(scene, threadCount, steps, deltaTime);
+
+		scene.SetOtherParameter("privateHashHistograms", "true");
+		SceneRunResult histogramsRun = RunSceneCPU(scene, threadCount, steps, deltaTime);
+
+		double atomicsBytes = 16 * bucketCount + 28 * particleCount;
+		double histogramsBytes = 16 * bucketCount + 4 * threadCount * bucketCount + 28 * particleCount;
+
+		results.AddRow({ "atomics", threadCount, (uint64)steps, atomicsRun.bestSecondsPerStep * 1e3, atomicsRun.meanSecondsPerStep * 1e3, 1.0, atomicsBytes / (1024.0 * 1024.0), 0.0, "reference" });
+		results.AddRow({
+			"histograms",
+			threadCount,
+			(uint64)steps,
+			histogramsRun.bestSecondsPerStep * 1e3,
+			histogramsRun.meanSecondsPerStep * 1e3,
+			atomicsRun.meanSecondsPerStep / histogramsRun.meanSecondsPerStep,
+			histogramsBytes / (1024.0 * 1024.0),
+			validationError,
+			validationError <= tolerance ? "passed" : "failed"
+			});
+	}
+
+	return results;
+}
\ No newline at end of file
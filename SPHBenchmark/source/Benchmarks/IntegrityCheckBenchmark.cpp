@@ -0,0 +1,72 @@
+#include "pch.h"
+#include "Benchmarks/Benchmarks.h"
+#include "Benchmarks/SceneRun.h"
+
+using namespace SPH;
+
+/*
+	Runs a scene with the integrity checks off and then checked after every n-th step for each interval. Checking every
+	step is what the engine always did before the checks could be turned off, so the speedup is relative to interval 1
+	and the overhead relative to the run without checks. The benchmark fails if a check finds an error.
+
+	Options:
+		--scene <path>            - scene file, required
+		--steps <n>               - timed simulation steps, default 20
+		--threads <n>             - threads used, default the hardware thread count
+		--deltaTime <x>           - time step, default 0.01
+		--intervals <n,m,...>     - checked step intervals, default 1,10,100
+*/
+BenchmarkResults RunIntegrityCheckBenchmark(const CommandLineArguments& arguments)
+{
+	BenchmarkResults results{ { "integrityCheckInterval", "threadCount", "steps", "bestMillisecondsPerStep", "meanMillisecondsPerStep", "speedupOverEveryStep", "overheadOverOff", "checkedStepCount", "errorCount" } };
+
+	std::string scenePath = arguments.Get("scene", "");
+	uintMem steps = std::max<uint64>(1, arguments.GetUInt("steps", 20));
+	uintMem threadCount = std::max<uint64>(1, arguments.GetUInt("threads", std::max(1u, std::thread::hardware_concurrency())));
+	float deltaTime = (float)arguments.GetDouble("deltaTime", 0.01);
+	std::vector<uint64> intervals = arguments.GetUIntList("intervals", { 1, 10, 100 });
+
+	SceneBlueprint scene;
+	if (scenePath.empty() || !scene.LoadScene(Path(scenePath.c_str())))
+	{
+		Debug::Logger::LogError("SPH Benchmark", "The integrity check benchmark needs a valid scene file given with \"--scene\"");
+		results.SetFailed();
+		return results;
+	}
+
+	scene.SetOtherParameter("integrityCheckInterval", "0");
+	SceneRunResult offRun = RunSceneCPU(scene, threadCount, steps, deltaTime);
+
+	scene.SetOtherParameter("integrityCheckInterval", "1");
+	SceneRunResult everyStepRun = RunSceneCPU(scene, threadCount, steps, deltaTime);
+
+	results.AddRow({ "off", (uint64)threadCount, (uint64)steps, offRun.bestSecondsPerStep * 1e3, offRun.meanSecondsPerStep * 1e3, everyStepRun.meanSecondsPerStep / offRun.meanSecondsPerStep, 0.0, (uint64)0, (uint64)0 });
+
+	for (uint64 interval : intervals)
+	{
+		std::string intervalString = std::to_string(std::max<uint64>(1, interval));
+		scene.SetOtherParameter("integrityCheckInterval", StringView(intervalString.data(), intervalString.size()));
+
+		IntegrityCheckStatistics statistics;
+		SceneRunResult run = RunSceneCPU(scene, threadCount, steps, deltaTime, { }, [&](SimulationEngineCPU& engine) {
+			statistics = engine.GetIntegrityCheckStatistics();
+			});
+
+		if (statistics.errorCount != 0)
+			results.SetFailed();
+
+		results.AddRow({
+			intervalString,
+			(uint64)threadCount,
+			(uint64)steps,
+			run.bestSecondsPerStep * 1e3,
+			run.meanSecondsPerStep * 1e3,
+			everyStepRun.meanSecondsPerStep / run.meanSecondsPerStep,
+			run.meanSecondsPerStep / offRun.meanSecondsPerStep - 1.0,
+			statistics.checkedStepCount,
+			statistics.errorCount
+			});
+	}
+
+	return results;
+}
\ No newline at end of file
@@ -0,0 +1,100 @@
+#include "pch.h"
+#include "Benchmarks/Benchmarks.h"
+#include "Benchmarks/SceneRun.h"
+
+using namespace SPH;
+
+/*
+	Runs a scene with the dynamic particles in the StructOfArrays layout once for every instruction set the CPU
+	supports. Each vectorized instruction set is validated in two ways before it is timed. After the validation steps
+	run with the scalar kernels, its pressure and dynamics functions are run on the same particles as the scalar ones
+	and the outputs of every particle are compared, which catches a wrong gather or mask even when its effect on the
+	scene is small. Then the scene is run for the validation steps with it and compared with the scalar run. The
+	benchmark fails if any difference is larger than the tolerance. The vectorized kernels only sum the neighbours in a
+	different order so the differences should stay close to the float precision.
+
+	Options:
+		--scene <path>            - scene file, required
+		--steps <n>               - timed simulation steps, default 20
+		--threads <n>             - threads used for the timed runs, default the hardware thread count
+		--deltaTime <x>           - time step, default 0.01
+		--validationSteps <n>     - steps run before the kernels are compared and compared with the scalar kernels, default 1
+		--tolerance <x>           - largest allowed error relative to max(1, |scalar value|), default 1e-4
+*/
+BenchmarkResults RunKernelBenchmark(const CommandLineArguments& arguments)
+{
+	BenchmarkResults results{ { "instructionSet", "threadCount", "steps", "bestMillisecondsPerStep", "meanMillisecondsPerStep", "speedup", "pressureKernelError", "dynamicsKernelError", "hashMismatchCount", "validationError", "validation" } };
+
+	std::string scenePath = arguments.Get("scene", "");
+	uintMem steps = std::max<uint64>(1, arguments.GetUInt("steps", 20));
+	uintMem threadCount = std::max<uint64>(1, arguments.GetUInt("threads", std::max(1u, std::thread::hardware_concurrency())));
+	float deltaTime = (float)arguments.GetDouble("deltaTime", 0.01);
+	uintMem validationSteps = std::max<uint64>(1, arguments.GetUInt("validationSteps", 1));
+	double tolerance = arguments.GetDouble("tolerance", 1e-4);
+
+	SceneBlueprint scene;
+	if (scenePath.empty() || !scene.LoadScene(Path(scenePath.c_str())))
+	{
+		Debug::Logger::LogError("SPH Benchmark", "The kernels benchmark needs a valid scene file given with \"--scene\"");
+		results.SetFailed();
+		return results;
+	}
+
+	//The vectorized kernels are only used with the StructOfArrays layout. "simdKernels" would override the instruction
+	//set chosen for each run
+	scene.SetOtherParameter("structOfArrays", "true");
+
+	struct InstructionSetInfo
+	{
+		CPUInstructionSet instructionSet;
+		const char* name;
+	};
+	InstructionSetInfo instructionSets[]{
+		{ CPUInstructionSet::Scalar, "scalar" },
+		{ CPUInstructionSet::AVX2, "avx2" },
+		{ CPUInstructionSet::AVX512, "avx512" },
+	};
+
+	auto useInstructionSet = [](CPUInstructionSet instructionSet) {
+		return [instructionSet](SimulationEngineCPU& engine) { engine.SetInstructionSet(instructionSet); };
+		};
+
+	SceneRunResult validationReference = RunSceneCPU(scene, 1, validationSteps, deltaTime, useInstructionSet(CPUInstructionSet::Scalar));
+	double scalarSecondsPerStep = 0;
+
+	for (auto& instructionSet : instructionSets)
+	{
+		if (!SimulationEngineCPU::IsInstructionSetSupported(instructionSet.instructionSet))
+			continue;
+
+		KernelComparison kernelComparison;
+		double validationError = 0;
+		const char* validation = "reference";
+
+		if (instructionSet.instructionSet != CPUInstructionSet::Scalar)
+		{
+			RunSceneCPU(scene, 1, validationSteps, deltaTime, useInstructionSet(CPUInstructionSet::Scalar), [&](SimulationEngineCPU& engine) {
+				kernelComparison = engine.CompareInstructionSetKernels(instructionSet.instructionSet, deltaTime);
+				});
+
+			double kernelError = std::max({ kernelComparison.pressureError, kernelComparison.positionError, kernelComparison.velocityError });
+			if (kernelError > tolerance)
+				Debug::Logger::LogError("SPH Benchmark", "The " + StringView(instructionSet.name) + " kernels differ from the scalar kernels by more than the tolerance");
+
+			validationError = MaxParticleError(RunSceneCPU(scene, 1, validationSteps, deltaTime, useInstructionSet(instructionSet.instructionSet)).particles, validationReference.particles);
+			validation = validationError <= tolerance && kernelError <= tolerance ? "passed" : "failed";
+
+			if (validationError > tolerance || kernelError > tolerance)
+				results.SetFailed();
+		}
+
+		SceneRunResult run = RunSceneCPU(scene, threadCount, steps, deltaTime, useInstructionSet(instructionSet.instructionSet));
+
+		if (instructionSet.instructionSet == CPUInstructionSet::Scalar)
+			scalarSecondsPerStep = run.meanSecondsPerStep;
+
+		results.AddRow({ instructionSet.name, (uint64)threadCount, (uint64)steps, run.bestSecondsPerStep * 1e3, run.meanSecondsPerStep * 1e3, scalarSecondsPerStep / run.meanSecondsPerStep, kernelComparison.pressureError, std::max(kernelComparison.positionError, kernelComparison.velocityError), kernelComparison.hashMismatchCount, validationError, validation });
+	}
+
+	return results;
+}
\ No newline at end of file
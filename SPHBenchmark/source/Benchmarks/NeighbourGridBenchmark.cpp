@@ -0,0 +1,98 @@
+#include "pch.h"
+#include "Benchmarks/Benchmarks.h"
+#include "Benchmarks/SceneRun.h"
+
+using namespace SPH;
+
+struct NeighbourGridRunResult
+{
+	bool denseGridUsed;
+	SceneRunResult run;
+	NeighbourSearchStatistics statistics;
+};
+
+static NeighbourGridRunResult RunScene(SceneBlueprint& scene, uintMem threadCount, uintMem steps, float deltaTime)
+{
+	NeighbourGridRunResult result;
+	result.run = RunSceneCPU(scene, threadCount, steps, deltaTime, { }, [&](SimulationEngineCPU& engine) {
+		result.denseGridUsed = engine.IsDenseGridUsed();
+		result.statistics = engine.ComputeNeighbourSearchStatistics();
+		});
+
+	return result;
+}
+
+/*
+	Runs a scene with the dynamic particles in the Morton hash map and then in the dense grid, and counts the
+	neighbour candidates the neighbour loops scan after the last step. Every candidate that isn't within the
+	interaction distance is wasted work, most of them come from hash collisions between distant cells. The dense grid
+	is built from the bounding box of the static particles so the scene must have some. The limit of the grid cells per
+	dynamic particle is lifted, so the grid is also measured on scenes where the engine would use the hash map.
+
+	Options:
+		--scene <path>            - scene file, required
+		--steps <n>               - timed simulation steps, default 20
+		--threads <n>             - threads used, default the hardware thread count
+		--deltaTime <x>           - time step, default 0.01
+*/
+BenchmarkResults RunNeighbourGridBenchmark(const CommandLineArguments& arguments)
+{
+	BenchmarkResults results{ { "index", "bucketCount", "threadCount", "steps", "bestMillisecondsPerStep", "meanMillisecondsPerStep", "speedup", "candidatesPerParticle", "neighboursPerParticle", "wastedCandidatesPerParticle", "eliminatedWastedCandidates" } };
+
+	std::string scenePath = arguments.Get("scene", "");
+	uintMem steps = std::max<uint64>(1, arguments.GetUInt("steps", 20));
+	uintMem threadCount = std::max<uint64>(1, arguments.GetUInt("threads", std::max(1u, std::thread::hardware_concurrency())));
+	float deltaTime = (float)arguments.GetDouble("deltaTime", 0.01);
+
+	SceneBlueprint scene;
+	if (scenePath.empty() || !scene.LoadScene(Path(scenePath.c_str())))
+	{
+		Debug::Logger::LogError("SPH Benchmark", "The neighbour grid benchmark needs a valid scene file given with \"--scene\"");
+		results.SetFailed();
+		return results;
+	}
+
+	scene.SetOtherParameter("denseGrid", "false");
+	NeighbourGridRunResult hashMapRun = RunScene(scene, threadCount, steps, deltaTime);
+
+	//The engine falls back to the hash map when the grid has too many cells per particle, which would leave nothing to
+	//compare on sparse scenes. The bucket count column shows how large the grid is instead
+	scene.SetOtherParameter("denseGrid", "true");
+	scene.SetOtherParameter("denseGridMaxCellsPerParticle", "1000000000");
+	NeighbourGridRunResult denseGridRun = RunScene(scene, threadCount, steps, deltaTime);
+
+	if (!denseGridRun.denseGridUsed)
+	{
+		Debug::Logger::LogError("SPH Benchmark", "The dense grid couldn't be used for the scene, it needs static particles that bound a small enough grid");
+		results.SetFailed();
+	}
+
+	auto wastedCandidates = [](const NeighbourSearchStatistics& statistics) {
+		return (statistics.dynamicCandidateCount - statistics.dynamicNeighbourCount) + (statistics.staticCandidateCount - statistics.staticNeighbourCount);
+		};
+	uint64 hashMapWastedCandidates = wastedCandidates(hashMapRun.statistics);
+
+	for (auto* run : { &hashMapRun, &denseGridRun })
+	{
+		const NeighbourSearchStatistics& statistics = run->statistics;
+		double particleCount = (double)std::max<uint64>(1, statistics.dynamicParticleCount);
+		uint64 wasted = wastedCandidates(statistics);
+		double eliminated = hashMapWastedCandidates == 0 ? 0.0 : 1.0 - (double)wasted / hashMapWastedCandidates;
+
+		results.AddRow({
+			run->denseGridUsed ? "denseGrid" : "hashMap",
+			statistics.dynamicBucketCount,
+			(uint64)threadCount,
+			(uint64)steps,
+			run->run.bestSecondsPerStep * 1e3,
+			run->run.meanSecondsPerStep * 1e3,
+			hashMapRun.run.meanSecondsPerStep / run->run.meanSecondsPerStep,
+			(statistics.dynamicCandidateCount + statistics.staticCandidateCount) / particleCount,
+			(statistics.dynamicNeighbourCount + statistics.staticNeighbourCount) / particleCount,
+			wasted / particleCount,
+			eliminated
+			});
+	}
+
+	return results;
+}
\ No newline at end of file
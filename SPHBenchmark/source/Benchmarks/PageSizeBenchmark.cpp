@@ -0,0 +1,138 @@
+#include "pch.h"
+#include "Benchmarks/Benchmarks.h"
+#include "Benchmarks/SceneRun.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace SPH;
+
+//Counts the data TLB load misses of the calling thread and of the threads it creates after Begin, with the perf
+//events of Linux. Not available on the other platforms or when the kernel doesn't allow the process to count
+class DataTLBMissCounter
+{
+public:
+	~DataTLBMissCounter()
+	{
+#ifdef __linux__
+		if (fd != -1)
+			close(fd);
+#endif
+	}
+
+	bool Begin()
+	{
+#ifdef __linux__
+		perf_event_attr attributes{ };
+		attributes.type = PERF_TYPE_HW_CACHE;
+		attributes.size = sizeof(attributes);
+		attributes.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+		attributes.inherit = 1;
+		attributes.exclude_kernel = 1;
+		attributes.exclude_hv = 1;
+
+		fd = (int)syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0);
+		return fd != -1;
+#else
+		return false;
+#endif
+	}
+	//The counts of the threads are only added when they exit, so this must be called after they were joined
+	uint64 End()
+	{
+		uint64 count = 0;
+#ifdef __linux__
+		if (fd == -1 || read(fd, &count, sizeof(count)) != sizeof(count))
+			count = 0;
+
+		close(fd);
+		fd = -1;
+#endif
+		return count;
+	}
+private:
+	int fd = -1;
+};
+
+/*
+	Runs a scene with the dynamic particle buffers, the hash map and the particle map in the default pages and with
+	each of the larger page sizes requested, for every thread count. The page size the hash map got after the fallbacks
+	is reported next to the step time and the data TLB load misses per step. The misses are counted for the whole run
+	including the initialization and the engine threads, so a run without steps is subtracted. They are only counted
+	on Linux, and only with a "perf_event_paranoid" setting that allows it, otherwise they are reported as -1. The
+	large pages need a scene with millions of particles to matter and the reserved pages of the OS, "vm.nr_hugepages"
+	on Linux or the "Lock pages in memory" privilege on Windows.
+
+	Options:
+		--scene <path>            - scene file, required
+		--steps <n>               - timed simulation steps, default 20
+		--threads <n,m,...>       - thread counts, default 1 and the hardware thread count
+		--pageSizes <n,m,...>     - the requested page sizes as values of the "pageSize" parameter, default 0, 1, 2 and 3
+		--deltaTime <x>           - time step, default 0.01
+*/
+BenchmarkResults RunPageSizeBenchmark(const CommandLineArguments& arguments)
+{
+	BenchmarkResults results{ { "requestedPageSize", "pageSize", "threadCount", "steps", "bestMillisecondsPerStep", "meanMillisecondsPerStep", "speedup", "dataTLBMissesPerStep" } };
+
+	std::string scenePath = arguments.Get("scene", "");
+	uintMem steps = std::max<uint64>(1, arguments.GetUInt("steps", 20));
+	std::vector<uint64> threadCounts = arguments.GetUIntList("threads", { 1, std::max(1u, std::thread::hardware_concurrency()) });
+	std::vector<uint64> pageSizes = arguments.GetUIntList("pageSizes", { 0, 1, 2, 3 });
+	float deltaTime = (float)arguments.GetDouble("deltaTime", 0.01);
+
+	SceneBlueprint scene;
+	if (scenePath.empty() || !scene.LoadScene(Path(scenePath.c_str())))
+	{
+		Debug::Logger::LogError("SPH Benchmark", "The page size benchmark needs a valid scene file given with \"--scene\"");
+		results.SetFailed();
+		return results;
+	}
+
+	const char* pageSizeNames[] = { "default", "transparentLarge", "large", "huge" };
+
+	for (uint64 threadCount : threadCounts)
+	{
+		threadCount = std::max<uint64>(1, threadCount);
+
+		double referenceSecondsPerStep = 0;
+
+		for (uint64 pageSize : pageSizes)
+		{
+			pageSize = std::min<uint64>(pageSize, (uint64)PageSize::Huge);
+			scene.SetOtherParameter("pageSize", std::to_string(pageSize).c_str());
+
+			DataTLBMissCounter initializationCounter;
+			bool countersAvailable = initializationCounter.Begin();
+			RunSceneCPU(scene, threadCount, 0, deltaTime);
+			uint64 initializationMisses = initializationCounter.End();
+
+			PageSize obtainedPageSize = PageSize::Default;
+			DataTLBMissCounter counter;
+			countersAvailable = counter.Begin() && countersAvailable;
+			SceneRunResult run = RunSceneCPU(scene, threadCount, steps, deltaTime, { }, [&](SimulationEngineCPU& engine) {
+				obtainedPageSize = engine.GetPageSize();
+				});
+			uint64 misses = counter.End();
+
+			if (referenceSecondsPerStep == 0)
+				referenceSecondsPerStep = run.meanSecondsPerStep;
+
+			results.AddRow({
+				pageSizeNames[pageSize],
+				pageSizeNames[(uint64)obtainedPageSize],
+				threadCount,
+				(uint64)steps,
+				run.bestSecondsPerStep * 1e3,
+				run.meanSecondsPerStep * 1e3,
+				referenceSecondsPerStep / run.meanSecondsPerStep,
+				countersAvailable ? (double)((int64)misses - (int64)initializationMisses) / steps : -1.0
+				});
+		}
+	}
+
+	return results;
+}
\ No newline at end of file
@@ -0,0 +1,107 @@
+#include "pch.h"
+#include "Benchmarks/Benchmarks.h"
+#include "Benchmarks/SceneRun.h"
+
+using namespace SPH;
+
+/*
+	Runs a scene with the hash map rebuilt every step and with the particles sorted by their buckets every step along
+	the Morton and the Hilbert curve, and incrementally along the Morton curve, for every thread count. Each of them is
+	also run for a few steps on the thread count and compared with the same sorting without the incremental sorting on
+	one thread. The sorted particles are in the same order for any thread count and with the incremental sorting, so
+	their difference must be 0 and the benchmark fails otherwise. The particles of a bucket of the rebuilt hash map are
+	in the order the threads added them in, so its difference is only reported. The incremental sorting reports the
+	steps it sorted only the moved particles in and the fraction of the particles whose bucket changed per step. The half neighbourhood
+	traversal sums the contributions of the threads in a different order for every thread count and the Verlet lists
+	can't be used with the sorting, so both are turned off.
+
+	Options:
+		--scene <path>            - scene file, required
+		--steps <n>               - timed simulation steps, default 20
+		--threads <n,m,...>       - thread counts, default 1 and the hardware thread count
+		--deltaTime <x>           - time step, default 0.01
+		--validationSteps <n>     - steps compared between one thread and the thread count, default 10
+		--maxMovedFraction <x>    - "incrementalSortMaxMovedFraction" of the incremental sorting, default 0.05
+*/
+BenchmarkResults RunParticleSortBenchmark(const CommandLineArguments& arguments)
+{
+	BenchmarkResults results{ { "ordering", "threadCount", "steps", "bestMillisecondsPerStep", "meanMillisecondsPerStep", "speedup", "incrementalSteps", "meanMovedFraction", "maxMovedFraction", "threadCountError", "deterministic" } };
+
+	std::string scenePath = arguments.Get("scene", "");
+	uintMem steps = std::max<uint64>(1, arguments.GetUInt("steps", 20));
+	std::vector<uint64> threadCounts = arguments.GetUIntList("threads", { 1, std::max(1u, std::thread::hardware_concurrency()) });
+	float deltaTime = (float)arguments.GetDouble("deltaTime", 0.01);
+	uintMem validationSteps = std::max<uint64>(1, arguments.GetUInt("validationSteps", 10));
+	double maxMovedFraction = arguments.GetDouble("maxMovedFraction", 0.05);
+
+	SceneBlueprint scene;
+	if (scenePath.empty() || !scene.LoadScene(Path(scenePath.c_str())))
+	{
+		Debug::Logger::LogError("SPH Benchmark", "The particle sort benchmark needs a valid scene file given with \"--scene\"");
+		results.SetFailed();
+		return results;
+	}
+
+	scene.SetOtherParameter("halfNeighbourhood", "false");
+	scene.SetOtherParameter("verletLists", "false");
+	scene.SetOtherParameter("incrementalSortMaxMovedFraction", std::to_string(maxMovedFraction).c_str());
+
+	struct Ordering
+	{
+		const char* name;
+		bool sortParticles;
+		bool hilbertCurve;
+		bool incrementalSort;
+	};
+	const Ordering orderings[]{
+		{ "hashMap", false, false, false },
+		{ "sortMorton", true, false, false },
+		{ "sortHilbert", true, true, false },
+		{ "sortIncremental", true, false, true },
+	};
+
+	for (uint64 threadCount : threadCounts)
+	{
+		threadCount = std::max<uint64>(1, threadCount);
+
+		double referenceSecondsPerStep = 0;
+
+		for (const Ordering& ordering : orderings)
+		{
+			scene.SetOtherParameter("sortParticles", ordering.sortParticles ? "true" : "false");
+			scene.SetOtherParameter("hilbertCurve", ordering.hilbertCurve ? "true" : "false");
+
+			scene.SetOtherParameter("incrementalSort", "false");
+			SceneRunResult validationReference = RunSceneCPU(scene, 1, validationSteps, deltaTime);
+
+			scene.SetOtherParameter("incrementalSort", ordering.incrementalSort ? "true" : "false");
+			double threadCountError = MaxParticleError(RunSceneCPU(scene, threadCount, validationSteps, deltaTime).particles, validationReference.particles);
+
+			ParticleSortStatistics statistics;
+			SceneRunResult run = RunSceneCPU(scene, threadCount, steps, deltaTime, { }, [&](SimulationEngineCPU& engine) { statistics = engine.GetParticleSortStatistics(); });
+			double particleCount = (double)std::max<uintMem>(1, run.particles.Count());
+
+			if (ordering.sortParticles && threadCountError != 0)
+				results.SetFailed();
+
+			if (referenceSecondsPerStep == 0)
+				referenceSecondsPerStep = run.meanSecondsPerStep;
+
+			results.AddRow({
+				ordering.name,
+				threadCount,
+				(uint64)steps,
+				run.bestSecondsPerStep * 1e3,
+				run.meanSecondsPerStep * 1e3,
+				referenceSecondsPerStep / run.meanSecondsPerStep,
+				statistics.incrementalStepCount,
+				statistics.stepCount == 0 ? 0.0 : statistics.movedParticleCount / (statistics.stepCount * particleCount),
+				statistics.maxMovedParticleCount / particleCount,
+				threadCountError,
+				threadCountError == 0 ? "yes" : "no"
+				});
+		}
+	}
+
+	return results;
+}
\ No newline at end of file
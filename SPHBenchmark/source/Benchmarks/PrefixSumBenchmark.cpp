@@ -0,0 +1,205 @@
+#include "pch.h"
+#include "Benchmarks/Benchmarks.h"
+#include "SPH/Concurrency/ParallelScan.h"
+
+using namespace SPH;
+
+enum class PrefixSumMode
+{
+	//Thread 0 scans all the buckets, what the engine does when "parallelPartialSum" is false
+	Serial,
+	//The previous parallel version, each thread scans its buckets and adds its sum to the group sums of all the
+	//following threads with atomics
+	GroupSums,
+	//ParallelInclusiveScan, used by the engine
+	ParallelScan
+};
+
+struct PrefixSumTask
+{
+	PrefixSumMode mode;
+	const Array<uint32>& counts;
+	Array<std::atomic_uint32_t>& values;
+	Array<std::atomic_uint32_t>& groupSums;
+	Array<uint32>& blockSums;
+	uintMem repetitions;
+	std::vector<double>& seconds;
+};
+
+static void PrefixSumTaskFunction(const ThreadContext& context, PrefixSumTask& task)
+{
+	uintMem threadIndex = context.GetThreadIndex();
+	uintMem count = task.counts.Count();
+	uintMem begin = count * threadIndex / context.GetThreadCount();
+	uintMem end = count * (threadIndex + 1) / context.GetThreadCount();
+
+	for (uintMem repetition = 0; repetition < task.repetitions; ++repetition)
+	{
+		//The scan is done in place, so the counts are copied back before every repetition
+		for (uintMem i = begin; i < end; ++i)
+			task.values[i].store(task.counts[i], std::memory_order_relaxed);
+		task.groupSums[threadIndex] = 0;
+
+		context.SyncThreads();
+
+		auto start = std::chrono::steady_clock::now();
+
+		switch (task.mode)
+		{
+		case PrefixSumMode::Serial:
+			if (threadIndex == 0)
+			{
+				uint32 valueSum = 0;
+				for (uintMem i = 0; i < count; ++i)
+				{
+					valueSum += task.values[i];
+					task.values[i] = valueSum;
+				}
+			}
+			break;
+		case PrefixSumMode::GroupSums: {
+			uint32 valueSum = 0;
+			for (uintMem i = begin; i < end; ++i)
+			{
+				valueSum += task.values[i];
+				task.values[i] = valueSum;
+			}
+
+			for (uintMem i = threadIndex; i < context.GetThreadCount() - 1; ++i)
+				task.groupSums[i] += valueSum;
+
+			context.SyncThreads();
+
+			if (threadIndex != 0)
+			{
+				uintMem addition = task.groupSums[threadIndex - 1];
+				for (uintMem i = begin; i < end; ++i)
+					task.values[i] += addition;
+			}
+			break;
+		}
+		case PrefixSumMode::ParallelScan:
+			ParallelInclusiveScan(context, task.values.Ptr(), count, task.blockSums.Ptr(), [&]() { context.SyncThreads(); });
+			break;
+		}
+
+		context.SyncThreads();
+
+		if (threadIndex == 0)
+			task.seconds.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+	}
+}
+
+/*
+	Computes the inclusive prefix sum of a hash map with 2 buckets per particle, like the dynamic particle hash map, with
+	the serial scan of thread 0, the previous group sum version and the parallel scan. The buckets have 0, 1 or 2
+	particles, 0.5 on average. The result of every mode is checked against a running sum of the counts.
+
+	Options:
+		--buckets <n,m,...>       - bucket counts, default 1000000,10000000,50000000
+		--threads <n,m,...>       - thread counts, default the hardware thread count
+		--repetitions <n>         - scans per measurement, default 10
+*/
+BenchmarkResults RunPrefixSumBenchmark(const CommandLineArguments& arguments)
+{
+	BenchmarkResults results{ { "bucketCount", "threadCount", "mode", "repetitions", "bestMilliseconds", "meanMilliseconds", "bucketsPerNanosecond", "speedupOverSerial", "validation" } };
+
+	std::vector<uint64> bucketCounts = arguments.GetUIntList("buckets", { 1000000, 10000000, 50000000 });
+	std::vector<uint64> threadCounts = arguments.GetUIntList("threads", { std::max(1u, std::thread::hardware_concurrency()) });
+	uintMem repetitions = std::max<uint64>(1, arguments.GetUInt("repetitions", 10));
+
+	struct PrefixSumModeInfo
+	{
+		PrefixSumMode mode;
+		const char* name;
+	};
+	PrefixSumModeInfo modes[]{
+		{ PrefixSumMode::Serial, "serial" },
+		{ PrefixSumMode::GroupSums, "groupSums" },
+		{ PrefixSumMode::ParallelScan, "parallelScan" },
+	};
+
+	for (uint64 bucketCount : bucketCounts)
+	{
+		Array<uint32> counts;
+		counts.Resize(bucketCount);
+
+		//A fixed hash instead of a random generator so that every run scans the same counts
+		for (uintMem i = 0; i < bucketCount; ++i)
+		{
+			uint32 hash = (uint32)i * 2654435761u;
+			hash ^= hash >> 15;
+			uint32 fraction = hash % 10;
+			counts[i] = fraction < 6 ? 0 : (fraction < 9 ? 1 : 2);
+		}
+
+		Array<std::atomic_uint32_t> values = Array<std::atomic_uint32_t>(bucketCount);
+
+		for (uint64 threadCount : threadCounts)
+		{
+			threadCount = std::max<uint64>(1, threadCount);
+
+			ThreadParallelTaskManager threadManager;
+			threadManager.AllocateThreads(threadCount);
+
+			Array<std::atomic_uint32_t> groupSums = Array<std::atomic_uint32_t>(threadCount);
+			Array<uint32> blockSums;
+			blockSums.Resize(threadCount);
+
+			double serialMeanSeconds = 0;
+
+			for (auto& mode : modes)
+			{
+				std::vector<double> seconds;
+
+				threadManager.EnqueueTask(PrefixSumTaskFunction, PrefixSumTask{
+					.mode = mode.mode,
+					.counts = counts,
+					.values = values,
+					.groupSums = groupSums,
+					.blockSums = blockSums,
+					.repetitions = repetitions,
+					.seconds = seconds
+					});
+				threadManager.FinishTasks();
+
+				bool valid = true;
+				uint32 valueSum = 0;
+				for (uintMem i = 0; i < bucketCount; ++i)
+				{
+					valueSum += counts[i];
+					valid &= values[i].load(std::memory_order_relaxed) == valueSum;
+				}
+
+				if (!valid)
+					results.SetFailed();
+
+				double bestSeconds = DBL_MAX;
+				double secondsSum = 0;
+				for (double value : seconds)
+				{
+					bestSeconds = std::min(bestSeconds, value);
+					secondsSum += value;
+				}
+				double meanSeconds = secondsSum / seconds.size();
+
+				if (mode.mode == PrefixSumMode::Serial)
+					serialMeanSeconds = meanSeconds;
+
+				results.AddRow({
+					bucketCount,
+					threadCount,
+					mode.name,
+					(uint64)repetitions,
+					bestSeconds * 1e3,
+					meanSeconds * 1e3,
+					bucketCount / (bestSeconds * 1e9),
+					serialMeanSeconds / meanSeconds,
+					valid ? "passed" : "failed"
+					});
+			}
+		}
+	}
+
+	return results;
+}
\ No newline at end of file
@@ -0,0 +1,92 @@
+#include "pch.h"
+#include "Benchmarks/Benchmarks.h"
+#include "Benchmarks/SceneRun.h"
+
+using namespace SPH;
+
+/*
+	Runs a scene without reordering the particles, with the particles reordered every "reorderTimeInterval" for the
+	given intervals and with the adaptive reordering for the given costs, for every thread count. Besides the step time
+	the reorderings and the largest scattered fraction of the particle map measured by the adaptive reordering are
+	reported. The particles of a bucket are in a different order after a reordering, so the difference to the run
+	without reordering is only reported. The sorting every step reorders the particles after every step, so it's turned
+	off.
+
+	Options:
+		--scene <path>            - scene file, required
+		--steps <n>               - timed simulation steps, default 100
+		--threads <n,m,...>       - thread counts, default 1 and the hardware thread count
+		--deltaTime <x>           - time step, default 0.01
+		--intervals <x,y,...>     - reorder time intervals, default 0.05, 0.2 and 1
+		--costs <x,y,...>         - "adaptiveReorderCost" values, default 0.25, 0.5, 1 and 2
+*/
+BenchmarkResults RunReorderScheduleBenchmark(const CommandLineArguments& arguments)
+{
+	BenchmarkResults results{ { "schedule", "value", "threadCount", "steps", "bestMillisecondsPerStep", "meanMillisecondsPerStep", "speedup", "reorders", "maxScatteredFraction", "error" } };
+
+	std::string scenePath = arguments.Get("scene", "");
+	uintMem steps = std::max<uint64>(1, arguments.GetUInt("steps", 100));
+	std::vector<uint64> threadCounts = arguments.GetUIntList("threads", { 1, std::max(1u, std::thread::hardware_concurrency()) });
+	float deltaTime = (float)arguments.GetDouble("deltaTime", 0.01);
+	std::vector<double> intervals = arguments.GetDoubleList("intervals", { 0.05, 0.2, 1 });
+	std::vector<double> costs = arguments.GetDoubleList("costs", { 0.25, 0.5, 1, 2 });
+
+	SceneBlueprint scene;
+	if (scenePath.empty() || !scene.LoadScene(Path(scenePath.c_str())))
+	{
+		Debug::Logger::LogError("SPH Benchmark", "The reorder schedule benchmark needs a valid scene file given with \"--scene\"");
+		results.SetFailed();
+		return results;
+	}
+
+	scene.SetOtherParameter("sortParticles", "false");
+
+	struct Schedule
+	{
+		const char* name;
+		double value;
+		bool adaptive;
+	};
+	std::vector<Schedule> schedules{ { "never", 0, false } };
+	for (double interval : intervals)
+		schedules.push_back({ "interval", interval, false });
+	for (double cost : costs)
+		schedules.push_back({ "adaptive", cost, true });
+
+	for (uint64 threadCount : threadCounts)
+	{
+		threadCount = std::max<uint64>(1, threadCount);
+
+		SceneRunResult reference;
+
+		for (const Schedule& schedule : schedules)
+		{
+			bool never = &schedule == &schedules.front();
+
+			scene.SetOtherParameter("reorderTimeInterval", never || schedule.adaptive ? "1e30" : std::to_string(schedule.value).c_str());
+			scene.SetOtherParameter("adaptiveReorder", schedule.adaptive ? "true" : "false");
+			scene.SetOtherParameter("adaptiveReorderCost", std::to_string(schedule.value).c_str());
+
+			ReorderStatistics statistics;
+			SceneRunResult run = RunSceneCPU(scene, threadCount, steps, deltaTime, { }, [&](SimulationEngineCPU& engine) { statistics = engine.GetReorderStatistics(); });
+
+			if (never)
+				reference = run;
+
+			results.AddRow({
+				schedule.name,
+				schedule.value,
+				threadCount,
+				(uint64)steps,
+				run.bestSecondsPerStep * 1e3,
+				run.meanSecondsPerStep * 1e3,
+				reference.meanSecondsPerStep / run.meanSecondsPerStep,
+				statistics.reorderCount,
+				statistics.maxScatteredFraction,
+				MaxParticleError(run.particles, reference.particles)
+				});
+		}
+	}
+
+	return results;
+}
\ No newline at end of file
@@ -0,0 +1,318 @@
+#include "pch.h"
+#include "Benchmarks/Benchmarks.h"
+#include "SPH/Core/SceneBlueprint.h"
+#include "SPH/OpenCL/OpenCLContext.h"
+#include "SPH/SimulationEngines/SimulationEngineCPU.h"
+#include "SPH/SimulationEngines/SimulationEngineGPU.h"
+#include "SPH/ParticleBufferManagers/OfflineCPUParticleBufferManager.h"
+#include "SPH/ParticleBufferManagers/OfflineGPUParticleBufferManager.h"
+#include "CL/cl.h"
+
+using namespace SPH;
+
+struct PhaseMeasurements
+{
+	const char* name;
+	uint32 stepsPerCall;
+	std::vector<double> seconds;
+};
+
+static double SecondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void AddPhaseRow(BenchmarkResults& results, const char* engineName, const BenchmarkResults::Value& threadCount, uint64 particleCount, const PhaseMeasurements& phase)
+{
+	if (phase.seconds.empty())
+		return;
+
+	std::vector<double> seconds = phase.seconds;
+	std::sort(seconds.begin(), seconds.end());
+
+	double total = 0;
+	for (double value : seconds)
+		total += value;
+
+	auto percentile = [&](double fraction) {
+		return seconds[std::min<uintMem>(seconds.size() - 1, (uintMem)(fraction * seconds.size()))];
+		};
+
+	results.AddRow({
+		engineName,
+		phase.name,
+		particleCount,
+		threadCount,
+		phase.stepsPerCall,
+		(uint64)seconds.size(),
+		total * 1e3,
+		total / seconds.size() * 1e3,
+		seconds.front() * 1e3,
+		percentile(0.5) * 1e3,
+		percentile(0.95) * 1e3,
+		seconds.back() * 1e3,
+		"-",
+		"-"
+		});
+}
+
+//The engine only keeps the sums of its phases, so the total is the time of the slowest thread and there is no distribution
+static void AddEnginePhaseRows(BenchmarkResults& results, const char* engineName, const BenchmarkResults::Value& threadCount, uint64 particleCount, const SimulationStatistics& statistics)
+{
+	for (auto& phase : statistics.phases)
+	{
+		double total = phase.MaxThreadSeconds();
+
+		results.AddRow({
+			engineName,
+			"step:" + std::string(phase.name.Ptr(), phase.name.Count()),
+			particleCount,
+			threadCount,
+			(uint32)1,
+			phase.callCount,
+			total * 1e3,
+			total / std::max<uint64>(1, phase.callCount) * 1e3,
+			"-",
+			"-",
+			"-",
+			"-",
+			phase.MeanWaitSeconds() * 1e3,
+			phase.LoadImbalance()
+			});
+	}
+}
+
+/*
+	Initializes the engine and runs the updates one by one, waiting for each to finish. 'readParticles' copies the
+	dynamic particles into host memory after the last update. 'statistics' is filled with the engine phases of the
+	timed updates.
+*/
+static std::vector<PhaseMeasurements> RunScene(
+	SceneBlueprint& scene,
+	SimulationEngine& engine,
+	ParticleBufferManager& dynamicParticlesBufferManager,
+	ParticleBufferManager& staticParticlesBufferManager,
+	uintMem warmupUpdates,
+	uintMem updates,
+	uint stepsPerUpdate,
+	float deltaTime,
+	const std::function<void(ParticleBufferManager&, Array<DynamicParticle>&)>& readParticles,
+	SimulationStatistics& statistics
+)
+{
+	PhaseMeasurements initialize{ "initialize", 0 };
+	PhaseMeasurements update{ "update", stepsPerUpdate };
+	PhaseMeasurements readback{ "readback", 0 };
+
+	auto start = std::chrono::steady_clock::now();
+	engine.Initialize(scene, dynamicParticlesBufferManager, staticParticlesBufferManager);
+	engine.FinishUpdates();
+	initialize.seconds.push_back(SecondsSince(start));
+
+	//The first updates allocate lazily and fill the caches, they would skew the measurements
+	for (uintMem i = 0; i < warmupUpdates; ++i)
+	{
+		engine.Update(deltaTime, stepsPerUpdate);
+		engine.FinishUpdates();
+	}
+
+	engine.ResetStatistics();
+
+	update.seconds.reserve(updates);
+	for (uintMem i = 0; i < updates; ++i)
+	{
+		start = std::chrono::steady_clock::now();
+		engine.Update(deltaTime, stepsPerUpdate);
+		engine.FinishUpdates();
+		update.seconds.push_back(SecondsSince(start));
+	}
+
+	statistics = engine.GetStatistics();
+
+	Array<DynamicParticle> particles;
+	start = std::chrono::steady_clock::now();
+	readParticles(dynamicParticlesBufferManager, particles);
+	readback.seconds.push_back(SecondsSince(start));
+
+	return { initialize, update, readback };
+}
+
+static void ReadParticlesCPU(ParticleBufferManager& bufferManager, Array<DynamicParticle>& particles)
+{
+	bufferManager.FlushAllOperations();
+
+	uintMem particleCount = bufferManager.GetParticleCount();
+	particles.Resize(particleCount);
+
+	ResourceLockGuard lockGuard = bufferManager.LockRead(nullptr);
+	if (bufferManager.GetLayout() == ParticleBufferLayout::StructOfArrays)
+		ConvertParticlesToArrayOfStructs(lockGuard.GetResource(), particles.Ptr(), sizeof(DynamicParticle), particleCount);
+	else
+		memcpy(particles.Ptr(), lockGuard.GetResource(), particleCount * sizeof(DynamicParticle));
+	lockGuard.Unlock({});
+}
+
+static auto ReadParticlesGPU(cl_command_queue clCommandQueue)
+{
+	return [clCommandQueue](ParticleBufferManager& bufferManager, Array<DynamicParticle>& particles) {
+		uintMem particleCount = bufferManager.GetParticleCount();
+		particles.Resize(particleCount);
+
+		cl_event lockAcquiredEvent = nullptr;
+		ResourceLockGuard lockGuard = bufferManager.LockRead(&lockAcquiredEvent);
+
+		cl_int ret = clEnqueueReadBuffer(clCommandQueue, (cl_mem)lockGuard.GetResource(), CL_TRUE, 0, particleCount * sizeof(DynamicParticle), particles.Ptr(), lockAcquiredEvent == nullptr ? 0 : 1, lockAcquiredEvent == nullptr ? nullptr : &lockAcquiredEvent, nullptr);
+		if (ret != CL_SUCCESS)
+			Debug::Logger::LogError("SPH Benchmark", "Failed to read the GPU particles back to the host");
+
+		if (lockAcquiredEvent != nullptr)
+			clReleaseEvent(lockAcquiredEvent);
+		lockGuard.Unlock({});
+		};
+}
+
+/*
+	Runs a scene file without a window, first with the CPU engine and then with the GPU engine when an OpenCL device
+	is found. No OpenGL context is created, the engines use the offline buffer managers, so it also runs on headless
+	machines. Every phase gets a row with the distribution of its wall clock times:
+		load       - parsing the scene file and loading its mesh
+		initialize - generating the particles and building the hash maps
+		update     - one engine update of 'stepsPerUpdate' simulation steps, waited for to finish
+		readback   - copying the dynamic particles into host memory after the last update
+	The engines also measure the phases of their simulation steps during the timed updates, each gets a "step:<name>"
+	row with its summed time, the mean time threads spent waiting at the barrier that ends it and the load imbalance,
+	the time of the slowest thread divided by the mean. The CPU engine measures them when it's compiled with
+	PROFILE_PHASES_CPU and the GPU engine with PROFILE_PHASES_GPU. Neither is defined by default, the CPU one reads
+	timestamps around every barrier and the GPU one waits for each update. The GPU rows have the summed kernel
+	execution times.
+	The paths inside the scene files are relative to the working directory, so the scenes in "assets/simulationScenes"
+	should be run from the FluidSimulationProject directory.
+
+	Options:
+		--scene <path>            - scene file, for example "assets/simulationScenes/scene.json", required
+		--engine <name>           - "cpu", "gpu" or "all", default "all"
+		--updates <n>             - timed updates, default 100
+		--warmupUpdates <n>       - updates run before the timed ones, default 5
+		--stepsPerUpdate <n>      - simulation steps per update, default 1
+		--threads <n>             - threads used by the CPU engine, default the hardware thread count
+		--deltaTime <x>           - time step, default 0.01
+		--gpuScans <names>        - hash map scans the GPU engine is run with, comma separated "reduceThenScan" and
+		                            "upDownSweep", default the one selected by the scene. With this option the GPU
+		                            rows are named "gpu:<scan>". The benchmark fails when a scene with
+		                            "integrityCheckInterval" finds an invalid hash map
+*/
+BenchmarkResults RunSceneBenchmark(const CommandLineArguments& arguments)
+{
+	BenchmarkResults results{ { "engine", "phase", "particleCount", "threadCount", "stepsPerCall", "calls", "totalMilliseconds", "meanMilliseconds", "minMilliseconds", "medianMilliseconds", "p95Milliseconds", "maxMilliseconds", "waitMilliseconds", "loadImbalance" } };
+
+	std::string scenePath = arguments.Get("scene", "");
+	std::string engineName = arguments.Get("engine", "all");
+	uintMem updates = std::max<uint64>(1, arguments.GetUInt("updates", 100));
+	uintMem warmupUpdates = arguments.GetUInt("warmupUpdates", 5);
+	uint stepsPerUpdate = (uint)std::max<uint64>(1, arguments.GetUInt("stepsPerUpdate", 1));
+	uintMem threadCount = std::max<uint64>(1, arguments.GetUInt("threads", std::max(1u, std::thread::hardware_concurrency())));
+	float deltaTime = (float)arguments.GetDouble("deltaTime", 0.01);
+	std::string gpuScans = arguments.Get("gpuScans", "");
+
+	bool runCPU = engineName == "cpu" || engineName == "all";
+	bool runGPU = engineName == "gpu" || engineName == "all";
+
+	if (!runCPU && !runGPU)
+	{
+		Debug::Logger::LogError("SPH Benchmark", "Invalid value for argument \"--engine\", it must be \"cpu\", \"gpu\" or \"all\"");
+		results.SetFailed();
+		return results;
+	}
+
+	PhaseMeasurements load{ "load", 0 };
+	SceneBlueprint scene;
+
+	auto start = std::chrono::steady_clock::now();
+	if (scenePath.empty() || !scene.LoadScene(Path(scenePath.c_str())))
+	{
+		Debug::Logger::LogError("SPH Benchmark", "The scene benchmark needs a valid scene file given with \"--scene\"");
+		results.SetFailed();
+		return results;
+	}
+	load.seconds.push_back(SecondsSince(start));
+
+	AddPhaseRow(results, "-", "-", 0, load);
+
+	if (runCPU)
+	{
+		OfflineCPUParticleBufferManager dynamicParticlesBufferManager;
+		OfflineCPUParticleBufferManager staticParticlesBufferManager;
+		SimulationEngineCPU engine{ threadCount };
+
+		SimulationStatistics statistics;
+		auto phases = RunScene(scene, engine, dynamicParticlesBufferManager, staticParticlesBufferManager, warmupUpdates, updates, stepsPerUpdate, deltaTime, ReadParticlesCPU, statistics);
+
+		for (auto& phase : phases)
+			AddPhaseRow(results, "cpu", (uint64)threadCount, dynamicParticlesBufferManager.GetParticleCount(), phase);
+		AddEnginePhaseRows(results, "cpu", (uint64)threadCount, dynamicParticlesBufferManager.GetParticleCount(), statistics);
+	}
+
+	if (runGPU)
+	{
+		OpenCLContext clContext;
+
+		if (clContext.context == nullptr)
+		{
+			//Not a failure, the benchmark is also meant for machines without a GPU
+			Debug::Logger::LogWarning("SPH Benchmark", "No suitable OpenCL device found, the GPU engine is skipped");
+
+			if (!runCPU)
+				results.SetFailed();
+
+			return results;
+		}
+
+		//An empty name runs the scan the scene selects
+		std::vector<std::string> scans;
+		for (uintMem begin = 0; begin <= gpuScans.size() && !gpuScans.empty();)
+		{
+			uintMem end = std::min(gpuScans.find(',', begin), gpuScans.size());
+			scans.push_back(gpuScans.substr(begin, end - begin));
+			begin = end + 1;
+		}
+		if (scans.empty())
+			scans.push_back("");
+
+		cl_command_queue clCommandQueue = clContext.GetCommandQueue(true, true);
+
+		for (const std::string& scan : scans)
+		{
+			if (scan == "upDownSweep" || scan == "reduceThenScan")
+				scene.SetOtherParameter("upDownSweepScan", scan == "upDownSweep" ? "true" : "false");
+			else if (!scan.empty())
+			{
+				Debug::Logger::LogError("SPH Benchmark", "Invalid value for argument \"--gpuScans\", the scans must be \"reduceThenScan\" or \"upDownSweep\"");
+				results.SetFailed();
+				break;
+			}
+
+			std::string engineLabel = scan.empty() ? "gpu" : "gpu:" + scan;
+
+			OfflineGPUParticleBufferManager dynamicParticlesBufferManager{ clContext.context, clContext.device, clCommandQueue };
+			OfflineGPUParticleBufferManager staticParticlesBufferManager{ clContext.context, clContext.device, clCommandQueue };
+			SimulationEngineGPU engine{ clContext.context, clContext.device, clCommandQueue };
+
+			SimulationStatistics statistics;
+			auto phases = RunScene(scene, engine, dynamicParticlesBufferManager, staticParticlesBufferManager, warmupUpdates, updates, stepsPerUpdate, deltaTime, ReadParticlesGPU(clCommandQueue), statistics);
+
+			for (auto& phase : phases)
+				AddPhaseRow(results, engineLabel.c_str(), "-", dynamicParticlesBufferManager.GetParticleCount(), phase);
+			AddEnginePhaseRows(results, engineLabel.c_str(), "-", dynamicParticlesBufferManager.GetParticleCount(), statistics);
+
+			//A scene with "integrityCheckInterval" validates the scanned hash maps on the host
+			if (engine.GetIntegrityCheckStatistics().errorCount != 0)
+				results.SetFailed();
+
+			engine.Clear();
+		}
+
+		clReleaseCommandQueue(clCommandQueue);
+	}
+
+	return results;
+}
\ No newline at end of file
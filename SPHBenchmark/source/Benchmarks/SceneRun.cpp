@@ -0,0 +1,126 @@
+#include "pch.h"
+#include "Benchmarks/SceneRun.h"
+#include "SPH/ParticleBufferManagers/OfflineCPUParticleBufferManager.h"
+#include "SPH/ParticleBufferManagers/OfflineGPUParticleBufferManager.h"
+#include "SPH/SimulationEngines/SimulationEngineGPU.h"
+#include "CL/cl.h"
+
+using namespace SPH;
+
+SceneRunResult RunSceneCPU(SceneBlueprint& scene, uintMem threadCount, uintMem steps, float deltaTime, const std::function<void(SimulationEngineCPU&)>& configure, const std::function<void(SimulationEngineCPU&)>& inspect)
+{
+	OfflineCPUParticleBufferManager dynamicParticlesBufferManager;
+	OfflineCPUParticleBufferManager staticParticlesBufferManager;
+
+	SimulationEngineCPU engine{ threadCount };
+	if (configure)
+		configure(engine);
+	engine.Initialize(scene, dynamicParticlesBufferManager, staticParticlesBufferManager);
+	engine.FinishUpdates();
+
+	SceneRunResult result{ .bestSecondsPerStep = DBL_MAX, .meanSecondsPerStep = 0 };
+
+	//The engine drops updates while one is running, so every step is waited for
+	for (uintMem i = 0; i < steps; ++i)
+	{
+		auto start = std::chrono::steady_clock::now();
+
+		engine.Update(deltaTime, 1);
+		engine.FinishUpdates();
+
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		result.bestSecondsPerStep = std::min(result.bestSecondsPerStep, seconds);
+		result.meanSecondsPerStep += seconds / steps;
+	}
+
+	if (inspect)
+		inspect(engine);
+
+	dynamicParticlesBufferManager.FlushAllOperations();
+
+	uintMem particleCount = dynamicParticlesBufferManager.GetParticleCount();
+	result.particles.Resize(particleCount);
+
+	ResourceLockGuard lockGuard = dynamicParticlesBufferManager.LockRead(nullptr);
+	if (dynamicParticlesBufferManager.GetLayout() == ParticleBufferLayout::StructOfArrays)
+		ConvertParticlesToArrayOfStructs(lockGuard.GetResource(), result.particles.Ptr(), sizeof(DynamicParticle), particleCount);
+	else
+		memcpy(result.particles.Ptr(), lockGuard.GetResource(), particleCount * sizeof(DynamicParticle));
+	lockGuard.Unlock({});
+
+	return result;
+}
+
+GPUSceneRunResult RunSceneGPU(SceneBlueprint& scene, OpenCLContext& clContext, cl_command_queue clCommandQueue, uintMem checkSteps, uintMem steps, float deltaTime)
+{
+	OfflineGPUParticleBufferManager dynamicParticlesBufferManager{ clContext.context, clContext.device, clCommandQueue };
+	OfflineGPUParticleBufferManager staticParticlesBufferManager{ clContext.context, clContext.device, clCommandQueue };
+	SimulationEngineGPU engine{ clContext.context, clContext.device, clCommandQueue };
+
+	GPUSceneRunResult result{ .bestSecondsPerStep = DBL_MAX, .meanSecondsPerStep = 0 };
+
+	engine.Initialize(scene, dynamicParticlesBufferManager, staticParticlesBufferManager);
+	engine.Update(deltaTime, (uint)checkSteps);
+	engine.FinishUpdates();
+
+	uintMem particleCount = dynamicParticlesBufferManager.GetParticleCount();
+	result.particles.Resize(particleCount);
+
+	cl_event lockAcquiredEvent = nullptr;
+	ResourceLockGuard lockGuard = dynamicParticlesBufferManager.LockRead(&lockAcquiredEvent);
+	if (clEnqueueReadBuffer(clCommandQueue, (cl_mem)lockGuard.GetResource(), CL_TRUE, 0, particleCount * sizeof(DynamicParticle), result.particles.Ptr(), lockAcquiredEvent == nullptr ? 0 : 1, lockAcquiredEvent == nullptr ? nullptr : &lockAcquiredEvent, nullptr) != CL_SUCCESS)
+		Debug::Logger::LogError("SPH Benchmark", "Failed to read the GPU particles back to the host");
+	if (lockAcquiredEvent != nullptr)
+		clReleaseEvent(lockAcquiredEvent);
+	lockGuard.Unlock({});
+
+	engine.ResetStatistics();
+
+	for (uintMem i = 0; i < steps; ++i)
+	{
+		auto start = std::chrono::steady_clock::now();
+
+		engine.Update(deltaTime, 1);
+		engine.FinishUpdates();
+
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		result.bestSecondsPerStep = std::min(result.bestSecondsPerStep, seconds);
+		result.meanSecondsPerStep += seconds / steps;
+	}
+
+	result.statistics = engine.GetStatistics();
+	result.integrityCheckStatistics = engine.GetIntegrityCheckStatistics();
+
+	engine.Clear();
+
+	return result;
+}
+
+double MaxParticleError(const Array<DynamicParticle>& particles, const Array<DynamicParticle>& referenceParticles)
+{
+	if (particles.Count() != referenceParticles.Count())
+		return DBL_MAX;
+
+	auto error = [](float value, float reference) {
+		return std::abs((double)value - reference) / std::max(1.0, std::abs((double)reference));
+		};
+
+	double maxError = 0;
+	for (uintMem i = 0; i < particles.Count(); ++i)
+	{
+		const DynamicParticle& particle = particles[i];
+		const DynamicParticle& reference = referenceParticles[i];
+
+		maxError = std::max({ maxError,
+			error(particle.position.x, reference.position.x),
+			error(particle.position.y, reference.position.y),
+			error(particle.position.z, reference.position.z),
+			error(particle.velocity.x, reference.velocity.x),
+			error(particle.velocity.y, reference.velocity.y),
+			error(particle.velocity.z, reference.velocity.z),
+			error(particle.pressure, reference.pressure),
+			});
+	}
+
+	return maxError;
+}
\ No newline at end of file
@@ -0,0 +1,49 @@
+#pragma once
+#include "SPH/Core/SceneBlueprint.h"
+#include "SPH/SimulationEngines/SimulationEngineCPU.h"
+#include "SPH/OpenCL/OpenCLContext.h"
+
+/*
+	Helpers shared by the benchmarks that run whole scenes with the CPU or the GPU engine
+*/
+
+struct SceneRunResult
+{
+	double bestSecondsPerStep;
+	double meanSecondsPerStep;
+	//The dynamic particles after the last step, in the ArrayOfStructs layout
+	Array<SPH::DynamicParticle> particles;
+};
+
+/*
+	Initializes a CPU engine with offline buffer managers and times the steps one by one. 'configure' is called before
+	the engine is initialized and 'inspect' after the last step, while the engine still exists. Both can be empty.
+*/
+SceneRunResult RunSceneCPU(
+	SPH::SceneBlueprint& scene,
+	uintMem threadCount,
+	uintMem steps,
+	float deltaTime,
+	const std::function<void(SPH::SimulationEngineCPU&)>& configure = { },
+	const std::function<void(SPH::SimulationEngineCPU&)>& inspect = { }
+);
+
+struct GPUSceneRunResult
+{
+	double bestSecondsPerStep;
+	double meanSecondsPerStep;
+	//The dynamic particles after the checked steps
+	Array<SPH::DynamicParticle> particles;
+	//Of the timed steps only
+	SPH::SimulationStatistics statistics;
+	SPH::IntegrityCheckStatistics integrityCheckStatistics;
+};
+
+/*
+	Initializes a GPU engine with offline buffer managers, runs 'checkSteps' steps and reads the dynamic particles back,
+	then times 'steps' more steps one by one.
+*/
+GPUSceneRunResult RunSceneGPU(SPH::SceneBlueprint& scene, OpenCLContext& clContext, cl_command_queue clCommandQueue, uintMem checkSteps, uintMem steps, float deltaTime);
+
+//Largest difference of the particle values, relative to the reference value when its magnitude is larger than 1
+double MaxParticleError(const Array<SPH::DynamicParticle>& particles, const Array<SPH::DynamicParticle>& referenceParticles);
\ No newline at end of file
@@ -0,0 +1,74 @@
+#include "pch.h"
+#include "Benchmarks/Benchmarks.h"
+#include "Benchmarks/SceneRun.h"
+
+using namespace SPH;
+
+/*
+	Runs a scene with the threads not pinned, pinned compactly and scattered over the NUMA nodes, for every thread
+	count. The particle buffers and the maps are first touched by the threads that update them, so on a machine with
+	more than one NUMA node the pinned runs keep the static split of the particles node-local. The processors of the
+	threads are reported as a list. Pinning doesn't change the results, only the time.
+
+	Options:
+		--scene <path>            - scene file, required
+		--steps <n>               - timed simulation steps, default 20
+		--threads <n,m,...>       - thread counts, default 1 and the hardware thread count
+		--deltaTime <x>           - time step, default 0.01
+*/
+BenchmarkResults RunThreadAffinityBenchmark(const CommandLineArguments& arguments)
+{
+	BenchmarkResults results{ { "affinity", "threadCount", "steps", "bestMillisecondsPerStep", "meanMillisecondsPerStep", "speedup", "processors" } };
+
+	std::string scenePath = arguments.Get("scene", "");
+	uintMem steps = std::max<uint64>(1, arguments.GetUInt("steps", 20));
+	std::vector<uint64> threadCounts = arguments.GetUIntList("threads", { 1, std::max(1u, std::thread::hardware_concurrency()) });
+	float deltaTime = (float)arguments.GetDouble("deltaTime", 0.01);
+
+	SceneBlueprint scene;
+	if (scenePath.empty() || !scene.LoadScene(Path(scenePath.c_str())))
+	{
+		Debug::Logger::LogError("SPH Benchmark", "The thread affinity benchmark needs a valid scene file given with \"--scene\"");
+		results.SetFailed();
+		return results;
+	}
+
+	struct Policy
+	{
+		const char* name;
+		ThreadAffinityPolicy policy;
+	};
+	const Policy policies[] = {
+		{ "none", ThreadAffinityPolicy::None },
+		{ "compact", ThreadAffinityPolicy::Compact },
+		{ "scatter", ThreadAffinityPolicy::Scatter },
+	};
+
+	for (uint64 threadCount : threadCounts)
+	{
+		threadCount = std::max<uint64>(1, threadCount);
+
+		double referenceSecondsPerStep = 0;
+
+		for (const Policy& policy : policies)
+		{
+			std::string processors;
+			SceneRunResult run = RunSceneCPU(scene, threadCount, steps, deltaTime, [&](SimulationEngineCPU& engine) {
+				engine.SetThreadAffinity(policy.policy);
+				}, [&](SimulationEngineCPU& engine) {
+					for (uintMem i = 0; i < threadCount; ++i)
+					{
+						uint32 processor = engine.GetThreadProcessor(i);
+						processors += (i == 0 ? "" : ",") + (processor == UINT32_MAX ? std::string("-") : std::to_string(processor));
+					}
+				});
+
+			if (policy.policy == ThreadAffinityPolicy::None)
+				referenceSecondsPerStep = run.meanSecondsPerStep;
+
+			results.AddRow({ policy.name, threadCount, (uint64)steps, run.bestSecondsPerStep * 1e3, run.meanSecondsPerStep * 1e3, referenceSecondsPerStep / run.meanSecondsPerStep, processors });
+		}
+	}
+
+	return results;
+}
\ No newline at end of file
@@ -0,0 +1,92 @@
+#include "pch.h"
+#include "Benchmarks/Benchmarks.h"
+#include "Benchmarks/SceneRun.h"
+
+using namespace SPH;
+
+/*
+	Runs a scene without the Verlet lists and then with them for every skin distance. A larger skin makes the lists
+	longer but they are rebuilt less often. The lists are also rebuilt every time the particles are reordered, so the
+	"reorderTimeInterval" of the scene limits how much they can be reused. The neighbour search is timed with the best
+	supported instruction set because the Verlet lists replace it. Each skin distance is first run for a few steps on one
+	thread and compared with the neighbour search, the benchmark fails if the difference is larger than the tolerance.
+	The dynamic particles are always in the StructOfArrays layout because the lists are only implemented for it.
+
+	Options:
+		--scene <path>            - scene file, required
+		--steps <n>               - timed simulation steps, default 20
+		--threads <n>             - threads used for the timed runs, default the hardware thread count
+		--deltaTime <x>           - time step, default 0.01
+		--skins <x,y,...>         - skin distances relative to the max interaction distance, at most 1, default 0.1,0.2,0.5
+		--validationSteps <n>     - steps compared with the neighbour search, default 10 so that the lists are reused
+		--tolerance <x>           - largest allowed error relative to max(1, |neighbour search value|), default 1e-4
+*/
+BenchmarkResults RunVerletListBenchmark(const CommandLineArguments& arguments)
+{
+	BenchmarkResults results{ { "skinDistance", "threadCount", "steps", "bestMillisecondsPerStep", "meanMillisecondsPerStep", "speedup", "rebuildCount", "stepsPerRebuild", "listEntriesPerParticle", "memoryMegabytes", "validationError", "validation" } };
+
+	std::string scenePath = arguments.Get("scene", "");
+	uintMem steps = std::max<uint64>(1, arguments.GetUInt("steps", 20));
+	uintMem threadCount = std::max<uint64>(1, arguments.GetUInt("threads", std::max(1u, std::thread::hardware_concurrency())));
+	float deltaTime = (float)arguments.GetDouble("deltaTime", 0.01);
+	std::vector<double> skins = arguments.GetDoubleList("skins", { 0.1, 0.2, 0.5 });
+	uintMem validationSteps = std::max<uint64>(1, arguments.GetUInt("validationSteps", 10));
+	double tolerance = arguments.GetDouble("tolerance", 1e-4);
+
+	SceneBlueprint scene;
+	if (scenePath.empty() || !scene.LoadScene(Path(scenePath.c_str())))
+	{
+		Debug::Logger::LogError("SPH Benchmark", "The Verlet list benchmark needs a valid scene file given with \"--scene\"");
+		results.SetFailed();
+		return results;
+	}
+
+	float maxInteractionDistance = scene.GetSystemParameters().particleBehaviourParameters.maxInteractionDistance;
+
+	scene.SetOtherParameter("structOfArrays", "true");
+	scene.SetOtherParameter("halfNeighbourhood", "false");
+
+	scene.SetOtherParameter("verletLists", "false");
+	SceneRunResult validationReference = RunSceneCPU(scene, 1, validationSteps, deltaTime);
+	SceneRunResult searchRun = RunSceneCPU(scene, threadCount, steps, deltaTime);
+
+	results.AddRow({ "-", (uint64)threadCount, (uint64)steps, searchRun.bestSecondsPerStep * 1e3, searchRun.meanSecondsPerStep * 1e3, 1.0, (uint64)0, 0.0, 0.0, 0.0, 0.0, "reference" });
+
+	scene.SetOtherParameter("verletLists", "true");
+
+	for (double skin : skins)
+	{
+		skin = std::clamp(skin, 0.0, 1.0);
+		std::string skinDistance = std::to_string(skin * maxInteractionDistance);
+		scene.SetOtherParameter("verletSkinDistance", StringView(skinDistance.data(), skinDistance.size()));
+
+		double validationError = MaxParticleError(RunSceneCPU(scene, 1, validationSteps, deltaTime).particles, validationReference.particles);
+
+		if (validationError > tolerance)
+			results.SetFailed();
+
+		VerletListStatistics statistics;
+		SceneRunResult run = RunSceneCPU(scene, threadCount, steps, deltaTime, { }, [&](SimulationEngineCPU& engine) {
+			statistics = engine.GetVerletListStatistics();
+			});
+
+		double particleCount = (double)std::max<uintMem>(1, run.particles.Count());
+
+		results.AddRow({
+			skinDistance,
+			(uint64)threadCount,
+			(uint64)steps,
+			run.bestSecondsPerStep * 1e3,
+			run.meanSecondsPerStep * 1e3,
+			searchRun.meanSecondsPerStep / run.meanSecondsPerStep,
+			statistics.rebuildCount,
+			(double)statistics.stepCount / std::max<uint64>(1, statistics.rebuildCount),
+			(double)(statistics.dynamicNeighbourCount + statistics.staticNeighbourCount) / particleCount,
+			statistics.memoryBytes / (1024.0 * 1024.0),
+			validationError,
+			validationError <= tolerance ? "passed" : "failed"
+			});
+	}
+
+	return results;
+}
\ No newline at end of file
@@ -0,0 +1,137 @@
+#include "pch.h"
+#include "CommandLineArguments.h"
+
+CommandLineArguments::CommandLineArguments(int argc, char* argv[])
+{
+	int i = 1;
+
+	if (i < argc && strncmp(argv[i], "--", 2) != 0)
+		command = argv[i++];
+
+	for (; i < argc; ++i)
+	{
+		if (strncmp(argv[i], "--", 2) != 0)
+		{
+			Debug::Logger::LogWarning("SPH Benchmark", "Ignoring unexpected command line argument \"" + StringView(argv[i], strlen(argv[i])) + "\"");
+			continue;
+		}
+
+		Argument argument{ .name = argv[i] + 2 };
+
+		if (i + 1 < argc && strncmp(argv[i + 1], "--", 2) != 0)
+			argument.value = argv[++i];
+
+		arguments.push_back(std::move(argument));
+	}
+}
+bool CommandLineArguments::Has(const std::string& name) const
+{
+	return Find(name) != nullptr;
+}
+std::string CommandLineArguments::Get(const std::string& name, const std::string& defaultValue) const
+{
+	const Argument* argument = Find(name);
+	return argument == nullptr ? defaultValue : argument->value;
+}
+uint64 CommandLineArguments::GetUInt(const std::string& name, uint64 defaultValue) const
+{
+	const Argument* argument = Find(name);
+
+	if (argument == nullptr)
+		return defaultValue;
+
+	try
+	{
+		return std::stoull(argument->value);
+	}
+	catch (const std::exception&)
+	{
+		Debug::Logger::LogWarning("SPH Benchmark", "Invalid value for argument \"--" + StringView(name.data(), name.size()) + "\"");
+		return defaultValue;
+	}
+}
+double CommandLineArguments::GetDouble(const std::string& name, double defaultValue) const
+{
+	const Argument* argument = Find(name);
+
+	if (argument == nullptr)
+		return defaultValue;
+
+	try
+	{
+		return std::stod(argument->value);
+	}
+	catch (const std::exception&)
+	{
+		Debug::Logger::LogWarning("SPH Benchmark", "Invalid value for argument \"--" + StringView(name.data(), name.size()) + "\"");
+		return defaultValue;
+	}
+}
+std::vector<uint64> CommandLineArguments::GetUIntList(const std::string& name, std::vector<uint64> defaultValue) const
+{
+	const Argument* argument = Find(name);
+
+	if (argument == nullptr)
+		return defaultValue;
+
+	std::vector<uint64> out;
+
+	try
+	{
+		uintMem begin = 0;
+		while (begin < argument->value.size())
+		{
+			uintMem end = argument->value.find(',', begin);
+			if (end == std::string::npos)
+				end = argument->value.size();
+
+			out.push_back(std::stoull(argument->value.substr(begin, end - begin)));
+			begin = end + 1;
+		}
+	}
+	catch (const std::exception&)
+	{
+		Debug::Logger::LogWarning("SPH Benchmark", "Invalid value for argument \"--" + StringView(name.data(), name.size()) + "\"");
+		return defaultValue;
+	}
+
+	return out;
+}
+std::vector<double> CommandLineArguments::GetDoubleList(const std::string& name, std::vector<double> defaultValue) const
+{
+	const Argument* argument = Find(name);
+
+	if (argument == nullptr)
+		return defaultValue;
+
+	std::vector<double> out;
+
+	try
+	{
+		uintMem begin = 0;
+		while (begin < argument->value.size())
+		{
+			uintMem end = argument->value.find(',', begin);
+			if (end == std::string::npos)
+				end = argument->value.size();
+
+			out.push_back(std::stod(argument->value.substr(begin, end - begin)));
+			begin = end + 1;
+		}
+	}
+	catch (const std::exception&)
+	{
+		Debug::Logger::LogWarning("SPH Benchmark", "Invalid value for argument \"--" + StringView(name.data(), name.size()) + "\"");
+		return defaultValue;
+	}
+
+	return out;
+}
+const CommandLineArguments::Argument* CommandLineArguments::Find(const std::string& name) const
+{
+	for (auto& argument : arguments)
+		if (argument.name == name)
+			return &argument;
+
+	return nullptr;
+}
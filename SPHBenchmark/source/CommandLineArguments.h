@@ -0,0 +1,33 @@
+#pragma once
+
+/*
+	Parses arguments of the form "<command> --name value --flag ..."
+*/
+class CommandLineArguments
+{
+public:
+	CommandLineArguments(int argc, char* argv[]);
+
+	inline const std::string& GetCommand() const { return command; }
+
+	bool Has(const std::string& name) const;
+	std::string Get(const std::string& name, const std::string& defaultValue) const;
+	uint64 GetUInt(const std::string& name, uint64 defaultValue) const;
+	double GetDouble(const std::string& name, double defaultValue) const;
+	/*
+		Parses a comma separated list, for example "--threads 1,2,4,8"
+	*/
+	std::vector<uint64> GetUIntList(const std::string& name, std::vector<uint64> defaultValue) const;
+	std::vector<double> GetDoubleList(const std::string& name, std::vector<double> defaultValue) const;
+private:
+	struct Argument
+	{
+		std::string name;
+		std::string value;
+	};
+
+	std::string command;
+	std::vector<Argument> arguments;
+
+	const Argument* Find(const std::string& name) const;
+};
@@ -0,0 +1,73 @@
+#include "pch.h"
+#include "CommandLineArguments.h"
+#include "BenchmarkResults.h"
+#include "Benchmarks/Benchmarks.h"
+
+struct BenchmarkEntry
+{
+	const char* name;
+	const char* description;
+	BenchmarkResults(*function)(const CommandLineArguments&);
+};
+
+static const BenchmarkEntry benchmarks[]{
+	{ "scene", "Per phase wall clock times of a scene file run headless with the CPU and GPU engines", RunSceneBenchmark },
+	{ "barrier", "ThreadContext::SyncThreads() latency by barrier type and thread count", RunBarrierBenchmark },
+	{ "kernels", "CPU neighbour kernel time per instruction set, validated against the scalar kernels", RunKernelBenchmark },
+	{ "neighbourGrid", "Wasted neighbour candidates and step time of the Morton hash map and the dense grid", RunNeighbourGridBenchmark },
+	{ "halfNeighbourhood", "Dynamic particle distance evaluations and step time of the full and half neighbourhood traversal", RunHalfNeighbourhoodBenchmark },
+	{ "verletLists", "Step time, rebuild frequency and memory of the Verlet lists for different skin distances", RunVerletListBenchmark },
+	{ "integrityCheck", "Step time of the integrity checks for different check intervals", RunIntegrityCheckBenchmark },
+	{ "prefixSum", "Prefix sum time of the dynamic hash map with the serial, group sum and parallel scan", RunPrefixSumBenchmark },
+	{ "hashHistograms", "Step time and modelled memory traffic of the hash map built with atomics and with private histograms", RunHashHistogramBenchmark },
+	{ "particleSort", "Step time, churn and thread count independence of the particles sorted by bucket every step, fully and incrementally", RunParticleSortBenchmark },
+	{ "reorderSchedule", "Step time and reorderings of the particles reordered by a time interval and adaptively by their locality", RunReorderScheduleBenchmark },
+	{ "cellBlocked", "Step time of the particles evaluated one by one and cell by cell with gathered neighbour candidates", RunCellBlockedBenchmark },
+	{ "dynamicScheduling", "Step time and busy and idle time of the threads with the passes split statically and scheduled dynamically in chunks", RunDynamicSchedulingBenchmark },
+	{ "threadAffinity", "Step time with the threads not pinned, pinned compactly and scattered over the NUMA nodes", RunThreadAffinityBenchmark },
+	{ "pageSize", "Step time and data TLB misses with the particle buffers and maps in default, transparent large, 2 MiB and 1 GiB pages", RunPageSizeBenchmark },
+	{ "allocations", "Heap allocations of the CPU engine updates after the warmup steps, for the optional paths of the engine", RunAllocationBenchmark },
+	{ "gpuTiling", "Results and kernel times of the GPU pressure and dynamics kernels with and without the neighbours staged in local memory", RunGPUTilingBenchmark },
+	{ "gpuSort", "Step time, integrity and run to run reproducibility of the GPU hash map built by atomics and by the radix sort", RunGPUSortBenchmark },
+	{ "gpuProgramCache", "Startup time of the GPU engine kernels built from the source and loaded from the program binary cache", RunGPUProgramCacheBenchmark },
+};
+
+static void PrintUsage()
+{
+	printf(
+		"Usage: SPHBenchmark <benchmark> [--option value]...\n"
+		"\n"
+		"Benchmarks:\n"
+	);
+
+	for (auto& benchmark : benchmarks)
+		printf("  %-16s %s\n", benchmark.name, benchmark.description);
+
+	printf(
+		"\n"
+		"Common options:\n"
+		"  --output <path>  also writes the results to a file, '.json' files get JSON and anything else CSV\n"
+	);
+}
+
+int main(int argc, char* argv[])
+{
+	CommandLineArguments arguments{ argc, argv };
+
+	for (auto& benchmark : benchmarks)
+	{
+		if (arguments.GetCommand() != benchmark.name)
+			continue;
+
+		BenchmarkResults results = benchmark.function(arguments);
+		results.Print();
+
+		if (arguments.Has("output") && !results.WriteToFile(arguments.Get("output", "")))
+			return 1;
+
+		return results.Failed() ? 1 : 0;
+	}
+
+	PrintUsage();
+	return arguments.GetCommand().empty() ? 0 : 1;
+}
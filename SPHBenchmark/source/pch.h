@@ -0,0 +1,14 @@
+#pragma once
+#include "BlazeEngine/BlazeEngineCore.h"
+//Needed by the OpenCL context header, no OpenGL context is created
+#define GRAPHICS_OPENGL
+#include "BlazeEngine/BlazeEngineGraphics.h"
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <cstdio>
+
+using namespace Blaze;
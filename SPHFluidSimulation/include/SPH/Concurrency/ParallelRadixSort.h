@@ -0,0 +1,65 @@
+#pragma once
+#include "SPH/Concurrency/ThreadParallelTaskManager.h"
+#include <algorithm>
+
+namespace SPH
+{
+	/*
+		Stable LSD radix sort of the first 'count' keys and their values, called by every thread of a task. Every pass
+		sorts by the next 8 bits of the keys until the lowest 'keyBits' bits are sorted. In a pass each thread counts the
+		digits of its block of the keys into its own 256 entries of 'digitCounts', which needs them for every thread.
+		After 'sync' synchronizes the threads, each of them places its keys of a digit after all the keys with a smaller
+		digit and after the keys with the same digit of the blocks before its own, in the order they are in its block,
+		so the sort is stable. The passes move the keys and values back and forth between their arrays and the
+		temporary ones, returns true when the sorted ones end up in the temporary arrays.
+	*/
+	template<typename Sync> requires std::invocable<Sync>
+	bool ParallelRadixSort(const ThreadContext& context, uint32* keys, uint32* values, uint32* tempKeys, uint32* tempValues, uintMem count, uint32 keyBits, uint32* digitCounts, const Sync& sync)
+	{
+		constexpr uint32 DigitBits = 8;
+		constexpr uint32 DigitCount = 1u << DigitBits;
+
+		uintMem threadIndex = context.GetThreadIndex();
+		uintMem threadCount = context.GetThreadCount();
+		uintMem begin = count * threadIndex / threadCount;
+		uintMem end = count * (threadIndex + 1) / threadCount;
+		uint32* threadDigitCounts = digitCounts + threadIndex * DigitCount;
+
+		bool sortedIntoTemp = false;
+		for (uint32 shift = 0; shift < keyBits; shift += DigitBits)
+		{
+			std::fill_n(threadDigitCounts, DigitCount, 0);
+			for (uintMem i = begin; i < end; ++i)
+				++threadDigitCounts[(keys[i] >> shift) & (DigitCount - 1)];
+
+			sync();
+
+			//The thread count is small so every thread computes its offsets itself instead of synchronizing again
+			uint32 offsets[DigitCount];
+			uint32 offset = 0;
+			for (uint32 digit = 0; digit < DigitCount; ++digit)
+				for (uintMem i = 0; i < threadCount; ++i)
+				{
+					if (i == threadIndex)
+						offsets[digit] = offset;
+
+					offset += digitCounts[i * DigitCount + digit];
+				}
+
+			for (uintMem i = begin; i < end; ++i)
+			{
+				uint32 index = offsets[(keys[i] >> shift) & (DigitCount - 1)]++;
+				tempKeys[index] = keys[i];
+				tempValues[index] = values[i];
+			}
+
+			sync();
+
+			std::swap(keys, tempKeys);
+			std::swap(values, tempValues);
+			sortedIntoTemp = !sortedIntoTemp;
+		}
+
+		return sortedIntoTemp;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,52 @@
+#pragma once
+#include "SPH/Concurrency/ThreadParallelTaskManager.h"
+#include <atomic>
+
+namespace SPH
+{
+	/*
+		Inclusive scan of the first 'count' values, called by every thread of a task. Each thread sums its block of the
+		values and stores the sum into 'blockSums', which needs an entry for every thread. After 'sync' synchronizes the
+		threads, each of them adds up the sums of the blocks before its own and scans its block starting from that
+		offset. Every value is read twice and written once. The values can be atomics, they are accessed with relaxed
+		order because 'sync' orders the accesses of the threads.
+	*/
+	template<typename T, typename Sync> requires std::invocable<Sync>
+	void ParallelInclusiveScan(const ThreadContext& context, T* values, uintMem count, uint32* blockSums, const Sync& sync)
+	{
+		auto load = [](const T& value) -> uint32 {
+			if constexpr (std::is_same_v<T, std::atomic_uint32_t>)
+				return value.load(std::memory_order_relaxed);
+			else
+				return value;
+			};
+		auto store = [](T& value, uint32 newValue) {
+			if constexpr (std::is_same_v<T, std::atomic_uint32_t>)
+				value.store(newValue, std::memory_order_relaxed);
+			else
+				value = newValue;
+			};
+
+		uintMem threadIndex = context.GetThreadIndex();
+		uintMem begin = count * threadIndex / context.GetThreadCount();
+		uintMem end = count * (threadIndex + 1) / context.GetThreadCount();
+
+		uint32 blockSum = 0;
+		for (uintMem i = begin; i < end; ++i)
+			blockSum += load(values[i]);
+		blockSums[threadIndex] = blockSum;
+
+		sync();
+
+		//The thread count is small so every thread scans the block sums itself instead of synchronizing again
+		uint32 sum = 0;
+		for (uintMem i = 0; i < threadIndex; ++i)
+			sum += blockSums[i];
+
+		for (uintMem i = begin; i < end; ++i)
+		{
+			sum += load(values[i]);
+			store(values[i], sum);
+		}
+	}
+}
\ No newline at end of file
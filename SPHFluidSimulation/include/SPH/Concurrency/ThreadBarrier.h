@@ -0,0 +1,34 @@
+#pragma once
+#include <atomic>
+
+namespace SPH
+{
+	/*
+		Sense-reversing barrier. The last thread to arrive flips the shared sense, the other threads spin on it
+		for a short while and then block with std::atomic::wait (a futex on Linux, WaitOnAddress on Windows).
+	*/
+	class ThreadBarrier
+	{
+	public:
+		ThreadBarrier();
+
+		/*
+			Must not be called while any thread is waiting on the barrier
+		*/
+		void SetThreadCount(uintMem threadCount);
+		void SetSpinCount(uint32 spinCount);
+
+		/*
+			\param localSense - state owned by the calling thread, it has to be 0 before the first call and must not
+			be modified between calls
+		*/
+		void Wait(uint32& localSense);
+
+		inline uintMem GetThreadCount() const { return threadCount; }
+	private:
+		alignas(64) std::atomic_uint32_t arrivedCount;
+		alignas(64) std::atomic_uint32_t sense;
+		uint32 threadCount;
+		uint32 spinCount;
+	};
+}
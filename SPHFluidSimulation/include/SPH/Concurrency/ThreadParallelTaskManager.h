@@ -1,5 +1,8 @@
 #pragma once
 #include "SPH/Concurrency/ThreadPool.h"
+#include "SPH/Concurrency/ThreadBarrier.h"
+#include <chrono>
+#include <cstddef>
 
 namespace SPH
 {
@@ -16,6 +19,18 @@ namespace SPH
 
 		void SyncThreads() const;
 
+		/*
+			Dynamically scheduled loop over [begin, end), called by every thread of the task. The range is split into
+			chunks of 'chunkSize' indices and every thread begins with its static share of them, which it takes from
+			the front. A thread whose share is done steals chunks from the back of the shares of the other threads, so
+			the threads whose indices take longer don't keep the others waiting. 'function' is called with the
+			beginning and the end of every chunk. The threads must be synchronized between two calls, the chunks are
+			only claimed with atomics. The time the threads spent in the loops is recorded, see
+			ThreadParallelTaskManager::GetParallelForStatistics
+		*/
+		template<typename F> requires std::invocable<F, uintMem, uintMem>
+		void ParallelFor(uintMem begin, uintMem end, uintMem chunkSize, const F& function) const;
+
 		ThreadContext& operator=(ThreadContext&& other) noexcept;
 	private:
 		ThreadContext(ThreadParallelTaskManager& manager, uintMem threadIndex, uintMem threadCount);
@@ -25,10 +40,31 @@ namespace SPH
 		uintMem threadIndex;
 		uintMem threadCount;
 		ThreadParallelTaskManager* manager;
+		mutable uint32 barrierSense;
 
 		friend class ThreadParallelTaskManager;
 	};
 	 
+	enum class ThreadBarrierType
+	{
+		//All threads wait on a condition variable guarded by a single mutex
+		ConditionVariable,
+		//Sense-reversing atomic barrier, threads spin shortly and then wait on the atomic
+		SpinAndWait
+	};
+
+	//Work of the threads in the ThreadContext::ParallelFor loops since the threads were allocated or the statistics were
+	//reset. The idle time of a loop is the time a thread finished it before the slowest thread, which it then spends
+	//waiting at the next synchronization
+	struct ParallelForStatistics
+	{
+		uint64 loopCount = 0;
+		Array<double> threadBusySeconds;
+		Array<double> threadIdleSeconds;
+		Array<uint64> threadIndexCount;
+		Array<uint64> threadStolenChunkCount;
+	};
+
 	class ThreadParallelTaskManager
 	{
 	public:		
@@ -41,15 +77,63 @@ namespace SPH
 		void AllocateThreads(uintMem threads);
 
 		void FinishTasks();
+
+		/*
+			Selects how ThreadContext::SyncThreads() waits for the other threads. Must not be called while a task
+			is executing.
+		*/
+		void SetBarrierType(ThreadBarrierType barrierType);
+		inline ThreadBarrierType GetBarrierType() const { return barrierType; }
+
+		//The threads pin themselves before the next task they execute, see ThreadPool::SetAffinityPolicy
+		void SetThreadAffinityPolicy(ThreadAffinityPolicy policy, ArrayView<uint32> processors = { }) { threadPool.SetAffinityPolicy(policy, processors); }
+		inline ThreadAffinityPolicy GetThreadAffinityPolicy() const { return threadPool.GetAffinityPolicy(); }
+		inline uint32 GetThreadProcessor(uintMem threadIndex) const { return threadPool.GetThreadProcessor(threadIndex); }
+
 		template<typename Task>
 		void EnqueueTask(TaskFunction<Task> function, Task&& task);
 		template<typename Task>
 		bool TryEnqueueTask(TaskFunction<Task> function, Task&& task);
 
 		uintMem ThreadCount() const { return threadPool.ThreadCount(); }
+
+		//Must not be called while a task is executing
+		ParallelForStatistics GetParallelForStatistics();
+		void ResetParallelForStatistics();
 	private:
+		//The chunks of the share of one thread in a ThreadContext::ParallelFor loop are packed into 'chunks' as the
+		//epoch of the loop, the next chunk from the front and the end of the chunks not stolen from the back. Every
+		//thread counts its loops in 'epoch', so a share with an older epoch isn't set up yet and the thread that sees it
+		//first sets it up
+		struct alignas(64) ParallelForSlot
+		{
+			std::atomic_uint64_t chunks = 0;
+			uint16 epoch = 0;
+
+			//Written at the end of the even and odd loops, the idle time of a loop is added in the next one
+			std::chrono::steady_clock::time_point loopEnd[2];
+			bool idlePending = false;
+
+			uint64 busyNanoseconds = 0;
+			uint64 idleNanoseconds = 0;
+			uint64 indexCount = 0;
+			uint64 stolenChunkCount = 0;
+		};
+		static constexpr uint32 ParallelForChunkBits = 24;
+		static constexpr uint64 ParallelForChunkMask = (1ull << ParallelForChunkBits) - 1;
+
+		static uint64 PackParallelForChunks(uint16 epoch, uint64 front, uint64 back) { return ((uint64)epoch << (ParallelForChunkBits * 2)) | (front << ParallelForChunkBits) | back; }
+		//Sets up the share of the thread for the loop of the epoch unless another thread already did, returns the chunks
+		uint64 AcquireParallelForShare(uintMem threadIndex, uintMem threadCount, uint16 epoch, uint64 chunkCount) const;
+		//Adds the idle time of the last loop of the thread
+		void AddParallelForIdleTime(uintMem threadIndex, uint16 epoch) const;
+
+		mutable Array<ParallelForSlot> parallelForSlots;
+		uint64 parallelForLoopCount;
+
 		struct TaskDataBase
 		{
+			virtual ~TaskDataBase() { }
 			virtual void Execute(const ThreadContext&) { };
 		};
 		template<typename Task>
@@ -64,14 +148,34 @@ namespace SPH
 			void Execute(const ThreadContext& context) override { function(context, task); }
 		};
 
+		//The queued tasks are constructed in place in a ring of fixed slots, so enqueuing a task doesn't allocate
+		static constexpr uintMem MaxQueuedTaskCount = 3;
+		static constexpr uintMem TaskSlotSize = 1024;
+		struct TaskSlot
+		{
+			alignas(std::max_align_t) std::byte storage[TaskSlotSize];
+			TaskDataBase* task = nullptr;
+		};
+
+		//These must be called with 'stateMutex' locked
+		template<typename Task>
+		void PushTask(TaskFunction<Task> function, Task&& task);
+		TaskDataBase& GetFirstTask();
+		void PopTask();
+
 		ThreadPool threadPool;		
 
 		std::mutex stateMutex;
 		std::condition_variable stateCV;
-		VirtualList<TaskDataBase> tasks;
+		TaskSlot taskSlots[MaxQueuedTaskCount];
+		uintMem firstTaskIndex;
+		uintMem taskCount;
 		bool exit;
 		uintMem threadIdleCount;		
 
+		ThreadBarrierType barrierType;
+		ThreadBarrier barrier;
+
 		mutable std::mutex syncMutex;
 		mutable std::condition_variable syncCV;
 		mutable uintMem threadSyncCount1;
@@ -81,6 +185,79 @@ namespace SPH
 
 		friend class ThreadContext;
 	};
+	template<typename F> requires std::invocable<F, uintMem, uintMem>
+	inline void ThreadContext::ParallelFor(uintMem begin, uintMem end, uintMem chunkSize, const F& function) const
+	{
+		using Manager = ThreadParallelTaskManager;
+
+		auto loopBegin = std::chrono::steady_clock::now();
+
+		Manager::ParallelForSlot& slot = manager->parallelForSlots[threadIndex];
+		uint16 epoch = ++slot.epoch;
+
+		manager->AddParallelForIdleTime(threadIndex, epoch);
+
+		if (threadIndex == 0)
+			++manager->parallelForLoopCount;
+
+		//The chunk count must fit into its bits
+		uintMem count = end > begin ? end - begin : 0;
+		chunkSize = std::max<uintMem>({ chunkSize, 1, (count >> (Manager::ParallelForChunkBits - 1)) + 1 });
+		uint64 chunkCount = (count + chunkSize - 1) / chunkSize;
+
+		auto runChunk = [&](uint64 chunk) {
+			uintMem chunkBegin = begin + chunk * chunkSize;
+			uintMem chunkEnd = std::min(chunkBegin + chunkSize, end);
+			function(chunkBegin, chunkEnd);
+			slot.indexCount += chunkEnd - chunkBegin;
+			};
+
+		//Own chunks from the front
+		uint64 chunks = manager->AcquireParallelForShare(threadIndex, threadCount, epoch, chunkCount);
+		while (true)
+		{
+			uint64 front = (chunks >> Manager::ParallelForChunkBits) & Manager::ParallelForChunkMask;
+			uint64 back = chunks & Manager::ParallelForChunkMask;
+
+			if (front >= back)
+				break;
+
+			if (slot.chunks.compare_exchange_weak(chunks, Manager::PackParallelForChunks(epoch, front + 1, back), std::memory_order_relaxed))
+			{
+				runChunk(front);
+				chunks = slot.chunks.load(std::memory_order_relaxed);
+			}
+		}
+
+		//Chunks of the other threads from the back
+		for (uintMem i = 1; i < threadCount; ++i)
+		{
+			uintMem victimIndex = (threadIndex + i) % threadCount;
+			Manager::ParallelForSlot& victim = manager->parallelForSlots[victimIndex];
+
+			uint64 chunks = manager->AcquireParallelForShare(victimIndex, threadCount, epoch, chunkCount);
+			while (true)
+			{
+				uint64 front = (chunks >> Manager::ParallelForChunkBits) & Manager::ParallelForChunkMask;
+				uint64 back = chunks & Manager::ParallelForChunkMask;
+
+				if (front >= back)
+					break;
+
+				if (victim.chunks.compare_exchange_weak(chunks, Manager::PackParallelForChunks(epoch, front, back - 1), std::memory_order_relaxed))
+				{
+					runChunk(back - 1);
+					++slot.stolenChunkCount;
+					chunks = victim.chunks.load(std::memory_order_relaxed);
+				}
+			}
+		}
+
+		auto loopEnd = std::chrono::steady_clock::now();
+		slot.busyNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(loopEnd - loopBegin).count();
+		slot.loopEnd[epoch % 2] = loopEnd;
+		slot.idlePending = true;
+	}
 	template<typename Task>
 	inline void ThreadParallelTaskManager::EnqueueTask(TaskFunction<Task> function, Task&& task)
 	{
@@ -89,9 +266,9 @@ namespace SPH
 		else
 		{
 			std::unique_lock lk{ stateMutex };
-			stateCV.wait(lk, [&]() { return tasks.Count() < 3; });
+			stateCV.wait(lk, [&]() { return taskCount < MaxQueuedTaskCount; });
 
-			tasks.AddBack<TaskData<Task>>(function, std::move(task));
+			PushTask(function, std::move(task));
 
 			stateCV.notify_all();
 		}
@@ -105,14 +282,24 @@ namespace SPH
 		{
 			std::unique_lock lk{ stateMutex };
 
-			if (tasks.Count() >= 3)
+			if (taskCount >= MaxQueuedTaskCount)
 				return false;
 
-			tasks.AddBack<TaskData<Task>>(function, std::move(task));
+			PushTask(function, std::move(task));
 
 			stateCV.notify_all();
 		}
 
 		return true;
 	}
+	template<typename Task>
+	inline void ThreadParallelTaskManager::PushTask(TaskFunction<Task> function, Task&& task)
+	{
+		static_assert(sizeof(TaskData<Task>) <= TaskSlotSize, "The task doesn't fit into a task slot, increase TaskSlotSize");
+		static_assert(alignof(TaskData<Task>) <= alignof(std::max_align_t), "The task is aligned more strictly than a task slot");
+
+		TaskSlot& slot = taskSlots[(firstTaskIndex + taskCount) % MaxQueuedTaskCount];
+		slot.task = new (slot.storage) TaskData<Task>(function, std::move(task));
+		++taskCount;
+	}
 }
\ No newline at end of file
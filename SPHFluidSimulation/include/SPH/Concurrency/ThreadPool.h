@@ -2,6 +2,21 @@
 
 namespace SPH
 {
+	/*
+		None     - the threads aren't pinned, the OS moves them freely
+		Compact  - thread i is pinned to the i-th processor, filling one NUMA node before the next one
+		Scatter  - the threads are pinned to the NUMA nodes in turn, so the threads of a pool with fewer threads than
+		           processors are spread over all nodes and their memory bandwidth
+		Explicit - thread i is pinned to the i-th processor of the given list, wrapping around when it is shorter
+	*/
+	enum class ThreadAffinityPolicy
+	{
+		None,
+		Compact,
+		Scatter,
+		Explicit
+	};
+
 	class ThreadPool
 	{
 	public:
@@ -9,6 +24,19 @@ namespace SPH
 
 		void AllocateThreads(uintMem threads);
 
+		/*
+			Sets the processors the threads of the pool run on. The threads started by RunTask pin themselves before
+			running the task, threads that are already running pin themselves on their next ApplyThreadAffinity call.
+			Processors the process isn't allowed to run on are skipped, an invalid or empty explicit list pins nothing
+		*/
+		void SetAffinityPolicy(ThreadAffinityPolicy policy, ArrayView<uint32> processors = { });
+		inline ThreadAffinityPolicy GetAffinityPolicy() const { return affinityPolicy; }
+		//Pins the calling thread, which must be thread 'threadIndex' of the pool, when the policy changed since the
+		//last call with the same 'appliedGeneration'
+		void ApplyThreadAffinity(uintMem threadIndex, uint64& appliedGeneration) const;
+		//The processor thread 'threadIndex' is pinned to, or UINT32_MAX when it isn't pinned
+		uint32 GetThreadProcessor(uintMem threadIndex) const;
+
 		/*
 			Runs on each thred in thread pool
 		*/
@@ -21,6 +49,14 @@ namespace SPH
 		inline uintMem ThreadCount() const { return threads.Count(); }
 	private:
 		Array<Blaze::Thread> threads;
+
+		//The processors the process was allowed to run on when the pool was created
+		Array<uint32> allowedProcessors;
+		mutable std::mutex affinityMutex;
+		ThreadAffinityPolicy affinityPolicy;
+		//The processor of thread i is affinityProcessors[i % affinityProcessors.Count()], empty when they aren't pinned
+		Array<uint32> affinityProcessors;
+		std::atomic_uint64_t affinityGeneration;
 	};
 
 	template<typename ...Args, std::invocable<uintMem, uintMem, Args...> F> requires SameAs<std::invoke_result_t<F, uintMem, uintMem, Args...>, uint>
@@ -30,6 +66,10 @@ namespace SPH
 			task(0, 1, std::forward<Args>(args)...);
 		else
 			for (uintMem i = 0; i < threads.Count(); ++i)
-				threads[i].Run(task, (uintMem)i, threads.Count(), std::forward<Args>(args)...);
+				threads[i].Run([this, task](uintMem threadIndex, uintMem threadCount, auto&& ... args) -> uint {
+					uint64 appliedGeneration = 0;
+					ApplyThreadAffinity(threadIndex, appliedGeneration);
+					return task(threadIndex, threadCount, std::forward<decltype(args)>(args)...);
+					}, (uintMem)i, threads.Count(), std::forward<Args>(args)...);
 	}
 }
\ No newline at end of file
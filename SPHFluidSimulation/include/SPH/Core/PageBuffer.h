@@ -0,0 +1,89 @@
+#pragma once
+
+namespace SPH
+{
+	/*
+		Default          - the pages of the OS, 4 KiB on x86
+		TransparentLarge - default pages the OS is asked to back with 2 MiB pages when it can, with madvise on Linux
+		Large            - 2 MiB pages reserved by the OS, MAP_HUGETLB on Linux and MEM_LARGE_PAGES on Windows
+		Huge             - 1 GiB pages reserved by the OS, only on Linux
+	*/
+	enum class PageSize
+	{
+		Default,
+		TransparentLarge,
+		Large,
+		Huge
+	};
+
+	/*
+		Memory allocated directly from the OS in pages of the preferred size. When the OS has no pages of that size, or
+		the process isn't allowed to use them, smaller pages are used instead: Huge falls back to Large, Large to
+		TransparentLarge and that to Default. The memory is zeroed and its pages aren't touched until they are first
+		written, so they are placed on the NUMA node of the thread that writes them first.
+	*/
+	class PageBuffer
+	{
+	public:
+		PageBuffer();
+		PageBuffer(PageBuffer&& other) noexcept;
+		~PageBuffer();
+
+		void Allocate(uintMem size, PageSize preferredPageSize);
+		void Clear();
+
+		inline void* Ptr() const { return ptr; }
+		inline uintMem Size() const { return size; }
+		//The page size the memory was allocated with, after the fallbacks
+		inline PageSize GetPageSize() const { return pageSize; }
+
+		PageBuffer& operator=(PageBuffer&& other) noexcept;
+
+		static uintMem GetPageBytes(PageSize pageSize);
+	private:
+		void* ptr;
+		uintMem size;
+		//The size of the mapping, rounded up to whole pages
+		uintMem allocatedSize;
+		PageSize pageSize;
+	};
+
+	/*
+		Array of 'count' values in a PageBuffer. The values are zero-initialized by the OS instead of constructed, so
+		only types for which all zero bytes are a valid value can be stored, like the integers and their atomics.
+	*/
+	template<typename T>
+	class PageArray
+	{
+	public:
+		static_assert(std::is_trivially_destructible_v<T> && std::is_standard_layout_v<T>, "The values of a PageArray aren't constructed or destroyed");
+
+		PageArray() = default;
+		PageArray(uintMem count, PageSize preferredPageSize = PageSize::Default) : count(count) { buffer.Allocate(count * sizeof(T), preferredPageSize); }
+		PageArray(PageArray&& other) noexcept : buffer(std::move(other.buffer)), count(other.count) { other.count = 0; }
+
+		void Clear() { buffer.Clear(); count = 0; }
+
+		inline bool Empty() const { return count == 0; }
+		inline uintMem Count() const { return count; }
+		inline T* Ptr() const { return (T*)buffer.Ptr(); }
+		inline T& Last() const { return Ptr()[count - 1]; }
+		inline PageSize GetPageSize() const { return buffer.GetPageSize(); }
+
+		inline T* begin() const { return Ptr(); }
+		inline T* end() const { return Ptr() + count; }
+
+		inline T& operator[](uintMem index) const { return Ptr()[index]; }
+
+		PageArray& operator=(PageArray&& other) noexcept
+		{
+			buffer = std::move(other.buffer);
+			count = other.count;
+			other.count = 0;
+			return *this;
+		}
+	private:
+		PageBuffer buffer;
+		uintMem count = 0;
+	};
+}
\ No newline at end of file
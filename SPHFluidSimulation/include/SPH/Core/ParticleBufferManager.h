@@ -1,9 +1,26 @@
 #pragma once
 #include "SPH/Core/Particles.h"
 #include "SPH/Core/ResourceLockGuard.h"
+#include "SPH/Core/PageBuffer.h"
 
 namespace SPH
 {
+	/*
+		ArrayOfStructs - the particles are stored one after another, each particle occupying 'particleSize' bytes.
+		StructOfArrays - the particles are split into 4 byte components, and the same component of all particles is
+		stored in one contiguous stream. For dynamic particles the streams are x, y, z, pressure, vx, vy, vz, hash.
+	*/
+	enum class ParticleBufferLayout
+	{
+		ArrayOfStructs,
+		StructOfArrays
+	};
+
+	//Copies 'particleCount' particles with the ArrayOfStructs layout from 'src' into 'dst' with the StructOfArrays layout
+	void ConvertParticlesToStructOfArrays(const void* src, void* dst, uintMem particleSize, uintMem particleCount);
+	//Copies 'particleCount' particles with the StructOfArrays layout from 'src' into 'dst' with the ArrayOfStructs layout
+	void ConvertParticlesToArrayOfStructs(const void* src, void* dst, uintMem particleSize, uintMem particleCount);
+
 	class ParticleBufferManager
 	{
 	public:
@@ -12,11 +29,23 @@ namespace SPH
 		virtual void Clear() = 0;
 		virtual void Advance() = 0;
 
-		virtual void Allocate(uintMem newParticleSize, uintMem newParticleCount, void* particles, uintMem newBufferCount) = 0;
+		/*
+			\param particles - initial particles which are copied into the first buffer. They are always given in the
+			ArrayOfStructs layout and are converted to 'layout' by the buffer manager. Can be nullptr
+			\param layout - the layout in which the particles are stored in the buffers returned by LockRead/LockWrite
+		*/
+		virtual void Allocate(uintMem newParticleSize, uintMem newParticleCount, void* particles, uintMem newBufferCount, ParticleBufferLayout layout) = 0;
+
+		//The page size the next Allocate call requests for the buffers in CPU memory, see PageBuffer. Buffer managers
+		//whose buffers aren't in CPU memory ignore it
+		virtual void SetPreferredPageSize(PageSize pageSize) { }
+		//The page size the buffers were allocated with, after the fallbacks
+		virtual PageSize GetPageSize() const { return PageSize::Default; }
 
 		virtual uintMem GetBufferCount() const = 0;
 		virtual uintMem GetParticleCount() const = 0;
 		virtual uintMem GetParticleSize() const = 0;
+		virtual ParticleBufferLayout GetLayout() const = 0;
 
 		virtual ResourceLockGuard LockRead(void* signalEvent) = 0;
 		virtual ResourceLockGuard LockWrite(void* signalEvent) = 0;
@@ -38,5 +38,18 @@ namespace SPH
 		//Constants
 		float selfDensity = 0.0f;
 		float smoothingKernelConstant = 0.0f;
+
+		//Dense grid, used instead of the hash map when gridSizeX isn't 0. The origin is the first cell of the grid as
+		//returned by GetCell
+		uint32 gridOriginX = 0;
+		uint32 gridOriginY = 0;
+		uint32 gridOriginZ = 0;
+		uint32 gridSizeX = 0;
+		uint32 gridSizeY = 0;
+		uint32 gridSizeZ = 0;
+
+		//Space filling curve the cell hashes of the hash map follow, 0 is the Morton curve and 1 the Hilbert curve. Only
+		//the CPU engine sets it, the GPU engine always uses the Morton curve
+		uint32 cellCurve = 0;
 	};
 }
\ No newline at end of file
@@ -16,10 +16,14 @@ namespace SPH
 		bool LoadScene(ReadSubStream& stream);
 
 		inline ParticleSimulationParameters GetSystemParameters() const { return systemParameters; }
+		//Overrides or adds a value in the "otherParameters" of the scene, for example to select an engine option
+		void SetOtherParameter(StringView name, StringView value);
 
 		inline const Graphics::BasicIndexedMesh& GetMesh() const { return mesh; }
 
 		Array<Vec3f> GenerateLayerParticlePositions(StringView layerName);
+		//Number of particles GenerateLayerParticles would generate, without generating them
+		uintMem GetLayerParticleCount(StringView layerName);
 		template<typename Particle>
 		void GenerateLayerParticles(StringView layerName, Array<Particle>& particles)
 		{
@@ -34,9 +38,7 @@ namespace SPH
 			if (it.IsNull())
 				return;
 
-			uintMem count = 0;
-			for (auto& blueprint : it->value)
-				count += blueprint->GetParticleCount();
+			uintMem count = GetLayerParticleCount(layerName);
 
 			uintMem index = particles.Count();
 			particles.Resize(particles.Count() + count);
@@ -4,8 +4,10 @@
 #include "BlazeEngine/Core/Container/ArrayView.h"
 #include "BlazeEngine/Core/String/String.h"
 #include "BlazeEngine/Core/String/StringView.h"
+#include "BlazeEngine/Graphics/Common/BasicIndexedMesh.h"
 
 #include "SPH/Core/Particles.h"
+#include "SPH/Core/SimulationStatistics.h"
 
 namespace SPH
 {
@@ -19,6 +21,7 @@ namespace SPH
 		
 		bool ParseParameter(StringView name, float& value) const;
 		bool ParseParameter(StringView name, bool& value) const;
+		bool ParseParameter(StringView name, uint64& value) const;
 	};
 
 	template<typename T>
@@ -32,6 +35,24 @@ namespace SPH
 
 	class ParticleBufferManager;
 
+	//Results of the integrity checks since the engine was initialized
+	struct IntegrityCheckStatistics
+	{
+		uint64 checkedStepCount = 0;
+		uint64 errorCount = 0;
+	};
+
+	//Reorderings of the dynamic particles since the engine was initialized. The scattered fraction is measured with
+	//SimulationEngine::CountScatteredParticleMapEntries and accumulated between the reorderings
+	struct ReorderStatistics
+	{
+		uint64 stepCount = 0;
+		uint64 reorderCount = 0;
+		uint64 measuredStepCount = 0;
+		double lastScatteredFraction = 0;
+		double maxScatteredFraction = 0;
+	};
+
 	class SimulationEngine
 	{
 	public:
@@ -40,6 +61,14 @@ namespace SPH
 		virtual void Clear() = 0;
 		virtual void Initialize(SceneBlueprint& scene, ParticleBufferManager& dynamicParticlesBufferManager, ParticleBufferManager& staticParticlesBufferManager) = 0;
 		virtual void Update(float dt, uint simulationStepCount) = 0;
+		//Waits until all enqueued updates are finished
+		virtual void FinishUpdates() = 0;
+
+		//Time spent in each phase of the simulation steps since the engine was initialized or the statistics were reset.
+		//The phases are only measured when the engine is compiled with its profiling define, otherwise there are none.
+		//Must not be called while an update is running, call FinishUpdates first
+		virtual SimulationStatistics GetStatistics() = 0;
+		virtual void ResetStatistics() = 0;
 
 		virtual StringView SystemImplementationName() = 0;			
 		virtual ParticleBufferManager* GetDynamicParticlesBufferManager() = 0;
@@ -49,30 +78,59 @@ namespace SPH
 
 		static Vec3u GetCell(Vec3f position, float maxInteractionDistance);
 		static uint GetHash(Vec3u cell);
+		//Returns the hash map bucket of the cell. It's the hash modulo the bucket count, or the dense grid cell index
+		//when the dense grid parameters are set
+		static uint GetCellBucket(Vec3u cell, uintMem bucketCount, const ParticleBehaviourParameters& parameters);
 		static float SmoothingKernelConstant(float h);
 		static float SmoothingKernelD0(float r, float maxInteractionDistance);
 		static float SmoothingKernelD1(float r, float maxInteractionDistance);
 		static float SmoothingKernelD2(float r, float maxInteractionDistance);
+		static float TriangleInteractionDistance();
+
+		//Largest difference of the particle indices of two consecutive particle map entries that still counts as local
+		static constexpr uint32 ParticleMapLocalityWindow = 8;
+		//Counts the entries of the particle map in [begin, end) whose particle index differs by more than
+		//ParticleMapLocalityWindow from the one of the entry before it. The neighbour loops read the particles of a
+		//bucket in the order of the map, so every such entry is likely a cache miss. The first entry of the map is
+		//never counted
+		static uint64 CountScatteredParticleMapEntries(const uint32* particleMap, uintMem begin, uintMem end);
+
+		/*
+			Bins the triangles into a hash map with cells the size of the triangle interaction distance. A triangle
+			is put into every cell its bounding box overlaps, but at most once into a single hash map bucket.
+
+			\param hashMap - is filled with the offsets into 'triangleMap', its size is the bucket count + 1
+			\param triangleMap - is filled with the triangle indices sorted by their buckets
+		*/
+		static void GenerateTriangleHashMap(ArrayView<Graphics::BasicIndexedMesh::Triangle> triangles, Array<uint32>& hashMap, Array<uint32>& triangleMap);
 
 		template<typename T, typename H, typename F> requires std::invocable<F, const T&>
 		static Array<T> GenerateHashMapAndReorderParticles(ArrayView<T> particles, Array<H>& hashMap, const F& hashGetter);				
 		template<typename H>
-		static Array<DynamicParticle> GenerateHashMapAndReorderParticles(ArrayView<DynamicParticle> particles, Array<H>& hashMap, float maxInteractionDistance);
+		static Array<DynamicParticle> GenerateHashMapAndReorderParticles(ArrayView<DynamicParticle> particles, Array<H>& hashMap, const ParticleBehaviourParameters& parameters);
 		template<typename H>
-		static Array<StaticParticle> GenerateHashMapAndReorderParticles(ArrayView<StaticParticle> particles, Array<H>& hashMap, float maxInteractionDistance);
+		static Array<StaticParticle> GenerateHashMapAndReorderParticles(ArrayView<StaticParticle> particles, Array<H>& hashMap, const ParticleBehaviourParameters& parameters);
 
+		/*
+			The integrity helpers below validate the particles and the hash maps on the host. They return the number of
+			errors found and log only the first one, so that a broken buffer doesn't flood the log
+		*/
+		template<typename T>
+		static uint64 DebugParticles(ArrayView<T> particles, float maxInteractionDistance, uintMem hashMapSize);
 		template<typename T>
-		static void DebugParticles(ArrayView<T> particles, float maxInteractionDistance, uintMem hashMapSize);
+		static uint64 DebugParticles(ArrayView<T> particles, const ParticleBehaviourParameters& parameters, uintMem hashMapSize);
 		template<typename T, typename H> requires ParticleWithHash<T>
-		static void DebugPrePrefixSumHashes(ArrayView<T> particles, Array<H> hashMap);
+		static uint64 DebugPrePrefixSumHashes(ArrayView<T> particles, Array<H> hashMap);
 		template<typename T, typename H> requires ParticleWithHash<T>
-		static void DebugInterPrefixSumHashes(Array<T> particles, Array<H> hashMap, uintMem groupSize, uintMem layerCount = 0);				
+		static uint64 DebugInterPrefixSumHashes(Array<T> particles, Array<H> hashMap, uintMem groupSize, uintMem layerCount = 0);				
 		template<typename T, typename H, typename F> requires std::invocable<F, const T&>
-		static void DebugHashAndParticleMap(ArrayView<T> particles, ArrayView<H> hashMap, ArrayView<uint32> particleMap, const F& hashGetter);				
+		static uint64 DebugHashAndParticleMap(ArrayView<T> particles, ArrayView<H> hashMap, ArrayView<uint32> particleMap, const F& hashGetter);				
 		template<typename H>
-		static void DebugHashAndParticleMap(ArrayView<StaticParticle> particles, ArrayView<H> hashMap, float maxInteractionDistance);
+		static uint64 DebugHashAndParticleMap(ArrayView<StaticParticle> particles, ArrayView<H> hashMap, float maxInteractionDistance);
 		template<typename H>
-		static void DebugHashAndParticleMap(ArrayView<DynamicParticle> particles, ArrayView<H> hashMap, ArrayView<uint32> particleMap);
+		static uint64 DebugHashAndParticleMap(ArrayView<StaticParticle> particles, ArrayView<H> hashMap, const ParticleBehaviourParameters& parameters);
+		template<typename H>
+		static uint64 DebugHashAndParticleMap(ArrayView<DynamicParticle> particles, ArrayView<H> hashMap, ArrayView<uint32> particleMap);
 	};	
 	
 	template<typename T, typename H, typename F> requires std::invocable<F, const T&>
@@ -99,97 +157,83 @@ namespace SPH
 		return particlesOutput;
 	}	
 	template<typename H>
-	Array<DynamicParticle> SimulationEngine::GenerateHashMapAndReorderParticles(ArrayView<DynamicParticle> particles, Array<H>& hashMap, float maxInteractionDistance)
+	Array<DynamicParticle> SimulationEngine::GenerateHashMapAndReorderParticles(ArrayView<DynamicParticle> particles, Array<H>& hashMap, const ParticleBehaviourParameters& parameters)
 	{
-		return GenerateHashMapAndReorderParticles<DynamicParticle, H>(particles, hashMap, [maxInteractionDistance = maxInteractionDistance, mod = hashMap.Count() - 1](const DynamicParticle& particle) {
-			return GetHash(GetCell(particle.position, maxInteractionDistance)) % mod;
+		return GenerateHashMapAndReorderParticles<DynamicParticle, H>(particles, hashMap, [&parameters, bucketCount = hashMap.Count() - 1](const DynamicParticle& particle) {
+			return GetCellBucket(GetCell(particle.position, parameters.maxInteractionDistance), bucketCount, parameters);
 			});
 	}
 	template<typename H>
-	Array<StaticParticle> SimulationEngine::GenerateHashMapAndReorderParticles(ArrayView<StaticParticle> particles, Array<H>& hashMap, float maxInteractionDistance)
+	Array<StaticParticle> SimulationEngine::GenerateHashMapAndReorderParticles(ArrayView<StaticParticle> particles, Array<H>& hashMap, const ParticleBehaviourParameters& parameters)
 	{
-		return GenerateHashMapAndReorderParticles<StaticParticle, H>(particles, hashMap, [maxInteractionDistance = maxInteractionDistance, mod = hashMap.Count() - 1](const StaticParticle& particle) {
-			return GetHash(GetCell(particle.position, maxInteractionDistance)) % mod;
+		return GenerateHashMapAndReorderParticles<StaticParticle, H>(particles, hashMap, [&parameters, bucketCount = hashMap.Count() - 1](const StaticParticle& particle) {
+			return GetCellBucket(GetCell(particle.position, parameters.maxInteractionDistance), bucketCount, parameters);
 			});
 	}
 	template<typename T> 
-	inline void SimulationEngine::DebugParticles(ArrayView<T> particles, float maxInteractionDistance, uintMem hashMapSize)
+	inline uint64 SimulationEngine::DebugParticles(ArrayView<T> particles, float maxInteractionDistance, uintMem hashMapSize)
 	{
+		ParticleBehaviourParameters parameters{ };
+		parameters.maxInteractionDistance = maxInteractionDistance;
+
+		return DebugParticles<T>(particles, parameters, hashMapSize);
+	}
+	template<typename T> 
+	inline uint64 SimulationEngine::DebugParticles(ArrayView<T> particles, const ParticleBehaviourParameters& parameters, uintMem hashMapSize)
+	{
+		uint64 errorCount = 0;
+		auto reportError = [&](const char* message) {
+			if (errorCount++ == 0)
+				Debug::Logger::LogError("Client", message);
+			};
+
 		for (auto& particle : particles)
 		{
 			if constexpr (ParticleWithPosition<T>)
 			{
-				if (isnan(particle.position.x) || isnan(particle.position.y) || isnan(particle.position.z))
-				{
-					Debug::Logger::LogDebug("Client", "One or more of particle position components is nan");
-					__debugbreak();
-				}
-
-				if (isinf(particle.position.x) || isinf(particle.position.y) || isinf(particle.position.z))
-				{
-					Debug::Logger::LogDebug("Client", "One or more of particle position components is inf");
-					__debugbreak();
-				}				
+				if (!std::isfinite(particle.position.x) || !std::isfinite(particle.position.y) || !std::isfinite(particle.position.z))
+					reportError("One or more of particle position components is nan or inf");
 			}
 
 			if constexpr (ParticleWithPressure<T>)
 			{
-				if (isnan(particle.pressure))
-				{
-					Debug::Logger::LogDebug("Client", "Particle pressure is nan");
-					__debugbreak();
-				}
-
-				if (isinf(particle.pressure))
-				{
-					Debug::Logger::LogDebug("Client", "Particle pressure is inf");
-					__debugbreak();
-				}
+				if (!std::isfinite(particle.pressure))
+					reportError("Particle pressure is nan or inf");
 			}
 
 			if constexpr (ParticleWithVelocity<T>)
 			{
-				if (isnan(particle.velocity.x) || isnan(particle.velocity.y) || isnan(particle.velocity.z))
-				{
-					Debug::Logger::LogDebug("Client", "One or more of particle velocity components is nan");
-					__debugbreak();
-				}
-
-				if (isinf(particle.velocity.x) || isinf(particle.velocity.y) || isinf(particle.velocity.z))
-				{
-					Debug::Logger::LogDebug("Client", "One or more of particle velocity components is inf");
-					__debugbreak();
-				}
+				if (!std::isfinite(particle.velocity.x) || !std::isfinite(particle.velocity.y) || !std::isfinite(particle.velocity.z))
+					reportError("One or more of particle velocity components is nan or inf");
 			}
 
 			if constexpr (ParticleWithHash<T>)
 			{
-				Vec3u cell = GetCell(particle.position, maxInteractionDistance);
-				uint32 hash = GetHash(cell) % hashMapSize;
+				Vec3u cell = GetCell(particle.position, parameters.maxInteractionDistance);
+				uint32 hash = GetCellBucket(cell, hashMapSize, parameters);
 
 				if (particle.hash != hash)
-				{
-					Debug::Logger::LogDebug("Client", "Invalid particle hash");
-					__debugbreak();
-				}				
+					reportError("Invalid particle hash");
 			}
 		}
+
+		return errorCount;
 	}
 	template<typename T, typename H> requires ParticleWithHash<T>
-	inline void SimulationEngine::DebugPrePrefixSumHashes(ArrayView<T> particles, Array<H> hashMap)
+	inline uint64 SimulationEngine::DebugPrePrefixSumHashes(ArrayView<T> particles, Array<H> hashMap)
 	{		
 		for (auto& particle : particles)
 			hashMap[particle.hash]--;
 
+		uint64 errorCount = 0;
 		for (uintMem i = 0; i < hashMap.Count() - 1; ++i)
-			if (hashMap[i] != 0)
-			{
-				Debug::Logger::LogDebug("Client", "Pre prefix sum hash not valid");
-				__debugbreak();
-			}
+			if (hashMap[i] != 0 && errorCount++ == 0)
+				Debug::Logger::LogError("Client", "Pre prefix sum hash not valid");
+
+		return errorCount;
 	}
 	template<typename T, typename H> requires ParticleWithHash<T>
-	inline void SimulationEngine::DebugInterPrefixSumHashes(Array<T> particles, Array<H> hashMap, uintMem groupSize, uintMem layerCount)
+	inline uint64 SimulationEngine::DebugInterPrefixSumHashes(Array<T> particles, Array<H> hashMap, uintMem groupSize, uintMem layerCount)
 	{						
 		uintMem startArraySize = layerCount == 0 ? groupSize : (hashMap.Count() - 1) / std::pow(groupSize, layerCount - 1);
 		for (uintMem arraySize = startArraySize; arraySize <= hashMap.Count() - 1; arraySize *= groupSize)
@@ -205,79 +249,76 @@ namespace SPH
 		for (auto& particle : particles)
 			--hashMap[particle.hash];
 
+		uint64 errorCount = 0;
 		for (uintMem i = 0; i < hashMap.Count() - 1; ++i)
-			if (hashMap[i] != 0)
-			{
-				Debug::Logger::LogDebug("Client", "Invalid sum");
-				__debugbreak();
-			}
+			if (hashMap[i] != 0 && errorCount++ == 0)
+				Debug::Logger::LogError("Client", "Invalid sum");
+
+		return errorCount;
 	}
 	template<typename H>
-	inline void SimulationEngine::DebugHashAndParticleMap(ArrayView<StaticParticle> particles, ArrayView<H> hashMap, float maxInteractionDistance)
+	inline uint64 SimulationEngine::DebugHashAndParticleMap(ArrayView<StaticParticle> particles, ArrayView<H> hashMap, float maxInteractionDistance)
 	{
-		DebugHashAndParticleMap<StaticParticle, H>(particles, hashMap, {}, [&, mod = hashMap.Count() - 1](const StaticParticle& particle) {
+		return DebugHashAndParticleMap<StaticParticle, H>(particles, hashMap, {}, [&, mod = hashMap.Count() - 1](const StaticParticle& particle) {
 			return GetHash(GetCell(particle.position, maxInteractionDistance)) % mod;
 			});
 	}
 	template<typename H>
-	inline void SimulationEngine::DebugHashAndParticleMap(ArrayView<DynamicParticle> particles, ArrayView<H> hashMap, ArrayView<uint32> particleMap)
+	inline uint64 SimulationEngine::DebugHashAndParticleMap(ArrayView<StaticParticle> particles, ArrayView<H> hashMap, const ParticleBehaviourParameters& parameters)
 	{
-		DebugHashAndParticleMap<DynamicParticle, H>(particles, hashMap, particleMap, [](const DynamicParticle& particle) {
+		return DebugHashAndParticleMap<StaticParticle, H>(particles, hashMap, {}, [&, bucketCount = hashMap.Count() - 1](const StaticParticle& particle) {
+			return GetCellBucket(GetCell(particle.position, parameters.maxInteractionDistance), bucketCount, parameters);
+			});
+	}
+	template<typename H>
+	inline uint64 SimulationEngine::DebugHashAndParticleMap(ArrayView<DynamicParticle> particles, ArrayView<H> hashMap, ArrayView<uint32> particleMap)
+	{
+		return DebugHashAndParticleMap<DynamicParticle, H>(particles, hashMap, particleMap, [](const DynamicParticle& particle) {
 			return particle.hash;
 			});
 	}
 	template<typename T, typename H, typename F> requires std::invocable<F, const T&>
-	inline void SimulationEngine::DebugHashAndParticleMap(ArrayView<T> particles, ArrayView<H> hashMap, ArrayView<uint32> particleMap, const F& hashGetter)
+	inline uint64 SimulationEngine::DebugHashAndParticleMap(ArrayView<T> particles, ArrayView<H> hashMap, ArrayView<uint32> particleMap, const F& hashGetter)
 	{
+		uint64 errorCount = 0;
+		auto reportError = [&](const char* message) {
+			if (errorCount++ == 0)
+				Debug::Logger::LogError("Client", message);
+			};
+
 		if (hashMap[0] != 0)
-		{
-			Debug::Logger::LogDebug("Client", "Hash map first value is not 0");
-			__debugbreak();
-		}
+			reportError("Hash map first value is not 0");
 
 		if (hashMap.Last() != particles.Count())
-		{
-			Debug::Logger::LogDebug("Client", "Hash map last value is not the number of particles");
-			__debugbreak();
-		}
+			reportError("Hash map last value is not the number of particles");
 
 		uint32 lastValue = 0;
 		for (uintMem i = 1; i < hashMap.Count(); ++i)
 		{
 			uint32 value = hashMap[i];
 
-			if (value < lastValue)
-			{
-				Debug::Logger::LogDebug("Client", "Hash map value smaller than the previous value");
-				__debugbreak();
-			}
-
-			if (value > particles.Count())
+			if (value < lastValue || value > particles.Count())
 			{
-				Debug::Logger::LogDebug("Client", "Invalid hash map value, it's greater than the dynamicParticleCount");
-				__debugbreak();
+				reportError("Hash map value smaller than the previous value or greater than the particle count");
+				continue;
 			}
 
 			if (particleMap.Empty())
+			{
 				for (uint32 j = lastValue; j < value; ++j)
-				{
 					if (hashGetter(particles[j]) != i - 1)
-					{
-						Debug::Logger::LogDebug("Client", "Invalid hash value");
-						__debugbreak();
-					}
-				}
+						reportError("Invalid hash value");
+			}
 			else
+			{
 				for (uint32 j = lastValue; j < value; ++j)
-				{										
-					if (hashGetter(particles[particleMap[j]]) != i - 1)
-					{
-						Debug::Logger::LogDebug("Client", "Invalid particleMap value");
-						__debugbreak();
-					}
-				}
+					if (particleMap[j] >= particles.Count() || hashGetter(particles[particleMap[j]]) != i - 1)
+						reportError("Invalid particleMap value");
+			}
 
 			lastValue = value;
 		}
+
+		return errorCount;
 	}	
 }
\ No newline at end of file
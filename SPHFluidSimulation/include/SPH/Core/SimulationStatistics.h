@@ -0,0 +1,101 @@
+#pragma once
+#include "BlazeEngine/Core/Container/Array.h"
+#include "BlazeEngine/Core/String/String.h"
+#include <chrono>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+namespace SPH
+{
+	//Time one phase of the simulation steps took, summed over all recorded steps
+	struct PhaseStatistics
+	{
+		String name;
+		//The most times a thread entered the phase
+		uint64 callCount = 0;
+		//Time each thread spent working in the phase. The GPU engine has a single entry with the execution time of its
+		//kernels
+		Array<double> threadSeconds;
+		//Time each thread spent waiting for the other threads at the end of the phase, 0 for the GPU engine
+		Array<double> threadWaitSeconds;
+
+		double MaxThreadSeconds() const;
+		double MeanThreadSeconds() const;
+		double MeanWaitSeconds() const;
+		//The time of the slowest thread divided by the mean time of all threads, 1 when the work is evenly distributed
+		double LoadImbalance() const;
+	};
+
+	struct SimulationStatistics
+	{
+		uint64 stepCount = 0;
+		//Only the phases that were entered at least once, in the order they appear in a step
+		Array<PhaseStatistics> phases;
+	};
+
+	/*
+		Accumulates the work and waiting time of a fixed number of phases for each thread. The time is read from the
+		timestamp counter so recording a phase costs a few nanoseconds. Each thread only writes into its own slot, so no
+		locks or atomics are needed, but the statistics must not be read while a thread is recording.
+	*/
+	class ThreadPhaseRecorder
+	{
+	public:
+		ThreadPhaseRecorder();
+
+		//Allocates the slots and resets the counters
+		void Initialize(uintMem threadCount, uintMem phaseCount);
+		//Sets the counters to 0, the thread and phase count stay the same
+		void Reset();
+
+		inline void AddCall(uintMem threadIndex, uintMem phase);
+		inline void AddWork(uintMem threadIndex, uintMem phase, uint64 ticks);
+		inline void AddWait(uintMem threadIndex, uintMem phase, uint64 ticks);
+		//Must only be called by one thread per step
+		inline void AddStep() { ++stepCount; }
+
+		//'phaseNames' must have 'phaseCount' entries
+		SimulationStatistics GetStatistics(const char* const* phaseNames) const;
+
+		//Ticks of the timestamp counter, or of the steady clock on other architectures
+		static inline uint64 ReadTimestamp();
+	private:
+		//Each thread has the work ticks, the wait ticks and the call count of every phase, padded to separate cache lines
+		Array<uint64> counters;
+		uintMem threadStride;
+		uintMem threadCount;
+		uintMem phaseCount;
+		uint64 stepCount;
+
+		//Used to convert the ticks to seconds
+		uint64 startTimestamp;
+		std::chrono::steady_clock::time_point startTime;
+	};
+
+	inline void ThreadPhaseRecorder::AddCall(uintMem threadIndex, uintMem phase)
+	{
+		++counters[threadIndex * threadStride + phaseCount * 2 + phase];
+	}
+	inline void ThreadPhaseRecorder::AddWork(uintMem threadIndex, uintMem phase, uint64 ticks)
+	{
+		counters[threadIndex * threadStride + phase] += ticks;
+	}
+	inline void ThreadPhaseRecorder::AddWait(uintMem threadIndex, uintMem phase, uint64 ticks)
+	{
+		counters[threadIndex * threadStride + phaseCount + phase] += ticks;
+	}
+	inline uint64 ThreadPhaseRecorder::ReadTimestamp()
+	{
+#if defined(_M_X64) || defined(__x86_64__)
+		return __rdtsc();
+#else
+		return (uint64)std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+	}
+}
\ No newline at end of file
@@ -14,12 +14,15 @@ typedef struct _cl_program* cl_program;
 class OpenCLContext
 {
 public:	
-	cl_platform_id platform;
-	cl_device_id device;
-	cl_context context;		
+	cl_platform_id platform = nullptr;
+	cl_device_id device = nullptr;
+	//Stays nullptr when no suitable device is found
+	cl_context context = nullptr;
 	bool supportedCLGLInterop;
 	
 	OpenCLContext(Graphics::OpenGL::GraphicsContext_OpenGL& graphicsContext);
+	//Creates a context without OpenCL-OpenGL interop, it doesn't need a window so it can be used by headless programs
+	OpenCLContext();
 	~OpenCLContext();	
 
 	cl_command_queue GetCommandQueue(bool profiling, bool outOfOrder);
@@ -33,4 +36,5 @@ private:
 	bool SearchAnyPlatformAndDevice(const Set<String>& requiredExtensions);
 	
 	bool CreateContext(Graphics::OpenGL::GraphicsContext_OpenGL& graphicsContext);
+	bool CreateContext();
 };
\ No newline at end of file
@@ -13,11 +13,15 @@ namespace SPH
 		void Clear() override;
 		void Advance() override;
 
-		void Allocate(uintMem newParticleSize, uintMem newParticleCount, void* particles, uintMem newBufferCount) override;
+		void Allocate(uintMem newParticleSize, uintMem newParticleCount, void* particles, uintMem newBufferCount, ParticleBufferLayout layout) override;
+
+		void SetPreferredPageSize(PageSize pageSize) override;
+		PageSize GetPageSize() const override;
 
 		uintMem GetBufferCount() const override;
 		uintMem GetParticleCount() const override;
 		uintMem GetParticleSize() const override;
+		ParticleBufferLayout GetLayout() const override;
 
 		ResourceLockGuard LockRead(void* signalEvent) override;
 		ResourceLockGuard LockWrite(void* signalEvent) override;
@@ -42,8 +46,10 @@ namespace SPH
 		uintMem currentBuffer;
 
 		Array<ParticlesBuffer> buffers;
-		Buffer buffer;
+		PageBuffer buffer;
+		PageSize preferredPageSize;
 		uintMem particleSize;
 		uintMem particleCount;
+		ParticleBufferLayout layout;
 	};
 }
\ No newline at end of file
@@ -13,11 +13,12 @@ namespace SPH
 		void Clear() override;
 		void Advance() override;
 
-		void Allocate(uintMem newParticleSize, uintMem newParticleCount, void* particles, uintMem newBufferCount) override;
+		void Allocate(uintMem newParticleSize, uintMem newParticleCount, void* particles, uintMem newBufferCount, ParticleBufferLayout layout) override;
 
 		uintMem GetBufferCount() const override;
 		uintMem GetParticleCount() const override;
 		uintMem GetParticleSize() const override;
+		ParticleBufferLayout GetLayout() const override;
 
 		ResourceLockGuard LockRead(void* signalEvent) override;
 		ResourceLockGuard LockWrite(void* signalEvent) override;
@@ -21,8 +21,32 @@ namespace SPH
 
 		inline cl_command_queue GetCommandQueue() const { return commandQueue; }
 	private:		
-		Array<cl_event> readLockFinishedSignalEvents;		
-		Array<cl_event> writeLockFinishedSignalEvents;
+		//The events are kept in place, so that locking and unlocking doesn't allocate
+		struct SignalEvents
+		{
+			static constexpr uintMem MaxEventCount = 8;
+
+			cl_event events[MaxEventCount];
+			uintMem count = 0;
+
+			SignalEvents() = default;
+			SignalEvents(SignalEvents&& other) noexcept : count(other.count) { std::copy_n(other.events, other.count, events); other.count = 0; }
+			SignalEvents& operator=(SignalEvents&& other) noexcept { count = other.count; std::copy_n(other.events, other.count, events); other.count = 0; return *this; }
+
+			inline bool Empty() const { return count == 0; }
+			inline uintMem Count() const { return count; }
+			inline cl_event* Ptr() { return events; }
+			inline void Clear() { count = 0; }
+			inline bool CanAppend(uintMem appendedCount) const { return count + appendedCount <= MaxEventCount; }
+			//Logs a fatal error and drops the events that don't fit
+			void Append(ArrayView<cl_event> appendedEvents);
+
+			inline cl_event* begin() { return events; }
+			inline cl_event* end() { return events + count; }
+		};
+
+		SignalEvents readLockFinishedSignalEvents;		
+		SignalEvents writeLockFinishedSignalEvents;
 		
 		cl_command_queue commandQueue;		
 
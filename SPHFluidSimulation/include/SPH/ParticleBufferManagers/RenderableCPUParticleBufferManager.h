@@ -24,9 +24,15 @@ namespace SPH
 		//Calling this function might allocate new particle buffers and therefore invalidate the old ones. Any
 		//operations acting on the old buffers will result in undefined behaviour after calling this function.
 		//Therefore those operations must be waited on. Before waiting for the operations function
-		//'FlushAllOperations' must be called otherwise a deadlock might occur
-		void Allocate(uintMem newParticleSize, uintMem newParticleCount, void* particles, uintMem newBufferCount) override;
+		//'FlushAllOperations' must be called otherwise a deadlock might occur. When the layout is StructOfArrays
+		//the particles are kept in separate CPU buffers and are converted to the ArrayOfStructs layout, that the
+		//graphics buffer uses, only when a buffer is prepared for rendering
+		void Allocate(uintMem newParticleSize, uintMem newParticleCount, void* particles, uintMem newBufferCount, ParticleBufferLayout layout) override;
 
+		//Only the CPU buffers of the StructOfArrays layout use the page size, the graphics buffer is allocated by the
+		//OpenGL driver
+		void SetPreferredPageSize(PageSize pageSize) override;
+		PageSize GetPageSize() const override;
 
 		//It is safe to call this function from multiple threads at the same time
 		uintMem GetBufferCount() const override;
@@ -36,6 +42,9 @@ namespace SPH
 		//It is safe to call this function from multiple threads at the same time, as long as new particles
 		//aren't being allocated at the same time
 		uintMem GetParticleSize() const override;
+		//It is safe to call this function from multiple threads at the same time, as long as new particles
+		//aren't being allocated at the same time
+		ParticleBufferLayout GetLayout() const override;
 
 		//It is safe to call this function from multiple threads at the same time, as long as new particles
 		//aren't being allocated at the same time
@@ -62,12 +71,14 @@ namespace SPH
 		public:
 			ParticlesBuffer();
 
-			void SetPointer(void* ptr, bool preparedForRendering);
+			//renderPtr is the place in the mapped graphics buffer to which the particles are converted when rendering,
+			//or nullptr if ptr already points into the mapped graphics buffer
+			void SetPointer(void* ptr, void* renderPtr, bool preparedForRendering);
 
 			ResourceLockGuard LockRead();
 			ResourceLockGuard LockWrite(bool isOpenGLThread);
 			//This function can only be called by the OpenGL thread
-			ResourceLockGuard LockForRendering(Graphics::OpenGL::ImmutableMappedGraphicsBuffer& buffer, uintMem index, uintMem bufferSize);
+			ResourceLockGuard LockForRendering(Graphics::OpenGL::ImmutableMappedGraphicsBuffer& buffer, uintMem index, uintMem particleSize, uintMem particleCount);
 
 			//This function can only be called by the OpenGL thread
 			void CheckRenderingFence();
@@ -76,9 +87,10 @@ namespace SPH
 			void WaitRenderingFence();
 
 			//This function can only be called by the OpenGL thread
-			void PrepareForRendering(Graphics::OpenGL::ImmutableMappedGraphicsBuffer& buffer, uintMem index, uintMem bufferSize);
+			void PrepareForRendering(Graphics::OpenGL::ImmutableMappedGraphicsBuffer& buffer, uintMem index, uintMem particleSize, uintMem particleCount);
 		private:
 			void* ptr;
+			void* renderPtr;
 			CPULock lock;
 			bool renderingFenceFlag;
 			bool preparedForRendering;
@@ -90,8 +102,11 @@ namespace SPH
 
 		Array<ParticlesBuffer> buffers;
 		Graphics::OpenGL::ImmutableMappedGraphicsBuffer bufferGL;
+		PageBuffer buffer;
+		PageSize preferredPageSize;
 		uintMem particleSize;
 		uintMem particleCount;
+		ParticleBufferLayout layout;
 
 		//This function can only be called by the OpenGL thread
 		void CheckAllRenderingFences();
@@ -101,11 +101,12 @@ namespace SPH
 		void Clear() override;
 		void Advance() override;
 
-		void Allocate(uintMem newParticleSize, uintMem newParticleCount, void* particles, uintMem newBufferCount) override;
+		void Allocate(uintMem newParticleSize, uintMem newParticleCount, void* particles, uintMem newBufferCount, ParticleBufferLayout layout) override;
 
 		uintMem GetBufferCount() const override;
 		uintMem GetParticleCount() const override;
 		uintMem GetParticleSize() const override;
+		ParticleBufferLayout GetLayout() const override;
 
 		Graphics::OpenGL::GraphicsBuffer* GetGraphicsBuffer(uintMem index, uintMem& bufferOffset) override;
 
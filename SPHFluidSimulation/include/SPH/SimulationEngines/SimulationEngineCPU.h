@@ -7,6 +7,63 @@ using namespace Blaze;
 
 namespace SPH
 {
+	//Instruction sets the neighbour loops of the CPU engine can be run with. The vectorized versions are only used when
+	//the dynamic particles are in the StructOfArrays layout
+	enum class CPUInstructionSet
+	{
+		Scalar,
+		AVX2,
+		AVX512
+	};
+
+	//Counts of the particles visited by the neighbour loops. Candidates are all the particles in the scanned hash map
+	//buckets and neighbours the ones of them that are within the interaction distance, the rest is wasted work. With
+	//the half neighbourhood traversal each dynamic particle pair is counted once
+	struct NeighbourSearchStatistics
+	{
+		uint64 dynamicParticleCount = 0;
+		uint64 dynamicCandidateCount = 0;
+		uint64 dynamicNeighbourCount = 0;
+		uint64 staticCandidateCount = 0;
+		uint64 staticNeighbourCount = 0;
+		uint64 dynamicBucketCount = 0;
+		uint64 staticBucketCount = 0;
+	};
+
+	//Usage of the Verlet lists since the engine was initialized. The neighbour counts are the entries of the lists after
+	//the last rebuild, including the particles within the skin distance
+	struct VerletListStatistics
+	{
+		uint64 stepCount = 0;
+		uint64 rebuildCount = 0;
+		uint64 dynamicNeighbourCount = 0;
+		uint64 staticNeighbourCount = 0;
+		//Allocated for the lists, their ranges and the positions at the last rebuild
+		uint64 memoryBytes = 0;
+	};
+
+	//Particles whose hash map bucket changed in the steps the particles were sorted in since the engine was initialized,
+	//only counted with the incremental sorting. Its steps sort only the moved particles, the others sort all of them
+	struct ParticleSortStatistics
+	{
+		uint64 stepCount = 0;
+		uint64 incrementalStepCount = 0;
+		uint64 movedParticleCount = 0;
+		uint64 maxMovedParticleCount = 0;
+	};
+
+	//Largest differences between the neighbour functions of an instruction set and the scalar ones, relative to
+	//max(1, |scalar value|). 'hashMismatchCount' counts the particles that were given a different hash map bucket, which
+	//can happen without an error when a particle is within the float precision of a cell boundary
+	struct KernelComparison
+	{
+		uint64 particleCount = 0;
+		double pressureError = 0;
+		double positionError = 0;
+		double velocityError = 0;
+		uint64 hashMismatchCount = 0;
+	};
+
 	class SimulationEngineCPU : public SimulationEngine
 	{
 	public:
@@ -22,27 +79,226 @@ namespace SPH
 		ParticleBufferManager* GetStaticParticlesBufferManager() override { return staticParticlesBufferManager; }
 
 		float GetSimulationTime() override { return simulationTime; }
+
+		void FinishUpdates() override;
+
+		//The phases are measured when PROFILE_PHASES_CPU is defined in SimulationEngineCPU.cpp. Each thread has its own
+		//work and waiting time, the waiting time is spent at the barrier that ends the phase
+		SimulationStatistics GetStatistics() override;
+		void ResetStatistics() override;
+
+		//If the instruction set isn't supported by the CPU the best supported one is used instead
+		void SetInstructionSet(CPUInstructionSet instructionSet);
+		CPUInstructionSet GetInstructionSet() const { return instructionSet; }
+
+		//The threads are pinned before the next update, or with the "threadAffinity" parameter: 0 - not pinned, the
+		//default, 1 - compact, 2 - scatter. The threads first write the part of the dynamic particle buffers, the hash
+		//map and the particle map they update in the steps, so with pinned threads these pages are on the NUMA node of
+		//the thread that uses them. That only holds for the static split of the particles, see IsDynamicSchedulingUsed
+		void SetThreadAffinity(ThreadAffinityPolicy policy, ArrayView<uint32> processors = { });
+		ThreadAffinityPolicy GetThreadAffinity() const { return threadManager.GetThreadAffinityPolicy(); }
+		//The processor thread 'threadIndex' is pinned to, or UINT32_MAX when it isn't pinned
+		uint32 GetThreadProcessor(uintMem threadIndex) const { return threadManager.GetThreadProcessor(threadIndex); }
+
+		//The dynamic particle buffers, the hash map and the particle map are accessed randomly and are too large for
+		//the TLB to cover them with the default pages. The "pageSize" parameter requests larger pages for them: 0 - the
+		//default pages, 1 - transparent large pages, 2 - 2 MiB pages, 3 - 1 GiB pages, see PageSize. When the OS
+		//doesn't have them smaller pages are used, this returns the page size the hash map got
+		PageSize GetPageSize() const { return dynamicParticlesHashMap.GetPageSize(); }
+
+		static bool IsInstructionSetSupported(CPUInstructionSet instructionSet);
+		static CPUInstructionSet GetBestSupportedInstructionSet();
+
+		//The half neighbourhood traversal visits every dynamic particle pair once instead of twice. It is used when the
+		//"halfNeighbourhood" parameter is set and the dynamic particles are in the StructOfArrays layout, the instruction
+		//set is ignored then
+		bool IsHalfNeighbourhoodUsed() const { return !pairInteractionSums.Empty(); }
+
+		//The Verlet lists store the neighbours within the interaction distance plus the "verletSkinDistance" parameter
+		//of every dynamic particle and are rebuilt when a particle moved more than half of the skin distance since the
+		//last rebuild, or when the particles are reordered. They are used when the "verletLists" parameter is set and the
+		//dynamic particles are in the StructOfArrays layout, the instruction set and the half neighbourhood traversal
+		//are ignored then. The hash map of the dynamic particles is only rebuilt after the steps after which the lists
+		//have to be rebuilt, the particles are reordered or checked by the integrity checker, so between those
+		//ComputeNeighbourSearchStatistics sees an outdated hash map
+		bool AreVerletListsUsed() const { return !verletListStorage.Empty(); }
+		const VerletListStatistics& GetVerletListStatistics() const { return verletListStatistics; }
+
+		//The dense grid is used when the "denseGrid" parameter is set and the static particles bound a small enough grid.
+		//Every step clears and scans all of its cells, so it must have at most "denseGridMaxCellsPerParticle" (default 8)
+		//cells per dynamic particle, otherwise the hash map with 2 buckets per particle is cheaper and used instead
+		bool IsDenseGridUsed() const { return particleBehaviourParameters.gridSizeX != 0; }
+
+		//With the "privateHashHistograms" parameter every thread counts the hashes of the particles it updates into its
+		//own histogram during the dynamics pass. The hash map is then built from the merged histograms without atomics
+		//and without clearing it first, and the particles of a bucket are in the order of their indices. The merge reads
+		//every histogram, so it only pays off for a few threads. It needs fewer than 2^24 dynamic particles
+		bool ArePrivateHashHistogramsUsed() const { return !hashHistograms.Empty(); }
+
+		//With the "cellBlockedNeighbours" parameter the threads evaluate the particles cell by cell instead of one by
+		//one. The candidates of the 27 neighbour cells are gathered once per cell into a contiguous buffer of the
+		//thread, which saves the bucket lookups and the indirect loads of every other particle of the cell. The
+		//results are the same as the ones of the scalar functions. It is only used for the dynamic particles in the
+		//StructOfArrays layout, not together with the Verlet lists or the half neighbourhood traversal, and the
+		//instruction set is ignored then
+		bool IsCellBlockedTraversalUsed() const { return !cellNeighbourCandidateIndices.Empty(); }
+
+		//With the "specializeKernels" parameter, the default, the scalar pressure and dynamics functions are the
+		//instantiations for the scene, see Details::GetUpdateParticlePressureVariant. They have no checks for the static
+		//particles and the triangles inside of their neighbour loops when the scene has none. Otherwise the instantiation
+		//is selected for every particle
+		bool AreKernelsSpecialized() const { return specializeKernels; }
+
+		//With the "dynamicScheduling" parameter the pressure and dynamics passes split the particle map into chunks of
+		//"dynamicSchedulingChunkSize" (default 64) particles, which the threads take from each other when they are done
+		//with their own, see ThreadContext::ParallelFor. The cell blocked traversal evaluates the buckets that begin in
+		//each chunk. The results are the same as with the static split. Not used together with the Verlet lists or the
+		//half neighbourhood traversal, whose buffers belong to the particles of each thread. The busy and idle time of
+		//the threads in the passes is reported by GetParallelForStatistics
+		bool IsDynamicSchedulingUsed() const { return dynamicSchedulingChunkSize != 0; }
+		//Must not be called while an update is running, reset by ResetStatistics
+		ParallelForStatistics GetParallelForStatistics() { return threadManager.GetParallelForStatistics(); }
+
+		//With the "sortParticles" parameter the dynamic particles are sorted by their hash map bucket after every step
+		//with a stable parallel radix sort, instead of being reordered every "reorderTimeInterval". The hash map is
+		//found from the sorted buckets without atomics and the particle map is the identity, so the neighbours are read
+		//in order and the particles are in the same order for any thread count. The buckets follow the Morton curve, or
+		//the Hilbert curve with the "hilbertCurve" parameter, whose codes take longer to compute for every visited cell.
+		//The cells of the dense grid are sorted by their grid index. Not used together with the Verlet lists, which
+		//would have to be rebuilt after every step
+		bool IsParticleSortingUsed() const { return !particleSortKeys.Empty(); }
+
+		//With the "incrementalSort" parameter the sorting counts the particles whose bucket changed in the step first.
+		//When they are at most "incrementalSortMaxMovedFraction" (default 0.05) of the particles only they are sorted
+		//and then merged with the others, which are still in order, otherwise all particles are sorted. The particles
+		//end up in the same order both ways
+		bool IsIncrementalSortingUsed() const { return !particleSortMovedKeys.Empty(); }
+		const ParticleSortStatistics& GetParticleSortStatistics() const { return particleSortStatistics; }
+
+		//Without sorting the particles are reordered after the steps that pass "reorderTimeInterval", or with the
+		//"adaptiveReorder" parameter when their order got too scattered, the interval is ignored then. After every step
+		//that rebuilt the particle map the threads measure the scattered fraction of it, see
+		//SimulationEngine::CountScatteredParticleMapEntries, and the fractions are summed as the estimated extra cost
+		//of the neighbour reads since the last reordering. When the sum reaches "adaptiveReorderCost" (default 0.5),
+		//the cost of a reordering relative to a step with every neighbour read scattered, the particles are reordered.
+		//Not used together with the sorting, which orders them after every step
+		bool IsAdaptiveReorderingUsed() const { return !reorderScatterCounts.Empty(); }
+		const ReorderStatistics& GetReorderStatistics() const { return reorderStatistics; }
+
+		//The integrity checker validates the dynamic particles, their hash map and the particle map after every
+		//"integrityCheckInterval" simulation steps, 0 turns it off and is the default. The threads check their own
+		//particles and hash map buckets in parallel and the first error of each thread is logged. The static particles
+		//are checked once when the engine is initialized and their errors are counted too
+		IntegrityCheckStatistics GetIntegrityCheckStatistics() const;
+
+		//Scans the neighbourhood of every dynamic particle the same way the simulation does. Must not be called while
+		//an update is running, call FinishUpdates first
+		NeighbourSearchStatistics ComputeNeighbourSearchStatistics();
+
+		//Runs the pressure and dynamics functions of the instruction set and the scalar ones for every dynamic particle
+		//on the same input and compares their outputs, without changing the particles. The dynamics functions of both
+		//get the scalar pressures, so the errors don't add up. Only the StructOfArrays layout has vectorized functions,
+		//for the other layout nothing is compared. Must not be called while an update is running
+		KernelComparison CompareInstructionSetKernels(CPUInstructionSet instructionSet, float deltaTime);
 	private:
 		ParticleBufferManager* dynamicParticlesBufferManager;
 		ParticleBufferManager* staticParticlesBufferManager;
 
 		ThreadParallelTaskManager threadManager;
 
+		//Thread 0 computes the prefix sum of the hash map alone when this is false
 		bool parallelPartialSum;
-		Array<std::atomic_uint32_t> hashMapGroupSums;
-		Array<std::atomic_uint32_t> dynamicParticlesHashMap;
+		bool denseGrid;
+		float denseGridMaxCellsPerParticle;
+		bool halfNeighbourhood;
+		bool verletLists;
+		float verletSkinDistance;
+		bool privateHashHistograms;
+		bool cellBlockedNeighbours;
+		bool specializeKernels;
+		//Chunk size of the dynamic scheduling, 0 when it isn't used
+		uint64 dynamicSchedulingChunkSize;
+		//Preferred page size of the dynamic particle buffers, the hash map and the particle map
+		PageSize pageSize;
+		bool sortParticles;
+		bool incrementalSort;
+		float incrementalSortMaxMovedFraction;
+		//Sums of the blocks of the parallel prefix sum, one for every thread
+		Array<uint32> prefixSumBlockSums;
+		PageArray<std::atomic_uint32_t> dynamicParticlesHashMap;
 		Array<std::atomic_uint32_t> staticParticlesHashMap;
 
-		Array<uint32> particleMap;
+		PageArray<uint32> particleMap;
+		//A histogram of the dynamic particle hashes for every thread, empty when they aren't used
+		Array<Array<uint32>> hashHistograms;
+		//Streams of the gathered neighbour candidates of every thread, see Details::CellNeighbourCandidates. Empty when
+		//the cell blocked traversal isn't used
+		Array<Array<float>> cellNeighbourCandidateStreams;
+		Array<Array<uint32>> cellNeighbourCandidateIndices;
+		//Buckets and indices of the sorted particles, each with space for the radix sort to move them between two halves,
+		//and the digit counts of the radix sort for every thread. Empty when the particles aren't sorted every step
+		Array<uint32> particleSortKeys;
+		Array<uint32> particleSortIndices;
+		Array<uint32> particleSortDigitCounts;
+		//The buckets of the sorted particles after the even and after the odd steps
+		Array<uint32> particleSortBuckets;
+		//Buckets and indices of the particles whose bucket changed in a step, with two halves like the ones above, the
+		//count of them in the block of every thread and the first particle of every block whose bucket didn't change.
+		//Empty when the incremental sorting isn't used
+		Array<uint32> particleSortMovedKeys;
+		Array<uint32> particleSortMovedIndices;
+		Array<uint32> particleSortMovedCounts;
+		Array<uint32> particleSortFirstUnmoved;
+		ParticleSortStatistics particleSortStatistics;
+		//Sums of the half neighbourhood traversal, empty when it isn't used. Every thread appends its contributions to
+		//the particles of the threads after it to its own arrays and then groups them by the thread they belong to into
+		//its grouped arrays. The group of thread j of thread i begins at pairContributionOffsets[i * (threadCount + 1) + j]
+		Array<float> pairInteractionSums;
+		Array<Array<uint32>> pairContributionIndices;
+		Array<Array<float>> pairContributionValues;
+		Array<Array<uint32>> groupedPairContributionIndices;
+		Array<Array<float>> groupedPairContributionValues;
+		Array<uintMem> pairContributionOffsets;
+
+		//Every thread keeps the Verlet lists of the particles it updates in its own array. For each particle
+		//'verletListRanges' has the beginning of its list, the end of its dynamic neighbours and the end of its static
+		//neighbours. All of these are empty when the Verlet lists aren't used
+		Array<Array<uint32>> verletListStorage;
+		Array<uint32> verletListRanges;
+		Array<float> verletListReferencePositions;
+		bool verletListsValid;
+		std::atomic_bool verletListRebuildRequested;
+		VerletListStatistics verletListStatistics;
+
+		ThreadPhaseRecorder phaseRecorder;
+
+		uint64 integrityCheckInterval;
+		uint64 simulatedStepCount;
+		uint64 integrityCheckedStepCount;
+		std::atomic_uint64_t integrityErrorCount;
+
+		ParticleBufferLayout dynamicParticlesLayout;
+		CPUInstructionSet instructionSet;
 		Array<Graphics::BasicIndexedMesh::Triangle> triangles;
+		Array<uint32> triangleHashMap;
+		Array<uint32> triangleMap;
 
 		ParticleBehaviourParameters particleBehaviourParameters;
 
 		float reorderParticlesElapsedTime;
 		float reorderParticlesTimeInterval;
+		bool adaptiveReorder;
+		float adaptiveReorderCost;
+		//Scattered particle map entries counted by every thread in the last step, empty when the reordering isn't
+		//adaptive, and their fractions summed since the last reordering
+		Array<uint64> reorderScatterCounts;
+		double reorderAccumulatedScatter;
+		ReorderStatistics reorderStatistics;
 
 		float simulationTime;
 
+		//Sets the dense grid parameters so that the grid covers the static particles with one cell of padding
+		void InitializeDenseGrid(ArrayView<StaticParticle> staticParticles, uintMem dynamicParticleCount);
 		void InitializeStaticParticles(SceneBlueprint& scene, ParticleBufferManager& staticParticlesBufferManager);
 		void InitializeDynamicParticles(SceneBlueprint& scene, ParticleBufferManager& dynamicParticlesBufferManager);
 	};
@@ -18,6 +18,49 @@ namespace SPH
 		void Clear() override;		
 		void Initialize(SceneBlueprint& scene, ParticleBufferManager& dynamicParticlesBufferManager, ParticleBufferManager& staticParticlesBufferManager) override;
 		void Update(float dt, uint simulationStepCount) override;
+		void FinishUpdates() override;
+
+		//The kernels are measured when PROFILE_PHASES_GPU is defined in SimulationEngineGPU.cpp. Each phase has a single
+		//thread entry with the summed execution time of its kernels and no waiting time
+		SimulationStatistics GetStatistics() override;
+		void ResetStatistics() override;
+
+		//After every "integrityCheckInterval" simulation steps, 0 turns it off and is the default, the dynamic particles,
+		//their hash map and the particle map are read back once and checked on the host. The first error of each check
+		//is logged. The static particles are checked once when the engine is initialized. Must not be called while an
+		//update is running, call FinishUpdates first
+		IntegrityCheckStatistics GetIntegrityCheckStatistics() const;
+
+		//The particles are reordered after the steps that pass "reorderTimeInterval", or with the "adaptiveReorder"
+		//parameter when their order got too scattered, the interval is ignored then. The particle map is read back
+		//after every "adaptiveReorderMeasureInterval" (default 8) steps that didn't reorder and its scattered fraction,
+		//see SimulationEngine::CountScatteredParticleMapEntries, is counted on the host. The last measured fraction is
+		//summed every step and the particles are reordered when the sum reaches "adaptiveReorderCost" (default 0.5), the
+		//cost of a reordering relative to a step with every neighbour read scattered. Every read back waits for the
+		//queue to finish the step
+		bool IsAdaptiveReorderingUsed() const { return adaptiveReorder; }
+		const ReorderStatistics& GetReorderStatistics() const { return reorderStatistics; }
+
+		//The hash maps are scanned with a reduce-then-scan that accepts any size, so the dynamic hash map has exactly
+		//two buckets per particle. The "upDownSweepScan" parameter selects the older up-sweep and down-sweep scan, the
+		//hash map sizes are rounded up to a power of its work group size then
+		bool IsUpDownSweepScanUsed() const { return upDownSweepScan; }
+		uintMem GetDynamicParticlesHashMapSize() const { return dynamicParticlesHashMapSize; }
+
+		//With the "localMemoryTiling" parameter the pressure and dynamics kernels are replaced by versions where every
+		//work group evaluates the particles of one hash map bucket and stages their neighbours in local memory. The
+		//occupied buckets are listed at the start of every step, the "occupiedBuckets" phase. The results are the same
+		bool IsLocalMemoryTilingUsed() const { return localMemoryTiling; }
+
+		//With the "radixSort" parameter the dynamic particles are sorted by their hashes with a stable radix sort after
+		//every step, instead of being counted into the hash map and scattered by atomics. The hash map is written from
+		//the sorted hashes and the particle map holds the sorted order, so the particles of a bucket keep their relative
+		//order and two runs of a scene give the same layout. Reordering still follows "reorderTimeInterval" and
+		//"adaptiveReorder", it then moves the particles into the sorted order. The sort is the "sort" phase
+		bool IsRadixSortUsed() const { return radixSort; }
+
+		//The kernel program is loaded from the program cache when possible, see SimulationEngineGPUKernels
+		const ProgramLoadStatistics& GetProgramLoadStatistics() const { return kernels.GetProgramLoadStatistics(); }
 
 		StringView SystemImplementationName() override { return "GPU"; };		
 		ParticleBufferManager* GetDynamicParticlesBufferManager() override { return dynamicParticlesBufferManager; }
@@ -41,41 +84,100 @@ namespace SPH
 		cl_mem staticParticlesHashMap = nullptr;
 		cl_mem particleBehaviourParametersBuffer = nullptr;
 
+		bool localMemoryTiling = false;
+		//Only used by the tiled kernels
+		cl_mem occupiedBucketsBuffer = nullptr;
+		cl_mem occupiedBucketCountBuffer = nullptr;
+
+		bool radixSort = false;
+		//Only used by the radix sort. The sorted values end up in the particle map, the second buffer they move through
+		//is 'sortValuesBuffer'
+		cl_mem sortKeysBuffers[2] = { nullptr, nullptr };
+		cl_mem sortValuesBuffer = nullptr;
+		uint sortKeyBitCount = 0;
+
 		ParticleBehaviourParameters particleBehaviourParameters;
 
 		cl_mem triangles = nullptr;
+		cl_mem triangleHashMap = nullptr;
+		cl_mem triangleMap = nullptr;
 		uintMem triangleCount = 0;
+		uintMem triangleHashMapSize = 0;
 
 		uintMem dynamicParticlesHashMapSize = 0;
 		uintMem staticParticlesHashMapSize = 0;		
 
+		bool upDownSweepScan = false;
+		//Only used by the up-sweep and down-sweep scan
 		uintMem staticParticlesHashMapGroupSize = 0;
 		uintMem dynamicParticlesHashMapGroupSize = 0;
 
 		float reorderElapsedTime = 0;
 		float reorderTimeInterval = FLT_MAX;
+		bool adaptiveReorder = false;
+		float adaptiveReorderCost = 0.5f;
+		uint64 adaptiveReorderMeasureInterval = 8;
+		//Steps since the particle map was last measured or the particles reordered
+		uint64 adaptiveReorderUnmeasuredStepCount = 0;
+		double reorderAccumulatedScatter = 0;
+		ReorderStatistics reorderStatistics;
+		//The particle map is read back into this when its scattered fraction is measured
+		Array<uint32> reorderParticleMapArray;
 
 		float simulationTime = 0;
 
+		SimulationStatistics statistics;
+
+		//A kernel measured with PROFILE_PHASES_GPU, its execution time is read after the update is enqueued
+		struct PhaseEvent
+		{
+			StringView phase;
+			cl_event event;
+		};
+		//Allocated when initializing so that the measuring doesn't allocate, only the first 'phaseEventCount' are used.
+		//When it's full the events are read in the middle of an update
+		static constexpr uintMem PhaseEventCapacity = 256;
+		Array<PhaseEvent> phaseEvents;
+		uintMem phaseEventCount = 0;
+
+		uint64 integrityCheckInterval = 0;
+		uint64 simulatedStepCount = 0;
+		uint64 integrityCheckedStepCount = 0;
+		uint64 integrityErrorCount = 0;
+
 #pragma region		
 		Array<StaticParticle> debugStaticParticlesArray;
 		Array<uint32> debugStaticHashMapArray;
 		Array<DynamicParticle> debugParticlesArray;
 		Array<uint32> debugHashMapArray;
 		Array<uint32> debugParticleMapArray;
-#pragma endregion DEBUG_BUFFERS_GPU
+#pragma endregion integrity checks
 
 		void InitializeStaticParticles(SceneBlueprint& scene, ParticleBufferManager& staticParticlesBufferManager);
 		void InitializeDynamicParticles(SceneBlueprint& scene, ParticleBufferManager& dynamicParticlesBufferManager);
 
-		//Call this function to retrieve buffer values and break. Will work evend if DEBUG_BUFFERS_GPU isn't defined
+		//Sets the hash map size to the target size or rounds it up for the up-sweep and down-sweep scan
+		void DetermineHashMapSize(uintMem targetHashMapSize, uintMem& hashMapSize, uintMem& hashMapGroupSize) const;
+		void EnqueueHashMapScan(cl_mem hashMap, uintMem hashMapSize, uintMem hashMapGroupSize, ArrayView<cl_event> waitEvents, cl_event* finishedEvent) const;
+		//Sorts the dynamic particles by the hashes they hold and finishes the hash map and the particle map. With a
+		//'sortedParticles' buffer the particles are moved into it in the sorted order. 'sortFinishedEvent' is signaled
+		//after the sort itself
+		void EnqueueSortDynamicParticles(cl_mem particles, cl_mem sortedParticles, uintMem particleCount, ArrayView<cl_event> waitEvents, cl_event* sortFinishedEvent, cl_event* finishedEvent) const;
+		void AddPhaseEvent(StringView phase, cl_event event);
+		//Waits for the recorded phase events and adds their execution times to the statistics
+		void ReadPhaseEvents();
+		//Called after the particle map of every step is enqueued, reads it back when it has to be measured
+		void AccumulateReorderScatter(bool reorderParticles, cl_event particleMapFinishedEvent);
+		void AddPhaseTime(StringView name, double seconds);
+
+		//Call this function to retrieve buffer values and break
 		void InspectStaticBuffers(cl_mem particles);
 #pragma region		
-		static void DebugStaticParticles(cl_command_queue clCommandQueue, Array<StaticParticle>& tempBuffer, cl_mem particles, uintMem hashMapSize, float maxInteractionDistance);
-		static void DebugDynamicParticles(cl_command_queue clCommandQueue, Array<DynamicParticle>& tempBuffer, cl_mem particles, uintMem hashMapSize, float maxInteractionDistance);
-		static void DebugStaticParticleHashAndParticleMap(cl_command_queue clCommandQueue, Array<StaticParticle>& tempParticles, Array<uint32>& tempHashMap, cl_mem particles, cl_mem hashMap, float maxInteractionDistance);
-		static void DebugDynamicParticleHashAndParticleMap(cl_command_queue clCommandQueue, Array<DynamicParticle>& tempParticles, Array<uint32>& tempHashMap, Array<uint32>& tempParticleMap, cl_mem particles, cl_mem hashMap, cl_mem particleMap);
-#pragma endregion DEBUG_BUFFERS_GPU
+		//Read the buffers back into the temporary arrays and check the hash map and the particle map, the particles
+		//themselves are left in the temporary arrays. Return the number of errors
+		static uint64 DebugStaticParticleHashAndParticleMap(cl_command_queue clCommandQueue, Array<StaticParticle>& tempParticles, Array<uint32>& tempHashMap, cl_mem particles, cl_mem hashMap, float maxInteractionDistance);
+		static uint64 DebugDynamicParticleHashAndParticleMap(cl_command_queue clCommandQueue, Array<DynamicParticle>& tempParticles, Array<uint32>& tempHashMap, Array<uint32>& tempParticleMap, cl_mem particles, cl_mem hashMap, cl_mem particleMap);
+#pragma endregion integrity checks
 
 		friend struct RenderableGPUParticleBufferSetWithGLInterop;
 		friend struct RenderableGPUParticleBufferSetWithoutGLInterop;
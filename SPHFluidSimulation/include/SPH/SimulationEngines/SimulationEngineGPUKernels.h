@@ -2,34 +2,77 @@
 
 namespace SPH
 {
+	//How the OpenCL program of the engine kernels was created. 'sourceBuildSeconds' is measured when the program is
+	//built from the source and stored with its binary, so a load from the cache saves about its difference to
+	//'loadSeconds'
+	struct ProgramLoadStatistics
+	{
+		bool loadedFromCache = false;
+		double loadSeconds = 0;
+		double sourceBuildSeconds = 0;
+	};
+
 	class SimulationEngineGPUKernels
 	{
 	public:
 		SimulationEngineGPUKernels(cl_context clContext, cl_device_id clDevice);
 		~SimulationEngineGPUKernels();
 
+		//Up-sweep and down-sweep scan, 'hashMapSize' must be a power of the group size, see DetermineHashGroupSize
 		void EnqueueInclusiveScanKernels(cl_command_queue clCommandQueue, cl_mem hashMap, uintMem hashMapSize, uintMem dynamicParticlesHashMapGroupSize, ArrayView<cl_event> waitEvents, cl_event* finishedEvent) const;
+		//Reduce-then-scan in three dispatches for a hash map of any size. The scans share a buffer of the tile sums, so
+		//two of them must not run at the same time
+		void EnqueueReduceThenScanKernels(cl_command_queue clCommandQueue, cl_mem hashMap, uintMem hashMapSize, ArrayView<cl_event> waitEvents, cl_event* finishedEvent) const;
+		//Stable LSD radix sort of the lowest 'keyBitCount' bits of 'count' keys with values, 4 bits per pass. Every pass
+		//moves the elements from one buffer of 'keys' and 'values' into the other, starting from the first ones. Returns
+		//the index of the buffers the sorted elements end up in, see GetRadixSortPassCount. The histograms are scanned
+		//with the reduce-then-scan, so a sort must not run at the same time as another sort or scan
+		uintMem EnqueueRadixSortKernels(cl_command_queue clCommandQueue, const cl_mem keys[2], const cl_mem values[2], uintMem count, uint keyBitCount, ArrayView<cl_event> waitEvents, cl_event* finishedEvent) const;
+		//Fills the radix sort keys with the hashes of the dynamic particles and the values with their indices
+		void EnqueuePrepareDynamicParticlesSortKernel(cl_command_queue clCommandQueue, cl_mem particles, cl_mem keys, cl_mem values, uintMem particleCount, ArrayView<cl_event> waitEvents, cl_event* finishedEvent) const;
+		//Writes the whole hash map from the sorted hashes, it doesn't have to be cleared
+		void EnqueueFinishSortedHashMapKernel(cl_command_queue clCommandQueue, cl_mem hashMap, uintMem hashMapSize, cl_mem sortedKeys, uintMem keyCount, ArrayView<cl_event> waitEvents, cl_event* finishedEvent) const;
+		//Moves the particles into the order of the sorted particle map and resets the map to the identity
+		void EnqueueGatherSortedDynamicParticlesKernel(cl_command_queue clCommandQueue, cl_mem particleMap, cl_mem inParticles, cl_mem outParticles, uintMem particleCount, ArrayView<cl_event> waitEvents, cl_event* finishedEvent) const;
 		void EnqueuePrepareStaticParticlesHashMapKernel(cl_command_queue clCommandQueue, cl_mem hashMap, uintMem hashMapSize, cl_mem inParticles, uintMem particleCount, float maxInteractionDistance, ArrayView<cl_event> waitEvents, cl_event* finishedEvent) const;
 		void EnqueueReorderStaticParticlesAndFinishHashMapKernel(cl_command_queue clCommandQueue, cl_mem hashMap, uintMem hashMapSize, cl_mem inParticles, cl_mem outParticles, uintMem particleCount, float maxInteractionDistance, ArrayView<cl_event> waitEvents, cl_event* finishedEvent) const;
 		void EnqueueComputeDynamicParticlesHashAndPrepareHashMapKernel(cl_command_queue clCommandQueue, cl_mem hashMap, uintMem hashMapSize, cl_mem particles, uintMem particleCount, float maxInteractionDistance, ArrayView<cl_event> waitEvents, cl_event* finishedEvent) const;
 		void EnqueueReorderDynamicParticlesAndFinishHashMapKernel(cl_command_queue clCommandQueue, cl_mem particleMap, cl_mem hashMap, cl_mem inParticles, cl_mem outParticles, uintMem particleCount, ArrayView<cl_event> waitEvents, cl_event* finishedEvent) const;
 		void EnqueueFillDynamicParticleMapAndFinishHashMapKernel(cl_command_queue clCommandQueue, cl_mem particleMap, cl_mem hashMap, cl_mem particles, uintMem particleCount, ArrayView<cl_event> waitEvents, cl_event* finishedEvent) const;
 		void EnqueueUpdateParticlesPressureKernel(cl_command_queue clCommandQueue, cl_mem dynamicParticlesHashMap, uintMem dynamicParticlesHashMapSize, cl_mem staticParticlesHashMap, uintMem staticParticlesHashMapSize, cl_mem particleMap, cl_mem particleReadBuffer, cl_mem particleWriteBuffer, cl_mem staticParticlesBuffer, uintMem dynamicParticlesCount, uintMem staticParticlesCount, cl_mem particleBehaviourParameters, ArrayView<cl_event> waitEvents, cl_event* finishedEvent) const;
-		void EnqueueUpdateParticlesDynamicsKernel(cl_command_queue clCommandQueue, cl_mem dynamicParticlesHashMap, uintMem dynamicParticlesHashMapSize, cl_mem staticParticlesHashMap, uintMem staticParticlesHashMapSize, cl_mem particleMap, cl_mem particleReadBuffer, cl_mem particleWriteBuffer, cl_mem staticParticlesBuffer, uintMem dynamicParticlesCount, uintMem staticParticlesCount, cl_mem particleBehaviourParameters, float deltaTime, uint64 triangleCount, cl_mem triangles, ArrayView<cl_event> waitEvents, cl_event* finishedEvent) const;
+		void EnqueueUpdateParticlesDynamicsKernel(cl_command_queue clCommandQueue, cl_mem dynamicParticlesHashMap, uintMem dynamicParticlesHashMapSize, cl_mem staticParticlesHashMap, uintMem staticParticlesHashMapSize, cl_mem particleMap, cl_mem particleReadBuffer, cl_mem particleWriteBuffer, cl_mem staticParticlesBuffer, uintMem dynamicParticlesCount, uintMem staticParticlesCount, cl_mem particleBehaviourParameters, float deltaTime, uint64 triangleCount, cl_mem triangles, uint64 triangleHashMapSize, cl_mem triangleHashMap, cl_mem triangleMap, ArrayView<cl_event> waitEvents, cl_event* finishedEvent) const;
+		//Lists the occupied buckets of the dynamic particles hash map for the tiled kernels, 'occupiedBucketCount' must be 0
+		void EnqueueListOccupiedBucketsKernel(cl_command_queue clCommandQueue, cl_mem occupiedBuckets, cl_mem occupiedBucketCount, cl_mem dynamicParticlesHashMap, cl_mem particleMap, cl_mem particles, uintMem particleCount, ArrayView<cl_event> waitEvents, cl_event* finishedEvent) const;
+		//Same as the kernels above but every work group evaluates the particles of one occupied bucket at a time with its
+		//neighbours staged in local memory
+		void EnqueueUpdateParticlesPressureTiledKernel(cl_command_queue clCommandQueue, cl_mem dynamicParticlesHashMap, uintMem dynamicParticlesHashMapSize, cl_mem staticParticlesHashMap, uintMem staticParticlesHashMapSize, cl_mem particleMap, cl_mem particleReadBuffer, cl_mem particleWriteBuffer, cl_mem staticParticlesBuffer, uintMem dynamicParticlesCount, uintMem staticParticlesCount, cl_mem particleBehaviourParameters, cl_mem occupiedBuckets, cl_mem occupiedBucketCount, ArrayView<cl_event> waitEvents, cl_event* finishedEvent) const;
+		void EnqueueUpdateParticlesDynamicsTiledKernel(cl_command_queue clCommandQueue, cl_mem dynamicParticlesHashMap, uintMem dynamicParticlesHashMapSize, cl_mem staticParticlesHashMap, uintMem staticParticlesHashMapSize, cl_mem particleMap, cl_mem particleReadBuffer, cl_mem particleWriteBuffer, cl_mem staticParticlesBuffer, uintMem dynamicParticlesCount, uintMem staticParticlesCount, cl_mem particleBehaviourParameters, float deltaTime, uint64 triangleCount, cl_mem triangles, uint64 triangleHashMapSize, cl_mem triangleHashMap, cl_mem triangleMap, cl_mem occupiedBuckets, cl_mem occupiedBucketCount, ArrayView<cl_event> waitEvents, cl_event* finishedEvent) const;
 
 		//Find the smallest hash map size that is greater than the target size but still be a power of in the 
 		//scanKernelElementCountPerGroup. This way the hash map size is convenient for computation.
 		void DetermineHashGroupSize(uintMem targetHashMapSize, uintMem& dynamicParticlesHashMapGroupSize, uintMem& hashMapSize) const;
+
+		static uintMem GetRadixSortPassCount(uint keyBitCount);
+
+		//The built program binary is stored in this directory, relative to the working directory, with a file per
+		//device. It is keyed by the device, its driver version, the build options and the kernel source, a binary with
+		//a different key or one that fails to build is replaced by a build from the source
+		static constexpr const char* ProgramCacheDirectory = "OpenCLProgramCache";
+		const ProgramLoadStatistics& GetProgramLoadStatistics() const { return programLoadStatistics; }
 	private:
 		cl_device_id clDevice;
 		cl_context clContext;
 
 		cl_program program = nullptr;
+		ProgramLoadStatistics programLoadStatistics;
 
 		bool supportsNonUniformWorkGroups = false;
 
 		cl_kernel inclusiveScanUpPassKernel = nullptr;
 		cl_kernel inclusiveScanDownPassKernel = nullptr;
+		cl_kernel inclusiveScanReduceTilesKernel = nullptr;
+		cl_kernel inclusiveScanTileSumsKernel = nullptr;
+		cl_kernel inclusiveScanTilesKernel = nullptr;
 		cl_kernel prepareStaticParticlesHashMapKernel = nullptr;
 		cl_kernel reorderStaticParticlesAndFinishHashMapKernel = nullptr;
 		cl_kernel computeDynamicParticlesHashAndPrepareHashMapKernel = nullptr;
@@ -37,9 +80,19 @@ namespace SPH
 		cl_kernel fillDynamicParticleMapAndFinishHashMapKernel = nullptr;
 		cl_kernel updateParticlesPressureKernel = nullptr;
 		cl_kernel updateParticlesDynamicsKernel = nullptr;
+		cl_kernel listOccupiedBucketsKernel = nullptr;
+		cl_kernel updateParticlesPressureTiledKernel = nullptr;
+		cl_kernel updateParticlesDynamicsTiledKernel = nullptr;
+		cl_kernel radixSortHistogramKernel = nullptr;
+		cl_kernel radixSortScatterKernel = nullptr;
+		cl_kernel prepareDynamicParticlesSortKernel = nullptr;
+		cl_kernel finishSortedHashMapKernel = nullptr;
+		cl_kernel gatherSortedDynamicParticlesKernel = nullptr;
 
 		uintMem inclusiveScanUpPassKernelWorkGroupSize = 0;
 		uintMem inclusiveScanDownPassKernelWorkGroupSize = 0;
+		//The same work group size is used by all three reduce-then-scan kernels
+		uintMem reduceThenScanWorkGroupSize = 0;
 		uintMem prepareStaticParticlesHashMapKernelWorkGroupSize = 0;
 		uintMem reorderStaticParticlesAndFinishHashMapKernelWorkGroupSize = 0;
 		uintMem computeDynamicParticlesHashAndPrepareHashMapKernelWorkGroupSize = 0;
@@ -47,6 +100,27 @@ namespace SPH
 		uintMem fillDynamicParticleMapAndFinishHashMapKernelWorkGroupSize = 0;
 		uintMem updateParticlesPressureKernelWorkGroupSize = 0;
 		uintMem updateParticlesDynamicsKernelWorkGroupSize = 0;
+		uintMem listOccupiedBucketsKernelWorkGroupSize = 0;
+		//The tiled kernels use one work group size, the preferred multiple of the device, about the particle count of a
+		//bucket. Enough groups are enqueued to keep every compute unit busy, they take the occupied buckets in turns
+		uintMem tiledWorkGroupSize = 0;
+		uintMem tiledWorkGroupCount = 0;
+		//Both radix sort kernels use the same work group size, it is the size of the chunks the scatter sorts locally
+		uintMem radixSortWorkGroupSize = 0;
+		uintMem prepareDynamicParticlesSortKernelWorkGroupSize = 0;
+		uintMem finishSortedHashMapKernelWorkGroupSize = 0;
+		uintMem gatherSortedDynamicParticlesKernelWorkGroupSize = 0;
+
+		//The tiles of a reduce-then-scan are made larger instead of adding more of them, so that the tile sums are
+		//scanned by a single work group in a few iterations
+		static constexpr uintMem MaxReduceThenScanTileCount = 1024;
+		cl_mem reduceThenScanTileSums = nullptr;
+
+		static constexpr uint RadixSortDigitBitCount = 4;
+		static constexpr uintMem RadixSortDigitCount = 1 << RadixSortDigitBitCount;
+		//Every tile of a radix sort pass has a count per digit, they are scanned with the reduce-then-scan
+		static constexpr uintMem MaxRadixSortTileCount = 1024;
+		cl_mem radixSortHistogram = nullptr;
 
 		void Load();
 	};
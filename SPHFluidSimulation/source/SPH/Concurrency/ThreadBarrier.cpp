@@ -0,0 +1,52 @@
+#include "pch.h"
+#include "SPH/Concurrency/ThreadBarrier.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SPIN_PAUSE() _mm_pause()
+#else
+#define SPIN_PAUSE()
+#endif
+
+namespace SPH
+{
+	ThreadBarrier::ThreadBarrier()
+		: arrivedCount(0), sense(0), threadCount(1), spinCount(4096)
+	{
+	}
+	void ThreadBarrier::SetThreadCount(uintMem threadCount)
+	{
+		this->threadCount = threadCount == 0 ? 1 : (uint32)threadCount;
+		arrivedCount.store(0, std::memory_order_relaxed);
+	}
+	void ThreadBarrier::SetSpinCount(uint32 spinCount)
+	{
+		this->spinCount = spinCount;
+	}
+	void ThreadBarrier::Wait(uint32& localSense)
+	{
+		localSense ^= 1;
+
+		if (arrivedCount.fetch_add(1, std::memory_order_acq_rel) == threadCount - 1)
+		{
+			//The count has to be reset before the sense is flipped, otherwise a released thread could arrive at
+			//the next barrier before it was reset
+			arrivedCount.store(0, std::memory_order_relaxed);
+			sense.store(localSense, std::memory_order_release);
+			sense.notify_all();
+			return;
+		}
+
+		for (uint32 i = 0; i < spinCount; ++i)
+		{
+			if (sense.load(std::memory_order_acquire) == localSense)
+				return;
+
+			SPIN_PAUSE();
+		}
+
+		uint32 currentSense;
+		while ((currentSense = sense.load(std::memory_order_acquire)) != localSense)
+			sense.wait(currentSense, std::memory_order_acquire);
+	}
+}
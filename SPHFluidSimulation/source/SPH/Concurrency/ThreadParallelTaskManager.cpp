@@ -4,15 +4,16 @@
 namespace SPH
 {
 	ThreadContext::ThreadContext()
-		: manager(nullptr), threadIndex(0), threadCount(0)
+		: manager(nullptr), threadIndex(0), threadCount(0), barrierSense(0)
 	{
 	}
 	ThreadContext::ThreadContext(ThreadContext&& other) noexcept
-		: manager(other.manager), threadIndex(other.threadIndex), threadCount(other.threadCount)
+		: manager(other.manager), threadIndex(other.threadIndex), threadCount(other.threadCount), barrierSense(other.barrierSense)
 	{
 		other.manager = nullptr;
 		other.threadCount = 0;
 		other.threadIndex = 0;
+		other.barrierSense = 0;
 	}
 	void ThreadContext::SyncThreads() const
 	{
@@ -25,6 +26,12 @@ namespace SPH
 		if (manager->threadPool.ThreadCount() == 0)
 			return;
 
+		if (manager->barrierType == ThreadBarrierType::SpinAndWait)
+		{
+			manager->barrier.Wait(barrierSense);
+			return;
+		}
+
 		std::unique_lock<std::mutex> lock{ manager->stateMutex };
 		SyncThreads(lock);
 	}
@@ -33,15 +40,17 @@ namespace SPH
 		manager = other.manager;
 		threadIndex = other.threadIndex;
 		threadCount = other.threadCount;
+		barrierSense = other.barrierSense;
 
 		other.manager = nullptr;
 		other.threadIndex = 0;
 		other.threadCount = 0;
+		other.barrierSense = 0;
 
 		return *this;
 	}
 	ThreadContext::ThreadContext(ThreadParallelTaskManager& manager, uintMem threadIndex, uintMem threadCount)
-		: manager(&manager), threadIndex(threadIndex), threadCount(threadCount)
+		: manager(&manager), threadIndex(threadIndex), threadCount(threadCount), barrierSense(0)
 	{
 	}
 	void ThreadContext::SyncThreads(std::unique_lock<std::mutex>& lock) const
@@ -55,30 +64,38 @@ namespace SPH
 		manager->syncCV.wait(lock, [&]() { return manager->threadSyncCount2 % manager->threadPool.ThreadCount() == 0; });
 	}
 	ThreadParallelTaskManager::ThreadParallelTaskManager() 
-		: threadIdleCount(0), threadSyncCount1(0), threadSyncCount2(0), exit(false)
+		: firstTaskIndex(0), taskCount(0), threadIdleCount(0), threadSyncCount1(0), threadSyncCount2(0), exit(false), barrierType(ThreadBarrierType::SpinAndWait), parallelForLoopCount(0)
 	{		
+		parallelForSlots = Array<ParallelForSlot>(1);
+		ResetParallelForStatistics();
 	}
 	ThreadParallelTaskManager::~ThreadParallelTaskManager()
 	{
-		if (threadPool.ThreadCount() == 0)
-			return;
-
-		if (!threadPool.IsAnyRunning())
-			return;
-
+		if (threadPool.ThreadCount() != 0 && threadPool.IsAnyRunning())
 		{
-			std::lock_guard lock{ stateMutex };
-			exit = true;
-			stateCV.notify_all();
+			{
+				std::lock_guard lock{ stateMutex };
+				exit = true;
+				stateCV.notify_all();
+			}
+
+			if (threadPool.WaitForAll(1.0f) != threadPool.ThreadCount())
+				Debug::Logger::LogWarning("Client", "Threads didn't exit on time");
 		}
 
-		if (threadPool.WaitForAll(1.0f) != threadPool.ThreadCount())
-			Debug::Logger::LogWarning("Client", "Threads didn't exit on time");
+		std::lock_guard lock{ stateMutex };
+		while (taskCount != 0)
+			PopTask();
 	}
 	void ThreadParallelTaskManager::AllocateThreads(uintMem threads)
 	{			
 		threadPool.WaitForAll(5.0f);		
 		threadPool.AllocateThreads(threads);
+		barrier.SetThreadCount(threads);
+		parallelForSlots = Array<ParallelForSlot>(std::max<uintMem>(threads, 1));
+		ResetParallelForStatistics();
+		//Spinning only steals time from the threads that are yet to arrive when there are more threads than cores
+		barrier.SetSpinCount(threads > std::thread::hardware_concurrency() ? 0 : 4096);
 		if (threads != 0)
 			threadPool.RunTask([](uintMem threadIndex, uintMem threadCount, ThreadParallelTaskManager& manager) -> uint {
 				manager.SimulationThreadFunc(ThreadContext(manager, threadIndex, threadCount));
@@ -91,8 +108,95 @@ namespace SPH
 			return;
 
 		std::unique_lock<std::mutex> lock{ stateMutex };
-		stateCV.wait(lock, [&]() { return threadIdleCount == threadPool.ThreadCount(); });
+		stateCV.wait(lock, [&]() { return taskCount == 0 && threadIdleCount == threadPool.ThreadCount(); });
 	}	
+	void ThreadParallelTaskManager::SetBarrierType(ThreadBarrierType barrierType)
+	{
+		FinishTasks();
+
+		this->barrierType = barrierType;
+	}
+	ParallelForStatistics ThreadParallelTaskManager::GetParallelForStatistics()
+	{
+		FinishTasks();
+
+		ParallelForStatistics statistics;
+		statistics.loopCount = parallelForLoopCount;
+		statistics.threadBusySeconds.Resize(parallelForSlots.Count());
+		statistics.threadIdleSeconds.Resize(parallelForSlots.Count());
+		statistics.threadIndexCount.Resize(parallelForSlots.Count());
+		statistics.threadStolenChunkCount.Resize(parallelForSlots.Count());
+
+		for (uintMem i = 0; i < parallelForSlots.Count(); ++i)
+		{
+			//The last loop of every thread is only added when the next one begins
+			AddParallelForIdleTime(i, parallelForSlots[i].epoch + 1);
+
+			statistics.threadBusySeconds[i] = parallelForSlots[i].busyNanoseconds * 1e-9;
+			statistics.threadIdleSeconds[i] = parallelForSlots[i].idleNanoseconds * 1e-9;
+			statistics.threadIndexCount[i] = parallelForSlots[i].indexCount;
+			statistics.threadStolenChunkCount[i] = parallelForSlots[i].stolenChunkCount;
+		}
+
+		return statistics;
+	}
+	void ThreadParallelTaskManager::ResetParallelForStatistics()
+	{
+		FinishTasks();
+
+		parallelForLoopCount = 0;
+
+		for (auto& slot : parallelForSlots)
+		{
+			slot.idlePending = false;
+			slot.busyNanoseconds = 0;
+			slot.idleNanoseconds = 0;
+			slot.indexCount = 0;
+			slot.stolenChunkCount = 0;
+		}
+	}
+	ThreadParallelTaskManager::TaskDataBase& ThreadParallelTaskManager::GetFirstTask()
+	{
+		return *taskSlots[firstTaskIndex].task;
+	}
+	void ThreadParallelTaskManager::PopTask()
+	{
+		taskSlots[firstTaskIndex].task->~TaskDataBase();
+		taskSlots[firstTaskIndex].task = nullptr;
+		firstTaskIndex = (firstTaskIndex + 1) % MaxQueuedTaskCount;
+		--taskCount;
+	}
+	uint64 ThreadParallelTaskManager::AcquireParallelForShare(uintMem threadIndex, uintMem threadCount, uint16 epoch, uint64 chunkCount) const
+	{
+		std::atomic_uint64_t& chunks = parallelForSlots[threadIndex].chunks;
+
+		uint64 value = chunks.load(std::memory_order_relaxed);
+		while ((uint16)(value >> (ParallelForChunkBits * 2)) != epoch)
+		{
+			uint64 share = PackParallelForChunks(epoch, chunkCount * threadIndex / threadCount, chunkCount * (threadIndex + 1) / threadCount);
+
+			if (chunks.compare_exchange_weak(value, share, std::memory_order_relaxed))
+				return share;
+		}
+
+		return value;
+	}
+	void ThreadParallelTaskManager::AddParallelForIdleTime(uintMem threadIndex, uint16 epoch) const
+	{
+		ParallelForSlot& slot = parallelForSlots[threadIndex];
+
+		if (!slot.idlePending)
+			return;
+
+		//The loop ends of the last loop of the other threads aren't overwritten before the next synchronization
+		uint16 lastEpoch = epoch - 1;
+		std::chrono::steady_clock::time_point lastEnd = slot.loopEnd[lastEpoch % 2];
+		for (const ParallelForSlot& other : parallelForSlots)
+			lastEnd = std::max(lastEnd, other.loopEnd[lastEpoch % 2]);
+
+		slot.idleNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(lastEnd - slot.loopEnd[lastEpoch % 2]).count();
+		slot.idlePending = false;
+	}
 	void ThreadParallelTaskManager::SimulationThreadFunc(ThreadContext context)
 	{
 		if (context.manager == nullptr)
@@ -103,22 +207,24 @@ namespace SPH
 
 		auto& manager = *context.manager;
 
+		uint64 appliedAffinityGeneration = 0;
 			
 		std::unique_lock<std::mutex> lock{ manager.stateMutex };
 		while (true)
 		{			
 			++manager.threadIdleCount;
 			manager.stateCV.notify_all();
-			manager.stateCV.wait(lock, [&]() { return manager.exit || !manager.tasks.Empty(); });
+			manager.stateCV.wait(lock, [&]() { return manager.exit || manager.taskCount != 0; });
 			--manager.threadIdleCount;
 
 			if (manager.exit)
 				break;
 
-			auto taskIt = manager.tasks.FirstIterator();
-			TaskDataBase* task = taskIt.GetValue<TaskDataBase>();			
+			TaskDataBase* task = &manager.GetFirstTask();
 			lock.unlock();
 
+			manager.threadPool.ApplyThreadAffinity(context.threadIndex, appliedAffinityGeneration);
+
 			task->Execute(context);
 
 			lock.lock();
@@ -126,7 +232,7 @@ namespace SPH
 
 			if (context.threadIndex == 0)
 			{
-				manager.tasks.EraseFirst();
+				manager.PopTask();
 				manager.stateCV.notify_all();				
 			}
 
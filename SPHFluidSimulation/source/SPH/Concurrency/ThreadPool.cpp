@@ -1,10 +1,173 @@
 #include "pch.h"
 #include "SPH/Concurrency/ThreadPool.h"
 
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <filesystem>
+#include <fstream>
+#endif
+
 namespace SPH
 {
+#ifdef _WIN32
+	static Array<uint32> GetAllowedProcessors()
+	{
+		Array<uint32> processors;
+
+		ULONG highestNode = 0;
+		if (!GetNumaHighestNodeNumber(&highestNode))
+			return processors;
+
+		for (ULONG node = 0; node <= highestNode; ++node)
+		{
+			GROUP_AFFINITY affinity{ };
+			if (!GetNumaNodeProcessorMaskEx((USHORT)node, &affinity))
+				continue;
+
+			for (uint32 i = 0; i < 64; ++i)
+				if ((affinity.Mask >> i) & 1)
+					processors.AddBack((uint32)affinity.Group * 64 + i);
+		}
+
+		std::sort(processors.Ptr(), processors.Ptr() + processors.Count());
+		return processors;
+	}
+	static Array<Array<uint32>> GetNumaNodeProcessors()
+	{
+		Array<Array<uint32>> nodes;
+
+		ULONG highestNode = 0;
+		if (!GetNumaHighestNodeNumber(&highestNode))
+			return nodes;
+
+		for (ULONG node = 0; node <= highestNode; ++node)
+		{
+			GROUP_AFFINITY affinity{ };
+			if (!GetNumaNodeProcessorMaskEx((USHORT)node, &affinity) || affinity.Mask == 0)
+				continue;
+
+			Array<uint32>& processors = *nodes.AddBack();
+			for (uint32 i = 0; i < 64; ++i)
+				if ((affinity.Mask >> i) & 1)
+					processors.AddBack((uint32)affinity.Group * 64 + i);
+		}
+
+		return nodes;
+	}
+	static bool SetCurrentThreadProcessors(ArrayView<uint32> processors)
+	{
+		//A thread can only run on the processors of one group
+		GROUP_AFFINITY affinity{ };
+		affinity.Group = (WORD)(processors.First() / 64);
+
+		for (uint32 processor : processors)
+			if (processor / 64 == affinity.Group)
+				affinity.Mask |= (KAFFINITY)1 << (processor % 64);
+
+		return SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr) != 0;
+	}
+#else
+	static Array<uint32> GetAllowedProcessors()
+	{
+		Array<uint32> processors;
+
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		if (sched_getaffinity(0, sizeof(set), &set) != 0)
+			return processors;
+
+		for (uint32 i = 0; i < CPU_SETSIZE; ++i)
+			if (CPU_ISSET(i, &set))
+				processors.AddBack(i);
+
+		return processors;
+	}
+	//Parses a list like "0-15,32-47"
+	static Array<uint32> ParseProcessorList(const std::string& list)
+	{
+		Array<uint32> processors;
+
+		uintMem position = 0;
+		while (position < list.size())
+		{
+			uintMem end = list.find(',', position);
+			if (end == std::string::npos)
+				end = list.size();
+
+			std::string range = list.substr(position, end - position);
+			uintMem dash = range.find('-');
+
+			try
+			{
+				uint32 first = (uint32)std::stoul(range.substr(0, dash));
+				uint32 last = dash == std::string::npos ? first : (uint32)std::stoul(range.substr(dash + 1));
+
+				for (uint32 i = first; i <= last; ++i)
+					processors.AddBack(i);
+			}
+			catch (...)
+			{
+			}
+
+			position = end + 1;
+		}
+
+		return processors;
+	}
+	static Array<Array<uint32>> GetNumaNodeProcessors()
+	{
+		Array<Array<uint32>> nodes;
+		std::error_code error;
+
+		Array<std::filesystem::path> nodePaths;
+		for (const auto& entry : std::filesystem::directory_iterator("/sys/devices/system/node", error))
+		{
+			std::string name = entry.path().filename().string();
+			if (name.size() > 4 && name.compare(0, 4, "node") == 0 && std::isdigit((unsigned char)name[4]))
+				nodePaths.AddBack(entry.path());
+		}
+
+		std::sort(nodePaths.Ptr(), nodePaths.Ptr() + nodePaths.Count(), [](const std::filesystem::path& a, const std::filesystem::path& b) {
+			return std::stoul(a.filename().string().substr(4)) < std::stoul(b.filename().string().substr(4));
+			});
+
+		for (const auto& path : nodePaths)
+		{
+			std::ifstream file{ path / "cpulist" };
+			std::string list;
+			if (!std::getline(file, list))
+				continue;
+
+			Array<uint32> processors = ParseProcessorList(list);
+			if (!processors.Empty())
+				*nodes.AddBack() = std::move(processors);
+		}
+
+		return nodes;
+	}
+	static bool SetCurrentThreadProcessors(ArrayView<uint32> processors)
+	{
+		cpu_set_t set;
+		CPU_ZERO(&set);
+
+		for (uint32 processor : processors)
+			if (processor < CPU_SETSIZE)
+				CPU_SET(processor, &set);
+
+		return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+	}
+#endif
+
 	ThreadPool::ThreadPool()
+		: affinityPolicy(ThreadAffinityPolicy::None), affinityGeneration(1)
 	{
+		allowedProcessors = GetAllowedProcessors();
 	}
 
 	void ThreadPool::AllocateThreads(uintMem threadCount)
@@ -12,6 +175,103 @@ namespace SPH
 		threads.Resize(threadCount);
 	}
 
+	void ThreadPool::SetAffinityPolicy(ThreadAffinityPolicy policy, ArrayView<uint32> processors)
+	{
+		auto isAllowed = [&](uint32 processor) {
+			return std::binary_search(allowedProcessors.Ptr(), allowedProcessors.Ptr() + allowedProcessors.Count(), processor);
+			};
+
+		Array<uint32> orderedProcessors;
+
+		if (policy == ThreadAffinityPolicy::Explicit)
+		{
+			for (uint32 processor : processors)
+				if (isAllowed(processor))
+					orderedProcessors.AddBack(processor);
+
+			if (orderedProcessors.Count() != processors.Count())
+				Debug::Logger::LogWarning("SPH Library", "Some of the processors of the explicit thread affinity aren't available to the process. They are skipped");
+		}
+		else if (policy != ThreadAffinityPolicy::None)
+		{
+			Array<Array<uint32>> nodes;
+			for (auto& node : GetNumaNodeProcessors())
+			{
+				Array<uint32> allowedNodeProcessors;
+				for (uint32 processor : node)
+					if (isAllowed(processor))
+						allowedNodeProcessors.AddBack(processor);
+
+				if (!allowedNodeProcessors.Empty())
+					*nodes.AddBack() = std::move(allowedNodeProcessors);
+			}
+
+			//Without the NUMA topology all processors are treated as one node
+			if (nodes.Empty())
+				*nodes.AddBack() = allowedProcessors;
+
+			if (policy == ThreadAffinityPolicy::Compact)
+			{
+				for (auto& node : nodes)
+					for (uint32 processor : node)
+						orderedProcessors.AddBack(processor);
+			}
+			else
+			{
+				for (uintMem i = 0; orderedProcessors.Count() < allowedProcessors.Count(); ++i)
+				{
+					bool anyLeft = false;
+					for (auto& node : nodes)
+						if (i < node.Count())
+						{
+							orderedProcessors.AddBack(node[i]);
+							anyLeft = true;
+						}
+
+					if (!anyLeft)
+						break;
+				}
+			}
+		}
+
+		std::lock_guard lock{ affinityMutex };
+		affinityPolicy = policy;
+		affinityProcessors = std::move(orderedProcessors);
+		++affinityGeneration;
+	}
+
+	void ThreadPool::ApplyThreadAffinity(uintMem threadIndex, uint64& appliedGeneration) const
+	{
+		uint64 generation = affinityGeneration.load(std::memory_order_acquire);
+
+		if (generation == appliedGeneration)
+			return;
+
+		uint32 processor = GetThreadProcessor(threadIndex);
+
+		//A thread that was never pinned doesn't need to be unpinned
+		bool applied = true;
+		if (processor != UINT32_MAX)
+			applied = SetCurrentThreadProcessors(ArrayView<uint32>(&processor, 1));
+		else if (appliedGeneration != 0 && !allowedProcessors.Empty())
+			applied = SetCurrentThreadProcessors(allowedProcessors);
+
+		if (!applied)
+			Debug::Logger::LogWarning("SPH Library", "Failed to set the affinity of a thread");
+
+		appliedGeneration = generation;
+	}
+
+	uint32 ThreadPool::GetThreadProcessor(uintMem threadIndex) const
+	{
+		std::lock_guard lock{ affinityMutex };
+
+		if (affinityProcessors.Empty())
+			return UINT32_MAX;
+
+		return affinityProcessors[threadIndex % affinityProcessors.Count()];
+	}
+
 	bool ThreadPool::IsAnyRunning()
 	{
 		for (auto& thread : threads)
@@ -0,0 +1,159 @@
+#include "pch.h"
+#include "SPH/Core/PageBuffer.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#endif
+
+namespace SPH
+{
+	static uintMem RoundUp(uintMem size, uintMem alignment)
+	{
+		return (size + alignment - 1) / alignment * alignment;
+	}
+#ifdef _WIN32
+	static void* MapPages(uintMem size, PageSize pageSize)
+	{
+		switch (pageSize)
+		{
+		case PageSize::Large:
+			//Needs the "Lock pages in memory" privilege, the allocation fails without it
+			return VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+		case PageSize::Default:
+			return VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+		default:
+			//1 GiB pages and transparent large pages aren't available with VirtualAlloc
+			return nullptr;
+		}
+	}
+	static void UnmapPages(void* ptr, uintMem size)
+	{
+		VirtualFree(ptr, 0, MEM_RELEASE);
+	}
+#else
+	static void* MapPages(uintMem size, PageSize pageSize)
+	{
+		int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+		switch (pageSize)
+		{
+		case PageSize::Huge: flags |= MAP_HUGETLB | (30 << MAP_HUGE_SHIFT); break;
+		case PageSize::Large: flags |= MAP_HUGETLB | (21 << MAP_HUGE_SHIFT); break;
+		default: break;
+		}
+
+		void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+		if (ptr == MAP_FAILED)
+			return nullptr;
+
+		if (pageSize == PageSize::TransparentLarge && madvise(ptr, size, MADV_HUGEPAGE) != 0)
+		{
+			munmap(ptr, size);
+			return nullptr;
+		}
+
+		return ptr;
+	}
+	static void UnmapPages(void* ptr, uintMem size)
+	{
+		munmap(ptr, size);
+	}
+#endif
+
+	PageBuffer::PageBuffer()
+		: ptr(nullptr), size(0), allocatedSize(0), pageSize(PageSize::Default)
+	{
+	}
+	PageBuffer::PageBuffer(PageBuffer&& other) noexcept
+		: ptr(other.ptr), size(other.size), allocatedSize(other.allocatedSize), pageSize(other.pageSize)
+	{
+		other.ptr = nullptr;
+		other.size = 0;
+		other.allocatedSize = 0;
+		other.pageSize = PageSize::Default;
+	}
+	PageBuffer::~PageBuffer()
+	{
+		Clear();
+	}
+	void PageBuffer::Allocate(uintMem newSize, PageSize preferredPageSize)
+	{
+		Clear();
+
+		if (newSize == 0)
+			return;
+
+		//Small buffers would waste most of a large page
+		uintMem minimalSize = GetPageBytes(PageSize::Large) / 2;
+		if (newSize < minimalSize && preferredPageSize != PageSize::Default)
+			preferredPageSize = PageSize::TransparentLarge;
+
+		for (int i = (int)preferredPageSize; i >= 0; --i)
+		{
+			PageSize candidatePageSize = (PageSize)i;
+			uintMem candidateSize = RoundUp(newSize, GetPageBytes(candidatePageSize));
+
+			ptr = MapPages(candidateSize, candidatePageSize);
+
+			if (ptr != nullptr)
+			{
+				size = newSize;
+				allocatedSize = candidateSize;
+				pageSize = candidatePageSize;
+				return;
+			}
+		}
+
+		Debug::Logger::LogFatal("SPH Library", "Failed to allocate memory from the OS");
+	}
+	void PageBuffer::Clear()
+	{
+		if (ptr != nullptr)
+			UnmapPages(ptr, allocatedSize);
+
+		ptr = nullptr;
+		size = 0;
+		allocatedSize = 0;
+		pageSize = PageSize::Default;
+	}
+	PageBuffer& PageBuffer::operator=(PageBuffer&& other) noexcept
+	{
+		Clear();
+
+		ptr = other.ptr;
+		size = other.size;
+		allocatedSize = other.allocatedSize;
+		pageSize = other.pageSize;
+
+		other.ptr = nullptr;
+		other.size = 0;
+		other.allocatedSize = 0;
+		other.pageSize = PageSize::Default;
+
+		return *this;
+	}
+	uintMem PageBuffer::GetPageBytes(PageSize pageSize)
+	{
+		switch (pageSize)
+		{
+		case PageSize::Huge: return (uintMem)1 << 30;
+		case PageSize::Large:
+#ifdef _WIN32
+			return std::max<uintMem>(GetLargePageMinimum(), 4096);
+#else
+			return (uintMem)1 << 21;
+#endif
+		//The transparent large pages are only used for whole 2 MiB ranges of the mapping
+		case PageSize::TransparentLarge: return 4096;
+		default: return 4096;
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,26 @@
+#include "pch.h"
+#include "SPH/Core/ParticleBufferManager.h"
+
+namespace SPH
+{
+	void ConvertParticlesToStructOfArrays(const void* src, void* dst, uintMem particleSize, uintMem particleCount)
+	{
+		const uintMem componentCount = particleSize / sizeof(uint32);
+		const uint32* in = (const uint32*)src;
+		uint32* out = (uint32*)dst;
+
+		for (uintMem i = 0; i < particleCount; ++i)
+			for (uintMem j = 0; j < componentCount; ++j)
+				out[j * particleCount + i] = in[i * componentCount + j];
+	}
+	void ConvertParticlesToArrayOfStructs(const void* src, void* dst, uintMem particleSize, uintMem particleCount)
+	{
+		const uintMem componentCount = particleSize / sizeof(uint32);
+		const uint32* in = (const uint32*)src;
+		uint32* out = (uint32*)dst;
+
+		for (uintMem i = 0; i < particleCount; ++i)
+			for (uintMem j = 0; j < componentCount; ++j)
+				out[i * componentCount + j] = in[j * particleCount + i];
+	}
+}
\ No newline at end of file
@@ -35,14 +35,29 @@ namespace SPH
 		return false;
 	}
 
+	bool ParticleSimulationParameters::ParseParameter(StringView name, uint64& value) const
+	{
+		auto it = otherParameters.Find(name);
+
+		if (!it.IsNull())
+			if (!it->value.ConvertToInteger(value))
+				Debug::Logger::LogWarning("Client", "Failed to convert SPH system parameter named \"" + name + "\"");
+			else
+				return true;
+
+		return false;
+	}
+
 	namespace Details
 	{
 		inline Vec3u GetCell(Vec3f position, float maxInteractionDistance);
 		inline uint GetHash(Vec3u cell);
+		inline uint32 GetCellBucket(Vec3u cell, uint64 hashMapSize, const ParticleBehaviourParameters* parameters);
 		float SmoothingKernelConstant(float h);
 		inline float SmoothingKernelD0(float r, float maxInteractionDistance);
 		inline float SmoothingKernelD1(float r, float maxInteractionDistance);
 		inline float SmoothingKernelD2(float r, float maxInteractionDistance);
+		float TriangleInteractionDistance();
 	}
 
 	Vec3u SimulationEngine::GetCell(Vec3f position, float maxInteractionDistance)
@@ -53,6 +68,10 @@ namespace SPH
 	{
 		return Details::GetHash(cell);
 	}
+	uint SimulationEngine::GetCellBucket(Vec3u cell, uintMem bucketCount, const ParticleBehaviourParameters& parameters)
+	{
+		return Details::GetCellBucket(cell, bucketCount, &parameters);
+	}
 	float SimulationEngine::SmoothingKernelConstant(float h)
 	{
 		return Details::SmoothingKernelConstant(h);
@@ -69,4 +88,95 @@ namespace SPH
 	{
 		return Details::SmoothingKernelD2(r, maxInteractionDistance);
 	}
+	float SimulationEngine::TriangleInteractionDistance()
+	{
+		return Details::TriangleInteractionDistance();
+	}
+	uint64 SimulationEngine::CountScatteredParticleMapEntries(const uint32* particleMap, uintMem begin, uintMem end)
+	{
+		uint64 count = 0;
+		for (uintMem i = std::max<uintMem>(begin, 1); i < end; ++i)
+			count += particleMap[i] - particleMap[i - 1] + ParticleMapLocalityWindow > 2 * ParticleMapLocalityWindow;
+		return count;
+	}
+	void SimulationEngine::GenerateTriangleHashMap(ArrayView<Graphics::BasicIndexedMesh::Triangle> triangles, Array<uint32>& hashMap, Array<uint32>& triangleMap)
+	{
+		hashMap.Clear();
+		triangleMap.Clear();
+
+		if (triangles.Empty())
+			return;
+
+		float cellSize = TriangleInteractionDistance();
+
+		auto getCellRange = [&](const Graphics::BasicIndexedMesh::Triangle& triangle, Vec3u& beginCell, Vec3u& endCell) {
+			Vec3f min = Vec3f(
+				std::min({ triangle.p1.x, triangle.p2.x, triangle.p3.x }),
+				std::min({ triangle.p1.y, triangle.p2.y, triangle.p3.y }),
+				std::min({ triangle.p1.z, triangle.p2.z, triangle.p3.z })
+			);
+			Vec3f max = Vec3f(
+				std::max({ triangle.p1.x, triangle.p2.x, triangle.p3.x }),
+				std::max({ triangle.p1.y, triangle.p2.y, triangle.p3.y }),
+				std::max({ triangle.p1.z, triangle.p2.z, triangle.p3.z })
+			);
+
+			beginCell = GetCell(min, cellSize);
+			endCell = GetCell(max, cellSize) + Vec3u(1, 1, 1);
+			};
+
+		uintMem cellCount = 0;
+		for (auto& triangle : triangles)
+		{
+			Vec3u beginCell, endCell;
+			getCellRange(triangle, beginCell, endCell);
+			cellCount += (uintMem)(endCell.x - beginCell.x) * (endCell.y - beginCell.y) * (endCell.z - beginCell.z);
+		}
+
+		uintMem hashMapSize = 2 * cellCount;
+		hashMap = Array<uint32>(hashMapSize + 1);
+		memset(hashMap.Ptr(), 0, hashMap.Count() * sizeof(uint32));
+
+		//Calls the function once for every bucket the triangle is put in
+		Array<uint32> triangleHashes;
+		auto forEachTriangleHash = [&](const Graphics::BasicIndexedMesh::Triangle& triangle, const auto& function) {
+			Vec3u beginCell, endCell;
+			getCellRange(triangle, beginCell, endCell);
+
+			triangleHashes.Clear();
+
+			Vec3u cell;
+			for (cell.x = beginCell.x; cell.x != endCell.x; ++cell.x)
+				for (cell.y = beginCell.y; cell.y != endCell.y; ++cell.y)
+					for (cell.z = beginCell.z; cell.z != endCell.z; ++cell.z)
+					{
+						uint32 hash = GetHash(cell) % hashMapSize;
+
+						bool duplicate = false;
+						for (auto& other : triangleHashes)
+							duplicate = duplicate || other == hash;
+
+						if (!duplicate)
+						{
+							triangleHashes.AddBack(hash);
+							function(hash);
+						}
+					}
+			};
+
+		for (auto& triangle : triangles)
+			forEachTriangleHash(triangle, [&](uint32 hash) { ++hashMap[hash]; });
+
+		uint32 indexSum = 0;
+		for (auto& index : hashMap)
+		{
+			indexSum += index;
+			index = indexSum;
+		}
+
+		triangleMap.Resize(indexSum);
+
+		for (uintMem i = 0; i < triangles.Count(); ++i)
+			forEachTriangleHash(triangles[i], [&](uint32 hash) { triangleMap[--hashMap[hash]] = (uint32)i; });
+	}
 }
\ No newline at end of file
@@ -131,6 +131,19 @@ namespace SPH
 
 		return particles;
 	}
+	uintMem SceneBlueprint::GetLayerParticleCount(StringView layerName)
+	{
+		auto it = layers.Find(layerName);
+
+		if (it.IsNull())
+			return 0;
+
+		uintMem count = 0;
+		for (auto& particleSetBlueprint : it->value)
+			count += particleSetBlueprint->GetParticleCount();
+
+		return count;
+	}
 	bool SceneBlueprint::LoadScene(const Path& path)
 	{
 		File file{ path, FileAccessPermission::Read };
@@ -181,6 +194,15 @@ namespace SPH
 		validScene = true;
 		return true;
 	}
+	void SceneBlueprint::SetOtherParameter(StringView name, StringView value)
+	{
+		auto it = systemParameters.otherParameters.Find(name);
+
+		if (it.IsNull())
+			systemParameters.otherParameters.Insert(name, value);
+		else
+			it->value = value;
+	}
 	void SceneBlueprint::MarkAsInvalid()
 	{
 		*this = {};
@@ -0,0 +1,93 @@
+#include "pch.h"
+#include "SPH/Core/SimulationStatistics.h"
+
+namespace SPH
+{
+	double PhaseStatistics::MaxThreadSeconds() const
+	{
+		double max = 0;
+		for (double seconds : threadSeconds)
+			max = std::max(max, seconds);
+		return max;
+	}
+	double PhaseStatistics::MeanThreadSeconds() const
+	{
+		if (threadSeconds.Empty())
+			return 0;
+
+		double sum = 0;
+		for (double seconds : threadSeconds)
+			sum += seconds;
+		return sum / threadSeconds.Count();
+	}
+	double PhaseStatistics::MeanWaitSeconds() const
+	{
+		if (threadWaitSeconds.Empty())
+			return 0;
+
+		double sum = 0;
+		for (double seconds : threadWaitSeconds)
+			sum += seconds;
+		return sum / threadWaitSeconds.Count();
+	}
+	double PhaseStatistics::LoadImbalance() const
+	{
+		double mean = MeanThreadSeconds();
+		return mean == 0 ? 1.0 : MaxThreadSeconds() / mean;
+	}
+
+	ThreadPhaseRecorder::ThreadPhaseRecorder()
+		: threadStride(0), threadCount(0), phaseCount(0), stepCount(0), startTimestamp(0)
+	{
+	}
+	void ThreadPhaseRecorder::Initialize(uintMem threadCount, uintMem phaseCount)
+	{
+		this->threadCount = threadCount;
+		this->phaseCount = phaseCount;
+
+		//Rounded to whole cache lines with one more line of padding, because the array itself isn't cache line aligned
+		threadStride = (phaseCount * 3 + 7) / 8 * 8 + 8;
+		counters.Resize(threadStride * threadCount);
+
+		Reset();
+	}
+	void ThreadPhaseRecorder::Reset()
+	{
+		std::fill_n(counters.Ptr(), counters.Count(), 0);
+		stepCount = 0;
+
+		startTimestamp = ReadTimestamp();
+		startTime = std::chrono::steady_clock::now();
+	}
+	SimulationStatistics ThreadPhaseRecorder::GetStatistics(const char* const* phaseNames) const
+	{
+		//The timestamp counter frequency isn't known, it's measured against the steady clock since the last reset
+		double elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+		uint64 elapsedTicks = ReadTimestamp() - startTimestamp;
+		double secondsPerTick = elapsedTicks == 0 ? 0.0 : elapsedSeconds / elapsedTicks;
+
+		SimulationStatistics statistics;
+		statistics.stepCount = stepCount;
+
+		for (uintMem phase = 0; phase < phaseCount; ++phase)
+		{
+			PhaseStatistics phaseStatistics;
+			phaseStatistics.name = phaseNames[phase];
+			phaseStatistics.threadSeconds.Resize(threadCount);
+			phaseStatistics.threadWaitSeconds.Resize(threadCount);
+
+			for (uintMem i = 0; i < threadCount; ++i)
+			{
+				const uint64* slot = counters.Ptr() + i * threadStride;
+				phaseStatistics.threadSeconds[i] = slot[phase] * secondsPerTick;
+				phaseStatistics.threadWaitSeconds[i] = slot[phaseCount + phase] * secondsPerTick;
+				phaseStatistics.callCount = std::max(phaseStatistics.callCount, slot[phaseCount * 2 + phase]);
+			}
+
+			if (phaseStatistics.callCount != 0)
+				statistics.phases.AddBack(std::move(phaseStatistics));
+		}
+
+		return statistics;
+	}
+}
\ No newline at end of file
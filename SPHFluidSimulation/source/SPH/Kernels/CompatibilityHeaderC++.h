@@ -5,6 +5,7 @@ using namespace Blaze;
 
 #include <cmath>
 #include <atomic>
+#include <algorithm>
 
 #define NEW_VEC3I(x, y, z) Vec3i(x, y, z)
 #define NEW_VEC3U(x, y, z) Vec3u(x, y, z)
@@ -104,698 +104,495 @@ namespace SPH::Kernels
 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x73, 0x65, 0x6c, 0x66, 0x44, 0x65, 0x6e, 0x73, 0x69, 
 0x74, 0x79, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x73, 0x6d, 
 0x6f, 0x6f, 0x74, 0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x43, 0x6f, 
-0x6e, 0x73, 0x74, 0x61, 0x6e, 0x74, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x3b, 0x09, 0x0d, 0x0a, 
-0x0d, 0x0a, 0x09, 0x73, 0x74, 0x72, 0x75, 0x63, 0x74, 0x20, 0x50, 0x41, 0x43, 0x4b, 0x45, 
-0x44, 0x20, 0x54, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x0d, 0x0a, 0x09, 0x7b, 0x0d, 
-0x0a, 0x23, 0x69, 0x66, 0x64, 0x65, 0x66, 0x20, 0x43, 0x4c, 0x5f, 0x43, 0x4f, 0x4d, 0x50, 
-0x49, 0x4c, 0x45, 0x52, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x34, 0x66, 0x20, 0x70, 
-0x31, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x34, 0x66, 0x20, 0x70, 0x32, 0x3b, 
-0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x34, 0x66, 0x20, 0x70, 0x33, 0x3b, 0x0d, 0x0a, 
-0x23, 0x65, 0x6c, 0x73, 0x65, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 
-0x70, 0x31, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x70, 0x32, 
-0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x70, 0x33, 0x3b, 0x0d, 
-0x0a, 0x23, 0x65, 0x6e, 0x64, 0x69, 0x66, 0x0d, 0x0a, 0x09, 0x7d, 0x3b, 0x0d, 0x0a, 0x0d, 
-0x0a, 0x23, 0x69, 0x66, 0x6e, 0x64, 0x65, 0x66, 0x20, 0x43, 0x4c, 0x5f, 0x43, 0x4f, 0x4d, 
-0x50, 0x49, 0x4c, 0x45, 0x52, 0x0d, 0x0a, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x6e, 0x61, 0x6d, 
-0x65, 0x73, 0x70, 0x61, 0x63, 0x65, 0x20, 0x53, 0x50, 0x48, 0x3a, 0x3a, 0x44, 0x65, 0x74, 
-0x61, 0x69, 0x6c, 0x73, 0x0d, 0x0a, 0x7b, 0x0d, 0x0a, 0x23, 0x65, 0x6e, 0x64, 0x69, 0x66, 
-0x0d, 0x0a, 0x0d, 0x0a, 0x2f, 0x2f, 0x23, 0x64, 0x65, 0x66, 0x69, 0x6e, 0x65, 0x20, 0x44, 
-0x45, 0x42, 0x55, 0x47, 0x5f, 0x42, 0x55, 0x46, 0x46, 0x45, 0x52, 0x53, 0x5f, 0x4b, 0x45, 
-0x52, 0x4e, 0x45, 0x4c, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x56, 0x65, 0x63, 0x33, 0x75, 0x20, 
-0x46, 0x6c, 0x6f, 0x6f, 0x72, 0x28, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x76, 0x61, 0x6c, 
-0x75, 0x65, 0x29, 0x0d, 0x0a, 0x09, 0x7b, 0x0d, 0x0a, 0x23, 0x69, 0x66, 0x64, 0x65, 0x66, 
+0x6e, 0x73, 0x74, 0x61, 0x6e, 0x74, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x2f, 0x2f, 
+0x44, 0x65, 0x6e, 0x73, 0x65, 0x20, 0x67, 0x72, 0x69, 0x64, 0x0d, 0x0a, 0x09, 0x09, 0x75, 
+0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x67, 0x72, 0x69, 0x64, 0x4f, 0x72, 0x69, 0x67, 0x69, 
+0x6e, 0x58, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x67, 
+0x72, 0x69, 0x64, 0x4f, 0x72, 0x69, 0x67, 0x69, 0x6e, 0x59, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x67, 0x72, 0x69, 0x64, 0x4f, 0x72, 0x69, 0x67, 
+0x69, 0x6e, 0x5a, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 
+0x67, 0x72, 0x69, 0x64, 0x53, 0x69, 0x7a, 0x65, 0x58, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x75, 
+0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x67, 0x72, 0x69, 0x64, 0x53, 0x69, 0x7a, 0x65, 0x59, 
+0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x67, 0x72, 0x69, 
+0x64, 0x53, 0x69, 0x7a, 0x65, 0x5a, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 
+0x6e, 0x74, 0x33, 0x32, 0x20, 0x63, 0x65, 0x6c, 0x6c, 0x43, 0x75, 0x72, 0x76, 0x65, 0x3b, 
+0x0d, 0x0a, 0x09, 0x7d, 0x3b, 0x09, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x73, 0x74, 0x72, 0x75, 
+0x63, 0x74, 0x20, 0x50, 0x41, 0x43, 0x4b, 0x45, 0x44, 0x20, 0x54, 0x72, 0x69, 0x61, 0x6e, 
+0x67, 0x6c, 0x65, 0x0d, 0x0a, 0x09, 0x7b, 0x0d, 0x0a, 0x23, 0x69, 0x66, 0x64, 0x65, 0x66, 
 0x20, 0x43, 0x4c, 0x5f, 0x43, 0x4f, 0x4d, 0x50, 0x49, 0x4c, 0x45, 0x52, 0x0d, 0x0a, 0x09, 
-0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x61, 0x73, 0x5f, 0x75, 0x69, 0x6e, 0x74, 
-0x33, 0x28, 0x63, 0x6f, 0x6e, 0x76, 0x65, 0x72, 0x74, 0x5f, 0x69, 0x6e, 0x74, 0x33, 0x5f, 
-0x72, 0x74, 0x6e, 0x28, 0x76, 0x61, 0x6c, 0x75, 0x65, 0x29, 0x29, 0x3b, 0x0d, 0x0a, 0x23, 
-0x65, 0x6c, 0x73, 0x65, 0x0d, 0x0a, 0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 
-0x56, 0x65, 0x63, 0x33, 0x75, 0x28, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x73, 0x74, 0x61, 0x74, 
-0x69, 0x63, 0x5f, 0x63, 0x61, 0x73, 0x74, 0x3c, 0x75, 0x69, 0x6e, 0x74, 0x3e, 0x28, 0x73, 
-0x74, 0x64, 0x3a, 0x3a, 0x66, 0x6c, 0x6f, 0x6f, 0x72, 0x66, 0x28, 0x76, 0x61, 0x6c, 0x75, 
-0x65, 0x2e, 0x78, 0x29, 0x29, 0x2c, 0x20, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x73, 0x74, 0x61, 
-0x74, 0x69, 0x63, 0x5f, 0x63, 0x61, 0x73, 0x74, 0x3c, 0x75, 0x69, 0x6e, 0x74, 0x3e, 0x28, 
-0x73, 0x74, 0x64, 0x3a, 0x3a, 0x66, 0x6c, 0x6f, 0x6f, 0x72, 0x66, 0x28, 0x76, 0x61, 0x6c, 
-0x75, 0x65, 0x2e, 0x79, 0x29, 0x29, 0x2c, 0x20, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x73, 0x74, 
-0x61, 0x74, 0x69, 0x63, 0x5f, 0x63, 0x61, 0x73, 0x74, 0x3c, 0x75, 0x69, 0x6e, 0x74, 0x3e, 
-0x28, 0x73, 0x74, 0x64, 0x3a, 0x3a, 0x66, 0x6c, 0x6f, 0x6f, 0x72, 0x66, 0x28, 0x76, 0x61, 
-0x6c, 0x75, 0x65, 0x2e, 0x7a, 0x29, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x29, 0x3b, 0x0d, 0x0a, 
-0x23, 0x65, 0x6e, 0x64, 0x69, 0x66, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 
-0x2f, 0x2f, 0x45, 0x78, 0x70, 0x65, 0x63, 0x74, 0x73, 0x20, 0x76, 0x61, 0x6c, 0x75, 0x65, 
-0x20, 0x69, 0x6e, 0x20, 0x72, 0x61, 0x6e, 0x67, 0x65, 0x20, 0x5b, 0x30, 0x2c, 0x20, 0x31, 
-0x30, 0x32, 0x34, 0x29, 0x0d, 0x0a, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x45, 
-0x78, 0x70, 0x61, 0x6e, 0x64, 0x42, 0x69, 0x74, 0x73, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 
-0x32, 0x20, 0x76, 0x29, 0x0d, 0x0a, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x76, 0x20, 0x3d, 
-0x20, 0x28, 0x76, 0x20, 0x2a, 0x20, 0x30, 0x78, 0x30, 0x30, 0x30, 0x31, 0x30, 0x30, 0x30, 
-0x31, 0x75, 0x29, 0x20, 0x26, 0x20, 0x30, 0x78, 0x46, 0x46, 0x30, 0x30, 0x30, 0x30, 0x46, 
+0x09, 0x56, 0x65, 0x63, 0x34, 0x66, 0x20, 0x70, 0x31, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x56, 
+0x65, 0x63, 0x34, 0x66, 0x20, 0x70, 0x32, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 
+0x34, 0x66, 0x20, 0x70, 0x33, 0x3b, 0x0d, 0x0a, 0x23, 0x65, 0x6c, 0x73, 0x65, 0x0d, 0x0a, 
+0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x70, 0x31, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x70, 0x32, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 
+0x63, 0x33, 0x66, 0x20, 0x70, 0x33, 0x3b, 0x0d, 0x0a, 0x23, 0x65, 0x6e, 0x64, 0x69, 0x66, 
+0x0d, 0x0a, 0x09, 0x7d, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x23, 0x69, 0x66, 0x6e, 0x64, 0x65, 
+0x66, 0x20, 0x43, 0x4c, 0x5f, 0x43, 0x4f, 0x4d, 0x50, 0x49, 0x4c, 0x45, 0x52, 0x0d, 0x0a, 
+0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x6e, 0x61, 0x6d, 0x65, 0x73, 0x70, 0x61, 0x63, 0x65, 0x20, 
+0x53, 0x50, 0x48, 0x3a, 0x3a, 0x44, 0x65, 0x74, 0x61, 0x69, 0x6c, 0x73, 0x0d, 0x0a, 0x7b, 
+0x0d, 0x0a, 0x23, 0x65, 0x6e, 0x64, 0x69, 0x66, 0x0d, 0x0a, 0x0d, 0x0a, 0x2f, 0x2f, 0x23, 
+0x64, 0x65, 0x66, 0x69, 0x6e, 0x65, 0x20, 0x44, 0x45, 0x42, 0x55, 0x47, 0x5f, 0x42, 0x55, 
+0x46, 0x46, 0x45, 0x52, 0x53, 0x5f, 0x4b, 0x45, 0x52, 0x4e, 0x45, 0x4c, 0x0d, 0x0a, 0x0d, 
+0x0a, 0x09, 0x56, 0x65, 0x63, 0x33, 0x75, 0x20, 0x46, 0x6c, 0x6f, 0x6f, 0x72, 0x28, 0x56, 
+0x65, 0x63, 0x33, 0x66, 0x20, 0x76, 0x61, 0x6c, 0x75, 0x65, 0x29, 0x0d, 0x0a, 0x09, 0x7b, 
+0x0d, 0x0a, 0x23, 0x69, 0x66, 0x64, 0x65, 0x66, 0x20, 0x43, 0x4c, 0x5f, 0x43, 0x4f, 0x4d, 
+0x50, 0x49, 0x4c, 0x45, 0x52, 0x0d, 0x0a, 0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 
+0x20, 0x61, 0x73, 0x5f, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x28, 0x63, 0x6f, 0x6e, 0x76, 0x65, 
+0x72, 0x74, 0x5f, 0x69, 0x6e, 0x74, 0x33, 0x5f, 0x72, 0x74, 0x6e, 0x28, 0x76, 0x61, 0x6c, 
+0x75, 0x65, 0x29, 0x29, 0x3b, 0x0d, 0x0a, 0x23, 0x65, 0x6c, 0x73, 0x65, 0x0d, 0x0a, 0x09, 
+0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x56, 0x65, 0x63, 0x33, 0x75, 0x28, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x5f, 0x63, 0x61, 0x73, 0x74, 
+0x3c, 0x75, 0x69, 0x6e, 0x74, 0x3e, 0x28, 0x73, 0x74, 0x64, 0x3a, 0x3a, 0x66, 0x6c, 0x6f, 
+0x6f, 0x72, 0x28, 0x76, 0x61, 0x6c, 0x75, 0x65, 0x2e, 0x78, 0x29, 0x29, 0x2c, 0x20, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x5f, 0x63, 0x61, 0x73, 0x74, 
+0x3c, 0x75, 0x69, 0x6e, 0x74, 0x3e, 0x28, 0x73, 0x74, 0x64, 0x3a, 0x3a, 0x66, 0x6c, 0x6f, 
+0x6f, 0x72, 0x28, 0x76, 0x61, 0x6c, 0x75, 0x65, 0x2e, 0x79, 0x29, 0x29, 0x2c, 0x20, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x5f, 0x63, 0x61, 0x73, 0x74, 
+0x3c, 0x75, 0x69, 0x6e, 0x74, 0x3e, 0x28, 0x73, 0x74, 0x64, 0x3a, 0x3a, 0x66, 0x6c, 0x6f, 
+0x6f, 0x72, 0x28, 0x76, 0x61, 0x6c, 0x75, 0x65, 0x2e, 0x7a, 0x29, 0x29, 0x0d, 0x0a, 0x09, 
+0x09, 0x29, 0x3b, 0x0d, 0x0a, 0x23, 0x65, 0x6e, 0x64, 0x69, 0x66, 0x0d, 0x0a, 0x09, 0x7d, 
+0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x2f, 0x2f, 0x45, 0x78, 0x70, 0x65, 0x63, 0x74, 0x73, 0x20, 
+0x76, 0x61, 0x6c, 0x75, 0x65, 0x20, 0x69, 0x6e, 0x20, 0x72, 0x61, 0x6e, 0x67, 0x65, 0x20, 
+0x5b, 0x30, 0x2c, 0x20, 0x31, 0x30, 0x32, 0x34, 0x29, 0x0d, 0x0a, 0x09, 0x75, 0x69, 0x6e, 
+0x74, 0x33, 0x32, 0x20, 0x45, 0x78, 0x70, 0x61, 0x6e, 0x64, 0x42, 0x69, 0x74, 0x73, 0x28, 
+0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x76, 0x29, 0x0d, 0x0a, 0x09, 0x7b, 0x0d, 0x0a, 
+0x09, 0x09, 0x76, 0x20, 0x3d, 0x20, 0x28, 0x76, 0x20, 0x2a, 0x20, 0x30, 0x78, 0x30, 0x30, 
+0x30, 0x31, 0x30, 0x30, 0x30, 0x31, 0x75, 0x29, 0x20, 0x26, 0x20, 0x30, 0x78, 0x46, 0x46, 
+0x30, 0x30, 0x30, 0x30, 0x46, 0x46, 0x75, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x76, 0x20, 0x3d, 
+0x20, 0x28, 0x76, 0x20, 0x2a, 0x20, 0x30, 0x78, 0x30, 0x30, 0x30, 0x30, 0x30, 0x31, 0x30, 
+0x31, 0x75, 0x29, 0x20, 0x26, 0x20, 0x30, 0x78, 0x30, 0x46, 0x30, 0x30, 0x46, 0x30, 0x30, 
 0x46, 0x75, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x76, 0x20, 0x3d, 0x20, 0x28, 0x76, 0x20, 0x2a, 
-0x20, 0x30, 0x78, 0x30, 0x30, 0x30, 0x30, 0x30, 0x31, 0x30, 0x31, 0x75, 0x29, 0x20, 0x26, 
-0x20, 0x30, 0x78, 0x30, 0x46, 0x30, 0x30, 0x46, 0x30, 0x30, 0x46, 0x75, 0x3b, 0x0d, 0x0a, 
+0x20, 0x30, 0x78, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x31, 0x31, 0x75, 0x29, 0x20, 0x26, 
+0x20, 0x30, 0x78, 0x43, 0x33, 0x30, 0x43, 0x33, 0x30, 0x43, 0x33, 0x75, 0x3b, 0x0d, 0x0a, 
 0x09, 0x09, 0x76, 0x20, 0x3d, 0x20, 0x28, 0x76, 0x20, 0x2a, 0x20, 0x30, 0x78, 0x30, 0x30, 
-0x30, 0x30, 0x30, 0x30, 0x31, 0x31, 0x75, 0x29, 0x20, 0x26, 0x20, 0x30, 0x78, 0x43, 0x33, 
-0x30, 0x43, 0x33, 0x30, 0x43, 0x33, 0x75, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x76, 0x20, 0x3d, 
-0x20, 0x28, 0x76, 0x20, 0x2a, 0x20, 0x30, 0x78, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 
-0x35, 0x75, 0x29, 0x20, 0x26, 0x20, 0x30, 0x78, 0x34, 0x39, 0x32, 0x34, 0x39, 0x32, 0x34, 
-0x39, 0x75, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x76, 
-0x3b, 0x09, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x75, 0x69, 0x6e, 0x74, 
-0x33, 0x32, 0x20, 0x4d, 0x6f, 0x72, 0x74, 0x6f, 0x6e, 0x33, 0x44, 0x28, 0x56, 0x65, 0x63, 
-0x33, 0x75, 0x20, 0x76, 0x61, 0x6c, 0x75, 0x65, 0x29, 0x0d, 0x0a, 0x09, 0x7b, 0x0d, 0x0a, 
-0x09, 0x09, 0x2f, 0x2f, 0x63, 0x65, 0x6e, 0x74, 0x65, 0x72, 0x20, 0x73, 0x6f, 0x20, 0x74, 
-0x68, 0x61, 0x74, 0x20, 0x30, 0x2c, 0x20, 0x30, 0x2c, 0x20, 0x30, 0x20, 0x69, 0x73, 0x20, 
-0x69, 0x6e, 0x20, 0x74, 0x68, 0x65, 0x20, 0x63, 0x65, 0x6e, 0x74, 0x65, 0x72, 0x20, 0x6f, 
-0x66, 0x20, 0x74, 0x68, 0x65, 0x20, 0x6d, 0x6f, 0x72, 0x74, 0x6f, 0x6e, 0x20, 0x63, 0x75, 
-0x62, 0x65, 0x0d, 0x0a, 0x09, 0x09, 0x2f, 0x2f, 0x76, 0x61, 0x6c, 0x75, 0x65, 0x20, 0x3d, 
-0x20, 0x76, 0x61, 0x6c, 0x75, 0x65, 0x20, 0x2b, 0x20, 0x4e, 0x45, 0x57, 0x5f, 0x56, 0x45, 
-0x43, 0x33, 0x49, 0x28, 0x35, 0x31, 0x32, 0x2c, 0x20, 0x35, 0x31, 0x32, 0x2c, 0x20, 0x35, 
-0x31, 0x32, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 
-0x32, 0x20, 0x78, 0x78, 0x20, 0x3d, 0x20, 0x45, 0x78, 0x70, 0x61, 0x6e, 0x64, 0x42, 0x69, 
-0x74, 0x73, 0x28, 0x76, 0x61, 0x6c, 0x75, 0x65, 0x2e, 0x78, 0x20, 0x26, 0x20, 0x30, 0x78, 
-0x30, 0x30, 0x30, 0x30, 0x30, 0x33, 0x46, 0x46, 0x75, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
-0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x79, 0x79, 0x20, 0x3d, 0x20, 0x45, 0x78, 0x70, 
-0x61, 0x6e, 0x64, 0x42, 0x69, 0x74, 0x73, 0x28, 0x76, 0x61, 0x6c, 0x75, 0x65, 0x2e, 0x79, 
+0x30, 0x30, 0x30, 0x30, 0x30, 0x35, 0x75, 0x29, 0x20, 0x26, 0x20, 0x30, 0x78, 0x34, 0x39, 
+0x32, 0x34, 0x39, 0x32, 0x34, 0x39, 0x75, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x72, 0x65, 0x74, 
+0x75, 0x72, 0x6e, 0x20, 0x76, 0x3b, 0x09, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 
+0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x4d, 0x6f, 0x72, 0x74, 0x6f, 0x6e, 0x33, 
+0x44, 0x28, 0x56, 0x65, 0x63, 0x33, 0x75, 0x20, 0x76, 0x61, 0x6c, 0x75, 0x65, 0x29, 0x0d, 
+0x0a, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x2f, 0x2f, 0x63, 0x65, 0x6e, 0x74, 0x65, 0x72, 
+0x20, 0x73, 0x6f, 0x20, 0x74, 0x68, 0x61, 0x74, 0x20, 0x30, 0x2c, 0x20, 0x30, 0x2c, 0x20, 
+0x30, 0x20, 0x69, 0x73, 0x20, 0x69, 0x6e, 0x20, 0x74, 0x68, 0x65, 0x20, 0x63, 0x65, 0x6e, 
+0x74, 0x65, 0x72, 0x20, 0x6f, 0x66, 0x20, 0x74, 0x68, 0x65, 0x20, 0x6d, 0x6f, 0x72, 0x74, 
+0x6f, 0x6e, 0x20, 0x63, 0x75, 0x62, 0x65, 0x0d, 0x0a, 0x09, 0x09, 0x2f, 0x2f, 0x76, 0x61, 
+0x6c, 0x75, 0x65, 0x20, 0x3d, 0x20, 0x76, 0x61, 0x6c, 0x75, 0x65, 0x20, 0x2b, 0x20, 0x4e, 
+0x45, 0x57, 0x5f, 0x56, 0x45, 0x43, 0x33, 0x49, 0x28, 0x35, 0x31, 0x32, 0x2c, 0x20, 0x35, 
+0x31, 0x32, 0x2c, 0x20, 0x35, 0x31, 0x32, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 
+0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x78, 0x78, 0x20, 0x3d, 0x20, 0x45, 0x78, 0x70, 
+0x61, 0x6e, 0x64, 0x42, 0x69, 0x74, 0x73, 0x28, 0x76, 0x61, 0x6c, 0x75, 0x65, 0x2e, 0x78, 
 0x20, 0x26, 0x20, 0x30, 0x78, 0x30, 0x30, 0x30, 0x30, 0x30, 0x33, 0x46, 0x46, 0x75, 0x29, 
-0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x7a, 0x7a, 0x20, 
+0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x79, 0x79, 0x20, 
 0x3d, 0x20, 0x45, 0x78, 0x70, 0x61, 0x6e, 0x64, 0x42, 0x69, 0x74, 0x73, 0x28, 0x76, 0x61, 
-0x6c, 0x75, 0x65, 0x2e, 0x7a, 0x20, 0x26, 0x20, 0x30, 0x78, 0x30, 0x30, 0x30, 0x30, 0x30, 
-0x33, 0x46, 0x46, 0x75, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 
-0x6e, 0x20, 0x78, 0x78, 0x20, 0x2b, 0x20, 0x79, 0x79, 0x20, 0x2a, 0x20, 0x32, 0x20, 0x2b, 
-0x20, 0x7a, 0x7a, 0x20, 0x2a, 0x20, 0x34, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 
-0x0a, 0x09, 0x69, 0x6e, 0x6c, 0x69, 0x6e, 0x65, 0x20, 0x56, 0x65, 0x63, 0x33, 0x75, 0x20, 
-0x47, 0x65, 0x74, 0x43, 0x65, 0x6c, 0x6c, 0x28, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x70, 
-0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x2c, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 
-0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 
-0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x0d, 0x0a, 0x09, 0x7b, 0x09, 0x09, 0x0d, 
-0x0a, 0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x46, 0x6c, 0x6f, 0x6f, 0x72, 
-0x28, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x2f, 0x20, 0x6d, 0x61, 0x78, 
-0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 
-0x61, 0x6e, 0x63, 0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x09, 0x0d, 0x0a, 0x09, 0x69, 
+0x6c, 0x75, 0x65, 0x2e, 0x79, 0x20, 0x26, 0x20, 0x30, 0x78, 0x30, 0x30, 0x30, 0x30, 0x30, 
+0x33, 0x46, 0x46, 0x75, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 
+0x32, 0x20, 0x7a, 0x7a, 0x20, 0x3d, 0x20, 0x45, 0x78, 0x70, 0x61, 0x6e, 0x64, 0x42, 0x69, 
+0x74, 0x73, 0x28, 0x76, 0x61, 0x6c, 0x75, 0x65, 0x2e, 0x7a, 0x20, 0x26, 0x20, 0x30, 0x78, 
+0x30, 0x30, 0x30, 0x30, 0x30, 0x33, 0x46, 0x46, 0x75, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x78, 0x78, 0x20, 0x2b, 0x20, 0x79, 0x79, 0x20, 
+0x2a, 0x20, 0x32, 0x20, 0x2b, 0x20, 0x7a, 0x7a, 0x20, 0x2a, 0x20, 0x34, 0x3b, 0x0d, 0x0a, 
+0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x2f, 0x2f, 0x53, 0x6b, 0x69, 0x6c, 0x6c, 0x69, 0x6e, 0x67, 
+0x27, 0x73, 0x20, 0x74, 0x72, 0x61, 0x6e, 0x73, 0x66, 0x6f, 0x72, 0x6d, 0x20, 0x6f, 0x66, 
+0x20, 0x74, 0x68, 0x65, 0x20, 0x63, 0x65, 0x6c, 0x6c, 0x20, 0x69, 0x6e, 0x74, 0x6f, 0x20, 
+0x74, 0x68, 0x65, 0x20, 0x74, 0x72, 0x61, 0x6e, 0x73, 0x70, 0x6f, 0x73, 0x65, 0x64, 0x20, 
+0x48, 0x69, 0x6c, 0x62, 0x65, 0x72, 0x74, 0x20, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x2c, 0x20, 
+0x77, 0x68, 0x6f, 0x73, 0x65, 0x20, 0x62, 0x69, 0x74, 0x73, 0x20, 0x61, 0x72, 0x65, 0x20, 
+0x74, 0x68, 0x65, 0x6e, 0x20, 0x69, 0x6e, 0x74, 0x65, 0x72, 0x6c, 0x65, 0x61, 0x76, 0x65, 
+0x64, 0x20, 0x74, 0x68, 0x65, 0x20, 0x73, 0x61, 0x6d, 0x65, 0x20, 0x77, 0x61, 0x79, 0x0d, 
+0x0a, 0x09, 0x2f, 0x2f, 0x61, 0x73, 0x20, 0x74, 0x68, 0x65, 0x20, 0x6f, 0x6e, 0x65, 0x73, 
+0x20, 0x6f, 0x66, 0x20, 0x74, 0x68, 0x65, 0x20, 0x4d, 0x6f, 0x72, 0x74, 0x6f, 0x6e, 0x20, 
+0x63, 0x6f, 0x64, 0x65, 0x2e, 0x20, 0x55, 0x6e, 0x6c, 0x69, 0x6b, 0x65, 0x20, 0x77, 0x69, 
+0x74, 0x68, 0x20, 0x74, 0x68, 0x65, 0x20, 0x4d, 0x6f, 0x72, 0x74, 0x6f, 0x6e, 0x20, 0x63, 
+0x6f, 0x64, 0x65, 0x2c, 0x20, 0x63, 0x65, 0x6c, 0x6c, 0x73, 0x20, 0x77, 0x69, 0x74, 0x68, 
+0x20, 0x63, 0x6f, 0x6e, 0x73, 0x65, 0x63, 0x75, 0x74, 0x69, 0x76, 0x65, 0x20, 0x63, 0x6f, 
+0x64, 0x65, 0x73, 0x20, 0x61, 0x72, 0x65, 0x20, 0x61, 0x6c, 0x77, 0x61, 0x79, 0x73, 0x20, 
+0x6e, 0x65, 0x69, 0x67, 0x68, 0x62, 0x6f, 0x75, 0x72, 0x73, 0x0d, 0x0a, 0x09, 0x75, 0x69, 
+0x6e, 0x74, 0x33, 0x32, 0x20, 0x48, 0x69, 0x6c, 0x62, 0x65, 0x72, 0x74, 0x33, 0x44, 0x28, 
+0x56, 0x65, 0x63, 0x33, 0x75, 0x20, 0x76, 0x61, 0x6c, 0x75, 0x65, 0x29, 0x0d, 0x0a, 0x09, 
+0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x78, 0x20, 0x3d, 
+0x20, 0x76, 0x61, 0x6c, 0x75, 0x65, 0x2e, 0x78, 0x20, 0x26, 0x20, 0x30, 0x78, 0x30, 0x30, 
+0x30, 0x30, 0x30, 0x33, 0x46, 0x46, 0x75, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 
+0x74, 0x33, 0x32, 0x20, 0x79, 0x20, 0x3d, 0x20, 0x76, 0x61, 0x6c, 0x75, 0x65, 0x2e, 0x79, 
+0x20, 0x26, 0x20, 0x30, 0x78, 0x30, 0x30, 0x30, 0x30, 0x30, 0x33, 0x46, 0x46, 0x75, 0x3b, 
+0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x7a, 0x20, 0x3d, 0x20, 
+0x76, 0x61, 0x6c, 0x75, 0x65, 0x2e, 0x7a, 0x20, 0x26, 0x20, 0x30, 0x78, 0x30, 0x30, 0x30, 
+0x30, 0x30, 0x33, 0x46, 0x46, 0x75, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6f, 
+0x72, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x71, 0x20, 0x3d, 0x20, 0x31, 
+0x75, 0x20, 0x3c, 0x3c, 0x20, 0x39, 0x3b, 0x20, 0x71, 0x20, 0x3e, 0x20, 0x31, 0x3b, 0x20, 
+0x71, 0x20, 0x3e, 0x3e, 0x3d, 0x20, 0x31, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x70, 0x20, 0x3d, 0x20, 0x71, 
+0x20, 0x2d, 0x20, 0x31, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 
+0x32, 0x20, 0x74, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 
+0x28, 0x78, 0x20, 0x26, 0x20, 0x71, 0x29, 0x20, 0x21, 0x3d, 0x20, 0x30, 0x29, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x78, 0x20, 0x5e, 0x3d, 0x20, 0x70, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x28, 0x79, 0x20, 0x26, 0x20, 0x71, 0x29, 0x20, 
+0x21, 0x3d, 0x20, 0x30, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x78, 0x20, 0x5e, 0x3d, 
+0x20, 0x70, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x65, 0x6c, 0x73, 0x65, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x74, 0x20, 0x3d, 0x20, 0x28, 0x78, 
+0x20, 0x5e, 0x20, 0x79, 0x29, 0x20, 0x26, 0x20, 0x70, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x78, 0x20, 0x5e, 0x3d, 0x20, 0x74, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x79, 
+0x20, 0x5e, 0x3d, 0x20, 0x74, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x28, 0x7a, 0x20, 0x26, 0x20, 0x71, 0x29, 
+0x20, 0x21, 0x3d, 0x20, 0x30, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x78, 0x20, 0x5e, 
+0x3d, 0x20, 0x70, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x65, 0x6c, 0x73, 0x65, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x74, 0x20, 0x3d, 0x20, 0x28, 
+0x78, 0x20, 0x5e, 0x20, 0x7a, 0x29, 0x20, 0x26, 0x20, 0x70, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x09, 0x78, 0x20, 0x5e, 0x3d, 0x20, 0x74, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x7a, 0x20, 0x5e, 0x3d, 0x20, 0x74, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 
+0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x79, 0x20, 0x5e, 0x3d, 0x20, 0x78, 
+0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x7a, 0x20, 0x5e, 0x3d, 0x20, 0x79, 0x3b, 0x0d, 0x0a, 0x0d, 
+0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x74, 0x20, 0x3d, 0x20, 0x30, 
+0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 
+0x32, 0x20, 0x71, 0x20, 0x3d, 0x20, 0x31, 0x75, 0x20, 0x3c, 0x3c, 0x20, 0x39, 0x3b, 0x20, 
+0x71, 0x20, 0x3e, 0x20, 0x31, 0x3b, 0x20, 0x71, 0x20, 0x3e, 0x3e, 0x3d, 0x20, 0x31, 0x29, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x28, 0x7a, 0x20, 0x26, 0x20, 0x71, 
+0x29, 0x20, 0x21, 0x3d, 0x20, 0x30, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x74, 0x20, 
+0x5e, 0x3d, 0x20, 0x71, 0x20, 0x2d, 0x20, 0x31, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 
+0x78, 0x20, 0x5e, 0x3d, 0x20, 0x74, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x79, 0x20, 0x5e, 0x3d, 
+0x20, 0x74, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x7a, 0x20, 0x5e, 0x3d, 0x20, 0x74, 0x3b, 0x0d, 
+0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x45, 0x78, 0x70, 
+0x61, 0x6e, 0x64, 0x42, 0x69, 0x74, 0x73, 0x28, 0x7a, 0x29, 0x20, 0x2b, 0x20, 0x45, 0x78, 
+0x70, 0x61, 0x6e, 0x64, 0x42, 0x69, 0x74, 0x73, 0x28, 0x79, 0x29, 0x20, 0x2a, 0x20, 0x32, 
+0x20, 0x2b, 0x20, 0x45, 0x78, 0x70, 0x61, 0x6e, 0x64, 0x42, 0x69, 0x74, 0x73, 0x28, 0x78, 
+0x29, 0x20, 0x2a, 0x20, 0x34, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 
+0x69, 0x6e, 0x6c, 0x69, 0x6e, 0x65, 0x20, 0x56, 0x65, 0x63, 0x33, 0x75, 0x20, 0x47, 0x65, 
+0x74, 0x43, 0x65, 0x6c, 0x6c, 0x28, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x70, 0x6f, 0x73, 
+0x69, 0x74, 0x69, 0x6f, 0x6e, 0x2c, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x6d, 0x61, 
+0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 
+0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x0d, 0x0a, 0x09, 0x7b, 0x09, 0x09, 0x0d, 0x0a, 0x09, 
+0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x46, 0x6c, 0x6f, 0x6f, 0x72, 0x28, 0x70, 
+0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x2f, 0x20, 0x6d, 0x61, 0x78, 0x49, 0x6e, 
+0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 
+0x63, 0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x09, 0x0d, 0x0a, 0x09, 0x69, 0x6e, 0x6c, 
+0x69, 0x6e, 0x65, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x47, 0x65, 0x74, 0x48, 
+0x61, 0x73, 0x68, 0x28, 0x56, 0x65, 0x63, 0x33, 0x75, 0x20, 0x63, 0x65, 0x6c, 0x6c, 0x29, 
+0x0d, 0x0a, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x2f, 0x2f, 0x4d, 0x6f, 0x72, 0x74, 0x6f, 
+0x6e, 0x20, 0x68, 0x61, 0x73, 0x68, 0x0d, 0x0a, 0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 
+0x6e, 0x20, 0x4d, 0x6f, 0x72, 0x74, 0x6f, 0x6e, 0x33, 0x44, 0x28, 0x63, 0x65, 0x6c, 0x6c, 
+0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x2f, 0x2f, 0x52, 0x61, 0x6e, 0x64, 0x6f, 
+0x6d, 0x20, 0x68, 0x61, 0x73, 0x68, 0x0d, 0x0a, 0x09, 0x09, 0x2f, 0x2f, 0x72, 0x65, 0x74, 
+0x75, 0x72, 0x6e, 0x20, 0x28, 0x0d, 0x0a, 0x09, 0x09, 0x2f, 0x2f, 0x09, 0x28, 0x28, 0x28, 
+0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x29, 0x63, 0x65, 0x6c, 0x6c, 0x2e, 0x78, 0x29, 0x20, 
+0x2a, 0x20, 0x37, 0x33, 0x38, 0x35, 0x36, 0x30, 0x39, 0x33, 0x29, 0x20, 0x5e, 0x0d, 0x0a, 
+0x09, 0x09, 0x2f, 0x2f, 0x09, 0x28, 0x28, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x29, 
+0x63, 0x65, 0x6c, 0x6c, 0x2e, 0x79, 0x29, 0x20, 0x2a, 0x20, 0x31, 0x39, 0x33, 0x34, 0x39, 
+0x36, 0x36, 0x33, 0x29, 0x20, 0x5e, 0x0d, 0x0a, 0x09, 0x09, 0x2f, 0x2f, 0x09, 0x28, 0x28, 
+0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x29, 0x63, 0x65, 0x6c, 0x6c, 0x2e, 0x7a, 0x29, 
+0x20, 0x2a, 0x20, 0x38, 0x33, 0x34, 0x39, 0x32, 0x37, 0x39, 0x31, 0x29, 0x0d, 0x0a, 0x09, 
+0x09, 0x2f, 0x2f, 0x09, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x2f, 0x2f, 
+0x52, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x73, 0x20, 0x74, 0x68, 0x65, 0x20, 0x62, 0x75, 0x63, 
+0x6b, 0x65, 0x74, 0x20, 0x74, 0x68, 0x65, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x73, 0x20, 0x6f, 0x66, 0x20, 0x74, 0x68, 0x65, 0x20, 0x63, 0x65, 0x6c, 0x6c, 0x20, 
+0x61, 0x72, 0x65, 0x20, 0x73, 0x74, 0x6f, 0x72, 0x65, 0x64, 0x20, 0x69, 0x6e, 0x2e, 0x20, 
+0x57, 0x69, 0x74, 0x68, 0x20, 0x74, 0x68, 0x65, 0x20, 0x64, 0x65, 0x6e, 0x73, 0x65, 0x20, 
+0x67, 0x72, 0x69, 0x64, 0x20, 0x65, 0x76, 0x65, 0x72, 0x79, 0x20, 0x63, 0x65, 0x6c, 0x6c, 
+0x20, 0x69, 0x6e, 0x73, 0x69, 0x64, 0x65, 0x20, 0x6f, 0x66, 0x20, 0x69, 0x74, 0x20, 0x68, 
+0x61, 0x73, 0x20, 0x69, 0x74, 0x73, 0x20, 0x6f, 0x77, 0x6e, 0x0d, 0x0a, 0x09, 0x2f, 0x2f, 
+0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x20, 0x61, 0x6e, 0x64, 0x20, 0x61, 0x6c, 0x6c, 0x20, 
+0x63, 0x65, 0x6c, 0x6c, 0x73, 0x20, 0x6f, 0x75, 0x74, 0x73, 0x69, 0x64, 0x65, 0x20, 0x6f, 
+0x66, 0x20, 0x69, 0x74, 0x20, 0x73, 0x68, 0x61, 0x72, 0x65, 0x20, 0x74, 0x68, 0x65, 0x20, 
+0x6c, 0x61, 0x73, 0x74, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x0d, 0x0a, 0x09, 0x69, 
 0x6e, 0x6c, 0x69, 0x6e, 0x65, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x47, 0x65, 
-0x74, 0x48, 0x61, 0x73, 0x68, 0x28, 0x56, 0x65, 0x63, 0x33, 0x75, 0x20, 0x63, 0x65, 0x6c, 
-0x6c, 0x29, 0x0d, 0x0a, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x2f, 0x2f, 0x4d, 0x6f, 0x72, 
-0x74, 0x6f, 0x6e, 0x20, 0x68, 0x61, 0x73, 0x68, 0x0d, 0x0a, 0x09, 0x09, 0x72, 0x65, 0x74, 
-0x75, 0x72, 0x6e, 0x20, 0x4d, 0x6f, 0x72, 0x74, 0x6f, 0x6e, 0x33, 0x44, 0x28, 0x63, 0x65, 
-0x6c, 0x6c, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x2f, 0x2f, 0x52, 0x61, 0x6e, 
-0x64, 0x6f, 0x6d, 0x20, 0x68, 0x61, 0x73, 0x68, 0x0d, 0x0a, 0x09, 0x09, 0x2f, 0x2f, 0x72, 
-0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x28, 0x0d, 0x0a, 0x09, 0x09, 0x2f, 0x2f, 0x09, 0x28, 
-0x28, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x29, 0x63, 0x65, 0x6c, 0x6c, 0x2e, 0x78, 
-0x29, 0x20, 0x2a, 0x20, 0x37, 0x33, 0x38, 0x35, 0x36, 0x30, 0x39, 0x33, 0x29, 0x20, 0x5e, 
-0x0d, 0x0a, 0x09, 0x09, 0x2f, 0x2f, 0x09, 0x28, 0x28, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 
-0x32, 0x29, 0x63, 0x65, 0x6c, 0x6c, 0x2e, 0x79, 0x29, 0x20, 0x2a, 0x20, 0x31, 0x39, 0x33, 
-0x34, 0x39, 0x36, 0x36, 0x33, 0x29, 0x20, 0x5e, 0x0d, 0x0a, 0x09, 0x09, 0x2f, 0x2f, 0x09, 
-0x28, 0x28, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x29, 0x63, 0x65, 0x6c, 0x6c, 0x2e, 
-0x7a, 0x29, 0x20, 0x2a, 0x20, 0x38, 0x33, 0x34, 0x39, 0x32, 0x37, 0x39, 0x31, 0x29, 0x0d, 
-0x0a, 0x09, 0x09, 0x2f, 0x2f, 0x09, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 
-0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x53, 0x6d, 0x6f, 0x6f, 0x74, 0x68, 0x69, 0x6e, 0x67, 
-0x4b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x43, 0x6f, 0x6e, 0x73, 0x74, 0x61, 0x6e, 0x74, 0x28, 
-0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x68, 0x29, 0x0d, 0x0a, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 
-0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x31, 0x35, 0x2e, 0x30, 0x66, 0x20, 0x2f, 
-0x20, 0x28, 0x33, 0x2e, 0x31, 0x34, 0x31, 0x35, 0x66, 0x20, 0x2a, 0x20, 0x68, 0x20, 0x2a, 
-0x20, 0x68, 0x20, 0x2a, 0x20, 0x68, 0x20, 0x2a, 0x20, 0x68, 0x20, 0x2a, 0x20, 0x68, 0x20, 
-0x2a, 0x20, 0x68, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x69, 0x6e, 0x6c, 
-0x69, 0x6e, 0x65, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x53, 0x6d, 0x6f, 0x6f, 0x74, 
-0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x44, 0x30, 0x28, 0x66, 0x6c, 
-0x6f, 0x61, 0x74, 0x20, 0x72, 0x2c, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x68, 0x29, 
-0x0d, 0x0a, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x72, 0x20, 0x3e, 
-0x3d, 0x20, 0x68, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 
-0x20, 0x30, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 
-0x20, 0x28, 0x68, 0x20, 0x2d, 0x20, 0x72, 0x29, 0x20, 0x2a, 0x20, 0x28, 0x68, 0x20, 0x2d, 
-0x20, 0x72, 0x29, 0x20, 0x2a, 0x20, 0x28, 0x68, 0x20, 0x2d, 0x20, 0x72, 0x29, 0x3b, 0x0d, 
-0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x69, 0x6e, 0x6c, 0x69, 0x6e, 0x65, 0x20, 0x66, 0x6c, 
-0x6f, 0x61, 0x74, 0x20, 0x53, 0x6d, 0x6f, 0x6f, 0x74, 0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 
-0x72, 0x6e, 0x65, 0x6c, 0x44, 0x31, 0x28, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x72, 0x2c, 
-0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x68, 0x29, 0x0d, 0x0a, 0x09, 0x7b, 0x0d, 0x0a, 
-0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x72, 0x20, 0x3e, 0x3d, 0x20, 0x68, 0x29, 0x0d, 0x0a, 
-0x09, 0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x30, 0x3b, 0x0d, 0x0a, 0x0d, 
-0x0a, 0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x2d, 0x33, 0x20, 0x2a, 0x20, 
-0x28, 0x68, 0x20, 0x2d, 0x20, 0x72, 0x29, 0x20, 0x2a, 0x20, 0x28, 0x68, 0x20, 0x2d, 0x20, 
-0x72, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x69, 0x6e, 0x6c, 0x69, 0x6e, 
-0x65, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x53, 0x6d, 0x6f, 0x6f, 0x74, 0x68, 0x69, 
-0x6e, 0x67, 0x4b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x44, 0x32, 0x28, 0x66, 0x6c, 0x6f, 0x61, 
-0x74, 0x20, 0x72, 0x2c, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x68, 0x29, 0x0d, 0x0a, 
-0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x72, 0x20, 0x3e, 0x3d, 0x20, 
-0x68, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x30, 
-0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x36, 
-0x20, 0x2a, 0x20, 0x28, 0x68, 0x20, 0x2d, 0x20, 0x72, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 
-0x0d, 0x0a, 0x09, 0x69, 0x6e, 0x6c, 0x69, 0x6e, 0x65, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 
-0x20, 0x4e, 0x6f, 0x69, 0x73, 0x65, 0x28, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x78, 0x29, 
-0x0d, 0x0a, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x70, 
-0x74, 0x72, 0x20, 0x3d, 0x20, 0x30, 0x2e, 0x30, 0x66, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x72, 
-0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x6d, 0x6f, 0x64, 0x66, 0x28, 0x73, 0x69, 0x6e, 0x28, 
-0x78, 0x20, 0x2a, 0x20, 0x31, 0x31, 0x32, 0x2e, 0x39, 0x38, 0x39, 0x38, 0x66, 0x29, 0x20, 
-0x2a, 0x20, 0x34, 0x33, 0x37, 0x35, 0x38, 0x2e, 0x35, 0x34, 0x35, 0x33, 0x66, 0x2c, 0x20, 
-0x26, 0x70, 0x74, 0x72, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x69, 0x6e, 
-0x6c, 0x69, 0x6e, 0x65, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x52, 0x61, 0x6e, 0x64, 
-0x6f, 0x6d, 0x44, 0x69, 0x72, 0x65, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x28, 0x66, 0x6c, 0x6f, 
-0x61, 0x74, 0x20, 0x78, 0x29, 0x0d, 0x0a, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x2f, 0x2f, 
-0x68, 0x74, 0x74, 0x70, 0x73, 0x3a, 0x2f, 0x2f, 0x6d, 0x61, 0x74, 0x68, 0x2e, 0x73, 0x74, 
-0x61, 0x63, 0x6b, 0x65, 0x78, 0x63, 0x68, 0x61, 0x6e, 0x67, 0x65, 0x2e, 0x63, 0x6f, 0x6d, 
-0x2f, 0x71, 0x75, 0x65, 0x73, 0x74, 0x69, 0x6f, 0x6e, 0x73, 0x2f, 0x34, 0x34, 0x36, 0x38, 
-0x39, 0x2f, 0x68, 0x6f, 0x77, 0x2d, 0x74, 0x6f, 0x2d, 0x66, 0x69, 0x6e, 0x64, 0x2d, 0x61, 
-0x2d, 0x72, 0x61, 0x6e, 0x64, 0x6f, 0x6d, 0x2d, 0x61, 0x78, 0x69, 0x73, 0x2d, 0x6f, 0x72, 
-0x2d, 0x75, 0x6e, 0x69, 0x74, 0x2d, 0x76, 0x65, 0x63, 0x74, 0x6f, 0x72, 0x2d, 0x69, 0x6e, 
-0x2d, 0x33, 0x64, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x74, 0x68, 
-0x65, 0x74, 0x61, 0x20, 0x3d, 0x20, 0x4e, 0x6f, 0x69, 0x73, 0x65, 0x28, 0x78, 0x29, 0x20, 
-0x2a, 0x20, 0x32, 0x20, 0x2a, 0x20, 0x33, 0x2e, 0x31, 0x34, 0x31, 0x35, 0x66, 0x3b, 0x0d, 
-0x0a, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x7a, 0x20, 0x3d, 0x20, 0x4e, 0x6f, 
-0x69, 0x73, 0x65, 0x28, 0x78, 0x29, 0x20, 0x2a, 0x20, 0x32, 0x20, 0x2d, 0x20, 0x31, 0x3b, 
-0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x73, 0x20, 0x3d, 
-0x20, 0x73, 0x69, 0x6e, 0x28, 0x74, 0x68, 0x65, 0x74, 0x61, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 
-0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x63, 0x20, 0x3d, 0x20, 0x63, 0x6f, 0x73, 0x28, 
-0x74, 0x68, 0x65, 0x74, 0x61, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 
-0x74, 0x20, 0x7a, 0x32, 0x20, 0x3d, 0x20, 0x73, 0x71, 0x72, 0x74, 0x28, 0x31, 0x20, 0x2d, 
-0x20, 0x7a, 0x20, 0x2a, 0x20, 0x7a, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x72, 0x65, 0x74, 
-0x75, 0x72, 0x6e, 0x20, 0x4e, 0x45, 0x57, 0x5f, 0x56, 0x45, 0x43, 0x33, 0x46, 0x28, 0x7a, 
-0x32, 0x20, 0x2a, 0x20, 0x63, 0x2c, 0x20, 0x7a, 0x32, 0x20, 0x2a, 0x20, 0x73, 0x2c, 0x20, 
+0x74, 0x43, 0x65, 0x6c, 0x6c, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x28, 0x56, 0x65, 0x63, 
+0x33, 0x75, 0x20, 0x63, 0x65, 0x6c, 0x6c, 0x2c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 
+0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x43, 
+0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 0x20, 0x53, 0x54, 0x52, 0x55, 0x43, 0x54, 0x20, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x42, 0x65, 0x68, 0x61, 0x76, 0x69, 0x6f, 
+0x75, 0x72, 0x50, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2a, 0x20, 0x70, 
+0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x29, 0x0d, 0x0a, 0x09, 0x7b, 0x0d, 
+0x0a, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 
+0x72, 0x73, 0x2d, 0x3e, 0x67, 0x72, 0x69, 0x64, 0x53, 0x69, 0x7a, 0x65, 0x58, 0x20, 0x3d, 
+0x3d, 0x20, 0x30, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 
+0x20, 0x28, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x63, 
+0x65, 0x6c, 0x6c, 0x43, 0x75, 0x72, 0x76, 0x65, 0x20, 0x3d, 0x3d, 0x20, 0x31, 0x20, 0x3f, 
+0x20, 0x48, 0x69, 0x6c, 0x62, 0x65, 0x72, 0x74, 0x33, 0x44, 0x28, 0x63, 0x65, 0x6c, 0x6c, 
+0x29, 0x20, 0x3a, 0x20, 0x47, 0x65, 0x74, 0x48, 0x61, 0x73, 0x68, 0x28, 0x63, 0x65, 0x6c, 
+0x6c, 0x29, 0x29, 0x20, 0x25, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 
+0x7a, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x75, 0x20, 
+0x67, 0x72, 0x69, 0x64, 0x43, 0x65, 0x6c, 0x6c, 0x20, 0x3d, 0x20, 0x63, 0x65, 0x6c, 0x6c, 
+0x20, 0x2d, 0x20, 0x4e, 0x45, 0x57, 0x5f, 0x56, 0x45, 0x43, 0x33, 0x55, 0x28, 0x70, 0x61, 
+0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x67, 0x72, 0x69, 0x64, 0x4f, 
+0x72, 0x69, 0x67, 0x69, 0x6e, 0x58, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 
+0x65, 0x72, 0x73, 0x2d, 0x3e, 0x67, 0x72, 0x69, 0x64, 0x4f, 0x72, 0x69, 0x67, 0x69, 0x6e, 
+0x59, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 
+0x67, 0x72, 0x69, 0x64, 0x4f, 0x72, 0x69, 0x67, 0x69, 0x6e, 0x5a, 0x29, 0x3b, 0x0d, 0x0a, 
+0x0d, 0x0a, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x67, 0x72, 0x69, 0x64, 0x43, 0x65, 0x6c, 
+0x6c, 0x2e, 0x78, 0x20, 0x3e, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 
+0x72, 0x73, 0x2d, 0x3e, 0x67, 0x72, 0x69, 0x64, 0x53, 0x69, 0x7a, 0x65, 0x58, 0x20, 0x7c, 
+0x7c, 0x20, 0x67, 0x72, 0x69, 0x64, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x79, 0x20, 0x3e, 0x3d, 
+0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x67, 0x72, 
+0x69, 0x64, 0x53, 0x69, 0x7a, 0x65, 0x59, 0x20, 0x7c, 0x7c, 0x20, 0x67, 0x72, 0x69, 0x64, 
+0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x7a, 0x20, 0x3e, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 
+0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x67, 0x72, 0x69, 0x64, 0x53, 0x69, 0x7a, 0x65, 
+0x5a, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x28, 
+0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x29, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 
+0x69, 0x7a, 0x65, 0x20, 0x2d, 0x20, 0x31, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x72, 
+0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x67, 0x72, 0x69, 0x64, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 
+0x78, 0x20, 0x2b, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 
+0x3e, 0x67, 0x72, 0x69, 0x64, 0x53, 0x69, 0x7a, 0x65, 0x58, 0x20, 0x2a, 0x20, 0x28, 0x67, 
+0x72, 0x69, 0x64, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x79, 0x20, 0x2b, 0x20, 0x70, 0x61, 0x72, 
+0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x67, 0x72, 0x69, 0x64, 0x53, 0x69, 
+0x7a, 0x65, 0x59, 0x20, 0x2a, 0x20, 0x67, 0x72, 0x69, 0x64, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 
 0x7a, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x69, 0x6e, 0x6c, 0x69, 0x6e, 
-0x65, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x43, 0x6c, 0x6f, 0x73, 0x65, 0x73, 0x74, 
-0x50, 0x6f, 0x69, 0x6e, 0x74, 0x4f, 0x6e, 0x54, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 
-0x28, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x70, 0x2c, 
-0x20, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x61, 0x2c, 
-0x20, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x62, 0x2c, 
-0x20, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x63, 0x29, 
-0x0d, 0x0a, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x56, 
-0x65, 0x63, 0x33, 0x66, 0x20, 0x61, 0x62, 0x20, 0x3d, 0x20, 0x62, 0x20, 0x2d, 0x20, 0x61, 
-0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x56, 0x65, 0x63, 0x33, 
-0x66, 0x20, 0x61, 0x63, 0x20, 0x3d, 0x20, 0x63, 0x20, 0x2d, 0x20, 0x61, 0x3b, 0x0d, 0x0a, 
-0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x61, 
-0x70, 0x20, 0x3d, 0x20, 0x70, 0x20, 0x2d, 0x20, 0x61, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 
-0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x31, 
-0x20, 0x3d, 0x20, 0x64, 0x6f, 0x74, 0x28, 0x61, 0x62, 0x2c, 0x20, 0x61, 0x70, 0x29, 0x3b, 
-0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 
-0x20, 0x64, 0x32, 0x20, 0x3d, 0x20, 0x64, 0x6f, 0x74, 0x28, 0x61, 0x63, 0x2c, 0x20, 0x61, 
-0x70, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x64, 0x31, 0x20, 0x3c, 
-0x3d, 0x20, 0x30, 0x2e, 0x66, 0x20, 0x26, 0x26, 0x20, 0x64, 0x32, 0x20, 0x3c, 0x3d, 0x20, 
-0x30, 0x2e, 0x66, 0x29, 0x20, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x61, 0x3b, 0x20, 
-0x2f, 0x2f, 0x23, 0x31, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 
-0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x62, 0x70, 0x20, 0x3d, 0x20, 0x70, 0x20, 0x2d, 
-0x20, 0x62, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x66, 0x6c, 
-0x6f, 0x61, 0x74, 0x20, 0x64, 0x33, 0x20, 0x3d, 0x20, 0x64, 0x6f, 0x74, 0x28, 0x61, 0x62, 
-0x2c, 0x20, 0x62, 0x70, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 
-0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x34, 0x20, 0x3d, 0x20, 0x64, 0x6f, 0x74, 
-0x28, 0x61, 0x63, 0x2c, 0x20, 0x62, 0x70, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x69, 0x66, 
-0x20, 0x28, 0x64, 0x33, 0x20, 0x3e, 0x3d, 0x20, 0x30, 0x2e, 0x66, 0x20, 0x26, 0x26, 0x20, 
-0x64, 0x34, 0x20, 0x3c, 0x3d, 0x20, 0x64, 0x33, 0x29, 0x20, 0x72, 0x65, 0x74, 0x75, 0x72, 
-0x6e, 0x20, 0x62, 0x3b, 0x20, 0x2f, 0x2f, 0x23, 0x32, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 
-0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x63, 0x70, 0x20, 
-0x3d, 0x20, 0x70, 0x20, 0x2d, 0x20, 0x63, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 
-0x73, 0x74, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x35, 0x20, 0x3d, 0x20, 0x64, 
-0x6f, 0x74, 0x28, 0x61, 0x62, 0x2c, 0x20, 0x63, 0x70, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
-0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x36, 0x20, 
-0x3d, 0x20, 0x64, 0x6f, 0x74, 0x28, 0x61, 0x63, 0x2c, 0x20, 0x63, 0x70, 0x29, 0x3b, 0x0d, 
-0x0a, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x64, 0x36, 0x20, 0x3e, 0x3d, 0x20, 0x30, 0x2e, 
-0x66, 0x20, 0x26, 0x26, 0x20, 0x64, 0x35, 0x20, 0x3c, 0x3d, 0x20, 0x64, 0x36, 0x29, 0x20, 
-0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x63, 0x3b, 0x20, 0x2f, 0x2f, 0x23, 0x33, 0x0d, 
-0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x66, 0x6c, 0x6f, 0x61, 
-0x74, 0x20, 0x76, 0x63, 0x20, 0x3d, 0x20, 0x64, 0x31, 0x20, 0x2a, 0x20, 0x64, 0x34, 0x20, 
-0x2d, 0x20, 0x64, 0x33, 0x20, 0x2a, 0x20, 0x64, 0x32, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x69, 
-0x66, 0x20, 0x28, 0x76, 0x63, 0x20, 0x3c, 0x3d, 0x20, 0x30, 0x2e, 0x66, 0x20, 0x26, 0x26, 
-0x20, 0x64, 0x31, 0x20, 0x3e, 0x3d, 0x20, 0x30, 0x2e, 0x66, 0x20, 0x26, 0x26, 0x20, 0x64, 
-0x33, 0x20, 0x3c, 0x3d, 0x20, 0x30, 0x2e, 0x66, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x7b, 0x0d, 
-0x0a, 0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 
-0x20, 0x76, 0x20, 0x3d, 0x20, 0x64, 0x31, 0x20, 0x2f, 0x20, 0x28, 0x64, 0x31, 0x20, 0x2d, 
-0x20, 0x64, 0x33, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 
-0x6e, 0x20, 0x61, 0x20, 0x2b, 0x20, 0x61, 0x62, 0x20, 0x2a, 0x20, 0x76, 0x3b, 0x20, 0x2f, 
-0x2f, 0x23, 0x34, 0x0d, 0x0a, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x63, 
-0x6f, 0x6e, 0x73, 0x74, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x76, 0x62, 0x20, 0x3d, 
-0x20, 0x64, 0x35, 0x20, 0x2a, 0x20, 0x64, 0x32, 0x20, 0x2d, 0x20, 0x64, 0x31, 0x20, 0x2a, 
-0x20, 0x64, 0x36, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x76, 0x62, 0x20, 
-0x3c, 0x3d, 0x20, 0x30, 0x2e, 0x66, 0x20, 0x26, 0x26, 0x20, 0x64, 0x32, 0x20, 0x3e, 0x3d, 
-0x20, 0x30, 0x2e, 0x66, 0x20, 0x26, 0x26, 0x20, 0x64, 0x36, 0x20, 0x3c, 0x3d, 0x20, 0x30, 
-0x2e, 0x66, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x63, 0x6f, 
-0x6e, 0x73, 0x74, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x76, 0x20, 0x3d, 0x20, 0x64, 
-0x32, 0x20, 0x2f, 0x20, 0x28, 0x64, 0x32, 0x20, 0x2d, 0x20, 0x64, 0x36, 0x29, 0x3b, 0x0d, 
-0x0a, 0x09, 0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x61, 0x20, 0x2b, 0x20, 
-0x61, 0x63, 0x20, 0x2a, 0x20, 0x76, 0x3b, 0x20, 0x2f, 0x2f, 0x23, 0x35, 0x0d, 0x0a, 0x09, 
-0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x66, 
-0x6c, 0x6f, 0x61, 0x74, 0x20, 0x76, 0x61, 0x20, 0x3d, 0x20, 0x64, 0x33, 0x20, 0x2a, 0x20, 
-0x64, 0x36, 0x20, 0x2d, 0x20, 0x64, 0x35, 0x20, 0x2a, 0x20, 0x64, 0x34, 0x3b, 0x0d, 0x0a, 
-0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x76, 0x61, 0x20, 0x3c, 0x3d, 0x20, 0x30, 0x2e, 0x66, 
-0x20, 0x26, 0x26, 0x20, 0x28, 0x64, 0x34, 0x20, 0x2d, 0x20, 0x64, 0x33, 0x29, 0x20, 0x3e, 
-0x3d, 0x20, 0x30, 0x2e, 0x66, 0x20, 0x26, 0x26, 0x20, 0x28, 0x64, 0x35, 0x20, 0x2d, 0x20, 
-0x64, 0x36, 0x29, 0x20, 0x3e, 0x3d, 0x20, 0x30, 0x2e, 0x66, 0x29, 0x0d, 0x0a, 0x09, 0x09, 
-0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x66, 0x6c, 0x6f, 
-0x61, 0x74, 0x20, 0x76, 0x20, 0x3d, 0x20, 0x28, 0x64, 0x34, 0x20, 0x2d, 0x20, 0x64, 0x33, 
-0x29, 0x20, 0x2f, 0x20, 0x28, 0x28, 0x64, 0x34, 0x20, 0x2d, 0x20, 0x64, 0x33, 0x29, 0x20, 
-0x2b, 0x20, 0x28, 0x64, 0x35, 0x20, 0x2d, 0x20, 0x64, 0x36, 0x29, 0x29, 0x3b, 0x0d, 0x0a, 
-0x09, 0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x62, 0x20, 0x2b, 0x20, 0x28, 
-0x63, 0x20, 0x2d, 0x20, 0x62, 0x29, 0x20, 0x2a, 0x20, 0x76, 0x3b, 0x20, 0x2f, 0x2f, 0x23, 
-0x36, 0x0d, 0x0a, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 
-0x73, 0x74, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x65, 0x6e, 0x6f, 0x6d, 0x20, 
-0x3d, 0x20, 0x31, 0x2e, 0x66, 0x20, 0x2f, 0x20, 0x28, 0x76, 0x61, 0x20, 0x2b, 0x20, 0x76, 
-0x62, 0x20, 0x2b, 0x20, 0x76, 0x63, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 
-0x73, 0x74, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x76, 0x20, 0x3d, 0x20, 0x76, 0x62, 
-0x20, 0x2a, 0x20, 0x64, 0x65, 0x6e, 0x6f, 0x6d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 
-0x6e, 0x73, 0x74, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x77, 0x20, 0x3d, 0x20, 0x76, 
-0x63, 0x20, 0x2a, 0x20, 0x64, 0x65, 0x6e, 0x6f, 0x6d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x72, 
-0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x61, 0x20, 0x2b, 0x20, 0x61, 0x62, 0x20, 0x2a, 0x20, 
-0x76, 0x20, 0x2b, 0x20, 0x61, 0x63, 0x20, 0x2a, 0x20, 0x77, 0x3b, 0x20, 0x2f, 0x2f, 0x23, 
-0x30, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x69, 0x6e, 0x6c, 0x69, 0x6e, 0x65, 0x20, 
-0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x43, 0x61, 0x6c, 0x63, 0x75, 0x6c, 0x61, 0x74, 0x65, 
-0x54, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x41, 0x6d, 
-0x70, 0x6c, 0x69, 0x74, 0x75, 0x64, 0x65, 0x28, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 
-0x69, 0x73, 0x74, 0x29, 0x0d, 0x0a, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6c, 0x6f, 
-0x61, 0x74, 0x20, 0x74, 0x20, 0x3d, 0x20, 0x31, 0x20, 0x2f, 0x20, 0x64, 0x69, 0x73, 0x74, 
-0x20, 0x2d, 0x20, 0x31, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 
-0x20, 0x74, 0x20, 0x2a, 0x20, 0x74, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x69, 
-0x6e, 0x6c, 0x69, 0x6e, 0x65, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x43, 0x61, 0x6c, 
-0x63, 0x75, 0x6c, 0x61, 0x74, 0x65, 0x54, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x46, 
-0x6f, 0x72, 0x63, 0x65, 0x28, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x56, 0x65, 0x63, 0x33, 
-0x66, 0x20, 0x70, 0x6f, 0x69, 0x6e, 0x74, 0x2c, 0x20, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 
-0x53, 0x54, 0x52, 0x55, 0x43, 0x54, 0x20, 0x54, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 
-0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x29, 0x0d, 0x0a, 0x09, 0x7b, 0x0d, 
-0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 
-0x69, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 
-0x61, 0x6e, 0x63, 0x65, 0x20, 0x3d, 0x20, 0x32, 0x2e, 0x35, 0x66, 0x3b, 0x09, 0x09, 0x0d, 
-0x0a, 0x23, 0x69, 0x66, 0x64, 0x65, 0x66, 0x20, 0x43, 0x4c, 0x5f, 0x43, 0x4f, 0x4d, 0x50, 
-0x49, 0x4c, 0x45, 0x52, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x76, 
+0x65, 0x20, 0x62, 0x6f, 0x6f, 0x6c, 0x20, 0x49, 0x73, 0x4f, 0x75, 0x74, 0x73, 0x69, 0x64, 
+0x65, 0x47, 0x72, 0x69, 0x64, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x28, 0x75, 0x69, 0x6e, 
+0x74, 0x33, 0x32, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x2c, 0x20, 0x75, 0x69, 0x6e, 
+0x74, 0x36, 0x34, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 
+0x2c, 0x20, 0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 0x20, 0x53, 0x54, 0x52, 0x55, 
+0x43, 0x54, 0x20, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x42, 0x65, 0x68, 0x61, 
+0x76, 0x69, 0x6f, 0x75, 0x72, 0x50, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 
+0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x29, 0x0d, 0x0a, 
+0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x70, 0x61, 
+0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x67, 0x72, 0x69, 0x64, 0x53, 
+0x69, 0x7a, 0x65, 0x58, 0x20, 0x21, 0x3d, 0x20, 0x30, 0x20, 0x26, 0x26, 0x20, 0x62, 0x75, 
+0x63, 0x6b, 0x65, 0x74, 0x20, 0x3d, 0x3d, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 
+0x53, 0x69, 0x7a, 0x65, 0x20, 0x2d, 0x20, 0x31, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 
+0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x53, 0x6d, 0x6f, 0x6f, 0x74, 0x68, 0x69, 0x6e, 
+0x67, 0x4b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x43, 0x6f, 0x6e, 0x73, 0x74, 0x61, 0x6e, 0x74, 
+0x28, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x68, 0x29, 0x0d, 0x0a, 0x09, 0x7b, 0x0d, 0x0a, 
+0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x31, 0x35, 0x2e, 0x30, 0x66, 0x20, 
+0x2f, 0x20, 0x28, 0x33, 0x2e, 0x31, 0x34, 0x31, 0x35, 0x66, 0x20, 0x2a, 0x20, 0x68, 0x20, 
+0x2a, 0x20, 0x68, 0x20, 0x2a, 0x20, 0x68, 0x20, 0x2a, 0x20, 0x68, 0x20, 0x2a, 0x20, 0x68, 
+0x20, 0x2a, 0x20, 0x68, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x69, 0x6e, 
+0x6c, 0x69, 0x6e, 0x65, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x53, 0x6d, 0x6f, 0x6f, 
+0x74, 0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x44, 0x30, 0x28, 0x66, 
+0x6c, 0x6f, 0x61, 0x74, 0x20, 0x72, 0x2c, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x68, 
+0x29, 0x0d, 0x0a, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x72, 0x20, 
+0x3e, 0x3d, 0x20, 0x68, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 
+0x6e, 0x20, 0x30, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 
+0x6e, 0x20, 0x28, 0x68, 0x20, 0x2d, 0x20, 0x72, 0x29, 0x20, 0x2a, 0x20, 0x28, 0x68, 0x20, 
+0x2d, 0x20, 0x72, 0x29, 0x20, 0x2a, 0x20, 0x28, 0x68, 0x20, 0x2d, 0x20, 0x72, 0x29, 0x3b, 
+0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x69, 0x6e, 0x6c, 0x69, 0x6e, 0x65, 0x20, 0x66, 
+0x6c, 0x6f, 0x61, 0x74, 0x20, 0x53, 0x6d, 0x6f, 0x6f, 0x74, 0x68, 0x69, 0x6e, 0x67, 0x4b, 
+0x65, 0x72, 0x6e, 0x65, 0x6c, 0x44, 0x31, 0x28, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x72, 
+0x2c, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x68, 0x29, 0x0d, 0x0a, 0x09, 0x7b, 0x0d, 
+0x0a, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x72, 0x20, 0x3e, 0x3d, 0x20, 0x68, 0x29, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x30, 0x3b, 0x0d, 0x0a, 
+0x0d, 0x0a, 0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x2d, 0x33, 0x20, 0x2a, 
+0x20, 0x28, 0x68, 0x20, 0x2d, 0x20, 0x72, 0x29, 0x20, 0x2a, 0x20, 0x28, 0x68, 0x20, 0x2d, 
+0x20, 0x72, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x69, 0x6e, 0x6c, 0x69, 
+0x6e, 0x65, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x53, 0x6d, 0x6f, 0x6f, 0x74, 0x68, 
+0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x44, 0x32, 0x28, 0x66, 0x6c, 0x6f, 
+0x61, 0x74, 0x20, 0x72, 0x2c, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x68, 0x29, 0x0d, 
+0x0a, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x72, 0x20, 0x3e, 0x3d, 
+0x20, 0x68, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 
+0x30, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 
+0x36, 0x20, 0x2a, 0x20, 0x28, 0x68, 0x20, 0x2d, 0x20, 0x72, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 
+0x7d, 0x0d, 0x0a, 0x09, 0x69, 0x6e, 0x6c, 0x69, 0x6e, 0x65, 0x20, 0x66, 0x6c, 0x6f, 0x61, 
+0x74, 0x20, 0x4e, 0x6f, 0x69, 0x73, 0x65, 0x28, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x78, 
+0x29, 0x0d, 0x0a, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 
+0x70, 0x74, 0x72, 0x20, 0x3d, 0x20, 0x30, 0x2e, 0x30, 0x66, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x6d, 0x6f, 0x64, 0x66, 0x28, 0x73, 0x69, 0x6e, 
+0x28, 0x78, 0x20, 0x2a, 0x20, 0x31, 0x31, 0x32, 0x2e, 0x39, 0x38, 0x39, 0x38, 0x66, 0x29, 
+0x20, 0x2a, 0x20, 0x34, 0x33, 0x37, 0x35, 0x38, 0x2e, 0x35, 0x34, 0x35, 0x33, 0x66, 0x2c, 
+0x20, 0x26, 0x70, 0x74, 0x72, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x69, 
+0x6e, 0x6c, 0x69, 0x6e, 0x65, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x52, 0x61, 0x6e, 
+0x64, 0x6f, 0x6d, 0x44, 0x69, 0x72, 0x65, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x28, 0x66, 0x6c, 
+0x6f, 0x61, 0x74, 0x20, 0x78, 0x29, 0x0d, 0x0a, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x2f, 
+0x2f, 0x68, 0x74, 0x74, 0x70, 0x73, 0x3a, 0x2f, 0x2f, 0x6d, 0x61, 0x74, 0x68, 0x2e, 0x73, 
+0x74, 0x61, 0x63, 0x6b, 0x65, 0x78, 0x63, 0x68, 0x61, 0x6e, 0x67, 0x65, 0x2e, 0x63, 0x6f, 
+0x6d, 0x2f, 0x71, 0x75, 0x65, 0x73, 0x74, 0x69, 0x6f, 0x6e, 0x73, 0x2f, 0x34, 0x34, 0x36, 
+0x38, 0x39, 0x2f, 0x68, 0x6f, 0x77, 0x2d, 0x74, 0x6f, 0x2d, 0x66, 0x69, 0x6e, 0x64, 0x2d, 
+0x61, 0x2d, 0x72, 0x61, 0x6e, 0x64, 0x6f, 0x6d, 0x2d, 0x61, 0x78, 0x69, 0x73, 0x2d, 0x6f, 
+0x72, 0x2d, 0x75, 0x6e, 0x69, 0x74, 0x2d, 0x76, 0x65, 0x63, 0x74, 0x6f, 0x72, 0x2d, 0x69, 
+0x6e, 0x2d, 0x33, 0x64, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x74, 
+0x68, 0x65, 0x74, 0x61, 0x20, 0x3d, 0x20, 0x4e, 0x6f, 0x69, 0x73, 0x65, 0x28, 0x78, 0x29, 
+0x20, 0x2a, 0x20, 0x32, 0x20, 0x2a, 0x20, 0x33, 0x2e, 0x31, 0x34, 0x31, 0x35, 0x66, 0x3b, 
+0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x7a, 0x20, 0x3d, 0x20, 0x4e, 
+0x6f, 0x69, 0x73, 0x65, 0x28, 0x78, 0x29, 0x20, 0x2a, 0x20, 0x32, 0x20, 0x2d, 0x20, 0x31, 
+0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x73, 0x20, 
+0x3d, 0x20, 0x73, 0x69, 0x6e, 0x28, 0x74, 0x68, 0x65, 0x74, 0x61, 0x29, 0x3b, 0x0d, 0x0a, 
+0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x63, 0x20, 0x3d, 0x20, 0x63, 0x6f, 0x73, 
+0x28, 0x74, 0x68, 0x65, 0x74, 0x61, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6c, 0x6f, 
+0x61, 0x74, 0x20, 0x7a, 0x32, 0x20, 0x3d, 0x20, 0x73, 0x71, 0x72, 0x74, 0x28, 0x31, 0x20, 
+0x2d, 0x20, 0x7a, 0x20, 0x2a, 0x20, 0x7a, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x72, 0x65, 
+0x74, 0x75, 0x72, 0x6e, 0x20, 0x4e, 0x45, 0x57, 0x5f, 0x56, 0x45, 0x43, 0x33, 0x46, 0x28, 
+0x7a, 0x32, 0x20, 0x2a, 0x20, 0x63, 0x2c, 0x20, 0x7a, 0x32, 0x20, 0x2a, 0x20, 0x73, 0x2c, 
+0x20, 0x7a, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x69, 0x6e, 0x6c, 0x69, 
+0x6e, 0x65, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x43, 0x6c, 0x6f, 0x73, 0x65, 0x73, 
+0x74, 0x50, 0x6f, 0x69, 0x6e, 0x74, 0x4f, 0x6e, 0x54, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 
+0x65, 0x28, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x70, 
+0x2c, 0x20, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x61, 
+0x2c, 0x20, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x62, 
+0x2c, 0x20, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x63, 
+0x29, 0x0d, 0x0a, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 
+0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x61, 0x62, 0x20, 0x3d, 0x20, 0x62, 0x20, 0x2d, 0x20, 
+0x61, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x56, 0x65, 0x63, 
+0x33, 0x66, 0x20, 0x61, 0x63, 0x20, 0x3d, 0x20, 0x63, 0x20, 0x2d, 0x20, 0x61, 0x3b, 0x0d, 
+0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 
+0x61, 0x70, 0x20, 0x3d, 0x20, 0x70, 0x20, 0x2d, 0x20, 0x61, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 
+0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 
+0x31, 0x20, 0x3d, 0x20, 0x64, 0x6f, 0x74, 0x28, 0x61, 0x62, 0x2c, 0x20, 0x61, 0x70, 0x29, 
+0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x66, 0x6c, 0x6f, 0x61, 
+0x74, 0x20, 0x64, 0x32, 0x20, 0x3d, 0x20, 0x64, 0x6f, 0x74, 0x28, 0x61, 0x63, 0x2c, 0x20, 
+0x61, 0x70, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x64, 0x31, 0x20, 
+0x3c, 0x3d, 0x20, 0x30, 0x2e, 0x66, 0x20, 0x26, 0x26, 0x20, 0x64, 0x32, 0x20, 0x3c, 0x3d, 
+0x20, 0x30, 0x2e, 0x66, 0x29, 0x20, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x61, 0x3b, 
+0x20, 0x2f, 0x2f, 0x23, 0x31, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 
+0x74, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x62, 0x70, 0x20, 0x3d, 0x20, 0x70, 0x20, 
+0x2d, 0x20, 0x62, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x66, 
+0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x33, 0x20, 0x3d, 0x20, 0x64, 0x6f, 0x74, 0x28, 0x61, 
+0x62, 0x2c, 0x20, 0x62, 0x70, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 
+0x74, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x34, 0x20, 0x3d, 0x20, 0x64, 0x6f, 
+0x74, 0x28, 0x61, 0x63, 0x2c, 0x20, 0x62, 0x70, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x69, 
+0x66, 0x20, 0x28, 0x64, 0x33, 0x20, 0x3e, 0x3d, 0x20, 0x30, 0x2e, 0x66, 0x20, 0x26, 0x26, 
+0x20, 0x64, 0x34, 0x20, 0x3c, 0x3d, 0x20, 0x64, 0x33, 0x29, 0x20, 0x72, 0x65, 0x74, 0x75, 
+0x72, 0x6e, 0x20, 0x62, 0x3b, 0x20, 0x2f, 0x2f, 0x23, 0x32, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 
+0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x63, 0x70, 
+0x20, 0x3d, 0x20, 0x70, 0x20, 0x2d, 0x20, 0x63, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 
+0x6e, 0x73, 0x74, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x35, 0x20, 0x3d, 0x20, 
+0x64, 0x6f, 0x74, 0x28, 0x61, 0x62, 0x2c, 0x20, 0x63, 0x70, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 
+0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x36, 
+0x20, 0x3d, 0x20, 0x64, 0x6f, 0x74, 0x28, 0x61, 0x63, 0x2c, 0x20, 0x63, 0x70, 0x29, 0x3b, 
+0x0d, 0x0a, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x64, 0x36, 0x20, 0x3e, 0x3d, 0x20, 0x30, 
+0x2e, 0x66, 0x20, 0x26, 0x26, 0x20, 0x64, 0x35, 0x20, 0x3c, 0x3d, 0x20, 0x64, 0x36, 0x29, 
+0x20, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x63, 0x3b, 0x20, 0x2f, 0x2f, 0x23, 0x33, 
+0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x66, 0x6c, 0x6f, 
+0x61, 0x74, 0x20, 0x76, 0x63, 0x20, 0x3d, 0x20, 0x64, 0x31, 0x20, 0x2a, 0x20, 0x64, 0x34, 
+0x20, 0x2d, 0x20, 0x64, 0x33, 0x20, 0x2a, 0x20, 0x64, 0x32, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x69, 0x66, 0x20, 0x28, 0x76, 0x63, 0x20, 0x3c, 0x3d, 0x20, 0x30, 0x2e, 0x66, 0x20, 0x26, 
+0x26, 0x20, 0x64, 0x31, 0x20, 0x3e, 0x3d, 0x20, 0x30, 0x2e, 0x66, 0x20, 0x26, 0x26, 0x20, 
+0x64, 0x33, 0x20, 0x3c, 0x3d, 0x20, 0x30, 0x2e, 0x66, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x7b, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x66, 0x6c, 0x6f, 0x61, 
+0x74, 0x20, 0x76, 0x20, 0x3d, 0x20, 0x64, 0x31, 0x20, 0x2f, 0x20, 0x28, 0x64, 0x31, 0x20, 
+0x2d, 0x20, 0x64, 0x33, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 
+0x72, 0x6e, 0x20, 0x61, 0x20, 0x2b, 0x20, 0x61, 0x62, 0x20, 0x2a, 0x20, 0x76, 0x3b, 0x20, 
+0x2f, 0x2f, 0x23, 0x34, 0x0d, 0x0a, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 
+0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x76, 0x62, 0x20, 
+0x3d, 0x20, 0x64, 0x35, 0x20, 0x2a, 0x20, 0x64, 0x32, 0x20, 0x2d, 0x20, 0x64, 0x31, 0x20, 
+0x2a, 0x20, 0x64, 0x36, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x76, 0x62, 
+0x20, 0x3c, 0x3d, 0x20, 0x30, 0x2e, 0x66, 0x20, 0x26, 0x26, 0x20, 0x64, 0x32, 0x20, 0x3e, 
+0x3d, 0x20, 0x30, 0x2e, 0x66, 0x20, 0x26, 0x26, 0x20, 0x64, 0x36, 0x20, 0x3c, 0x3d, 0x20, 
+0x30, 0x2e, 0x66, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x63, 
+0x6f, 0x6e, 0x73, 0x74, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x76, 0x20, 0x3d, 0x20, 
+0x64, 0x32, 0x20, 0x2f, 0x20, 0x28, 0x64, 0x32, 0x20, 0x2d, 0x20, 0x64, 0x36, 0x29, 0x3b, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x61, 0x20, 0x2b, 
+0x20, 0x61, 0x63, 0x20, 0x2a, 0x20, 0x76, 0x3b, 0x20, 0x2f, 0x2f, 0x23, 0x35, 0x0d, 0x0a, 
+0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 
+0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x76, 0x61, 0x20, 0x3d, 0x20, 0x64, 0x33, 0x20, 0x2a, 
+0x20, 0x64, 0x36, 0x20, 0x2d, 0x20, 0x64, 0x35, 0x20, 0x2a, 0x20, 0x64, 0x34, 0x3b, 0x0d, 
+0x0a, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x76, 0x61, 0x20, 0x3c, 0x3d, 0x20, 0x30, 0x2e, 
+0x66, 0x20, 0x26, 0x26, 0x20, 0x28, 0x64, 0x34, 0x20, 0x2d, 0x20, 0x64, 0x33, 0x29, 0x20, 
+0x3e, 0x3d, 0x20, 0x30, 0x2e, 0x66, 0x20, 0x26, 0x26, 0x20, 0x28, 0x64, 0x35, 0x20, 0x2d, 
+0x20, 0x64, 0x36, 0x29, 0x20, 0x3e, 0x3d, 0x20, 0x30, 0x2e, 0x66, 0x29, 0x0d, 0x0a, 0x09, 
+0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x66, 0x6c, 
+0x6f, 0x61, 0x74, 0x20, 0x76, 0x20, 0x3d, 0x20, 0x28, 0x64, 0x34, 0x20, 0x2d, 0x20, 0x64, 
+0x33, 0x29, 0x20, 0x2f, 0x20, 0x28, 0x28, 0x64, 0x34, 0x20, 0x2d, 0x20, 0x64, 0x33, 0x29, 
+0x20, 0x2b, 0x20, 0x28, 0x64, 0x35, 0x20, 0x2d, 0x20, 0x64, 0x36, 0x29, 0x29, 0x3b, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x62, 0x20, 0x2b, 0x20, 
+0x28, 0x63, 0x20, 0x2d, 0x20, 0x62, 0x29, 0x20, 0x2a, 0x20, 0x76, 0x3b, 0x20, 0x2f, 0x2f, 
+0x23, 0x36, 0x0d, 0x0a, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 
+0x6e, 0x73, 0x74, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x65, 0x6e, 0x6f, 0x6d, 
+0x20, 0x3d, 0x20, 0x31, 0x2e, 0x66, 0x20, 0x2f, 0x20, 0x28, 0x76, 0x61, 0x20, 0x2b, 0x20, 
+0x76, 0x62, 0x20, 0x2b, 0x20, 0x76, 0x63, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 
+0x6e, 0x73, 0x74, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x76, 0x20, 0x3d, 0x20, 0x76, 
+0x62, 0x20, 0x2a, 0x20, 0x64, 0x65, 0x6e, 0x6f, 0x6d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x63, 
+0x6f, 0x6e, 0x73, 0x74, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x77, 0x20, 0x3d, 0x20, 
+0x76, 0x63, 0x20, 0x2a, 0x20, 0x64, 0x65, 0x6e, 0x6f, 0x6d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x61, 0x20, 0x2b, 0x20, 0x61, 0x62, 0x20, 0x2a, 
+0x20, 0x76, 0x20, 0x2b, 0x20, 0x61, 0x63, 0x20, 0x2a, 0x20, 0x77, 0x3b, 0x20, 0x2f, 0x2f, 
+0x23, 0x30, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 
+0x54, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 
+0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x28, 0x29, 0x0d, 
+0x0a, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x32, 
+0x2e, 0x35, 0x66, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x69, 0x6e, 0x6c, 0x69, 
+0x6e, 0x65, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x43, 0x61, 0x6c, 0x63, 0x75, 0x6c, 
+0x61, 0x74, 0x65, 0x54, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x46, 0x6f, 0x72, 0x63, 
+0x65, 0x41, 0x6d, 0x70, 0x6c, 0x69, 0x74, 0x75, 0x64, 0x65, 0x28, 0x66, 0x6c, 0x6f, 0x61, 
+0x74, 0x20, 0x64, 0x69, 0x73, 0x74, 0x29, 0x0d, 0x0a, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 
+0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x74, 0x20, 0x3d, 0x20, 0x31, 0x20, 0x2f, 0x20, 0x64, 
+0x69, 0x73, 0x74, 0x20, 0x2d, 0x20, 0x31, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x72, 0x65, 0x74, 
+0x75, 0x72, 0x6e, 0x20, 0x74, 0x20, 0x2a, 0x20, 0x74, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 
+0x0a, 0x09, 0x69, 0x6e, 0x6c, 0x69, 0x6e, 0x65, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 
+0x43, 0x61, 0x6c, 0x63, 0x75, 0x6c, 0x61, 0x74, 0x65, 0x54, 0x72, 0x69, 0x61, 0x6e, 0x67, 
+0x6c, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x28, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x56, 
+0x65, 0x63, 0x33, 0x66, 0x20, 0x70, 0x6f, 0x69, 0x6e, 0x74, 0x2c, 0x20, 0x63, 0x6f, 0x6e, 
+0x73, 0x74, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x63, 0x6c, 0x6f, 0x73, 0x65, 0x73, 
+0x74, 0x50, 0x6f, 0x69, 0x6e, 0x74, 0x29, 0x0d, 0x0a, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 
+0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x69, 0x6e, 0x74, 
+0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 
+0x65, 0x20, 0x3d, 0x20, 0x54, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x49, 0x6e, 0x74, 
+0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 
+0x65, 0x28, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x76, 
 0x65, 0x63, 0x54, 0x6f, 0x54, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x20, 0x3d, 0x20, 
-0x43, 0x6c, 0x6f, 0x73, 0x65, 0x73, 0x74, 0x50, 0x6f, 0x69, 0x6e, 0x74, 0x4f, 0x6e, 0x54, 
-0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x28, 0x70, 0x6f, 0x69, 0x6e, 0x74, 0x2c, 0x20, 
-0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x2e, 0x70, 0x31, 0x2e, 0x78, 0x79, 0x7a, 
-0x28, 0x29, 0x2c, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x2e, 0x70, 0x32, 
-0x2e, 0x78, 0x79, 0x7a, 0x28, 0x29, 0x2c, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 
-0x65, 0x2e, 0x70, 0x33, 0x2e, 0x78, 0x79, 0x7a, 0x28, 0x29, 0x29, 0x20, 0x2d, 0x20, 0x70, 
-0x6f, 0x69, 0x6e, 0x74, 0x3b, 0x0d, 0x0a, 0x23, 0x65, 0x6c, 0x73, 0x65, 0x0d, 0x0a, 0x09, 
-0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x76, 0x65, 0x63, 0x54, 0x6f, 0x54, 0x72, 0x69, 
-0x61, 0x6e, 0x67, 0x6c, 0x65, 0x20, 0x3d, 0x20, 0x43, 0x6c, 0x6f, 0x73, 0x65, 0x73, 0x74, 
-0x50, 0x6f, 0x69, 0x6e, 0x74, 0x4f, 0x6e, 0x54, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 
-0x28, 0x70, 0x6f, 0x69, 0x6e, 0x74, 0x2c, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 
-0x65, 0x2e, 0x70, 0x31, 0x2c, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x2e, 
-0x70, 0x32, 0x2c, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x2e, 0x70, 0x33, 
-0x29, 0x20, 0x2d, 0x20, 0x70, 0x6f, 0x69, 0x6e, 0x74, 0x3b, 0x0d, 0x0a, 0x23, 0x65, 0x6e, 
-0x64, 0x69, 0x66, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x69, 
-0x73, 0x74, 0x20, 0x3d, 0x20, 0x73, 0x71, 0x72, 0x74, 0x28, 0x64, 0x6f, 0x74, 0x28, 0x76, 
-0x65, 0x63, 0x54, 0x6f, 0x54, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x2c, 0x20, 0x76, 
-0x65, 0x63, 0x54, 0x6f, 0x54, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x29, 0x29, 0x3b, 
+0x63, 0x6c, 0x6f, 0x73, 0x65, 0x73, 0x74, 0x50, 0x6f, 0x69, 0x6e, 0x74, 0x20, 0x2d, 0x20, 
+0x70, 0x6f, 0x69, 0x6e, 0x74, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 
+0x20, 0x64, 0x69, 0x73, 0x74, 0x20, 0x3d, 0x20, 0x73, 0x71, 0x72, 0x74, 0x28, 0x64, 0x6f, 
+0x74, 0x28, 0x76, 0x65, 0x63, 0x54, 0x6f, 0x54, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 
+0x2c, 0x20, 0x76, 0x65, 0x63, 0x54, 0x6f, 0x54, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 
+0x29, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 
+0x66, 0x6f, 0x72, 0x63, 0x65, 0x44, 0x69, 0x72, 0x20, 0x3d, 0x20, 0x2d, 0x76, 0x65, 0x63, 
+0x54, 0x6f, 0x54, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x20, 0x2f, 0x20, 0x64, 0x69, 
+0x73, 0x74, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x64, 0x69, 
+0x73, 0x74, 0x20, 0x3e, 0x20, 0x69, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 
+0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x4e, 0x45, 0x57, 0x5f, 0x56, 0x45, 0x43, 0x33, 
+0x46, 0x28, 0x30, 0x2c, 0x20, 0x30, 0x2c, 0x20, 0x30, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x0d, 0x0a, 0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x66, 0x6f, 0x72, 0x63, 
+0x65, 0x44, 0x69, 0x72, 0x20, 0x2a, 0x20, 0x43, 0x61, 0x6c, 0x63, 0x75, 0x6c, 0x61, 0x74, 
+0x65, 0x54, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x41, 
+0x6d, 0x70, 0x6c, 0x69, 0x74, 0x75, 0x64, 0x65, 0x28, 0x64, 0x69, 0x73, 0x74, 0x20, 0x2f, 
+0x20, 0x69, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 
+0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x20, 0x2a, 0x20, 0x35, 0x30, 0x3b, 0x09, 0x09, 0x0d, 
+0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x2f, 0x2f, 0x54, 0x68, 0x65, 0x20, 0x74, 0x72, 0x69, 
+0x61, 0x6e, 0x67, 0x6c, 0x65, 0x73, 0x20, 0x61, 0x72, 0x65, 0x20, 0x62, 0x69, 0x6e, 0x6e, 
+0x65, 0x64, 0x20, 0x69, 0x6e, 0x74, 0x6f, 0x20, 0x65, 0x76, 0x65, 0x72, 0x79, 0x20, 0x63, 
+0x65, 0x6c, 0x6c, 0x20, 0x28, 0x77, 0x69, 0x74, 0x68, 0x20, 0x74, 0x68, 0x65, 0x20, 0x73, 
+0x69, 0x7a, 0x65, 0x20, 0x6f, 0x66, 0x20, 0x74, 0x68, 0x65, 0x20, 0x74, 0x72, 0x69, 0x61, 
+0x6e, 0x67, 0x6c, 0x65, 0x20, 0x69, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 
+0x6e, 0x20, 0x64, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x20, 0x74, 0x68, 0x61, 
+0x74, 0x20, 0x74, 0x68, 0x65, 0x69, 0x72, 0x0d, 0x0a, 0x09, 0x2f, 0x2f, 0x62, 0x6f, 0x75, 
+0x6e, 0x64, 0x69, 0x6e, 0x67, 0x20, 0x62, 0x6f, 0x78, 0x20, 0x6f, 0x76, 0x65, 0x72, 0x6c, 
+0x61, 0x70, 0x73, 0x2c, 0x20, 0x73, 0x6f, 0x20, 0x6f, 0x6e, 0x6c, 0x79, 0x20, 0x74, 0x68, 
+0x65, 0x20, 0x32, 0x37, 0x20, 0x63, 0x65, 0x6c, 0x6c, 0x73, 0x20, 0x61, 0x72, 0x6f, 0x75, 
+0x6e, 0x64, 0x20, 0x74, 0x68, 0x65, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x20, 0x6e, 0x65, 0x65, 0x64, 0x20, 0x74, 0x6f, 0x20, 0x62, 0x65, 0x20, 0x63, 0x68, 0x65, 
+0x63, 0x6b, 0x65, 0x64, 0x2e, 0x20, 0x42, 0x65, 0x63, 0x61, 0x75, 0x73, 0x65, 0x20, 0x61, 
+0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x20, 0x63, 0x61, 0x6e, 0x20, 0x62, 
+0x65, 0x20, 0x0d, 0x0a, 0x09, 0x2f, 0x2f, 0x73, 0x74, 0x6f, 0x72, 0x65, 0x64, 0x20, 0x69, 
+0x6e, 0x20, 0x6d, 0x6f, 0x72, 0x65, 0x20, 0x74, 0x68, 0x61, 0x6e, 0x20, 0x6f, 0x6e, 0x65, 
+0x20, 0x6f, 0x66, 0x20, 0x74, 0x68, 0x6f, 0x73, 0x65, 0x20, 0x63, 0x65, 0x6c, 0x6c, 0x73, 
+0x20, 0x69, 0x74, 0x20, 0x69, 0x73, 0x20, 0x6f, 0x6e, 0x6c, 0x79, 0x20, 0x61, 0x70, 0x70, 
+0x6c, 0x69, 0x65, 0x64, 0x20, 0x66, 0x72, 0x6f, 0x6d, 0x20, 0x74, 0x68, 0x65, 0x20, 0x62, 
+0x75, 0x63, 0x6b, 0x65, 0x74, 0x20, 0x6f, 0x66, 0x20, 0x74, 0x68, 0x65, 0x20, 0x63, 0x65, 
+0x6c, 0x6c, 0x20, 0x74, 0x68, 0x61, 0x74, 0x20, 0x63, 0x6f, 0x6e, 0x74, 0x61, 0x69, 0x6e, 
+0x73, 0x20, 0x74, 0x68, 0x65, 0x0d, 0x0a, 0x09, 0x2f, 0x2f, 0x63, 0x6c, 0x6f, 0x73, 0x65, 
+0x73, 0x74, 0x20, 0x70, 0x6f, 0x69, 0x6e, 0x74, 0x20, 0x6f, 0x6e, 0x20, 0x74, 0x68, 0x65, 
+0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x2e, 0x0d, 0x0a, 0x09, 0x69, 0x6e, 
+0x6c, 0x69, 0x6e, 0x65, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x43, 0x61, 0x6c, 0x63, 
+0x75, 0x6c, 0x61, 0x74, 0x65, 0x42, 0x6f, 0x75, 0x6e, 0x64, 0x61, 0x72, 0x79, 0x46, 0x6f, 
+0x72, 0x63, 0x65, 0x28, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x56, 
+0x65, 0x63, 0x33, 0x66, 0x20, 0x70, 0x6f, 0x69, 0x6e, 0x74, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 
+0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 
+0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x0d, 0x0a, 0x09, 
+0x09, 0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x33, 
+0x32, 0x2a, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 
+0x4d, 0x61, 0x70, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 
+0x54, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x2a, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 
+0x67, 0x6c, 0x65, 0x4d, 0x61, 0x70, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x43, 0x4f, 0x4e, 0x53, 
+0x54, 0x41, 0x4e, 0x54, 0x20, 0x53, 0x54, 0x52, 0x55, 0x43, 0x54, 0x20, 0x54, 0x72, 0x69, 
+0x61, 0x6e, 0x67, 0x6c, 0x65, 0x2a, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 
+0x73, 0x0d, 0x0a, 0x09, 0x29, 0x20, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 
+0x74, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x69, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 
+0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x20, 0x3d, 0x20, 
+0x54, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 
+0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x28, 0x29, 0x3b, 
 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x66, 0x6f, 0x72, 
-0x63, 0x65, 0x44, 0x69, 0x72, 0x20, 0x3d, 0x20, 0x2d, 0x76, 0x65, 0x63, 0x54, 0x6f, 0x54, 
-0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x20, 0x2f, 0x20, 0x64, 0x69, 0x73, 0x74, 0x3b, 
-0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x64, 0x69, 0x73, 0x74, 0x20, 
-0x3e, 0x20, 0x69, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 
-0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x72, 0x65, 0x74, 
-0x75, 0x72, 0x6e, 0x20, 0x4e, 0x45, 0x57, 0x5f, 0x56, 0x45, 0x43, 0x33, 0x46, 0x28, 0x30, 
-0x2c, 0x20, 0x30, 0x2c, 0x20, 0x30, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x0d, 0x0a, 0x09, 
-0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x66, 0x6f, 0x72, 0x63, 0x65, 0x44, 0x69, 
-0x72, 0x20, 0x2a, 0x20, 0x43, 0x61, 0x6c, 0x63, 0x75, 0x6c, 0x61, 0x74, 0x65, 0x54, 0x72, 
-0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x41, 0x6d, 0x70, 0x6c, 
-0x69, 0x74, 0x75, 0x64, 0x65, 0x28, 0x64, 0x69, 0x73, 0x74, 0x20, 0x2f, 0x20, 0x69, 0x6e, 
+0x63, 0x65, 0x20, 0x3d, 0x20, 0x4e, 0x45, 0x57, 0x5f, 0x56, 0x45, 0x43, 0x33, 0x46, 0x28, 
+0x30, 0x2c, 0x20, 0x30, 0x2c, 0x20, 0x30, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 
+0x56, 0x65, 0x63, 0x33, 0x75, 0x20, 0x63, 0x65, 0x6c, 0x6c, 0x20, 0x3d, 0x20, 0x47, 0x65, 
+0x74, 0x43, 0x65, 0x6c, 0x6c, 0x28, 0x70, 0x6f, 0x69, 0x6e, 0x74, 0x2c, 0x20, 0x69, 0x6e, 
 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 
-0x63, 0x65, 0x29, 0x20, 0x2a, 0x20, 0x35, 0x30, 0x3b, 0x09, 0x09, 0x0d, 0x0a, 0x09, 0x7d, 
-0x0d, 0x0a, 0x0d, 0x0a, 0x23, 0x69, 0x66, 0x64, 0x65, 0x66, 0x20, 0x43, 0x4c, 0x5f, 0x43, 
-0x4f, 0x4d, 0x50, 0x49, 0x4c, 0x45, 0x52, 0x0d, 0x0a, 0x09, 0x2f, 0x2f, 0x61, 0x72, 0x72, 
-0x61, 0x79, 0x20, 0x73, 0x68, 0x6f, 0x75, 0x6c, 0x64, 0x20, 0x62, 0x65, 0x20, 0x73, 0x69, 
-0x7a, 0x65, 0x64, 0x20, 0x67, 0x65, 0x74, 0x5f, 0x65, 0x6e, 0x71, 0x75, 0x65, 0x75, 0x65, 
-0x64, 0x5f, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x5f, 0x73, 0x69, 0x7a, 0x65, 0x28, 0x30, 0x29, 
-0x20, 0x2a, 0x20, 0x67, 0x65, 0x74, 0x5f, 0x6e, 0x75, 0x6d, 0x5f, 0x67, 0x72, 0x6f, 0x75, 
-0x70, 0x73, 0x28, 0x30, 0x29, 0x20, 0x2a, 0x20, 0x32, 0x0d, 0x0a, 0x09, 0x76, 0x6f, 0x69, 
-0x64, 0x20, 0x6b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x20, 0x49, 0x6e, 0x63, 0x6c, 0x75, 0x73, 
-0x69, 0x76, 0x65, 0x53, 0x63, 0x61, 0x6e, 0x55, 0x70, 0x50, 0x61, 0x73, 0x73, 0x28, 0x6c, 
-0x6f, 0x63, 0x61, 0x6c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x2a, 0x20, 0x74, 0x65, 0x6d, 0x70, 
-0x2c, 0x20, 0x67, 0x6c, 0x6f, 0x62, 0x61, 0x6c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x2a, 0x20, 
-0x61, 0x72, 0x72, 0x61, 0x79, 0x2c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x20, 0x73, 0x63, 0x61, 
-0x6c, 0x65, 0x2c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x74, 0x61, 0x72, 0x67, 
-0x65, 0x74, 0x47, 0x6c, 0x6f, 0x62, 0x61, 0x6c, 0x57, 0x6f, 0x72, 0x6b, 0x53, 0x69, 0x7a, 
-0x65, 0x29, 0x0d, 0x0a, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x53, 0x54, 0x4f, 0x50, 0x5f, 
-0x45, 0x58, 0x54, 0x45, 0x4e, 0x53, 0x49, 0x56, 0x45, 0x5f, 0x57, 0x4f, 0x52, 0x4b, 0x5f, 
-0x49, 0x54, 0x45, 0x4d, 0x53, 0x28, 0x74, 0x61, 0x72, 0x67, 0x65, 0x74, 0x47, 0x6c, 0x6f, 
-0x62, 0x61, 0x6c, 0x57, 0x6f, 0x72, 0x6b, 0x53, 0x69, 0x7a, 0x65, 0x29, 0x0d, 0x0a, 0x0d, 
-0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x20, 0x6e, 
-0x20, 0x3d, 0x20, 0x6d, 0x69, 0x6e, 0x28, 0x28, 0x67, 0x65, 0x74, 0x5f, 0x67, 0x6c, 0x6f, 
-0x62, 0x61, 0x6c, 0x5f, 0x73, 0x69, 0x7a, 0x65, 0x28, 0x30, 0x29, 0x20, 0x2d, 0x20, 0x67, 
-0x65, 0x74, 0x5f, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x5f, 0x73, 0x69, 0x7a, 0x65, 0x28, 0x30, 
-0x29, 0x20, 0x2a, 0x20, 0x67, 0x65, 0x74, 0x5f, 0x67, 0x72, 0x6f, 0x75, 0x70, 0x5f, 0x69, 
-0x64, 0x28, 0x30, 0x29, 0x29, 0x2c, 0x20, 0x67, 0x65, 0x74, 0x5f, 0x6c, 0x6f, 0x63, 0x61, 
-0x6c, 0x5f, 0x73, 0x69, 0x7a, 0x65, 0x28, 0x30, 0x29, 0x29, 0x20, 0x2a, 0x20, 0x32, 0x3b, 
-0x0d, 0x0a, 0x09, 0x09, 0x67, 0x6c, 0x6f, 0x62, 0x61, 0x6c, 0x20, 0x75, 0x69, 0x6e, 0x74, 
-0x2a, 0x20, 0x70, 0x74, 0x72, 0x49, 0x6e, 0x20, 0x3d, 0x20, 0x61, 0x72, 0x72, 0x61, 0x79, 
-0x20, 0x2b, 0x20, 0x67, 0x65, 0x74, 0x5f, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x5f, 0x73, 0x69, 
-0x7a, 0x65, 0x28, 0x30, 0x29, 0x20, 0x2a, 0x20, 0x67, 0x65, 0x74, 0x5f, 0x67, 0x72, 0x6f, 
-0x75, 0x70, 0x5f, 0x69, 0x64, 0x28, 0x30, 0x29, 0x20, 0x2a, 0x20, 0x32, 0x20, 0x2a, 0x20, 
-0x73, 0x63, 0x61, 0x6c, 0x65, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x67, 0x6c, 0x6f, 0x62, 0x61, 
-0x6c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x2a, 0x20, 0x70, 0x74, 0x72, 0x4f, 0x75, 0x74, 0x20, 
-0x3d, 0x20, 0x70, 0x74, 0x72, 0x49, 0x6e, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x69, 
-0x6e, 0x74, 0x20, 0x74, 0x68, 0x69, 0x64, 0x20, 0x3d, 0x20, 0x67, 0x65, 0x74, 0x5f, 0x6c, 
-0x6f, 0x63, 0x61, 0x6c, 0x5f, 0x69, 0x64, 0x28, 0x30, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
-0x69, 0x6e, 0x74, 0x20, 0x6f, 0x66, 0x66, 0x73, 0x65, 0x74, 0x20, 0x3d, 0x20, 0x31, 0x3b, 
-0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x74, 0x65, 0x6d, 0x70, 0x5b, 0x32, 0x20, 0x2a, 0x20, 
-0x74, 0x68, 0x69, 0x64, 0x20, 0x2b, 0x20, 0x30, 0x5d, 0x20, 0x3d, 0x20, 0x70, 0x74, 0x72, 
-0x49, 0x6e, 0x5b, 0x28, 0x32, 0x20, 0x2a, 0x20, 0x74, 0x68, 0x69, 0x64, 0x20, 0x2b, 0x20, 
-0x31, 0x29, 0x20, 0x2a, 0x20, 0x73, 0x63, 0x61, 0x6c, 0x65, 0x20, 0x2d, 0x20, 0x31, 0x5d, 
-0x3b, 0x20, 0x2f, 0x2f, 0x20, 0x6c, 0x6f, 0x61, 0x64, 0x20, 0x69, 0x6e, 0x70, 0x75, 0x74, 
-0x20, 0x69, 0x6e, 0x74, 0x6f, 0x20, 0x73, 0x68, 0x61, 0x72, 0x65, 0x64, 0x20, 0x6d, 0x65, 
-0x6d, 0x6f, 0x72, 0x79, 0x0d, 0x0a, 0x09, 0x09, 0x74, 0x65, 0x6d, 0x70, 0x5b, 0x32, 0x20, 
-0x2a, 0x20, 0x74, 0x68, 0x69, 0x64, 0x20, 0x2b, 0x20, 0x31, 0x5d, 0x20, 0x3d, 0x20, 0x70, 
-0x74, 0x72, 0x49, 0x6e, 0x5b, 0x28, 0x32, 0x20, 0x2a, 0x20, 0x74, 0x68, 0x69, 0x64, 0x20, 
-0x2b, 0x20, 0x32, 0x29, 0x20, 0x2a, 0x20, 0x73, 0x63, 0x61, 0x6c, 0x65, 0x20, 0x2d, 0x20, 
-0x31, 0x5d, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x69, 
-0x6e, 0x74, 0x20, 0x64, 0x20, 0x3d, 0x20, 0x6e, 0x20, 0x3e, 0x3e, 0x20, 0x31, 0x3b, 0x20, 
-0x64, 0x20, 0x3e, 0x20, 0x30, 0x3b, 0x20, 0x64, 0x20, 0x3e, 0x3e, 0x3d, 0x20, 0x31, 0x29, 
-0x20, 0x2f, 0x2f, 0x20, 0x62, 0x75, 0x69, 0x6c, 0x64, 0x20, 0x73, 0x75, 0x6d, 0x20, 0x69, 
-0x6e, 0x20, 0x70, 0x6c, 0x61, 0x63, 0x65, 0x20, 0x75, 0x70, 0x20, 0x74, 0x68, 0x65, 0x20, 
-0x74, 0x72, 0x65, 0x65, 0x0d, 0x0a, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x62, 
-0x61, 0x72, 0x72, 0x69, 0x65, 0x72, 0x28, 0x43, 0x4c, 0x4b, 0x5f, 0x4c, 0x4f, 0x43, 0x41, 
-0x4c, 0x5f, 0x4d, 0x45, 0x4d, 0x5f, 0x46, 0x45, 0x4e, 0x43, 0x45, 0x29, 0x3b, 0x0d, 0x0a, 
-0x0d, 0x0a, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x74, 0x68, 0x69, 0x64, 0x20, 0x3c, 
-0x20, 0x64, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
-0x69, 0x6e, 0x74, 0x20, 0x61, 0x69, 0x20, 0x3d, 0x20, 0x6f, 0x66, 0x66, 0x73, 0x65, 0x74, 
-0x20, 0x2a, 0x20, 0x28, 0x32, 0x20, 0x2a, 0x20, 0x74, 0x68, 0x69, 0x64, 0x20, 0x2b, 0x20, 
-0x31, 0x29, 0x20, 0x2d, 0x20, 0x31, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x69, 0x6e, 
-0x74, 0x20, 0x62, 0x69, 0x20, 0x3d, 0x20, 0x6f, 0x66, 0x66, 0x73, 0x65, 0x74, 0x20, 0x2a, 
-0x20, 0x28, 0x32, 0x20, 0x2a, 0x20, 0x74, 0x68, 0x69, 0x64, 0x20, 0x2b, 0x20, 0x32, 0x29, 
-0x20, 0x2d, 0x20, 0x31, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x74, 0x65, 
-0x6d, 0x70, 0x5b, 0x62, 0x69, 0x5d, 0x20, 0x2b, 0x3d, 0x20, 0x74, 0x65, 0x6d, 0x70, 0x5b, 
-0x61, 0x69, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 
-0x09, 0x09, 0x6f, 0x66, 0x66, 0x73, 0x65, 0x74, 0x20, 0x2a, 0x3d, 0x20, 0x32, 0x3b, 0x0d, 
-0x0a, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x69, 0x66, 0x20, 
-0x28, 0x74, 0x68, 0x69, 0x64, 0x20, 0x3d, 0x3d, 0x20, 0x30, 0x29, 0x0d, 0x0a, 0x09, 0x09, 
-0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x74, 0x65, 0x6d, 0x70, 0x5b, 0x6e, 0x5d, 0x20, 0x3d, 
-0x20, 0x74, 0x65, 0x6d, 0x70, 0x5b, 0x6e, 0x20, 0x2d, 0x20, 0x31, 0x5d, 0x3b, 0x0d, 0x0a, 
-0x09, 0x09, 0x09, 0x74, 0x65, 0x6d, 0x70, 0x5b, 0x6e, 0x20, 0x2d, 0x20, 0x31, 0x5d, 0x20, 
-0x3d, 0x20, 0x30, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x7d, 0x20, 0x2f, 0x2f, 0x20, 0x63, 0x6c, 
-0x65, 0x61, 0x72, 0x20, 0x74, 0x68, 0x65, 0x20, 0x6c, 0x61, 0x73, 0x74, 0x20, 0x65, 0x6c, 
-0x65, 0x6d, 0x65, 0x6e, 0x74, 0x0d, 0x0a, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6f, 
-0x72, 0x20, 0x28, 0x69, 0x6e, 0x74, 0x20, 0x64, 0x20, 0x3d, 0x20, 0x31, 0x3b, 0x20, 0x64, 
-0x20, 0x3c, 0x20, 0x6e, 0x3b, 0x20, 0x64, 0x20, 0x2a, 0x3d, 0x20, 0x32, 0x29, 0x20, 0x2f, 
-0x2f, 0x20, 0x74, 0x72, 0x61, 0x76, 0x65, 0x72, 0x73, 0x65, 0x20, 0x64, 0x6f, 0x77, 0x6e, 
-0x20, 0x74, 0x72, 0x65, 0x65, 0x20, 0x26, 0x20, 0x62, 0x75, 0x69, 0x6c, 0x64, 0x20, 0x73, 
-0x63, 0x61, 0x6e, 0x0d, 0x0a, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x6f, 0x66, 
-0x66, 0x73, 0x65, 0x74, 0x20, 0x3e, 0x3e, 0x3d, 0x20, 0x31, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
-0x09, 0x62, 0x61, 0x72, 0x72, 0x69, 0x65, 0x72, 0x28, 0x43, 0x4c, 0x4b, 0x5f, 0x4c, 0x4f, 
-0x43, 0x41, 0x4c, 0x5f, 0x4d, 0x45, 0x4d, 0x5f, 0x46, 0x45, 0x4e, 0x43, 0x45, 0x29, 0x3b, 
-0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x74, 0x68, 0x69, 0x64, 
-0x20, 0x3c, 0x20, 0x64, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 
-0x09, 0x09, 0x69, 0x6e, 0x74, 0x20, 0x61, 0x69, 0x20, 0x3d, 0x20, 0x6f, 0x66, 0x66, 0x73, 
-0x65, 0x74, 0x20, 0x2a, 0x20, 0x28, 0x32, 0x20, 0x2a, 0x20, 0x74, 0x68, 0x69, 0x64, 0x20, 
-0x2b, 0x20, 0x31, 0x29, 0x20, 0x2d, 0x20, 0x31, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
-0x69, 0x6e, 0x74, 0x20, 0x62, 0x69, 0x20, 0x3d, 0x20, 0x6f, 0x66, 0x66, 0x73, 0x65, 0x74, 
-0x20, 0x2a, 0x20, 0x28, 0x32, 0x20, 0x2a, 0x20, 0x74, 0x68, 0x69, 0x64, 0x20, 0x2b, 0x20, 
-0x32, 0x29, 0x20, 0x2d, 0x20, 0x31, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
-0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x74, 0x20, 0x3d, 0x20, 0x74, 0x65, 0x6d, 0x70, 0x5b, 
-0x61, 0x69, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x74, 0x65, 0x6d, 0x70, 0x5b, 
-0x61, 0x69, 0x5d, 0x20, 0x3d, 0x20, 0x74, 0x65, 0x6d, 0x70, 0x5b, 0x62, 0x69, 0x5d, 0x3b, 
-0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x74, 0x65, 0x6d, 0x70, 0x5b, 0x62, 0x69, 0x5d, 0x20, 
-0x2b, 0x3d, 0x20, 0x74, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x09, 
-0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x62, 0x61, 0x72, 0x72, 0x69, 0x65, 0x72, 0x28, 
-0x43, 0x4c, 0x4b, 0x5f, 0x4c, 0x4f, 0x43, 0x41, 0x4c, 0x5f, 0x4d, 0x45, 0x4d, 0x5f, 0x46, 
-0x45, 0x4e, 0x43, 0x45, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x70, 0x74, 0x72, 
-0x4f, 0x75, 0x74, 0x5b, 0x28, 0x32, 0x20, 0x2a, 0x20, 0x74, 0x68, 0x69, 0x64, 0x20, 0x2b, 
-0x20, 0x31, 0x29, 0x20, 0x2a, 0x20, 0x73, 0x63, 0x61, 0x6c, 0x65, 0x20, 0x2d, 0x20, 0x31, 
-0x5d, 0x20, 0x3d, 0x20, 0x74, 0x65, 0x6d, 0x70, 0x5b, 0x32, 0x20, 0x2a, 0x20, 0x74, 0x68, 
-0x69, 0x64, 0x20, 0x2b, 0x20, 0x31, 0x5d, 0x3b, 0x20, 0x2f, 0x2f, 0x20, 0x77, 0x72, 0x69, 
-0x74, 0x65, 0x20, 0x72, 0x65, 0x73, 0x75, 0x6c, 0x74, 0x73, 0x20, 0x74, 0x6f, 0x20, 0x64, 
-0x65, 0x76, 0x69, 0x63, 0x65, 0x20, 0x6d, 0x65, 0x6d, 0x6f, 0x72, 0x79, 0x0d, 0x0a, 0x09, 
-0x09, 0x70, 0x74, 0x72, 0x4f, 0x75, 0x74, 0x5b, 0x28, 0x32, 0x20, 0x2a, 0x20, 0x74, 0x68, 
-0x69, 0x64, 0x20, 0x2b, 0x20, 0x32, 0x29, 0x20, 0x2a, 0x20, 0x73, 0x63, 0x61, 0x6c, 0x65, 
-0x20, 0x2d, 0x20, 0x31, 0x5d, 0x20, 0x3d, 0x20, 0x74, 0x65, 0x6d, 0x70, 0x5b, 0x32, 0x20, 
-0x2a, 0x20, 0x74, 0x68, 0x69, 0x64, 0x20, 0x2b, 0x20, 0x32, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 
-0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x76, 0x6f, 0x69, 0x64, 0x20, 0x6b, 0x65, 0x72, 0x6e, 
-0x65, 0x6c, 0x20, 0x49, 0x6e, 0x63, 0x6c, 0x75, 0x73, 0x69, 0x76, 0x65, 0x53, 0x63, 0x61, 
-0x6e, 0x44, 0x6f, 0x77, 0x6e, 0x50, 0x61, 0x73, 0x73, 0x28, 0x67, 0x6c, 0x6f, 0x62, 0x61, 
-0x6c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x2a, 0x20, 0x61, 0x72, 0x72, 0x61, 0x79, 0x73, 0x2c, 
-0x20, 0x75, 0x69, 0x6e, 0x74, 0x20, 0x73, 0x63, 0x61, 0x6c, 0x65, 0x2c, 0x20, 0x75, 0x69, 
-0x6e, 0x74, 0x36, 0x34, 0x20, 0x74, 0x61, 0x72, 0x67, 0x65, 0x74, 0x47, 0x6c, 0x6f, 0x62, 
-0x61, 0x6c, 0x57, 0x6f, 0x72, 0x6b, 0x53, 0x69, 0x7a, 0x65, 0x29, 0x0d, 0x0a, 0x09, 0x7b, 
-0x0d, 0x0a, 0x09, 0x09, 0x53, 0x54, 0x4f, 0x50, 0x5f, 0x45, 0x58, 0x54, 0x45, 0x4e, 0x53, 
-0x49, 0x56, 0x45, 0x5f, 0x57, 0x4f, 0x52, 0x4b, 0x5f, 0x49, 0x54, 0x45, 0x4d, 0x53, 0x28, 
-0x74, 0x61, 0x72, 0x67, 0x65, 0x74, 0x47, 0x6c, 0x6f, 0x62, 0x61, 0x6c, 0x57, 0x6f, 0x72, 
-0x6b, 0x53, 0x69, 0x7a, 0x65, 0x29, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 
-0x74, 0x20, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x28, 0x67, 0x65, 0x74, 0x5f, 
-0x67, 0x72, 0x6f, 0x75, 0x70, 0x5f, 0x69, 0x64, 0x28, 0x30, 0x29, 0x20, 0x2b, 0x20, 0x31, 
-0x29, 0x20, 0x2a, 0x20, 0x28, 0x67, 0x65, 0x74, 0x5f, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x5f, 
-0x73, 0x69, 0x7a, 0x65, 0x28, 0x30, 0x29, 0x20, 0x2b, 0x20, 0x31, 0x29, 0x3b, 0x0d, 0x0a, 
-0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x20, 0x69, 0x6e, 0x63, 0x20, 0x3d, 0x20, 0x61, 0x72, 
-0x72, 0x61, 0x79, 0x73, 0x5b, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x2a, 0x20, 0x73, 0x63, 
-0x61, 0x6c, 0x65, 0x20, 0x2d, 0x20, 0x31, 0x5d, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 
-0x61, 0x72, 0x72, 0x61, 0x79, 0x73, 0x5b, 0x28, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x2b, 
-0x20, 0x67, 0x65, 0x74, 0x5f, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x5f, 0x69, 0x64, 0x28, 0x30, 
-0x29, 0x20, 0x2b, 0x20, 0x31, 0x29, 0x20, 0x2a, 0x20, 0x73, 0x63, 0x61, 0x6c, 0x65, 0x20, 
-0x2d, 0x20, 0x31, 0x5d, 0x20, 0x2b, 0x3d, 0x20, 0x69, 0x6e, 0x63, 0x3b, 0x0d, 0x0a, 0x09, 
-0x7d, 0x0d, 0x0a, 0x23, 0x65, 0x6e, 0x64, 0x69, 0x66, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x76, 
-0x6f, 0x69, 0x64, 0x20, 0x4b, 0x45, 0x52, 0x4e, 0x45, 0x4c, 0x20, 0x50, 0x72, 0x65, 0x70, 
-0x61, 0x72, 0x65, 0x53, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
-0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x28, 0x75, 0x69, 0x6e, 0x74, 
-0x36, 0x34, 0x20, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x2c, 0x20, 0x76, 0x6f, 
-0x6c, 0x61, 0x74, 0x69, 0x6c, 0x65, 0x20, 0x47, 0x4c, 0x4f, 0x42, 0x41, 0x4c, 0x20, 0x48, 
-0x41, 0x53, 0x48, 0x5f, 0x54, 0x59, 0x50, 0x45, 0x2a, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 
-0x61, 0x70, 0x2c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x68, 0x61, 0x73, 0x68, 
-0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 
-0x4e, 0x54, 0x20, 0x53, 0x54, 0x52, 0x55, 0x43, 0x54, 0x20, 0x53, 0x74, 0x61, 0x74, 0x69, 
-0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x2a, 0x20, 0x69, 0x6e, 0x50, 0x61, 
-0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 
-0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 
-0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x2c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 
-0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x29, 
-0x0d, 0x0a, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x53, 0x54, 0x4f, 0x50, 0x5f, 0x45, 0x58, 
-0x54, 0x45, 0x4e, 0x53, 0x49, 0x56, 0x45, 0x5f, 0x57, 0x4f, 0x52, 0x4b, 0x5f, 0x49, 0x54, 
-0x45, 0x4d, 0x53, 0x28, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x43, 0x6f, 0x75, 
-0x6e, 0x74, 0x29, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x49, 0x4e, 0x49, 0x54, 0x49, 0x41, 
-0x4c, 0x49, 0x5a, 0x45, 0x5f, 0x54, 0x48, 0x52, 0x45, 0x41, 0x44, 0x5f, 0x49, 0x44, 0x28, 
-0x29, 0x3b, 0x09, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 
-0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x20, 0x3d, 
-0x20, 0x47, 0x65, 0x74, 0x48, 0x61, 0x73, 0x68, 0x28, 0x47, 0x65, 0x74, 0x43, 0x65, 0x6c, 
-0x6c, 0x28, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x5b, 0x74, 
-0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 
-0x6f, 0x6e, 0x41, 0x6e, 0x64, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x2e, 0x78, 
-0x79, 0x7a, 0x28, 0x29, 0x2c, 0x20, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 
-0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x29, 
-0x20, 0x25, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x3b, 
-0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x61, 0x74, 0x6f, 0x6d, 0x69, 0x63, 0x5f, 0x69, 0x6e, 
-0x63, 0x28, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x20, 0x2b, 0x20, 0x70, 0x61, 0x72, 
-0x74, 0x69, 0x63, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 
-0x0d, 0x0a, 0x09, 0x76, 0x6f, 0x69, 0x64, 0x20, 0x4b, 0x45, 0x52, 0x4e, 0x45, 0x4c, 0x20, 
-0x52, 0x65, 0x6f, 0x72, 0x64, 0x65, 0x72, 0x53, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 
-0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x41, 0x6e, 0x64, 0x46, 0x69, 0x6e, 0x69, 0x73, 
-0x68, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 
-0x20, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x2c, 0x20, 0x76, 0x6f, 0x6c, 0x61, 
-0x74, 0x69, 0x6c, 0x65, 0x20, 0x47, 0x4c, 0x4f, 0x42, 0x41, 0x4c, 0x20, 0x48, 0x41, 0x53, 
-0x48, 0x5f, 0x54, 0x59, 0x50, 0x45, 0x2a, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 
-0x2c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 
-0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 
-0x20, 0x53, 0x54, 0x52, 0x55, 0x43, 0x54, 0x20, 0x53, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 
-0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x2a, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 
-0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x20, 0x47, 0x4c, 0x4f, 0x42, 0x41, 0x4c, 0x20, 0x53, 
-0x54, 0x52, 0x55, 0x43, 0x54, 0x20, 0x53, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 
-0x74, 0x69, 0x63, 0x6c, 0x65, 0x2a, 0x20, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 
-0x63, 0x6c, 0x65, 0x73, 0x2c, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x6d, 0x61, 0x78, 
-0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 
-0x61, 0x6e, 0x63, 0x65, 0x2c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x70, 0x61, 
-0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x29, 0x0d, 0x0a, 0x09, 
-0x7b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x53, 0x54, 0x4f, 0x50, 0x5f, 0x45, 0x58, 0x54, 
-0x45, 0x4e, 0x53, 0x49, 0x56, 0x45, 0x5f, 0x57, 0x4f, 0x52, 0x4b, 0x5f, 0x49, 0x54, 0x45, 
-0x4d, 0x53, 0x28, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x43, 0x6f, 0x75, 0x6e, 
-0x74, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x49, 0x4e, 0x49, 0x54, 0x49, 0x41, 0x4c, 0x49, 0x5a, 
-0x45, 0x5f, 0x54, 0x48, 0x52, 0x45, 0x41, 0x44, 0x5f, 0x49, 0x44, 0x28, 0x29, 0x3b, 0x0d, 
-0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x73, 0x69, 0x7a, 0x65, 0x5f, 0x74, 0x20, 0x6f, 0x6c, 0x64, 
-0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 
-0x44, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 
-0x32, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x20, 
-0x3d, 0x20, 0x47, 0x65, 0x74, 0x48, 0x61, 0x73, 0x68, 0x28, 0x47, 0x65, 0x74, 0x43, 0x65, 
-0x6c, 0x6c, 0x28, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x5b, 
-0x6f, 0x6c, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 
-0x69, 0x6f, 0x6e, 0x41, 0x6e, 0x64, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x2e, 
-0x78, 0x79, 0x7a, 0x28, 0x29, 0x2c, 0x20, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 
-0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 
-0x29, 0x20, 0x25, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 
-0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x73, 0x69, 0x7a, 0x65, 0x5f, 0x74, 0x20, 0x6e, 
-0x65, 0x77, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x28, 0x73, 0x69, 0x7a, 0x65, 
-0x5f, 0x74, 0x29, 0x28, 0x61, 0x74, 0x6f, 0x6d, 0x69, 0x63, 0x5f, 0x64, 0x65, 0x63, 0x28, 
-0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x20, 0x2b, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 
-0x63, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x29, 0x20, 0x2d, 0x20, 0x31, 0x29, 0x3b, 0x0d, 
-0x0a, 0x09, 0x09, 0x0d, 0x0a, 0x09, 0x09, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 
-0x63, 0x6c, 0x65, 0x73, 0x5b, 0x6e, 0x65, 0x77, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x20, 
-0x3d, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x5b, 0x6f, 
-0x6c, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 
-0x09, 0x76, 0x6f, 0x69, 0x64, 0x20, 0x4b, 0x45, 0x52, 0x4e, 0x45, 0x4c, 0x20, 0x43, 0x6f, 
-0x6d, 0x70, 0x75, 0x74, 0x65, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 
-0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x41, 0x6e, 0x64, 0x50, 0x72, 
-0x65, 0x70, 0x61, 0x72, 0x65, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x28, 0x75, 0x69, 
-0x6e, 0x74, 0x36, 0x34, 0x20, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x2c, 0x20, 
-0x76, 0x6f, 0x6c, 0x61, 0x74, 0x69, 0x6c, 0x65, 0x20, 0x47, 0x4c, 0x4f, 0x42, 0x41, 0x4c, 
-0x20, 0x48, 0x41, 0x53, 0x48, 0x5f, 0x54, 0x59, 0x50, 0x45, 0x2a, 0x20, 0x68, 0x61, 0x73, 
-0x68, 0x4d, 0x61, 0x70, 0x2c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x68, 0x61, 
-0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x47, 0x4c, 0x4f, 0x42, 
-0x41, 0x4c, 0x20, 0x53, 0x54, 0x52, 0x55, 0x43, 0x54, 0x20, 0x44, 0x79, 0x6e, 0x61, 0x6d, 
-0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x2a, 0x20, 0x70, 0x61, 0x72, 
-0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x6d, 
-0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 
-0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x2c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 
-0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x29, 0x0d, 
-0x0a, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x53, 0x54, 0x4f, 0x50, 0x5f, 0x45, 0x58, 0x54, 
-0x45, 0x4e, 0x53, 0x49, 0x56, 0x45, 0x5f, 0x57, 0x4f, 0x52, 0x4b, 0x5f, 0x49, 0x54, 0x45, 
-0x4d, 0x53, 0x28, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x43, 0x6f, 0x75, 0x6e, 
-0x74, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x49, 0x4e, 0x49, 0x54, 0x49, 0x41, 0x4c, 0x49, 0x5a, 
-0x45, 0x5f, 0x54, 0x48, 0x52, 0x45, 0x41, 0x44, 0x5f, 0x49, 0x44, 0x28, 0x29, 0x3b, 0x0d, 
-0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x70, 0x61, 0x72, 
-0x74, 0x69, 0x63, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x20, 0x3d, 0x20, 0x47, 0x65, 0x74, 
-0x48, 0x61, 0x73, 0x68, 0x28, 0x47, 0x65, 0x74, 0x43, 0x65, 0x6c, 0x6c, 0x28, 0x70, 0x61, 
-0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 
-0x44, 0x5d, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x41, 0x6e, 0x64, 0x50, 
-0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x2e, 0x78, 0x79, 0x7a, 0x28, 0x29, 0x2c, 0x20, 
-0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 
-0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x29, 0x20, 0x25, 0x20, 0x68, 0x61, 0x73, 
-0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 
-0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 
-0x64, 0x49, 0x44, 0x5d, 0x2e, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x41, 0x6e, 
-0x64, 0x48, 0x61, 0x73, 0x68, 0x2e, 0x77, 0x20, 0x3d, 0x20, 0x2a, 0x28, 0x66, 0x6c, 0x6f, 
-0x61, 0x74, 0x2a, 0x29, 0x26, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x48, 0x61, 
-0x73, 0x68, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x61, 0x74, 0x6f, 0x6d, 0x69, 0x63, 
-0x5f, 0x69, 0x6e, 0x63, 0x28, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x20, 0x2b, 0x20, 
-0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x29, 0x3b, 0x0d, 
-0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x76, 0x6f, 0x69, 0x64, 0x20, 0x4b, 0x45, 0x52, 0x4e, 
-0x45, 0x4c, 0x20, 0x52, 0x65, 0x6f, 0x72, 0x64, 0x65, 0x72, 0x44, 0x79, 0x6e, 0x61, 0x6d, 
-0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x41, 0x6e, 0x64, 0x46, 
-0x69, 0x6e, 0x69, 0x73, 0x68, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x28, 0x75, 0x69, 
-0x6e, 0x74, 0x36, 0x34, 0x20, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x2c, 0x20, 
-0x47, 0x4c, 0x4f, 0x42, 0x41, 0x4c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x2a, 0x20, 
-0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x70, 0x2c, 0x20, 0x76, 0x6f, 
-0x6c, 0x61, 0x74, 0x69, 0x6c, 0x65, 0x20, 0x47, 0x4c, 0x4f, 0x42, 0x41, 0x4c, 0x20, 0x48, 
-0x41, 0x53, 0x48, 0x5f, 0x54, 0x59, 0x50, 0x45, 0x2a, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 
-0x61, 0x70, 0x2c, 0x20, 0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 0x20, 0x53, 0x54, 
-0x52, 0x55, 0x43, 0x54, 0x20, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 
-0x74, 0x69, 0x63, 0x6c, 0x65, 0x2a, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
-0x6c, 0x65, 0x73, 0x2c, 0x20, 0x47, 0x4c, 0x4f, 0x42, 0x41, 0x4c, 0x20, 0x53, 0x54, 0x52, 
-0x55, 0x43, 0x54, 0x20, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 
-0x69, 0x63, 0x6c, 0x65, 0x2a, 0x20, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
-0x6c, 0x65, 0x73, 0x2c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x70, 0x61, 0x72, 
-0x74, 0x69, 0x63, 0x6c, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x29, 0x0d, 0x0a, 0x09, 0x7b, 
-0x0d, 0x0a, 0x09, 0x09, 0x53, 0x54, 0x4f, 0x50, 0x5f, 0x45, 0x58, 0x54, 0x45, 0x4e, 0x53, 
-0x49, 0x56, 0x45, 0x5f, 0x57, 0x4f, 0x52, 0x4b, 0x5f, 0x49, 0x54, 0x45, 0x4d, 0x53, 0x28, 
-0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x29, 0x0d, 
-0x0a, 0x09, 0x09, 0x49, 0x4e, 0x49, 0x54, 0x49, 0x41, 0x4c, 0x49, 0x5a, 0x45, 0x5f, 0x54, 
-0x48, 0x52, 0x45, 0x41, 0x44, 0x5f, 0x49, 0x44, 0x28, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 
-0x09, 0x09, 0x73, 0x69, 0x7a, 0x65, 0x5f, 0x74, 0x20, 0x6f, 0x6c, 0x64, 0x49, 0x6e, 0x64, 
-0x65, 0x78, 0x20, 0x3d, 0x20, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x3b, 0x0d, 
-0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x70, 0x61, 0x72, 
-0x74, 0x69, 0x63, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x20, 0x3d, 0x20, 0x61, 0x73, 0x5f, 
-0x75, 0x69, 0x6e, 0x74, 0x28, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
-0x73, 0x5b, 0x6f, 0x6c, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x2e, 0x76, 0x65, 0x6c, 
-0x6f, 0x63, 0x69, 0x74, 0x79, 0x41, 0x6e, 0x64, 0x48, 0x61, 0x73, 0x68, 0x2e, 0x77, 0x29, 
-0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x0d, 0x0a, 0x09, 0x09, 0x73, 0x69, 0x7a, 0x65, 0x5f, 0x74, 
-0x20, 0x6e, 0x65, 0x77, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x28, 0x73, 0x69, 
-0x7a, 0x65, 0x5f, 0x74, 0x29, 0x28, 0x61, 0x74, 0x6f, 0x6d, 0x69, 0x63, 0x5f, 0x64, 0x65, 
-0x63, 0x28, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x20, 0x2b, 0x20, 0x70, 0x61, 0x72, 
-0x74, 0x69, 0x63, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x29, 0x20, 0x2d, 0x20, 0x31, 0x29, 
-0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x0d, 0x0a, 0x09, 0x09, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 
-0x6c, 0x65, 0x4d, 0x61, 0x70, 0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 
-0x20, 0x3d, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x29, 0x74, 0x68, 0x72, 0x65, 
-0x61, 0x64, 0x49, 0x44, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 
-0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x5b, 0x6e, 0x65, 0x77, 0x49, 0x6e, 0x64, 0x65, 0x78, 
-0x5d, 0x20, 0x3d, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 
-0x5b, 0x6f, 0x6c, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 
-0x0d, 0x0a, 0x09, 0x76, 0x6f, 0x69, 0x64, 0x20, 0x4b, 0x45, 0x52, 0x4e, 0x45, 0x4c, 0x20, 
-0x46, 0x69, 0x6c, 0x6c, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 
-0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x70, 0x41, 0x6e, 0x64, 0x46, 0x69, 0x6e, 0x69, 0x73, 
-0x68, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 
-0x20, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x2c, 0x20, 0x47, 0x4c, 0x4f, 0x42, 
-0x41, 0x4c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x74, 
-0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x70, 0x2c, 0x20, 0x76, 0x6f, 0x6c, 0x61, 0x74, 0x69, 
-0x6c, 0x65, 0x20, 0x47, 0x4c, 0x4f, 0x42, 0x41, 0x4c, 0x20, 0x48, 0x41, 0x53, 0x48, 0x5f, 
-0x54, 0x59, 0x50, 0x45, 0x2a, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 0x20, 
-0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 0x20, 0x53, 0x54, 0x52, 0x55, 0x43, 0x54, 
-0x20, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
-0x65, 0x2a, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 
-0x20, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
-0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x29, 0x0d, 0x0a, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 
-0x53, 0x54, 0x4f, 0x50, 0x5f, 0x45, 0x58, 0x54, 0x45, 0x4e, 0x53, 0x49, 0x56, 0x45, 0x5f, 
-0x57, 0x4f, 0x52, 0x4b, 0x5f, 0x49, 0x54, 0x45, 0x4d, 0x53, 0x28, 0x70, 0x61, 0x72, 0x74, 
-0x69, 0x63, 0x6c, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x49, 
-0x4e, 0x49, 0x54, 0x49, 0x41, 0x4c, 0x49, 0x5a, 0x45, 0x5f, 0x54, 0x48, 0x52, 0x45, 0x41, 
-0x44, 0x5f, 0x49, 0x44, 0x28, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 
-0x6e, 0x74, 0x33, 0x32, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x48, 0x61, 
-0x73, 0x68, 0x20, 0x3d, 0x20, 0x61, 0x73, 0x5f, 0x75, 0x69, 0x6e, 0x74, 0x28, 0x69, 0x6e, 
-0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 
-0x64, 0x49, 0x44, 0x5d, 0x2e, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x41, 0x6e, 
-0x64, 0x48, 0x61, 0x73, 0x68, 0x2e, 0x77, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 
-0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 
-0x61, 0x74, 0x6f, 0x6d, 0x69, 0x63, 0x5f, 0x64, 0x65, 0x63, 0x28, 0x68, 0x61, 0x73, 0x68, 
-0x4d, 0x61, 0x70, 0x20, 0x2b, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x48, 
-0x61, 0x73, 0x68, 0x29, 0x20, 0x2d, 0x20, 0x31, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x0d, 0x0a, 
-0x09, 0x09, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x70, 0x5b, 0x69, 
-0x6e, 0x64, 0x65, 0x78, 0x5d, 0x20, 0x3d, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 
-0x29, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 
-0x0a, 0x0d, 0x0a, 0x09, 0x76, 0x6f, 0x69, 0x64, 0x20, 0x4b, 0x45, 0x52, 0x4e, 0x45, 0x4c, 
-0x20, 0x55, 0x70, 0x64, 0x61, 0x74, 0x65, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
-0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x28, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 
-0x6e, 0x74, 0x36, 0x34, 0x20, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x2c, 0x0d, 
-0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 
-0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x43, 0x6f, 0x75, 0x6e, 
-0x74, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x64, 0x79, 
-0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 
-0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 
-0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 
-0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x2c, 0x0d, 0x0a, 
-0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 
-0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 
-0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x43, 0x4f, 0x4e, 0x53, 0x54, 
-0x41, 0x4e, 0x54, 0x20, 0x53, 0x54, 0x52, 0x55, 0x43, 0x54, 0x20, 0x44, 0x79, 0x6e, 0x61, 
-0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x2a, 0x20, 0x69, 0x6e, 
-0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x47, 
-0x4c, 0x4f, 0x42, 0x41, 0x4c, 0x20, 0x53, 0x54, 0x52, 0x55, 0x43, 0x54, 0x20, 0x44, 0x79, 
-0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x2a, 0x20, 
-0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x0d, 0x0a, 
-0x09, 0x09, 0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 0x20, 0x48, 0x41, 0x53, 0x48, 
-0x5f, 0x54, 0x59, 0x50, 0x45, 0x2a, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 
-0x0d, 0x0a, 0x09, 0x09, 0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 0x20, 0x75, 0x69, 
-0x6e, 0x74, 0x33, 0x32, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 
-0x61, 0x70, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 
-0x20, 0x53, 0x54, 0x52, 0x55, 0x43, 0x54, 0x20, 0x53, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 
-0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x2a, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 
-0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x43, 
-0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 0x20, 0x48, 0x41, 0x53, 0x48, 0x5f, 0x54, 0x59, 
-0x50, 0x45, 0x2a, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 
-0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 0x0d, 0x0a, 0x09, 
-0x09, 0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 0x20, 0x53, 0x54, 0x52, 0x55, 0x43, 
-0x54, 0x20, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x42, 0x65, 0x68, 0x61, 0x76, 
-0x69, 0x6f, 0x75, 0x72, 0x50, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2a, 
-0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x0d, 0x0a, 0x09, 0x29, 
-0x20, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x53, 0x54, 0x4f, 0x50, 0x5f, 0x45, 0x58, 0x54, 0x45, 
-0x4e, 0x53, 0x49, 0x56, 0x45, 0x5f, 0x57, 0x4f, 0x52, 0x4b, 0x5f, 0x49, 0x54, 0x45, 0x4d, 
-0x53, 0x28, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
-0x6c, 0x65, 0x73, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x49, 0x4e, 
-0x49, 0x54, 0x49, 0x41, 0x4c, 0x49, 0x5a, 0x45, 0x5f, 0x54, 0x48, 0x52, 0x45, 0x41, 0x44, 
-0x5f, 0x49, 0x44, 0x28, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x43, 0x4f, 0x4e, 
-0x53, 0x54, 0x41, 0x4e, 0x54, 0x20, 0x53, 0x54, 0x52, 0x55, 0x43, 0x54, 0x20, 0x44, 0x79, 
-0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x2a, 0x20, 
-0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x74, 0x72, 0x20, 0x3d, 
-0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x20, 0x2b, 0x20, 
-0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x47, 0x4c, 
-0x4f, 0x42, 0x41, 0x4c, 0x20, 0x53, 0x54, 0x52, 0x55, 0x43, 0x54, 0x20, 0x44, 0x79, 0x6e, 
-0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x2a, 0x20, 0x6f, 
-0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x74, 0x72, 0x20, 0x3d, 
-0x20, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x20, 0x2b, 
-0x20, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x23, 
-0x69, 0x66, 0x64, 0x65, 0x66, 0x20, 0x44, 0x45, 0x42, 0x55, 0x47, 0x5f, 0x42, 0x55, 0x46, 
-0x46, 0x45, 0x52, 0x53, 0x5f, 0x4b, 0x45, 0x52, 0x4e, 0x45, 0x4c, 0x0d, 0x0a, 0x09, 0x09, 
-0x69, 0x66, 0x20, 0x28, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x20, 0x3e, 0x3d, 
-0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
-0x65, 0x73, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 
-0x09, 0x09, 0x09, 0x70, 0x72, 0x69, 0x6e, 0x74, 0x66, 0x28, 0x22, 0x41, 0x6c, 0x6c, 0x6f, 
-0x63, 0x61, 0x74, 0x69, 0x6e, 0x67, 0x20, 0x6d, 0x6f, 0x72, 0x65, 0x20, 0x77, 0x6f, 0x72, 
-0x6b, 0x20, 0x69, 0x74, 0x65, 0x6d, 0x73, 0x20, 0x74, 0x68, 0x61, 0x6e, 0x20, 0x70, 0x61, 
-0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x22, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
-0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x23, 
-0x65, 0x6e, 0x64, 0x69, 0x66, 0x09, 0x09, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 
-0x63, 0x33, 0x66, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 
-0x69, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x3d, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 
-0x63, 0x6c, 0x65, 0x50, 0x74, 0x72, 0x2d, 0x3e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 
-0x6e, 0x41, 0x6e, 0x64, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x2e, 0x78, 0x79, 
-0x7a, 0x28, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x75, 
-0x20, 0x63, 0x65, 0x6c, 0x6c, 0x20, 0x3d, 0x20, 0x47, 0x65, 0x74, 0x43, 0x65, 0x6c, 0x6c, 
-0x28, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 
-0x6f, 0x6e, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 
-0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 
-0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 
-0x09, 0x56, 0x65, 0x63, 0x33, 0x75, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x43, 0x65, 0x6c, 
-0x6c, 0x20, 0x3d, 0x20, 0x63, 0x65, 0x6c, 0x6c, 0x20, 0x2d, 0x20, 0x4e, 0x45, 0x57, 0x5f, 
-0x56, 0x45, 0x43, 0x33, 0x55, 0x28, 0x31, 0x2c, 0x20, 0x31, 0x2c, 0x20, 0x31, 0x29, 0x3b, 
-0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x75, 0x20, 0x65, 0x6e, 0x64, 0x43, 0x65, 
-0x6c, 0x6c, 0x20, 0x3d, 0x20, 0x63, 0x65, 0x6c, 0x6c, 0x20, 0x2b, 0x20, 0x4e, 0x45, 0x57, 
-0x5f, 0x56, 0x45, 0x43, 0x33, 0x55, 0x28, 0x32, 0x2c, 0x20, 0x32, 0x2c, 0x20, 0x32, 0x29, 
-0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x79, 
-0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 
-0x66, 0x6c, 0x75, 0x65, 0x6e, 0x63, 0x65, 0x53, 0x75, 0x6d, 0x20, 0x3d, 0x20, 0x30, 0x3b, 
-0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 
-0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x66, 0x6c, 0x75, 0x65, 
-0x6e, 0x63, 0x65, 0x53, 0x75, 0x6d, 0x20, 0x3d, 0x20, 0x30, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 
+0x63, 0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x75, 0x20, 0x62, 
+0x65, 0x67, 0x69, 0x6e, 0x43, 0x65, 0x6c, 0x6c, 0x20, 0x3d, 0x20, 0x63, 0x65, 0x6c, 0x6c, 
+0x20, 0x2d, 0x20, 0x4e, 0x45, 0x57, 0x5f, 0x56, 0x45, 0x43, 0x33, 0x55, 0x28, 0x31, 0x2c, 
+0x20, 0x31, 0x2c, 0x20, 0x31, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 
+0x75, 0x20, 0x65, 0x6e, 0x64, 0x43, 0x65, 0x6c, 0x6c, 0x20, 0x3d, 0x20, 0x63, 0x65, 0x6c, 
+0x6c, 0x20, 0x2b, 0x20, 0x4e, 0x45, 0x57, 0x5f, 0x56, 0x45, 0x43, 0x33, 0x55, 0x28, 0x32, 
+0x2c, 0x20, 0x32, 0x2c, 0x20, 0x32, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x75, 
+0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x76, 0x69, 0x73, 0x69, 0x74, 0x65, 0x64, 0x48, 0x61, 
+0x73, 0x68, 0x65, 0x73, 0x5b, 0x32, 0x37, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 
+0x6e, 0x74, 0x33, 0x32, 0x20, 0x76, 0x69, 0x73, 0x69, 0x74, 0x65, 0x64, 0x48, 0x61, 0x73, 
+0x68, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x20, 0x3d, 0x20, 0x30, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 
 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x75, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 
 0x6c, 0x6c, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x6f, 0x74, 0x68, 
 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x78, 0x20, 0x3d, 0x20, 0x62, 0x65, 0x67, 0x69, 
@@ -814,309 +611,3199 @@ namespace SPH::Kernels
 0x6e, 0x64, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x7a, 0x3b, 0x20, 0x2b, 0x2b, 0x6f, 0x74, 0x68, 
 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x7a, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 
-0x6f, 0x74, 0x68, 0x65, 0x72, 0x48, 0x61, 0x73, 0x68, 0x20, 0x3d, 0x20, 0x47, 0x65, 0x74, 
-0x48, 0x61, 0x73, 0x68, 0x28, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x29, 
-0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x2f, 0x2f, 0x43, 0x61, 0x6c, 
-0x63, 0x75, 0x6c, 0x61, 0x74, 0x69, 0x6e, 0x67, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 
-0x63, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x20, 0x70, 0x72, 0x65, 0x73, 
-0x73, 0x75, 0x72, 0x65, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 
-0x33, 0x32, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x6f, 0x64, 
-0x20, 0x3d, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x48, 0x61, 0x73, 0x68, 0x20, 0x25, 0x20, 
-0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
-0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x3b, 0x0d, 0x0a, 
-0x09, 0x09, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x62, 0x65, 0x67, 
-0x69, 0x6e, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 
-0x61, 0x70, 0x5b, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x6f, 0x64, 
-0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 
-0x20, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x68, 0x61, 0x73, 
+0x6f, 0x74, 0x68, 0x65, 0x72, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x6f, 0x64, 0x20, 0x3d, 0x20, 
+0x47, 0x65, 0x74, 0x48, 0x61, 0x73, 0x68, 0x28, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 
+0x6c, 0x6c, 0x29, 0x20, 0x25, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x48, 
+0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x2f, 0x2f, 0x54, 0x77, 0x6f, 0x20, 0x6e, 0x65, 0x69, 0x67, 
+0x68, 0x62, 0x6f, 0x75, 0x72, 0x69, 0x6e, 0x67, 0x20, 0x63, 0x65, 0x6c, 0x6c, 0x73, 0x20, 
+0x63, 0x61, 0x6e, 0x20, 0x6c, 0x61, 0x6e, 0x64, 0x20, 0x69, 0x6e, 0x20, 0x74, 0x68, 0x65, 
+0x20, 0x73, 0x61, 0x6d, 0x65, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x2c, 0x20, 0x69, 
+0x74, 0x20, 0x6d, 0x75, 0x73, 0x74, 0x20, 0x62, 0x65, 0x20, 0x63, 0x68, 0x65, 0x63, 0x6b, 
+0x65, 0x64, 0x20, 0x6f, 0x6e, 0x6c, 0x79, 0x20, 0x6f, 0x6e, 0x63, 0x65, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x62, 0x6f, 0x6f, 0x6c, 0x20, 0x76, 0x69, 0x73, 0x69, 0x74, 0x65, 
+0x64, 0x20, 0x3d, 0x20, 0x66, 0x61, 0x6c, 0x73, 0x65, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x69, 
+0x20, 0x3d, 0x20, 0x30, 0x3b, 0x20, 0x69, 0x20, 0x3c, 0x20, 0x76, 0x69, 0x73, 0x69, 0x74, 
+0x65, 0x64, 0x48, 0x61, 0x73, 0x68, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x3b, 0x20, 0x2b, 0x2b, 
+0x69, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x76, 0x69, 0x73, 0x69, 0x74, 
+0x65, 0x64, 0x20, 0x3d, 0x20, 0x76, 0x69, 0x73, 0x69, 0x74, 0x65, 0x64, 0x20, 0x7c, 0x7c, 
+0x20, 0x76, 0x69, 0x73, 0x69, 0x74, 0x65, 0x64, 0x48, 0x61, 0x73, 0x68, 0x65, 0x73, 0x5b, 
+0x69, 0x5d, 0x20, 0x3d, 0x3d, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x48, 0x61, 0x73, 0x68, 
+0x4d, 0x6f, 0x64, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 
+0x20, 0x28, 0x76, 0x69, 0x73, 0x69, 0x74, 0x65, 0x64, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x74, 0x69, 0x6e, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x76, 0x69, 0x73, 0x69, 0x74, 0x65, 0x64, 0x48, 0x61, 
+0x73, 0x68, 0x65, 0x73, 0x5b, 0x76, 0x69, 0x73, 0x69, 0x74, 0x65, 0x64, 0x48, 0x61, 0x73, 
+0x68, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x2b, 0x2b, 0x5d, 0x20, 0x3d, 0x20, 0x6f, 0x74, 0x68, 
+0x65, 0x72, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x6f, 0x64, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x62, 0x65, 0x67, 0x69, 
+0x6e, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 
+0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x5b, 0x6f, 0x74, 0x68, 0x65, 0x72, 
+0x48, 0x61, 0x73, 0x68, 0x4d, 0x6f, 0x64, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 
+0x78, 0x20, 0x3d, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x48, 0x61, 0x73, 
 0x68, 0x4d, 0x61, 0x70, 0x5b, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x48, 0x61, 0x73, 0x68, 0x4d, 
-0x6f, 0x64, 0x20, 0x2b, 0x20, 0x31, 0x5d, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x23, 0x69, 0x66, 
-0x64, 0x65, 0x66, 0x20, 0x44, 0x45, 0x42, 0x55, 0x47, 0x5f, 0x42, 0x55, 0x46, 0x46, 0x45, 
-0x52, 0x53, 0x5f, 0x4b, 0x45, 0x52, 0x4e, 0x45, 0x4c, 0x09, 0x09, 0x09, 0x09, 0x0d, 0x0a, 
-0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 
-0x6e, 0x64, 0x65, 0x78, 0x20, 0x3e, 0x20, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 
-0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
-0x09, 0x09, 0x70, 0x72, 0x69, 0x6e, 0x74, 0x66, 0x28, 0x22, 0x44, 0x79, 0x6e, 0x61, 0x6d, 
-0x69, 0x63, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x20, 0x6d, 0x61, 0x70, 
-0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x20, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x69, 0x73, 
-0x20, 0x62, 0x69, 0x67, 0x67, 0x65, 0x72, 0x20, 0x74, 0x68, 0x61, 0x6e, 0x20, 0x65, 0x6e, 
-0x64, 0x20, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x2e, 0x20, 0x42, 0x65, 0x67, 0x69, 0x6e, 0x3a, 
-0x20, 0x25, 0x75, 0x20, 0x45, 0x6e, 0x64, 0x3a, 0x20, 0x25, 0x75, 0x22, 0x2c, 0x20, 0x62, 
-0x65, 0x67, 0x69, 0x6e, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x2c, 0x20, 0x65, 0x6e, 0x64, 0x49, 
-0x6e, 0x64, 0x65, 0x78, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x62, 
-0x72, 0x65, 0x61, 0x6b, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 
-0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 
-0x6e, 0x64, 0x65, 0x78, 0x20, 0x3e, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 
-0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x29, 0x0d, 
-0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
-0x70, 0x72, 0x69, 0x6e, 0x74, 0x66, 0x28, 0x22, 0x49, 0x6e, 0x76, 0x61, 0x6c, 0x69, 0x64, 
-0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 
-0x6c, 0x65, 0x20, 0x6d, 0x61, 0x70, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x20, 0x69, 0x6e, 
-0x64, 0x65, 0x78, 0x3a, 0x20, 0x25, 0x75, 0x22, 0x2c, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 
-0x49, 0x6e, 0x64, 0x65, 0x78, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
-0x62, 0x72, 0x65, 0x61, 0x6b, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 
-0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x65, 0x6e, 0x64, 0x49, 0x6e, 
-0x64, 0x65, 0x78, 0x20, 0x3e, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 
-0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x29, 0x0d, 0x0a, 
-0x09, 0x09, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x70, 
-0x72, 0x69, 0x6e, 0x74, 0x66, 0x28, 0x22, 0x49, 0x6e, 0x76, 0x61, 0x6c, 0x69, 0x64, 0x20, 
-0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
-0x65, 0x20, 0x6d, 0x61, 0x70, 0x20, 0x65, 0x6e, 0x64, 0x20, 0x69, 0x6e, 0x64, 0x65, 0x78, 
-0x3a, 0x20, 0x25, 0x75, 0x22, 0x2c, 0x20, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 
-0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x62, 0x72, 0x65, 0x61, 0x6b, 
-0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x23, 0x65, 0x6e, 0x64, 
-0x69, 0x66, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 
-0x09, 0x09, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 
-0x20, 0x69, 0x20, 0x3d, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 0x6e, 0x64, 0x65, 0x78, 
-0x3b, 0x20, 0x69, 0x20, 0x3c, 0x20, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x3b, 
-0x20, 0x2b, 0x2b, 0x69, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 
-0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x69, 0x6e, 
-0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 
-0x61, 0x70, 0x5b, 0x69, 0x5d, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x23, 0x69, 0x66, 0x64, 0x65, 
-0x66, 0x20, 0x44, 0x45, 0x42, 0x55, 0x47, 0x5f, 0x42, 0x55, 0x46, 0x46, 0x45, 0x52, 0x53, 
-0x5f, 0x4b, 0x45, 0x52, 0x4e, 0x45, 0x4c, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
-0x69, 0x66, 0x20, 0x28, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3e, 0x3d, 0x20, 0x64, 0x79, 
-0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x43, 
-0x6f, 0x75, 0x6e, 0x74, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7b, 0x0d, 
-0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x70, 0x72, 0x69, 0x6e, 0x74, 0x66, 0x28, 
-0x22, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
-0x65, 0x20, 0x6d, 0x61, 0x70, 0x20, 0x76, 0x61, 0x6c, 0x75, 0x65, 0x20, 0x6f, 0x75, 0x74, 
-0x73, 0x69, 0x64, 0x65, 0x20, 0x76, 0x61, 0x6c, 0x69, 0x64, 0x20, 0x72, 0x61, 0x6e, 0x67, 
-0x65, 0x22, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x63, 0x6f, 
-0x6e, 0x74, 0x69, 0x6e, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
-0x7d, 0x0d, 0x0a, 0x23, 0x65, 0x6e, 0x64, 0x69, 0x66, 0x0d, 0x0a, 0x0d, 0x0a, 0x0d, 0x0a, 
-0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 0x20, 
+0x6f, 0x64, 0x20, 0x2b, 0x20, 0x31, 0x5d, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x69, 
+0x20, 0x3d, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x3b, 0x20, 
+0x69, 0x20, 0x3c, 0x20, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x3b, 0x20, 0x2b, 
+0x2b, 0x69, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 0x20, 0x53, 0x54, 
+0x52, 0x55, 0x43, 0x54, 0x20, 0x54, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x2a, 0x20, 
+0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x20, 0x3d, 0x20, 0x74, 0x72, 0x69, 0x61, 
+0x6e, 0x67, 0x6c, 0x65, 0x73, 0x20, 0x2b, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 
+0x65, 0x4d, 0x61, 0x70, 0x5b, 0x69, 0x5d, 0x3b, 0x0d, 0x0a, 0x23, 0x69, 0x66, 0x64, 0x65, 
+0x66, 0x20, 0x43, 0x4c, 0x5f, 0x43, 0x4f, 0x4d, 0x50, 0x49, 0x4c, 0x45, 0x52, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x63, 0x6c, 0x6f, 
+0x73, 0x65, 0x73, 0x74, 0x50, 0x6f, 0x69, 0x6e, 0x74, 0x20, 0x3d, 0x20, 0x43, 0x6c, 0x6f, 
+0x73, 0x65, 0x73, 0x74, 0x50, 0x6f, 0x69, 0x6e, 0x74, 0x4f, 0x6e, 0x54, 0x72, 0x69, 0x61, 
+0x6e, 0x67, 0x6c, 0x65, 0x28, 0x70, 0x6f, 0x69, 0x6e, 0x74, 0x2c, 0x20, 0x74, 0x72, 0x69, 
+0x61, 0x6e, 0x67, 0x6c, 0x65, 0x2d, 0x3e, 0x70, 0x31, 0x2e, 0x78, 0x79, 0x7a, 0x28, 0x29, 
+0x2c, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x2d, 0x3e, 0x70, 0x32, 0x2e, 
+0x78, 0x79, 0x7a, 0x28, 0x29, 0x2c, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 
+0x2d, 0x3e, 0x70, 0x33, 0x2e, 0x78, 0x79, 0x7a, 0x28, 0x29, 0x29, 0x3b, 0x0d, 0x0a, 0x23, 
+0x65, 0x6c, 0x73, 0x65, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 
+0x33, 0x66, 0x20, 0x63, 0x6c, 0x6f, 0x73, 0x65, 0x73, 0x74, 0x50, 0x6f, 0x69, 0x6e, 0x74, 
+0x20, 0x3d, 0x20, 0x43, 0x6c, 0x6f, 0x73, 0x65, 0x73, 0x74, 0x50, 0x6f, 0x69, 0x6e, 0x74, 
+0x4f, 0x6e, 0x54, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x28, 0x70, 0x6f, 0x69, 0x6e, 
+0x74, 0x2c, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x2d, 0x3e, 0x70, 0x31, 
+0x2c, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x2d, 0x3e, 0x70, 0x32, 0x2c, 
+0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x2d, 0x3e, 0x70, 0x33, 0x29, 0x3b, 
+0x0d, 0x0a, 0x23, 0x65, 0x6e, 0x64, 0x69, 0x66, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x47, 0x65, 0x74, 0x48, 0x61, 0x73, 0x68, 0x28, 
+0x47, 0x65, 0x74, 0x43, 0x65, 0x6c, 0x6c, 0x28, 0x63, 0x6c, 0x6f, 0x73, 0x65, 0x73, 0x74, 
+0x50, 0x6f, 0x69, 0x6e, 0x74, 0x2c, 0x20, 0x69, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 
+0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x29, 0x20, 0x25, 
+0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 
+0x70, 0x53, 0x69, 0x7a, 0x65, 0x20, 0x21, 0x3d, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x48, 
+0x61, 0x73, 0x68, 0x4d, 0x6f, 0x64, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x63, 0x6f, 0x6e, 0x74, 0x69, 0x6e, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x2b, 0x3d, 0x20, 0x43, 
+0x61, 0x6c, 0x63, 0x75, 0x6c, 0x61, 0x74, 0x65, 0x54, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 
+0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x28, 0x70, 0x6f, 0x69, 0x6e, 0x74, 0x2c, 0x20, 0x63, 
+0x6c, 0x6f, 0x73, 0x65, 0x73, 0x74, 0x50, 0x6f, 0x69, 0x6e, 0x74, 0x29, 0x3b, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 
+0x0d, 0x0a, 0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x66, 0x6f, 0x72, 0x63, 
+0x65, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x23, 0x69, 0x66, 0x64, 0x65, 
+0x66, 0x20, 0x43, 0x4c, 0x5f, 0x43, 0x4f, 0x4d, 0x50, 0x49, 0x4c, 0x45, 0x52, 0x0d, 0x0a, 
+0x09, 0x2f, 0x2f, 0x61, 0x72, 0x72, 0x61, 0x79, 0x20, 0x73, 0x68, 0x6f, 0x75, 0x6c, 0x64, 
+0x20, 0x62, 0x65, 0x20, 0x73, 0x69, 0x7a, 0x65, 0x64, 0x20, 0x67, 0x65, 0x74, 0x5f, 0x65, 
+0x6e, 0x71, 0x75, 0x65, 0x75, 0x65, 0x64, 0x5f, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x5f, 0x73, 
+0x69, 0x7a, 0x65, 0x28, 0x30, 0x29, 0x20, 0x2a, 0x20, 0x67, 0x65, 0x74, 0x5f, 0x6e, 0x75, 
+0x6d, 0x5f, 0x67, 0x72, 0x6f, 0x75, 0x70, 0x73, 0x28, 0x30, 0x29, 0x20, 0x2a, 0x20, 0x32, 
+0x0d, 0x0a, 0x09, 0x76, 0x6f, 0x69, 0x64, 0x20, 0x6b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x20, 
+0x49, 0x6e, 0x63, 0x6c, 0x75, 0x73, 0x69, 0x76, 0x65, 0x53, 0x63, 0x61, 0x6e, 0x55, 0x70, 
+0x50, 0x61, 0x73, 0x73, 0x28, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x20, 0x75, 0x69, 0x6e, 0x74, 
+0x2a, 0x20, 0x74, 0x65, 0x6d, 0x70, 0x2c, 0x20, 0x67, 0x6c, 0x6f, 0x62, 0x61, 0x6c, 0x20, 
+0x75, 0x69, 0x6e, 0x74, 0x2a, 0x20, 0x61, 0x72, 0x72, 0x61, 0x79, 0x2c, 0x20, 0x75, 0x69, 
+0x6e, 0x74, 0x20, 0x73, 0x63, 0x61, 0x6c, 0x65, 0x2c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x36, 
+0x34, 0x20, 0x74, 0x61, 0x72, 0x67, 0x65, 0x74, 0x47, 0x6c, 0x6f, 0x62, 0x61, 0x6c, 0x57, 
+0x6f, 0x72, 0x6b, 0x53, 0x69, 0x7a, 0x65, 0x29, 0x0d, 0x0a, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 
+0x09, 0x53, 0x54, 0x4f, 0x50, 0x5f, 0x45, 0x58, 0x54, 0x45, 0x4e, 0x53, 0x49, 0x56, 0x45, 
+0x5f, 0x57, 0x4f, 0x52, 0x4b, 0x5f, 0x49, 0x54, 0x45, 0x4d, 0x53, 0x28, 0x74, 0x61, 0x72, 
+0x67, 0x65, 0x74, 0x47, 0x6c, 0x6f, 0x62, 0x61, 0x6c, 0x57, 0x6f, 0x72, 0x6b, 0x53, 0x69, 
+0x7a, 0x65, 0x29, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 
+0x75, 0x69, 0x6e, 0x74, 0x20, 0x6e, 0x20, 0x3d, 0x20, 0x6d, 0x69, 0x6e, 0x28, 0x28, 0x67, 
+0x65, 0x74, 0x5f, 0x67, 0x6c, 0x6f, 0x62, 0x61, 0x6c, 0x5f, 0x73, 0x69, 0x7a, 0x65, 0x28, 
+0x30, 0x29, 0x20, 0x2d, 0x20, 0x67, 0x65, 0x74, 0x5f, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x5f, 
+0x73, 0x69, 0x7a, 0x65, 0x28, 0x30, 0x29, 0x20, 0x2a, 0x20, 0x67, 0x65, 0x74, 0x5f, 0x67, 
+0x72, 0x6f, 0x75, 0x70, 0x5f, 0x69, 0x64, 0x28, 0x30, 0x29, 0x29, 0x2c, 0x20, 0x67, 0x65, 
+0x74, 0x5f, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x5f, 0x73, 0x69, 0x7a, 0x65, 0x28, 0x30, 0x29, 
+0x29, 0x20, 0x2a, 0x20, 0x32, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x67, 0x6c, 0x6f, 0x62, 0x61, 
+0x6c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x2a, 0x20, 0x70, 0x74, 0x72, 0x49, 0x6e, 0x20, 0x3d, 
+0x20, 0x61, 0x72, 0x72, 0x61, 0x79, 0x20, 0x2b, 0x20, 0x67, 0x65, 0x74, 0x5f, 0x6c, 0x6f, 
+0x63, 0x61, 0x6c, 0x5f, 0x73, 0x69, 0x7a, 0x65, 0x28, 0x30, 0x29, 0x20, 0x2a, 0x20, 0x67, 
+0x65, 0x74, 0x5f, 0x67, 0x72, 0x6f, 0x75, 0x70, 0x5f, 0x69, 0x64, 0x28, 0x30, 0x29, 0x20, 
+0x2a, 0x20, 0x32, 0x20, 0x2a, 0x20, 0x73, 0x63, 0x61, 0x6c, 0x65, 0x3b, 0x0d, 0x0a, 0x09, 
+0x09, 0x67, 0x6c, 0x6f, 0x62, 0x61, 0x6c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x2a, 0x20, 0x70, 
+0x74, 0x72, 0x4f, 0x75, 0x74, 0x20, 0x3d, 0x20, 0x70, 0x74, 0x72, 0x49, 0x6e, 0x3b, 0x0d, 
+0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x69, 0x6e, 0x74, 0x20, 0x74, 0x68, 0x69, 0x64, 0x20, 0x3d, 
+0x20, 0x67, 0x65, 0x74, 0x5f, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x5f, 0x69, 0x64, 0x28, 0x30, 
+0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x69, 0x6e, 0x74, 0x20, 0x6f, 0x66, 0x66, 0x73, 0x65, 
+0x74, 0x20, 0x3d, 0x20, 0x31, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x74, 0x65, 0x6d, 
+0x70, 0x5b, 0x32, 0x20, 0x2a, 0x20, 0x74, 0x68, 0x69, 0x64, 0x20, 0x2b, 0x20, 0x30, 0x5d, 
+0x20, 0x3d, 0x20, 0x70, 0x74, 0x72, 0x49, 0x6e, 0x5b, 0x28, 0x32, 0x20, 0x2a, 0x20, 0x74, 
+0x68, 0x69, 0x64, 0x20, 0x2b, 0x20, 0x31, 0x29, 0x20, 0x2a, 0x20, 0x73, 0x63, 0x61, 0x6c, 
+0x65, 0x20, 0x2d, 0x20, 0x31, 0x5d, 0x3b, 0x20, 0x2f, 0x2f, 0x20, 0x6c, 0x6f, 0x61, 0x64, 
+0x20, 0x69, 0x6e, 0x70, 0x75, 0x74, 0x20, 0x69, 0x6e, 0x74, 0x6f, 0x20, 0x73, 0x68, 0x61, 
+0x72, 0x65, 0x64, 0x20, 0x6d, 0x65, 0x6d, 0x6f, 0x72, 0x79, 0x0d, 0x0a, 0x09, 0x09, 0x74, 
+0x65, 0x6d, 0x70, 0x5b, 0x32, 0x20, 0x2a, 0x20, 0x74, 0x68, 0x69, 0x64, 0x20, 0x2b, 0x20, 
+0x31, 0x5d, 0x20, 0x3d, 0x20, 0x70, 0x74, 0x72, 0x49, 0x6e, 0x5b, 0x28, 0x32, 0x20, 0x2a, 
+0x20, 0x74, 0x68, 0x69, 0x64, 0x20, 0x2b, 0x20, 0x32, 0x29, 0x20, 0x2a, 0x20, 0x73, 0x63, 
+0x61, 0x6c, 0x65, 0x20, 0x2d, 0x20, 0x31, 0x5d, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 
+0x66, 0x6f, 0x72, 0x20, 0x28, 0x69, 0x6e, 0x74, 0x20, 0x64, 0x20, 0x3d, 0x20, 0x6e, 0x20, 
+0x3e, 0x3e, 0x20, 0x31, 0x3b, 0x20, 0x64, 0x20, 0x3e, 0x20, 0x30, 0x3b, 0x20, 0x64, 0x20, 
+0x3e, 0x3e, 0x3d, 0x20, 0x31, 0x29, 0x20, 0x2f, 0x2f, 0x20, 0x62, 0x75, 0x69, 0x6c, 0x64, 
+0x20, 0x73, 0x75, 0x6d, 0x20, 0x69, 0x6e, 0x20, 0x70, 0x6c, 0x61, 0x63, 0x65, 0x20, 0x75, 
+0x70, 0x20, 0x74, 0x68, 0x65, 0x20, 0x74, 0x72, 0x65, 0x65, 0x0d, 0x0a, 0x09, 0x09, 0x7b, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x62, 0x61, 0x72, 0x72, 0x69, 0x65, 0x72, 0x28, 0x43, 0x4c, 
+0x4b, 0x5f, 0x4c, 0x4f, 0x43, 0x41, 0x4c, 0x5f, 0x4d, 0x45, 0x4d, 0x5f, 0x46, 0x45, 0x4e, 
+0x43, 0x45, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 
+0x74, 0x68, 0x69, 0x64, 0x20, 0x3c, 0x20, 0x64, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x7b, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x69, 0x6e, 0x74, 0x20, 0x61, 0x69, 0x20, 0x3d, 0x20, 
+0x6f, 0x66, 0x66, 0x73, 0x65, 0x74, 0x20, 0x2a, 0x20, 0x28, 0x32, 0x20, 0x2a, 0x20, 0x74, 
+0x68, 0x69, 0x64, 0x20, 0x2b, 0x20, 0x31, 0x29, 0x20, 0x2d, 0x20, 0x31, 0x3b, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x69, 0x6e, 0x74, 0x20, 0x62, 0x69, 0x20, 0x3d, 0x20, 0x6f, 0x66, 
+0x66, 0x73, 0x65, 0x74, 0x20, 0x2a, 0x20, 0x28, 0x32, 0x20, 0x2a, 0x20, 0x74, 0x68, 0x69, 
+0x64, 0x20, 0x2b, 0x20, 0x32, 0x29, 0x20, 0x2d, 0x20, 0x31, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x74, 0x65, 0x6d, 0x70, 0x5b, 0x62, 0x69, 0x5d, 0x20, 0x2b, 0x3d, 
+0x20, 0x74, 0x65, 0x6d, 0x70, 0x5b, 0x61, 0x69, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x6f, 0x66, 0x66, 0x73, 0x65, 0x74, 0x20, 
+0x2a, 0x3d, 0x20, 0x32, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x0d, 
+0x0a, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x74, 0x68, 0x69, 0x64, 0x20, 0x3d, 0x3d, 0x20, 
+0x30, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x74, 0x65, 0x6d, 
+0x70, 0x5b, 0x6e, 0x5d, 0x20, 0x3d, 0x20, 0x74, 0x65, 0x6d, 0x70, 0x5b, 0x6e, 0x20, 0x2d, 
+0x20, 0x31, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x74, 0x65, 0x6d, 0x70, 0x5b, 0x6e, 
+0x20, 0x2d, 0x20, 0x31, 0x5d, 0x20, 0x3d, 0x20, 0x30, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x7d, 
+0x20, 0x2f, 0x2f, 0x20, 0x63, 0x6c, 0x65, 0x61, 0x72, 0x20, 0x74, 0x68, 0x65, 0x20, 0x6c, 
+0x61, 0x73, 0x74, 0x20, 0x65, 0x6c, 0x65, 0x6d, 0x65, 0x6e, 0x74, 0x0d, 0x0a, 0x0d, 0x0a, 
+0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x69, 0x6e, 0x74, 0x20, 0x64, 0x20, 
+0x3d, 0x20, 0x31, 0x3b, 0x20, 0x64, 0x20, 0x3c, 0x20, 0x6e, 0x3b, 0x20, 0x64, 0x20, 0x2a, 
+0x3d, 0x20, 0x32, 0x29, 0x20, 0x2f, 0x2f, 0x20, 0x74, 0x72, 0x61, 0x76, 0x65, 0x72, 0x73, 
+0x65, 0x20, 0x64, 0x6f, 0x77, 0x6e, 0x20, 0x74, 0x72, 0x65, 0x65, 0x20, 0x26, 0x20, 0x62, 
+0x75, 0x69, 0x6c, 0x64, 0x20, 0x73, 0x63, 0x61, 0x6e, 0x0d, 0x0a, 0x09, 0x09, 0x7b, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x6f, 0x66, 0x66, 0x73, 0x65, 0x74, 0x20, 0x3e, 0x3e, 0x3d, 0x20, 
+0x31, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x62, 0x61, 0x72, 0x72, 0x69, 0x65, 0x72, 0x28, 
+0x43, 0x4c, 0x4b, 0x5f, 0x4c, 0x4f, 0x43, 0x41, 0x4c, 0x5f, 0x4d, 0x45, 0x4d, 0x5f, 0x46, 
+0x45, 0x4e, 0x43, 0x45, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x69, 0x66, 
+0x20, 0x28, 0x74, 0x68, 0x69, 0x64, 0x20, 0x3c, 0x20, 0x64, 0x29, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x69, 0x6e, 0x74, 0x20, 0x61, 0x69, 0x20, 
+0x3d, 0x20, 0x6f, 0x66, 0x66, 0x73, 0x65, 0x74, 0x20, 0x2a, 0x20, 0x28, 0x32, 0x20, 0x2a, 
+0x20, 0x74, 0x68, 0x69, 0x64, 0x20, 0x2b, 0x20, 0x31, 0x29, 0x20, 0x2d, 0x20, 0x31, 0x3b, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x69, 0x6e, 0x74, 0x20, 0x62, 0x69, 0x20, 0x3d, 0x20, 
+0x6f, 0x66, 0x66, 0x73, 0x65, 0x74, 0x20, 0x2a, 0x20, 0x28, 0x32, 0x20, 0x2a, 0x20, 0x74, 
+0x68, 0x69, 0x64, 0x20, 0x2b, 0x20, 0x32, 0x29, 0x20, 0x2d, 0x20, 0x31, 0x3b, 0x0d, 0x0a, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x74, 0x20, 0x3d, 
+0x20, 0x74, 0x65, 0x6d, 0x70, 0x5b, 0x61, 0x69, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x74, 0x65, 0x6d, 0x70, 0x5b, 0x61, 0x69, 0x5d, 0x20, 0x3d, 0x20, 0x74, 0x65, 0x6d, 
+0x70, 0x5b, 0x62, 0x69, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x74, 0x65, 0x6d, 
+0x70, 0x5b, 0x62, 0x69, 0x5d, 0x20, 0x2b, 0x3d, 0x20, 0x74, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x62, 0x61, 
+0x72, 0x72, 0x69, 0x65, 0x72, 0x28, 0x43, 0x4c, 0x4b, 0x5f, 0x4c, 0x4f, 0x43, 0x41, 0x4c, 
+0x5f, 0x4d, 0x45, 0x4d, 0x5f, 0x46, 0x45, 0x4e, 0x43, 0x45, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 
+0x0a, 0x09, 0x09, 0x70, 0x74, 0x72, 0x4f, 0x75, 0x74, 0x5b, 0x28, 0x32, 0x20, 0x2a, 0x20, 
+0x74, 0x68, 0x69, 0x64, 0x20, 0x2b, 0x20, 0x31, 0x29, 0x20, 0x2a, 0x20, 0x73, 0x63, 0x61, 
+0x6c, 0x65, 0x20, 0x2d, 0x20, 0x31, 0x5d, 0x20, 0x3d, 0x20, 0x74, 0x65, 0x6d, 0x70, 0x5b, 
+0x32, 0x20, 0x2a, 0x20, 0x74, 0x68, 0x69, 0x64, 0x20, 0x2b, 0x20, 0x31, 0x5d, 0x3b, 0x20, 
+0x2f, 0x2f, 0x20, 0x77, 0x72, 0x69, 0x74, 0x65, 0x20, 0x72, 0x65, 0x73, 0x75, 0x6c, 0x74, 
+0x73, 0x20, 0x74, 0x6f, 0x20, 0x64, 0x65, 0x76, 0x69, 0x63, 0x65, 0x20, 0x6d, 0x65, 0x6d, 
+0x6f, 0x72, 0x79, 0x0d, 0x0a, 0x09, 0x09, 0x70, 0x74, 0x72, 0x4f, 0x75, 0x74, 0x5b, 0x28, 
+0x32, 0x20, 0x2a, 0x20, 0x74, 0x68, 0x69, 0x64, 0x20, 0x2b, 0x20, 0x32, 0x29, 0x20, 0x2a, 
+0x20, 0x73, 0x63, 0x61, 0x6c, 0x65, 0x20, 0x2d, 0x20, 0x31, 0x5d, 0x20, 0x3d, 0x20, 0x74, 
+0x65, 0x6d, 0x70, 0x5b, 0x32, 0x20, 0x2a, 0x20, 0x74, 0x68, 0x69, 0x64, 0x20, 0x2b, 0x20, 
+0x32, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x76, 0x6f, 0x69, 
+0x64, 0x20, 0x6b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x20, 0x49, 0x6e, 0x63, 0x6c, 0x75, 0x73, 
+0x69, 0x76, 0x65, 0x53, 0x63, 0x61, 0x6e, 0x44, 0x6f, 0x77, 0x6e, 0x50, 0x61, 0x73, 0x73, 
+0x28, 0x67, 0x6c, 0x6f, 0x62, 0x61, 0x6c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x2a, 0x20, 0x61, 
+0x72, 0x72, 0x61, 0x79, 0x73, 0x2c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x20, 0x73, 0x63, 0x61, 
+0x6c, 0x65, 0x2c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x74, 0x61, 0x72, 0x67, 
+0x65, 0x74, 0x47, 0x6c, 0x6f, 0x62, 0x61, 0x6c, 0x57, 0x6f, 0x72, 0x6b, 0x53, 0x69, 0x7a, 
+0x65, 0x29, 0x0d, 0x0a, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x53, 0x54, 0x4f, 0x50, 0x5f, 
+0x45, 0x58, 0x54, 0x45, 0x4e, 0x53, 0x49, 0x56, 0x45, 0x5f, 0x57, 0x4f, 0x52, 0x4b, 0x5f, 
+0x49, 0x54, 0x45, 0x4d, 0x53, 0x28, 0x74, 0x61, 0x72, 0x67, 0x65, 0x74, 0x47, 0x6c, 0x6f, 
+0x62, 0x61, 0x6c, 0x57, 0x6f, 0x72, 0x6b, 0x53, 0x69, 0x7a, 0x65, 0x29, 0x0d, 0x0a, 0x0d, 
+0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x20, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 
+0x20, 0x28, 0x67, 0x65, 0x74, 0x5f, 0x67, 0x72, 0x6f, 0x75, 0x70, 0x5f, 0x69, 0x64, 0x28, 
+0x30, 0x29, 0x20, 0x2b, 0x20, 0x31, 0x29, 0x20, 0x2a, 0x20, 0x28, 0x67, 0x65, 0x74, 0x5f, 
+0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x5f, 0x73, 0x69, 0x7a, 0x65, 0x28, 0x30, 0x29, 0x20, 0x2b, 
+0x20, 0x31, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x20, 0x69, 0x6e, 
+0x63, 0x20, 0x3d, 0x20, 0x61, 0x72, 0x72, 0x61, 0x79, 0x73, 0x5b, 0x69, 0x6e, 0x64, 0x65, 
+0x78, 0x20, 0x2a, 0x20, 0x73, 0x63, 0x61, 0x6c, 0x65, 0x20, 0x2d, 0x20, 0x31, 0x5d, 0x3b, 
+0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x61, 0x72, 0x72, 0x61, 0x79, 0x73, 0x5b, 0x28, 0x69, 
+0x6e, 0x64, 0x65, 0x78, 0x20, 0x2b, 0x20, 0x67, 0x65, 0x74, 0x5f, 0x6c, 0x6f, 0x63, 0x61, 
+0x6c, 0x5f, 0x69, 0x64, 0x28, 0x30, 0x29, 0x20, 0x2b, 0x20, 0x31, 0x29, 0x20, 0x2a, 0x20, 
+0x73, 0x63, 0x61, 0x6c, 0x65, 0x20, 0x2d, 0x20, 0x31, 0x5d, 0x20, 0x2b, 0x3d, 0x20, 0x69, 
+0x6e, 0x63, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x2f, 0x2a, 0x0d, 
+0x0a, 0x09, 0x09, 0x52, 0x65, 0x64, 0x75, 0x63, 0x65, 0x2d, 0x74, 0x68, 0x65, 0x6e, 0x2d, 
+0x73, 0x63, 0x61, 0x6e, 0x20, 0x6f, 0x66, 0x20, 0x61, 0x6e, 0x20, 0x61, 0x72, 0x72, 0x61, 
+0x79, 0x20, 0x6f, 0x66, 0x20, 0x61, 0x6e, 0x79, 0x20, 0x73, 0x69, 0x7a, 0x65, 0x20, 0x69, 
+0x6e, 0x20, 0x74, 0x68, 0x72, 0x65, 0x65, 0x20, 0x64, 0x69, 0x73, 0x70, 0x61, 0x74, 0x63, 
+0x68, 0x65, 0x73, 0x2e, 0x20, 0x54, 0x68, 0x65, 0x20, 0x61, 0x72, 0x72, 0x61, 0x79, 0x20, 
+0x69, 0x73, 0x20, 0x73, 0x70, 0x6c, 0x69, 0x74, 0x20, 0x69, 0x6e, 0x74, 0x6f, 0x20, 0x6f, 
+0x6e, 0x65, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x20, 0x70, 0x65, 0x72, 0x20, 0x77, 0x6f, 0x72, 
+0x6b, 0x20, 0x67, 0x72, 0x6f, 0x75, 0x70, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x65, 0x76, 0x65, 
+0x72, 0x79, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x20, 0x69, 0x73, 0x20, 0x61, 0x20, 0x6d, 0x75, 
+0x6c, 0x74, 0x69, 0x70, 0x6c, 0x65, 0x20, 0x6f, 0x66, 0x20, 0x74, 0x68, 0x65, 0x20, 0x77, 
+0x6f, 0x72, 0x6b, 0x20, 0x67, 0x72, 0x6f, 0x75, 0x70, 0x20, 0x73, 0x69, 0x7a, 0x65, 0x2e, 
+0x20, 0x54, 0x68, 0x65, 0x20, 0x66, 0x69, 0x72, 0x73, 0x74, 0x20, 0x70, 0x61, 0x73, 0x73, 
+0x20, 0x73, 0x75, 0x6d, 0x73, 0x20, 0x65, 0x76, 0x65, 0x72, 0x79, 0x20, 0x74, 0x69, 0x6c, 
+0x65, 0x2c, 0x20, 0x74, 0x68, 0x65, 0x20, 0x73, 0x65, 0x63, 0x6f, 0x6e, 0x64, 0x20, 0x73, 
+0x63, 0x61, 0x6e, 0x73, 0x20, 0x74, 0x68, 0x65, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x20, 0x73, 
+0x75, 0x6d, 0x73, 0x0d, 0x0a, 0x09, 0x09, 0x69, 0x6e, 0x20, 0x61, 0x20, 0x73, 0x69, 0x6e, 
+0x67, 0x6c, 0x65, 0x20, 0x77, 0x6f, 0x72, 0x6b, 0x20, 0x67, 0x72, 0x6f, 0x75, 0x70, 0x20, 
+0x61, 0x6e, 0x64, 0x20, 0x74, 0x68, 0x65, 0x20, 0x74, 0x68, 0x69, 0x72, 0x64, 0x20, 0x73, 
+0x63, 0x61, 0x6e, 0x73, 0x20, 0x65, 0x76, 0x65, 0x72, 0x79, 0x20, 0x74, 0x69, 0x6c, 0x65, 
+0x20, 0x73, 0x74, 0x61, 0x72, 0x74, 0x69, 0x6e, 0x67, 0x20, 0x66, 0x72, 0x6f, 0x6d, 0x20, 
+0x74, 0x68, 0x65, 0x20, 0x73, 0x75, 0x6d, 0x20, 0x6f, 0x66, 0x20, 0x74, 0x68, 0x65, 0x20, 
+0x74, 0x69, 0x6c, 0x65, 0x73, 0x20, 0x62, 0x65, 0x66, 0x6f, 0x72, 0x65, 0x20, 0x69, 0x74, 
+0x2e, 0x20, 0x41, 0x6c, 0x6c, 0x20, 0x77, 0x6f, 0x72, 0x6b, 0x0d, 0x0a, 0x09, 0x09, 0x67, 
+0x72, 0x6f, 0x75, 0x70, 0x73, 0x20, 0x6d, 0x75, 0x73, 0x74, 0x20, 0x62, 0x65, 0x20, 0x66, 
+0x75, 0x6c, 0x6c, 0x2c, 0x20, 0x74, 0x68, 0x65, 0x20, 0x77, 0x6f, 0x72, 0x6b, 0x20, 0x69, 
+0x74, 0x65, 0x6d, 0x73, 0x20, 0x70, 0x61, 0x73, 0x74, 0x20, 0x74, 0x68, 0x65, 0x20, 0x65, 
+0x6e, 0x64, 0x20, 0x6f, 0x66, 0x20, 0x74, 0x68, 0x65, 0x20, 0x61, 0x72, 0x72, 0x61, 0x79, 
+0x20, 0x75, 0x73, 0x65, 0x20, 0x30, 0x2e, 0x0d, 0x0a, 0x09, 0x2a, 0x2f, 0x0d, 0x0a, 0x0d, 
+0x0a, 0x09, 0x2f, 0x2f, 0x49, 0x6e, 0x63, 0x6c, 0x75, 0x73, 0x69, 0x76, 0x65, 0x20, 0x73, 
+0x63, 0x61, 0x6e, 0x20, 0x6f, 0x66, 0x20, 0x6f, 0x6e, 0x65, 0x20, 0x76, 0x61, 0x6c, 0x75, 
+0x65, 0x20, 0x70, 0x65, 0x72, 0x20, 0x77, 0x6f, 0x72, 0x6b, 0x20, 0x69, 0x74, 0x65, 0x6d, 
+0x20, 0x6f, 0x66, 0x20, 0x74, 0x68, 0x65, 0x20, 0x67, 0x72, 0x6f, 0x75, 0x70, 0x2c, 0x20, 
+0x27, 0x74, 0x65, 0x6d, 0x70, 0x27, 0x20, 0x6d, 0x75, 0x73, 0x74, 0x20, 0x68, 0x6f, 0x6c, 
+0x64, 0x20, 0x67, 0x65, 0x74, 0x5f, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x5f, 0x73, 0x69, 0x7a, 
+0x65, 0x28, 0x30, 0x29, 0x20, 0x76, 0x61, 0x6c, 0x75, 0x65, 0x73, 0x2e, 0x20, 0x54, 0x68, 
+0x65, 0x20, 0x73, 0x75, 0x6d, 0x20, 0x6f, 0x66, 0x20, 0x61, 0x6c, 0x6c, 0x0d, 0x0a, 0x09, 
+0x2f, 0x2f, 0x74, 0x68, 0x65, 0x20, 0x76, 0x61, 0x6c, 0x75, 0x65, 0x73, 0x20, 0x69, 0x73, 
+0x20, 0x77, 0x72, 0x69, 0x74, 0x74, 0x65, 0x6e, 0x20, 0x69, 0x6e, 0x74, 0x6f, 0x20, 0x27, 
+0x74, 0x6f, 0x74, 0x61, 0x6c, 0x27, 0x0d, 0x0a, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x20, 0x57, 
+0x6f, 0x72, 0x6b, 0x47, 0x72, 0x6f, 0x75, 0x70, 0x49, 0x6e, 0x63, 0x6c, 0x75, 0x73, 0x69, 
+0x76, 0x65, 0x53, 0x63, 0x61, 0x6e, 0x28, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x20, 0x75, 0x69, 
+0x6e, 0x74, 0x2a, 0x20, 0x74, 0x65, 0x6d, 0x70, 0x2c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x20, 
+0x76, 0x61, 0x6c, 0x75, 0x65, 0x2c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x2a, 0x20, 0x74, 0x6f, 
+0x74, 0x61, 0x6c, 0x29, 0x0d, 0x0a, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 
+0x74, 0x20, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x49, 0x44, 0x20, 0x3d, 0x20, 0x67, 0x65, 0x74, 
+0x5f, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x5f, 0x69, 0x64, 0x28, 0x30, 0x29, 0x3b, 0x0d, 0x0a, 
+0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x20, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x53, 0x69, 0x7a, 
+0x65, 0x20, 0x3d, 0x20, 0x67, 0x65, 0x74, 0x5f, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x5f, 0x73, 
+0x69, 0x7a, 0x65, 0x28, 0x30, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x74, 0x65, 
+0x6d, 0x70, 0x5b, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x49, 0x44, 0x5d, 0x20, 0x3d, 0x20, 0x76, 
+0x61, 0x6c, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 
+0x28, 0x75, 0x69, 0x6e, 0x74, 0x20, 0x6f, 0x66, 0x66, 0x73, 0x65, 0x74, 0x20, 0x3d, 0x20, 
+0x31, 0x3b, 0x20, 0x6f, 0x66, 0x66, 0x73, 0x65, 0x74, 0x20, 0x3c, 0x20, 0x6c, 0x6f, 0x63, 
+0x61, 0x6c, 0x53, 0x69, 0x7a, 0x65, 0x3b, 0x20, 0x6f, 0x66, 0x66, 0x73, 0x65, 0x74, 0x20, 
+0x3c, 0x3c, 0x3d, 0x20, 0x31, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x62, 0x61, 0x72, 0x72, 0x69, 0x65, 0x72, 0x28, 0x43, 0x4c, 0x4b, 0x5f, 0x4c, 0x4f, 
+0x43, 0x41, 0x4c, 0x5f, 0x4d, 0x45, 0x4d, 0x5f, 0x46, 0x45, 0x4e, 0x43, 0x45, 0x29, 0x3b, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 
+0x20, 0x3d, 0x20, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x49, 0x44, 0x20, 0x3e, 0x3d, 0x20, 0x6f, 
+0x66, 0x66, 0x73, 0x65, 0x74, 0x20, 0x3f, 0x20, 0x74, 0x65, 0x6d, 0x70, 0x5b, 0x6c, 0x6f, 
+0x63, 0x61, 0x6c, 0x49, 0x44, 0x20, 0x2d, 0x20, 0x6f, 0x66, 0x66, 0x73, 0x65, 0x74, 0x5d, 
+0x20, 0x3a, 0x20, 0x30, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x62, 0x61, 0x72, 0x72, 0x69, 
+0x65, 0x72, 0x28, 0x43, 0x4c, 0x4b, 0x5f, 0x4c, 0x4f, 0x43, 0x41, 0x4c, 0x5f, 0x4d, 0x45, 
+0x4d, 0x5f, 0x46, 0x45, 0x4e, 0x43, 0x45, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x74, 
+0x65, 0x6d, 0x70, 0x5b, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x49, 0x44, 0x5d, 0x20, 0x2b, 0x3d, 
+0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 
+0x0a, 0x09, 0x09, 0x62, 0x61, 0x72, 0x72, 0x69, 0x65, 0x72, 0x28, 0x43, 0x4c, 0x4b, 0x5f, 
+0x4c, 0x4f, 0x43, 0x41, 0x4c, 0x5f, 0x4d, 0x45, 0x4d, 0x5f, 0x46, 0x45, 0x4e, 0x43, 0x45, 
+0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x76, 0x61, 0x6c, 0x75, 0x65, 0x20, 0x3d, 0x20, 0x74, 
+0x65, 0x6d, 0x70, 0x5b, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x49, 0x44, 0x5d, 0x3b, 0x0d, 0x0a, 
+0x09, 0x09, 0x2a, 0x74, 0x6f, 0x74, 0x61, 0x6c, 0x20, 0x3d, 0x20, 0x74, 0x65, 0x6d, 0x70, 
+0x5b, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x53, 0x69, 0x7a, 0x65, 0x20, 0x2d, 0x20, 0x31, 0x5d, 
+0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x2f, 0x2f, 0x27, 0x74, 0x65, 0x6d, 0x70, 0x27, 0x20, 0x63, 
+0x61, 0x6e, 0x20, 0x62, 0x65, 0x20, 0x72, 0x65, 0x75, 0x73, 0x65, 0x64, 0x20, 0x61, 0x66, 
+0x74, 0x65, 0x72, 0x20, 0x74, 0x68, 0x65, 0x20, 0x66, 0x75, 0x6e, 0x63, 0x74, 0x69, 0x6f, 
+0x6e, 0x20, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x73, 0x0d, 0x0a, 0x09, 0x09, 0x62, 0x61, 
+0x72, 0x72, 0x69, 0x65, 0x72, 0x28, 0x43, 0x4c, 0x4b, 0x5f, 0x4c, 0x4f, 0x43, 0x41, 0x4c, 
+0x5f, 0x4d, 0x45, 0x4d, 0x5f, 0x46, 0x45, 0x4e, 0x43, 0x45, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 
+0x0a, 0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x76, 0x61, 0x6c, 0x75, 0x65, 
+0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x76, 0x6f, 0x69, 0x64, 0x20, 0x6b, 0x65, 
+0x72, 0x6e, 0x65, 0x6c, 0x20, 0x49, 0x6e, 0x63, 0x6c, 0x75, 0x73, 0x69, 0x76, 0x65, 0x53, 
+0x63, 0x61, 0x6e, 0x52, 0x65, 0x64, 0x75, 0x63, 0x65, 0x54, 0x69, 0x6c, 0x65, 0x73, 0x28, 
+0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x2a, 0x20, 0x74, 0x65, 0x6d, 
+0x70, 0x2c, 0x20, 0x67, 0x6c, 0x6f, 0x62, 0x61, 0x6c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x2a, 
+0x20, 0x61, 0x72, 0x72, 0x61, 0x79, 0x2c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 
+0x73, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x74, 0x69, 
+0x6c, 0x65, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x67, 0x6c, 0x6f, 0x62, 0x61, 0x6c, 0x20, 
+0x75, 0x69, 0x6e, 0x74, 0x2a, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x53, 0x75, 0x6d, 0x73, 0x29, 
+0x0d, 0x0a, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 
+0x74, 0x69, 0x6c, 0x65, 0x42, 0x65, 0x67, 0x69, 0x6e, 0x20, 0x3d, 0x20, 0x67, 0x65, 0x74, 
+0x5f, 0x67, 0x72, 0x6f, 0x75, 0x70, 0x5f, 0x69, 0x64, 0x28, 0x30, 0x29, 0x20, 0x2a, 0x20, 
+0x74, 0x69, 0x6c, 0x65, 0x53, 0x69, 0x7a, 0x65, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 
+0x6e, 0x74, 0x36, 0x34, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x45, 0x6e, 0x64, 0x20, 0x3d, 0x20, 
+0x6d, 0x69, 0x6e, 0x28, 0x74, 0x69, 0x6c, 0x65, 0x42, 0x65, 0x67, 0x69, 0x6e, 0x20, 0x2b, 
+0x20, 0x74, 0x69, 0x6c, 0x65, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x73, 0x69, 0x7a, 0x65, 
+0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x20, 0x73, 0x75, 
+0x6d, 0x20, 0x3d, 0x20, 0x30, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 
+0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x69, 0x20, 0x3d, 0x20, 0x74, 0x69, 0x6c, 0x65, 
+0x42, 0x65, 0x67, 0x69, 0x6e, 0x20, 0x2b, 0x20, 0x67, 0x65, 0x74, 0x5f, 0x6c, 0x6f, 0x63, 
+0x61, 0x6c, 0x5f, 0x69, 0x64, 0x28, 0x30, 0x29, 0x3b, 0x20, 0x69, 0x20, 0x3c, 0x20, 0x74, 
+0x69, 0x6c, 0x65, 0x45, 0x6e, 0x64, 0x3b, 0x20, 0x69, 0x20, 0x2b, 0x3d, 0x20, 0x67, 0x65, 
+0x74, 0x5f, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x5f, 0x73, 0x69, 0x7a, 0x65, 0x28, 0x30, 0x29, 
+0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x73, 0x75, 0x6d, 0x20, 0x2b, 0x3d, 0x20, 0x61, 0x72, 
+0x72, 0x61, 0x79, 0x5b, 0x69, 0x5d, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 
+0x6e, 0x74, 0x20, 0x74, 0x6f, 0x74, 0x61, 0x6c, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x57, 0x6f, 
+0x72, 0x6b, 0x47, 0x72, 0x6f, 0x75, 0x70, 0x49, 0x6e, 0x63, 0x6c, 0x75, 0x73, 0x69, 0x76, 
+0x65, 0x53, 0x63, 0x61, 0x6e, 0x28, 0x74, 0x65, 0x6d, 0x70, 0x2c, 0x20, 0x73, 0x75, 0x6d, 
+0x2c, 0x20, 0x26, 0x74, 0x6f, 0x74, 0x61, 0x6c, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 
+0x09, 0x69, 0x66, 0x20, 0x28, 0x67, 0x65, 0x74, 0x5f, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x5f, 
+0x69, 0x64, 0x28, 0x30, 0x29, 0x20, 0x3d, 0x3d, 0x20, 0x30, 0x29, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x74, 0x69, 0x6c, 0x65, 0x53, 0x75, 0x6d, 0x73, 0x5b, 0x67, 0x65, 0x74, 0x5f, 0x67, 
+0x72, 0x6f, 0x75, 0x70, 0x5f, 0x69, 0x64, 0x28, 0x30, 0x29, 0x5d, 0x20, 0x3d, 0x20, 0x74, 
+0x6f, 0x74, 0x61, 0x6c, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x2f, 0x2f, 0x4c, 
+0x61, 0x75, 0x6e, 0x63, 0x68, 0x65, 0x64, 0x20, 0x77, 0x69, 0x74, 0x68, 0x20, 0x61, 0x20, 
+0x73, 0x69, 0x6e, 0x67, 0x6c, 0x65, 0x20, 0x77, 0x6f, 0x72, 0x6b, 0x20, 0x67, 0x72, 0x6f, 
+0x75, 0x70, 0x2c, 0x20, 0x72, 0x65, 0x70, 0x6c, 0x61, 0x63, 0x65, 0x73, 0x20, 0x74, 0x68, 
+0x65, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x20, 0x73, 0x75, 0x6d, 0x73, 0x20, 0x77, 0x69, 0x74, 
+0x68, 0x20, 0x74, 0x68, 0x65, 0x20, 0x73, 0x75, 0x6d, 0x73, 0x20, 0x6f, 0x66, 0x20, 0x74, 
+0x68, 0x65, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x73, 0x20, 0x62, 0x65, 0x66, 0x6f, 0x72, 0x65, 
+0x20, 0x74, 0x68, 0x65, 0x6d, 0x0d, 0x0a, 0x09, 0x76, 0x6f, 0x69, 0x64, 0x20, 0x6b, 0x65, 
+0x72, 0x6e, 0x65, 0x6c, 0x20, 0x49, 0x6e, 0x63, 0x6c, 0x75, 0x73, 0x69, 0x76, 0x65, 0x53, 
+0x63, 0x61, 0x6e, 0x54, 0x69, 0x6c, 0x65, 0x53, 0x75, 0x6d, 0x73, 0x28, 0x6c, 0x6f, 0x63, 
+0x61, 0x6c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x2a, 0x20, 0x74, 0x65, 0x6d, 0x70, 0x2c, 0x20, 
+0x67, 0x6c, 0x6f, 0x62, 0x61, 0x6c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x2a, 0x20, 0x74, 0x69, 
+0x6c, 0x65, 0x53, 0x75, 0x6d, 0x73, 0x2c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 
+0x74, 0x69, 0x6c, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x29, 0x0d, 0x0a, 0x09, 0x7b, 0x0d, 
+0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x20, 0x63, 0x61, 0x72, 0x72, 0x79, 0x20, 0x3d, 
+0x20, 0x30, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x75, 0x69, 0x6e, 
+0x74, 0x36, 0x34, 0x20, 0x63, 0x68, 0x75, 0x6e, 0x6b, 0x42, 0x65, 0x67, 0x69, 0x6e, 0x20, 
+0x3d, 0x20, 0x30, 0x3b, 0x20, 0x63, 0x68, 0x75, 0x6e, 0x6b, 0x42, 0x65, 0x67, 0x69, 0x6e, 
+0x20, 0x3c, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x3b, 0x20, 0x63, 
+0x68, 0x75, 0x6e, 0x6b, 0x42, 0x65, 0x67, 0x69, 0x6e, 0x20, 0x2b, 0x3d, 0x20, 0x67, 0x65, 
+0x74, 0x5f, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x5f, 0x73, 0x69, 0x7a, 0x65, 0x28, 0x30, 0x29, 
+0x29, 0x0d, 0x0a, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 
+0x36, 0x34, 0x20, 0x69, 0x20, 0x3d, 0x20, 0x63, 0x68, 0x75, 0x6e, 0x6b, 0x42, 0x65, 0x67, 
+0x69, 0x6e, 0x20, 0x2b, 0x20, 0x67, 0x65, 0x74, 0x5f, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x5f, 
+0x69, 0x64, 0x28, 0x30, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 
+0x20, 0x76, 0x61, 0x6c, 0x75, 0x65, 0x20, 0x3d, 0x20, 0x69, 0x20, 0x3c, 0x20, 0x74, 0x69, 
+0x6c, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x20, 0x3f, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x53, 
+0x75, 0x6d, 0x73, 0x5b, 0x69, 0x5d, 0x20, 0x3a, 0x20, 0x30, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x20, 0x74, 0x6f, 0x74, 0x61, 0x6c, 0x3b, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x20, 0x73, 0x75, 0x6d, 0x20, 0x3d, 0x20, 
+0x57, 0x6f, 0x72, 0x6b, 0x47, 0x72, 0x6f, 0x75, 0x70, 0x49, 0x6e, 0x63, 0x6c, 0x75, 0x73, 
+0x69, 0x76, 0x65, 0x53, 0x63, 0x61, 0x6e, 0x28, 0x74, 0x65, 0x6d, 0x70, 0x2c, 0x20, 0x76, 
+0x61, 0x6c, 0x75, 0x65, 0x2c, 0x20, 0x26, 0x74, 0x6f, 0x74, 0x61, 0x6c, 0x29, 0x3b, 0x0d, 
+0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x69, 0x20, 0x3c, 0x20, 0x74, 
+0x69, 0x6c, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x74, 0x69, 0x6c, 0x65, 0x53, 0x75, 0x6d, 0x73, 0x5b, 0x69, 0x5d, 0x20, 0x3d, 0x20, 0x63, 
+0x61, 0x72, 0x72, 0x79, 0x20, 0x2b, 0x20, 0x73, 0x75, 0x6d, 0x20, 0x2d, 0x20, 0x76, 0x61, 
+0x6c, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x63, 0x61, 0x72, 0x72, 
+0x79, 0x20, 0x2b, 0x3d, 0x20, 0x74, 0x6f, 0x74, 0x61, 0x6c, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x7d, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x76, 0x6f, 0x69, 0x64, 0x20, 0x6b, 0x65, 
+0x72, 0x6e, 0x65, 0x6c, 0x20, 0x49, 0x6e, 0x63, 0x6c, 0x75, 0x73, 0x69, 0x76, 0x65, 0x53, 
+0x63, 0x61, 0x6e, 0x54, 0x69, 0x6c, 0x65, 0x73, 0x28, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x20, 
+0x75, 0x69, 0x6e, 0x74, 0x2a, 0x20, 0x74, 0x65, 0x6d, 0x70, 0x2c, 0x20, 0x67, 0x6c, 0x6f, 
+0x62, 0x61, 0x6c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x2a, 0x20, 0x61, 0x72, 0x72, 0x61, 0x79, 
+0x2c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x73, 0x69, 0x7a, 0x65, 0x2c, 0x20, 
+0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x53, 0x69, 0x7a, 0x65, 
+0x2c, 0x20, 0x67, 0x6c, 0x6f, 0x62, 0x61, 0x6c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x2a, 0x20, 
+0x74, 0x69, 0x6c, 0x65, 0x53, 0x75, 0x6d, 0x73, 0x29, 0x0d, 0x0a, 0x09, 0x7b, 0x0d, 0x0a, 
+0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x42, 0x65, 
+0x67, 0x69, 0x6e, 0x20, 0x3d, 0x20, 0x67, 0x65, 0x74, 0x5f, 0x67, 0x72, 0x6f, 0x75, 0x70, 
+0x5f, 0x69, 0x64, 0x28, 0x30, 0x29, 0x20, 0x2a, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x53, 0x69, 
+0x7a, 0x65, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x74, 
+0x69, 0x6c, 0x65, 0x45, 0x6e, 0x64, 0x20, 0x3d, 0x20, 0x6d, 0x69, 0x6e, 0x28, 0x74, 0x69, 
+0x6c, 0x65, 0x42, 0x65, 0x67, 0x69, 0x6e, 0x20, 0x2b, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x53, 
+0x69, 0x7a, 0x65, 0x2c, 0x20, 0x73, 0x69, 0x7a, 0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 
+0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x20, 0x63, 0x61, 0x72, 0x72, 0x79, 0x20, 0x3d, 0x20, 
+0x74, 0x69, 0x6c, 0x65, 0x53, 0x75, 0x6d, 0x73, 0x5b, 0x67, 0x65, 0x74, 0x5f, 0x67, 0x72, 
+0x6f, 0x75, 0x70, 0x5f, 0x69, 0x64, 0x28, 0x30, 0x29, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x66, 0x6f, 0x72, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x63, 0x68, 0x75, 
+0x6e, 0x6b, 0x42, 0x65, 0x67, 0x69, 0x6e, 0x20, 0x3d, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x42, 
+0x65, 0x67, 0x69, 0x6e, 0x3b, 0x20, 0x63, 0x68, 0x75, 0x6e, 0x6b, 0x42, 0x65, 0x67, 0x69, 
+0x6e, 0x20, 0x3c, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x45, 0x6e, 0x64, 0x3b, 0x20, 0x63, 0x68, 
+0x75, 0x6e, 0x6b, 0x42, 0x65, 0x67, 0x69, 0x6e, 0x20, 0x2b, 0x3d, 0x20, 0x67, 0x65, 0x74, 
+0x5f, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x5f, 0x73, 0x69, 0x7a, 0x65, 0x28, 0x30, 0x29, 0x29, 
+0x0d, 0x0a, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 
+0x34, 0x20, 0x69, 0x20, 0x3d, 0x20, 0x63, 0x68, 0x75, 0x6e, 0x6b, 0x42, 0x65, 0x67, 0x69, 
+0x6e, 0x20, 0x2b, 0x20, 0x67, 0x65, 0x74, 0x5f, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x5f, 0x69, 
+0x64, 0x28, 0x30, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x20, 
+0x76, 0x61, 0x6c, 0x75, 0x65, 0x20, 0x3d, 0x20, 0x69, 0x20, 0x3c, 0x20, 0x74, 0x69, 0x6c, 
+0x65, 0x45, 0x6e, 0x64, 0x20, 0x3f, 0x20, 0x61, 0x72, 0x72, 0x61, 0x79, 0x5b, 0x69, 0x5d, 
+0x20, 0x3a, 0x20, 0x30, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 
+0x74, 0x20, 0x74, 0x6f, 0x74, 0x61, 0x6c, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x75, 0x69, 
+0x6e, 0x74, 0x20, 0x73, 0x75, 0x6d, 0x20, 0x3d, 0x20, 0x57, 0x6f, 0x72, 0x6b, 0x47, 0x72, 
+0x6f, 0x75, 0x70, 0x49, 0x6e, 0x63, 0x6c, 0x75, 0x73, 0x69, 0x76, 0x65, 0x53, 0x63, 0x61, 
+0x6e, 0x28, 0x74, 0x65, 0x6d, 0x70, 0x2c, 0x20, 0x76, 0x61, 0x6c, 0x75, 0x65, 0x2c, 0x20, 
+0x26, 0x74, 0x6f, 0x74, 0x61, 0x6c, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x69, 0x66, 0x20, 0x28, 0x69, 0x20, 0x3c, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x45, 0x6e, 0x64, 
+0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x61, 0x72, 0x72, 0x61, 0x79, 0x5b, 0x69, 0x5d, 
+0x20, 0x3d, 0x20, 0x63, 0x61, 0x72, 0x72, 0x79, 0x20, 0x2b, 0x20, 0x73, 0x75, 0x6d, 0x3b, 
+0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x63, 0x61, 0x72, 0x72, 0x79, 0x20, 0x2b, 0x3d, 
+0x20, 0x74, 0x6f, 0x74, 0x61, 0x6c, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 
+0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x2f, 0x2a, 0x0d, 0x0a, 0x09, 0x09, 0x53, 0x74, 0x61, 
+0x62, 0x6c, 0x65, 0x20, 0x4c, 0x53, 0x44, 0x20, 0x72, 0x61, 0x64, 0x69, 0x78, 0x20, 0x73, 
+0x6f, 0x72, 0x74, 0x20, 0x6f, 0x66, 0x20, 0x33, 0x32, 0x20, 0x62, 0x69, 0x74, 0x20, 0x6b, 
+0x65, 0x79, 0x73, 0x20, 0x77, 0x69, 0x74, 0x68, 0x20, 0x33, 0x32, 0x20, 0x62, 0x69, 0x74, 
+0x20, 0x76, 0x61, 0x6c, 0x75, 0x65, 0x73, 0x2c, 0x20, 0x34, 0x20, 0x62, 0x69, 0x74, 0x73, 
+0x20, 0x6f, 0x66, 0x20, 0x74, 0x68, 0x65, 0x20, 0x6b, 0x65, 0x79, 0x73, 0x20, 0x70, 0x65, 
+0x72, 0x20, 0x70, 0x61, 0x73, 0x73, 0x2e, 0x20, 0x54, 0x68, 0x65, 0x20, 0x61, 0x72, 0x72, 
+0x61, 0x79, 0x20, 0x69, 0x73, 0x20, 0x73, 0x70, 0x6c, 0x69, 0x74, 0x20, 0x69, 0x6e, 0x74, 
+0x6f, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x73, 0x0d, 0x0a, 0x09, 0x09, 0x6c, 0x69, 0x6b, 0x65, 
+0x20, 0x66, 0x6f, 0x72, 0x20, 0x74, 0x68, 0x65, 0x20, 0x72, 0x65, 0x64, 0x75, 0x63, 0x65, 
+0x2d, 0x74, 0x68, 0x65, 0x6e, 0x2d, 0x73, 0x63, 0x61, 0x6e, 0x20, 0x61, 0x62, 0x6f, 0x76, 
+0x65, 0x2e, 0x20, 0x52, 0x61, 0x64, 0x69, 0x78, 0x53, 0x6f, 0x72, 0x74, 0x48, 0x69, 0x73, 
+0x74, 0x6f, 0x67, 0x72, 0x61, 0x6d, 0x20, 0x63, 0x6f, 0x75, 0x6e, 0x74, 0x73, 0x20, 0x74, 
+0x68, 0x65, 0x20, 0x64, 0x69, 0x67, 0x69, 0x74, 0x73, 0x20, 0x6f, 0x66, 0x20, 0x65, 0x76, 
+0x65, 0x72, 0x79, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x20, 0x69, 0x6e, 0x74, 0x6f, 0x20, 0x27, 
+0x68, 0x69, 0x73, 0x74, 0x6f, 0x67, 0x72, 0x61, 0x6d, 0x27, 0x20, 0x64, 0x69, 0x67, 0x69, 
+0x74, 0x0d, 0x0a, 0x09, 0x09, 0x6d, 0x61, 0x6a, 0x6f, 0x72, 0x2c, 0x20, 0x73, 0x6f, 0x20, 
+0x74, 0x68, 0x61, 0x74, 0x20, 0x69, 0x74, 0x73, 0x20, 0x69, 0x6e, 0x63, 0x6c, 0x75, 0x73, 
+0x69, 0x76, 0x65, 0x20, 0x73, 0x63, 0x61, 0x6e, 0x20, 0x65, 0x6e, 0x64, 0x73, 0x20, 0x72, 
+0x69, 0x67, 0x68, 0x74, 0x20, 0x62, 0x65, 0x66, 0x6f, 0x72, 0x65, 0x20, 0x77, 0x68, 0x65, 
+0x72, 0x65, 0x20, 0x74, 0x68, 0x65, 0x20, 0x65, 0x6c, 0x65, 0x6d, 0x65, 0x6e, 0x74, 0x73, 
+0x20, 0x6f, 0x66, 0x20, 0x74, 0x68, 0x65, 0x20, 0x6e, 0x65, 0x78, 0x74, 0x20, 0x64, 0x69, 
+0x67, 0x69, 0x74, 0x20, 0x61, 0x6e, 0x64, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x20, 0x67, 0x6f, 
+0x2e, 0x0d, 0x0a, 0x09, 0x09, 0x52, 0x61, 0x64, 0x69, 0x78, 0x53, 0x6f, 0x72, 0x74, 0x53, 
+0x63, 0x61, 0x74, 0x74, 0x65, 0x72, 0x20, 0x74, 0x68, 0x65, 0x6e, 0x20, 0x6d, 0x6f, 0x76, 
+0x65, 0x73, 0x20, 0x74, 0x68, 0x65, 0x20, 0x65, 0x6c, 0x65, 0x6d, 0x65, 0x6e, 0x74, 0x73, 
+0x20, 0x6f, 0x66, 0x20, 0x69, 0x74, 0x73, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x20, 0x61, 0x20, 
+0x63, 0x68, 0x75, 0x6e, 0x6b, 0x20, 0x6f, 0x66, 0x20, 0x6f, 0x6e, 0x65, 0x20, 0x65, 0x6c, 
+0x65, 0x6d, 0x65, 0x6e, 0x74, 0x20, 0x70, 0x65, 0x72, 0x20, 0x77, 0x6f, 0x72, 0x6b, 0x20, 
+0x69, 0x74, 0x65, 0x6d, 0x20, 0x61, 0x74, 0x20, 0x61, 0x20, 0x74, 0x69, 0x6d, 0x65, 0x2c, 
+0x20, 0x73, 0x6f, 0x72, 0x74, 0x69, 0x6e, 0x67, 0x0d, 0x0a, 0x09, 0x09, 0x74, 0x68, 0x65, 
+0x20, 0x63, 0x68, 0x75, 0x6e, 0x6b, 0x20, 0x62, 0x79, 0x20, 0x74, 0x68, 0x65, 0x20, 0x64, 
+0x69, 0x67, 0x69, 0x74, 0x20, 0x69, 0x6e, 0x20, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x20, 0x6d, 
+0x65, 0x6d, 0x6f, 0x72, 0x79, 0x20, 0x66, 0x69, 0x72, 0x73, 0x74, 0x2c, 0x20, 0x77, 0x69, 
+0x74, 0x68, 0x20, 0x61, 0x20, 0x73, 0x70, 0x6c, 0x69, 0x74, 0x20, 0x6f, 0x6e, 0x20, 0x65, 
+0x76, 0x65, 0x72, 0x79, 0x20, 0x62, 0x69, 0x74, 0x20, 0x6f, 0x66, 0x20, 0x74, 0x68, 0x65, 
+0x20, 0x64, 0x69, 0x67, 0x69, 0x74, 0x2e, 0x20, 0x54, 0x68, 0x65, 0x20, 0x72, 0x65, 0x73, 
+0x75, 0x6c, 0x74, 0x20, 0x64, 0x6f, 0x65, 0x73, 0x6e, 0x27, 0x74, 0x20, 0x64, 0x65, 0x70, 
+0x65, 0x6e, 0x64, 0x0d, 0x0a, 0x09, 0x09, 0x6f, 0x6e, 0x20, 0x68, 0x6f, 0x77, 0x20, 0x74, 
+0x68, 0x65, 0x20, 0x77, 0x6f, 0x72, 0x6b, 0x20, 0x69, 0x74, 0x65, 0x6d, 0x73, 0x20, 0x61, 
+0x72, 0x65, 0x20, 0x73, 0x63, 0x68, 0x65, 0x64, 0x75, 0x6c, 0x65, 0x64, 0x0d, 0x0a, 0x09, 
+0x2a, 0x2f, 0x0d, 0x0a, 0x23, 0x64, 0x65, 0x66, 0x69, 0x6e, 0x65, 0x20, 0x52, 0x41, 0x44, 
+0x49, 0x58, 0x5f, 0x53, 0x4f, 0x52, 0x54, 0x5f, 0x44, 0x49, 0x47, 0x49, 0x54, 0x5f, 0x42, 
+0x49, 0x54, 0x53, 0x20, 0x34, 0x0d, 0x0a, 0x23, 0x64, 0x65, 0x66, 0x69, 0x6e, 0x65, 0x20, 
+0x52, 0x41, 0x44, 0x49, 0x58, 0x5f, 0x53, 0x4f, 0x52, 0x54, 0x5f, 0x44, 0x49, 0x47, 0x49, 
+0x54, 0x5f, 0x43, 0x4f, 0x55, 0x4e, 0x54, 0x20, 0x28, 0x31, 0x20, 0x3c, 0x3c, 0x20, 0x52, 
+0x41, 0x44, 0x49, 0x58, 0x5f, 0x53, 0x4f, 0x52, 0x54, 0x5f, 0x44, 0x49, 0x47, 0x49, 0x54, 
+0x5f, 0x42, 0x49, 0x54, 0x53, 0x29, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x76, 0x6f, 0x69, 0x64, 
+0x20, 0x6b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x20, 0x52, 0x61, 0x64, 0x69, 0x78, 0x53, 0x6f, 
+0x72, 0x74, 0x48, 0x69, 0x73, 0x74, 0x6f, 0x67, 0x72, 0x61, 0x6d, 0x28, 0x67, 0x6c, 0x6f, 
+0x62, 0x61, 0x6c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x2a, 0x20, 0x6b, 0x65, 0x79, 0x73, 0x2c, 
+0x20, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x73, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x75, 
+0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x53, 0x69, 0x7a, 0x65, 0x2c, 
+0x20, 0x75, 0x69, 0x6e, 0x74, 0x20, 0x73, 0x68, 0x69, 0x66, 0x74, 0x2c, 0x20, 0x67, 0x6c, 
+0x6f, 0x62, 0x61, 0x6c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x2a, 0x20, 0x68, 0x69, 0x73, 0x74, 
+0x6f, 0x67, 0x72, 0x61, 0x6d, 0x29, 0x0d, 0x0a, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x6c, 
+0x6f, 0x63, 0x61, 0x6c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x20, 0x64, 0x69, 0x67, 0x69, 0x74, 
+0x43, 0x6f, 0x75, 0x6e, 0x74, 0x73, 0x5b, 0x52, 0x41, 0x44, 0x49, 0x58, 0x5f, 0x53, 0x4f, 
+0x52, 0x54, 0x5f, 0x44, 0x49, 0x47, 0x49, 0x54, 0x5f, 0x43, 0x4f, 0x55, 0x4e, 0x54, 0x5d, 
+0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x75, 0x69, 0x6e, 
+0x74, 0x20, 0x64, 0x69, 0x67, 0x69, 0x74, 0x20, 0x3d, 0x20, 0x67, 0x65, 0x74, 0x5f, 0x6c, 
+0x6f, 0x63, 0x61, 0x6c, 0x5f, 0x69, 0x64, 0x28, 0x30, 0x29, 0x3b, 0x20, 0x64, 0x69, 0x67, 
+0x69, 0x74, 0x20, 0x3c, 0x20, 0x52, 0x41, 0x44, 0x49, 0x58, 0x5f, 0x53, 0x4f, 0x52, 0x54, 
+0x5f, 0x44, 0x49, 0x47, 0x49, 0x54, 0x5f, 0x43, 0x4f, 0x55, 0x4e, 0x54, 0x3b, 0x20, 0x64, 
+0x69, 0x67, 0x69, 0x74, 0x20, 0x2b, 0x3d, 0x20, 0x67, 0x65, 0x74, 0x5f, 0x6c, 0x6f, 0x63, 
+0x61, 0x6c, 0x5f, 0x73, 0x69, 0x7a, 0x65, 0x28, 0x30, 0x29, 0x29, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x64, 0x69, 0x67, 0x69, 0x74, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x73, 0x5b, 0x64, 0x69, 
+0x67, 0x69, 0x74, 0x5d, 0x20, 0x3d, 0x20, 0x30, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 
+0x62, 0x61, 0x72, 0x72, 0x69, 0x65, 0x72, 0x28, 0x43, 0x4c, 0x4b, 0x5f, 0x4c, 0x4f, 0x43, 
+0x41, 0x4c, 0x5f, 0x4d, 0x45, 0x4d, 0x5f, 0x46, 0x45, 0x4e, 0x43, 0x45, 0x29, 0x3b, 0x0d, 
+0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x74, 0x69, 0x6c, 
+0x65, 0x42, 0x65, 0x67, 0x69, 0x6e, 0x20, 0x3d, 0x20, 0x67, 0x65, 0x74, 0x5f, 0x67, 0x72, 
+0x6f, 0x75, 0x70, 0x5f, 0x69, 0x64, 0x28, 0x30, 0x29, 0x20, 0x2a, 0x20, 0x74, 0x69, 0x6c, 
+0x65, 0x53, 0x69, 0x7a, 0x65, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 
+0x34, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x45, 0x6e, 0x64, 0x20, 0x3d, 0x20, 0x6d, 0x69, 0x6e, 
+0x28, 0x74, 0x69, 0x6c, 0x65, 0x42, 0x65, 0x67, 0x69, 0x6e, 0x20, 0x2b, 0x20, 0x74, 0x69, 
+0x6c, 0x65, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x73, 0x69, 0x7a, 0x65, 0x29, 0x3b, 0x0d, 
+0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x36, 
+0x34, 0x20, 0x69, 0x20, 0x3d, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x42, 0x65, 0x67, 0x69, 0x6e, 
+0x20, 0x2b, 0x20, 0x67, 0x65, 0x74, 0x5f, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x5f, 0x69, 0x64, 
+0x28, 0x30, 0x29, 0x3b, 0x20, 0x69, 0x20, 0x3c, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x45, 0x6e, 
+0x64, 0x3b, 0x20, 0x69, 0x20, 0x2b, 0x3d, 0x20, 0x67, 0x65, 0x74, 0x5f, 0x6c, 0x6f, 0x63, 
+0x61, 0x6c, 0x5f, 0x73, 0x69, 0x7a, 0x65, 0x28, 0x30, 0x29, 0x29, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x61, 0x74, 0x6f, 0x6d, 0x69, 0x63, 0x5f, 0x69, 0x6e, 0x63, 0x28, 0x64, 0x69, 0x67, 
+0x69, 0x74, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x73, 0x20, 0x2b, 0x20, 0x28, 0x28, 0x6b, 0x65, 
+0x79, 0x73, 0x5b, 0x69, 0x5d, 0x20, 0x3e, 0x3e, 0x20, 0x73, 0x68, 0x69, 0x66, 0x74, 0x29, 
+0x20, 0x26, 0x20, 0x28, 0x52, 0x41, 0x44, 0x49, 0x58, 0x5f, 0x53, 0x4f, 0x52, 0x54, 0x5f, 
+0x44, 0x49, 0x47, 0x49, 0x54, 0x5f, 0x43, 0x4f, 0x55, 0x4e, 0x54, 0x20, 0x2d, 0x20, 0x31, 
+0x29, 0x29, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x62, 0x61, 0x72, 0x72, 0x69, 
+0x65, 0x72, 0x28, 0x43, 0x4c, 0x4b, 0x5f, 0x4c, 0x4f, 0x43, 0x41, 0x4c, 0x5f, 0x4d, 0x45, 
+0x4d, 0x5f, 0x46, 0x45, 0x4e, 0x43, 0x45, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 
+0x66, 0x6f, 0x72, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x20, 0x64, 0x69, 0x67, 0x69, 0x74, 
+0x20, 0x3d, 0x20, 0x67, 0x65, 0x74, 0x5f, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x5f, 0x69, 0x64, 
+0x28, 0x30, 0x29, 0x3b, 0x20, 0x64, 0x69, 0x67, 0x69, 0x74, 0x20, 0x3c, 0x20, 0x52, 0x41, 
+0x44, 0x49, 0x58, 0x5f, 0x53, 0x4f, 0x52, 0x54, 0x5f, 0x44, 0x49, 0x47, 0x49, 0x54, 0x5f, 
+0x43, 0x4f, 0x55, 0x4e, 0x54, 0x3b, 0x20, 0x64, 0x69, 0x67, 0x69, 0x74, 0x20, 0x2b, 0x3d, 
+0x20, 0x67, 0x65, 0x74, 0x5f, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x5f, 0x73, 0x69, 0x7a, 0x65, 
+0x28, 0x30, 0x29, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x68, 0x69, 0x73, 0x74, 0x6f, 0x67, 
+0x72, 0x61, 0x6d, 0x5b, 0x64, 0x69, 0x67, 0x69, 0x74, 0x20, 0x2a, 0x20, 0x67, 0x65, 0x74, 
+0x5f, 0x6e, 0x75, 0x6d, 0x5f, 0x67, 0x72, 0x6f, 0x75, 0x70, 0x73, 0x28, 0x30, 0x29, 0x20, 
+0x2b, 0x20, 0x67, 0x65, 0x74, 0x5f, 0x67, 0x72, 0x6f, 0x75, 0x70, 0x5f, 0x69, 0x64, 0x28, 
+0x30, 0x29, 0x5d, 0x20, 0x3d, 0x20, 0x64, 0x69, 0x67, 0x69, 0x74, 0x43, 0x6f, 0x75, 0x6e, 
+0x74, 0x73, 0x5b, 0x64, 0x69, 0x67, 0x69, 0x74, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 
+0x0a, 0x09, 0x2f, 0x2f, 0x27, 0x68, 0x69, 0x73, 0x74, 0x6f, 0x67, 0x72, 0x61, 0x6d, 0x27, 
+0x20, 0x6d, 0x75, 0x73, 0x74, 0x20, 0x62, 0x65, 0x20, 0x73, 0x63, 0x61, 0x6e, 0x6e, 0x65, 
+0x64, 0x2c, 0x20, 0x27, 0x74, 0x65, 0x6d, 0x70, 0x53, 0x63, 0x61, 0x6e, 0x27, 0x2c, 0x20, 
+0x27, 0x74, 0x65, 0x6d, 0x70, 0x4b, 0x65, 0x79, 0x73, 0x27, 0x20, 0x61, 0x6e, 0x64, 0x20, 
+0x27, 0x74, 0x65, 0x6d, 0x70, 0x56, 0x61, 0x6c, 0x75, 0x65, 0x73, 0x27, 0x20, 0x6d, 0x75, 
+0x73, 0x74, 0x20, 0x68, 0x6f, 0x6c, 0x64, 0x20, 0x67, 0x65, 0x74, 0x5f, 0x6c, 0x6f, 0x63, 
+0x61, 0x6c, 0x5f, 0x73, 0x69, 0x7a, 0x65, 0x28, 0x30, 0x29, 0x20, 0x76, 0x61, 0x6c, 0x75, 
+0x65, 0x73, 0x0d, 0x0a, 0x09, 0x76, 0x6f, 0x69, 0x64, 0x20, 0x6b, 0x65, 0x72, 0x6e, 0x65, 
+0x6c, 0x20, 0x52, 0x61, 0x64, 0x69, 0x78, 0x53, 0x6f, 0x72, 0x74, 0x53, 0x63, 0x61, 0x74, 
+0x74, 0x65, 0x72, 0x28, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x2a, 
+0x20, 0x74, 0x65, 0x6d, 0x70, 0x53, 0x63, 0x61, 0x6e, 0x2c, 0x20, 0x6c, 0x6f, 0x63, 0x61, 
+0x6c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x2a, 0x20, 0x74, 0x65, 0x6d, 0x70, 0x4b, 0x65, 0x79, 
+0x73, 0x2c, 0x20, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x2a, 0x20, 
+0x74, 0x65, 0x6d, 0x70, 0x56, 0x61, 0x6c, 0x75, 0x65, 0x73, 0x2c, 0x20, 0x67, 0x6c, 0x6f, 
+0x62, 0x61, 0x6c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x2a, 0x20, 0x6b, 0x65, 0x79, 0x73, 0x2c, 
+0x20, 0x67, 0x6c, 0x6f, 0x62, 0x61, 0x6c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x2a, 0x20, 0x76, 
+0x61, 0x6c, 0x75, 0x65, 0x73, 0x2c, 0x20, 0x67, 0x6c, 0x6f, 0x62, 0x61, 0x6c, 0x20, 0x75, 
+0x69, 0x6e, 0x74, 0x2a, 0x20, 0x6f, 0x75, 0x74, 0x4b, 0x65, 0x79, 0x73, 0x2c, 0x20, 0x67, 
+0x6c, 0x6f, 0x62, 0x61, 0x6c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x2a, 0x20, 0x6f, 0x75, 0x74, 
+0x56, 0x61, 0x6c, 0x75, 0x65, 0x73, 0x2c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 
+0x73, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x74, 0x69, 
+0x6c, 0x65, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x20, 0x73, 0x68, 
+0x69, 0x66, 0x74, 0x2c, 0x20, 0x67, 0x6c, 0x6f, 0x62, 0x61, 0x6c, 0x20, 0x75, 0x69, 0x6e, 
+0x74, 0x2a, 0x20, 0x68, 0x69, 0x73, 0x74, 0x6f, 0x67, 0x72, 0x61, 0x6d, 0x29, 0x0d, 0x0a, 
+0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x2f, 0x2f, 0x57, 0x68, 0x65, 0x72, 0x65, 0x20, 0x74, 
+0x68, 0x65, 0x20, 0x6e, 0x65, 0x78, 0x74, 0x20, 0x65, 0x6c, 0x65, 0x6d, 0x65, 0x6e, 0x74, 
+0x20, 0x6f, 0x66, 0x20, 0x65, 0x76, 0x65, 0x72, 0x79, 0x20, 0x64, 0x69, 0x67, 0x69, 0x74, 
+0x20, 0x6f, 0x66, 0x20, 0x74, 0x68, 0x65, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x20, 0x67, 0x6f, 
+0x65, 0x73, 0x0d, 0x0a, 0x09, 0x09, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x20, 0x75, 0x69, 0x6e, 
+0x74, 0x20, 0x64, 0x69, 0x67, 0x69, 0x74, 0x4f, 0x75, 0x74, 0x70, 0x75, 0x74, 0x49, 0x6e, 
+0x64, 0x69, 0x63, 0x65, 0x73, 0x5b, 0x52, 0x41, 0x44, 0x49, 0x58, 0x5f, 0x53, 0x4f, 0x52, 
+0x54, 0x5f, 0x44, 0x49, 0x47, 0x49, 0x54, 0x5f, 0x43, 0x4f, 0x55, 0x4e, 0x54, 0x5d, 0x3b, 
+0x0d, 0x0a, 0x09, 0x09, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x20, 
+0x63, 0x68, 0x75, 0x6e, 0x6b, 0x44, 0x69, 0x67, 0x69, 0x74, 0x43, 0x6f, 0x75, 0x6e, 0x74, 
+0x73, 0x5b, 0x52, 0x41, 0x44, 0x49, 0x58, 0x5f, 0x53, 0x4f, 0x52, 0x54, 0x5f, 0x44, 0x49, 
+0x47, 0x49, 0x54, 0x5f, 0x43, 0x4f, 0x55, 0x4e, 0x54, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x20, 0x63, 0x68, 0x75, 0x6e, 
+0x6b, 0x44, 0x69, 0x67, 0x69, 0x74, 0x42, 0x65, 0x67, 0x69, 0x6e, 0x73, 0x5b, 0x52, 0x41, 
+0x44, 0x49, 0x58, 0x5f, 0x53, 0x4f, 0x52, 0x54, 0x5f, 0x44, 0x49, 0x47, 0x49, 0x54, 0x5f, 
+0x43, 0x4f, 0x55, 0x4e, 0x54, 0x5d, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 
+0x6e, 0x74, 0x20, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x49, 0x44, 0x20, 0x3d, 0x20, 0x67, 0x65, 
+0x74, 0x5f, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x5f, 0x69, 0x64, 0x28, 0x30, 0x29, 0x3b, 0x0d, 
+0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x20, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x53, 0x69, 
+0x7a, 0x65, 0x20, 0x3d, 0x20, 0x67, 0x65, 0x74, 0x5f, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x5f, 
+0x73, 0x69, 0x7a, 0x65, 0x28, 0x30, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x66, 
+0x6f, 0x72, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x20, 0x64, 0x69, 0x67, 0x69, 0x74, 0x20, 
+0x3d, 0x20, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x49, 0x44, 0x3b, 0x20, 0x64, 0x69, 0x67, 0x69, 
+0x74, 0x20, 0x3c, 0x20, 0x52, 0x41, 0x44, 0x49, 0x58, 0x5f, 0x53, 0x4f, 0x52, 0x54, 0x5f, 
+0x44, 0x49, 0x47, 0x49, 0x54, 0x5f, 0x43, 0x4f, 0x55, 0x4e, 0x54, 0x3b, 0x20, 0x64, 0x69, 
+0x67, 0x69, 0x74, 0x20, 0x2b, 0x3d, 0x20, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x53, 0x69, 0x7a, 
+0x65, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 
+0x74, 0x20, 0x68, 0x69, 0x73, 0x74, 0x6f, 0x67, 0x72, 0x61, 0x6d, 0x49, 0x6e, 0x64, 0x65, 
+0x78, 0x20, 0x3d, 0x20, 0x64, 0x69, 0x67, 0x69, 0x74, 0x20, 0x2a, 0x20, 0x67, 0x65, 0x74, 
+0x5f, 0x6e, 0x75, 0x6d, 0x5f, 0x67, 0x72, 0x6f, 0x75, 0x70, 0x73, 0x28, 0x30, 0x29, 0x20, 
+0x2b, 0x20, 0x67, 0x65, 0x74, 0x5f, 0x67, 0x72, 0x6f, 0x75, 0x70, 0x5f, 0x69, 0x64, 0x28, 
+0x30, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x64, 0x69, 0x67, 0x69, 0x74, 0x4f, 0x75, 
+0x74, 0x70, 0x75, 0x74, 0x49, 0x6e, 0x64, 0x69, 0x63, 0x65, 0x73, 0x5b, 0x64, 0x69, 0x67, 
+0x69, 0x74, 0x5d, 0x20, 0x3d, 0x20, 0x68, 0x69, 0x73, 0x74, 0x6f, 0x67, 0x72, 0x61, 0x6d, 
+0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x3d, 0x20, 0x30, 0x20, 0x3f, 0x20, 0x30, 0x20, 
+0x3a, 0x20, 0x68, 0x69, 0x73, 0x74, 0x6f, 0x67, 0x72, 0x61, 0x6d, 0x5b, 0x68, 0x69, 0x73, 
+0x74, 0x6f, 0x67, 0x72, 0x61, 0x6d, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x2d, 0x20, 0x31, 
+0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 
+0x6e, 0x74, 0x36, 0x34, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x42, 0x65, 0x67, 0x69, 0x6e, 0x20, 
+0x3d, 0x20, 0x67, 0x65, 0x74, 0x5f, 0x67, 0x72, 0x6f, 0x75, 0x70, 0x5f, 0x69, 0x64, 0x28, 
+0x30, 0x29, 0x20, 0x2a, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x53, 0x69, 0x7a, 0x65, 0x3b, 0x0d, 
+0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x45, 
+0x6e, 0x64, 0x20, 0x3d, 0x20, 0x6d, 0x69, 0x6e, 0x28, 0x74, 0x69, 0x6c, 0x65, 0x42, 0x65, 
+0x67, 0x69, 0x6e, 0x20, 0x2b, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x53, 0x69, 0x7a, 0x65, 0x2c, 
+0x20, 0x73, 0x69, 0x7a, 0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6f, 
+0x72, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x63, 0x68, 0x75, 0x6e, 0x6b, 
+0x42, 0x65, 0x67, 0x69, 0x6e, 0x20, 0x3d, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x42, 0x65, 0x67, 
+0x69, 0x6e, 0x3b, 0x20, 0x63, 0x68, 0x75, 0x6e, 0x6b, 0x42, 0x65, 0x67, 0x69, 0x6e, 0x20, 
+0x3c, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x45, 0x6e, 0x64, 0x3b, 0x20, 0x63, 0x68, 0x75, 0x6e, 
+0x6b, 0x42, 0x65, 0x67, 0x69, 0x6e, 0x20, 0x2b, 0x3d, 0x20, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 
+0x53, 0x69, 0x7a, 0x65, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x75, 0x69, 0x6e, 0x74, 0x20, 0x63, 0x68, 0x75, 0x6e, 0x6b, 0x53, 0x69, 0x7a, 0x65, 0x20, 
+0x3d, 0x20, 0x6d, 0x69, 0x6e, 0x28, 0x74, 0x69, 0x6c, 0x65, 0x45, 0x6e, 0x64, 0x20, 0x2d, 
+0x20, 0x63, 0x68, 0x75, 0x6e, 0x6b, 0x42, 0x65, 0x67, 0x69, 0x6e, 0x2c, 0x20, 0x28, 0x75, 
+0x69, 0x6e, 0x74, 0x36, 0x34, 0x29, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x53, 0x69, 0x7a, 0x65, 
+0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x75, 
+0x69, 0x6e, 0x74, 0x20, 0x64, 0x69, 0x67, 0x69, 0x74, 0x20, 0x3d, 0x20, 0x6c, 0x6f, 0x63, 
+0x61, 0x6c, 0x49, 0x44, 0x3b, 0x20, 0x64, 0x69, 0x67, 0x69, 0x74, 0x20, 0x3c, 0x20, 0x52, 
+0x41, 0x44, 0x49, 0x58, 0x5f, 0x53, 0x4f, 0x52, 0x54, 0x5f, 0x44, 0x49, 0x47, 0x49, 0x54, 
+0x5f, 0x43, 0x4f, 0x55, 0x4e, 0x54, 0x3b, 0x20, 0x64, 0x69, 0x67, 0x69, 0x74, 0x20, 0x2b, 
+0x3d, 0x20, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x53, 0x69, 0x7a, 0x65, 0x29, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x63, 0x68, 0x75, 0x6e, 0x6b, 0x44, 0x69, 0x67, 0x69, 0x74, 0x43, 0x6f, 
+0x75, 0x6e, 0x74, 0x73, 0x5b, 0x64, 0x69, 0x67, 0x69, 0x74, 0x5d, 0x20, 0x3d, 0x20, 0x30, 
+0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x62, 0x61, 0x72, 0x72, 0x69, 0x65, 0x72, 
+0x28, 0x43, 0x4c, 0x4b, 0x5f, 0x4c, 0x4f, 0x43, 0x41, 0x4c, 0x5f, 0x4d, 0x45, 0x4d, 0x5f, 
+0x46, 0x45, 0x4e, 0x43, 0x45, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x2f, 
+0x2f, 0x54, 0x68, 0x65, 0x20, 0x77, 0x6f, 0x72, 0x6b, 0x20, 0x69, 0x74, 0x65, 0x6d, 0x73, 
+0x20, 0x70, 0x61, 0x73, 0x74, 0x20, 0x74, 0x68, 0x65, 0x20, 0x65, 0x6e, 0x64, 0x20, 0x67, 
+0x65, 0x74, 0x20, 0x74, 0x68, 0x65, 0x20, 0x6c, 0x61, 0x72, 0x67, 0x65, 0x73, 0x74, 0x20, 
+0x64, 0x69, 0x67, 0x69, 0x74, 0x2c, 0x20, 0x74, 0x68, 0x65, 0x79, 0x20, 0x73, 0x74, 0x61, 
+0x79, 0x20, 0x62, 0x65, 0x68, 0x69, 0x6e, 0x64, 0x20, 0x61, 0x6c, 0x6c, 0x20, 0x74, 0x68, 
+0x65, 0x20, 0x65, 0x6c, 0x65, 0x6d, 0x65, 0x6e, 0x74, 0x73, 0x20, 0x6f, 0x66, 0x20, 0x74, 
+0x68, 0x65, 0x20, 0x63, 0x68, 0x75, 0x6e, 0x6b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x62, 0x6f, 
+0x6f, 0x6c, 0x20, 0x76, 0x61, 0x6c, 0x69, 0x64, 0x20, 0x3d, 0x20, 0x6c, 0x6f, 0x63, 0x61, 
+0x6c, 0x49, 0x44, 0x20, 0x3c, 0x20, 0x63, 0x68, 0x75, 0x6e, 0x6b, 0x53, 0x69, 0x7a, 0x65, 
+0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x20, 0x6b, 0x65, 0x79, 0x20, 
+0x3d, 0x20, 0x76, 0x61, 0x6c, 0x69, 0x64, 0x20, 0x3f, 0x20, 0x6b, 0x65, 0x79, 0x73, 0x5b, 
+0x63, 0x68, 0x75, 0x6e, 0x6b, 0x42, 0x65, 0x67, 0x69, 0x6e, 0x20, 0x2b, 0x20, 0x6c, 0x6f, 
+0x63, 0x61, 0x6c, 0x49, 0x44, 0x5d, 0x20, 0x3a, 0x20, 0x55, 0x49, 0x4e, 0x54, 0x5f, 0x4d, 
+0x41, 0x58, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x20, 0x76, 0x61, 
+0x6c, 0x75, 0x65, 0x20, 0x3d, 0x20, 0x76, 0x61, 0x6c, 0x69, 0x64, 0x20, 0x3f, 0x20, 0x76, 
+0x61, 0x6c, 0x75, 0x65, 0x73, 0x5b, 0x63, 0x68, 0x75, 0x6e, 0x6b, 0x42, 0x65, 0x67, 0x69, 
+0x6e, 0x20, 0x2b, 0x20, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x49, 0x44, 0x5d, 0x20, 0x3a, 0x20, 
+0x30, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x20, 0x64, 0x69, 0x67, 
+0x69, 0x74, 0x20, 0x3d, 0x20, 0x28, 0x6b, 0x65, 0x79, 0x20, 0x3e, 0x3e, 0x20, 0x73, 0x68, 
+0x69, 0x66, 0x74, 0x29, 0x20, 0x26, 0x20, 0x28, 0x52, 0x41, 0x44, 0x49, 0x58, 0x5f, 0x53, 
+0x4f, 0x52, 0x54, 0x5f, 0x44, 0x49, 0x47, 0x49, 0x54, 0x5f, 0x43, 0x4f, 0x55, 0x4e, 0x54, 
+0x20, 0x2d, 0x20, 0x31, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x69, 0x66, 
+0x20, 0x28, 0x76, 0x61, 0x6c, 0x69, 0x64, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x61, 
+0x74, 0x6f, 0x6d, 0x69, 0x63, 0x5f, 0x69, 0x6e, 0x63, 0x28, 0x63, 0x68, 0x75, 0x6e, 0x6b, 
+0x44, 0x69, 0x67, 0x69, 0x74, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x73, 0x20, 0x2b, 0x20, 0x64, 
+0x69, 0x67, 0x69, 0x74, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x2f, 0x2f, 
+0x45, 0x76, 0x65, 0x72, 0x79, 0x20, 0x73, 0x70, 0x6c, 0x69, 0x74, 0x20, 0x6d, 0x6f, 0x76, 
+0x65, 0x73, 0x20, 0x74, 0x68, 0x65, 0x20, 0x65, 0x6c, 0x65, 0x6d, 0x65, 0x6e, 0x74, 0x73, 
+0x20, 0x77, 0x69, 0x74, 0x68, 0x20, 0x74, 0x68, 0x65, 0x20, 0x62, 0x69, 0x74, 0x20, 0x63, 
+0x6c, 0x65, 0x61, 0x72, 0x65, 0x64, 0x20, 0x69, 0x6e, 0x20, 0x66, 0x72, 0x6f, 0x6e, 0x74, 
+0x20, 0x6f, 0x66, 0x20, 0x74, 0x68, 0x65, 0x20, 0x6f, 0x6e, 0x65, 0x73, 0x20, 0x77, 0x69, 
+0x74, 0x68, 0x20, 0x69, 0x74, 0x20, 0x73, 0x65, 0x74, 0x2c, 0x20, 0x6b, 0x65, 0x65, 0x70, 
+0x69, 0x6e, 0x67, 0x20, 0x74, 0x68, 0x65, 0x69, 0x72, 0x20, 0x6f, 0x72, 0x64, 0x65, 0x72, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x20, 
+0x62, 0x69, 0x74, 0x20, 0x3d, 0x20, 0x30, 0x3b, 0x20, 0x62, 0x69, 0x74, 0x20, 0x3c, 0x20, 
+0x52, 0x41, 0x44, 0x49, 0x58, 0x5f, 0x53, 0x4f, 0x52, 0x54, 0x5f, 0x44, 0x49, 0x47, 0x49, 
+0x54, 0x5f, 0x42, 0x49, 0x54, 0x53, 0x3b, 0x20, 0x2b, 0x2b, 0x62, 0x69, 0x74, 0x29, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 
+0x20, 0x69, 0x73, 0x5a, 0x65, 0x72, 0x6f, 0x20, 0x3d, 0x20, 0x28, 0x28, 0x64, 0x69, 0x67, 
+0x69, 0x74, 0x20, 0x3e, 0x3e, 0x20, 0x62, 0x69, 0x74, 0x29, 0x20, 0x26, 0x20, 0x31, 0x29, 
+0x20, 0x3d, 0x3d, 0x20, 0x30, 0x20, 0x3f, 0x20, 0x31, 0x20, 0x3a, 0x20, 0x30, 0x3b, 0x0d, 
+0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x20, 0x7a, 0x65, 0x72, 
+0x6f, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x75, 0x69, 
+0x6e, 0x74, 0x20, 0x7a, 0x65, 0x72, 0x6f, 0x73, 0x55, 0x70, 0x54, 0x6f, 0x54, 0x68, 0x69, 
+0x73, 0x20, 0x3d, 0x20, 0x57, 0x6f, 0x72, 0x6b, 0x47, 0x72, 0x6f, 0x75, 0x70, 0x49, 0x6e, 
+0x63, 0x6c, 0x75, 0x73, 0x69, 0x76, 0x65, 0x53, 0x63, 0x61, 0x6e, 0x28, 0x74, 0x65, 0x6d, 
+0x70, 0x53, 0x63, 0x61, 0x6e, 0x2c, 0x20, 0x69, 0x73, 0x5a, 0x65, 0x72, 0x6f, 0x2c, 0x20, 
+0x26, 0x7a, 0x65, 0x72, 0x6f, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x20, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 
+0x6e, 0x20, 0x3d, 0x20, 0x69, 0x73, 0x5a, 0x65, 0x72, 0x6f, 0x20, 0x3f, 0x20, 0x7a, 0x65, 
+0x72, 0x6f, 0x73, 0x55, 0x70, 0x54, 0x6f, 0x54, 0x68, 0x69, 0x73, 0x20, 0x2d, 0x20, 0x31, 
+0x20, 0x3a, 0x20, 0x7a, 0x65, 0x72, 0x6f, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x20, 0x2b, 0x20, 
+0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x49, 0x44, 0x20, 0x2d, 0x20, 0x7a, 0x65, 0x72, 0x6f, 0x73, 
+0x55, 0x70, 0x54, 0x6f, 0x54, 0x68, 0x69, 0x73, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x09, 0x74, 0x65, 0x6d, 0x70, 0x4b, 0x65, 0x79, 0x73, 0x5b, 0x70, 0x6f, 0x73, 0x69, 
+0x74, 0x69, 0x6f, 0x6e, 0x5d, 0x20, 0x3d, 0x20, 0x6b, 0x65, 0x79, 0x3b, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x74, 0x65, 0x6d, 0x70, 0x56, 0x61, 0x6c, 0x75, 0x65, 0x73, 0x5b, 0x70, 
+0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x5d, 0x20, 0x3d, 0x20, 0x76, 0x61, 0x6c, 0x75, 
+0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x62, 0x61, 0x72, 0x72, 0x69, 
+0x65, 0x72, 0x28, 0x43, 0x4c, 0x4b, 0x5f, 0x4c, 0x4f, 0x43, 0x41, 0x4c, 0x5f, 0x4d, 0x45, 
+0x4d, 0x5f, 0x46, 0x45, 0x4e, 0x43, 0x45, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x09, 0x6b, 0x65, 0x79, 0x20, 0x3d, 0x20, 0x74, 0x65, 0x6d, 0x70, 0x4b, 0x65, 0x79, 
+0x73, 0x5b, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x49, 0x44, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x09, 0x76, 0x61, 0x6c, 0x75, 0x65, 0x20, 0x3d, 0x20, 0x74, 0x65, 0x6d, 0x70, 0x56, 
+0x61, 0x6c, 0x75, 0x65, 0x73, 0x5b, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x49, 0x44, 0x5d, 0x3b, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x64, 0x69, 0x67, 0x69, 0x74, 0x20, 0x3d, 0x20, 0x28, 
+0x6b, 0x65, 0x79, 0x20, 0x3e, 0x3e, 0x20, 0x73, 0x68, 0x69, 0x66, 0x74, 0x29, 0x20, 0x26, 
+0x20, 0x28, 0x52, 0x41, 0x44, 0x49, 0x58, 0x5f, 0x53, 0x4f, 0x52, 0x54, 0x5f, 0x44, 0x49, 
+0x47, 0x49, 0x54, 0x5f, 0x43, 0x4f, 0x55, 0x4e, 0x54, 0x20, 0x2d, 0x20, 0x31, 0x29, 0x3b, 
+0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x62, 0x61, 0x72, 0x72, 0x69, 0x65, 0x72, 
+0x28, 0x43, 0x4c, 0x4b, 0x5f, 0x4c, 0x4f, 0x43, 0x41, 0x4c, 0x5f, 0x4d, 0x45, 0x4d, 0x5f, 
+0x46, 0x45, 0x4e, 0x43, 0x45, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x49, 
+0x44, 0x20, 0x3d, 0x3d, 0x20, 0x30, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x20, 0x73, 0x75, 0x6d, 0x20, 0x3d, 0x20, 
+0x30, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x75, 0x69, 
+0x6e, 0x74, 0x20, 0x69, 0x20, 0x3d, 0x20, 0x30, 0x3b, 0x20, 0x69, 0x20, 0x3c, 0x20, 0x52, 
+0x41, 0x44, 0x49, 0x58, 0x5f, 0x53, 0x4f, 0x52, 0x54, 0x5f, 0x44, 0x49, 0x47, 0x49, 0x54, 
+0x5f, 0x43, 0x4f, 0x55, 0x4e, 0x54, 0x3b, 0x20, 0x2b, 0x2b, 0x69, 0x29, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x63, 0x68, 0x75, 0x6e, 
+0x6b, 0x44, 0x69, 0x67, 0x69, 0x74, 0x42, 0x65, 0x67, 0x69, 0x6e, 0x73, 0x5b, 0x69, 0x5d, 
+0x20, 0x3d, 0x20, 0x73, 0x75, 0x6d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x73, 
+0x75, 0x6d, 0x20, 0x2b, 0x3d, 0x20, 0x63, 0x68, 0x75, 0x6e, 0x6b, 0x44, 0x69, 0x67, 0x69, 
+0x74, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x73, 0x5b, 0x69, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x62, 0x61, 0x72, 0x72, 0x69, 0x65, 0x72, 0x28, 0x43, 0x4c, 0x4b, 0x5f, 0x4c, 0x4f, 
+0x43, 0x41, 0x4c, 0x5f, 0x4d, 0x45, 0x4d, 0x5f, 0x46, 0x45, 0x4e, 0x43, 0x45, 0x29, 0x3b, 
+0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x6c, 0x6f, 0x63, 0x61, 
+0x6c, 0x49, 0x44, 0x20, 0x3c, 0x20, 0x63, 0x68, 0x75, 0x6e, 0x6b, 0x53, 0x69, 0x7a, 0x65, 
+0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x75, 0x69, 
+0x6e, 0x74, 0x20, 0x6f, 0x75, 0x74, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x64, 
+0x69, 0x67, 0x69, 0x74, 0x4f, 0x75, 0x74, 0x70, 0x75, 0x74, 0x49, 0x6e, 0x64, 0x69, 0x63, 
+0x65, 0x73, 0x5b, 0x64, 0x69, 0x67, 0x69, 0x74, 0x5d, 0x20, 0x2b, 0x20, 0x6c, 0x6f, 0x63, 
+0x61, 0x6c, 0x49, 0x44, 0x20, 0x2d, 0x20, 0x63, 0x68, 0x75, 0x6e, 0x6b, 0x44, 0x69, 0x67, 
+0x69, 0x74, 0x42, 0x65, 0x67, 0x69, 0x6e, 0x73, 0x5b, 0x64, 0x69, 0x67, 0x69, 0x74, 0x5d, 
+0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x6f, 0x75, 0x74, 0x4b, 0x65, 0x79, 0x73, 0x5b, 
+0x6f, 0x75, 0x74, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x20, 0x3d, 0x20, 0x6b, 0x65, 0x79, 
+0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x6f, 0x75, 0x74, 0x56, 0x61, 0x6c, 0x75, 0x65, 
+0x73, 0x5b, 0x6f, 0x75, 0x74, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x20, 0x3d, 0x20, 0x76, 
+0x61, 0x6c, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x62, 0x61, 0x72, 0x72, 0x69, 0x65, 0x72, 0x28, 0x43, 0x4c, 0x4b, 0x5f, 
+0x4c, 0x4f, 0x43, 0x41, 0x4c, 0x5f, 0x4d, 0x45, 0x4d, 0x5f, 0x46, 0x45, 0x4e, 0x43, 0x45, 
+0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x75, 
+0x69, 0x6e, 0x74, 0x20, 0x69, 0x20, 0x3d, 0x20, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x49, 0x44, 
+0x3b, 0x20, 0x69, 0x20, 0x3c, 0x20, 0x52, 0x41, 0x44, 0x49, 0x58, 0x5f, 0x53, 0x4f, 0x52, 
+0x54, 0x5f, 0x44, 0x49, 0x47, 0x49, 0x54, 0x5f, 0x43, 0x4f, 0x55, 0x4e, 0x54, 0x3b, 0x20, 
+0x69, 0x20, 0x2b, 0x3d, 0x20, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x53, 0x69, 0x7a, 0x65, 0x29, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x64, 0x69, 0x67, 0x69, 0x74, 0x4f, 0x75, 0x74, 0x70, 
+0x75, 0x74, 0x49, 0x6e, 0x64, 0x69, 0x63, 0x65, 0x73, 0x5b, 0x69, 0x5d, 0x20, 0x2b, 0x3d, 
+0x20, 0x63, 0x68, 0x75, 0x6e, 0x6b, 0x44, 0x69, 0x67, 0x69, 0x74, 0x43, 0x6f, 0x75, 0x6e, 
+0x74, 0x73, 0x5b, 0x69, 0x5d, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x62, 0x61, 
+0x72, 0x72, 0x69, 0x65, 0x72, 0x28, 0x43, 0x4c, 0x4b, 0x5f, 0x4c, 0x4f, 0x43, 0x41, 0x4c, 
+0x5f, 0x4d, 0x45, 0x4d, 0x5f, 0x46, 0x45, 0x4e, 0x43, 0x45, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 
+0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x2f, 0x2f, 0x54, 0x68, 0x65, 0x20, 
+0x72, 0x61, 0x64, 0x69, 0x78, 0x20, 0x73, 0x6f, 0x72, 0x74, 0x20, 0x6b, 0x65, 0x79, 0x73, 
+0x20, 0x6f, 0x66, 0x20, 0x74, 0x68, 0x65, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 
+0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x20, 0x61, 0x72, 0x65, 0x20, 
+0x74, 0x68, 0x65, 0x69, 0x72, 0x20, 0x68, 0x61, 0x73, 0x68, 0x65, 0x73, 0x2c, 0x20, 0x74, 
+0x68, 0x65, 0x20, 0x76, 0x61, 0x6c, 0x75, 0x65, 0x73, 0x20, 0x74, 0x68, 0x65, 0x69, 0x72, 
+0x20, 0x69, 0x6e, 0x64, 0x69, 0x63, 0x65, 0x73, 0x0d, 0x0a, 0x09, 0x76, 0x6f, 0x69, 0x64, 
+0x20, 0x6b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x20, 0x50, 0x72, 0x65, 0x70, 0x61, 0x72, 0x65, 
+0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x73, 0x53, 0x6f, 0x72, 0x74, 0x28, 0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 0x20, 
 0x53, 0x54, 0x52, 0x55, 0x43, 0x54, 0x20, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 
-0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x2a, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 
-0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x74, 0x72, 0x20, 0x3d, 0x20, 0x69, 0x6e, 
-0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x20, 0x2b, 0x20, 0x69, 0x6e, 0x64, 
-0x65, 0x78, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 
-0x20, 0x28, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x74, 0x72, 
-0x20, 0x3d, 0x3d, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
-0x6c, 0x65, 0x50, 0x74, 0x72, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
-0x63, 0x6f, 0x6e, 0x74, 0x69, 0x6e, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 
-0x09, 0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x64, 0x69, 0x72, 0x20, 0x3d, 
-0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 
-0x74, 0x72, 0x2d, 0x3e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x41, 0x6e, 0x64, 
-0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x2e, 0x78, 0x79, 0x7a, 0x28, 0x29, 0x20, 
-0x2d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 
-0x69, 0x6f, 0x6e, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6c, 0x6f, 
-0x61, 0x74, 0x20, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x20, 0x3d, 0x20, 0x64, 0x6f, 
-0x74, 0x28, 0x64, 0x69, 0x72, 0x2c, 0x20, 0x64, 0x69, 0x72, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 
-0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x64, 0x69, 0x73, 0x74, 
-0x53, 0x71, 0x72, 0x20, 0x3e, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 
-0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 
-0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x20, 0x2a, 0x20, 0x70, 0x61, 
-0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x73, 0x2c, 0x20, 0x67, 0x6c, 0x6f, 0x62, 0x61, 0x6c, 0x20, 0x75, 0x69, 0x6e, 
+0x74, 0x2a, 0x20, 0x6b, 0x65, 0x79, 0x73, 0x2c, 0x20, 0x67, 0x6c, 0x6f, 0x62, 0x61, 0x6c, 
+0x20, 0x75, 0x69, 0x6e, 0x74, 0x2a, 0x20, 0x76, 0x61, 0x6c, 0x75, 0x65, 0x73, 0x2c, 0x20, 
+0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x43, 0x6f, 0x75, 0x6e, 0x74, 0x29, 0x0d, 0x0a, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x53, 
+0x54, 0x4f, 0x50, 0x5f, 0x45, 0x58, 0x54, 0x45, 0x4e, 0x53, 0x49, 0x56, 0x45, 0x5f, 0x57, 
+0x4f, 0x52, 0x4b, 0x5f, 0x49, 0x54, 0x45, 0x4d, 0x53, 0x28, 0x70, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x29, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 
+0x75, 0x69, 0x6e, 0x74, 0x20, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x67, 0x65, 
+0x74, 0x5f, 0x67, 0x6c, 0x6f, 0x62, 0x61, 0x6c, 0x5f, 0x69, 0x64, 0x28, 0x30, 0x29, 0x3b, 
+0x0d, 0x0a, 0x09, 0x09, 0x6b, 0x65, 0x79, 0x73, 0x5b, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x5d, 
+0x20, 0x3d, 0x20, 0x61, 0x73, 0x5f, 0x75, 0x69, 0x6e, 0x74, 0x28, 0x70, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x73, 0x5b, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x2e, 0x76, 0x65, 
+0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x41, 0x6e, 0x64, 0x48, 0x61, 0x73, 0x68, 0x2e, 0x77, 
+0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x76, 0x61, 0x6c, 0x75, 0x65, 0x73, 0x5b, 0x69, 0x6e, 
+0x64, 0x65, 0x78, 0x5d, 0x20, 0x3d, 0x20, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x3b, 0x0d, 0x0a, 
+0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x2f, 0x2f, 0x4c, 0x61, 0x75, 0x6e, 0x63, 0x68, 0x65, 0x64, 
+0x20, 0x77, 0x69, 0x74, 0x68, 0x20, 0x6f, 0x6e, 0x65, 0x20, 0x77, 0x6f, 0x72, 0x6b, 0x20, 
+0x69, 0x74, 0x65, 0x6d, 0x20, 0x6d, 0x6f, 0x72, 0x65, 0x20, 0x74, 0x68, 0x61, 0x6e, 0x20, 
+0x74, 0x68, 0x65, 0x72, 0x65, 0x20, 0x61, 0x72, 0x65, 0x20, 0x6b, 0x65, 0x79, 0x73, 0x2e, 
+0x20, 0x45, 0x76, 0x65, 0x72, 0x79, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x20, 0x67, 
+0x65, 0x74, 0x73, 0x20, 0x74, 0x68, 0x65, 0x20, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x6f, 
+0x66, 0x20, 0x74, 0x68, 0x65, 0x20, 0x66, 0x69, 0x72, 0x73, 0x74, 0x20, 0x73, 0x6f, 0x72, 
+0x74, 0x65, 0x64, 0x20, 0x6b, 0x65, 0x79, 0x20, 0x74, 0x68, 0x61, 0x74, 0x0d, 0x0a, 0x09, 
+0x2f, 0x2f, 0x69, 0x73, 0x6e, 0x27, 0x74, 0x20, 0x73, 0x6d, 0x61, 0x6c, 0x6c, 0x65, 0x72, 
+0x20, 0x74, 0x68, 0x61, 0x6e, 0x20, 0x69, 0x74, 0x2c, 0x20, 0x6f, 0x72, 0x20, 0x74, 0x68, 
+0x65, 0x20, 0x6b, 0x65, 0x79, 0x20, 0x63, 0x6f, 0x75, 0x6e, 0x74, 0x0d, 0x0a, 0x09, 0x76, 
+0x6f, 0x69, 0x64, 0x20, 0x6b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x20, 0x46, 0x69, 0x6e, 0x69, 
+0x73, 0x68, 0x53, 0x6f, 0x72, 0x74, 0x65, 0x64, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 
+0x28, 0x67, 0x6c, 0x6f, 0x62, 0x61, 0x6c, 0x20, 0x48, 0x41, 0x53, 0x48, 0x5f, 0x54, 0x59, 
+0x50, 0x45, 0x2a, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 0x20, 0x75, 0x69, 
+0x6e, 0x74, 0x36, 0x34, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 
+0x65, 0x2c, 0x20, 0x67, 0x6c, 0x6f, 0x62, 0x61, 0x6c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x2a, 
+0x20, 0x73, 0x6f, 0x72, 0x74, 0x65, 0x64, 0x4b, 0x65, 0x79, 0x73, 0x2c, 0x20, 0x75, 0x69, 
+0x6e, 0x74, 0x36, 0x34, 0x20, 0x6b, 0x65, 0x79, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x29, 0x0d, 
+0x0a, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x53, 0x54, 0x4f, 0x50, 0x5f, 0x45, 0x58, 0x54, 
+0x45, 0x4e, 0x53, 0x49, 0x56, 0x45, 0x5f, 0x57, 0x4f, 0x52, 0x4b, 0x5f, 0x49, 0x54, 0x45, 
+0x4d, 0x53, 0x28, 0x6b, 0x65, 0x79, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x20, 0x2b, 0x20, 0x31, 
+0x29, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x20, 0x69, 0x6e, 0x64, 
+0x65, 0x78, 0x20, 0x3d, 0x20, 0x67, 0x65, 0x74, 0x5f, 0x67, 0x6c, 0x6f, 0x62, 0x61, 0x6c, 
+0x5f, 0x69, 0x64, 0x28, 0x30, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 
+0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x42, 0x65, 0x67, 0x69, 0x6e, 0x20, 0x3d, 0x20, 
+0x69, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x3d, 0x20, 0x30, 0x20, 0x3f, 0x20, 0x30, 0x20, 
+0x3a, 0x20, 0x73, 0x6f, 0x72, 0x74, 0x65, 0x64, 0x4b, 0x65, 0x79, 0x73, 0x5b, 0x69, 0x6e, 
+0x64, 0x65, 0x78, 0x20, 0x2d, 0x20, 0x31, 0x5d, 0x20, 0x2b, 0x20, 0x31, 0x3b, 0x0d, 0x0a, 
+0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x45, 0x6e, 
+0x64, 0x20, 0x3d, 0x20, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x3d, 0x20, 0x6b, 0x65, 
+0x79, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x20, 0x3f, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 
+0x70, 0x53, 0x69, 0x7a, 0x65, 0x20, 0x2b, 0x20, 0x31, 0x20, 0x3a, 0x20, 0x73, 0x6f, 0x72, 
+0x74, 0x65, 0x64, 0x4b, 0x65, 0x79, 0x73, 0x5b, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x20, 
+0x2b, 0x20, 0x31, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 
+0x75, 0x69, 0x6e, 0x74, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x20, 0x3d, 0x20, 0x62, 
+0x75, 0x63, 0x6b, 0x65, 0x74, 0x42, 0x65, 0x67, 0x69, 0x6e, 0x3b, 0x20, 0x62, 0x75, 0x63, 
+0x6b, 0x65, 0x74, 0x20, 0x3c, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x45, 0x6e, 0x64, 
+0x3b, 0x20, 0x2b, 0x2b, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x29, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x5b, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 
+0x5d, 0x20, 0x3d, 0x20, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 
+0x0a, 0x09, 0x2f, 0x2f, 0x4d, 0x6f, 0x76, 0x65, 0x73, 0x20, 0x74, 0x68, 0x65, 0x20, 0x70, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x20, 0x69, 0x6e, 0x74, 0x6f, 0x20, 0x74, 
+0x68, 0x65, 0x20, 0x6f, 0x72, 0x64, 0x65, 0x72, 0x20, 0x6f, 0x66, 0x20, 0x74, 0x68, 0x65, 
+0x20, 0x73, 0x6f, 0x72, 0x74, 0x65, 0x64, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x20, 0x6d, 0x61, 0x70, 0x2c, 0x20, 0x77, 0x68, 0x69, 0x63, 0x68, 0x20, 0x69, 0x73, 
+0x20, 0x74, 0x68, 0x65, 0x6e, 0x20, 0x72, 0x65, 0x73, 0x65, 0x74, 0x20, 0x74, 0x6f, 0x20, 
+0x74, 0x68, 0x65, 0x20, 0x69, 0x64, 0x65, 0x6e, 0x74, 0x69, 0x74, 0x79, 0x0d, 0x0a, 0x09, 
+0x76, 0x6f, 0x69, 0x64, 0x20, 0x6b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x20, 0x47, 0x61, 0x74, 
+0x68, 0x65, 0x72, 0x53, 0x6f, 0x72, 0x74, 0x65, 0x64, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 
+0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x28, 0x67, 0x6c, 0x6f, 0x62, 
+0x61, 0x6c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x4d, 0x61, 0x70, 0x2c, 0x20, 0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 
+0x20, 0x53, 0x54, 0x52, 0x55, 0x43, 0x54, 0x20, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x2a, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x20, 0x47, 0x4c, 0x4f, 0x42, 0x41, 0x4c, 0x20, 
+0x53, 0x54, 0x52, 0x55, 0x43, 0x54, 0x20, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x2a, 0x20, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 
+0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x29, 0x0d, 
+0x0a, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x53, 0x54, 0x4f, 0x50, 0x5f, 0x45, 0x58, 0x54, 
+0x45, 0x4e, 0x53, 0x49, 0x56, 0x45, 0x5f, 0x57, 0x4f, 0x52, 0x4b, 0x5f, 0x49, 0x54, 0x45, 
+0x4d, 0x53, 0x28, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x43, 0x6f, 0x75, 0x6e, 
+0x74, 0x29, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x20, 0x69, 0x6e, 
+0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x67, 0x65, 0x74, 0x5f, 0x67, 0x6c, 0x6f, 0x62, 0x61, 
+0x6c, 0x5f, 0x69, 0x64, 0x28, 0x30, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x6f, 0x75, 0x74, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x5b, 0x69, 0x6e, 0x64, 0x65, 0x78, 
+0x5d, 0x20, 0x3d, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 
+0x5b, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x70, 0x5b, 0x69, 0x6e, 
+0x64, 0x65, 0x78, 0x5d, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x70, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x4d, 0x61, 0x70, 0x5b, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x20, 0x3d, 
+0x20, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x23, 0x65, 
+0x6e, 0x64, 0x69, 0x66, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x76, 0x6f, 0x69, 0x64, 0x20, 0x4b, 
+0x45, 0x52, 0x4e, 0x45, 0x4c, 0x20, 0x50, 0x72, 0x65, 0x70, 0x61, 0x72, 0x65, 0x53, 0x74, 
+0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 
+0x73, 0x68, 0x4d, 0x61, 0x70, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x74, 0x68, 
+0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x2c, 0x20, 0x76, 0x6f, 0x6c, 0x61, 0x74, 0x69, 0x6c, 
+0x65, 0x20, 0x47, 0x4c, 0x4f, 0x42, 0x41, 0x4c, 0x20, 0x48, 0x41, 0x53, 0x48, 0x5f, 0x54, 
+0x59, 0x50, 0x45, 0x2a, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 0x20, 0x75, 
+0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 
+0x7a, 0x65, 0x2c, 0x20, 0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 0x20, 0x53, 0x54, 
+0x52, 0x55, 0x43, 0x54, 0x20, 0x53, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x2a, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x73, 0x2c, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x6d, 0x61, 0x78, 0x49, 0x6e, 
 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 
-0x63, 0x65, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 
-0x74, 0x69, 0x6e, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 
-0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x69, 0x73, 0x74, 0x20, 0x3d, 0x20, 0x73, 
-0x71, 0x72, 0x74, 0x28, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x29, 0x3b, 0x0d, 0x0a, 
-0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 
-0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x66, 0x6c, 0x75, 0x65, 0x6e, 
-0x63, 0x65, 0x53, 0x75, 0x6d, 0x20, 0x2b, 0x3d, 0x20, 0x53, 0x6d, 0x6f, 0x6f, 0x74, 0x68, 
-0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x44, 0x30, 0x28, 0x64, 0x69, 0x73, 
-0x74, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 
-0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 
-0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
-0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 
-0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 
-0x43, 0x6f, 0x75, 0x6e, 0x74, 0x20, 0x3d, 0x3d, 0x20, 0x30, 0x29, 0x0d, 0x0a, 0x09, 0x09, 
-0x09, 0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x74, 0x69, 0x6e, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 
-0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x2f, 0x2f, 0x43, 0x61, 0x6c, 0x63, 0x75, 0x6c, 
-0x61, 0x74, 0x69, 0x6e, 0x67, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x20, 0x70, 0x61, 
-0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x20, 0x70, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 
-0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x48, 0x61, 0x73, 
-0x68, 0x4d, 0x6f, 0x64, 0x20, 0x3d, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x48, 0x61, 0x73, 
-0x68, 0x20, 0x25, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x65, 0x2c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x70, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x29, 0x0d, 0x0a, 0x09, 0x7b, 0x0d, 
+0x0a, 0x09, 0x09, 0x53, 0x54, 0x4f, 0x50, 0x5f, 0x45, 0x58, 0x54, 0x45, 0x4e, 0x53, 0x49, 
+0x56, 0x45, 0x5f, 0x57, 0x4f, 0x52, 0x4b, 0x5f, 0x49, 0x54, 0x45, 0x4d, 0x53, 0x28, 0x70, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x29, 0x0d, 0x0a, 
+0x0d, 0x0a, 0x09, 0x09, 0x49, 0x4e, 0x49, 0x54, 0x49, 0x41, 0x4c, 0x49, 0x5a, 0x45, 0x5f, 
+0x54, 0x48, 0x52, 0x45, 0x41, 0x44, 0x5f, 0x49, 0x44, 0x28, 0x29, 0x3b, 0x09, 0x0d, 0x0a, 
+0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x70, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x20, 0x3d, 0x20, 0x47, 0x65, 0x74, 0x48, 
+0x61, 0x73, 0x68, 0x28, 0x47, 0x65, 0x74, 0x43, 0x65, 0x6c, 0x6c, 0x28, 0x69, 0x6e, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 
+0x49, 0x44, 0x5d, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x41, 0x6e, 0x64, 
+0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x2e, 0x78, 0x79, 0x7a, 0x28, 0x29, 0x2c, 
+0x20, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 
+0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x29, 0x20, 0x25, 0x20, 0x68, 0x61, 
+0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 
+0x09, 0x61, 0x74, 0x6f, 0x6d, 0x69, 0x63, 0x5f, 0x69, 0x6e, 0x63, 0x28, 0x68, 0x61, 0x73, 
+0x68, 0x4d, 0x61, 0x70, 0x20, 0x2b, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x48, 0x61, 0x73, 0x68, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x76, 0x6f, 
+0x69, 0x64, 0x20, 0x4b, 0x45, 0x52, 0x4e, 0x45, 0x4c, 0x20, 0x52, 0x65, 0x6f, 0x72, 0x64, 
+0x65, 0x72, 0x53, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x73, 0x41, 0x6e, 0x64, 0x46, 0x69, 0x6e, 0x69, 0x73, 0x68, 0x48, 0x61, 0x73, 0x68, 
+0x4d, 0x61, 0x70, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x74, 0x68, 0x72, 0x65, 
+0x61, 0x64, 0x49, 0x44, 0x2c, 0x20, 0x76, 0x6f, 0x6c, 0x61, 0x74, 0x69, 0x6c, 0x65, 0x20, 
+0x47, 0x4c, 0x4f, 0x42, 0x41, 0x4c, 0x20, 0x48, 0x41, 0x53, 0x48, 0x5f, 0x54, 0x59, 0x50, 
+0x45, 0x2a, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 0x20, 0x75, 0x69, 0x6e, 
+0x74, 0x36, 0x34, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 
+0x2c, 0x20, 0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 0x20, 0x53, 0x54, 0x52, 0x55, 
+0x43, 0x54, 0x20, 0x53, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x2a, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 
+0x2c, 0x20, 0x47, 0x4c, 0x4f, 0x42, 0x41, 0x4c, 0x20, 0x53, 0x54, 0x52, 0x55, 0x43, 0x54, 
+0x20, 0x53, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x2a, 0x20, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 
+0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 
+0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x2c, 
+0x20, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x29, 0x0d, 0x0a, 0x09, 0x7b, 0x0d, 0x0a, 0x0d, 0x0a, 
+0x09, 0x09, 0x53, 0x54, 0x4f, 0x50, 0x5f, 0x45, 0x58, 0x54, 0x45, 0x4e, 0x53, 0x49, 0x56, 
+0x45, 0x5f, 0x57, 0x4f, 0x52, 0x4b, 0x5f, 0x49, 0x54, 0x45, 0x4d, 0x53, 0x28, 0x70, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x29, 0x0d, 0x0a, 0x09, 
+0x09, 0x49, 0x4e, 0x49, 0x54, 0x49, 0x41, 0x4c, 0x49, 0x5a, 0x45, 0x5f, 0x54, 0x48, 0x52, 
+0x45, 0x41, 0x44, 0x5f, 0x49, 0x44, 0x28, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 
+0x73, 0x69, 0x7a, 0x65, 0x5f, 0x74, 0x20, 0x6f, 0x6c, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 
+0x20, 0x3d, 0x20, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x3b, 0x0d, 0x0a, 0x09, 
+0x09, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x70, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x20, 0x3d, 0x20, 0x47, 0x65, 0x74, 
+0x48, 0x61, 0x73, 0x68, 0x28, 0x47, 0x65, 0x74, 0x43, 0x65, 0x6c, 0x6c, 0x28, 0x69, 0x6e, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x5b, 0x6f, 0x6c, 0x64, 0x49, 0x6e, 
+0x64, 0x65, 0x78, 0x5d, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x41, 0x6e, 
+0x64, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x2e, 0x78, 0x79, 0x7a, 0x28, 0x29, 
+0x2c, 0x20, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 
+0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x29, 0x20, 0x25, 0x20, 0x68, 
+0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 
+0x09, 0x09, 0x73, 0x69, 0x7a, 0x65, 0x5f, 0x74, 0x20, 0x6e, 0x65, 0x77, 0x49, 0x6e, 0x64, 
+0x65, 0x78, 0x20, 0x3d, 0x20, 0x28, 0x73, 0x69, 0x7a, 0x65, 0x5f, 0x74, 0x29, 0x28, 0x61, 
+0x74, 0x6f, 0x6d, 0x69, 0x63, 0x5f, 0x64, 0x65, 0x63, 0x28, 0x68, 0x61, 0x73, 0x68, 0x4d, 
+0x61, 0x70, 0x20, 0x2b, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x48, 0x61, 
+0x73, 0x68, 0x29, 0x20, 0x2d, 0x20, 0x31, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x0d, 0x0a, 
+0x09, 0x09, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x5b, 
+0x6e, 0x65, 0x77, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x20, 0x3d, 0x20, 0x69, 0x6e, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x5b, 0x6f, 0x6c, 0x64, 0x49, 0x6e, 0x64, 
+0x65, 0x78, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x76, 0x6f, 0x69, 0x64, 
+0x20, 0x4b, 0x45, 0x52, 0x4e, 0x45, 0x4c, 0x20, 0x43, 0x6f, 0x6d, 0x70, 0x75, 0x74, 0x65, 
+0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x73, 0x48, 0x61, 0x73, 0x68, 0x41, 0x6e, 0x64, 0x50, 0x72, 0x65, 0x70, 0x61, 0x72, 0x65, 
+0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 
+0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x2c, 0x20, 0x76, 0x6f, 0x6c, 0x61, 0x74, 
+0x69, 0x6c, 0x65, 0x20, 0x47, 0x4c, 0x4f, 0x42, 0x41, 0x4c, 0x20, 0x48, 0x41, 0x53, 0x48, 
+0x5f, 0x54, 0x59, 0x50, 0x45, 0x2a, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 
+0x20, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 
+0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x47, 0x4c, 0x4f, 0x42, 0x41, 0x4c, 0x20, 0x53, 0x54, 
+0x52, 0x55, 0x43, 0x54, 0x20, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x73, 0x2c, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 
+0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 
+0x65, 0x2c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x29, 0x0d, 0x0a, 0x09, 0x7b, 0x0d, 0x0a, 
+0x09, 0x09, 0x53, 0x54, 0x4f, 0x50, 0x5f, 0x45, 0x58, 0x54, 0x45, 0x4e, 0x53, 0x49, 0x56, 
+0x45, 0x5f, 0x57, 0x4f, 0x52, 0x4b, 0x5f, 0x49, 0x54, 0x45, 0x4d, 0x53, 0x28, 0x70, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x29, 0x0d, 0x0a, 0x09, 
+0x09, 0x49, 0x4e, 0x49, 0x54, 0x49, 0x41, 0x4c, 0x49, 0x5a, 0x45, 0x5f, 0x54, 0x48, 0x52, 
+0x45, 0x41, 0x44, 0x5f, 0x49, 0x44, 0x28, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 
+0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x48, 0x61, 0x73, 0x68, 0x20, 0x3d, 0x20, 0x47, 0x65, 0x74, 0x48, 0x61, 0x73, 0x68, 0x28, 
+0x47, 0x65, 0x74, 0x43, 0x65, 0x6c, 0x6c, 0x28, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x73, 0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 0x2e, 0x70, 0x6f, 
+0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x41, 0x6e, 0x64, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 
+0x72, 0x65, 0x2e, 0x78, 0x79, 0x7a, 0x28, 0x29, 0x2c, 0x20, 0x6d, 0x61, 0x78, 0x49, 0x6e, 
+0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 
+0x63, 0x65, 0x29, 0x29, 0x20, 0x25, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 
+0x69, 0x7a, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x70, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x73, 0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 0x2e, 
+0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x41, 0x6e, 0x64, 0x48, 0x61, 0x73, 0x68, 
+0x2e, 0x77, 0x20, 0x3d, 0x20, 0x2a, 0x28, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x2a, 0x29, 0x26, 
+0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x3b, 0x0d, 0x0a, 
+0x0d, 0x0a, 0x09, 0x09, 0x61, 0x74, 0x6f, 0x6d, 0x69, 0x63, 0x5f, 0x69, 0x6e, 0x63, 0x28, 
+0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x20, 0x2b, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 
+0x09, 0x76, 0x6f, 0x69, 0x64, 0x20, 0x4b, 0x45, 0x52, 0x4e, 0x45, 0x4c, 0x20, 0x52, 0x65, 
+0x6f, 0x72, 0x64, 0x65, 0x72, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x41, 0x6e, 0x64, 0x46, 0x69, 0x6e, 0x69, 0x73, 0x68, 
+0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 
+0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x2c, 0x20, 0x47, 0x4c, 0x4f, 0x42, 0x41, 
+0x4c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x4d, 0x61, 0x70, 0x2c, 0x20, 0x76, 0x6f, 0x6c, 0x61, 0x74, 0x69, 0x6c, 
+0x65, 0x20, 0x47, 0x4c, 0x4f, 0x42, 0x41, 0x4c, 0x20, 0x48, 0x41, 0x53, 0x48, 0x5f, 0x54, 
+0x59, 0x50, 0x45, 0x2a, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 0x20, 0x43, 
+0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 0x20, 0x53, 0x54, 0x52, 0x55, 0x43, 0x54, 0x20, 
+0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x2a, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x20, 
+0x47, 0x4c, 0x4f, 0x42, 0x41, 0x4c, 0x20, 0x53, 0x54, 0x52, 0x55, 0x43, 0x54, 0x20, 0x44, 
+0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x2a, 
+0x20, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x20, 
+0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x43, 0x6f, 0x75, 0x6e, 0x74, 0x29, 0x0d, 0x0a, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x53, 
+0x54, 0x4f, 0x50, 0x5f, 0x45, 0x58, 0x54, 0x45, 0x4e, 0x53, 0x49, 0x56, 0x45, 0x5f, 0x57, 
+0x4f, 0x52, 0x4b, 0x5f, 0x49, 0x54, 0x45, 0x4d, 0x53, 0x28, 0x70, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x49, 0x4e, 
+0x49, 0x54, 0x49, 0x41, 0x4c, 0x49, 0x5a, 0x45, 0x5f, 0x54, 0x48, 0x52, 0x45, 0x41, 0x44, 
+0x5f, 0x49, 0x44, 0x28, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x73, 0x69, 0x7a, 
+0x65, 0x5f, 0x74, 0x20, 0x6f, 0x6c, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 
+0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 
+0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x48, 0x61, 0x73, 0x68, 0x20, 0x3d, 0x20, 0x61, 0x73, 0x5f, 0x75, 0x69, 0x6e, 0x74, 0x28, 
+0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x5b, 0x6f, 0x6c, 0x64, 
+0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x2e, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 
+0x41, 0x6e, 0x64, 0x48, 0x61, 0x73, 0x68, 0x2e, 0x77, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x0d, 0x0a, 0x09, 0x09, 0x73, 0x69, 0x7a, 0x65, 0x5f, 0x74, 0x20, 0x6e, 0x65, 0x77, 0x49, 
+0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x28, 0x73, 0x69, 0x7a, 0x65, 0x5f, 0x74, 0x29, 
+0x28, 0x61, 0x74, 0x6f, 0x6d, 0x69, 0x63, 0x5f, 0x64, 0x65, 0x63, 0x28, 0x68, 0x61, 0x73, 
+0x68, 0x4d, 0x61, 0x70, 0x20, 0x2b, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x48, 0x61, 0x73, 0x68, 0x29, 0x20, 0x2d, 0x20, 0x31, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x0d, 0x0a, 0x09, 0x09, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x70, 
+0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 0x20, 0x3d, 0x20, 0x28, 0x75, 
+0x69, 0x6e, 0x74, 0x33, 0x32, 0x29, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x3b, 
+0x0d, 0x0a, 0x09, 0x09, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x73, 0x5b, 0x6e, 0x65, 0x77, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x20, 0x3d, 0x20, 0x69, 
+0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x5b, 0x6f, 0x6c, 0x64, 0x49, 
+0x6e, 0x64, 0x65, 0x78, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x76, 0x6f, 
+0x69, 0x64, 0x20, 0x4b, 0x45, 0x52, 0x4e, 0x45, 0x4c, 0x20, 0x46, 0x69, 0x6c, 0x6c, 0x44, 
+0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 
+0x61, 0x70, 0x41, 0x6e, 0x64, 0x46, 0x69, 0x6e, 0x69, 0x73, 0x68, 0x48, 0x61, 0x73, 0x68, 
+0x4d, 0x61, 0x70, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x74, 0x68, 0x72, 0x65, 
+0x61, 0x64, 0x49, 0x44, 0x2c, 0x20, 0x47, 0x4c, 0x4f, 0x42, 0x41, 0x4c, 0x20, 0x75, 0x69, 
+0x6e, 0x74, 0x33, 0x32, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 
+0x61, 0x70, 0x2c, 0x20, 0x76, 0x6f, 0x6c, 0x61, 0x74, 0x69, 0x6c, 0x65, 0x20, 0x47, 0x4c, 
+0x4f, 0x42, 0x41, 0x4c, 0x20, 0x48, 0x41, 0x53, 0x48, 0x5f, 0x54, 0x59, 0x50, 0x45, 0x2a, 
+0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 0x20, 0x43, 0x4f, 0x4e, 0x53, 0x54, 
+0x41, 0x4e, 0x54, 0x20, 0x53, 0x54, 0x52, 0x55, 0x43, 0x54, 0x20, 0x44, 0x79, 0x6e, 0x61, 
+0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x2a, 0x20, 0x69, 0x6e, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x20, 0x75, 0x69, 0x6e, 0x74, 
+0x36, 0x34, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x43, 0x6f, 0x75, 0x6e, 
+0x74, 0x29, 0x0d, 0x0a, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x53, 0x54, 0x4f, 0x50, 0x5f, 
+0x45, 0x58, 0x54, 0x45, 0x4e, 0x53, 0x49, 0x56, 0x45, 0x5f, 0x57, 0x4f, 0x52, 0x4b, 0x5f, 
+0x49, 0x54, 0x45, 0x4d, 0x53, 0x28, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x43, 
+0x6f, 0x75, 0x6e, 0x74, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x49, 0x4e, 0x49, 0x54, 0x49, 0x41, 
+0x4c, 0x49, 0x5a, 0x45, 0x5f, 0x54, 0x48, 0x52, 0x45, 0x41, 0x44, 0x5f, 0x49, 0x44, 0x28, 
+0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 
+0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x20, 0x3d, 0x20, 
+0x61, 0x73, 0x5f, 0x75, 0x69, 0x6e, 0x74, 0x28, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x73, 0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 0x2e, 
+0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x41, 0x6e, 0x64, 0x48, 0x61, 0x73, 0x68, 
+0x2e, 0x77, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 
+0x32, 0x20, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x61, 0x74, 0x6f, 0x6d, 0x69, 
+0x63, 0x5f, 0x64, 0x65, 0x63, 0x28, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x20, 0x2b, 
+0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x29, 0x20, 
+0x2d, 0x20, 0x31, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x0d, 0x0a, 0x09, 0x09, 0x70, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x70, 0x5b, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x5d, 
+0x20, 0x3d, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x29, 0x74, 0x68, 0x72, 0x65, 
+0x61, 0x64, 0x49, 0x44, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x76, 
+0x6f, 0x69, 0x64, 0x20, 0x4b, 0x45, 0x52, 0x4e, 0x45, 0x4c, 0x20, 0x55, 0x70, 0x64, 0x61, 
+0x74, 0x65, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 
+0x75, 0x72, 0x65, 0x28, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 
+0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 
+0x6e, 0x74, 0x36, 0x34, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x2c, 0x0d, 0x0a, 0x09, 
+0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 
+0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 
+0x34, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x73, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 
+0x74, 0x36, 0x34, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 
 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 
-0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 0x6e, 
-0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 
-0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x5b, 0x6f, 
-0x74, 0x68, 0x65, 0x72, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x6f, 0x64, 0x5d, 0x3b, 0x0d, 0x0a, 
-0x09, 0x09, 0x09, 0x09, 0x09, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 
-0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
-0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x5b, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x48, 
-0x61, 0x73, 0x68, 0x4d, 0x6f, 0x64, 0x20, 0x2b, 0x20, 0x31, 0x5d, 0x3b, 0x0d, 0x0a, 0x0d, 
-0x0a, 0x23, 0x69, 0x66, 0x64, 0x65, 0x66, 0x20, 0x44, 0x45, 0x42, 0x55, 0x47, 0x5f, 0x42, 
-0x55, 0x46, 0x46, 0x45, 0x52, 0x53, 0x5f, 0x4b, 0x45, 0x52, 0x4e, 0x45, 0x4c, 0x09, 0x09, 
-0x09, 0x09, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x62, 0x65, 
-0x67, 0x69, 0x6e, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3e, 0x20, 0x65, 0x6e, 0x64, 0x49, 
-0x6e, 0x64, 0x65, 0x78, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 
-0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x70, 0x72, 0x69, 0x6e, 0x74, 0x66, 0x28, 0x22, 0x53, 
-0x74, 0x61, 0x74, 0x69, 0x63, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x20, 0x69, 0x6e, 0x64, 
+0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 0x20, 0x53, 
+0x54, 0x52, 0x55, 0x43, 0x54, 0x20, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x2a, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x47, 0x4c, 0x4f, 0x42, 0x41, 0x4c, 
+0x20, 0x53, 0x54, 0x52, 0x55, 0x43, 0x54, 0x20, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x2a, 0x20, 0x6f, 0x75, 0x74, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x43, 0x4f, 0x4e, 
+0x53, 0x54, 0x41, 0x4e, 0x54, 0x20, 0x48, 0x41, 0x53, 0x48, 0x5f, 0x54, 0x59, 0x50, 0x45, 
+0x2a, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x43, 
+0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x2a, 
+0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x70, 0x2c, 0x0d, 0x0a, 
+0x09, 0x09, 0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 0x20, 0x53, 0x54, 0x52, 0x55, 
+0x43, 0x54, 0x20, 0x53, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x2a, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 
+0x4e, 0x54, 0x20, 0x48, 0x41, 0x53, 0x48, 0x5f, 0x54, 0x59, 0x50, 0x45, 0x2a, 0x20, 0x73, 
+0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 
+0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x43, 0x4f, 0x4e, 0x53, 
+0x54, 0x41, 0x4e, 0x54, 0x20, 0x53, 0x54, 0x52, 0x55, 0x43, 0x54, 0x20, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x42, 0x65, 0x68, 0x61, 0x76, 0x69, 0x6f, 0x75, 0x72, 0x50, 
+0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 
+0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x0d, 0x0a, 0x09, 0x29, 0x20, 0x7b, 0x0d, 0x0a, 0x09, 
+0x09, 0x53, 0x54, 0x4f, 0x50, 0x5f, 0x45, 0x58, 0x54, 0x45, 0x4e, 0x53, 0x49, 0x56, 0x45, 
+0x5f, 0x57, 0x4f, 0x52, 0x4b, 0x5f, 0x49, 0x54, 0x45, 0x4d, 0x53, 0x28, 0x64, 0x79, 0x6e, 
+0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x43, 0x6f, 
+0x75, 0x6e, 0x74, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x49, 0x4e, 0x49, 0x54, 0x49, 0x41, 0x4c, 
+0x49, 0x5a, 0x45, 0x5f, 0x54, 0x48, 0x52, 0x45, 0x41, 0x44, 0x5f, 0x49, 0x44, 0x28, 0x29, 
+0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 
+0x20, 0x53, 0x54, 0x52, 0x55, 0x43, 0x54, 0x20, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x2a, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x74, 0x72, 0x20, 0x3d, 0x20, 0x69, 0x6e, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x20, 0x2b, 0x20, 0x74, 0x68, 0x72, 0x65, 0x61, 
+0x64, 0x49, 0x44, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x47, 0x4c, 0x4f, 0x42, 0x41, 0x4c, 0x20, 
+0x53, 0x54, 0x52, 0x55, 0x43, 0x54, 0x20, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x2a, 0x20, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x74, 0x72, 0x20, 0x3d, 0x20, 0x6f, 0x75, 0x74, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x20, 0x2b, 0x20, 0x74, 0x68, 0x72, 0x65, 
+0x61, 0x64, 0x49, 0x44, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x23, 0x69, 0x66, 0x64, 0x65, 0x66, 
+0x20, 0x44, 0x45, 0x42, 0x55, 0x47, 0x5f, 0x42, 0x55, 0x46, 0x46, 0x45, 0x52, 0x53, 0x5f, 
+0x4b, 0x45, 0x52, 0x4e, 0x45, 0x4c, 0x0d, 0x0a, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x74, 
+0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x20, 0x3e, 0x3d, 0x20, 0x64, 0x79, 0x6e, 0x61, 
+0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x43, 0x6f, 0x75, 
+0x6e, 0x74, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x70, 0x72, 
+0x69, 0x6e, 0x74, 0x66, 0x28, 0x22, 0x41, 0x6c, 0x6c, 0x6f, 0x63, 0x61, 0x74, 0x69, 0x6e, 
+0x67, 0x20, 0x6d, 0x6f, 0x72, 0x65, 0x20, 0x77, 0x6f, 0x72, 0x6b, 0x20, 0x69, 0x74, 0x65, 
+0x6d, 0x73, 0x20, 0x74, 0x68, 0x61, 0x6e, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x73, 0x22, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 
+0x6e, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x23, 0x65, 0x6e, 0x64, 0x69, 0x66, 
+0x09, 0x09, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x70, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 
+0x20, 0x3d, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x74, 
+0x72, 0x2d, 0x3e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x41, 0x6e, 0x64, 0x50, 
+0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x2e, 0x78, 0x79, 0x7a, 0x28, 0x29, 0x3b, 0x0d, 
+0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x75, 0x20, 0x63, 0x65, 0x6c, 0x6c, 
+0x20, 0x3d, 0x20, 0x47, 0x65, 0x74, 0x43, 0x65, 0x6c, 0x6c, 0x28, 0x70, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x2c, 0x20, 0x70, 
+0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 
+0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 
+0x6e, 0x63, 0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 
+0x75, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x43, 0x65, 0x6c, 0x6c, 0x20, 0x3d, 0x20, 0x63, 
+0x65, 0x6c, 0x6c, 0x20, 0x2d, 0x20, 0x4e, 0x45, 0x57, 0x5f, 0x56, 0x45, 0x43, 0x33, 0x55, 
+0x28, 0x31, 0x2c, 0x20, 0x31, 0x2c, 0x20, 0x31, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x56, 
+0x65, 0x63, 0x33, 0x75, 0x20, 0x65, 0x6e, 0x64, 0x43, 0x65, 0x6c, 0x6c, 0x20, 0x3d, 0x20, 
+0x63, 0x65, 0x6c, 0x6c, 0x20, 0x2b, 0x20, 0x4e, 0x45, 0x57, 0x5f, 0x56, 0x45, 0x43, 0x33, 
+0x55, 0x28, 0x32, 0x2c, 0x20, 0x32, 0x2c, 0x20, 0x32, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 
+0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x66, 0x6c, 0x75, 0x65, 0x6e, 
+0x63, 0x65, 0x53, 0x75, 0x6d, 0x20, 0x3d, 0x20, 0x30, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x66, 
+0x6c, 0x6f, 0x61, 0x74, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x66, 0x6c, 0x75, 0x65, 0x6e, 0x63, 0x65, 0x53, 0x75, 
+0x6d, 0x20, 0x3d, 0x20, 0x30, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x62, 0x6f, 0x6f, 
+0x6c, 0x20, 0x6f, 0x75, 0x74, 0x73, 0x69, 0x64, 0x65, 0x47, 0x72, 0x69, 0x64, 0x42, 0x75, 
+0x63, 0x6b, 0x65, 0x74, 0x56, 0x69, 0x73, 0x69, 0x74, 0x65, 0x64, 0x20, 0x3d, 0x20, 0x66, 
+0x61, 0x6c, 0x73, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 
+0x75, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x3b, 0x0d, 0x0a, 0x09, 
+0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 
+0x2e, 0x78, 0x20, 0x3d, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 
+0x78, 0x3b, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x78, 0x20, 
+0x21, 0x3d, 0x20, 0x65, 0x6e, 0x64, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x78, 0x3b, 0x20, 0x2b, 
+0x2b, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x78, 0x29, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 
+0x6c, 0x6c, 0x2e, 0x79, 0x20, 0x3d, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x43, 0x65, 0x6c, 
+0x6c, 0x2e, 0x79, 0x3b, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 
+0x79, 0x20, 0x21, 0x3d, 0x20, 0x65, 0x6e, 0x64, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x79, 0x3b, 
+0x20, 0x2b, 0x2b, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x79, 0x29, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x6f, 0x74, 0x68, 0x65, 
+0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x7a, 0x20, 0x3d, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 
+0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x7a, 0x3b, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 
+0x6c, 0x6c, 0x2e, 0x7a, 0x20, 0x21, 0x3d, 0x20, 0x65, 0x6e, 0x64, 0x43, 0x65, 0x6c, 0x6c, 
+0x2e, 0x7a, 0x3b, 0x20, 0x2b, 0x2b, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 
+0x2e, 0x7a, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x48, 
+0x61, 0x73, 0x68, 0x4d, 0x6f, 0x64, 0x20, 0x3d, 0x20, 0x47, 0x65, 0x74, 0x43, 0x65, 0x6c, 
+0x6c, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x28, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 
+0x6c, 0x6c, 0x2c, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 
+0x65, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x29, 0x3b, 
+0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x2f, 0x2f, 0x57, 0x69, 0x74, 0x68, 
+0x20, 0x74, 0x68, 0x65, 0x20, 0x64, 0x65, 0x6e, 0x73, 0x65, 0x20, 0x67, 0x72, 0x69, 0x64, 
+0x20, 0x61, 0x6c, 0x6c, 0x20, 0x63, 0x65, 0x6c, 0x6c, 0x73, 0x20, 0x6f, 0x75, 0x74, 0x73, 
+0x69, 0x64, 0x65, 0x20, 0x6f, 0x66, 0x20, 0x69, 0x74, 0x20, 0x73, 0x68, 0x61, 0x72, 0x65, 
+0x20, 0x6f, 0x6e, 0x65, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x2c, 0x20, 0x69, 0x74, 
+0x20, 0x6d, 0x75, 0x73, 0x74, 0x20, 0x62, 0x65, 0x20, 0x63, 0x68, 0x65, 0x63, 0x6b, 0x65, 
+0x64, 0x20, 0x6f, 0x6e, 0x6c, 0x79, 0x20, 0x6f, 0x6e, 0x63, 0x65, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x49, 0x73, 0x4f, 0x75, 0x74, 0x73, 0x69, 0x64, 
+0x65, 0x47, 0x72, 0x69, 0x64, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x28, 0x6f, 0x74, 0x68, 
+0x65, 0x72, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x6f, 0x64, 0x2c, 0x20, 0x64, 0x79, 0x6e, 0x61, 
+0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 
+0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 
+0x65, 0x74, 0x65, 0x72, 0x73, 0x29, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7b, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x6f, 0x75, 0x74, 
+0x73, 0x69, 0x64, 0x65, 0x47, 0x72, 0x69, 0x64, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x56, 
+0x69, 0x73, 0x69, 0x74, 0x65, 0x64, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x63, 0x6f, 0x6e, 0x74, 0x69, 0x6e, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x6f, 0x75, 0x74, 0x73, 0x69, 0x64, 0x65, 0x47, 0x72, 0x69, 
+0x64, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x56, 0x69, 0x73, 0x69, 0x74, 0x65, 0x64, 0x20, 
+0x3d, 0x20, 0x74, 0x72, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7d, 
+0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x2f, 0x2f, 0x43, 0x61, 0x6c, 0x63, 
+0x75, 0x6c, 0x61, 0x74, 0x69, 0x6e, 0x67, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 
+0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x20, 0x70, 0x72, 0x65, 0x73, 0x73, 
+0x75, 0x72, 0x65, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 
+0x32, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 
+0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x5b, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x48, 0x61, 
+0x73, 0x68, 0x4d, 0x6f, 0x64, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x75, 
+0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 
+0x3d, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x5b, 0x6f, 0x74, 0x68, 0x65, 0x72, 
+0x48, 0x61, 0x73, 0x68, 0x4d, 0x6f, 0x64, 0x20, 0x2b, 0x20, 0x31, 0x5d, 0x3b, 0x0d, 0x0a, 
+0x0d, 0x0a, 0x23, 0x69, 0x66, 0x64, 0x65, 0x66, 0x20, 0x44, 0x45, 0x42, 0x55, 0x47, 0x5f, 
+0x42, 0x55, 0x46, 0x46, 0x45, 0x52, 0x53, 0x5f, 0x4b, 0x45, 0x52, 0x4e, 0x45, 0x4c, 0x09, 
+0x09, 0x09, 0x09, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x62, 
+0x65, 0x67, 0x69, 0x6e, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3e, 0x20, 0x65, 0x6e, 0x64, 
+0x49, 0x6e, 0x64, 0x65, 0x78, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7b, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x70, 0x72, 0x69, 0x6e, 0x74, 0x66, 0x28, 0x22, 
+0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x20, 0x6d, 0x61, 0x70, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x20, 0x69, 0x6e, 0x64, 
 0x65, 0x78, 0x20, 0x69, 0x73, 0x20, 0x62, 0x69, 0x67, 0x67, 0x65, 0x72, 0x20, 0x74, 0x68, 
-0x61, 0x6e, 0x20, 0x65, 0x6e, 0x64, 0x20, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x66, 0x6f, 
-0x72, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 
-0x6c, 0x65, 0x73, 0x2e, 0x20, 0x42, 0x65, 0x67, 0x69, 0x6e, 0x3a, 0x20, 0x25, 0x75, 0x20, 
-0x45, 0x6e, 0x64, 0x3a, 0x20, 0x25, 0x75, 0x22, 0x2c, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 
-0x49, 0x6e, 0x64, 0x65, 0x78, 0x2c, 0x20, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 
-0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x62, 0x72, 0x65, 0x61, 0x6b, 
-0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
-0x09, 0x69, 0x66, 0x20, 0x28, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 0x6e, 0x64, 0x65, 0x78, 
+0x61, 0x6e, 0x20, 0x65, 0x6e, 0x64, 0x20, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x2e, 0x20, 0x42, 
+0x65, 0x67, 0x69, 0x6e, 0x3a, 0x20, 0x25, 0x75, 0x20, 0x45, 0x6e, 0x64, 0x3a, 0x20, 0x25, 
+0x75, 0x22, 0x2c, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x2c, 
+0x20, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x62, 0x72, 0x65, 0x61, 0x6b, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x62, 
+0x65, 0x67, 0x69, 0x6e, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3e, 0x20, 0x64, 0x79, 0x6e, 
+0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x43, 0x6f, 
+0x75, 0x6e, 0x74, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x70, 0x72, 0x69, 0x6e, 0x74, 0x66, 0x28, 0x22, 0x49, 0x6e, 
+0x76, 0x61, 0x6c, 0x69, 0x64, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x20, 0x70, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x20, 0x6d, 0x61, 0x70, 0x20, 0x62, 0x65, 0x67, 
+0x69, 0x6e, 0x20, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x3a, 0x20, 0x25, 0x75, 0x22, 0x2c, 0x20, 
+0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x62, 0x72, 0x65, 0x61, 0x6b, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 
+0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3e, 0x20, 0x64, 0x79, 0x6e, 0x61, 
+0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x43, 0x6f, 0x75, 
+0x6e, 0x74, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x70, 0x72, 0x69, 0x6e, 0x74, 0x66, 0x28, 0x22, 0x49, 0x6e, 0x76, 
+0x61, 0x6c, 0x69, 0x64, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x20, 0x70, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x20, 0x6d, 0x61, 0x70, 0x20, 0x65, 0x6e, 0x64, 0x20, 
+0x69, 0x6e, 0x64, 0x65, 0x78, 0x3a, 0x20, 0x25, 0x75, 0x22, 0x2c, 0x20, 0x65, 0x6e, 0x64, 
+0x49, 0x6e, 0x64, 0x65, 0x78, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x62, 0x72, 0x65, 0x61, 0x6b, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 
+0x0a, 0x23, 0x65, 0x6e, 0x64, 0x69, 0x66, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x75, 
+0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x69, 0x20, 0x3d, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 
+0x49, 0x6e, 0x64, 0x65, 0x78, 0x3b, 0x20, 0x69, 0x20, 0x3c, 0x20, 0x65, 0x6e, 0x64, 0x49, 
+0x6e, 0x64, 0x65, 0x78, 0x3b, 0x20, 0x2b, 0x2b, 0x69, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 
+0x33, 0x32, 0x20, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x70, 0x5b, 0x69, 0x5d, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 
+0x23, 0x69, 0x66, 0x64, 0x65, 0x66, 0x20, 0x44, 0x45, 0x42, 0x55, 0x47, 0x5f, 0x42, 0x55, 
+0x46, 0x46, 0x45, 0x52, 0x53, 0x5f, 0x4b, 0x45, 0x52, 0x4e, 0x45, 0x4c, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x20, 
+0x3e, 0x3d, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x73, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x70, 0x72, 
+0x69, 0x6e, 0x74, 0x66, 0x28, 0x22, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x20, 0x6d, 0x61, 0x70, 0x20, 0x76, 0x61, 0x6c, 0x75, 
+0x65, 0x20, 0x6f, 0x75, 0x74, 0x73, 0x69, 0x64, 0x65, 0x20, 0x76, 0x61, 0x6c, 0x69, 0x64, 
+0x20, 0x72, 0x61, 0x6e, 0x67, 0x65, 0x22, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x74, 0x69, 0x6e, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x23, 0x65, 0x6e, 0x64, 0x69, 0x66, 0x0d, 
+0x0a, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x43, 0x4f, 0x4e, 0x53, 
+0x54, 0x41, 0x4e, 0x54, 0x20, 0x53, 0x54, 0x52, 0x55, 0x43, 0x54, 0x20, 0x44, 0x79, 0x6e, 
+0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x2a, 0x20, 0x6f, 
+0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x74, 0x72, 
+0x20, 0x3d, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x20, 
+0x2b, 0x20, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x50, 0x74, 0x72, 0x20, 0x3d, 0x3d, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x74, 0x72, 0x29, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x74, 0x69, 0x6e, 0x75, 0x65, 0x3b, 0x0d, 
+0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 
+0x64, 0x69, 0x72, 0x20, 0x3d, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x50, 0x74, 0x72, 0x2d, 0x3e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 
+0x6f, 0x6e, 0x41, 0x6e, 0x64, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x2e, 0x78, 
+0x79, 0x7a, 0x28, 0x29, 0x20, 0x2d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 
+0x20, 0x3d, 0x20, 0x64, 0x6f, 0x74, 0x28, 0x64, 0x69, 0x72, 0x2c, 0x20, 0x64, 0x69, 0x72, 
+0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 
+0x28, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x20, 0x3e, 0x20, 0x70, 0x61, 0x72, 0x61, 
+0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 
+0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 
+0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 
+0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 
+0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x63, 0x6f, 0x6e, 0x74, 0x69, 0x6e, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x69, 0x73, 
+0x74, 0x20, 0x3d, 0x20, 0x73, 0x71, 0x72, 0x74, 0x28, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 
+0x72, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x64, 0x79, 
+0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 
+0x66, 0x6c, 0x75, 0x65, 0x6e, 0x63, 0x65, 0x53, 0x75, 0x6d, 0x20, 0x2b, 0x3d, 0x20, 0x53, 
+0x6d, 0x6f, 0x6f, 0x74, 0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x44, 
+0x30, 0x28, 0x64, 0x69, 0x73, 0x74, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 
+0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 
+0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x3b, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x69, 0x66, 0x20, 0x28, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x73, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x20, 0x3d, 0x3d, 0x20, 0x30, 
+0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x74, 0x69, 0x6e, 
+0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x2f, 0x2f, 0x43, 
+0x61, 0x6c, 0x63, 0x75, 0x6c, 0x61, 0x74, 0x69, 0x6e, 0x67, 0x20, 0x73, 0x74, 0x61, 0x74, 
+0x69, 0x63, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x20, 0x70, 0x72, 0x65, 
+0x73, 0x73, 0x75, 0x72, 0x65, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x6f, 0x74, 0x68, 
+0x65, 0x72, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x6f, 0x64, 0x20, 0x3d, 0x20, 0x47, 0x65, 0x74, 
+0x43, 0x65, 0x6c, 0x6c, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x28, 0x6f, 0x74, 0x68, 0x65, 
+0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2c, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 
+0x69, 0x7a, 0x65, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 
+0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 
+0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x5b, 
+0x6f, 0x74, 0x68, 0x65, 0x72, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x6f, 0x64, 0x5d, 0x3b, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 
+0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x5b, 0x6f, 0x74, 0x68, 0x65, 0x72, 
+0x48, 0x61, 0x73, 0x68, 0x4d, 0x6f, 0x64, 0x20, 0x2b, 0x20, 0x31, 0x5d, 0x3b, 0x0d, 0x0a, 
+0x0d, 0x0a, 0x23, 0x69, 0x66, 0x64, 0x65, 0x66, 0x20, 0x44, 0x45, 0x42, 0x55, 0x47, 0x5f, 
+0x42, 0x55, 0x46, 0x46, 0x45, 0x52, 0x53, 0x5f, 0x4b, 0x45, 0x52, 0x4e, 0x45, 0x4c, 0x09, 
+0x09, 0x09, 0x09, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x62, 
+0x65, 0x67, 0x69, 0x6e, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3e, 0x20, 0x65, 0x6e, 0x64, 
+0x49, 0x6e, 0x64, 0x65, 0x78, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7b, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x70, 0x72, 0x69, 0x6e, 0x74, 0x66, 0x28, 0x22, 
+0x53, 0x74, 0x61, 0x74, 0x69, 0x63, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x20, 0x69, 0x6e, 
+0x64, 0x65, 0x78, 0x20, 0x69, 0x73, 0x20, 0x62, 0x69, 0x67, 0x67, 0x65, 0x72, 0x20, 0x74, 
+0x68, 0x61, 0x6e, 0x20, 0x65, 0x6e, 0x64, 0x20, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x66, 
+0x6f, 0x72, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x73, 0x2e, 0x20, 0x42, 0x65, 0x67, 0x69, 0x6e, 0x3a, 0x20, 0x25, 0x75, 
+0x20, 0x45, 0x6e, 0x64, 0x3a, 0x20, 0x25, 0x75, 0x22, 0x2c, 0x20, 0x62, 0x65, 0x67, 0x69, 
+0x6e, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x2c, 0x20, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 
+0x78, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x62, 0x72, 0x65, 0x61, 
+0x6b, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 0x6e, 0x64, 0x65, 
+0x78, 0x20, 0x3e, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x73, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x70, 0x72, 0x69, 0x6e, 
+0x74, 0x66, 0x28, 0x22, 0x49, 0x6e, 0x76, 0x61, 0x6c, 0x69, 0x64, 0x20, 0x73, 0x74, 0x61, 
+0x74, 0x69, 0x63, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x20, 0x69, 0x6e, 0x64, 0x65, 0x78, 
+0x3a, 0x20, 0x25, 0x75, 0x22, 0x2c, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 0x6e, 0x64, 
+0x65, 0x78, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x62, 0x72, 0x65, 
+0x61, 0x6b, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 
 0x20, 0x3e, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
 0x6c, 0x65, 0x73, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x70, 0x72, 0x69, 0x6e, 0x74, 
 0x66, 0x28, 0x22, 0x49, 0x6e, 0x76, 0x61, 0x6c, 0x69, 0x64, 0x20, 0x73, 0x74, 0x61, 0x74, 
-0x69, 0x63, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x20, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x3a, 
-0x20, 0x25, 0x75, 0x22, 0x2c, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 0x6e, 0x64, 0x65, 
-0x78, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x62, 0x72, 0x65, 0x61, 
-0x6b, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
-0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 
-0x3e, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
-0x65, 0x73, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 
-0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x70, 0x72, 0x69, 0x6e, 0x74, 0x66, 
-0x28, 0x22, 0x49, 0x6e, 0x76, 0x61, 0x6c, 0x69, 0x64, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 
-0x63, 0x20, 0x65, 0x6e, 0x64, 0x20, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x3a, 0x20, 0x25, 0x75, 
-0x22, 0x2c, 0x20, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x29, 0x3b, 0x0d, 0x0a, 
-0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x62, 0x72, 0x65, 0x61, 0x6b, 0x3b, 0x0d, 0x0a, 0x09, 
-0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x23, 0x65, 0x6e, 0x64, 0x69, 0x66, 0x0d, 0x0a, 
+0x69, 0x63, 0x20, 0x65, 0x6e, 0x64, 0x20, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x3a, 0x20, 0x25, 
+0x75, 0x22, 0x2c, 0x20, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x29, 0x3b, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x62, 0x72, 0x65, 0x61, 0x6b, 0x3b, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x23, 0x65, 0x6e, 0x64, 0x69, 0x66, 0x0d, 
+0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x75, 0x69, 
+0x6e, 0x74, 0x33, 0x32, 0x20, 0x69, 0x20, 0x3d, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 
+0x6e, 0x64, 0x65, 0x78, 0x3b, 0x20, 0x69, 0x20, 0x3c, 0x20, 0x65, 0x6e, 0x64, 0x49, 0x6e, 
+0x64, 0x65, 0x78, 0x3b, 0x20, 0x2b, 0x2b, 0x69, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x43, 0x4f, 0x4e, 0x53, 0x54, 
+0x41, 0x4e, 0x54, 0x20, 0x53, 0x54, 0x52, 0x55, 0x43, 0x54, 0x20, 0x53, 0x74, 0x61, 0x74, 
+0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x2a, 0x20, 0x6f, 0x74, 0x68, 
+0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x74, 0x72, 0x20, 0x3d, 
+0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x73, 0x20, 0x2b, 0x20, 0x69, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x64, 0x69, 0x72, 0x20, 0x3d, 0x20, 0x6f, 0x74, 
+0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x74, 0x72, 0x2d, 
+0x3e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x41, 0x6e, 0x64, 0x50, 0x72, 0x65, 
+0x73, 0x73, 0x75, 0x72, 0x65, 0x2e, 0x78, 0x79, 0x7a, 0x28, 0x29, 0x20, 0x2d, 0x20, 0x70, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 
+0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 
+0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x20, 0x3d, 0x20, 0x64, 0x6f, 0x74, 0x28, 0x64, 
+0x69, 0x72, 0x2c, 0x20, 0x64, 0x69, 0x72, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 
+0x20, 0x3e, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 
+0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 
+0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 
+0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 
+0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x74, 0x69, 0x6e, 
+0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6c, 
+0x6f, 0x61, 0x74, 0x20, 0x64, 0x69, 0x73, 0x74, 0x20, 0x3d, 0x20, 0x73, 0x71, 0x72, 0x74, 
+0x28, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x66, 0x6c, 0x75, 0x65, 0x6e, 0x63, 0x65, 0x53, 0x75, 
+0x6d, 0x20, 0x2b, 0x3d, 0x20, 0x53, 0x6d, 0x6f, 0x6f, 0x74, 0x68, 0x69, 0x6e, 0x67, 0x4b, 
+0x65, 0x72, 0x6e, 0x65, 0x6c, 0x44, 0x30, 0x28, 0x64, 0x69, 0x73, 0x74, 0x2c, 0x20, 0x70, 
+0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 
+0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 
+0x6e, 0x63, 0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 
+0x74, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x44, 0x65, 0x6e, 0x73, 0x69, 
+0x74, 0x79, 0x20, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 
+0x2d, 0x3e, 0x73, 0x65, 0x6c, 0x66, 0x44, 0x65, 0x6e, 0x73, 0x69, 0x74, 0x79, 0x20, 0x2b, 
+0x20, 0x28, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x49, 0x6e, 0x66, 0x6c, 0x75, 0x65, 0x6e, 0x63, 0x65, 0x53, 0x75, 0x6d, 0x20, 
+0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x70, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x73, 0x73, 0x20, 0x2b, 0x20, 0x73, 
+0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 
+0x66, 0x6c, 0x75, 0x65, 0x6e, 0x63, 0x65, 0x53, 0x75, 0x6d, 0x20, 0x2a, 0x20, 0x70, 0x61, 
+0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x70, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x4d, 0x61, 0x73, 0x73, 0x29, 0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 
+0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x73, 0x6d, 0x6f, 0x6f, 0x74, 0x68, 0x69, 
+0x6e, 0x67, 0x4b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x43, 0x6f, 0x6e, 0x73, 0x74, 0x61, 0x6e, 
+0x74, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x70, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x20, 0x3d, 
+0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x67, 0x61, 
+0x73, 0x43, 0x6f, 0x6e, 0x73, 0x74, 0x61, 0x6e, 0x74, 0x20, 0x2a, 0x20, 0x28, 0x70, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x44, 0x65, 0x6e, 0x73, 0x69, 0x74, 0x79, 0x20, 0x2d, 
+0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x72, 0x65, 
+0x73, 0x74, 0x44, 0x65, 0x6e, 0x73, 0x69, 0x74, 0x79, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 
+0x09, 0x09, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x74, 
+0x72, 0x2d, 0x3e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x41, 0x6e, 0x64, 0x50, 
+0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x2e, 0x77, 0x20, 0x3d, 0x20, 0x70, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x3b, 0x0d, 
+0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x76, 0x6f, 0x69, 0x64, 0x20, 0x4b, 0x45, 
+0x52, 0x4e, 0x45, 0x4c, 0x20, 0x55, 0x70, 0x64, 0x61, 0x74, 0x65, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x73, 0x28, 0x0d, 0x0a, 
+0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 
+0x49, 0x44, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x64, 
+0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 
+0x43, 0x6f, 0x75, 0x6e, 0x74, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 
+0x34, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 
+0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x73, 0x74, 0x61, 0x74, 
+0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x43, 0x6f, 0x75, 0x6e, 
+0x74, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x73, 0x74, 
+0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 
+0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x43, 
+0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 0x20, 0x53, 0x54, 0x52, 0x55, 0x43, 0x54, 0x20, 
+0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x2a, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x0d, 
+0x0a, 0x09, 0x09, 0x47, 0x4c, 0x4f, 0x42, 0x41, 0x4c, 0x20, 0x53, 0x54, 0x52, 0x55, 0x43, 
+0x54, 0x20, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x2a, 0x20, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 0x20, 
+0x48, 0x41, 0x53, 0x48, 0x5f, 0x54, 0x59, 0x50, 0x45, 0x2a, 0x20, 0x68, 0x61, 0x73, 0x68, 
+0x4d, 0x61, 0x70, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 
+0x54, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x4d, 0x61, 0x70, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x43, 0x4f, 0x4e, 0x53, 
+0x54, 0x41, 0x4e, 0x54, 0x20, 0x53, 0x54, 0x52, 0x55, 0x43, 0x54, 0x20, 0x53, 0x74, 0x61, 
+0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x2a, 0x20, 0x73, 0x74, 
+0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x0d, 
+0x0a, 0x09, 0x09, 0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 0x20, 0x48, 0x41, 0x53, 
+0x48, 0x5f, 0x54, 0x59, 0x50, 0x45, 0x2a, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 
+0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x66, 0x6c, 0x6f, 0x61, 
+0x74, 0x20, 0x64, 0x65, 0x6c, 0x74, 0x61, 0x54, 0x69, 0x6d, 0x65, 0x2c, 0x0d, 0x0a, 0x09, 
+0x09, 0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 0x20, 0x53, 0x54, 0x52, 0x55, 0x43, 
+0x54, 0x20, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x42, 0x65, 0x68, 0x61, 0x76, 
+0x69, 0x6f, 0x75, 0x72, 0x50, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2a, 
+0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 
+0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 
+0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x43, 0x4f, 0x4e, 0x53, 
+0x54, 0x41, 0x4e, 0x54, 0x20, 0x53, 0x54, 0x52, 0x55, 0x43, 0x54, 0x20, 0x54, 0x72, 0x69, 
+0x61, 0x6e, 0x67, 0x6c, 0x65, 0x2a, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 
+0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x74, 0x72, 
+0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 
+0x7a, 0x65, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 
+0x20, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x2a, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 
+0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x43, 
+0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x2a, 
+0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x4d, 0x61, 0x70, 0x0d, 0x0a, 0x09, 
+0x29, 0x20, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x53, 0x54, 0x4f, 0x50, 0x5f, 0x45, 0x58, 0x54, 
+0x45, 0x4e, 0x53, 0x49, 0x56, 0x45, 0x5f, 0x57, 0x4f, 0x52, 0x4b, 0x5f, 0x49, 0x54, 0x45, 
+0x4d, 0x53, 0x28, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x73, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x49, 
+0x4e, 0x49, 0x54, 0x49, 0x41, 0x4c, 0x49, 0x5a, 0x45, 0x5f, 0x54, 0x48, 0x52, 0x45, 0x41, 
+0x44, 0x5f, 0x49, 0x44, 0x28, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 
+0x6e, 0x74, 0x36, 0x34, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 
+0x44, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 0x20, 
+0x53, 0x54, 0x52, 0x55, 0x43, 0x54, 0x20, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x2a, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x50, 0x74, 0x72, 0x20, 0x3d, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x20, 0x2b, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x75, 
+0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x74, 0x68, 0x72, 0x65, 0x61, 
+0x64, 0x49, 0x44, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x47, 0x4c, 0x4f, 0x42, 0x41, 0x4c, 0x20, 
+0x53, 0x54, 0x52, 0x55, 0x43, 0x54, 0x20, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x2a, 0x20, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x74, 0x72, 0x20, 0x3d, 0x20, 0x6f, 0x75, 0x74, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x20, 0x2b, 0x20, 0x6f, 0x75, 0x74, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x3b, 0x0d, 0x0a, 
+0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x3d, 0x20, 0x69, 
+0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x74, 0x72, 0x2d, 0x3e, 0x70, 
+0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x41, 0x6e, 0x64, 0x50, 0x72, 0x65, 0x73, 0x73, 
+0x75, 0x72, 0x65, 0x2e, 0x78, 0x79, 0x7a, 0x28, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x66, 
+0x6c, 0x6f, 0x61, 0x74, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 
+0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x20, 0x3d, 0x20, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x74, 0x72, 0x2d, 0x3e, 0x70, 0x6f, 0x73, 0x69, 0x74, 
+0x69, 0x6f, 0x6e, 0x41, 0x6e, 0x64, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x2e, 
+0x77, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x70, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x20, 0x3d, 
+0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x74, 0x72, 0x2d, 
+0x3e, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x41, 0x6e, 0x64, 0x48, 0x61, 0x73, 
+0x68, 0x2e, 0x78, 0x79, 0x7a, 0x28, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6c, 0x6f, 
+0x61, 0x74, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 
+0x5f, 0x46, 0x4c, 0x4f, 0x41, 0x54, 0x20, 0x3d, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x50, 0x74, 0x72, 0x2d, 0x3e, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 
+0x74, 0x79, 0x41, 0x6e, 0x64, 0x48, 0x61, 0x73, 0x68, 0x2e, 0x77, 0x3b, 0x0d, 0x0a, 0x09, 
+0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x48, 0x61, 0x73, 0x68, 0x20, 0x3d, 0x20, 0x2a, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 
+0x32, 0x2a, 0x29, 0x26, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x48, 0x61, 0x73, 
+0x68, 0x5f, 0x46, 0x4c, 0x4f, 0x41, 0x54, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x56, 
+0x65, 0x63, 0x33, 0x75, 0x20, 0x63, 0x65, 0x6c, 0x6c, 0x20, 0x3d, 0x20, 0x47, 0x65, 0x74, 
+0x43, 0x65, 0x6c, 0x6c, 0x28, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 
+0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 
+0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 
+0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x3b, 0x0d, 
+0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x75, 0x20, 0x62, 0x65, 0x67, 0x69, 
+0x6e, 0x43, 0x65, 0x6c, 0x6c, 0x20, 0x3d, 0x20, 0x63, 0x65, 0x6c, 0x6c, 0x20, 0x2d, 0x20, 
+0x4e, 0x45, 0x57, 0x5f, 0x56, 0x45, 0x43, 0x33, 0x55, 0x28, 0x31, 0x2c, 0x20, 0x31, 0x2c, 
+0x20, 0x31, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x75, 0x20, 0x65, 
+0x6e, 0x64, 0x43, 0x65, 0x6c, 0x6c, 0x20, 0x3d, 0x20, 0x63, 0x65, 0x6c, 0x6c, 0x20, 0x2b, 
+0x20, 0x4e, 0x45, 0x57, 0x5f, 0x56, 0x45, 0x43, 0x33, 0x55, 0x28, 0x32, 0x2c, 0x20, 0x32, 
+0x2c, 0x20, 0x32, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 
+0x66, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 
+0x20, 0x3d, 0x20, 0x4e, 0x45, 0x57, 0x5f, 0x56, 0x45, 0x43, 0x33, 0x46, 0x28, 0x30, 0x2e, 
+0x30, 0x66, 0x2c, 0x20, 0x30, 0x2e, 0x30, 0x66, 0x2c, 0x20, 0x30, 0x2e, 0x30, 0x66, 0x29, 
+0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x64, 0x79, 0x6e, 0x61, 
+0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 
+0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x3d, 0x20, 0x4e, 0x45, 
+0x57, 0x5f, 0x56, 0x45, 0x43, 0x33, 0x46, 0x28, 0x30, 0x2e, 0x30, 0x66, 0x2c, 0x20, 0x30, 
+0x2e, 0x30, 0x66, 0x2c, 0x20, 0x30, 0x2e, 0x30, 0x66, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 
+0x72, 0x63, 0x65, 0x20, 0x3d, 0x20, 0x4e, 0x45, 0x57, 0x5f, 0x56, 0x45, 0x43, 0x33, 0x46, 
+0x28, 0x30, 0x2e, 0x30, 0x66, 0x2c, 0x20, 0x30, 0x2e, 0x30, 0x66, 0x2c, 0x20, 0x30, 0x2e, 
+0x30, 0x66, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x73, 
+0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 
+0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x3d, 0x20, 
+0x4e, 0x45, 0x57, 0x5f, 0x56, 0x45, 0x43, 0x33, 0x46, 0x28, 0x30, 0x2e, 0x30, 0x66, 0x2c, 
+0x20, 0x30, 0x2e, 0x30, 0x66, 0x2c, 0x20, 0x30, 0x2e, 0x30, 0x66, 0x29, 0x3b, 0x0d, 0x0a, 
+0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x44, 0x65, 0x6e, 0x73, 0x69, 0x74, 0x79, 0x20, 0x3d, 0x20, 0x70, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x20, 
+0x2f, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x67, 
+0x61, 0x73, 0x43, 0x6f, 0x6e, 0x73, 0x74, 0x61, 0x6e, 0x74, 0x20, 0x2b, 0x20, 0x70, 0x61, 
+0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x72, 0x65, 0x73, 0x74, 0x44, 
+0x65, 0x6e, 0x73, 0x69, 0x74, 0x79, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x62, 0x6f, 
+0x6f, 0x6c, 0x20, 0x6f, 0x75, 0x74, 0x73, 0x69, 0x64, 0x65, 0x47, 0x72, 0x69, 0x64, 0x42, 
+0x75, 0x63, 0x6b, 0x65, 0x74, 0x56, 0x69, 0x73, 0x69, 0x74, 0x65, 0x64, 0x20, 0x3d, 0x20, 
+0x66, 0x61, 0x6c, 0x73, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 
+0x33, 0x75, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x3b, 0x0d, 0x0a, 
+0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 
+0x6c, 0x2e, 0x78, 0x20, 0x3d, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x43, 0x65, 0x6c, 0x6c, 
+0x2e, 0x78, 0x3b, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x78, 
+0x20, 0x21, 0x3d, 0x20, 0x65, 0x6e, 0x64, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x78, 0x3b, 0x20, 
+0x2b, 0x2b, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x78, 0x29, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 
+0x65, 0x6c, 0x6c, 0x2e, 0x79, 0x20, 0x3d, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x43, 0x65, 
+0x6c, 0x6c, 0x2e, 0x79, 0x3b, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 
+0x2e, 0x79, 0x20, 0x21, 0x3d, 0x20, 0x65, 0x6e, 0x64, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x79, 
+0x3b, 0x20, 0x2b, 0x2b, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x79, 
+0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x6f, 0x74, 0x68, 
+0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x7a, 0x20, 0x3d, 0x20, 0x62, 0x65, 0x67, 0x69, 
+0x6e, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x7a, 0x3b, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 
+0x65, 0x6c, 0x6c, 0x2e, 0x7a, 0x20, 0x21, 0x3d, 0x20, 0x65, 0x6e, 0x64, 0x43, 0x65, 0x6c, 
+0x6c, 0x2e, 0x7a, 0x3b, 0x20, 0x2b, 0x2b, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 
+0x6c, 0x2e, 0x7a, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 
+0x48, 0x61, 0x73, 0x68, 0x4d, 0x6f, 0x64, 0x20, 0x3d, 0x20, 0x47, 0x65, 0x74, 0x43, 0x65, 
+0x6c, 0x6c, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x28, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 
+0x65, 0x6c, 0x6c, 0x2c, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 
+0x7a, 0x65, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x29, 
+0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x2f, 0x2f, 0x57, 0x69, 0x74, 
+0x68, 0x20, 0x74, 0x68, 0x65, 0x20, 0x64, 0x65, 0x6e, 0x73, 0x65, 0x20, 0x67, 0x72, 0x69, 
+0x64, 0x20, 0x61, 0x6c, 0x6c, 0x20, 0x63, 0x65, 0x6c, 0x6c, 0x73, 0x20, 0x6f, 0x75, 0x74, 
+0x73, 0x69, 0x64, 0x65, 0x20, 0x6f, 0x66, 0x20, 0x69, 0x74, 0x20, 0x73, 0x68, 0x61, 0x72, 
+0x65, 0x20, 0x6f, 0x6e, 0x65, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x2c, 0x20, 0x69, 
+0x74, 0x20, 0x6d, 0x75, 0x73, 0x74, 0x20, 0x62, 0x65, 0x20, 0x63, 0x68, 0x65, 0x63, 0x6b, 
+0x65, 0x64, 0x20, 0x6f, 0x6e, 0x6c, 0x79, 0x20, 0x6f, 0x6e, 0x63, 0x65, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x49, 0x73, 0x4f, 0x75, 0x74, 0x73, 0x69, 
+0x64, 0x65, 0x47, 0x72, 0x69, 0x64, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x28, 0x6f, 0x74, 
+0x68, 0x65, 0x72, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x6f, 0x64, 0x2c, 0x20, 0x64, 0x79, 0x6e, 
+0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 
+0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 
+0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x29, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x6f, 0x75, 
+0x74, 0x73, 0x69, 0x64, 0x65, 0x47, 0x72, 0x69, 0x64, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 
+0x56, 0x69, 0x73, 0x69, 0x74, 0x65, 0x64, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x63, 0x6f, 0x6e, 0x74, 0x69, 0x6e, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x6f, 0x75, 0x74, 0x73, 0x69, 0x64, 0x65, 0x47, 0x72, 
+0x69, 0x64, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x56, 0x69, 0x73, 0x69, 0x74, 0x65, 0x64, 
+0x20, 0x3d, 0x20, 0x74, 0x72, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 
+0x32, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 
+0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x5b, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x48, 0x61, 
+0x73, 0x68, 0x4d, 0x6f, 0x64, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x75, 
+0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 
+0x3d, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x5b, 0x6f, 0x74, 0x68, 0x65, 0x72, 
+0x48, 0x61, 0x73, 0x68, 0x4d, 0x6f, 0x64, 0x20, 0x2b, 0x20, 0x31, 0x5d, 0x3b, 0x0d, 0x0a, 
 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x75, 0x69, 0x6e, 
 0x74, 0x33, 0x32, 0x20, 0x69, 0x20, 0x3d, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 0x6e, 
 0x64, 0x65, 0x78, 0x3b, 0x20, 0x69, 0x20, 0x3c, 0x20, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 
 0x65, 0x78, 0x3b, 0x20, 0x2b, 0x2b, 0x69, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 
-0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 
-0x4e, 0x54, 0x20, 0x53, 0x54, 0x52, 0x55, 0x43, 0x54, 0x20, 0x53, 0x74, 0x61, 0x74, 0x69, 
-0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x2a, 0x20, 0x6f, 0x74, 0x68, 0x65, 
-0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x74, 0x72, 0x20, 0x3d, 0x20, 
-0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 
-0x20, 0x2b, 0x20, 0x69, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
-0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x64, 0x69, 0x72, 0x20, 0x3d, 0x20, 0x6f, 0x74, 0x68, 
-0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x74, 0x72, 0x2d, 0x3e, 
-0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x41, 0x6e, 0x64, 0x50, 0x72, 0x65, 0x73, 
-0x73, 0x75, 0x72, 0x65, 0x2e, 0x78, 0x79, 0x7a, 0x28, 0x29, 0x20, 0x2d, 0x20, 0x70, 0x61, 
-0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x3b, 
-0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 
-0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x20, 0x3d, 0x20, 0x64, 0x6f, 0x74, 0x28, 0x64, 0x69, 
-0x72, 0x2c, 0x20, 0x64, 0x69, 0x72, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
-0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x20, 
-0x3e, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 
-0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 
-0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 
+0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 
+0x20, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x4d, 0x61, 0x70, 0x5b, 0x69, 0x5d, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 
+0x3d, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x64, 
+0x65, 0x78, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 
+0x74, 0x69, 0x6e, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x20, 0x3d, 
+0x20, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x5b, 0x69, 
+0x6e, 0x64, 0x65, 0x78, 0x5d, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x41, 
+0x6e, 0x64, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x2e, 0x77, 0x3b, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x6f, 0x74, 0x68, 
+0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 
+0x69, 0x6f, 0x6e, 0x20, 0x3d, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x73, 0x5b, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 
+0x69, 0x6f, 0x6e, 0x41, 0x6e, 0x64, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x2e, 
+0x78, 0x79, 0x7a, 0x28, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x56, 
+0x65, 0x63, 0x33, 0x66, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x56, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x20, 0x3d, 0x20, 0x69, 
+0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x5b, 0x69, 0x6e, 0x64, 0x65, 
+0x78, 0x5d, 0x2e, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x41, 0x6e, 0x64, 0x48, 
+0x61, 0x73, 0x68, 0x2e, 0x78, 0x79, 0x7a, 0x28, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x64, 0x69, 0x72, 0x20, 
+0x3d, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x2d, 0x20, 0x70, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x3b, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x69, 0x73, 
+0x74, 0x53, 0x71, 0x72, 0x20, 0x3d, 0x20, 0x64, 0x6f, 0x74, 0x28, 0x64, 0x69, 0x72, 0x2c, 
+0x20, 0x64, 0x69, 0x72, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x69, 0x66, 0x20, 0x28, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x20, 0x3e, 0x20, 
+0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 
+0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 
+0x61, 0x6e, 0x63, 0x65, 0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 
+0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 
+0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x74, 0x69, 0x6e, 0x75, 0x65, 0x3b, 
+0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 
+0x20, 0x64, 0x69, 0x73, 0x74, 0x20, 0x3d, 0x20, 0x73, 0x71, 0x72, 0x74, 0x28, 0x64, 0x69, 
+0x73, 0x74, 0x53, 0x71, 0x72, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x20, 0x3d, 
+0x3d, 0x20, 0x30, 0x20, 0x7c, 0x7c, 0x20, 0x64, 0x69, 0x73, 0x74, 0x20, 0x3d, 0x3d, 0x20, 
+0x30, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x64, 0x69, 0x72, 0x20, 0x3d, 0x20, 0x52, 0x61, 0x6e, 0x64, 
+0x6f, 0x6d, 0x44, 0x69, 0x72, 0x65, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x28, 0x28, 0x66, 0x6c, 
+0x6f, 0x61, 0x74, 0x29, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x29, 0x3b, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x70, 0x72, 0x69, 0x6e, 0x74, 0x66, 0x28, 
+0x22, 0x54, 0x77, 0x6f, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x20, 0x70, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x20, 0x68, 0x61, 0x76, 0x65, 0x20, 0x74, 0x68, 
+0x65, 0x20, 0x73, 0x61, 0x6d, 0x65, 0x20, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 
+0x2e, 0x20, 0x53, 0x69, 0x6d, 0x75, 0x6c, 0x61, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x77, 0x6f, 
+0x6e, 0x74, 0x20, 0x62, 0x65, 0x20, 0x64, 0x65, 0x74, 0x65, 0x72, 0x6d, 0x69, 0x6e, 0x69, 
+0x73, 0x74, 0x69, 0x63, 0x2e, 0x20, 0x46, 0x69, 0x72, 0x73, 0x74, 0x20, 0x70, 0x6f, 0x73, 
+0x69, 0x74, 0x69, 0x6f, 0x6e, 0x3a, 0x20, 0x25, 0x20, 0x33, 0x2e, 0x33, 0x76, 0x33, 0x66, 
+0x3b, 0x20, 0x73, 0x65, 0x63, 0x6f, 0x6e, 0x64, 0x20, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 
+0x6f, 0x6e, 0x3a, 0x20, 0x25, 0x20, 0x33, 0x2e, 0x33, 0x76, 0x33, 0x66, 0x3b, 0x20, 0x69, 
+0x31, 0x3a, 0x20, 0x25, 0x75, 0x3b, 0x20, 0x69, 0x32, 0x3a, 0x20, 0x25, 0x75, 0x22, 0x2c, 
+0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 
+0x6f, 0x6e, 0x2c, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x2c, 0x20, 0x69, 0x6e, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x2c, 0x20, 0x69, 
+0x6e, 0x64, 0x65, 0x78, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7d, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x65, 0x6c, 0x73, 0x65, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x64, 0x69, 0x72, 0x20, 0x2f, 0x3d, 0x20, 0x64, 0x69, 
+0x73, 0x74, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x2f, 0x2f, 
+0x61, 0x70, 0x70, 0x6c, 0x79, 0x20, 0x70, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x20, 
+0x66, 0x6f, 0x72, 0x63, 0x65, 0x09, 0x09, 0x09, 0x09, 0x09, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 
+0x65, 0x20, 0x2b, 0x3d, 0x20, 0x64, 0x69, 0x72, 0x20, 0x2a, 0x20, 0x28, 0x70, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x20, 0x2b, 
+0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 
+0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x29, 0x20, 0x2a, 0x20, 0x53, 0x6d, 0x6f, 0x6f, 
+0x74, 0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x44, 0x31, 0x28, 0x64, 
+0x69, 0x73, 0x74, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 
+0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 
+0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x2f, 0x2f, 0x61, 0x70, 0x70, 0x6c, 0x79, 0x20, 0x76, 
+0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x20, 0x66, 0x6f, 0x72, 0x63, 0x65, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x64, 0x79, 0x6e, 
+0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 
+0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x2b, 0x3d, 0x20, 
+0x28, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 
+0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x20, 0x2d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x56, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x29, 0x20, 0x2a, 0x20, 
+0x53, 0x6d, 0x6f, 0x6f, 0x74, 0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 
+0x44, 0x32, 0x28, 0x64, 0x69, 0x73, 0x74, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 
 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 
-0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x0d, 
-0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x74, 0x69, 0x6e, 0x75, 
-0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6c, 0x6f, 
-0x61, 0x74, 0x20, 0x64, 0x69, 0x73, 0x74, 0x20, 0x3d, 0x20, 0x73, 0x71, 0x72, 0x74, 0x28, 
-0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 
-0x09, 0x09, 0x09, 0x09, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 
-0x63, 0x6c, 0x65, 0x49, 0x6e, 0x66, 0x6c, 0x75, 0x65, 0x6e, 0x63, 0x65, 0x53, 0x75, 0x6d, 
-0x20, 0x2b, 0x3d, 0x20, 0x53, 0x6d, 0x6f, 0x6f, 0x74, 0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 
-0x72, 0x6e, 0x65, 0x6c, 0x44, 0x30, 0x28, 0x64, 0x69, 0x73, 0x74, 0x2c, 0x20, 0x70, 0x61, 
-0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 
-0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 
-0x63, 0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 
-0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 
-0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x44, 0x65, 0x6e, 0x73, 0x69, 0x74, 
-0x79, 0x20, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 
-0x3e, 0x73, 0x65, 0x6c, 0x66, 0x44, 0x65, 0x6e, 0x73, 0x69, 0x74, 0x79, 0x20, 0x2b, 0x20, 
-0x28, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
-0x65, 0x49, 0x6e, 0x66, 0x6c, 0x75, 0x65, 0x6e, 0x63, 0x65, 0x53, 0x75, 0x6d, 0x20, 0x2a, 
+0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x3b, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x20, 0x3d, 0x3d, 0x20, 
+0x30, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x74, 0x69, 
+0x6e, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x6f, 0x74, 
+0x68, 0x65, 0x72, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x6f, 0x64, 0x20, 0x3d, 0x20, 0x47, 0x65, 
+0x74, 0x43, 0x65, 0x6c, 0x6c, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x28, 0x6f, 0x74, 0x68, 
+0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2c, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 
+0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 
+0x73, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x62, 0x65, 0x67, 0x69, 0x6e, 
+0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 
+0x5b, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x6f, 0x64, 0x5d, 0x3b, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 
+0x20, 0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x5b, 0x6f, 0x74, 0x68, 0x65, 
+0x72, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x6f, 0x64, 0x20, 0x2b, 0x20, 0x31, 0x5d, 0x3b, 0x0d, 
+0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x75, 0x69, 
+0x6e, 0x74, 0x33, 0x32, 0x20, 0x69, 0x20, 0x3d, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 
+0x6e, 0x64, 0x65, 0x78, 0x3b, 0x20, 0x69, 0x20, 0x3c, 0x20, 0x65, 0x6e, 0x64, 0x49, 0x6e, 
+0x64, 0x65, 0x78, 0x3b, 0x20, 0x2b, 0x2b, 0x69, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x53, 0x54, 0x52, 0x55, 0x43, 
+0x54, 0x20, 0x53, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x20, 0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x73, 0x5b, 0x69, 0x5d, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x64, 0x69, 0x72, 0x20, 0x3d, 0x20, 0x6f, 
+0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x2e, 0x70, 0x6f, 
+0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x41, 0x6e, 0x64, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 
+0x72, 0x65, 0x2e, 0x78, 0x79, 0x7a, 0x28, 0x29, 0x20, 0x2d, 0x20, 0x70, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x3b, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x69, 0x73, 
+0x74, 0x53, 0x71, 0x72, 0x20, 0x3d, 0x20, 0x64, 0x6f, 0x74, 0x28, 0x64, 0x69, 0x72, 0x2c, 
+0x20, 0x64, 0x69, 0x72, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x69, 0x66, 0x20, 0x28, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x20, 0x3e, 0x20, 
+0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 
+0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 
+0x61, 0x6e, 0x63, 0x65, 0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 
+0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 
+0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x74, 0x69, 0x6e, 0x75, 0x65, 0x3b, 
+0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 
+0x20, 0x64, 0x69, 0x73, 0x74, 0x20, 0x3d, 0x20, 0x73, 0x71, 0x72, 0x74, 0x28, 0x64, 0x69, 
+0x73, 0x74, 0x53, 0x71, 0x72, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x20, 0x3d, 
+0x3d, 0x20, 0x30, 0x20, 0x7c, 0x7c, 0x20, 0x64, 0x69, 0x73, 0x74, 0x20, 0x3d, 0x3d, 0x20, 
+0x30, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x64, 0x69, 0x72, 0x20, 0x3d, 0x20, 0x52, 0x61, 0x6e, 0x64, 
+0x6f, 0x6d, 0x44, 0x69, 0x72, 0x65, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x28, 0x28, 0x66, 0x6c, 
+0x6f, 0x61, 0x74, 0x29, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x29, 0x3b, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x70, 0x72, 0x69, 0x6e, 0x74, 0x66, 0x28, 
+0x22, 0x41, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x20, 0x70, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x20, 0x61, 0x6e, 0x64, 0x20, 0x61, 0x20, 0x73, 0x74, 0x61, 0x74, 
+0x69, 0x63, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x20, 0x68, 0x61, 0x76, 
+0x65, 0x20, 0x74, 0x68, 0x65, 0x20, 0x73, 0x61, 0x6d, 0x65, 0x20, 0x70, 0x6f, 0x73, 0x69, 
+0x74, 0x69, 0x6f, 0x6e, 0x2e, 0x20, 0x53, 0x69, 0x6d, 0x75, 0x6c, 0x61, 0x74, 0x69, 0x6f, 
+0x6e, 0x20, 0x77, 0x6f, 0x6e, 0x74, 0x20, 0x62, 0x65, 0x20, 0x64, 0x65, 0x74, 0x65, 0x72, 
+0x6d, 0x69, 0x6e, 0x69, 0x73, 0x74, 0x69, 0x63, 0x2e, 0x20, 0x46, 0x69, 0x72, 0x73, 0x74, 
+0x20, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x3a, 0x20, 0x25, 0x20, 0x33, 0x2e, 
+0x33, 0x76, 0x33, 0x66, 0x3b, 0x20, 0x73, 0x65, 0x63, 0x6f, 0x6e, 0x64, 0x20, 0x70, 0x6f, 
+0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x3a, 0x20, 0x25, 0x20, 0x33, 0x2e, 0x33, 0x76, 0x33, 
+0x66, 0x22, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 
+0x69, 0x74, 0x69, 0x6f, 0x6e, 0x2c, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x41, 
+0x6e, 0x64, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x2e, 0x78, 0x79, 0x7a, 0x28, 
+0x29, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x65, 0x6c, 0x73, 0x65, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x64, 0x69, 0x72, 0x20, 0x2f, 0x3d, 0x20, 0x64, 0x69, 0x73, 0x74, 0x3b, 
+0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x2f, 0x2f, 0x61, 0x70, 0x70, 
+0x6c, 0x79, 0x20, 0x70, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x20, 0x66, 0x6f, 0x72, 
+0x63, 0x65, 0x09, 0x09, 0x09, 0x09, 0x09, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 
+0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x2b, 0x3d, 
+0x20, 0x64, 0x69, 0x72, 0x20, 0x2a, 0x20, 0x66, 0x61, 0x62, 0x73, 0x28, 0x70, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x29, 0x20, 
+0x2a, 0x20, 0x53, 0x6d, 0x6f, 0x6f, 0x74, 0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 0x6e, 
+0x65, 0x6c, 0x44, 0x31, 0x28, 0x64, 0x69, 0x73, 0x74, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 
+0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 
+0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 
+0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x2f, 0x2f, 0x61, 
+0x70, 0x70, 0x6c, 0x79, 0x20, 0x76, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x20, 
+0x66, 0x6f, 0x72, 0x63, 0x65, 0x09, 0x09, 0x09, 0x09, 0x09, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 
+0x65, 0x20, 0x2b, 0x3d, 0x20, 0x2d, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 
+0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x20, 0x2a, 0x20, 0x53, 0x6d, 0x6f, 0x6f, 0x74, 
+0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x44, 0x32, 0x28, 0x64, 0x69, 
+0x73, 0x74, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 
+0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 
+0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 
+0x09, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 
+0x2a, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 
+0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x73, 0x73, 0x20, 0x2f, 0x20, 
+0x28, 0x32, 0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x44, 0x65, 
+0x6e, 0x73, 0x69, 0x74, 0x79, 0x29, 0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 
+0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x73, 0x6d, 0x6f, 0x6f, 0x74, 0x68, 0x69, 0x6e, 0x67, 
+0x4b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x43, 0x6f, 0x6e, 0x73, 0x74, 0x61, 0x6e, 0x74, 0x3b, 
+0x0d, 0x0a, 0x09, 0x09, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 
+0x72, 0x63, 0x65, 0x20, 0x2a, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 
+0x72, 0x73, 0x2d, 0x3e, 0x76, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x20, 0x2a, 
 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x70, 0x61, 
-0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x73, 0x73, 0x20, 0x2b, 0x20, 0x73, 0x74, 
-0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x66, 
-0x6c, 0x75, 0x65, 0x6e, 0x63, 0x65, 0x53, 0x75, 0x6d, 0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 
-0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 
-0x6c, 0x65, 0x4d, 0x61, 0x73, 0x73, 0x29, 0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x73, 0x73, 0x20, 0x2a, 0x20, 0x70, 0x61, 
+0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x73, 0x6d, 0x6f, 0x6f, 0x74, 
+0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x43, 0x6f, 0x6e, 0x73, 0x74, 
+0x61, 0x6e, 0x74, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 
+0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x2a, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 
+0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 
+0x61, 0x73, 0x73, 0x20, 0x2f, 0x20, 0x28, 0x32, 0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x44, 0x65, 0x6e, 0x73, 0x69, 0x74, 0x79, 0x29, 0x20, 0x2a, 0x20, 
+0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x73, 0x6d, 0x6f, 
+0x6f, 0x74, 0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x43, 0x6f, 0x6e, 
+0x73, 0x74, 0x61, 0x6e, 0x74, 0x20, 0x2a, 0x20, 0x31, 0x2e, 0x30, 0x66, 0x3b, 0x0d, 0x0a, 
+0x09, 0x09, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 
+0x20, 0x2a, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 
+0x3e, 0x76, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x20, 0x2a, 0x20, 0x70, 0x61, 
+0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x70, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x4d, 0x61, 0x73, 0x73, 0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 
 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x73, 0x6d, 0x6f, 0x6f, 0x74, 0x68, 0x69, 0x6e, 
 0x67, 0x4b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x43, 0x6f, 0x6e, 0x73, 0x74, 0x61, 0x6e, 0x74, 
-0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x70, 0x61, 0x72, 0x74, 
-0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x20, 0x3d, 0x20, 
-0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x67, 0x61, 0x73, 
-0x43, 0x6f, 0x6e, 0x73, 0x74, 0x61, 0x6e, 0x74, 0x20, 0x2a, 0x20, 0x28, 0x70, 0x61, 0x72, 
-0x74, 0x69, 0x63, 0x6c, 0x65, 0x44, 0x65, 0x6e, 0x73, 0x69, 0x74, 0x79, 0x20, 0x2d, 0x20, 
-0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x72, 0x65, 0x73, 
-0x74, 0x44, 0x65, 0x6e, 0x73, 0x69, 0x74, 0x79, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 
-0x09, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x74, 0x72, 
-0x2d, 0x3e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x41, 0x6e, 0x64, 0x50, 0x72, 
-0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x2e, 0x77, 0x20, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x74, 
-0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x3b, 0x0d, 0x0a, 
-0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x76, 0x6f, 0x69, 0x64, 0x20, 0x4b, 0x45, 0x52, 
-0x4e, 0x45, 0x4c, 0x20, 0x55, 0x70, 0x64, 0x61, 0x74, 0x65, 0x50, 0x61, 0x72, 0x74, 0x69, 
-0x63, 0x6c, 0x65, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x73, 0x28, 0x0d, 0x0a, 0x09, 
-0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 
-0x44, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x64, 0x79, 
-0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x43, 
-0x6f, 0x75, 0x6e, 0x74, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 
+0x20, 0x2a, 0x20, 0x30, 0x2e, 0x30, 0x66, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x56, 
+0x65, 0x63, 0x33, 0x66, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x46, 0x6f, 
+0x72, 0x63, 0x65, 0x20, 0x3d, 0x20, 0x4e, 0x45, 0x57, 0x5f, 0x56, 0x45, 0x43, 0x33, 0x46, 
+0x28, 0x30, 0x2c, 0x20, 0x30, 0x2c, 0x20, 0x30, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x70, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x2b, 0x3d, 
 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
-0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x0d, 
-0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 
-0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x43, 0x6f, 0x75, 0x6e, 0x74, 
+0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x3b, 
+0x0d, 0x0a, 0x09, 0x09, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x46, 0x6f, 0x72, 
+0x63, 0x65, 0x20, 0x2b, 0x3d, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 
+0x46, 0x6f, 0x72, 0x63, 0x65, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x70, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x2b, 0x3d, 0x20, 0x73, 0x74, 0x61, 
+0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 
+0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x70, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x2b, 0x3d, 
+0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x3b, 
+0x0d, 0x0a, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 
+0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x20, 0x21, 0x3d, 0x20, 0x30, 0x29, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 
+0x20, 0x2b, 0x3d, 0x20, 0x43, 0x61, 0x6c, 0x63, 0x75, 0x6c, 0x61, 0x74, 0x65, 0x42, 0x6f, 
+0x75, 0x6e, 0x64, 0x61, 0x72, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x28, 0x70, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x2c, 0x20, 
+0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 
+0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x48, 
+0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 
+0x65, 0x4d, 0x61, 0x70, 0x2c, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x73, 
+0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x61, 0x63, 0x63, 
+0x65, 0x6c, 0x65, 0x72, 0x61, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x3d, 0x20, 0x70, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x2f, 0x20, 0x70, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x44, 0x65, 0x6e, 0x73, 0x69, 0x74, 0x79, 0x20, 0x2b, 
+0x20, 0x4e, 0x45, 0x57, 0x5f, 0x56, 0x45, 0x43, 0x33, 0x46, 0x28, 0x70, 0x61, 0x72, 0x61, 
+0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x67, 0x72, 0x61, 0x76, 0x69, 0x74, 0x79, 
+0x58, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 
+0x67, 0x72, 0x61, 0x76, 0x69, 0x74, 0x79, 0x59, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 
+0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x67, 0x72, 0x61, 0x76, 0x69, 0x74, 0x79, 0x5a, 
+0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x2f, 0x2f, 0x49, 0x6e, 0x74, 0x65, 0x67, 
+0x72, 0x61, 0x74, 0x65, 0x0d, 0x0a, 0x09, 0x09, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x56, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x20, 0x2b, 0x3d, 0x20, 0x61, 0x63, 
+0x63, 0x65, 0x6c, 0x65, 0x72, 0x61, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x2a, 0x20, 0x64, 0x65, 
+0x6c, 0x74, 0x61, 0x54, 0x69, 0x6d, 0x65, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x70, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x2b, 
+0x3d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x65, 0x6c, 0x6f, 0x63, 
+0x69, 0x74, 0x79, 0x20, 0x2a, 0x20, 0x64, 0x65, 0x6c, 0x74, 0x61, 0x54, 0x69, 0x6d, 0x65, 
+0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x65, 0x6c, 0x6c, 0x20, 0x3d, 0x20, 0x47, 
+0x65, 0x74, 0x43, 0x65, 0x6c, 0x6c, 0x28, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 
+0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 
+0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 
+0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x48, 0x61, 
+0x73, 0x68, 0x20, 0x3d, 0x20, 0x47, 0x65, 0x74, 0x43, 0x65, 0x6c, 0x6c, 0x42, 0x75, 0x63, 
+0x6b, 0x65, 0x74, 0x28, 0x63, 0x65, 0x6c, 0x6c, 0x2c, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 
+0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 
+0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 
+0x74, 0x65, 0x72, 0x73, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x23, 0x69, 0x66, 0x64, 0x65, 
+0x66, 0x20, 0x43, 0x4c, 0x5f, 0x43, 0x4f, 0x4d, 0x50, 0x49, 0x4c, 0x45, 0x52, 0x0d, 0x0a, 
+0x09, 0x09, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x74, 
+0x72, 0x2d, 0x3e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x41, 0x6e, 0x64, 0x50, 
+0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x2e, 0x78, 0x79, 0x7a, 0x20, 0x3d, 0x20, 0x70, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 
+0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x50, 0x74, 0x72, 0x2d, 0x3e, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x41, 
+0x6e, 0x64, 0x48, 0x61, 0x73, 0x68, 0x2e, 0x78, 0x79, 0x7a, 0x20, 0x3d, 0x20, 0x70, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x3b, 
+0x0d, 0x0a, 0x09, 0x09, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x50, 0x74, 0x72, 0x2d, 0x3e, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x41, 0x6e, 
+0x64, 0x48, 0x61, 0x73, 0x68, 0x2e, 0x77, 0x20, 0x3d, 0x20, 0x61, 0x73, 0x5f, 0x66, 0x6c, 
+0x6f, 0x61, 0x74, 0x28, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x48, 0x61, 0x73, 
+0x68, 0x29, 0x3b, 0x0d, 0x0a, 0x23, 0x65, 0x6c, 0x73, 0x65, 0x0d, 0x0a, 0x09, 0x09, 0x6f, 
+0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x74, 0x72, 0x2d, 0x3e, 
+0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x41, 0x6e, 0x64, 0x50, 0x72, 0x65, 0x73, 
+0x73, 0x75, 0x72, 0x65, 0x20, 0x3d, 0x20, 0x56, 0x65, 0x63, 0x34, 0x66, 0x28, 0x70, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x2c, 
+0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 
+0x72, 0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x50, 0x74, 0x72, 0x2d, 0x3e, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 
+0x74, 0x79, 0x41, 0x6e, 0x64, 0x48, 0x61, 0x73, 0x68, 0x20, 0x3d, 0x20, 0x56, 0x65, 0x63, 
+0x34, 0x66, 0x28, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x65, 0x6c, 0x6f, 
+0x63, 0x69, 0x74, 0x79, 0x2c, 0x20, 0x2a, 0x28, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x2a, 0x29, 
+0x26, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x29, 0x3b, 
+0x0d, 0x0a, 0x23, 0x65, 0x6e, 0x64, 0x69, 0x66, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 
+0x0a, 0x0d, 0x0a, 0x23, 0x69, 0x66, 0x64, 0x65, 0x66, 0x20, 0x43, 0x4c, 0x5f, 0x43, 0x4f, 
+0x4d, 0x50, 0x49, 0x4c, 0x45, 0x52, 0x0d, 0x0a, 0x09, 0x2f, 0x2a, 0x0d, 0x0a, 0x09, 0x09, 
+0x56, 0x65, 0x72, 0x73, 0x69, 0x6f, 0x6e, 0x73, 0x20, 0x6f, 0x66, 0x20, 0x55, 0x70, 0x64, 
+0x61, 0x74, 0x65, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 
+0x73, 0x75, 0x72, 0x65, 0x20, 0x61, 0x6e, 0x64, 0x20, 0x55, 0x70, 0x64, 0x61, 0x74, 0x65, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 
+0x73, 0x20, 0x74, 0x68, 0x61, 0x74, 0x20, 0x73, 0x74, 0x61, 0x67, 0x65, 0x20, 0x74, 0x68, 
+0x65, 0x20, 0x6e, 0x65, 0x69, 0x67, 0x68, 0x62, 0x6f, 0x75, 0x72, 0x73, 0x20, 0x69, 0x6e, 
+0x20, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x20, 0x6d, 0x65, 0x6d, 0x6f, 0x72, 0x79, 0x2e, 0x20, 
+0x41, 0x20, 0x77, 0x6f, 0x72, 0x6b, 0x0d, 0x0a, 0x09, 0x09, 0x67, 0x72, 0x6f, 0x75, 0x70, 
+0x20, 0x65, 0x76, 0x61, 0x6c, 0x75, 0x61, 0x74, 0x65, 0x73, 0x20, 0x74, 0x68, 0x65, 0x20, 
+0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x20, 0x6f, 0x66, 0x20, 0x6f, 0x6e, 
+0x65, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x20, 0x6f, 0x66, 0x20, 0x74, 0x68, 0x65, 
+0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x73, 0x20, 0x68, 0x61, 0x73, 0x68, 0x20, 0x6d, 0x61, 0x70, 0x20, 0x61, 0x74, 
+0x20, 0x61, 0x20, 0x74, 0x69, 0x6d, 0x65, 0x2c, 0x20, 0x74, 0x68, 0x65, 0x73, 0x65, 0x20, 
+0x61, 0x6c, 0x6c, 0x20, 0x68, 0x61, 0x76, 0x65, 0x20, 0x74, 0x68, 0x65, 0x20, 0x73, 0x61, 
+0x6d, 0x65, 0x0d, 0x0a, 0x09, 0x09, 0x6e, 0x65, 0x69, 0x67, 0x68, 0x62, 0x6f, 0x75, 0x72, 
+0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x2e, 0x20, 0x54, 0x68, 0x65, 0x20, 0x70, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x20, 0x6f, 0x66, 0x20, 0x65, 0x76, 0x65, 
+0x72, 0x79, 0x20, 0x6e, 0x65, 0x69, 0x67, 0x68, 0x62, 0x6f, 0x75, 0x72, 0x20, 0x62, 0x75, 
+0x63, 0x6b, 0x65, 0x74, 0x20, 0x61, 0x72, 0x65, 0x20, 0x6c, 0x6f, 0x61, 0x64, 0x65, 0x64, 
+0x20, 0x69, 0x6e, 0x74, 0x6f, 0x20, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x20, 0x6d, 0x65, 0x6d, 
+0x6f, 0x72, 0x79, 0x20, 0x69, 0x6e, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x73, 0x20, 0x6f, 0x66, 
+0x20, 0x6f, 0x6e, 0x65, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x0d, 0x0a, 
+0x09, 0x09, 0x70, 0x65, 0x72, 0x20, 0x77, 0x6f, 0x72, 0x6b, 0x20, 0x69, 0x74, 0x65, 0x6d, 
+0x20, 0x61, 0x6e, 0x64, 0x20, 0x65, 0x76, 0x65, 0x72, 0x79, 0x20, 0x77, 0x6f, 0x72, 0x6b, 
+0x20, 0x69, 0x74, 0x65, 0x6d, 0x20, 0x6f, 0x66, 0x20, 0x74, 0x68, 0x65, 0x20, 0x67, 0x72, 
+0x6f, 0x75, 0x70, 0x20, 0x72, 0x65, 0x61, 0x64, 0x73, 0x20, 0x74, 0x68, 0x65, 0x6d, 0x20, 
+0x66, 0x72, 0x6f, 0x6d, 0x20, 0x74, 0x68, 0x65, 0x72, 0x65, 0x20, 0x69, 0x6e, 0x73, 0x74, 
+0x65, 0x61, 0x64, 0x20, 0x6f, 0x66, 0x20, 0x66, 0x72, 0x6f, 0x6d, 0x20, 0x67, 0x6c, 0x6f, 
+0x62, 0x61, 0x6c, 0x20, 0x6d, 0x65, 0x6d, 0x6f, 0x72, 0x79, 0x2e, 0x20, 0x57, 0x68, 0x65, 
+0x6e, 0x20, 0x68, 0x61, 0x73, 0x68, 0x65, 0x73, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6c, 
+0x6c, 0x69, 0x64, 0x65, 0x20, 0x61, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x20, 0x68, 
+0x6f, 0x6c, 0x64, 0x73, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x20, 
+0x6f, 0x66, 0x20, 0x64, 0x69, 0x66, 0x66, 0x65, 0x72, 0x65, 0x6e, 0x74, 0x20, 0x63, 0x65, 
+0x6c, 0x6c, 0x73, 0x2c, 0x20, 0x74, 0x68, 0x65, 0x69, 0x72, 0x20, 0x6e, 0x65, 0x69, 0x67, 
+0x68, 0x62, 0x6f, 0x75, 0x72, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x20, 0x64, 
+0x69, 0x66, 0x66, 0x65, 0x72, 0x2c, 0x20, 0x73, 0x6f, 0x20, 0x74, 0x68, 0x65, 0x20, 0x63, 
+0x65, 0x6c, 0x6c, 0x73, 0x20, 0x6f, 0x66, 0x20, 0x61, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 
+0x74, 0x0d, 0x0a, 0x09, 0x09, 0x61, 0x72, 0x65, 0x20, 0x65, 0x76, 0x61, 0x6c, 0x75, 0x61, 
+0x74, 0x65, 0x64, 0x20, 0x6f, 0x6e, 0x65, 0x20, 0x61, 0x66, 0x74, 0x65, 0x72, 0x20, 0x61, 
+0x6e, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x2e, 0x20, 0x54, 0x68, 0x65, 0x20, 0x77, 0x6f, 0x72, 
+0x6b, 0x20, 0x67, 0x72, 0x6f, 0x75, 0x70, 0x73, 0x20, 0x74, 0x61, 0x6b, 0x65, 0x20, 0x74, 
+0x68, 0x65, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x20, 0x6c, 0x69, 0x73, 0x74, 
+0x65, 0x64, 0x20, 0x62, 0x79, 0x20, 0x4c, 0x69, 0x73, 0x74, 0x4f, 0x63, 0x63, 0x75, 0x70, 
+0x69, 0x65, 0x64, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x20, 0x69, 0x6e, 0x20, 0x74, 
+0x75, 0x72, 0x6e, 0x73, 0x2e, 0x20, 0x54, 0x68, 0x65, 0x0d, 0x0a, 0x09, 0x09, 0x6e, 0x65, 
+0x69, 0x67, 0x68, 0x62, 0x6f, 0x75, 0x72, 0x73, 0x20, 0x61, 0x72, 0x65, 0x20, 0x76, 0x69, 
+0x73, 0x69, 0x74, 0x65, 0x64, 0x20, 0x69, 0x6e, 0x20, 0x74, 0x68, 0x65, 0x20, 0x73, 0x61, 
+0x6d, 0x65, 0x20, 0x6f, 0x72, 0x64, 0x65, 0x72, 0x20, 0x61, 0x73, 0x20, 0x62, 0x79, 0x20, 
+0x74, 0x68, 0x65, 0x20, 0x6b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x73, 0x20, 0x61, 0x62, 0x6f, 
+0x76, 0x65, 0x0d, 0x0a, 0x09, 0x2a, 0x2f, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x2f, 0x2f, 0x57, 
+0x72, 0x69, 0x74, 0x65, 0x73, 0x20, 0x74, 0x68, 0x65, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 
+0x74, 0x73, 0x20, 0x6f, 0x66, 0x20, 0x74, 0x68, 0x65, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 
+0x69, 0x63, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x20, 0x68, 0x61, 
+0x73, 0x68, 0x20, 0x6d, 0x61, 0x70, 0x20, 0x74, 0x68, 0x61, 0x74, 0x20, 0x68, 0x6f, 0x6c, 
+0x64, 0x20, 0x61, 0x6e, 0x79, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 
+0x20, 0x69, 0x6e, 0x74, 0x6f, 0x20, 0x27, 0x6f, 0x63, 0x63, 0x75, 0x70, 0x69, 0x65, 0x64, 
+0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x27, 0x20, 0x69, 0x6e, 0x20, 0x6e, 0x6f, 0x0d, 
+0x0a, 0x09, 0x2f, 0x2f, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x75, 0x6c, 0x61, 0x72, 0x20, 
+0x6f, 0x72, 0x64, 0x65, 0x72, 0x2e, 0x20, 0x27, 0x6f, 0x63, 0x63, 0x75, 0x70, 0x69, 0x65, 
+0x64, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x27, 0x20, 0x6d, 
+0x75, 0x73, 0x74, 0x20, 0x62, 0x65, 0x20, 0x30, 0x20, 0x62, 0x65, 0x66, 0x6f, 0x72, 0x65, 
+0x0d, 0x0a, 0x09, 0x76, 0x6f, 0x69, 0x64, 0x20, 0x6b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x20, 
+0x4c, 0x69, 0x73, 0x74, 0x4f, 0x63, 0x63, 0x75, 0x70, 0x69, 0x65, 0x64, 0x42, 0x75, 0x63, 
+0x6b, 0x65, 0x74, 0x73, 0x28, 0x67, 0x6c, 0x6f, 0x62, 0x61, 0x6c, 0x20, 0x75, 0x69, 0x6e, 
+0x74, 0x2a, 0x20, 0x6f, 0x63, 0x63, 0x75, 0x70, 0x69, 0x65, 0x64, 0x42, 0x75, 0x63, 0x6b, 
+0x65, 0x74, 0x73, 0x2c, 0x20, 0x76, 0x6f, 0x6c, 0x61, 0x74, 0x69, 0x6c, 0x65, 0x20, 0x67, 
+0x6c, 0x6f, 0x62, 0x61, 0x6c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x2a, 0x20, 0x6f, 0x63, 0x63, 
+0x75, 0x70, 0x69, 0x65, 0x64, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x43, 0x6f, 0x75, 0x6e, 
+0x74, 0x2c, 0x20, 0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 0x20, 0x48, 0x41, 0x53, 
+0x48, 0x5f, 0x54, 0x59, 0x50, 0x45, 0x2a, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 
+0x2c, 0x20, 0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 0x20, 0x75, 0x69, 0x6e, 0x74, 
+0x33, 0x32, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x70, 
+0x2c, 0x20, 0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 0x20, 0x53, 0x54, 0x52, 0x55, 
+0x43, 0x54, 0x20, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 
+0x20, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x29, 0x0d, 0x0a, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 
+0x53, 0x54, 0x4f, 0x50, 0x5f, 0x45, 0x58, 0x54, 0x45, 0x4e, 0x53, 0x49, 0x56, 0x45, 0x5f, 
+0x57, 0x4f, 0x52, 0x4b, 0x5f, 0x49, 0x54, 0x45, 0x4d, 0x53, 0x28, 0x70, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x29, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 
+0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 
+0x20, 0x67, 0x65, 0x74, 0x5f, 0x67, 0x6c, 0x6f, 0x62, 0x61, 0x6c, 0x5f, 0x69, 0x64, 0x28, 
+0x30, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x70, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x20, 0x3d, 0x20, 0x61, 
+0x73, 0x5f, 0x75, 0x69, 0x6e, 0x74, 0x28, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x73, 0x5b, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x70, 0x5b, 0x69, 
+0x6e, 0x64, 0x65, 0x78, 0x5d, 0x5d, 0x2e, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 
+0x41, 0x6e, 0x64, 0x48, 0x61, 0x73, 0x68, 0x2e, 0x77, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 
+0x09, 0x09, 0x2f, 0x2f, 0x4f, 0x6e, 0x6c, 0x79, 0x20, 0x74, 0x68, 0x65, 0x20, 0x66, 0x69, 
+0x72, 0x73, 0x74, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x20, 0x6f, 0x66, 
+0x20, 0x61, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x20, 0x6c, 0x69, 0x73, 0x74, 0x73, 
+0x20, 0x69, 0x74, 0x0d, 0x0a, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x68, 0x61, 0x73, 0x68, 
+0x4d, 0x61, 0x70, 0x5b, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x48, 0x61, 0x73, 
+0x68, 0x5d, 0x20, 0x3d, 0x3d, 0x20, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x29, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x6f, 0x63, 0x63, 0x75, 0x70, 0x69, 0x65, 0x64, 0x42, 0x75, 0x63, 0x6b, 0x65, 
+0x74, 0x73, 0x5b, 0x61, 0x74, 0x6f, 0x6d, 0x69, 0x63, 0x5f, 0x69, 0x6e, 0x63, 0x28, 0x6f, 
+0x63, 0x63, 0x75, 0x70, 0x69, 0x65, 0x64, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x43, 0x6f, 
+0x75, 0x6e, 0x74, 0x29, 0x5d, 0x20, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x48, 0x61, 0x73, 0x68, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x2f, 0x2f, 
+0x52, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x73, 0x20, 0x74, 0x68, 0x65, 0x20, 0x6c, 0x6f, 0x63, 
+0x61, 0x6c, 0x20, 0x49, 0x44, 0x20, 0x6f, 0x66, 0x20, 0x61, 0x20, 0x77, 0x6f, 0x72, 0x6b, 
+0x20, 0x69, 0x74, 0x65, 0x6d, 0x20, 0x74, 0x68, 0x61, 0x74, 0x20, 0x68, 0x61, 0x73, 0x20, 
+0x27, 0x70, 0x65, 0x6e, 0x64, 0x69, 0x6e, 0x67, 0x27, 0x20, 0x73, 0x65, 0x74, 0x2c, 0x20, 
+0x6f, 0x72, 0x20, 0x55, 0x49, 0x4e, 0x54, 0x5f, 0x4d, 0x41, 0x58, 0x20, 0x77, 0x68, 0x65, 
+0x6e, 0x20, 0x6e, 0x6f, 0x6e, 0x65, 0x20, 0x68, 0x61, 0x73, 0x20, 0x69, 0x74, 0x2e, 0x20, 
+0x41, 0x6c, 0x6c, 0x20, 0x77, 0x6f, 0x72, 0x6b, 0x20, 0x69, 0x74, 0x65, 0x6d, 0x73, 0x20, 
+0x6f, 0x66, 0x20, 0x74, 0x68, 0x65, 0x0d, 0x0a, 0x09, 0x2f, 0x2f, 0x67, 0x72, 0x6f, 0x75, 
+0x70, 0x20, 0x67, 0x65, 0x74, 0x20, 0x74, 0x68, 0x65, 0x20, 0x73, 0x61, 0x6d, 0x65, 0x20, 
+0x76, 0x61, 0x6c, 0x75, 0x65, 0x0d, 0x0a, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 
+0x53, 0x65, 0x6c, 0x65, 0x63, 0x74, 0x50, 0x65, 0x6e, 0x64, 0x69, 0x6e, 0x67, 0x57, 0x6f, 
+0x72, 0x6b, 0x49, 0x74, 0x65, 0x6d, 0x28, 0x76, 0x6f, 0x6c, 0x61, 0x74, 0x69, 0x6c, 0x65, 
+0x20, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x2a, 0x20, 
+0x73, 0x65, 0x6c, 0x65, 0x63, 0x74, 0x65, 0x64, 0x2c, 0x20, 0x62, 0x6f, 0x6f, 0x6c, 0x20, 
+0x70, 0x65, 0x6e, 0x64, 0x69, 0x6e, 0x67, 0x29, 0x0d, 0x0a, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 
+0x09, 0x69, 0x66, 0x20, 0x28, 0x67, 0x65, 0x74, 0x5f, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x5f, 
+0x69, 0x64, 0x28, 0x30, 0x29, 0x20, 0x3d, 0x3d, 0x20, 0x30, 0x29, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x2a, 0x73, 0x65, 0x6c, 0x65, 0x63, 0x74, 0x65, 0x64, 0x20, 0x3d, 0x20, 0x55, 0x49, 
+0x4e, 0x54, 0x5f, 0x4d, 0x41, 0x58, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x62, 0x61, 
+0x72, 0x72, 0x69, 0x65, 0x72, 0x28, 0x43, 0x4c, 0x4b, 0x5f, 0x4c, 0x4f, 0x43, 0x41, 0x4c, 
+0x5f, 0x4d, 0x45, 0x4d, 0x5f, 0x46, 0x45, 0x4e, 0x43, 0x45, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 
+0x0a, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x70, 0x65, 0x6e, 0x64, 0x69, 0x6e, 0x67, 0x29, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x61, 0x74, 0x6f, 0x6d, 0x69, 0x63, 0x5f, 0x6d, 0x69, 0x6e, 
+0x28, 0x73, 0x65, 0x6c, 0x65, 0x63, 0x74, 0x65, 0x64, 0x2c, 0x20, 0x28, 0x75, 0x69, 0x6e, 
+0x74, 0x33, 0x32, 0x29, 0x67, 0x65, 0x74, 0x5f, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x5f, 0x69, 
+0x64, 0x28, 0x30, 0x29, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x62, 0x61, 0x72, 
+0x72, 0x69, 0x65, 0x72, 0x28, 0x43, 0x4c, 0x4b, 0x5f, 0x4c, 0x4f, 0x43, 0x41, 0x4c, 0x5f, 
+0x4d, 0x45, 0x4d, 0x5f, 0x46, 0x45, 0x4e, 0x43, 0x45, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x76, 0x61, 0x6c, 0x75, 0x65, 0x20, 0x3d, 0x20, 
+0x2a, 0x73, 0x65, 0x6c, 0x65, 0x63, 0x74, 0x65, 0x64, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x62, 
+0x61, 0x72, 0x72, 0x69, 0x65, 0x72, 0x28, 0x43, 0x4c, 0x4b, 0x5f, 0x4c, 0x4f, 0x43, 0x41, 
+0x4c, 0x5f, 0x4d, 0x45, 0x4d, 0x5f, 0x46, 0x45, 0x4e, 0x43, 0x45, 0x29, 0x3b, 0x0d, 0x0a, 
+0x0d, 0x0a, 0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x76, 0x61, 0x6c, 0x75, 
+0x65, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x76, 0x6f, 0x69, 0x64, 0x20, 0x6b, 
+0x65, 0x72, 0x6e, 0x65, 0x6c, 0x20, 0x55, 0x70, 0x64, 0x61, 0x74, 0x65, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x54, 0x69, 
+0x6c, 0x65, 0x64, 0x28, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 
+0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x0d, 0x0a, 
+0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x2c, 
+0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x73, 0x74, 0x61, 0x74, 
+0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 
+0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x43, 0x4f, 0x4e, 
+0x53, 0x54, 0x41, 0x4e, 0x54, 0x20, 0x53, 0x54, 0x52, 0x55, 0x43, 0x54, 0x20, 0x44, 0x79, 
+0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x2a, 0x20, 
+0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 
+0x09, 0x47, 0x4c, 0x4f, 0x42, 0x41, 0x4c, 0x20, 0x53, 0x54, 0x52, 0x55, 0x43, 0x54, 0x20, 
+0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x2a, 0x20, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 
+0x0d, 0x0a, 0x09, 0x09, 0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 0x20, 0x48, 0x41, 
+0x53, 0x48, 0x5f, 0x54, 0x59, 0x50, 0x45, 0x2a, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 
+0x70, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 0x20, 
+0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x4d, 0x61, 0x70, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 
+0x4e, 0x54, 0x20, 0x53, 0x54, 0x52, 0x55, 0x43, 0x54, 0x20, 0x53, 0x74, 0x61, 0x74, 0x69, 
+0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x2a, 0x20, 0x73, 0x74, 0x61, 0x74, 
+0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 
+0x09, 0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 0x20, 0x48, 0x41, 0x53, 0x48, 0x5f, 
+0x54, 0x59, 0x50, 0x45, 0x2a, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 0x0d, 
+0x0a, 0x09, 0x09, 0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 0x20, 0x53, 0x54, 0x52, 
+0x55, 0x43, 0x54, 0x20, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x42, 0x65, 0x68, 
+0x61, 0x76, 0x69, 0x6f, 0x75, 0x72, 0x50, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 
+0x73, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2c, 0x0d, 
+0x0a, 0x09, 0x09, 0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 0x20, 0x75, 0x69, 0x6e, 
+0x74, 0x33, 0x32, 0x2a, 0x20, 0x6f, 0x63, 0x63, 0x75, 0x70, 0x69, 0x65, 0x64, 0x42, 0x75, 
+0x63, 0x6b, 0x65, 0x74, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x43, 0x4f, 0x4e, 0x53, 0x54, 
+0x41, 0x4e, 0x54, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x2a, 0x20, 0x6f, 0x63, 0x63, 
+0x75, 0x70, 0x69, 0x65, 0x64, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x43, 0x6f, 0x75, 0x6e, 
+0x74, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x20, 0x56, 0x65, 0x63, 
+0x34, 0x66, 0x2a, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 
+0x6e, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x20, 0x75, 0x69, 
+0x6e, 0x74, 0x33, 0x32, 0x2a, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x49, 0x6e, 0x64, 0x69, 0x63, 
+0x65, 0x73, 0x0d, 0x0a, 0x09, 0x29, 0x20, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x6c, 0x6f, 0x63, 
+0x61, 0x6c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x73, 0x65, 0x6c, 0x65, 0x63, 
+0x74, 0x65, 0x64, 0x57, 0x6f, 0x72, 0x6b, 0x49, 0x74, 0x65, 0x6d, 0x3b, 0x0d, 0x0a, 0x09, 
+0x09, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x20, 0x56, 0x65, 0x63, 0x33, 0x75, 0x20, 0x73, 0x65, 
+0x6c, 0x65, 0x63, 0x74, 0x65, 0x64, 0x43, 0x65, 0x6c, 0x6c, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 
+0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x49, 
+0x44, 0x20, 0x3d, 0x20, 0x67, 0x65, 0x74, 0x5f, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x5f, 0x69, 
+0x64, 0x28, 0x30, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 
+0x20, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x53, 0x69, 0x7a, 0x65, 0x20, 0x3d, 0x20, 0x67, 0x65, 
+0x74, 0x5f, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x5f, 0x73, 0x69, 0x7a, 0x65, 0x28, 0x30, 0x29, 
+0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x6d, 0x61, 0x78, 0x49, 
+0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 
+0x6e, 0x63, 0x65, 0x53, 0x71, 0x72, 0x20, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 
+0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 
+0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x20, 0x2a, 
+0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 
+0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 
+0x74, 0x61, 0x6e, 0x63, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6f, 0x72, 
+0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x6f, 0x63, 0x63, 0x75, 0x70, 0x69, 
+0x65, 0x64, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 
+0x20, 0x67, 0x65, 0x74, 0x5f, 0x67, 0x72, 0x6f, 0x75, 0x70, 0x5f, 0x69, 0x64, 0x28, 0x30, 
+0x29, 0x3b, 0x20, 0x6f, 0x63, 0x63, 0x75, 0x70, 0x69, 0x65, 0x64, 0x42, 0x75, 0x63, 0x6b, 
+0x65, 0x74, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3c, 0x20, 0x2a, 0x6f, 0x63, 0x63, 0x75, 
+0x70, 0x69, 0x65, 0x64, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x43, 0x6f, 0x75, 0x6e, 0x74, 
+0x3b, 0x20, 0x6f, 0x63, 0x63, 0x75, 0x70, 0x69, 0x65, 0x64, 0x42, 0x75, 0x63, 0x6b, 0x65, 
+0x74, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x2b, 0x3d, 0x20, 0x67, 0x65, 0x74, 0x5f, 0x6e, 
+0x75, 0x6d, 0x5f, 0x67, 0x72, 0x6f, 0x75, 0x70, 0x73, 0x28, 0x30, 0x29, 0x29, 0x0d, 0x0a, 
+0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 
+0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x20, 0x3d, 0x20, 0x6f, 0x63, 0x63, 0x75, 0x70, 0x69, 
+0x65, 0x64, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x5b, 0x6f, 0x63, 0x63, 0x75, 0x70, 
+0x69, 0x65, 0x64, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 
+0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x62, 0x75, 
+0x63, 0x6b, 0x65, 0x74, 0x42, 0x65, 0x67, 0x69, 0x6e, 0x20, 0x3d, 0x20, 0x68, 0x61, 0x73, 
+0x68, 0x4d, 0x61, 0x70, 0x5b, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x5d, 0x3b, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 
+0x74, 0x45, 0x6e, 0x64, 0x20, 0x3d, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x5b, 
+0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x20, 0x2b, 0x20, 0x31, 0x5d, 0x3b, 0x0d, 0x0a, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 
+0x20, 0x63, 0x68, 0x75, 0x6e, 0x6b, 0x42, 0x65, 0x67, 0x69, 0x6e, 0x20, 0x3d, 0x20, 0x62, 
+0x75, 0x63, 0x6b, 0x65, 0x74, 0x42, 0x65, 0x67, 0x69, 0x6e, 0x3b, 0x20, 0x63, 0x68, 0x75, 
+0x6e, 0x6b, 0x42, 0x65, 0x67, 0x69, 0x6e, 0x20, 0x3c, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 
+0x74, 0x45, 0x6e, 0x64, 0x3b, 0x20, 0x63, 0x68, 0x75, 0x6e, 0x6b, 0x42, 0x65, 0x67, 0x69, 
+0x6e, 0x20, 0x2b, 0x3d, 0x20, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x53, 0x69, 0x7a, 0x65, 0x29, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x62, 0x6f, 0x6f, 
+0x6c, 0x20, 0x70, 0x65, 0x6e, 0x64, 0x69, 0x6e, 0x67, 0x20, 0x3d, 0x20, 0x63, 0x68, 0x75, 
+0x6e, 0x6b, 0x42, 0x65, 0x67, 0x69, 0x6e, 0x20, 0x2b, 0x20, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 
+0x49, 0x44, 0x20, 0x3c, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x45, 0x6e, 0x64, 0x3b, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x70, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x70, 
+0x65, 0x6e, 0x64, 0x69, 0x6e, 0x67, 0x20, 0x3f, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x4d, 0x61, 0x70, 0x5b, 0x63, 0x68, 0x75, 0x6e, 0x6b, 0x42, 0x65, 0x67, 0x69, 
+0x6e, 0x20, 0x2b, 0x20, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x49, 0x44, 0x5d, 0x20, 0x3a, 0x20, 
+0x30, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x70, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 
+0x20, 0x3d, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x5b, 
+0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x2e, 
+0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x41, 0x6e, 0x64, 0x50, 0x72, 0x65, 0x73, 
+0x73, 0x75, 0x72, 0x65, 0x2e, 0x78, 0x79, 0x7a, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x56, 0x65, 0x63, 0x33, 0x75, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x43, 
+0x65, 0x6c, 0x6c, 0x20, 0x3d, 0x20, 0x47, 0x65, 0x74, 0x43, 0x65, 0x6c, 0x6c, 0x28, 0x70, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 
+0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 
+0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 
+0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x2f, 0x2f, 0x55, 0x73, 0x75, 0x61, 0x6c, 0x6c, 0x79, 0x20, 0x61, 0x6c, 0x6c, 0x20, 
+0x74, 0x68, 0x65, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x20, 0x6f, 
+0x66, 0x20, 0x61, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x20, 0x61, 0x72, 0x65, 0x20, 
+0x69, 0x6e, 0x20, 0x6f, 0x6e, 0x65, 0x20, 0x63, 0x65, 0x6c, 0x6c, 0x20, 0x61, 0x6e, 0x64, 
+0x20, 0x74, 0x68, 0x69, 0x73, 0x20, 0x72, 0x75, 0x6e, 0x73, 0x20, 0x6f, 0x6e, 0x63, 0x65, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x77, 0x68, 0x69, 0x6c, 0x65, 0x20, 0x28, 0x74, 0x72, 
+0x75, 0x65, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x73, 0x65, 0x6c, 0x65, 0x63, 0x74, 
+0x65, 0x64, 0x20, 0x3d, 0x20, 0x53, 0x65, 0x6c, 0x65, 0x63, 0x74, 0x50, 0x65, 0x6e, 0x64, 
+0x69, 0x6e, 0x67, 0x57, 0x6f, 0x72, 0x6b, 0x49, 0x74, 0x65, 0x6d, 0x28, 0x26, 0x73, 0x65, 
+0x6c, 0x65, 0x63, 0x74, 0x65, 0x64, 0x57, 0x6f, 0x72, 0x6b, 0x49, 0x74, 0x65, 0x6d, 0x2c, 
+0x20, 0x70, 0x65, 0x6e, 0x64, 0x69, 0x6e, 0x67, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x73, 0x65, 0x6c, 0x65, 0x63, 0x74, 0x65, 
+0x64, 0x20, 0x3d, 0x3d, 0x20, 0x55, 0x49, 0x4e, 0x54, 0x5f, 0x4d, 0x41, 0x58, 0x29, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x62, 0x72, 0x65, 0x61, 0x6b, 0x3b, 0x0d, 0x0a, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x6c, 0x6f, 0x63, 0x61, 
+0x6c, 0x49, 0x44, 0x20, 0x3d, 0x3d, 0x20, 0x73, 0x65, 0x6c, 0x65, 0x63, 0x74, 0x65, 0x64, 
+0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x73, 0x65, 0x6c, 0x65, 0x63, 0x74, 
+0x65, 0x64, 0x43, 0x65, 0x6c, 0x6c, 0x20, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x43, 0x65, 0x6c, 0x6c, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x62, 0x61, 0x72, 0x72, 0x69, 0x65, 0x72, 0x28, 0x43, 0x4c, 0x4b, 0x5f, 0x4c, 0x4f, 
+0x43, 0x41, 0x4c, 0x5f, 0x4d, 0x45, 0x4d, 0x5f, 0x46, 0x45, 0x4e, 0x43, 0x45, 0x29, 0x3b, 
+0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x75, 0x20, 
+0x63, 0x65, 0x6c, 0x6c, 0x20, 0x3d, 0x20, 0x73, 0x65, 0x6c, 0x65, 0x63, 0x74, 0x65, 0x64, 
+0x43, 0x65, 0x6c, 0x6c, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x62, 0x6f, 0x6f, 
+0x6c, 0x20, 0x61, 0x63, 0x74, 0x69, 0x76, 0x65, 0x20, 0x3d, 0x20, 0x70, 0x65, 0x6e, 0x64, 
+0x69, 0x6e, 0x67, 0x20, 0x26, 0x26, 0x20, 0x61, 0x6c, 0x6c, 0x28, 0x70, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x43, 0x65, 0x6c, 0x6c, 0x20, 0x3d, 0x3d, 0x20, 0x63, 0x65, 0x6c, 
+0x6c, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 
+0x33, 0x75, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x43, 0x65, 0x6c, 0x6c, 0x20, 0x3d, 0x20, 
+0x63, 0x65, 0x6c, 0x6c, 0x20, 0x2d, 0x20, 0x4e, 0x45, 0x57, 0x5f, 0x56, 0x45, 0x43, 0x33, 
+0x55, 0x28, 0x31, 0x2c, 0x20, 0x31, 0x2c, 0x20, 0x31, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x75, 0x20, 0x65, 0x6e, 0x64, 0x43, 0x65, 0x6c, 
+0x6c, 0x20, 0x3d, 0x20, 0x63, 0x65, 0x6c, 0x6c, 0x20, 0x2b, 0x20, 0x4e, 0x45, 0x57, 0x5f, 
+0x56, 0x45, 0x43, 0x33, 0x55, 0x28, 0x32, 0x2c, 0x20, 0x32, 0x2c, 0x20, 0x32, 0x29, 0x3b, 
+0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 
+0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x49, 0x6e, 0x66, 0x6c, 0x75, 0x65, 0x6e, 0x63, 0x65, 0x53, 0x75, 0x6d, 0x20, 0x3d, 0x20, 
+0x30, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 
+0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 
+0x6e, 0x66, 0x6c, 0x75, 0x65, 0x6e, 0x63, 0x65, 0x53, 0x75, 0x6d, 0x20, 0x3d, 0x20, 0x30, 
+0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x62, 0x6f, 0x6f, 0x6c, 0x20, 
+0x6f, 0x75, 0x74, 0x73, 0x69, 0x64, 0x65, 0x47, 0x72, 0x69, 0x64, 0x42, 0x75, 0x63, 0x6b, 
+0x65, 0x74, 0x56, 0x69, 0x73, 0x69, 0x74, 0x65, 0x64, 0x20, 0x3d, 0x20, 0x66, 0x61, 0x6c, 
+0x73, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 
+0x33, 0x75, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x3b, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x6f, 0x74, 0x68, 0x65, 0x72, 
+0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x78, 0x20, 0x3d, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x43, 
+0x65, 0x6c, 0x6c, 0x2e, 0x78, 0x3b, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 
+0x6c, 0x2e, 0x78, 0x20, 0x21, 0x3d, 0x20, 0x65, 0x6e, 0x64, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 
+0x78, 0x3b, 0x20, 0x2b, 0x2b, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 
+0x78, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 
+0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x79, 0x20, 0x3d, 0x20, 0x62, 
+0x65, 0x67, 0x69, 0x6e, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x79, 0x3b, 0x20, 0x6f, 0x74, 0x68, 
+0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x79, 0x20, 0x21, 0x3d, 0x20, 0x65, 0x6e, 0x64, 
+0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x79, 0x3b, 0x20, 0x2b, 0x2b, 0x6f, 0x74, 0x68, 0x65, 0x72, 
+0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x79, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 
+0x2e, 0x7a, 0x20, 0x3d, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 
+0x7a, 0x3b, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x7a, 0x20, 
+0x21, 0x3d, 0x20, 0x65, 0x6e, 0x64, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x7a, 0x3b, 0x20, 0x2b, 
+0x2b, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x7a, 0x29, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 
+0x48, 0x61, 0x73, 0x68, 0x4d, 0x6f, 0x64, 0x20, 0x3d, 0x20, 0x47, 0x65, 0x74, 0x43, 0x65, 
+0x6c, 0x6c, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x28, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 
+0x65, 0x6c, 0x6c, 0x2c, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 
+0x7a, 0x65, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x29, 
+0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 
+0x20, 0x28, 0x49, 0x73, 0x4f, 0x75, 0x74, 0x73, 0x69, 0x64, 0x65, 0x47, 0x72, 0x69, 0x64, 
+0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x28, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x48, 0x61, 0x73, 
+0x68, 0x4d, 0x6f, 0x64, 0x2c, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 
+0x69, 0x7a, 0x65, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 
+0x29, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x6f, 0x75, 
+0x74, 0x73, 0x69, 0x64, 0x65, 0x47, 0x72, 0x69, 0x64, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 
+0x56, 0x69, 0x73, 0x69, 0x74, 0x65, 0x64, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x74, 0x69, 0x6e, 0x75, 0x65, 0x3b, 0x0d, 
+0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x6f, 0x75, 0x74, 
+0x73, 0x69, 0x64, 0x65, 0x47, 0x72, 0x69, 0x64, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x56, 
+0x69, 0x73, 0x69, 0x74, 0x65, 0x64, 0x20, 0x3d, 0x20, 0x74, 0x72, 0x75, 0x65, 0x3b, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x62, 
+0x65, 0x67, 0x69, 0x6e, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x68, 0x61, 0x73, 
+0x68, 0x4d, 0x61, 0x70, 0x5b, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x48, 0x61, 0x73, 0x68, 0x4d, 
+0x6f, 0x64, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x75, 
+0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 
+0x3d, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x5b, 0x6f, 0x74, 0x68, 0x65, 0x72, 
+0x48, 0x61, 0x73, 0x68, 0x4d, 0x6f, 0x64, 0x20, 0x2b, 0x20, 0x31, 0x5d, 0x3b, 0x0d, 0x0a, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 
+0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x42, 0x65, 0x67, 0x69, 
+0x6e, 0x20, 0x3d, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x3b, 
+0x20, 0x74, 0x69, 0x6c, 0x65, 0x42, 0x65, 0x67, 0x69, 0x6e, 0x20, 0x3c, 0x20, 0x65, 0x6e, 
+0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x3b, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x42, 0x65, 0x67, 
+0x69, 0x6e, 0x20, 0x2b, 0x3d, 0x20, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x53, 0x69, 0x7a, 0x65, 
+0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 
+0x74, 0x69, 0x6c, 0x65, 0x53, 0x69, 0x7a, 0x65, 0x20, 0x3d, 0x20, 0x6d, 0x69, 0x6e, 0x28, 
+0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x2d, 0x20, 0x74, 0x69, 0x6c, 0x65, 
+0x42, 0x65, 0x67, 0x69, 0x6e, 0x2c, 0x20, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x53, 0x69, 0x7a, 
+0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x2f, 0x2f, 0x54, 0x68, 0x65, 0x20, 0x70, 0x72, 0x65, 0x76, 0x69, 0x6f, 0x75, 0x73, 
+0x20, 0x74, 0x69, 0x6c, 0x65, 0x20, 0x6d, 0x75, 0x73, 0x74, 0x20, 0x62, 0x65, 0x20, 0x72, 
+0x65, 0x61, 0x64, 0x20, 0x62, 0x79, 0x20, 0x61, 0x6c, 0x6c, 0x20, 0x77, 0x6f, 0x72, 0x6b, 
+0x20, 0x69, 0x74, 0x65, 0x6d, 0x73, 0x20, 0x62, 0x65, 0x66, 0x6f, 0x72, 0x65, 0x20, 0x69, 
+0x74, 0x27, 0x73, 0x20, 0x6f, 0x76, 0x65, 0x72, 0x77, 0x72, 0x69, 0x74, 0x74, 0x65, 0x6e, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x62, 0x61, 0x72, 0x72, 
+0x69, 0x65, 0x72, 0x28, 0x43, 0x4c, 0x4b, 0x5f, 0x4c, 0x4f, 0x43, 0x41, 0x4c, 0x5f, 0x4d, 
+0x45, 0x4d, 0x5f, 0x46, 0x45, 0x4e, 0x43, 0x45, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x6c, 0x6f, 0x63, 
+0x61, 0x6c, 0x49, 0x44, 0x20, 0x3c, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x53, 0x69, 0x7a, 0x65, 
+0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 
+0x32, 0x20, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x4d, 0x61, 0x70, 0x5b, 0x74, 0x69, 0x6c, 0x65, 0x42, 0x65, 0x67, 0x69, 
+0x6e, 0x20, 0x2b, 0x20, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x49, 0x44, 0x5d, 0x3b, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x74, 0x69, 0x6c, 0x65, 0x49, 
+0x6e, 0x64, 0x69, 0x63, 0x65, 0x73, 0x5b, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x49, 0x44, 0x5d, 
+0x20, 0x3d, 0x20, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x74, 0x69, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 
+0x69, 0x6f, 0x6e, 0x73, 0x5b, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x49, 0x44, 0x5d, 0x20, 0x3d, 
+0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x5b, 0x69, 0x6e, 
+0x64, 0x65, 0x78, 0x5d, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x41, 0x6e, 
+0x64, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x62, 0x61, 0x72, 0x72, 0x69, 0x65, 0x72, 0x28, 0x43, 0x4c, 
+0x4b, 0x5f, 0x4c, 0x4f, 0x43, 0x41, 0x4c, 0x5f, 0x4d, 0x45, 0x4d, 0x5f, 0x46, 0x45, 0x4e, 
+0x43, 0x45, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x21, 0x61, 0x63, 0x74, 0x69, 0x76, 0x65, 0x29, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x74, 
+0x69, 0x6e, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 
+0x69, 0x20, 0x3d, 0x20, 0x30, 0x3b, 0x20, 0x69, 0x20, 0x3c, 0x20, 0x74, 0x69, 0x6c, 0x65, 
+0x53, 0x69, 0x7a, 0x65, 0x3b, 0x20, 0x2b, 0x2b, 0x69, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x74, 0x69, 0x6c, 0x65, 0x49, 0x6e, 0x64, 
+0x69, 0x63, 0x65, 0x73, 0x5b, 0x69, 0x5d, 0x20, 0x3d, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x74, 0x69, 0x6e, 0x75, 
+0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x64, 0x69, 0x72, 0x20, 0x3d, 0x20, 0x74, 0x69, 
+0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x73, 0x5b, 0x69, 0x5d, 0x2e, 
+0x78, 0x79, 0x7a, 0x20, 0x2d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 
+0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x69, 0x73, 0x74, 
+0x53, 0x71, 0x72, 0x20, 0x3d, 0x20, 0x64, 0x6f, 0x74, 0x28, 0x64, 0x69, 0x72, 0x2c, 0x20, 
+0x64, 0x69, 0x72, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 
+0x20, 0x3e, 0x20, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 
+0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x53, 0x71, 0x72, 0x29, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 
+0x74, 0x69, 0x6e, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x69, 0x73, 0x74, 
+0x20, 0x3d, 0x20, 0x73, 0x71, 0x72, 0x74, 0x28, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 
+0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x49, 0x6e, 0x66, 0x6c, 0x75, 0x65, 0x6e, 0x63, 0x65, 0x53, 0x75, 0x6d, 0x20, 0x2b, 
+0x3d, 0x20, 0x53, 0x6d, 0x6f, 0x6f, 0x74, 0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 0x6e, 
+0x65, 0x6c, 0x44, 0x30, 0x28, 0x64, 0x69, 0x73, 0x74, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 
+0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 
+0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 
+0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x73, 0x74, 0x61, 0x74, 
+0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x43, 0x6f, 0x75, 0x6e, 
+0x74, 0x20, 0x3d, 0x3d, 0x20, 0x30, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x74, 0x69, 0x6e, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x48, 
+0x61, 0x73, 0x68, 0x4d, 0x6f, 0x64, 0x20, 0x3d, 0x20, 0x47, 0x65, 0x74, 0x43, 0x65, 0x6c, 
+0x6c, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x28, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 
+0x6c, 0x6c, 0x2c, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 
+0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x29, 0x3b, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 
+0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x5b, 
+0x6f, 0x74, 0x68, 0x65, 0x72, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x6f, 0x64, 0x5d, 0x3b, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 
+0x65, 0x78, 0x20, 0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x5b, 0x6f, 0x74, 
+0x68, 0x65, 0x72, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x6f, 0x64, 0x20, 0x2b, 0x20, 0x31, 0x5d, 
+0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6f, 
+0x72, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x42, 
+0x65, 0x67, 0x69, 0x6e, 0x20, 0x3d, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 0x6e, 0x64, 
+0x65, 0x78, 0x3b, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x42, 0x65, 0x67, 0x69, 0x6e, 0x20, 0x3c, 
+0x20, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x3b, 0x20, 0x74, 0x69, 0x6c, 0x65, 
+0x42, 0x65, 0x67, 0x69, 0x6e, 0x20, 0x2b, 0x3d, 0x20, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x53, 
+0x69, 0x7a, 0x65, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7b, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 
+0x33, 0x32, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x53, 0x69, 0x7a, 0x65, 0x20, 0x3d, 0x20, 0x6d, 
+0x69, 0x6e, 0x28, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x2d, 0x20, 0x74, 
+0x69, 0x6c, 0x65, 0x42, 0x65, 0x67, 0x69, 0x6e, 0x2c, 0x20, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 
+0x53, 0x69, 0x7a, 0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x62, 0x61, 0x72, 0x72, 0x69, 0x65, 0x72, 0x28, 0x43, 0x4c, 0x4b, 
+0x5f, 0x4c, 0x4f, 0x43, 0x41, 0x4c, 0x5f, 0x4d, 0x45, 0x4d, 0x5f, 0x46, 0x45, 0x4e, 0x43, 
+0x45, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x69, 0x66, 0x20, 0x28, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x49, 0x44, 0x20, 0x3c, 0x20, 
+0x74, 0x69, 0x6c, 0x65, 0x53, 0x69, 0x7a, 0x65, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x74, 0x69, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 
+0x69, 0x6f, 0x6e, 0x73, 0x5b, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x49, 0x44, 0x5d, 0x20, 0x3d, 
+0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x73, 0x5b, 0x74, 0x69, 0x6c, 0x65, 0x42, 0x65, 0x67, 0x69, 0x6e, 0x20, 0x2b, 0x20, 0x6c, 
+0x6f, 0x63, 0x61, 0x6c, 0x49, 0x44, 0x5d, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 
+0x6e, 0x41, 0x6e, 0x64, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x3b, 0x0d, 0x0a, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x62, 0x61, 0x72, 0x72, 
+0x69, 0x65, 0x72, 0x28, 0x43, 0x4c, 0x4b, 0x5f, 0x4c, 0x4f, 0x43, 0x41, 0x4c, 0x5f, 0x4d, 
+0x45, 0x4d, 0x5f, 0x46, 0x45, 0x4e, 0x43, 0x45, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x21, 0x61, 0x63, 
+0x74, 0x69, 0x76, 0x65, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x63, 0x6f, 0x6e, 0x74, 0x69, 0x6e, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x75, 
+0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x69, 0x20, 0x3d, 0x20, 0x30, 0x3b, 0x20, 0x69, 0x20, 
+0x3c, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x53, 0x69, 0x7a, 0x65, 0x3b, 0x20, 0x2b, 0x2b, 0x69, 
+0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 
+0x20, 0x64, 0x69, 0x72, 0x20, 0x3d, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 
+0x74, 0x69, 0x6f, 0x6e, 0x73, 0x5b, 0x69, 0x5d, 0x2e, 0x78, 0x79, 0x7a, 0x20, 0x2d, 0x20, 
+0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 
+0x6e, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x66, 
+0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x20, 0x3d, 0x20, 
+0x64, 0x6f, 0x74, 0x28, 0x64, 0x69, 0x72, 0x2c, 0x20, 0x64, 0x69, 0x72, 0x29, 0x3b, 0x0d, 
+0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 
+0x20, 0x28, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x20, 0x3e, 0x20, 0x6d, 0x61, 0x78, 
+0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 
+0x61, 0x6e, 0x63, 0x65, 0x53, 0x71, 0x72, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x74, 0x69, 0x6e, 0x75, 0x65, 0x3b, 
+0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x66, 
+0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x69, 0x73, 0x74, 0x20, 0x3d, 0x20, 0x73, 0x71, 0x72, 
+0x74, 0x28, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x73, 0x74, 0x61, 0x74, 0x69, 
+0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x66, 0x6c, 0x75, 0x65, 
+0x6e, 0x63, 0x65, 0x53, 0x75, 0x6d, 0x20, 0x2b, 0x3d, 0x20, 0x53, 0x6d, 0x6f, 0x6f, 0x74, 
+0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x44, 0x30, 0x28, 0x64, 0x69, 
+0x73, 0x74, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 
+0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 
+0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x61, 0x63, 0x74, 0x69, 
+0x76, 0x65, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x44, 0x65, 0x6e, 0x73, 0x69, 0x74, 0x79, 0x20, 0x3d, 0x20, 0x70, 0x61, 
+0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x73, 0x65, 0x6c, 0x66, 0x44, 
+0x65, 0x6e, 0x73, 0x69, 0x74, 0x79, 0x20, 0x2b, 0x20, 0x28, 0x64, 0x79, 0x6e, 0x61, 0x6d, 
+0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x66, 0x6c, 0x75, 
+0x65, 0x6e, 0x63, 0x65, 0x53, 0x75, 0x6d, 0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 
+0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x4d, 0x61, 0x73, 0x73, 0x20, 0x2b, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x66, 0x6c, 0x75, 0x65, 0x6e, 0x63, 0x65, 
+0x53, 0x75, 0x6d, 0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 
+0x73, 0x2d, 0x3e, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x73, 0x73, 
+0x29, 0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 
+0x3e, 0x73, 0x6d, 0x6f, 0x6f, 0x74, 0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 0x6e, 0x65, 
+0x6c, 0x43, 0x6f, 0x6e, 0x73, 0x74, 0x61, 0x6e, 0x74, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x20, 0x3d, 0x20, 0x70, 0x61, 
+0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x67, 0x61, 0x73, 0x43, 0x6f, 
+0x6e, 0x73, 0x74, 0x61, 0x6e, 0x74, 0x20, 0x2a, 0x20, 0x28, 0x70, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x44, 0x65, 0x6e, 0x73, 0x69, 0x74, 0x79, 0x20, 0x2d, 0x20, 0x70, 0x61, 
+0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x72, 0x65, 0x73, 0x74, 0x44, 
+0x65, 0x6e, 0x73, 0x69, 0x74, 0x79, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 
+0x5b, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 
+0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x41, 0x6e, 0x64, 0x50, 0x72, 0x65, 
+0x73, 0x73, 0x75, 0x72, 0x65, 0x2e, 0x77, 0x20, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x3b, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x70, 0x65, 0x6e, 0x64, 0x69, 0x6e, 0x67, 0x20, 0x3d, 0x20, 
+0x66, 0x61, 0x6c, 0x73, 0x65, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 
+0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x76, 0x6f, 0x69, 0x64, 0x20, 0x6b, 
+0x65, 0x72, 0x6e, 0x65, 0x6c, 0x20, 0x55, 0x70, 0x64, 0x61, 0x74, 0x65, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x73, 0x54, 0x69, 
+0x6c, 0x65, 0x64, 0x28, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 
+0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x0d, 0x0a, 
+0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x2c, 
+0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x73, 0x74, 0x61, 0x74, 
+0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 
+0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x43, 0x4f, 0x4e, 
+0x53, 0x54, 0x41, 0x4e, 0x54, 0x20, 0x53, 0x54, 0x52, 0x55, 0x43, 0x54, 0x20, 0x44, 0x79, 
+0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x2a, 0x20, 
+0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 
+0x09, 0x47, 0x4c, 0x4f, 0x42, 0x41, 0x4c, 0x20, 0x53, 0x54, 0x52, 0x55, 0x43, 0x54, 0x20, 
+0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x2a, 0x20, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 
+0x0d, 0x0a, 0x09, 0x09, 0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 0x20, 0x48, 0x41, 
+0x53, 0x48, 0x5f, 0x54, 0x59, 0x50, 0x45, 0x2a, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 
+0x70, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 0x20, 
+0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x4d, 0x61, 0x70, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 
+0x4e, 0x54, 0x20, 0x53, 0x54, 0x52, 0x55, 0x43, 0x54, 0x20, 0x53, 0x74, 0x61, 0x74, 0x69, 
+0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x2a, 0x20, 0x73, 0x74, 0x61, 0x74, 
+0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 
+0x09, 0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 0x20, 0x48, 0x41, 0x53, 0x48, 0x5f, 
+0x54, 0x59, 0x50, 0x45, 0x2a, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 0x0d, 
+0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 
+0x64, 0x65, 0x6c, 0x74, 0x61, 0x54, 0x69, 0x6d, 0x65, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x43, 
+0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 0x20, 0x53, 0x54, 0x52, 0x55, 0x43, 0x54, 0x20, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x42, 0x65, 0x68, 0x61, 0x76, 0x69, 0x6f, 
+0x75, 0x72, 0x50, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2a, 0x20, 0x70, 
+0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x75, 
+0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x43, 
+0x6f, 0x75, 0x6e, 0x74, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 
+0x4e, 0x54, 0x20, 0x53, 0x54, 0x52, 0x55, 0x43, 0x54, 0x20, 0x54, 0x72, 0x69, 0x61, 0x6e, 
+0x67, 0x6c, 0x65, 0x2a, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x73, 0x2c, 
+0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x74, 0x72, 0x69, 0x61, 
+0x6e, 0x67, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 
+0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 0x20, 0x75, 
+0x69, 0x6e, 0x74, 0x33, 0x32, 0x2a, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 
+0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x43, 0x4f, 0x4e, 
+0x53, 0x54, 0x41, 0x4e, 0x54, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x2a, 0x20, 0x74, 
+0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x4d, 0x61, 0x70, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 
+0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 
+0x2a, 0x20, 0x6f, 0x63, 0x63, 0x75, 0x70, 0x69, 0x65, 0x64, 0x42, 0x75, 0x63, 0x6b, 0x65, 
+0x74, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 
+0x20, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x2a, 0x20, 0x6f, 0x63, 0x63, 0x75, 0x70, 0x69, 
+0x65, 0x64, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x2c, 0x0d, 
+0x0a, 0x09, 0x09, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x20, 0x56, 0x65, 0x63, 0x34, 0x66, 0x2a, 
+0x20, 0x74, 0x69, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x73, 0x2c, 
+0x0d, 0x0a, 0x09, 0x09, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x20, 0x56, 0x65, 0x63, 0x34, 0x66, 
+0x2a, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x56, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x69, 0x65, 
+0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x20, 0x75, 0x69, 0x6e, 
+0x74, 0x33, 0x32, 0x2a, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x49, 0x6e, 0x64, 0x69, 0x63, 0x65, 
+0x73, 0x0d, 0x0a, 0x09, 0x29, 0x20, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x6c, 0x6f, 0x63, 0x61, 
+0x6c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x73, 0x65, 0x6c, 0x65, 0x63, 0x74, 
+0x65, 0x64, 0x57, 0x6f, 0x72, 0x6b, 0x49, 0x74, 0x65, 0x6d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x20, 0x56, 0x65, 0x63, 0x33, 0x75, 0x20, 0x73, 0x65, 0x6c, 
+0x65, 0x63, 0x74, 0x65, 0x64, 0x43, 0x65, 0x6c, 0x6c, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 
+0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x49, 0x44, 
+0x20, 0x3d, 0x20, 0x67, 0x65, 0x74, 0x5f, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x5f, 0x69, 0x64, 
+0x28, 0x30, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 
+0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x53, 0x69, 0x7a, 0x65, 0x20, 0x3d, 0x20, 0x67, 0x65, 0x74, 
+0x5f, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x5f, 0x73, 0x69, 0x7a, 0x65, 0x28, 0x30, 0x29, 0x3b, 
+0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x6d, 0x61, 0x78, 0x49, 0x6e, 
+0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 
+0x63, 0x65, 0x53, 0x71, 0x72, 0x20, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 
+0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 
+0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x20, 0x2a, 0x20, 
+0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 
+0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 
+0x61, 0x6e, 0x63, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 
+0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x6f, 0x63, 0x63, 0x75, 0x70, 0x69, 0x65, 
+0x64, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 
+0x67, 0x65, 0x74, 0x5f, 0x67, 0x72, 0x6f, 0x75, 0x70, 0x5f, 0x69, 0x64, 0x28, 0x30, 0x29, 
+0x3b, 0x20, 0x6f, 0x63, 0x63, 0x75, 0x70, 0x69, 0x65, 0x64, 0x42, 0x75, 0x63, 0x6b, 0x65, 
+0x74, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3c, 0x20, 0x2a, 0x6f, 0x63, 0x63, 0x75, 0x70, 
+0x69, 0x65, 0x64, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x3b, 
+0x20, 0x6f, 0x63, 0x63, 0x75, 0x70, 0x69, 0x65, 0x64, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 
+0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x2b, 0x3d, 0x20, 0x67, 0x65, 0x74, 0x5f, 0x6e, 0x75, 
+0x6d, 0x5f, 0x67, 0x72, 0x6f, 0x75, 0x70, 0x73, 0x28, 0x30, 0x29, 0x29, 0x0d, 0x0a, 0x09, 
+0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x62, 
+0x75, 0x63, 0x6b, 0x65, 0x74, 0x20, 0x3d, 0x20, 0x6f, 0x63, 0x63, 0x75, 0x70, 0x69, 0x65, 
+0x64, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x5b, 0x6f, 0x63, 0x63, 0x75, 0x70, 0x69, 
+0x65, 0x64, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x3b, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x62, 0x75, 0x63, 
+0x6b, 0x65, 0x74, 0x42, 0x65, 0x67, 0x69, 0x6e, 0x20, 0x3d, 0x20, 0x68, 0x61, 0x73, 0x68, 
+0x4d, 0x61, 0x70, 0x5b, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 
+0x45, 0x6e, 0x64, 0x20, 0x3d, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x5b, 0x62, 
+0x75, 0x63, 0x6b, 0x65, 0x74, 0x20, 0x2b, 0x20, 0x31, 0x5d, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 
+0x63, 0x68, 0x75, 0x6e, 0x6b, 0x42, 0x65, 0x67, 0x69, 0x6e, 0x20, 0x3d, 0x20, 0x62, 0x75, 
+0x63, 0x6b, 0x65, 0x74, 0x42, 0x65, 0x67, 0x69, 0x6e, 0x3b, 0x20, 0x63, 0x68, 0x75, 0x6e, 
+0x6b, 0x42, 0x65, 0x67, 0x69, 0x6e, 0x20, 0x3c, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 
+0x45, 0x6e, 0x64, 0x3b, 0x20, 0x63, 0x68, 0x75, 0x6e, 0x6b, 0x42, 0x65, 0x67, 0x69, 0x6e, 
+0x20, 0x2b, 0x3d, 0x20, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x53, 0x69, 0x7a, 0x65, 0x29, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x62, 0x6f, 0x6f, 0x6c, 
+0x20, 0x70, 0x65, 0x6e, 0x64, 0x69, 0x6e, 0x67, 0x20, 0x3d, 0x20, 0x63, 0x68, 0x75, 0x6e, 
+0x6b, 0x42, 0x65, 0x67, 0x69, 0x6e, 0x20, 0x2b, 0x20, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x49, 
+0x44, 0x20, 0x3c, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x45, 0x6e, 0x64, 0x3b, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x70, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x70, 0x65, 
+0x6e, 0x64, 0x69, 0x6e, 0x67, 0x20, 0x3f, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x4d, 0x61, 0x70, 0x5b, 0x63, 0x68, 0x75, 0x6e, 0x6b, 0x42, 0x65, 0x67, 0x69, 0x6e, 
+0x20, 0x2b, 0x20, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x49, 0x44, 0x5d, 0x20, 0x3a, 0x20, 0x30, 
+0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 
+0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 
+0x6e, 0x20, 0x3d, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 
+0x5b, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 
+0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x41, 0x6e, 0x64, 0x50, 0x72, 0x65, 
+0x73, 0x73, 0x75, 0x72, 0x65, 0x2e, 0x78, 0x79, 0x7a, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x20, 0x3d, 0x20, 0x6f, 0x75, 0x74, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x5b, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 
+0x6f, 0x6e, 0x41, 0x6e, 0x64, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x2e, 0x77, 
+0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x70, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x20, 
+0x3d, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x5b, 0x70, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x2e, 0x76, 
+0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x41, 0x6e, 0x64, 0x48, 0x61, 0x73, 0x68, 0x2e, 
+0x78, 0x79, 0x7a, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x75, 
+0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x43, 0x65, 0x6c, 0x6c, 0x20, 0x3d, 
+0x20, 0x47, 0x65, 0x74, 0x43, 0x65, 0x6c, 0x6c, 0x28, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x2c, 0x20, 0x70, 0x61, 0x72, 
+0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 
+0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 
+0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 
+0x74, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x44, 0x65, 0x6e, 0x73, 0x69, 
+0x74, 0x79, 0x20, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 
+0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x20, 0x2f, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 
+0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x67, 0x61, 0x73, 0x43, 0x6f, 0x6e, 0x73, 0x74, 0x61, 
+0x6e, 0x74, 0x20, 0x2b, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 
+0x2d, 0x3e, 0x72, 0x65, 0x73, 0x74, 0x44, 0x65, 0x6e, 0x73, 0x69, 0x74, 0x79, 0x3b, 0x0d, 
+0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x77, 0x68, 0x69, 0x6c, 0x65, 0x20, 0x28, 0x74, 
+0x72, 0x75, 0x65, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x73, 0x65, 0x6c, 0x65, 0x63, 
+0x74, 0x65, 0x64, 0x20, 0x3d, 0x20, 0x53, 0x65, 0x6c, 0x65, 0x63, 0x74, 0x50, 0x65, 0x6e, 
+0x64, 0x69, 0x6e, 0x67, 0x57, 0x6f, 0x72, 0x6b, 0x49, 0x74, 0x65, 0x6d, 0x28, 0x26, 0x73, 
+0x65, 0x6c, 0x65, 0x63, 0x74, 0x65, 0x64, 0x57, 0x6f, 0x72, 0x6b, 0x49, 0x74, 0x65, 0x6d, 
+0x2c, 0x20, 0x70, 0x65, 0x6e, 0x64, 0x69, 0x6e, 0x67, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x73, 0x65, 0x6c, 0x65, 0x63, 0x74, 
+0x65, 0x64, 0x20, 0x3d, 0x3d, 0x20, 0x55, 0x49, 0x4e, 0x54, 0x5f, 0x4d, 0x41, 0x58, 0x29, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x62, 0x72, 0x65, 0x61, 0x6b, 0x3b, 0x0d, 
+0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x6c, 0x6f, 0x63, 
+0x61, 0x6c, 0x49, 0x44, 0x20, 0x3d, 0x3d, 0x20, 0x73, 0x65, 0x6c, 0x65, 0x63, 0x74, 0x65, 
+0x64, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x73, 0x65, 0x6c, 0x65, 0x63, 
+0x74, 0x65, 0x64, 0x43, 0x65, 0x6c, 0x6c, 0x20, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x43, 0x65, 0x6c, 0x6c, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x62, 0x61, 0x72, 0x72, 0x69, 0x65, 0x72, 0x28, 0x43, 0x4c, 0x4b, 0x5f, 0x4c, 
+0x4f, 0x43, 0x41, 0x4c, 0x5f, 0x4d, 0x45, 0x4d, 0x5f, 0x46, 0x45, 0x4e, 0x43, 0x45, 0x29, 
+0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x75, 
+0x20, 0x63, 0x65, 0x6c, 0x6c, 0x20, 0x3d, 0x20, 0x73, 0x65, 0x6c, 0x65, 0x63, 0x74, 0x65, 
+0x64, 0x43, 0x65, 0x6c, 0x6c, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x62, 0x6f, 
+0x6f, 0x6c, 0x20, 0x61, 0x63, 0x74, 0x69, 0x76, 0x65, 0x20, 0x3d, 0x20, 0x70, 0x65, 0x6e, 
+0x64, 0x69, 0x6e, 0x67, 0x20, 0x26, 0x26, 0x20, 0x61, 0x6c, 0x6c, 0x28, 0x70, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x43, 0x65, 0x6c, 0x6c, 0x20, 0x3d, 0x3d, 0x20, 0x63, 0x65, 
+0x6c, 0x6c, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x56, 0x65, 
+0x63, 0x33, 0x75, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x43, 0x65, 0x6c, 0x6c, 0x20, 0x3d, 
+0x20, 0x63, 0x65, 0x6c, 0x6c, 0x20, 0x2d, 0x20, 0x4e, 0x45, 0x57, 0x5f, 0x56, 0x45, 0x43, 
+0x33, 0x55, 0x28, 0x31, 0x2c, 0x20, 0x31, 0x2c, 0x20, 0x31, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x75, 0x20, 0x65, 0x6e, 0x64, 0x43, 0x65, 
+0x6c, 0x6c, 0x20, 0x3d, 0x20, 0x63, 0x65, 0x6c, 0x6c, 0x20, 0x2b, 0x20, 0x4e, 0x45, 0x57, 
+0x5f, 0x56, 0x45, 0x43, 0x33, 0x55, 0x28, 0x32, 0x2c, 0x20, 0x32, 0x2c, 0x20, 0x32, 0x29, 
+0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 
+0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 
+0x3d, 0x20, 0x4e, 0x45, 0x57, 0x5f, 0x56, 0x45, 0x43, 0x33, 0x46, 0x28, 0x30, 0x2e, 0x30, 
+0x66, 0x2c, 0x20, 0x30, 0x2e, 0x30, 0x66, 0x2c, 0x20, 0x30, 0x2e, 0x30, 0x66, 0x29, 0x3b, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x64, 0x79, 
+0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 
+0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x3d, 0x20, 
+0x4e, 0x45, 0x57, 0x5f, 0x56, 0x45, 0x43, 0x33, 0x46, 0x28, 0x30, 0x2e, 0x30, 0x66, 0x2c, 
+0x20, 0x30, 0x2e, 0x30, 0x66, 0x2c, 0x20, 0x30, 0x2e, 0x30, 0x66, 0x29, 0x3b, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x73, 0x74, 0x61, 0x74, 
+0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 
+0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x3d, 0x20, 0x4e, 0x45, 0x57, 0x5f, 
+0x56, 0x45, 0x43, 0x33, 0x46, 0x28, 0x30, 0x2e, 0x30, 0x66, 0x2c, 0x20, 0x30, 0x2e, 0x30, 
+0x66, 0x2c, 0x20, 0x30, 0x2e, 0x30, 0x66, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 
+0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x3d, 0x20, 0x4e, 0x45, 0x57, 0x5f, 0x56, 0x45, 0x43, 
+0x33, 0x46, 0x28, 0x30, 0x2e, 0x30, 0x66, 0x2c, 0x20, 0x30, 0x2e, 0x30, 0x66, 0x2c, 0x20, 
+0x30, 0x2e, 0x30, 0x66, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x62, 0x6f, 0x6f, 0x6c, 0x20, 0x6f, 0x75, 0x74, 0x73, 0x69, 0x64, 0x65, 0x47, 0x72, 0x69, 
+0x64, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x56, 0x69, 0x73, 0x69, 0x74, 0x65, 0x64, 0x20, 
+0x3d, 0x20, 0x66, 0x61, 0x6c, 0x73, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x75, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 
+0x6c, 0x6c, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 
+0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x78, 0x20, 0x3d, 0x20, 0x62, 
+0x65, 0x67, 0x69, 0x6e, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x78, 0x3b, 0x20, 0x6f, 0x74, 0x68, 
+0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x78, 0x20, 0x21, 0x3d, 0x20, 0x65, 0x6e, 0x64, 
+0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x78, 0x3b, 0x20, 0x2b, 0x2b, 0x6f, 0x74, 0x68, 0x65, 0x72, 
+0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x78, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x66, 0x6f, 0x72, 0x20, 0x28, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 
+0x79, 0x20, 0x3d, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x79, 
+0x3b, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x79, 0x20, 0x21, 
+0x3d, 0x20, 0x65, 0x6e, 0x64, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x79, 0x3b, 0x20, 0x2b, 0x2b, 
+0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x79, 0x29, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x6f, 0x74, 0x68, 0x65, 
+0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x7a, 0x20, 0x3d, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 
+0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x7a, 0x3b, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 
+0x6c, 0x6c, 0x2e, 0x7a, 0x20, 0x21, 0x3d, 0x20, 0x65, 0x6e, 0x64, 0x43, 0x65, 0x6c, 0x6c, 
+0x2e, 0x7a, 0x3b, 0x20, 0x2b, 0x2b, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 
+0x2e, 0x7a, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 
+0x6f, 0x74, 0x68, 0x65, 0x72, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x6f, 0x64, 0x20, 0x3d, 0x20, 
+0x47, 0x65, 0x74, 0x43, 0x65, 0x6c, 0x6c, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x28, 0x6f, 
+0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2c, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 
+0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 
+0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 
+0x74, 0x65, 0x72, 0x73, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x49, 0x73, 0x4f, 0x75, 0x74, 0x73, 0x69, 0x64, 
+0x65, 0x47, 0x72, 0x69, 0x64, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x28, 0x6f, 0x74, 0x68, 
+0x65, 0x72, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x6f, 0x64, 0x2c, 0x20, 0x64, 0x79, 0x6e, 0x61, 
+0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 
+0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 
+0x65, 0x74, 0x65, 0x72, 0x73, 0x29, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 
+0x66, 0x20, 0x28, 0x6f, 0x75, 0x74, 0x73, 0x69, 0x64, 0x65, 0x47, 0x72, 0x69, 0x64, 0x42, 
+0x75, 0x63, 0x6b, 0x65, 0x74, 0x56, 0x69, 0x73, 0x69, 0x74, 0x65, 0x64, 0x29, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x74, 0x69, 
+0x6e, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x6f, 0x75, 0x74, 0x73, 0x69, 0x64, 0x65, 0x47, 0x72, 0x69, 0x64, 0x42, 0x75, 
+0x63, 0x6b, 0x65, 0x74, 0x56, 0x69, 0x73, 0x69, 0x74, 0x65, 0x64, 0x20, 0x3d, 0x20, 0x74, 
+0x72, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7d, 
+0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 
+0x74, 0x33, 0x32, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 
+0x3d, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x5b, 0x6f, 0x74, 0x68, 0x65, 0x72, 
+0x48, 0x61, 0x73, 0x68, 0x4d, 0x6f, 0x64, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x65, 0x6e, 0x64, 0x49, 
+0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x5b, 
+0x6f, 0x74, 0x68, 0x65, 0x72, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x6f, 0x64, 0x20, 0x2b, 0x20, 
+0x31, 0x5d, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x66, 0x6f, 0x72, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x74, 0x69, 0x6c, 
+0x65, 0x42, 0x65, 0x67, 0x69, 0x6e, 0x20, 0x3d, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 
+0x6e, 0x64, 0x65, 0x78, 0x3b, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x42, 0x65, 0x67, 0x69, 0x6e, 
+0x20, 0x3c, 0x20, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x3b, 0x20, 0x74, 0x69, 
+0x6c, 0x65, 0x42, 0x65, 0x67, 0x69, 0x6e, 0x20, 0x2b, 0x3d, 0x20, 0x6c, 0x6f, 0x63, 0x61, 
+0x6c, 0x53, 0x69, 0x7a, 0x65, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x75, 0x69, 
+0x6e, 0x74, 0x33, 0x32, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x53, 0x69, 0x7a, 0x65, 0x20, 0x3d, 
+0x20, 0x6d, 0x69, 0x6e, 0x28, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x2d, 
+0x20, 0x74, 0x69, 0x6c, 0x65, 0x42, 0x65, 0x67, 0x69, 0x6e, 0x2c, 0x20, 0x6c, 0x6f, 0x63, 
+0x61, 0x6c, 0x53, 0x69, 0x7a, 0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x62, 0x61, 0x72, 0x72, 0x69, 0x65, 0x72, 0x28, 0x43, 
+0x4c, 0x4b, 0x5f, 0x4c, 0x4f, 0x43, 0x41, 0x4c, 0x5f, 0x4d, 0x45, 0x4d, 0x5f, 0x46, 0x45, 
+0x4e, 0x43, 0x45, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x49, 0x44, 0x20, 
+0x3c, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x53, 0x69, 0x7a, 0x65, 0x29, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x69, 0x6e, 0x64, 
+0x65, 0x78, 0x20, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 
+0x70, 0x5b, 0x74, 0x69, 0x6c, 0x65, 0x42, 0x65, 0x67, 0x69, 0x6e, 0x20, 0x2b, 0x20, 0x6c, 
+0x6f, 0x63, 0x61, 0x6c, 0x49, 0x44, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x2f, 0x2f, 0x54, 0x68, 0x65, 0x20, 0x70, 0x72, 0x65, 0x73, 
+0x73, 0x75, 0x72, 0x65, 0x20, 0x77, 0x61, 0x73, 0x20, 0x63, 0x6f, 0x6d, 0x70, 0x75, 0x74, 
+0x65, 0x64, 0x20, 0x69, 0x6e, 0x74, 0x6f, 0x20, 0x74, 0x68, 0x65, 0x20, 0x6f, 0x75, 0x74, 
+0x70, 0x75, 0x74, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 0x34, 0x66, 
+0x20, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x41, 0x6e, 0x64, 0x50, 0x72, 0x65, 
+0x73, 0x73, 0x75, 0x72, 0x65, 0x20, 0x3d, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x73, 0x5b, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x2e, 0x70, 0x6f, 0x73, 
+0x69, 0x74, 0x69, 0x6f, 0x6e, 0x41, 0x6e, 0x64, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 
+0x65, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x70, 
+0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x41, 0x6e, 0x64, 0x50, 0x72, 0x65, 0x73, 0x73, 
+0x75, 0x72, 0x65, 0x2e, 0x77, 0x20, 0x3d, 0x20, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x73, 0x5b, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x2e, 0x70, 0x6f, 
+0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x41, 0x6e, 0x64, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 
+0x72, 0x65, 0x2e, 0x77, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x74, 0x69, 0x6c, 0x65, 0x49, 0x6e, 0x64, 0x69, 0x63, 0x65, 0x73, 
+0x5b, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x49, 0x44, 0x5d, 0x20, 0x3d, 0x20, 0x69, 0x6e, 0x64, 
+0x65, 0x78, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x74, 0x69, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x73, 0x5b, 0x6c, 
+0x6f, 0x63, 0x61, 0x6c, 0x49, 0x44, 0x5d, 0x20, 0x3d, 0x20, 0x70, 0x6f, 0x73, 0x69, 0x74, 
+0x69, 0x6f, 0x6e, 0x41, 0x6e, 0x64, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x3b, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x74, 0x69, 0x6c, 
+0x65, 0x56, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x69, 0x65, 0x73, 0x5b, 0x6c, 0x6f, 0x63, 
+0x61, 0x6c, 0x49, 0x44, 0x5d, 0x20, 0x3d, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x73, 0x5b, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x2e, 0x76, 0x65, 0x6c, 
+0x6f, 0x63, 0x69, 0x74, 0x79, 0x41, 0x6e, 0x64, 0x48, 0x61, 0x73, 0x68, 0x3b, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x62, 0x61, 0x72, 0x72, 0x69, 0x65, 0x72, 
+0x28, 0x43, 0x4c, 0x4b, 0x5f, 0x4c, 0x4f, 0x43, 0x41, 0x4c, 0x5f, 0x4d, 0x45, 0x4d, 0x5f, 
+0x46, 0x45, 0x4e, 0x43, 0x45, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x21, 0x61, 0x63, 0x74, 0x69, 0x76, 
+0x65, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x63, 
+0x6f, 0x6e, 0x74, 0x69, 0x6e, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 
+0x33, 0x32, 0x20, 0x69, 0x20, 0x3d, 0x20, 0x30, 0x3b, 0x20, 0x69, 0x20, 0x3c, 0x20, 0x74, 
+0x69, 0x6c, 0x65, 0x53, 0x69, 0x7a, 0x65, 0x3b, 0x20, 0x2b, 0x2b, 0x69, 0x29, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x69, 
+0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x49, 0x6e, 0x64, 0x69, 
+0x63, 0x65, 0x73, 0x5b, 0x69, 0x5d, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x69, 0x6e, 0x64, 0x65, 0x78, 
+0x20, 0x3d, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x64, 
+0x65, 0x78, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x63, 0x6f, 0x6e, 0x74, 0x69, 0x6e, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 0x34, 0x66, 0x20, 
+0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 
+0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x41, 0x6e, 0x64, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 
+0x72, 0x65, 0x20, 0x3d, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 
+0x6f, 0x6e, 0x73, 0x5b, 0x69, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 
+0x6e, 0x20, 0x3d, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x41, 0x6e, 0x64, 0x50, 0x72, 
+0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x2e, 0x78, 0x79, 0x7a, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x6f, 
+0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x65, 0x6c, 
+0x6f, 0x63, 0x69, 0x74, 0x79, 0x20, 0x3d, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x56, 0x65, 0x6c, 
+0x6f, 0x63, 0x69, 0x74, 0x69, 0x65, 0x73, 0x5b, 0x69, 0x5d, 0x2e, 0x78, 0x79, 0x7a, 0x3b, 
+0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x56, 
+0x65, 0x63, 0x33, 0x66, 0x20, 0x64, 0x69, 0x72, 0x20, 0x3d, 0x20, 0x6f, 0x74, 0x68, 0x65, 
+0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 
+0x6f, 0x6e, 0x20, 0x2d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 
+0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x69, 0x73, 0x74, 0x53, 
+0x71, 0x72, 0x20, 0x3d, 0x20, 0x64, 0x6f, 0x74, 0x28, 0x64, 0x69, 0x72, 0x2c, 0x20, 0x64, 
+0x69, 0x72, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x20, 
+0x3e, 0x20, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 
+0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x53, 0x71, 0x72, 0x29, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x74, 
+0x69, 0x6e, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x69, 0x73, 0x74, 0x20, 
+0x3d, 0x20, 0x73, 0x71, 0x72, 0x74, 0x28, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x29, 
+0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x69, 0x66, 0x20, 0x28, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x20, 0x3d, 0x3d, 0x20, 
+0x30, 0x20, 0x7c, 0x7c, 0x20, 0x64, 0x69, 0x73, 0x74, 0x20, 0x3d, 0x3d, 0x20, 0x30, 0x29, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x64, 0x69, 0x72, 0x20, 
+0x3d, 0x20, 0x52, 0x61, 0x6e, 0x64, 0x6f, 0x6d, 0x44, 0x69, 0x72, 0x65, 0x63, 0x74, 0x69, 
+0x6f, 0x6e, 0x28, 0x28, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x29, 0x70, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x70, 0x72, 0x69, 0x6e, 0x74, 0x66, 0x28, 
+0x22, 0x54, 0x77, 0x6f, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x20, 0x70, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x20, 0x68, 0x61, 0x76, 0x65, 0x20, 0x74, 0x68, 
+0x65, 0x20, 0x73, 0x61, 0x6d, 0x65, 0x20, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 
+0x2e, 0x20, 0x53, 0x69, 0x6d, 0x75, 0x6c, 0x61, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x77, 0x6f, 
+0x6e, 0x74, 0x20, 0x62, 0x65, 0x20, 0x64, 0x65, 0x74, 0x65, 0x72, 0x6d, 0x69, 0x6e, 0x69, 
+0x73, 0x74, 0x69, 0x63, 0x2e, 0x20, 0x46, 0x69, 0x72, 0x73, 0x74, 0x20, 0x70, 0x6f, 0x73, 
+0x69, 0x74, 0x69, 0x6f, 0x6e, 0x3a, 0x20, 0x25, 0x20, 0x33, 0x2e, 0x33, 0x76, 0x33, 0x66, 
+0x3b, 0x20, 0x73, 0x65, 0x63, 0x6f, 0x6e, 0x64, 0x20, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 
+0x6f, 0x6e, 0x3a, 0x20, 0x25, 0x20, 0x33, 0x2e, 0x33, 0x76, 0x33, 0x66, 0x3b, 0x20, 0x69, 
+0x31, 0x3a, 0x20, 0x25, 0x75, 0x3b, 0x20, 0x69, 0x32, 0x3a, 0x20, 0x25, 0x75, 0x22, 0x2c, 
+0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 
+0x6f, 0x6e, 0x2c, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x2c, 0x20, 0x70, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x2c, 0x20, 0x69, 0x6e, 0x64, 
+0x65, 0x78, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x65, 
+0x6c, 0x73, 0x65, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x64, 0x69, 0x72, 0x20, 0x2f, 0x3d, 0x20, 0x64, 0x69, 0x73, 0x74, 0x3b, 0x0d, 0x0a, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x64, 0x79, 0x6e, 
+0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 
+0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x2b, 0x3d, 0x20, 0x64, 
+0x69, 0x72, 0x20, 0x2a, 0x20, 0x28, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 
+0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x20, 0x2b, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 
+0x6e, 0x41, 0x6e, 0x64, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x2e, 0x77, 0x29, 
+0x20, 0x2a, 0x20, 0x53, 0x6d, 0x6f, 0x6f, 0x74, 0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 
+0x6e, 0x65, 0x6c, 0x44, 0x31, 0x28, 0x64, 0x69, 0x73, 0x74, 0x2c, 0x20, 0x70, 0x61, 0x72, 
+0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 
+0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 
+0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 
+0x2b, 0x3d, 0x20, 0x28, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x56, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x20, 0x2d, 0x20, 0x70, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x29, 
+0x20, 0x2a, 0x20, 0x53, 0x6d, 0x6f, 0x6f, 0x74, 0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 
+0x6e, 0x65, 0x6c, 0x44, 0x32, 0x28, 0x64, 0x69, 0x73, 0x74, 0x2c, 0x20, 0x70, 0x61, 0x72, 
+0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 
+0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 
+0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7d, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x73, 0x74, 0x61, 
+0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x43, 0x6f, 0x75, 
+0x6e, 0x74, 0x20, 0x3d, 0x3d, 0x20, 0x30, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x74, 0x69, 0x6e, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x6f, 0x74, 0x68, 0x65, 0x72, 
+0x48, 0x61, 0x73, 0x68, 0x4d, 0x6f, 0x64, 0x20, 0x3d, 0x20, 0x47, 0x65, 0x74, 0x43, 0x65, 
+0x6c, 0x6c, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x28, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 
+0x65, 0x6c, 0x6c, 0x2c, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 
+0x65, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x29, 0x3b, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x62, 0x65, 0x67, 0x69, 0x6e, 
+0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 
+0x5b, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x6f, 0x64, 0x5d, 0x3b, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x65, 0x6e, 0x64, 0x49, 0x6e, 
+0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x5b, 0x6f, 
+0x74, 0x68, 0x65, 0x72, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x6f, 0x64, 0x20, 0x2b, 0x20, 0x31, 
+0x5d, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x66, 
+0x6f, 0x72, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x74, 0x69, 0x6c, 0x65, 
+0x42, 0x65, 0x67, 0x69, 0x6e, 0x20, 0x3d, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 0x6e, 
+0x64, 0x65, 0x78, 0x3b, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x42, 0x65, 0x67, 0x69, 0x6e, 0x20, 
+0x3c, 0x20, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x3b, 0x20, 0x74, 0x69, 0x6c, 
+0x65, 0x42, 0x65, 0x67, 0x69, 0x6e, 0x20, 0x2b, 0x3d, 0x20, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 
+0x53, 0x69, 0x7a, 0x65, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 
+0x74, 0x33, 0x32, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x53, 0x69, 0x7a, 0x65, 0x20, 0x3d, 0x20, 
+0x6d, 0x69, 0x6e, 0x28, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x2d, 0x20, 
+0x74, 0x69, 0x6c, 0x65, 0x42, 0x65, 0x67, 0x69, 0x6e, 0x2c, 0x20, 0x6c, 0x6f, 0x63, 0x61, 
+0x6c, 0x53, 0x69, 0x7a, 0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x62, 0x61, 0x72, 0x72, 0x69, 0x65, 0x72, 0x28, 0x43, 0x4c, 
+0x4b, 0x5f, 0x4c, 0x4f, 0x43, 0x41, 0x4c, 0x5f, 0x4d, 0x45, 0x4d, 0x5f, 0x46, 0x45, 0x4e, 
+0x43, 0x45, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x49, 0x44, 0x20, 0x3c, 
+0x20, 0x74, 0x69, 0x6c, 0x65, 0x53, 0x69, 0x7a, 0x65, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x74, 0x69, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 
+0x74, 0x69, 0x6f, 0x6e, 0x73, 0x5b, 0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x49, 0x44, 0x5d, 0x20, 
+0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x73, 0x5b, 0x74, 0x69, 0x6c, 0x65, 0x42, 0x65, 0x67, 0x69, 0x6e, 0x20, 0x2b, 0x20, 
+0x6c, 0x6f, 0x63, 0x61, 0x6c, 0x49, 0x44, 0x5d, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 
+0x6f, 0x6e, 0x41, 0x6e, 0x64, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x3b, 0x0d, 
+0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x62, 0x61, 0x72, 
+0x72, 0x69, 0x65, 0x72, 0x28, 0x43, 0x4c, 0x4b, 0x5f, 0x4c, 0x4f, 0x43, 0x41, 0x4c, 0x5f, 
+0x4d, 0x45, 0x4d, 0x5f, 0x46, 0x45, 0x4e, 0x43, 0x45, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x21, 0x61, 
+0x63, 0x74, 0x69, 0x76, 0x65, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x74, 0x69, 0x6e, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 
+0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x69, 0x20, 0x3d, 0x20, 0x30, 0x3b, 0x20, 0x69, 
+0x20, 0x3c, 0x20, 0x74, 0x69, 0x6c, 0x65, 0x53, 0x69, 0x7a, 0x65, 0x3b, 0x20, 0x2b, 0x2b, 
+0x69, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7b, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 
+0x66, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x3d, 0x20, 0x74, 0x69, 0x6c, 0x65, 
+0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x73, 0x5b, 0x69, 0x5d, 0x2e, 0x78, 0x79, 
+0x7a, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x64, 0x69, 0x72, 0x20, 0x3d, 0x20, 0x6f, 0x74, 
+0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 
+0x74, 0x69, 0x6f, 0x6e, 0x20, 0x2d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x69, 0x73, 
+0x74, 0x53, 0x71, 0x72, 0x20, 0x3d, 0x20, 0x64, 0x6f, 0x74, 0x28, 0x64, 0x69, 0x72, 0x2c, 
+0x20, 0x64, 0x69, 0x72, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 
+0x72, 0x20, 0x3e, 0x20, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 
+0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x53, 0x71, 0x72, 0x29, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x63, 0x6f, 
+0x6e, 0x74, 0x69, 0x6e, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x69, 0x73, 
+0x74, 0x20, 0x3d, 0x20, 0x73, 0x71, 0x72, 0x74, 0x28, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 
+0x72, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x20, 0x3d, 
+0x3d, 0x20, 0x30, 0x20, 0x7c, 0x7c, 0x20, 0x64, 0x69, 0x73, 0x74, 0x20, 0x3d, 0x3d, 0x20, 
+0x30, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7b, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x64, 0x69, 
+0x72, 0x20, 0x3d, 0x20, 0x52, 0x61, 0x6e, 0x64, 0x6f, 0x6d, 0x44, 0x69, 0x72, 0x65, 0x63, 
+0x74, 0x69, 0x6f, 0x6e, 0x28, 0x28, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x29, 0x70, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x70, 0x72, 0x69, 0x6e, 0x74, 
+0x66, 0x28, 0x22, 0x41, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x20, 0x70, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x20, 0x61, 0x6e, 0x64, 0x20, 0x61, 0x20, 0x73, 0x74, 
+0x61, 0x74, 0x69, 0x63, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x20, 0x68, 
+0x61, 0x76, 0x65, 0x20, 0x74, 0x68, 0x65, 0x20, 0x73, 0x61, 0x6d, 0x65, 0x20, 0x70, 0x6f, 
+0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x2e, 0x20, 0x53, 0x69, 0x6d, 0x75, 0x6c, 0x61, 0x74, 
+0x69, 0x6f, 0x6e, 0x20, 0x77, 0x6f, 0x6e, 0x74, 0x20, 0x62, 0x65, 0x20, 0x64, 0x65, 0x74, 
+0x65, 0x72, 0x6d, 0x69, 0x6e, 0x69, 0x73, 0x74, 0x69, 0x63, 0x2e, 0x20, 0x46, 0x69, 0x72, 
+0x73, 0x74, 0x20, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x3a, 0x20, 0x25, 0x20, 
+0x33, 0x2e, 0x33, 0x76, 0x33, 0x66, 0x3b, 0x20, 0x73, 0x65, 0x63, 0x6f, 0x6e, 0x64, 0x20, 
+0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x3a, 0x20, 0x25, 0x20, 0x33, 0x2e, 0x33, 
+0x76, 0x33, 0x66, 0x22, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 
+0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x2c, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 
+0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7d, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x65, 0x6c, 0x73, 
+0x65, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x64, 
+0x69, 0x72, 0x20, 0x2f, 0x3d, 0x20, 0x64, 0x69, 0x73, 0x74, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x73, 0x74, 0x61, 0x74, 0x69, 
+0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 
+0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x2b, 0x3d, 0x20, 0x64, 0x69, 0x72, 0x20, 
+0x2a, 0x20, 0x66, 0x61, 0x62, 0x73, 0x28, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x29, 0x20, 0x2a, 0x20, 0x53, 0x6d, 0x6f, 
+0x6f, 0x74, 0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x44, 0x31, 0x28, 
+0x64, 0x69, 0x73, 0x74, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 
+0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 
+0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 
+0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x2b, 0x3d, 0x20, 0x2d, 0x70, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x20, 0x2a, 
+0x20, 0x53, 0x6d, 0x6f, 0x6f, 0x74, 0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 0x6e, 0x65, 
+0x6c, 0x44, 0x32, 0x28, 0x64, 0x69, 0x73, 0x74, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 
+0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 
+0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 
+0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 
+0x20, 0x28, 0x21, 0x61, 0x63, 0x74, 0x69, 0x76, 0x65, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x74, 0x69, 0x6e, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x70, 0x65, 0x6e, 0x64, 0x69, 0x6e, 0x67, 0x20, 0x3d, 
+0x20, 0x66, 0x61, 0x6c, 0x73, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 
+0x2a, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 
+0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x73, 0x73, 0x20, 0x2f, 0x20, 
+0x28, 0x32, 0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x44, 0x65, 
+0x6e, 0x73, 0x69, 0x74, 0x79, 0x29, 0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 
+0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x73, 0x6d, 0x6f, 0x6f, 0x74, 0x68, 0x69, 0x6e, 0x67, 
+0x4b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x43, 0x6f, 0x6e, 0x73, 0x74, 0x61, 0x6e, 0x74, 0x3b, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 
+0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x2a, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 
+0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x76, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 
+0x79, 0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 
+0x3e, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x73, 0x73, 0x20, 0x2a, 
+0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x73, 0x6d, 
+0x6f, 0x6f, 0x74, 0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x43, 0x6f, 
+0x6e, 0x73, 0x74, 0x61, 0x6e, 0x74, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x73, 
+0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 
+0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x2a, 0x3d, 0x20, 
+0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x70, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x73, 0x73, 0x20, 0x2f, 0x20, 0x28, 0x32, 0x20, 
+0x2a, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x44, 0x65, 0x6e, 0x73, 0x69, 
+0x74, 0x79, 0x29, 0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 
+0x73, 0x2d, 0x3e, 0x73, 0x6d, 0x6f, 0x6f, 0x74, 0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 
+0x6e, 0x65, 0x6c, 0x43, 0x6f, 0x6e, 0x73, 0x74, 0x61, 0x6e, 0x74, 0x20, 0x2a, 0x20, 0x31, 
+0x2e, 0x30, 0x66, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x73, 0x74, 0x61, 0x74, 
+0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 
+0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x2a, 0x3d, 0x20, 0x70, 0x61, 
+0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x76, 0x69, 0x73, 0x63, 0x6f, 
+0x73, 0x69, 0x74, 0x79, 0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 
+0x72, 0x73, 0x2d, 0x3e, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x73, 
+0x73, 0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 
+0x3e, 0x73, 0x6d, 0x6f, 0x6f, 0x74, 0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 0x6e, 0x65, 
+0x6c, 0x43, 0x6f, 0x6e, 0x73, 0x74, 0x61, 0x6e, 0x74, 0x20, 0x2a, 0x20, 0x30, 0x2e, 0x30, 
+0x66, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 
+0x66, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 
+0x20, 0x3d, 0x20, 0x4e, 0x45, 0x57, 0x5f, 0x56, 0x45, 0x43, 0x33, 0x46, 0x28, 0x30, 0x2c, 
+0x20, 0x30, 0x2c, 0x20, 0x30, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x70, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x2b, 0x3d, 
+0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x3b, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x2b, 0x3d, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 
+0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 
+0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 
+0x2b, 0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 
+0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x2b, 0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 
+0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 
+0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x69, 0x66, 0x20, 0x28, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x43, 0x6f, 
+0x75, 0x6e, 0x74, 0x20, 0x21, 0x3d, 0x20, 0x30, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 
+0x20, 0x2b, 0x3d, 0x20, 0x43, 0x61, 0x6c, 0x63, 0x75, 0x6c, 0x61, 0x74, 0x65, 0x42, 0x6f, 
+0x75, 0x6e, 0x64, 0x61, 0x72, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x28, 0x70, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x2c, 0x20, 
+0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 
+0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x48, 
+0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 
+0x65, 0x4d, 0x61, 0x70, 0x2c, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x73, 
+0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 
+0x61, 0x63, 0x63, 0x65, 0x6c, 0x65, 0x72, 0x61, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x3d, 0x20, 
+0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x2f, 
+0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x44, 0x65, 0x6e, 0x73, 0x69, 0x74, 
+0x79, 0x20, 0x2b, 0x20, 0x4e, 0x45, 0x57, 0x5f, 0x56, 0x45, 0x43, 0x33, 0x46, 0x28, 0x70, 
+0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x67, 0x72, 0x61, 0x76, 
+0x69, 0x74, 0x79, 0x58, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 
+0x73, 0x2d, 0x3e, 0x67, 0x72, 0x61, 0x76, 0x69, 0x74, 0x79, 0x59, 0x2c, 0x20, 0x70, 0x61, 
+0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x67, 0x72, 0x61, 0x76, 0x69, 
+0x74, 0x79, 0x5a, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x56, 
+0x65, 0x63, 0x33, 0x66, 0x20, 0x6e, 0x65, 0x77, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x56, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x20, 0x3d, 0x20, 0x70, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x20, 0x2b, 
+0x20, 0x61, 0x63, 0x63, 0x65, 0x6c, 0x65, 0x72, 0x61, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x2a, 
+0x20, 0x64, 0x65, 0x6c, 0x74, 0x61, 0x54, 0x69, 0x6d, 0x65, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x6e, 0x65, 0x77, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x3d, 
+0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 
+0x6f, 0x6e, 0x20, 0x2b, 0x20, 0x6e, 0x65, 0x77, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x56, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x20, 0x2a, 0x20, 0x64, 0x65, 0x6c, 
+0x74, 0x61, 0x54, 0x69, 0x6d, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x48, 0x61, 0x73, 0x68, 0x20, 0x3d, 0x20, 0x47, 0x65, 0x74, 0x43, 0x65, 0x6c, 0x6c, 
+0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x28, 0x47, 0x65, 0x74, 0x43, 0x65, 0x6c, 0x6c, 0x28, 
+0x6e, 0x65, 0x77, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 
+0x74, 0x69, 0x6f, 0x6e, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 
+0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 
+0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x2c, 0x20, 0x64, 0x79, 
+0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 
+0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x70, 0x61, 0x72, 
+0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 
+0x5b, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 
+0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x41, 0x6e, 0x64, 0x50, 0x72, 0x65, 
+0x73, 0x73, 0x75, 0x72, 0x65, 0x2e, 0x78, 0x79, 0x7a, 0x20, 0x3d, 0x20, 0x6e, 0x65, 0x77, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 
+0x6e, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x5b, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x2e, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 
+0x41, 0x6e, 0x64, 0x48, 0x61, 0x73, 0x68, 0x2e, 0x78, 0x79, 0x7a, 0x20, 0x3d, 0x20, 0x6e, 
+0x65, 0x77, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x65, 0x6c, 0x6f, 0x63, 
+0x69, 0x74, 0x79, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x6f, 0x75, 0x74, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x5b, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x2e, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 
+0x74, 0x79, 0x41, 0x6e, 0x64, 0x48, 0x61, 0x73, 0x68, 0x2e, 0x77, 0x20, 0x3d, 0x20, 0x61, 
+0x73, 0x5f, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x28, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x48, 0x61, 0x73, 0x68, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 
+0x0a, 0x23, 0x65, 0x6e, 0x64, 0x69, 0x66, 0x0d, 0x0a, 0x0d, 0x0a, 0x23, 0x69, 0x66, 0x6e, 
+0x64, 0x65, 0x66, 0x20, 0x43, 0x4c, 0x5f, 0x43, 0x4f, 0x4d, 0x50, 0x49, 0x4c, 0x45, 0x52, 
+0x0d, 0x0a, 0x09, 0x2f, 0x2f, 0x56, 0x65, 0x72, 0x73, 0x69, 0x6f, 0x6e, 0x20, 0x6f, 0x66, 
+0x20, 0x43, 0x6f, 0x6d, 0x70, 0x75, 0x74, 0x65, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x41, 0x6e, 
+0x64, 0x50, 0x72, 0x65, 0x70, 0x61, 0x72, 0x65, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 
+0x20, 0x74, 0x68, 0x61, 0x74, 0x20, 0x63, 0x61, 0x6e, 0x20, 0x61, 0x6c, 0x73, 0x6f, 0x20, 
+0x75, 0x73, 0x65, 0x20, 0x74, 0x68, 0x65, 0x20, 0x64, 0x65, 0x6e, 0x73, 0x65, 0x20, 0x67, 
+0x72, 0x69, 0x64, 0x2e, 0x20, 0x49, 0x74, 0x20, 0x69, 0x73, 0x20, 0x75, 0x73, 0x65, 0x64, 
+0x20, 0x62, 0x79, 0x20, 0x74, 0x68, 0x65, 0x20, 0x43, 0x50, 0x55, 0x0d, 0x0a, 0x09, 0x2f, 
+0x2f, 0x65, 0x6e, 0x67, 0x69, 0x6e, 0x65, 0x0d, 0x0a, 0x09, 0x76, 0x6f, 0x69, 0x64, 0x20, 
+0x43, 0x6f, 0x6d, 0x70, 0x75, 0x74, 0x65, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x41, 0x6e, 0x64, 
+0x50, 0x72, 0x65, 0x70, 0x61, 0x72, 0x65, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x28, 
+0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 
+0x2c, 0x20, 0x76, 0x6f, 0x6c, 0x61, 0x74, 0x69, 0x6c, 0x65, 0x20, 0x48, 0x41, 0x53, 0x48, 
+0x5f, 0x54, 0x59, 0x50, 0x45, 0x2a, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 
+0x20, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 
+0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x73, 0x2c, 0x20, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x42, 0x65, 0x68, 0x61, 0x76, 0x69, 0x6f, 0x75, 0x72, 0x50, 0x61, 0x72, 
+0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 
+0x74, 0x65, 0x72, 0x73, 0x2c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x70, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x29, 0x0d, 0x0a, 0x09, 
+0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x70, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x20, 0x3d, 0x20, 0x47, 0x65, 0x74, 
+0x43, 0x65, 0x6c, 0x6c, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x28, 0x47, 0x65, 0x74, 0x43, 
+0x65, 0x6c, 0x6c, 0x28, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x5b, 0x74, 
+0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 
+0x6f, 0x6e, 0x41, 0x6e, 0x64, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x2e, 0x78, 
+0x79, 0x7a, 0x28, 0x29, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 
+0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 
+0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x2c, 0x20, 0x68, 0x61, 
+0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 
+0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x70, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 
+0x49, 0x44, 0x5d, 0x2e, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x41, 0x6e, 0x64, 
+0x48, 0x61, 0x73, 0x68, 0x2e, 0x77, 0x20, 0x3d, 0x20, 0x2a, 0x28, 0x66, 0x6c, 0x6f, 0x61, 
+0x74, 0x2a, 0x29, 0x26, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x48, 0x61, 0x73, 
+0x68, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x61, 0x74, 0x6f, 0x6d, 0x69, 0x63, 0x5f, 
+0x69, 0x6e, 0x63, 0x28, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x20, 0x2b, 0x20, 0x70, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x29, 0x3b, 0x0d, 0x0a, 
+0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x2f, 0x2f, 0x56, 0x65, 0x72, 0x73, 0x69, 0x6f, 
+0x6e, 0x73, 0x20, 0x6f, 0x66, 0x20, 0x74, 0x68, 0x65, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 
+0x69, 0x63, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x20, 0x66, 0x75, 0x6e, 
+0x63, 0x74, 0x69, 0x6f, 0x6e, 0x73, 0x20, 0x66, 0x6f, 0x72, 0x20, 0x70, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x73, 0x20, 0x73, 0x74, 0x6f, 0x72, 0x65, 0x64, 0x20, 0x69, 0x6e, 
+0x20, 0x74, 0x68, 0x65, 0x20, 0x53, 0x74, 0x72, 0x75, 0x63, 0x74, 0x4f, 0x66, 0x41, 0x72, 
+0x72, 0x61, 0x79, 0x73, 0x20, 0x6c, 0x61, 0x79, 0x6f, 0x75, 0x74, 0x2e, 0x20, 0x54, 0x68, 
+0x65, 0x79, 0x20, 0x61, 0x72, 0x65, 0x20, 0x6f, 0x6e, 0x6c, 0x79, 0x20, 0x75, 0x73, 0x65, 
+0x64, 0x0d, 0x0a, 0x09, 0x2f, 0x2f, 0x62, 0x79, 0x20, 0x74, 0x68, 0x65, 0x20, 0x43, 0x50, 
+0x55, 0x20, 0x65, 0x6e, 0x67, 0x69, 0x6e, 0x65, 0x2e, 0x20, 0x54, 0x68, 0x65, 0x20, 0x6e, 
+0x65, 0x69, 0x67, 0x68, 0x62, 0x6f, 0x75, 0x72, 0x20, 0x6c, 0x6f, 0x6f, 0x70, 0x73, 0x20, 
+0x72, 0x65, 0x61, 0x64, 0x20, 0x6f, 0x6e, 0x6c, 0x79, 0x20, 0x74, 0x68, 0x65, 0x20, 0x73, 
+0x74, 0x72, 0x65, 0x61, 0x6d, 0x73, 0x20, 0x74, 0x68, 0x65, 0x79, 0x20, 0x6e, 0x65, 0x65, 
+0x64, 0x20, 0x69, 0x6e, 0x73, 0x74, 0x65, 0x61, 0x64, 0x20, 0x6f, 0x66, 0x20, 0x77, 0x68, 
+0x6f, 0x6c, 0x65, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x0d, 0x0a, 
+0x0d, 0x0a, 0x09, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x53, 0x74, 0x72, 0x65, 0x61, 0x6d, 0x73, 0x20, 0x47, 0x65, 0x74, 0x44, 
+0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x53, 
+0x74, 0x72, 0x65, 0x61, 0x6d, 0x73, 0x28, 0x76, 0x6f, 0x69, 0x64, 0x2a, 0x20, 0x70, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 
+0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x29, 
+0x0d, 0x0a, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x2a, 0x20, 
+0x73, 0x74, 0x72, 0x65, 0x61, 0x6d, 0x73, 0x20, 0x3d, 0x20, 0x28, 0x66, 0x6c, 0x6f, 0x61, 
+0x74, 0x2a, 0x29, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x3b, 0x0d, 0x0a, 
+0x0d, 0x0a, 0x09, 0x09, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x53, 0x74, 0x72, 0x65, 0x61, 0x6d, 0x73, 0x20, 0x6f, 0x75, 0x74, 
+0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x6f, 0x75, 0x74, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 
+0x6f, 0x6e, 0x58, 0x20, 0x3d, 0x20, 0x73, 0x74, 0x72, 0x65, 0x61, 0x6d, 0x73, 0x20, 0x2b, 
+0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x20, 
+0x2a, 0x20, 0x30, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x6f, 0x75, 0x74, 0x2e, 0x70, 0x6f, 0x73, 
+0x69, 0x74, 0x69, 0x6f, 0x6e, 0x59, 0x20, 0x3d, 0x20, 0x73, 0x74, 0x72, 0x65, 0x61, 0x6d, 
+0x73, 0x20, 0x2b, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x43, 0x6f, 0x75, 
+0x6e, 0x74, 0x20, 0x2a, 0x20, 0x31, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x6f, 0x75, 0x74, 0x2e, 
+0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x5a, 0x20, 0x3d, 0x20, 0x73, 0x74, 0x72, 
+0x65, 0x61, 0x6d, 0x73, 0x20, 0x2b, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x43, 0x6f, 0x75, 0x6e, 0x74, 0x20, 0x2a, 0x20, 0x32, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x6f, 
+0x75, 0x74, 0x2e, 0x70, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x20, 0x3d, 0x20, 0x73, 
+0x74, 0x72, 0x65, 0x61, 0x6d, 0x73, 0x20, 0x2b, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x20, 0x2a, 0x20, 0x33, 0x3b, 0x0d, 0x0a, 0x09, 
+0x09, 0x6f, 0x75, 0x74, 0x2e, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x58, 0x20, 
+0x3d, 0x20, 0x73, 0x74, 0x72, 0x65, 0x61, 0x6d, 0x73, 0x20, 0x2b, 0x20, 0x70, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x20, 0x2a, 0x20, 0x34, 0x3b, 
+0x0d, 0x0a, 0x09, 0x09, 0x6f, 0x75, 0x74, 0x2e, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 
+0x79, 0x59, 0x20, 0x3d, 0x20, 0x73, 0x74, 0x72, 0x65, 0x61, 0x6d, 0x73, 0x20, 0x2b, 0x20, 
+0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x20, 0x2a, 
+0x20, 0x35, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x6f, 0x75, 0x74, 0x2e, 0x76, 0x65, 0x6c, 0x6f, 
+0x63, 0x69, 0x74, 0x79, 0x5a, 0x20, 0x3d, 0x20, 0x73, 0x74, 0x72, 0x65, 0x61, 0x6d, 0x73, 
+0x20, 0x2b, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x43, 0x6f, 0x75, 0x6e, 
+0x74, 0x20, 0x2a, 0x20, 0x36, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x6f, 0x75, 0x74, 0x2e, 0x68, 
+0x61, 0x73, 0x68, 0x20, 0x3d, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x2a, 0x29, 
+0x28, 0x73, 0x74, 0x72, 0x65, 0x61, 0x6d, 0x73, 0x20, 0x2b, 0x20, 0x70, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x20, 0x2a, 0x20, 0x37, 0x29, 0x3b, 
+0x0d, 0x0a, 0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x6f, 0x75, 0x74, 0x3b, 
+0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x76, 0x6f, 0x69, 0x64, 0x20, 0x43, 0x6f, 0x6d, 
+0x70, 0x75, 0x74, 0x65, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x41, 0x6e, 0x64, 0x50, 0x72, 0x65, 
+0x70, 0x61, 0x72, 0x65, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x28, 0x75, 0x69, 0x6e, 
+0x74, 0x36, 0x34, 0x20, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x2c, 0x20, 0x76, 
+0x6f, 0x6c, 0x61, 0x74, 0x69, 0x6c, 0x65, 0x20, 0x48, 0x41, 0x53, 0x48, 0x5f, 0x54, 0x59, 
+0x50, 0x45, 0x2a, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 0x20, 0x75, 0x69, 
+0x6e, 0x74, 0x36, 0x34, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 
+0x65, 0x2c, 0x20, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x53, 0x74, 0x72, 0x65, 0x61, 0x6d, 0x73, 0x20, 0x70, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x20, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x42, 0x65, 0x68, 0x61, 0x76, 0x69, 0x6f, 0x75, 0x72, 
+0x50, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2a, 0x20, 0x70, 0x61, 0x72, 
+0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 
+0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x29, 
+0x0d, 0x0a, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x70, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 
+0x20, 0x3d, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x28, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x58, 0x5b, 0x74, 
+0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x59, 0x5b, 
+0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x5a, 
+0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 
+0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x20, 0x3d, 0x20, 0x47, 0x65, 0x74, 0x43, 0x65, 
+0x6c, 0x6c, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x28, 0x47, 0x65, 0x74, 0x43, 0x65, 0x6c, 
+0x6c, 0x28, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 
+0x69, 0x6f, 0x6e, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 
+0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 
+0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x2c, 0x20, 0x68, 0x61, 0x73, 
+0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 
+0x65, 0x74, 0x65, 0x72, 0x73, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x70, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x68, 0x61, 0x73, 0x68, 0x5b, 0x74, 0x68, 
+0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 0x20, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x61, 
+0x74, 0x6f, 0x6d, 0x69, 0x63, 0x5f, 0x69, 0x6e, 0x63, 0x28, 0x68, 0x61, 0x73, 0x68, 0x4d, 
+0x61, 0x70, 0x20, 0x2b, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x48, 0x61, 
+0x73, 0x68, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x76, 0x6f, 0x69, 0x64, 
+0x20, 0x52, 0x65, 0x6f, 0x72, 0x64, 0x65, 0x72, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x41, 0x6e, 0x64, 0x46, 0x69, 0x6e, 
+0x69, 0x73, 0x68, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x28, 0x75, 0x69, 0x6e, 0x74, 
+0x36, 0x34, 0x20, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x2c, 0x20, 0x75, 0x69, 
+0x6e, 0x74, 0x33, 0x32, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 
+0x61, 0x70, 0x2c, 0x20, 0x76, 0x6f, 0x6c, 0x61, 0x74, 0x69, 0x6c, 0x65, 0x20, 0x48, 0x41, 
+0x53, 0x48, 0x5f, 0x54, 0x59, 0x50, 0x45, 0x2a, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 
+0x70, 0x2c, 0x20, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x53, 0x74, 0x72, 0x65, 0x61, 0x6d, 0x73, 0x20, 0x69, 0x6e, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x20, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 
+0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x53, 0x74, 0x72, 0x65, 0x61, 0x6d, 
+0x73, 0x20, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 
+0x20, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x29, 0x0d, 0x0a, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 
+0x73, 0x69, 0x7a, 0x65, 0x5f, 0x74, 0x20, 0x6f, 0x6c, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 
+0x20, 0x3d, 0x20, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x3b, 0x0d, 0x0a, 0x0d, 
+0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x20, 0x3d, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x68, 0x61, 0x73, 0x68, 0x5b, 0x6f, 0x6c, 0x64, 
+0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x73, 0x69, 
+0x7a, 0x65, 0x5f, 0x74, 0x20, 0x6e, 0x65, 0x77, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 
+0x20, 0x28, 0x73, 0x69, 0x7a, 0x65, 0x5f, 0x74, 0x29, 0x28, 0x61, 0x74, 0x6f, 0x6d, 0x69, 
+0x63, 0x5f, 0x64, 0x65, 0x63, 0x28, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x20, 0x2b, 
+0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x29, 0x20, 
+0x2d, 0x20, 0x31, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x70, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x70, 0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 
+0x44, 0x5d, 0x20, 0x3d, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x29, 0x74, 0x68, 
+0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x6f, 0x75, 0x74, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 
+0x6f, 0x6e, 0x58, 0x5b, 0x6e, 0x65, 0x77, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x20, 0x3d, 
+0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 
+0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x58, 0x5b, 0x6f, 0x6c, 0x64, 0x49, 0x6e, 0x64, 0x65, 
+0x78, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x59, 0x5b, 
+0x6e, 0x65, 0x77, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x20, 0x3d, 0x20, 0x69, 0x6e, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 
+0x6f, 0x6e, 0x59, 0x5b, 0x6f, 0x6c, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x3b, 0x0d, 
+0x0a, 0x09, 0x09, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 
+0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x5a, 0x5b, 0x6e, 0x65, 0x77, 0x49, 
+0x6e, 0x64, 0x65, 0x78, 0x5d, 0x20, 0x3d, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x5a, 0x5b, 
+0x6f, 0x6c, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x6f, 
+0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x72, 0x65, 
+0x73, 0x73, 0x75, 0x72, 0x65, 0x5b, 0x6e, 0x65, 0x77, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 
+0x20, 0x3d, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 
+0x70, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x5b, 0x6f, 0x6c, 0x64, 0x49, 0x6e, 0x64, 
+0x65, 0x78, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x58, 
+0x5b, 0x6e, 0x65, 0x77, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x20, 0x3d, 0x20, 0x69, 0x6e, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x76, 0x65, 0x6c, 0x6f, 0x63, 
+0x69, 0x74, 0x79, 0x58, 0x5b, 0x6f, 0x6c, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x3b, 
+0x0d, 0x0a, 0x09, 0x09, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x73, 0x2e, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x59, 0x5b, 0x6e, 0x65, 0x77, 
+0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x20, 0x3d, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x59, 
+0x5b, 0x6f, 0x6c, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x76, 0x65, 
+0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x5a, 0x5b, 0x6e, 0x65, 0x77, 0x49, 0x6e, 0x64, 0x65, 
+0x78, 0x5d, 0x20, 0x3d, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x73, 0x2e, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x5a, 0x5b, 0x6f, 0x6c, 0x64, 
+0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x6f, 0x75, 0x74, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x68, 0x61, 0x73, 0x68, 0x5b, 0x6e, 
+0x65, 0x77, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x20, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 
+0x09, 0x76, 0x6f, 0x69, 0x64, 0x20, 0x46, 0x69, 0x6c, 0x6c, 0x44, 0x79, 0x6e, 0x61, 0x6d, 
+0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x70, 0x41, 0x6e, 
+0x64, 0x46, 0x69, 0x6e, 0x69, 0x73, 0x68, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x28, 
+0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 
+0x2c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x4d, 0x61, 0x70, 0x2c, 0x20, 0x76, 0x6f, 0x6c, 0x61, 0x74, 0x69, 0x6c, 
+0x65, 0x20, 0x48, 0x41, 0x53, 0x48, 0x5f, 0x54, 0x59, 0x50, 0x45, 0x2a, 0x20, 0x68, 0x61, 
+0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 0x20, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x75, 0x69, 
+0x6e, 0x74, 0x33, 0x32, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x48, 
+0x61, 0x73, 0x68, 0x65, 0x73, 0x2c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x70, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x29, 0x0d, 0x0a, 
+0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x70, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x20, 0x3d, 0x20, 0x70, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x65, 0x73, 0x5b, 0x74, 0x68, 
+0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x75, 
+0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x61, 
+0x74, 0x6f, 0x6d, 0x69, 0x63, 0x5f, 0x64, 0x65, 0x63, 0x28, 0x68, 0x61, 0x73, 0x68, 0x4d, 
+0x61, 0x70, 0x20, 0x2b, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x48, 0x61, 
+0x73, 0x68, 0x29, 0x20, 0x2d, 0x20, 0x31, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x70, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x70, 0x5b, 0x69, 0x6e, 0x64, 0x65, 
+0x78, 0x5d, 0x20, 0x3d, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x29, 0x74, 0x68, 
+0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 
+0x09, 0x76, 0x6f, 0x69, 0x64, 0x20, 0x55, 0x70, 0x64, 0x61, 0x74, 0x65, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x28, 0x0d, 
+0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x74, 0x68, 0x72, 0x65, 0x61, 
+0x64, 0x49, 0x44, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 
+0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x73, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 
+0x36, 0x34, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 
 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x73, 0x74, 0x61, 
-0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 
-0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x43, 0x4f, 
-0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 0x20, 0x53, 0x54, 0x52, 0x55, 0x43, 0x54, 0x20, 0x44, 
-0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x2a, 
-0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x0d, 0x0a, 
-0x09, 0x09, 0x47, 0x4c, 0x4f, 0x42, 0x41, 0x4c, 0x20, 0x53, 0x54, 0x52, 0x55, 0x43, 0x54, 
-0x20, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
-0x65, 0x2a, 0x20, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 
-0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 0x20, 0x48, 
-0x41, 0x53, 0x48, 0x5f, 0x54, 0x59, 0x50, 0x45, 0x2a, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 
-0x61, 0x70, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 
+0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x43, 0x6f, 0x75, 
+0x6e, 0x74, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x73, 
+0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 
+0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 
+0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x53, 0x74, 0x72, 0x65, 0x61, 0x6d, 0x73, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x2a, 
+0x20, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x50, 0x72, 
+0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 
+0x74, 0x20, 0x48, 0x41, 0x53, 0x48, 0x5f, 0x54, 0x59, 0x50, 0x45, 0x2a, 0x20, 0x68, 0x61, 
+0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 
 0x20, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 
-0x6c, 0x65, 0x4d, 0x61, 0x70, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x43, 0x4f, 0x4e, 0x53, 0x54, 
-0x41, 0x4e, 0x54, 0x20, 0x53, 0x54, 0x52, 0x55, 0x43, 0x54, 0x20, 0x53, 0x74, 0x61, 0x74, 
-0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x2a, 0x20, 0x73, 0x74, 0x61, 
-0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x0d, 0x0a, 
-0x09, 0x09, 0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 0x20, 0x48, 0x41, 0x53, 0x48, 
-0x5f, 0x54, 0x59, 0x50, 0x45, 0x2a, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 
-0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 
-0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 
-0x20, 0x64, 0x65, 0x6c, 0x74, 0x61, 0x54, 0x69, 0x6d, 0x65, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 
-0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 0x4e, 0x54, 0x20, 0x53, 0x54, 0x52, 0x55, 0x43, 0x54, 
-0x20, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x42, 0x65, 0x68, 0x61, 0x76, 0x69, 
-0x6f, 0x75, 0x72, 0x50, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2a, 0x20, 
-0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 
-0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 
-0x43, 0x6f, 0x75, 0x6e, 0x74, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x43, 0x4f, 0x4e, 0x53, 0x54, 
-0x41, 0x4e, 0x54, 0x20, 0x53, 0x54, 0x52, 0x55, 0x43, 0x54, 0x20, 0x54, 0x72, 0x69, 0x61, 
-0x6e, 0x67, 0x6c, 0x65, 0x2a, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x73, 
-0x0d, 0x0a, 0x09, 0x29, 0x20, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x53, 0x54, 0x4f, 0x50, 0x5f, 
-0x45, 0x58, 0x54, 0x45, 0x4e, 0x53, 0x49, 0x56, 0x45, 0x5f, 0x57, 0x4f, 0x52, 0x4b, 0x5f, 
-0x49, 0x54, 0x45, 0x4d, 0x53, 0x28, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 
-0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x29, 0x0d, 0x0a, 
-0x09, 0x09, 0x49, 0x4e, 0x49, 0x54, 0x49, 0x41, 0x4c, 0x49, 0x5a, 0x45, 0x5f, 0x54, 0x48, 
-0x52, 0x45, 0x41, 0x44, 0x5f, 0x49, 0x44, 0x28, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 
-0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 
-0x63, 0x6c, 0x65, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x74, 0x68, 0x72, 0x65, 
-0x61, 0x64, 0x49, 0x44, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x43, 0x4f, 0x4e, 0x53, 0x54, 0x41, 
-0x4e, 0x54, 0x20, 0x53, 0x54, 0x52, 0x55, 0x43, 0x54, 0x20, 0x44, 0x79, 0x6e, 0x61, 0x6d, 
-0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x2a, 0x20, 0x69, 0x6e, 0x50, 
-0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x74, 0x72, 0x20, 0x3d, 0x20, 0x69, 0x6e, 
-0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x20, 0x2b, 0x20, 0x69, 0x6e, 0x50, 
-0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x3b, 0x0d, 0x0a, 
-0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 
-0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x74, 0x68, 
-0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x47, 0x4c, 0x4f, 0x42, 
-0x41, 0x4c, 0x20, 0x53, 0x54, 0x52, 0x55, 0x43, 0x54, 0x20, 0x44, 0x79, 0x6e, 0x61, 0x6d, 
-0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x2a, 0x20, 0x6f, 0x75, 0x74, 
-0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x74, 0x72, 0x20, 0x3d, 0x20, 0x6f, 
-0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x20, 0x2b, 0x20, 0x6f, 
-0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x64, 0x65, 0x78, 
-0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x70, 0x61, 
-0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x20, 
-0x3d, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x74, 0x72, 
-0x2d, 0x3e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x41, 0x6e, 0x64, 0x50, 0x72, 
-0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x2e, 0x78, 0x79, 0x7a, 0x28, 0x29, 0x3b, 0x0d, 0x0a, 
-0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
-0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x20, 0x3d, 0x20, 0x6f, 0x75, 0x74, 
-0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x74, 0x72, 0x2d, 0x3e, 0x70, 0x6f, 
-0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x41, 0x6e, 0x64, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 
-0x72, 0x65, 0x2e, 0x77, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 
-0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 
-0x79, 0x20, 0x3d, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 
-0x74, 0x72, 0x2d, 0x3e, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x41, 0x6e, 0x64, 
-0x48, 0x61, 0x73, 0x68, 0x2e, 0x78, 0x79, 0x7a, 0x28, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
-0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x48, 
-0x61, 0x73, 0x68, 0x5f, 0x46, 0x4c, 0x4f, 0x41, 0x54, 0x20, 0x3d, 0x20, 0x69, 0x6e, 0x50, 
-0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x74, 0x72, 0x2d, 0x3e, 0x76, 0x65, 0x6c, 
-0x6f, 0x63, 0x69, 0x74, 0x79, 0x41, 0x6e, 0x64, 0x48, 0x61, 0x73, 0x68, 0x2e, 0x77, 0x3b, 
-0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x70, 0x61, 0x72, 0x74, 
-0x69, 0x63, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x20, 0x3d, 0x20, 0x2a, 0x28, 0x75, 0x69, 
-0x6e, 0x74, 0x33, 0x32, 0x2a, 0x29, 0x26, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
-0x48, 0x61, 0x73, 0x68, 0x5f, 0x46, 0x4c, 0x4f, 0x41, 0x54, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 
+0x6c, 0x65, 0x4d, 0x61, 0x70, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 
+0x20, 0x53, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x2a, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x48, 0x41, 
+0x53, 0x48, 0x5f, 0x54, 0x59, 0x50, 0x45, 0x2a, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 
+0x70, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x42, 0x65, 0x68, 0x61, 0x76, 0x69, 0x6f, 0x75, 0x72, 0x50, 
+0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 
+0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x0d, 0x0a, 0x09, 0x29, 0x20, 0x7b, 0x0d, 0x0a, 0x09, 
+0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x3d, 0x20, 0x56, 0x65, 0x63, 0x33, 
+0x66, 0x28, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 
+0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x58, 0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 
+0x49, 0x44, 0x5d, 0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x73, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x59, 0x5b, 0x74, 0x68, 0x72, 
+0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x5a, 0x5b, 
+0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 
 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x75, 0x20, 0x63, 0x65, 0x6c, 0x6c, 0x20, 0x3d, 0x20, 
 0x47, 0x65, 0x74, 0x43, 0x65, 0x6c, 0x6c, 0x28, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 
@@ -1124,98 +3811,141 @@ namespace SPH::Kernels
 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 
 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x75, 0x20, 0x62, 
 0x65, 0x67, 0x69, 0x6e, 0x43, 0x65, 0x6c, 0x6c, 0x20, 0x3d, 0x20, 0x63, 0x65, 0x6c, 0x6c, 
-0x20, 0x2d, 0x20, 0x4e, 0x45, 0x57, 0x5f, 0x56, 0x45, 0x43, 0x33, 0x55, 0x28, 0x31, 0x2c, 
-0x20, 0x31, 0x2c, 0x20, 0x31, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 
-0x75, 0x20, 0x65, 0x6e, 0x64, 0x43, 0x65, 0x6c, 0x6c, 0x20, 0x3d, 0x20, 0x63, 0x65, 0x6c, 
-0x6c, 0x20, 0x2b, 0x20, 0x4e, 0x45, 0x57, 0x5f, 0x56, 0x45, 0x43, 0x33, 0x55, 0x28, 0x32, 
-0x2c, 0x20, 0x32, 0x2c, 0x20, 0x32, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x56, 
-0x65, 0x63, 0x33, 0x66, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 
-0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 
-0x72, 0x63, 0x65, 0x20, 0x3d, 0x20, 0x4e, 0x45, 0x57, 0x5f, 0x56, 0x45, 0x43, 0x33, 0x46, 
-0x28, 0x30, 0x2e, 0x30, 0x66, 0x2c, 0x20, 0x30, 0x2e, 0x30, 0x66, 0x2c, 0x20, 0x30, 0x2e, 
-0x30, 0x66, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x64, 
-0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 
-0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x3d, 
-0x20, 0x4e, 0x45, 0x57, 0x5f, 0x56, 0x45, 0x43, 0x33, 0x46, 0x28, 0x30, 0x2e, 0x30, 0x66, 
-0x2c, 0x20, 0x30, 0x2e, 0x30, 0x66, 0x2c, 0x20, 0x30, 0x2e, 0x30, 0x66, 0x29, 0x3b, 0x0d, 
-0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 
-0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 
-0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x3d, 0x20, 0x4e, 0x45, 0x57, 0x5f, 0x56, 0x45, 
-0x43, 0x33, 0x46, 0x28, 0x30, 0x2e, 0x30, 0x66, 0x2c, 0x20, 0x30, 0x2e, 0x30, 0x66, 0x2c, 
-0x20, 0x30, 0x2e, 0x30, 0x66, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 
-0x66, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
-0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 
-0x20, 0x3d, 0x20, 0x4e, 0x45, 0x57, 0x5f, 0x56, 0x45, 0x43, 0x33, 0x46, 0x28, 0x30, 0x2e, 
-0x30, 0x66, 0x2c, 0x20, 0x30, 0x2e, 0x30, 0x66, 0x2c, 0x20, 0x30, 0x2e, 0x30, 0x66, 0x29, 
-0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x70, 0x61, 
-0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x44, 0x65, 0x6e, 0x73, 0x69, 0x74, 0x79, 0x20, 0x3d, 
-0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 
-0x72, 0x65, 0x20, 0x2f, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 
-0x2d, 0x3e, 0x67, 0x61, 0x73, 0x43, 0x6f, 0x6e, 0x73, 0x74, 0x61, 0x6e, 0x74, 0x20, 0x2b, 
-0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x72, 0x65, 
-0x73, 0x74, 0x44, 0x65, 0x6e, 0x73, 0x69, 0x74, 0x79, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 
-0x09, 0x56, 0x65, 0x63, 0x33, 0x75, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 
-0x6c, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x6f, 0x74, 0x68, 0x65, 
-0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x78, 0x20, 0x3d, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 
-0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x78, 0x3b, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 
-0x6c, 0x6c, 0x2e, 0x78, 0x20, 0x21, 0x3d, 0x20, 0x65, 0x6e, 0x64, 0x43, 0x65, 0x6c, 0x6c, 
-0x2e, 0x78, 0x3b, 0x20, 0x2b, 0x2b, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 
-0x2e, 0x78, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x6f, 0x74, 
-0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x79, 0x20, 0x3d, 0x20, 0x62, 0x65, 0x67, 
-0x69, 0x6e, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x79, 0x3b, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 
-0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x79, 0x20, 0x21, 0x3d, 0x20, 0x65, 0x6e, 0x64, 0x43, 0x65, 
-0x6c, 0x6c, 0x2e, 0x79, 0x3b, 0x20, 0x2b, 0x2b, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 
-0x6c, 0x6c, 0x2e, 0x79, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 
-0x28, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x7a, 0x20, 0x3d, 0x20, 
-0x62, 0x65, 0x67, 0x69, 0x6e, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x7a, 0x3b, 0x20, 0x6f, 0x74, 
-0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x7a, 0x20, 0x21, 0x3d, 0x20, 0x65, 0x6e, 
-0x64, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x7a, 0x3b, 0x20, 0x2b, 0x2b, 0x6f, 0x74, 0x68, 0x65, 
-0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x7a, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x7b, 
-0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x6f, 
-0x74, 0x68, 0x65, 0x72, 0x48, 0x61, 0x73, 0x68, 0x20, 0x3d, 0x20, 0x47, 0x65, 0x74, 0x48, 
-0x61, 0x73, 0x68, 0x28, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x29, 0x3b, 
-0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 
-0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x6f, 0x64, 0x20, 0x3d, 
-0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x48, 0x61, 0x73, 0x68, 0x20, 0x25, 0x20, 0x64, 0x79, 
-0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 
-0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
-0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 
-0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 
-0x5b, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x6f, 0x64, 0x5d, 0x3b, 
-0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x65, 
-0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 
-0x61, 0x70, 0x5b, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x6f, 0x64, 
-0x20, 0x2b, 0x20, 0x31, 0x5d, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 
-0x66, 0x6f, 0x72, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x69, 0x20, 0x3d, 
-0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x3b, 0x20, 0x69, 0x20, 
-0x3c, 0x20, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x3b, 0x20, 0x2b, 0x2b, 0x69, 
-0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
-0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x20, 
-0x3d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x70, 0x5b, 0x69, 
-0x5d, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 
-0x28, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x3d, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 
-0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x29, 0x0d, 0x0a, 0x09, 0x09, 
+0x20, 0x2d, 0x20, 0x56, 0x65, 0x63, 0x33, 0x75, 0x28, 0x31, 0x2c, 0x20, 0x31, 0x2c, 0x20, 
+0x31, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x75, 0x20, 0x65, 0x6e, 
+0x64, 0x43, 0x65, 0x6c, 0x6c, 0x20, 0x3d, 0x20, 0x63, 0x65, 0x6c, 0x6c, 0x20, 0x2b, 0x20, 
+0x56, 0x65, 0x63, 0x33, 0x75, 0x28, 0x32, 0x2c, 0x20, 0x32, 0x2c, 0x20, 0x32, 0x29, 0x3b, 
+0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x79, 0x6e, 
+0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x66, 
+0x6c, 0x75, 0x65, 0x6e, 0x63, 0x65, 0x53, 0x75, 0x6d, 0x20, 0x3d, 0x20, 0x30, 0x3b, 0x0d, 
+0x0a, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x66, 0x6c, 0x75, 0x65, 0x6e, 
+0x63, 0x65, 0x53, 0x75, 0x6d, 0x20, 0x3d, 0x20, 0x30, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 
+0x09, 0x62, 0x6f, 0x6f, 0x6c, 0x20, 0x6f, 0x75, 0x74, 0x73, 0x69, 0x64, 0x65, 0x47, 0x72, 
+0x69, 0x64, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x56, 0x69, 0x73, 0x69, 0x74, 0x65, 0x64, 
+0x20, 0x3d, 0x20, 0x66, 0x61, 0x6c, 0x73, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 
+0x56, 0x65, 0x63, 0x33, 0x75, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 
+0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x6f, 0x74, 0x68, 0x65, 0x72, 
+0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x78, 0x20, 0x3d, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x43, 
+0x65, 0x6c, 0x6c, 0x2e, 0x78, 0x3b, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 
+0x6c, 0x2e, 0x78, 0x20, 0x21, 0x3d, 0x20, 0x65, 0x6e, 0x64, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 
+0x78, 0x3b, 0x20, 0x2b, 0x2b, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 
+0x78, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x6f, 0x74, 0x68, 
+0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x79, 0x20, 0x3d, 0x20, 0x62, 0x65, 0x67, 0x69, 
+0x6e, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x79, 0x3b, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 
+0x65, 0x6c, 0x6c, 0x2e, 0x79, 0x20, 0x21, 0x3d, 0x20, 0x65, 0x6e, 0x64, 0x43, 0x65, 0x6c, 
+0x6c, 0x2e, 0x79, 0x3b, 0x20, 0x2b, 0x2b, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 
+0x6c, 0x2e, 0x79, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 
+0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x7a, 0x20, 0x3d, 0x20, 0x62, 
+0x65, 0x67, 0x69, 0x6e, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x7a, 0x3b, 0x20, 0x6f, 0x74, 0x68, 
+0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x7a, 0x20, 0x21, 0x3d, 0x20, 0x65, 0x6e, 0x64, 
+0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x7a, 0x3b, 0x20, 0x2b, 0x2b, 0x6f, 0x74, 0x68, 0x65, 0x72, 
+0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x7a, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x7b, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x6f, 0x74, 
+0x68, 0x65, 0x72, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x6f, 0x64, 0x20, 0x3d, 0x20, 0x47, 0x65, 
+0x74, 0x43, 0x65, 0x6c, 0x6c, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x28, 0x6f, 0x74, 0x68, 
+0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2c, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 
+0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 
+0x72, 0x73, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x2f, 0x2f, 
+0x57, 0x69, 0x74, 0x68, 0x20, 0x74, 0x68, 0x65, 0x20, 0x64, 0x65, 0x6e, 0x73, 0x65, 0x20, 
+0x67, 0x72, 0x69, 0x64, 0x20, 0x61, 0x6c, 0x6c, 0x20, 0x63, 0x65, 0x6c, 0x6c, 0x73, 0x20, 
+0x6f, 0x75, 0x74, 0x73, 0x69, 0x64, 0x65, 0x20, 0x6f, 0x66, 0x20, 0x69, 0x74, 0x20, 0x73, 
+0x68, 0x61, 0x72, 0x65, 0x20, 0x6f, 0x6e, 0x65, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 
+0x2c, 0x20, 0x69, 0x74, 0x20, 0x6d, 0x75, 0x73, 0x74, 0x20, 0x62, 0x65, 0x20, 0x63, 0x68, 
+0x65, 0x63, 0x6b, 0x65, 0x64, 0x20, 0x6f, 0x6e, 0x6c, 0x79, 0x20, 0x6f, 0x6e, 0x63, 0x65, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x49, 0x73, 0x4f, 0x75, 
+0x74, 0x73, 0x69, 0x64, 0x65, 0x47, 0x72, 0x69, 0x64, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 
+0x28, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x6f, 0x64, 0x2c, 0x20, 
+0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x70, 
+0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x29, 0x29, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 
+0x28, 0x6f, 0x75, 0x74, 0x73, 0x69, 0x64, 0x65, 0x47, 0x72, 0x69, 0x64, 0x42, 0x75, 0x63, 
+0x6b, 0x65, 0x74, 0x56, 0x69, 0x73, 0x69, 0x74, 0x65, 0x64, 0x29, 0x0d, 0x0a, 0x09, 0x09, 
 0x09, 0x09, 0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x74, 0x69, 0x6e, 0x75, 0x65, 0x3b, 0x0d, 
-0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 
-0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 
-0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x20, 0x3d, 0x20, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 
-0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x5b, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x2e, 0x70, 
-0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x41, 0x6e, 0x64, 0x50, 0x72, 0x65, 0x73, 0x73, 
-0x75, 0x72, 0x65, 0x2e, 0x77, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x56, 
-0x65, 0x63, 0x33, 0x66, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 
-0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x3d, 0x20, 0x69, 
-0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x5b, 0x69, 0x6e, 0x64, 0x65, 
-0x78, 0x5d, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x41, 0x6e, 0x64, 0x50, 
-0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x2e, 0x78, 0x79, 0x7a, 0x28, 0x29, 0x3b, 0x0d, 
-0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x6f, 0x74, 
-0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x65, 0x6c, 0x6f, 
-0x63, 0x69, 0x74, 0x79, 0x20, 0x3d, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
-0x6c, 0x65, 0x73, 0x5b, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x2e, 0x76, 0x65, 0x6c, 0x6f, 
-0x63, 0x69, 0x74, 0x79, 0x41, 0x6e, 0x64, 0x48, 0x61, 0x73, 0x68, 0x2e, 0x78, 0x79, 0x7a, 
-0x28, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x56, 0x65, 
-0x63, 0x33, 0x66, 0x20, 0x64, 0x69, 0x72, 0x20, 0x3d, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 
-0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 
-0x6e, 0x20, 0x2d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 
+0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x6f, 0x75, 0x74, 0x73, 0x69, 0x64, 
+0x65, 0x47, 0x72, 0x69, 0x64, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x56, 0x69, 0x73, 0x69, 
+0x74, 0x65, 0x64, 0x20, 0x3d, 0x20, 0x74, 0x72, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x2f, 0x2f, 
+0x43, 0x61, 0x6c, 0x63, 0x75, 0x6c, 0x61, 0x74, 0x69, 0x6e, 0x67, 0x20, 0x64, 0x79, 0x6e, 
+0x61, 0x6d, 0x69, 0x63, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x20, 0x70, 
+0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x75, 
+0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 0x6e, 0x64, 0x65, 
+0x78, 0x20, 0x3d, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x5b, 0x6f, 0x74, 0x68, 
+0x65, 0x72, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x6f, 0x64, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x65, 0x6e, 0x64, 0x49, 0x6e, 
+0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x5b, 0x6f, 
+0x74, 0x68, 0x65, 0x72, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x6f, 0x64, 0x20, 0x2b, 0x20, 0x31, 
+0x5d, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 
+0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x69, 0x20, 0x3d, 0x20, 0x62, 0x65, 0x67, 
+0x69, 0x6e, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x3b, 0x20, 0x69, 0x20, 0x3c, 0x20, 0x65, 0x6e, 
+0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x3b, 0x20, 0x2b, 0x2b, 0x69, 0x29, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x75, 0x69, 
+0x6e, 0x74, 0x33, 0x32, 0x20, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x70, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x70, 0x5b, 0x69, 0x5d, 0x3b, 0x0d, 0x0a, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x69, 0x6e, 0x64, 
+0x65, 0x78, 0x20, 0x3d, 0x3d, 0x20, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x29, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x74, 0x69, 0x6e, 
+0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x56, 0x65, 
+0x63, 0x33, 0x66, 0x20, 0x64, 0x69, 0x72, 0x20, 0x3d, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 
+0x28, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 
+0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x58, 0x5b, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x2c, 
+0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 
+0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x59, 0x5b, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x2c, 
+0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 
+0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x5a, 0x5b, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x29, 
+0x20, 0x2d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 
+0x74, 0x69, 0x6f, 0x6e, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6c, 
+0x6f, 0x61, 0x74, 0x20, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x20, 0x3d, 0x20, 0x64, 
+0x6f, 0x74, 0x28, 0x64, 0x69, 0x72, 0x2c, 0x20, 0x64, 0x69, 0x72, 0x29, 0x3b, 0x0d, 0x0a, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x64, 0x69, 0x73, 
+0x74, 0x53, 0x71, 0x72, 0x20, 0x3e, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 
+0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 
+0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x20, 0x2a, 0x20, 0x70, 
+0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 
+0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 
+0x6e, 0x63, 0x65, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x63, 0x6f, 
+0x6e, 0x74, 0x69, 0x6e, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x69, 0x73, 0x74, 0x20, 0x3d, 0x20, 
+0x73, 0x71, 0x72, 0x74, 0x28, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x29, 0x3b, 0x0d, 
+0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 
+0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x66, 0x6c, 0x75, 0x65, 
+0x6e, 0x63, 0x65, 0x53, 0x75, 0x6d, 0x20, 0x2b, 0x3d, 0x20, 0x53, 0x6d, 0x6f, 0x6f, 0x74, 
+0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x44, 0x30, 0x28, 0x64, 0x69, 
+0x73, 0x74, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 
+0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 
+0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 
+0x28, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x73, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x20, 0x3d, 0x3d, 0x20, 0x30, 0x29, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x74, 0x69, 0x6e, 0x75, 0x65, 0x3b, 0x0d, 
+0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x2f, 0x2f, 0x43, 0x61, 0x6c, 0x63, 0x75, 
+0x6c, 0x61, 0x74, 0x69, 0x6e, 0x67, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x20, 0x70, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x20, 0x70, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 
+0x65, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x48, 0x61, 
+0x73, 0x68, 0x4d, 0x6f, 0x64, 0x20, 0x3d, 0x20, 0x47, 0x65, 0x74, 0x43, 0x65, 0x6c, 0x6c, 
+0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x28, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 
+0x6c, 0x2c, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 
+0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x29, 0x3b, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 0x6e, 0x64, 0x65, 0x78, 
+0x20, 0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x5b, 0x6f, 0x74, 0x68, 0x65, 
+0x72, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x6f, 0x64, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x73, 0x74, 
+0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 
+0x73, 0x68, 0x4d, 0x61, 0x70, 0x5b, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x48, 0x61, 0x73, 0x68, 
+0x4d, 0x6f, 0x64, 0x20, 0x2b, 0x20, 0x31, 0x5d, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 
+0x69, 0x20, 0x3d, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x3b, 
+0x20, 0x69, 0x20, 0x3c, 0x20, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x3b, 0x20, 
+0x2b, 0x2b, 0x69, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x64, 0x69, 0x72, 0x20, 
+0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x73, 0x5b, 0x69, 0x5d, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x41, 
+0x6e, 0x64, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x2e, 0x78, 0x79, 0x7a, 0x28, 
+0x29, 0x20, 0x2d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 
 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x66, 
 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x20, 0x3d, 0x20, 
 0x64, 0x6f, 0x74, 0x28, 0x64, 0x69, 0x72, 0x2c, 0x20, 0x64, 0x69, 0x72, 0x29, 0x3b, 0x0d, 
@@ -1229,137 +3959,351 @@ namespace SPH::Kernels
 0x6f, 0x6e, 0x74, 0x69, 0x6e, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
 0x09, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x69, 0x73, 0x74, 0x20, 0x3d, 
 0x20, 0x73, 0x71, 0x72, 0x74, 0x28, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x29, 0x3b, 
-0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x64, 
-0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x20, 0x3d, 0x3d, 0x20, 0x30, 0x20, 0x7c, 0x7c, 0x20, 
-0x64, 0x69, 0x73, 0x74, 0x20, 0x3d, 0x3d, 0x20, 0x30, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
-0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x64, 0x69, 
-0x72, 0x20, 0x3d, 0x20, 0x52, 0x61, 0x6e, 0x64, 0x6f, 0x6d, 0x44, 0x69, 0x72, 0x65, 0x63, 
-0x74, 0x69, 0x6f, 0x6e, 0x28, 0x28, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x29, 0x74, 0x68, 0x72, 
-0x65, 0x61, 0x64, 0x49, 0x44, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
-0x09, 0x70, 0x72, 0x69, 0x6e, 0x74, 0x66, 0x28, 0x22, 0x54, 0x77, 0x6f, 0x20, 0x64, 0x79, 
-0x6e, 0x61, 0x6d, 0x69, 0x63, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 
-0x20, 0x68, 0x61, 0x76, 0x65, 0x20, 0x74, 0x68, 0x65, 0x20, 0x73, 0x61, 0x6d, 0x65, 0x20, 
-0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x2e, 0x20, 0x53, 0x69, 0x6d, 0x75, 0x6c, 
-0x61, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x77, 0x6f, 0x6e, 0x74, 0x20, 0x62, 0x65, 0x20, 0x64, 
-0x65, 0x74, 0x65, 0x72, 0x6d, 0x69, 0x6e, 0x69, 0x73, 0x74, 0x69, 0x63, 0x2e, 0x20, 0x46, 
-0x69, 0x72, 0x73, 0x74, 0x20, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x3a, 0x20, 
-0x25, 0x20, 0x33, 0x2e, 0x33, 0x76, 0x33, 0x66, 0x3b, 0x20, 0x73, 0x65, 0x63, 0x6f, 0x6e, 
-0x64, 0x20, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x3a, 0x20, 0x25, 0x20, 0x33, 
-0x2e, 0x33, 0x76, 0x33, 0x66, 0x3b, 0x20, 0x69, 0x31, 0x3a, 0x20, 0x25, 0x75, 0x3b, 0x20, 
-0x69, 0x32, 0x3a, 0x20, 0x25, 0x75, 0x22, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 
-0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x2c, 0x20, 0x6f, 0x74, 0x68, 
-0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 
-0x69, 0x6f, 0x6e, 0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
-0x49, 0x6e, 0x64, 0x65, 0x78, 0x2c, 0x20, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x29, 0x3b, 0x0d, 
-0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 
-0x09, 0x65, 0x6c, 0x73, 0x65, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x64, 
-0x69, 0x72, 0x20, 0x2f, 0x3d, 0x20, 0x64, 0x69, 0x73, 0x74, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 
-0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x2f, 0x2f, 0x61, 0x70, 0x70, 0x6c, 0x79, 0x20, 0x70, 
-0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x20, 0x66, 0x6f, 0x72, 0x63, 0x65, 0x09, 0x09, 
-0x09, 0x09, 0x09, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x64, 0x79, 0x6e, 0x61, 
-0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 
-0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x2b, 0x3d, 0x20, 0x64, 0x69, 
-0x72, 0x20, 0x2a, 0x20, 0x28, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 
-0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x20, 0x2b, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 
-0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 
-0x29, 0x20, 0x2a, 0x20, 0x53, 0x6d, 0x6f, 0x6f, 0x74, 0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 
-0x72, 0x6e, 0x65, 0x6c, 0x44, 0x31, 0x28, 0x64, 0x69, 0x73, 0x74, 0x2c, 0x20, 0x70, 0x61, 
-0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 
-0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 
-0x63, 0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x2f, 
-0x2f, 0x61, 0x70, 0x70, 0x6c, 0x79, 0x20, 0x76, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 
-0x79, 0x20, 0x66, 0x6f, 0x72, 0x63, 0x65, 0x09, 0x09, 0x09, 0x09, 0x09, 0x0d, 0x0a, 0x09, 
-0x09, 0x09, 0x09, 0x09, 0x09, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 
-0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 
-0x6f, 0x72, 0x63, 0x65, 0x20, 0x2b, 0x3d, 0x20, 0x28, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 
-0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 
-0x20, 0x2d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x65, 0x6c, 0x6f, 
-0x63, 0x69, 0x74, 0x79, 0x29, 0x20, 0x2a, 0x20, 0x53, 0x6d, 0x6f, 0x6f, 0x74, 0x68, 0x69, 
-0x6e, 0x67, 0x4b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x44, 0x32, 0x28, 0x64, 0x69, 0x73, 0x74, 
-0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 
-0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 
-0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 
-0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x73, 
-0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x43, 
-0x6f, 0x75, 0x6e, 0x74, 0x20, 0x3d, 0x3d, 0x20, 0x30, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
-0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x74, 0x69, 0x6e, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 
-0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x48, 0x61, 0x73, 0x68, 
-0x4d, 0x6f, 0x64, 0x20, 0x3d, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x48, 0x61, 0x73, 0x68, 
-0x20, 0x25, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
-0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x3b, 
-0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 0x6e, 0x64, 
-0x65, 0x78, 0x20, 0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 
-0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x5b, 0x6f, 0x74, 
-0x68, 0x65, 0x72, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x6f, 0x64, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 
-0x09, 0x09, 0x09, 0x09, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 
-0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 
-0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x5b, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x48, 0x61, 
-0x73, 0x68, 0x4d, 0x6f, 0x64, 0x20, 0x2b, 0x20, 0x31, 0x5d, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 
-0x09, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 
-0x32, 0x20, 0x69, 0x20, 0x3d, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 0x6e, 0x64, 0x65, 
-0x78, 0x3b, 0x20, 0x69, 0x20, 0x3c, 0x20, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 
-0x3b, 0x20, 0x2b, 0x2b, 0x69, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7b, 0x0d, 
-0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x53, 0x54, 0x52, 0x55, 0x43, 0x54, 0x20, 0x53, 
-0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x20, 0x6f, 
-0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x20, 0x3d, 0x20, 
-0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 
-0x5b, 0x69, 0x5d, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x56, 
-0x65, 0x63, 0x33, 0x66, 0x20, 0x64, 0x69, 0x72, 0x20, 0x3d, 0x20, 0x6f, 0x74, 0x68, 0x65, 
-0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 
-0x69, 0x6f, 0x6e, 0x41, 0x6e, 0x64, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x2e, 
-0x78, 0x79, 0x7a, 0x28, 0x29, 0x20, 0x2d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
-0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
-0x09, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 
-0x72, 0x20, 0x3d, 0x20, 0x64, 0x6f, 0x74, 0x28, 0x64, 0x69, 0x72, 0x2c, 0x20, 0x64, 0x69, 
-0x72, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 
-0x20, 0x28, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x20, 0x3e, 0x20, 0x70, 0x61, 0x72, 
-0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 
-0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 
-0x65, 0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 
+0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x73, 0x74, 0x61, 0x74, 0x69, 
+0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x66, 0x6c, 0x75, 0x65, 
+0x6e, 0x63, 0x65, 0x53, 0x75, 0x6d, 0x20, 0x2b, 0x3d, 0x20, 0x53, 0x6d, 0x6f, 0x6f, 0x74, 
+0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x44, 0x30, 0x28, 0x64, 0x69, 
+0x73, 0x74, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 
 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 
-0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
-0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x74, 0x69, 0x6e, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 
-0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x69, 
-0x73, 0x74, 0x20, 0x3d, 0x20, 0x73, 0x71, 0x72, 0x74, 0x28, 0x64, 0x69, 0x73, 0x74, 0x53, 
-0x71, 0x72, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 
-0x66, 0x20, 0x28, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x20, 0x3d, 0x3d, 0x20, 0x30, 
-0x20, 0x7c, 0x7c, 0x20, 0x64, 0x69, 0x73, 0x74, 0x20, 0x3d, 0x3d, 0x20, 0x30, 0x29, 0x0d, 
-0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 
-0x09, 0x09, 0x64, 0x69, 0x72, 0x20, 0x3d, 0x20, 0x52, 0x61, 0x6e, 0x64, 0x6f, 0x6d, 0x44, 
-0x69, 0x72, 0x65, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x28, 0x28, 0x66, 0x6c, 0x6f, 0x61, 0x74, 
-0x29, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
-0x09, 0x09, 0x09, 0x09, 0x09, 0x70, 0x72, 0x69, 0x6e, 0x74, 0x66, 0x28, 0x22, 0x41, 0x20, 
-0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
-0x65, 0x20, 0x61, 0x6e, 0x64, 0x20, 0x61, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x20, 
-0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x20, 0x68, 0x61, 0x76, 0x65, 0x20, 0x74, 
-0x68, 0x65, 0x20, 0x73, 0x61, 0x6d, 0x65, 0x20, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 
-0x6e, 0x2e, 0x20, 0x53, 0x69, 0x6d, 0x75, 0x6c, 0x61, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x77, 
-0x6f, 0x6e, 0x74, 0x20, 0x62, 0x65, 0x20, 0x64, 0x65, 0x74, 0x65, 0x72, 0x6d, 0x69, 0x6e, 
-0x69, 0x73, 0x74, 0x69, 0x63, 0x2e, 0x20, 0x46, 0x69, 0x72, 0x73, 0x74, 0x20, 0x70, 0x6f, 
-0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x3a, 0x20, 0x25, 0x20, 0x33, 0x2e, 0x33, 0x76, 0x33, 
-0x66, 0x3b, 0x20, 0x73, 0x65, 0x63, 0x6f, 0x6e, 0x64, 0x20, 0x70, 0x6f, 0x73, 0x69, 0x74, 
-0x69, 0x6f, 0x6e, 0x3a, 0x20, 0x25, 0x20, 0x33, 0x2e, 0x33, 0x76, 0x33, 0x66, 0x22, 0x2c, 
-0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 
-0x6f, 0x6e, 0x2c, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
-0x6c, 0x65, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x41, 0x6e, 0x64, 0x50, 
-0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x2e, 0x78, 0x79, 0x7a, 0x28, 0x29, 0x29, 0x3b, 
-0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
-0x09, 0x09, 0x65, 0x6c, 0x73, 0x65, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
-0x64, 0x69, 0x72, 0x20, 0x2f, 0x3d, 0x20, 0x64, 0x69, 0x73, 0x74, 0x3b, 0x0d, 0x0a, 0x0d, 
-0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x2f, 0x2f, 0x61, 0x70, 0x70, 0x6c, 0x79, 0x20, 
-0x70, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x20, 0x66, 0x6f, 0x72, 0x63, 0x65, 0x09, 
-0x09, 0x09, 0x09, 0x09, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x73, 0x74, 0x61, 
-0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 
-0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x2b, 0x3d, 0x20, 0x64, 0x69, 
-0x72, 0x20, 0x2a, 0x20, 0x66, 0x61, 0x62, 0x73, 0x28, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 
-0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x29, 0x20, 0x2a, 0x20, 0x53, 
-0x6d, 0x6f, 0x6f, 0x74, 0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x44, 
-0x31, 0x28, 0x64, 0x69, 0x73, 0x74, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 
-0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 
-0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x3b, 0x0d, 
-0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x2f, 0x2f, 0x61, 0x70, 0x70, 0x6c, 
-0x79, 0x20, 0x76, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x20, 0x66, 0x6f, 0x72, 
-0x63, 0x65, 0x09, 0x09, 0x09, 0x09, 0x09, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 
+0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x44, 0x65, 0x6e, 0x73, 0x69, 0x74, 0x79, 0x20, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 
+0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x73, 0x65, 0x6c, 0x66, 0x44, 0x65, 0x6e, 0x73, 
+0x69, 0x74, 0x79, 0x20, 0x2b, 0x20, 0x28, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x66, 0x6c, 0x75, 0x65, 0x6e, 0x63, 
+0x65, 0x53, 0x75, 0x6d, 0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 
+0x72, 0x73, 0x2d, 0x3e, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x73, 
+0x73, 0x20, 0x2b, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x49, 0x6e, 0x66, 0x6c, 0x75, 0x65, 0x6e, 0x63, 0x65, 0x53, 0x75, 0x6d, 
+0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 
+0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x73, 0x73, 0x29, 0x20, 0x2a, 
+0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x73, 0x6d, 
+0x6f, 0x6f, 0x74, 0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x43, 0x6f, 
+0x6e, 0x73, 0x74, 0x61, 0x6e, 0x74, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 
+0x74, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 
+0x75, 0x72, 0x65, 0x20, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 
+0x73, 0x2d, 0x3e, 0x67, 0x61, 0x73, 0x43, 0x6f, 0x6e, 0x73, 0x74, 0x61, 0x6e, 0x74, 0x20, 
+0x2a, 0x20, 0x28, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x44, 0x65, 0x6e, 0x73, 
+0x69, 0x74, 0x79, 0x20, 0x2d, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 
+0x73, 0x2d, 0x3e, 0x72, 0x65, 0x73, 0x74, 0x44, 0x65, 0x6e, 0x73, 0x69, 0x74, 0x79, 0x29, 
+0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x73, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x5b, 0x74, 0x68, 
+0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 0x20, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x3b, 0x0d, 0x0a, 0x09, 
+0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x76, 0x6f, 0x69, 0x64, 0x20, 0x55, 0x70, 0x64, 0x61, 
+0x74, 0x65, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x44, 0x79, 0x6e, 0x61, 0x6d, 
+0x69, 0x63, 0x73, 0x28, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 
+0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 
+0x6e, 0x74, 0x36, 0x34, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x2c, 0x0d, 0x0a, 0x09, 
+0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 
+0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 
+0x34, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x73, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 
+0x74, 0x36, 0x34, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 
+0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x53, 0x74, 0x72, 0x65, 0x61, 0x6d, 0x73, 0x20, 0x69, 0x6e, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x44, 
+0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x53, 
+0x74, 0x72, 0x65, 0x61, 0x6d, 0x73, 0x20, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 
+0x48, 0x41, 0x53, 0x48, 0x5f, 0x54, 0x59, 0x50, 0x45, 0x2a, 0x20, 0x68, 0x61, 0x73, 0x68, 
+0x4d, 0x61, 0x70, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x75, 
+0x69, 0x6e, 0x74, 0x33, 0x32, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x4d, 0x61, 0x70, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x53, 
+0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x2a, 0x20, 
+0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 
+0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x48, 0x41, 0x53, 0x48, 
+0x5f, 0x54, 0x59, 0x50, 0x45, 0x2a, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 
+0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 
+0x20, 0x64, 0x65, 0x6c, 0x74, 0x61, 0x54, 0x69, 0x6d, 0x65, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 
+0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x42, 
+0x65, 0x68, 0x61, 0x76, 0x69, 0x6f, 0x75, 0x72, 0x50, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 
+0x65, 0x72, 0x73, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 
+0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x74, 0x72, 0x69, 
+0x61, 0x6e, 0x67, 0x6c, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 
+0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x54, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x2a, 
+0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 
+0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 
+0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x0d, 0x0a, 0x09, 
+0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x2a, 0x20, 
+0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 
+0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x75, 0x69, 0x6e, 0x74, 
+0x33, 0x32, 0x2a, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x4d, 0x61, 0x70, 
+0x0d, 0x0a, 0x09, 0x29, 0x20, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 
+0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 
+0x6f, 0x6e, 0x20, 0x3d, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x28, 0x69, 0x6e, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 
+0x6e, 0x58, 0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 0x2c, 0x20, 0x69, 
+0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 0x69, 
+0x74, 0x69, 0x6f, 0x6e, 0x59, 0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 
+0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 
+0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x5a, 0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 
+0x49, 0x44, 0x5d, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 
+0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 
+0x65, 0x20, 0x3d, 0x20, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x73, 0x2e, 0x70, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x5b, 0x74, 0x68, 0x72, 0x65, 
+0x61, 0x64, 0x49, 0x44, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 
+0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x65, 0x6c, 0x6f, 0x63, 0x69, 
+0x74, 0x79, 0x20, 0x3d, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x28, 0x69, 0x6e, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 
+0x79, 0x58, 0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 0x2c, 0x20, 0x69, 
+0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x76, 0x65, 0x6c, 0x6f, 
+0x63, 0x69, 0x74, 0x79, 0x59, 0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 
+0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x76, 
+0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x5a, 0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 
+0x49, 0x44, 0x5d, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 
+0x75, 0x20, 0x63, 0x65, 0x6c, 0x6c, 0x20, 0x3d, 0x20, 0x47, 0x65, 0x74, 0x43, 0x65, 0x6c, 
+0x6c, 0x28, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 
+0x69, 0x6f, 0x6e, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 
+0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 
+0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 
+0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x75, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x43, 0x65, 
+0x6c, 0x6c, 0x20, 0x3d, 0x20, 0x63, 0x65, 0x6c, 0x6c, 0x20, 0x2d, 0x20, 0x56, 0x65, 0x63, 
+0x33, 0x75, 0x28, 0x31, 0x2c, 0x20, 0x31, 0x2c, 0x20, 0x31, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 
+0x09, 0x56, 0x65, 0x63, 0x33, 0x75, 0x20, 0x65, 0x6e, 0x64, 0x43, 0x65, 0x6c, 0x6c, 0x20, 
+0x3d, 0x20, 0x63, 0x65, 0x6c, 0x6c, 0x20, 0x2b, 0x20, 0x56, 0x65, 0x63, 0x33, 0x75, 0x28, 
+0x32, 0x2c, 0x20, 0x32, 0x2c, 0x20, 0x32, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 
+0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 
+0x6f, 0x72, 0x63, 0x65, 0x20, 0x3d, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x28, 0x30, 0x2e, 
+0x30, 0x66, 0x2c, 0x20, 0x30, 0x2e, 0x30, 0x66, 0x2c, 0x20, 0x30, 0x2e, 0x30, 0x66, 0x29, 
+0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x64, 0x79, 0x6e, 0x61, 
+0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 
+0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x3d, 0x20, 0x56, 0x65, 
+0x63, 0x33, 0x66, 0x28, 0x30, 0x2e, 0x30, 0x66, 0x2c, 0x20, 0x30, 0x2e, 0x30, 0x66, 0x2c, 
+0x20, 0x30, 0x2e, 0x30, 0x66, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 
+0x66, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 
+0x3d, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x28, 0x30, 0x2e, 0x30, 0x66, 0x2c, 0x20, 0x30, 
+0x2e, 0x30, 0x66, 0x2c, 0x20, 0x30, 0x2e, 0x30, 0x66, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 
+0x6f, 0x72, 0x63, 0x65, 0x20, 0x3d, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x28, 0x30, 0x2e, 
+0x30, 0x66, 0x2c, 0x20, 0x30, 0x2e, 0x30, 0x66, 0x2c, 0x20, 0x30, 0x2e, 0x30, 0x66, 0x29, 
+0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x62, 0x6f, 0x6f, 0x6c, 0x20, 0x6f, 0x75, 0x74, 
+0x73, 0x69, 0x64, 0x65, 0x47, 0x72, 0x69, 0x64, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x56, 
+0x69, 0x73, 0x69, 0x74, 0x65, 0x64, 0x20, 0x3d, 0x20, 0x66, 0x61, 0x6c, 0x73, 0x65, 0x3b, 
+0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x75, 0x20, 0x6f, 0x74, 0x68, 
+0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 
+0x28, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x78, 0x20, 0x3d, 0x20, 
+0x62, 0x65, 0x67, 0x69, 0x6e, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x78, 0x3b, 0x20, 0x6f, 0x74, 
+0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x78, 0x20, 0x21, 0x3d, 0x20, 0x65, 0x6e, 
+0x64, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x78, 0x3b, 0x20, 0x2b, 0x2b, 0x6f, 0x74, 0x68, 0x65, 
+0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x78, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x66, 0x6f, 
+0x72, 0x20, 0x28, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x79, 0x20, 
+0x3d, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x79, 0x3b, 0x20, 
+0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x79, 0x20, 0x21, 0x3d, 0x20, 
+0x65, 0x6e, 0x64, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x79, 0x3b, 0x20, 0x2b, 0x2b, 0x6f, 0x74, 
+0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x79, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 
+0x2e, 0x7a, 0x20, 0x3d, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 
+0x7a, 0x3b, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x7a, 0x20, 
+0x21, 0x3d, 0x20, 0x65, 0x6e, 0x64, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x7a, 0x3b, 0x20, 0x2b, 
+0x2b, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x7a, 0x29, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 
+0x74, 0x33, 0x32, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x6f, 
+0x64, 0x20, 0x3d, 0x20, 0x47, 0x65, 0x74, 0x43, 0x65, 0x6c, 0x6c, 0x42, 0x75, 0x63, 0x6b, 
+0x65, 0x74, 0x28, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2c, 0x20, 0x64, 
+0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 
+0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x70, 0x61, 
+0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x2f, 0x2f, 0x57, 0x69, 0x74, 0x68, 0x20, 0x74, 0x68, 0x65, 0x20, 
+0x64, 0x65, 0x6e, 0x73, 0x65, 0x20, 0x67, 0x72, 0x69, 0x64, 0x20, 0x61, 0x6c, 0x6c, 0x20, 
+0x63, 0x65, 0x6c, 0x6c, 0x73, 0x20, 0x6f, 0x75, 0x74, 0x73, 0x69, 0x64, 0x65, 0x20, 0x6f, 
+0x66, 0x20, 0x69, 0x74, 0x20, 0x73, 0x68, 0x61, 0x72, 0x65, 0x20, 0x6f, 0x6e, 0x65, 0x20, 
+0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x2c, 0x20, 0x69, 0x74, 0x20, 0x6d, 0x75, 0x73, 0x74, 
+0x20, 0x62, 0x65, 0x20, 0x63, 0x68, 0x65, 0x63, 0x6b, 0x65, 0x64, 0x20, 0x6f, 0x6e, 0x6c, 
+0x79, 0x20, 0x6f, 0x6e, 0x63, 0x65, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 
+0x20, 0x28, 0x49, 0x73, 0x4f, 0x75, 0x74, 0x73, 0x69, 0x64, 0x65, 0x47, 0x72, 0x69, 0x64, 
+0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x28, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x48, 0x61, 0x73, 
+0x68, 0x4d, 0x6f, 0x64, 0x2c, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 
+0x69, 0x7a, 0x65, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 
+0x29, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x6f, 0x75, 0x74, 0x73, 0x69, 0x64, 0x65, 0x47, 
+0x72, 0x69, 0x64, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x56, 0x69, 0x73, 0x69, 0x74, 0x65, 
+0x64, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x74, 
+0x69, 0x6e, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x6f, 0x75, 0x74, 0x73, 0x69, 0x64, 0x65, 0x47, 0x72, 0x69, 0x64, 0x42, 0x75, 0x63, 0x6b, 
+0x65, 0x74, 0x56, 0x69, 0x73, 0x69, 0x74, 0x65, 0x64, 0x20, 0x3d, 0x20, 0x74, 0x72, 0x75, 
+0x65, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x62, 0x65, 0x67, 0x69, 
+0x6e, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 
+0x70, 0x5b, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x6f, 0x64, 0x5d, 
+0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 
+0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x68, 0x61, 0x73, 0x68, 
+0x4d, 0x61, 0x70, 0x5b, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x6f, 
+0x64, 0x20, 0x2b, 0x20, 0x31, 0x5d, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x69, 0x20, 
+0x3d, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x3b, 0x20, 0x69, 
+0x20, 0x3c, 0x20, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x3b, 0x20, 0x2b, 0x2b, 
+0x69, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x69, 0x6e, 0x64, 0x65, 0x78, 
+0x20, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x70, 0x5b, 
+0x69, 0x5d, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 
+0x20, 0x28, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x3d, 0x20, 0x74, 0x68, 0x72, 0x65, 
+0x61, 0x64, 0x49, 0x44, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x63, 
+0x6f, 0x6e, 0x74, 0x69, 0x6e, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 
+0x20, 0x3d, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x28, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x58, 
+0x5b, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x59, 
+0x5b, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x5a, 
+0x5b, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x64, 0x69, 0x72, 0x20, 0x3d, 
+0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 
+0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x2d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x3b, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x69, 0x73, 0x74, 
+0x53, 0x71, 0x72, 0x20, 0x3d, 0x20, 0x64, 0x6f, 0x74, 0x28, 0x64, 0x69, 0x72, 0x2c, 0x20, 
+0x64, 0x69, 0x72, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x69, 0x66, 0x20, 0x28, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x20, 0x3e, 0x20, 0x70, 
+0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 
+0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 
+0x6e, 0x63, 0x65, 0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 
+0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 
+0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x74, 0x69, 0x6e, 0x75, 0x65, 0x3b, 0x0d, 
+0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 
+0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 
+0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x20, 0x3d, 0x20, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 
+0x5b, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x20, 0x3d, 
+0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x28, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x73, 0x2e, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x58, 0x5b, 0x69, 
+0x6e, 0x64, 0x65, 0x78, 0x5d, 0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x73, 0x2e, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x59, 0x5b, 0x69, 
+0x6e, 0x64, 0x65, 0x78, 0x5d, 0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x73, 0x2e, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x5a, 0x5b, 0x69, 
+0x6e, 0x64, 0x65, 0x78, 0x5d, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x69, 0x73, 0x74, 0x20, 0x3d, 0x20, 
+0x73, 0x71, 0x72, 0x74, 0x28, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x29, 0x3b, 0x0d, 
+0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x64, 0x69, 
+0x73, 0x74, 0x53, 0x71, 0x72, 0x20, 0x3d, 0x3d, 0x20, 0x30, 0x20, 0x7c, 0x7c, 0x20, 0x64, 
+0x69, 0x73, 0x74, 0x20, 0x3d, 0x3d, 0x20, 0x30, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x64, 0x69, 0x72, 
+0x20, 0x3d, 0x20, 0x52, 0x61, 0x6e, 0x64, 0x6f, 0x6d, 0x44, 0x69, 0x72, 0x65, 0x63, 0x74, 
+0x69, 0x6f, 0x6e, 0x28, 0x28, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x29, 0x74, 0x68, 0x72, 0x65, 
+0x61, 0x64, 0x49, 0x44, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x70, 0x72, 0x69, 0x6e, 0x74, 0x66, 0x28, 0x22, 0x54, 0x77, 0x6f, 0x20, 0x64, 0x79, 0x6e, 
+0x61, 0x6d, 0x69, 0x63, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x20, 
+0x68, 0x61, 0x76, 0x65, 0x20, 0x74, 0x68, 0x65, 0x20, 0x73, 0x61, 0x6d, 0x65, 0x20, 0x70, 
+0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x2e, 0x20, 0x53, 0x69, 0x6d, 0x75, 0x6c, 0x61, 
+0x74, 0x69, 0x6f, 0x6e, 0x20, 0x77, 0x6f, 0x6e, 0x74, 0x20, 0x62, 0x65, 0x20, 0x64, 0x65, 
+0x74, 0x65, 0x72, 0x6d, 0x69, 0x6e, 0x69, 0x73, 0x74, 0x69, 0x63, 0x2e, 0x20, 0x69, 0x31, 
+0x3a, 0x20, 0x25, 0x75, 0x3b, 0x20, 0x69, 0x32, 0x3a, 0x20, 0x25, 0x75, 0x22, 0x2c, 0x20, 
+0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x29, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 
+0x44, 0x2c, 0x20, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x65, 0x6c, 0x73, 
+0x65, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x64, 0x69, 0x72, 0x20, 0x2f, 
+0x3d, 0x20, 0x64, 0x69, 0x73, 0x74, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x2f, 0x2f, 0x61, 0x70, 0x70, 0x6c, 0x79, 0x20, 0x70, 0x72, 0x65, 0x73, 0x73, 
+0x75, 0x72, 0x65, 0x20, 0x66, 0x6f, 0x72, 0x63, 0x65, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 
+0x20, 0x2b, 0x3d, 0x20, 0x64, 0x69, 0x72, 0x20, 0x2a, 0x20, 0x28, 0x70, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x20, 0x2b, 0x20, 
+0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 
+0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x29, 0x20, 0x2a, 0x20, 0x53, 0x6d, 0x6f, 0x6f, 0x74, 
+0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x44, 0x31, 0x28, 0x64, 0x69, 
+0x73, 0x74, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 
+0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 
+0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x2f, 0x2f, 0x61, 0x70, 0x70, 0x6c, 0x79, 0x20, 0x76, 0x69, 
+0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x20, 0x66, 0x6f, 0x72, 0x63, 0x65, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 
+0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x2b, 0x3d, 0x20, 0x28, 0x6f, 0x74, 0x68, 0x65, 0x72, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 
+0x79, 0x20, 0x2d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x65, 0x6c, 
+0x6f, 0x63, 0x69, 0x74, 0x79, 0x29, 0x20, 0x2a, 0x20, 0x53, 0x6d, 0x6f, 0x6f, 0x74, 0x68, 
+0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x44, 0x32, 0x28, 0x64, 0x69, 0x73, 
+0x74, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 
+0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 
+0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 
+0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 
+0x43, 0x6f, 0x75, 0x6e, 0x74, 0x20, 0x3d, 0x3d, 0x20, 0x30, 0x29, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x74, 0x69, 0x6e, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x48, 0x61, 0x73, 
+0x68, 0x4d, 0x6f, 0x64, 0x20, 0x3d, 0x20, 0x47, 0x65, 0x74, 0x43, 0x65, 0x6c, 0x6c, 0x42, 
+0x75, 0x63, 0x6b, 0x65, 0x74, 0x28, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 
+0x2c, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 
+0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 
+0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x5b, 0x6f, 0x74, 0x68, 0x65, 0x72, 
+0x48, 0x61, 0x73, 0x68, 0x4d, 0x6f, 0x64, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x73, 0x74, 0x61, 
+0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 
+0x68, 0x4d, 0x61, 0x70, 0x5b, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x48, 0x61, 0x73, 0x68, 0x4d, 
+0x6f, 0x64, 0x20, 0x2b, 0x20, 0x31, 0x5d, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x69, 
+0x20, 0x3d, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x3b, 0x20, 
+0x69, 0x20, 0x3c, 0x20, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x3b, 0x20, 0x2b, 
+0x2b, 0x69, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x64, 0x69, 0x72, 0x20, 0x3d, 
+0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x73, 0x5b, 0x69, 0x5d, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x41, 0x6e, 
+0x64, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x2e, 0x78, 0x79, 0x7a, 0x28, 0x29, 
+0x20, 0x2d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 
+0x74, 0x69, 0x6f, 0x6e, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6c, 
+0x6f, 0x61, 0x74, 0x20, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x20, 0x3d, 0x20, 0x64, 
+0x6f, 0x74, 0x28, 0x64, 0x69, 0x72, 0x2c, 0x20, 0x64, 0x69, 0x72, 0x29, 0x3b, 0x0d, 0x0a, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x64, 0x69, 0x73, 
+0x74, 0x53, 0x71, 0x72, 0x20, 0x3e, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 
+0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 
+0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x20, 0x2a, 0x20, 0x70, 
+0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 
+0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 
+0x6e, 0x63, 0x65, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x63, 0x6f, 
+0x6e, 0x74, 0x69, 0x6e, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x69, 0x73, 0x74, 0x20, 0x3d, 0x20, 
+0x73, 0x71, 0x72, 0x74, 0x28, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x29, 0x3b, 0x0d, 
+0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x64, 0x69, 
+0x73, 0x74, 0x53, 0x71, 0x72, 0x20, 0x3d, 0x3d, 0x20, 0x30, 0x20, 0x7c, 0x7c, 0x20, 0x64, 
+0x69, 0x73, 0x74, 0x20, 0x3d, 0x3d, 0x20, 0x30, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x64, 0x69, 0x72, 
+0x20, 0x3d, 0x20, 0x52, 0x61, 0x6e, 0x64, 0x6f, 0x6d, 0x44, 0x69, 0x72, 0x65, 0x63, 0x74, 
+0x69, 0x6f, 0x6e, 0x28, 0x28, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x29, 0x74, 0x68, 0x72, 0x65, 
+0x61, 0x64, 0x49, 0x44, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x70, 0x72, 0x69, 0x6e, 0x74, 0x66, 0x28, 0x22, 0x41, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 
+0x69, 0x63, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x20, 0x61, 0x6e, 0x64, 
+0x20, 0x61, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x20, 0x68, 0x61, 0x76, 0x65, 0x20, 0x74, 0x68, 0x65, 0x20, 0x73, 0x61, 
+0x6d, 0x65, 0x20, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x2e, 0x20, 0x53, 0x69, 
+0x6d, 0x75, 0x6c, 0x61, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x77, 0x6f, 0x6e, 0x74, 0x20, 0x62, 
+0x65, 0x20, 0x64, 0x65, 0x74, 0x65, 0x72, 0x6d, 0x69, 0x6e, 0x69, 0x73, 0x74, 0x69, 0x63, 
+0x2e, 0x20, 0x69, 0x31, 0x3a, 0x20, 0x25, 0x75, 0x3b, 0x20, 0x69, 0x32, 0x3a, 0x20, 0x25, 
+0x75, 0x22, 0x2c, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x29, 0x74, 0x68, 0x72, 
+0x65, 0x61, 0x64, 0x49, 0x44, 0x2c, 0x20, 0x69, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x65, 0x6c, 0x73, 
+0x65, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x64, 0x69, 0x72, 0x20, 0x2f, 
+0x3d, 0x20, 0x64, 0x69, 0x73, 0x74, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x2f, 0x2f, 0x61, 0x70, 0x70, 0x6c, 0x79, 0x20, 0x70, 0x72, 0x65, 0x73, 0x73, 
+0x75, 0x72, 0x65, 0x20, 0x66, 0x6f, 0x72, 0x63, 0x65, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 
+0x2b, 0x3d, 0x20, 0x64, 0x69, 0x72, 0x20, 0x2a, 0x20, 0x66, 0x61, 0x62, 0x73, 0x28, 0x70, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 
+0x29, 0x20, 0x2a, 0x20, 0x53, 0x6d, 0x6f, 0x6f, 0x74, 0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 
+0x72, 0x6e, 0x65, 0x6c, 0x44, 0x31, 0x28, 0x64, 0x69, 0x73, 0x74, 0x2c, 0x20, 0x70, 0x61, 
+0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 
+0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 
+0x63, 0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x2f, 
+0x2f, 0x61, 0x70, 0x70, 0x6c, 0x79, 0x20, 0x76, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 
+0x79, 0x20, 0x66, 0x6f, 0x72, 0x63, 0x65, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 
 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 
 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x2b, 
 0x3d, 0x20, 0x2d, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x65, 0x6c, 0x6f, 
@@ -1368,120 +4312,2885 @@ namespace SPH::Kernels
 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 
 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 
 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7d, 
-0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x64, 0x79, 
-0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 
-0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x2a, 0x3d, 0x20, 
-0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x70, 0x61, 0x72, 
-0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x73, 0x73, 0x20, 0x2f, 0x20, 0x28, 0x32, 0x20, 
-0x2a, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x44, 0x65, 0x6e, 0x73, 0x69, 
-0x74, 0x79, 0x29, 0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 
-0x73, 0x2d, 0x3e, 0x73, 0x6d, 0x6f, 0x6f, 0x74, 0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 
-0x6e, 0x65, 0x6c, 0x43, 0x6f, 0x6e, 0x73, 0x74, 0x61, 0x6e, 0x74, 0x3b, 0x0d, 0x0a, 0x09, 
-0x09, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
-0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 
-0x20, 0x2a, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 
-0x3e, 0x76, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x20, 0x2a, 0x20, 0x70, 0x61, 
-0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x70, 0x61, 0x72, 0x74, 0x69, 
-0x63, 0x6c, 0x65, 0x4d, 0x61, 0x73, 0x73, 0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 
-0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x73, 0x6d, 0x6f, 0x6f, 0x74, 0x68, 0x69, 0x6e, 
-0x67, 0x4b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x43, 0x6f, 0x6e, 0x73, 0x74, 0x61, 0x6e, 0x74, 
-0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 
+0x6f, 0x6e, 0x53, 0x75, 0x6d, 0x73, 0x20, 0x73, 0x75, 0x6d, 0x73, 0x3b, 0x0d, 0x0a, 0x09, 
+0x09, 0x73, 0x75, 0x6d, 0x73, 0x2e, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 
+0x6f, 0x72, 0x63, 0x65, 0x5b, 0x30, 0x5d, 0x20, 0x3d, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 
+0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 
+0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x2e, 0x78, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x73, 0x75, 0x6d, 0x73, 0x2e, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 
+0x72, 0x63, 0x65, 0x5b, 0x31, 0x5d, 0x20, 0x3d, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 
+0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 
+0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x2e, 0x79, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x73, 
+0x75, 0x6d, 0x73, 0x2e, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 
 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 
-0x63, 0x65, 0x20, 0x2a, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 
-0x73, 0x2d, 0x3e, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x73, 0x73, 
-0x20, 0x2f, 0x20, 0x28, 0x32, 0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
-0x65, 0x44, 0x65, 0x6e, 0x73, 0x69, 0x74, 0x79, 0x29, 0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 
-0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x73, 0x6d, 0x6f, 0x6f, 0x74, 0x68, 
-0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x43, 0x6f, 0x6e, 0x73, 0x74, 0x61, 
-0x6e, 0x74, 0x20, 0x2a, 0x20, 0x31, 0x2e, 0x30, 0x66, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x73, 
+0x63, 0x65, 0x5b, 0x32, 0x5d, 0x20, 0x3d, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 
+0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x2e, 0x7a, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x73, 0x75, 
+0x6d, 0x73, 0x2e, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 
+0x63, 0x65, 0x5b, 0x30, 0x5d, 0x20, 0x3d, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 
+0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x2e, 0x78, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x73, 
+0x75, 0x6d, 0x73, 0x2e, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 
+0x72, 0x63, 0x65, 0x5b, 0x31, 0x5d, 0x20, 0x3d, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 
+0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 
+0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x2e, 0x79, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x73, 0x75, 0x6d, 0x73, 0x2e, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 
+0x6f, 0x72, 0x63, 0x65, 0x5b, 0x32, 0x5d, 0x20, 0x3d, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 
+0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 
+0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x2e, 0x7a, 0x3b, 0x0d, 0x0a, 0x09, 
+0x09, 0x73, 0x75, 0x6d, 0x73, 0x2e, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 
+0x72, 0x63, 0x65, 0x5b, 0x30, 0x5d, 0x20, 0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 
+0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x2e, 0x78, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x73, 0x75, 
+0x6d, 0x73, 0x2e, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 
+0x5b, 0x31, 0x5d, 0x20, 0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 
+0x72, 0x63, 0x65, 0x2e, 0x79, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x73, 0x75, 0x6d, 0x73, 0x2e, 
+0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 
+0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x5b, 0x32, 0x5d, 
+0x20, 0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 
+0x2e, 0x7a, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x73, 0x75, 0x6d, 0x73, 0x2e, 0x73, 0x74, 0x61, 
+0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 
+0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x5b, 0x30, 0x5d, 0x20, 0x3d, 
+0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x2e, 
+0x78, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x73, 0x75, 0x6d, 0x73, 0x2e, 0x73, 0x74, 0x61, 0x74, 
+0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 
+0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x5b, 0x31, 0x5d, 0x20, 0x3d, 0x20, 
+0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 
+0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x2e, 0x79, 
+0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x73, 0x75, 0x6d, 0x73, 0x2e, 0x73, 0x74, 0x61, 0x74, 0x69, 
+0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 
+0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x5b, 0x32, 0x5d, 0x20, 0x3d, 0x20, 0x73, 
 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 
+0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x2e, 0x7a, 0x3b, 
+0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x49, 0x6e, 0x74, 0x65, 0x67, 0x72, 0x61, 0x74, 0x65, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x28, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 
+0x49, 0x44, 0x2c, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 
+0x65, 0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 
+0x20, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x20, 
+0x73, 0x75, 0x6d, 0x73, 0x2c, 0x20, 0x64, 0x65, 0x6c, 0x74, 0x61, 0x54, 0x69, 0x6d, 0x65, 
+0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2c, 0x20, 0x74, 
+0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x2c, 0x20, 0x74, 
+0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x73, 0x2c, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 
+0x67, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 
+0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 
+0x70, 0x2c, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x4d, 0x61, 0x70, 0x29, 
+0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 
+0x32, 0x20, 0x47, 0x65, 0x74, 0x4e, 0x65, 0x69, 0x67, 0x68, 0x62, 0x6f, 0x75, 0x72, 0x43, 
+0x65, 0x6c, 0x6c, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x28, 0x66, 0x6c, 0x6f, 0x61, 
+0x74, 0x20, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x58, 0x2c, 0x20, 0x66, 0x6c, 
+0x6f, 0x61, 0x74, 0x20, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x59, 0x2c, 0x20, 
+0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x5a, 
+0x2c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 
+0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x42, 0x65, 0x68, 0x61, 0x76, 0x69, 0x6f, 0x75, 0x72, 
+0x50, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2a, 0x20, 0x70, 0x61, 0x72, 
+0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 
+0x2a, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x29, 0x0d, 0x0a, 0x09, 0x7b, 0x0d, 
+0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x75, 0x20, 0x63, 0x65, 0x6c, 0x6c, 0x20, 0x3d, 
+0x20, 0x47, 0x65, 0x74, 0x43, 0x65, 0x6c, 0x6c, 0x28, 0x56, 0x65, 0x63, 0x33, 0x66, 0x28, 
+0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x58, 0x2c, 0x20, 0x70, 0x6f, 0x73, 0x69, 
+0x74, 0x69, 0x6f, 0x6e, 0x59, 0x2c, 0x20, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 
+0x5a, 0x29, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 
+0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 
+0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 
+0x09, 0x56, 0x65, 0x63, 0x33, 0x75, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x43, 0x65, 0x6c, 
+0x6c, 0x20, 0x3d, 0x20, 0x63, 0x65, 0x6c, 0x6c, 0x20, 0x2d, 0x20, 0x56, 0x65, 0x63, 0x33, 
+0x75, 0x28, 0x31, 0x2c, 0x20, 0x31, 0x2c, 0x20, 0x31, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x56, 0x65, 0x63, 0x33, 0x75, 0x20, 0x65, 0x6e, 0x64, 0x43, 0x65, 0x6c, 0x6c, 0x20, 0x3d, 
+0x20, 0x63, 0x65, 0x6c, 0x6c, 0x20, 0x2b, 0x20, 0x56, 0x65, 0x63, 0x33, 0x75, 0x28, 0x32, 
+0x2c, 0x20, 0x32, 0x2c, 0x20, 0x32, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x75, 
+0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x43, 0x6f, 0x75, 
+0x6e, 0x74, 0x20, 0x3d, 0x20, 0x30, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x62, 0x6f, 0x6f, 0x6c, 
+0x20, 0x6f, 0x75, 0x74, 0x73, 0x69, 0x64, 0x65, 0x47, 0x72, 0x69, 0x64, 0x42, 0x75, 0x63, 
+0x6b, 0x65, 0x74, 0x56, 0x69, 0x73, 0x69, 0x74, 0x65, 0x64, 0x20, 0x3d, 0x20, 0x66, 0x61, 
+0x6c, 0x73, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x75, 
+0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x66, 0x6f, 0x72, 0x20, 0x28, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 
+0x78, 0x20, 0x3d, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x78, 
+0x3b, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x78, 0x20, 0x21, 
+0x3d, 0x20, 0x65, 0x6e, 0x64, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x78, 0x3b, 0x20, 0x2b, 0x2b, 
+0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x78, 0x29, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 
+0x6c, 0x2e, 0x79, 0x20, 0x3d, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x43, 0x65, 0x6c, 0x6c, 
+0x2e, 0x79, 0x3b, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x79, 
+0x20, 0x21, 0x3d, 0x20, 0x65, 0x6e, 0x64, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x79, 0x3b, 0x20, 
+0x2b, 0x2b, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x79, 0x29, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x6f, 0x74, 0x68, 0x65, 0x72, 
+0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x7a, 0x20, 0x3d, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x43, 
+0x65, 0x6c, 0x6c, 0x2e, 0x7a, 0x3b, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 
+0x6c, 0x2e, 0x7a, 0x20, 0x21, 0x3d, 0x20, 0x65, 0x6e, 0x64, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 
+0x7a, 0x3b, 0x20, 0x2b, 0x2b, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 
+0x7a, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x20, 
+0x3d, 0x20, 0x47, 0x65, 0x74, 0x43, 0x65, 0x6c, 0x6c, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 
+0x28, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2c, 0x20, 0x68, 0x61, 0x73, 
+0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 
+0x65, 0x74, 0x65, 0x72, 0x73, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x69, 0x66, 0x20, 0x28, 0x49, 0x73, 0x4f, 0x75, 0x74, 0x73, 0x69, 0x64, 0x65, 0x47, 
+0x72, 0x69, 0x64, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x28, 0x62, 0x75, 0x63, 0x6b, 0x65, 
+0x74, 0x2c, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 
+0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x29, 0x29, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 
+0x66, 0x20, 0x28, 0x6f, 0x75, 0x74, 0x73, 0x69, 0x64, 0x65, 0x47, 0x72, 0x69, 0x64, 0x42, 
+0x75, 0x63, 0x6b, 0x65, 0x74, 0x56, 0x69, 0x73, 0x69, 0x74, 0x65, 0x64, 0x29, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x74, 0x69, 0x6e, 0x75, 0x65, 
+0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x6f, 0x75, 0x74, 0x73, 
+0x69, 0x64, 0x65, 0x47, 0x72, 0x69, 0x64, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x56, 0x69, 
+0x73, 0x69, 0x74, 0x65, 0x64, 0x20, 0x3d, 0x20, 0x74, 0x72, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x5b, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x43, 
+0x6f, 0x75, 0x6e, 0x74, 0x2b, 0x2b, 0x5d, 0x20, 0x3d, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 
+0x74, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 
+0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x43, 0x6f, 
+0x75, 0x6e, 0x74, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x76, 0x6f, 
+0x69, 0x64, 0x20, 0x49, 0x6e, 0x74, 0x65, 0x67, 0x72, 0x61, 0x74, 0x65, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x28, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 
+0x34, 0x20, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 
+0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 
+0x53, 0x69, 0x7a, 0x65, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 
+0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x53, 0x74, 0x72, 0x65, 0x61, 0x6d, 
+0x73, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x0d, 
+0x0a, 0x09, 0x09, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x53, 0x74, 0x72, 0x65, 0x61, 0x6d, 0x73, 0x20, 0x6f, 0x75, 0x74, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 
+0x6e, 0x73, 0x74, 0x20, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x74, 
+0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x53, 0x75, 0x6d, 0x73, 0x26, 0x20, 0x73, 
+0x75, 0x6d, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x66, 
+0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x65, 0x6c, 0x74, 0x61, 0x54, 0x69, 0x6d, 0x65, 0x2c, 
+0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x42, 0x65, 0x68, 0x61, 0x76, 0x69, 0x6f, 0x75, 0x72, 0x50, 0x61, 0x72, 
+0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 
+0x74, 0x65, 0x72, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 
+0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x2c, 
+0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x54, 0x72, 0x69, 0x61, 0x6e, 
+0x67, 0x6c, 0x65, 0x2a, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x73, 0x2c, 
+0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x74, 0x72, 0x69, 0x61, 
+0x6e, 0x67, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 
+0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x75, 0x69, 0x6e, 0x74, 
+0x33, 0x32, 0x2a, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x48, 0x61, 0x73, 
+0x68, 0x4d, 0x61, 0x70, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 
+0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x2a, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 
+0x65, 0x4d, 0x61, 0x70, 0x0d, 0x0a, 0x09, 0x29, 0x20, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x56, 
+0x65, 0x63, 0x33, 0x66, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 
+0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x3d, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x28, 
+0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 
+0x69, 0x74, 0x69, 0x6f, 0x6e, 0x58, 0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 
+0x5d, 0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 
+0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x59, 0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 
+0x64, 0x49, 0x44, 0x5d, 0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x5a, 0x5b, 0x74, 0x68, 
+0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6c, 
+0x6f, 0x61, 0x74, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 
+0x73, 0x73, 0x75, 0x72, 0x65, 0x20, 0x3d, 0x20, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x5b, 
+0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x56, 
+0x65, 0x63, 0x33, 0x66, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x65, 
+0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x20, 0x3d, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x28, 
+0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x76, 0x65, 0x6c, 
+0x6f, 0x63, 0x69, 0x74, 0x79, 0x58, 0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 
+0x5d, 0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 
+0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x59, 0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 
+0x64, 0x49, 0x44, 0x5d, 0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x73, 0x2e, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x5a, 0x5b, 0x74, 0x68, 
+0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 
+0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x44, 
+0x65, 0x6e, 0x73, 0x69, 0x74, 0x79, 0x20, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x20, 0x2f, 0x20, 0x70, 0x61, 
+0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x67, 0x61, 0x73, 0x43, 0x6f, 
+0x6e, 0x73, 0x74, 0x61, 0x6e, 0x74, 0x20, 0x2b, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 
+0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x72, 0x65, 0x73, 0x74, 0x44, 0x65, 0x6e, 0x73, 0x69, 
+0x74, 0x79, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 
+0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x3d, 
+0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x28, 0x73, 0x75, 0x6d, 0x73, 0x2e, 0x64, 0x79, 0x6e, 
+0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 
+0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x5b, 0x30, 0x5d, 0x2c, 0x20, 
+0x73, 0x75, 0x6d, 0x73, 0x2e, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 
+0x72, 0x63, 0x65, 0x5b, 0x31, 0x5d, 0x2c, 0x20, 0x73, 0x75, 0x6d, 0x73, 0x2e, 0x64, 0x79, 
+0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 
+0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x5b, 0x32, 0x5d, 0x29, 
+0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x64, 0x79, 0x6e, 0x61, 
+0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 
+0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x3d, 0x20, 0x56, 0x65, 
+0x63, 0x33, 0x66, 0x28, 0x73, 0x75, 0x6d, 0x73, 0x2e, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 
+0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 
+0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x5b, 0x30, 0x5d, 0x2c, 0x20, 0x73, 0x75, 
+0x6d, 0x73, 0x2e, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 
+0x63, 0x65, 0x5b, 0x31, 0x5d, 0x2c, 0x20, 0x73, 0x75, 0x6d, 0x73, 0x2e, 0x64, 0x79, 0x6e, 
+0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 
+0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x5b, 0x32, 0x5d, 0x29, 
+0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x73, 0x74, 0x61, 0x74, 
+0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 
+0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x3d, 0x20, 0x56, 0x65, 0x63, 0x33, 
+0x66, 0x28, 0x73, 0x75, 0x6d, 0x73, 0x2e, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 
+0x6f, 0x72, 0x63, 0x65, 0x5b, 0x30, 0x5d, 0x2c, 0x20, 0x73, 0x75, 0x6d, 0x73, 0x2e, 0x73, 
+0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 
+0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x5b, 0x31, 0x5d, 0x2c, 
+0x20, 0x73, 0x75, 0x6d, 0x73, 0x2e, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 
+0x72, 0x63, 0x65, 0x5b, 0x32, 0x5d, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 
+0x33, 0x66, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 
+0x65, 0x20, 0x3d, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x28, 0x73, 0x75, 0x6d, 0x73, 0x2e, 
+0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 
+0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x5b, 0x30, 
+0x5d, 0x2c, 0x20, 0x73, 0x75, 0x6d, 0x73, 0x2e, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 
+0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x5b, 0x31, 0x5d, 0x2c, 0x20, 0x73, 0x75, 0x6d, 0x73, 
+0x2e, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x5b, 
+0x32, 0x5d, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x64, 0x79, 0x6e, 0x61, 0x6d, 
+0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 
+0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x2a, 0x3d, 0x20, 0x70, 0x61, 0x72, 
+0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x4d, 0x61, 0x73, 0x73, 0x20, 0x2f, 0x20, 0x28, 0x32, 0x20, 0x2a, 0x20, 0x70, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x44, 0x65, 0x6e, 0x73, 0x69, 0x74, 0x79, 0x29, 
+0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 
+0x73, 0x6d, 0x6f, 0x6f, 0x74, 0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 
+0x43, 0x6f, 0x6e, 0x73, 0x74, 0x61, 0x6e, 0x74, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x64, 0x79, 
+0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 
 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x2a, 0x3d, 
 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x76, 0x69, 
 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 
 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
 0x4d, 0x61, 0x73, 0x73, 0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 
 0x72, 0x73, 0x2d, 0x3e, 0x73, 0x6d, 0x6f, 0x6f, 0x74, 0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 
-0x72, 0x6e, 0x65, 0x6c, 0x43, 0x6f, 0x6e, 0x73, 0x74, 0x61, 0x6e, 0x74, 0x20, 0x2a, 0x20, 
-0x30, 0x2e, 0x30, 0x66, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 
-0x66, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 
-0x20, 0x3d, 0x20, 0x4e, 0x45, 0x57, 0x5f, 0x56, 0x45, 0x43, 0x33, 0x46, 0x28, 0x30, 0x2c, 
-0x20, 0x30, 0x2c, 0x20, 0x30, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x70, 0x61, 0x72, 0x74, 
-0x69, 0x63, 0x6c, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x2b, 0x3d, 0x20, 0x64, 0x79, 
-0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 
-0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x3b, 0x0d, 0x0a, 0x09, 
-0x09, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 
-0x2b, 0x3d, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 
-0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 
-0x63, 0x65, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
-0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x2b, 0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 
-0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 
-0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x70, 0x61, 0x72, 0x74, 
-0x69, 0x63, 0x6c, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x2b, 0x3d, 0x20, 0x73, 0x74, 
-0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 
-0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x3b, 0x0d, 0x0a, 0x09, 
-0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x4d, 0x65, 0x6d, 0x20, 0x69, 
-0x20, 0x3d, 0x20, 0x30, 0x3b, 0x20, 0x69, 0x20, 0x3c, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 
-0x67, 0x6c, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x3b, 0x20, 0x2b, 0x2b, 0x69, 0x29, 0x0d, 
-0x0a, 0x09, 0x09, 0x09, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x46, 0x6f, 0x72, 
-0x63, 0x65, 0x20, 0x2b, 0x3d, 0x20, 0x43, 0x61, 0x6c, 0x63, 0x75, 0x6c, 0x61, 0x74, 0x65, 
-0x54, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x28, 0x70, 
+0x72, 0x6e, 0x65, 0x6c, 0x43, 0x6f, 0x6e, 0x73, 0x74, 0x61, 0x6e, 0x74, 0x3b, 0x0d, 0x0a, 
+0x09, 0x09, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 
+0x2a, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 
+0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x73, 0x73, 0x20, 0x2f, 0x20, 
+0x28, 0x32, 0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x44, 0x65, 
+0x6e, 0x73, 0x69, 0x74, 0x79, 0x29, 0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 
+0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x73, 0x6d, 0x6f, 0x6f, 0x74, 0x68, 0x69, 0x6e, 0x67, 
+0x4b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x43, 0x6f, 0x6e, 0x73, 0x74, 0x61, 0x6e, 0x74, 0x20, 
+0x2a, 0x20, 0x31, 0x2e, 0x30, 0x66, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x73, 0x74, 0x61, 0x74, 
+0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 
+0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x2a, 0x3d, 0x20, 0x70, 0x61, 
+0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x76, 0x69, 0x73, 0x63, 0x6f, 
+0x73, 0x69, 0x74, 0x79, 0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 
+0x72, 0x73, 0x2d, 0x3e, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x73, 
+0x73, 0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 
+0x3e, 0x73, 0x6d, 0x6f, 0x6f, 0x74, 0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 0x6e, 0x65, 
+0x6c, 0x43, 0x6f, 0x6e, 0x73, 0x74, 0x61, 0x6e, 0x74, 0x20, 0x2a, 0x20, 0x30, 0x2e, 0x30, 
+0x66, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x70, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x3d, 0x20, 
+0x56, 0x65, 0x63, 0x33, 0x66, 0x28, 0x30, 0x2c, 0x20, 0x30, 0x2c, 0x20, 0x30, 0x29, 0x3b, 
+0x0d, 0x0a, 0x09, 0x09, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x46, 0x6f, 0x72, 
+0x63, 0x65, 0x20, 0x2b, 0x3d, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 
+0x6f, 0x72, 0x63, 0x65, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x2b, 0x3d, 0x20, 0x64, 0x79, 0x6e, 0x61, 
+0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 
+0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x2b, 
+0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x3b, 
+0x0d, 0x0a, 0x09, 0x09, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x46, 0x6f, 0x72, 
+0x63, 0x65, 0x20, 0x2b, 0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 
+0x6f, 0x72, 0x63, 0x65, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x74, 0x72, 
+0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x20, 0x21, 0x3d, 0x20, 
+0x30, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x2b, 0x3d, 0x20, 0x43, 0x61, 0x6c, 0x63, 0x75, 0x6c, 
+0x61, 0x74, 0x65, 0x42, 0x6f, 0x75, 0x6e, 0x64, 0x61, 0x72, 0x79, 0x46, 0x6f, 0x72, 0x63, 
+0x65, 0x28, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 
+0x69, 0x6f, 0x6e, 0x2c, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x48, 0x61, 
+0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x74, 0x72, 0x69, 0x61, 
+0x6e, 0x67, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 0x20, 0x74, 0x72, 
+0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x4d, 0x61, 0x70, 0x2c, 0x20, 0x74, 0x72, 0x69, 0x61, 
+0x6e, 0x67, 0x6c, 0x65, 0x73, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 
+0x66, 0x20, 0x61, 0x63, 0x63, 0x65, 0x6c, 0x65, 0x72, 0x61, 0x74, 0x69, 0x6f, 0x6e, 0x20, 
+0x3d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 
+0x20, 0x2f, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x44, 0x65, 0x6e, 0x73, 
+0x69, 0x74, 0x79, 0x20, 0x2b, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x28, 0x70, 0x61, 0x72, 
+0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x67, 0x72, 0x61, 0x76, 0x69, 0x74, 
+0x79, 0x58, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 
+0x3e, 0x67, 0x72, 0x61, 0x76, 0x69, 0x74, 0x79, 0x59, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 
+0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x67, 0x72, 0x61, 0x76, 0x69, 0x74, 0x79, 
+0x5a, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x2f, 0x2f, 0x49, 0x6e, 0x74, 0x65, 
+0x67, 0x72, 0x61, 0x74, 0x65, 0x0d, 0x0a, 0x09, 0x09, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x56, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x20, 0x2b, 0x3d, 0x20, 0x61, 
+0x63, 0x63, 0x65, 0x6c, 0x65, 0x72, 0x61, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x2a, 0x20, 0x64, 
+0x65, 0x6c, 0x74, 0x61, 0x54, 0x69, 0x6d, 0x65, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x70, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x20, 
+0x2b, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x65, 0x6c, 0x6f, 
+0x63, 0x69, 0x74, 0x79, 0x20, 0x2a, 0x20, 0x64, 0x65, 0x6c, 0x74, 0x61, 0x54, 0x69, 0x6d, 
+0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x75, 0x20, 0x63, 
+0x65, 0x6c, 0x6c, 0x20, 0x3d, 0x20, 0x47, 0x65, 0x74, 0x43, 0x65, 0x6c, 0x6c, 0x28, 0x70, 
 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 
-0x2c, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x73, 0x5b, 0x69, 0x5d, 0x29, 
-0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x61, 0x63, 0x63, 0x65, 
-0x6c, 0x65, 0x72, 0x61, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x74, 
-0x69, 0x63, 0x6c, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x2f, 0x20, 0x70, 0x61, 0x72, 
-0x74, 0x69, 0x63, 0x6c, 0x65, 0x44, 0x65, 0x6e, 0x73, 0x69, 0x74, 0x79, 0x20, 0x2b, 0x20, 
-0x4e, 0x45, 0x57, 0x5f, 0x56, 0x45, 0x43, 0x33, 0x46, 0x28, 0x70, 0x61, 0x72, 0x61, 0x6d, 
-0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x67, 0x72, 0x61, 0x76, 0x69, 0x74, 0x79, 0x58, 
-0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x67, 
-0x72, 0x61, 0x76, 0x69, 0x74, 0x79, 0x59, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 
-0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x67, 0x72, 0x61, 0x76, 0x69, 0x74, 0x79, 0x5a, 0x29, 
-0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x2f, 0x2f, 0x49, 0x6e, 0x74, 0x65, 0x67, 0x72, 
-0x61, 0x74, 0x65, 0x0d, 0x0a, 0x09, 0x09, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
-0x56, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x20, 0x2b, 0x3d, 0x20, 0x61, 0x63, 0x63, 
-0x65, 0x6c, 0x65, 0x72, 0x61, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x2a, 0x20, 0x64, 0x65, 0x6c, 
-0x74, 0x61, 0x54, 0x69, 0x6d, 0x65, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x70, 0x61, 0x72, 0x74, 
-0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x2b, 0x3d, 
-0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x65, 0x6c, 0x6f, 0x63, 0x69, 
-0x74, 0x79, 0x20, 0x2a, 0x20, 0x64, 0x65, 0x6c, 0x74, 0x61, 0x54, 0x69, 0x6d, 0x65, 0x3b, 
-0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x65, 0x6c, 0x6c, 0x20, 0x3d, 0x20, 0x47, 0x65, 
-0x74, 0x43, 0x65, 0x6c, 0x6c, 0x28, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 
-0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 
+0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 
+0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 
+0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 
+0x74, 0x33, 0x32, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x48, 0x61, 0x73, 
+0x68, 0x20, 0x3d, 0x20, 0x47, 0x65, 0x74, 0x43, 0x65, 0x6c, 0x6c, 0x42, 0x75, 0x63, 0x6b, 
+0x65, 0x74, 0x28, 0x63, 0x65, 0x6c, 0x6c, 0x2c, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 
+0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 
+0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 
+0x65, 0x72, 0x73, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x6f, 0x75, 0x74, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 
+0x6f, 0x6e, 0x58, 0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 0x20, 0x3d, 
+0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 
+0x6f, 0x6e, 0x2e, 0x78, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 
+0x59, 0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 0x20, 0x3d, 0x20, 0x70, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 
+0x2e, 0x79, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x5a, 0x5b, 
+0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 0x20, 0x3d, 0x20, 0x70, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x2e, 0x7a, 
+0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x73, 0x2e, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x58, 0x5b, 0x74, 0x68, 
+0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 0x20, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x56, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x2e, 0x78, 0x3b, 0x0d, 
+0x0a, 0x09, 0x09, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 
+0x2e, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x59, 0x5b, 0x74, 0x68, 0x72, 0x65, 
+0x61, 0x64, 0x49, 0x44, 0x5d, 0x20, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x56, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x2e, 0x79, 0x3b, 0x0d, 0x0a, 0x09, 
+0x09, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x76, 
+0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x5a, 0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 
+0x49, 0x44, 0x5d, 0x20, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 
+0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x2e, 0x7a, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x6f, 
+0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x68, 0x61, 0x73, 
+0x68, 0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 0x20, 0x3d, 0x20, 0x70, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x3b, 0x0d, 0x0a, 0x09, 
+0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x47, 0x65, 
+0x74, 0x55, 0x6e, 0x69, 0x71, 0x75, 0x65, 0x4e, 0x65, 0x69, 0x67, 0x68, 0x62, 0x6f, 0x75, 
+0x72, 0x43, 0x65, 0x6c, 0x6c, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x28, 0x66, 0x6c, 
+0x6f, 0x61, 0x74, 0x20, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x58, 0x2c, 0x20, 
+0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x59, 
+0x2c, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 
+0x6e, 0x5a, 0x2c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x68, 0x61, 0x73, 0x68, 
+0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x42, 0x65, 0x68, 0x61, 0x76, 0x69, 0x6f, 
+0x75, 0x72, 0x50, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2a, 0x20, 0x70, 
+0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2c, 0x20, 0x75, 0x69, 0x6e, 0x74, 
+0x33, 0x32, 0x2a, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x29, 0x0d, 0x0a, 0x09, 
+0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x62, 0x75, 0x63, 
+0x6b, 0x65, 0x74, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x20, 0x3d, 0x20, 0x47, 0x65, 0x74, 0x4e, 
+0x65, 0x69, 0x67, 0x68, 0x62, 0x6f, 0x75, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x42, 0x75, 0x63, 
+0x6b, 0x65, 0x74, 0x73, 0x28, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x58, 0x2c, 
+0x20, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x59, 0x2c, 0x20, 0x70, 0x6f, 0x73, 
+0x69, 0x74, 0x69, 0x6f, 0x6e, 0x5a, 0x2c, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 
+0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 
+0x73, 0x2c, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 
+0x0a, 0x09, 0x09, 0x2f, 0x2f, 0x4f, 0x6e, 0x6c, 0x79, 0x20, 0x74, 0x68, 0x65, 0x20, 0x68, 
+0x61, 0x73, 0x68, 0x20, 0x6d, 0x61, 0x70, 0x20, 0x63, 0x61, 0x6e, 0x20, 0x70, 0x75, 0x74, 
+0x20, 0x74, 0x77, 0x6f, 0x20, 0x6e, 0x65, 0x69, 0x67, 0x68, 0x62, 0x6f, 0x75, 0x72, 0x20, 
+0x63, 0x65, 0x6c, 0x6c, 0x73, 0x20, 0x69, 0x6e, 0x74, 0x6f, 0x20, 0x74, 0x68, 0x65, 0x20, 
+0x73, 0x61, 0x6d, 0x65, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x0d, 0x0a, 0x09, 0x09, 
+0x69, 0x66, 0x20, 0x28, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 
+0x3e, 0x67, 0x72, 0x69, 0x64, 0x53, 0x69, 0x7a, 0x65, 0x58, 0x20, 0x21, 0x3d, 0x20, 0x30, 
+0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x62, 0x75, 
+0x63, 0x6b, 0x65, 0x74, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 
+0x09, 0x2f, 0x2f, 0x54, 0x68, 0x65, 0x20, 0x4d, 0x6f, 0x72, 0x74, 0x6f, 0x6e, 0x20, 0x63, 
+0x6f, 0x64, 0x65, 0x20, 0x67, 0x72, 0x6f, 0x77, 0x73, 0x20, 0x77, 0x69, 0x74, 0x68, 0x20, 
+0x65, 0x76, 0x65, 0x72, 0x79, 0x20, 0x63, 0x6f, 0x6f, 0x72, 0x64, 0x69, 0x6e, 0x61, 0x74, 
+0x65, 0x2c, 0x20, 0x73, 0x6f, 0x20, 0x77, 0x68, 0x65, 0x6e, 0x20, 0x6e, 0x6f, 0x6e, 0x65, 
+0x20, 0x6f, 0x66, 0x20, 0x74, 0x68, 0x65, 0x6d, 0x20, 0x77, 0x72, 0x61, 0x70, 0x73, 0x20, 
+0x61, 0x72, 0x6f, 0x75, 0x6e, 0x64, 0x20, 0x74, 0x68, 0x65, 0x20, 0x63, 0x6f, 0x64, 0x65, 
+0x73, 0x20, 0x6f, 0x66, 0x20, 0x74, 0x68, 0x65, 0x20, 0x63, 0x65, 0x6c, 0x6c, 0x73, 0x20, 
+0x61, 0x72, 0x65, 0x0d, 0x0a, 0x09, 0x09, 0x2f, 0x2f, 0x62, 0x65, 0x74, 0x77, 0x65, 0x65, 
+0x6e, 0x20, 0x74, 0x68, 0x65, 0x20, 0x6f, 0x6e, 0x65, 0x73, 0x20, 0x6f, 0x66, 0x20, 0x74, 
+0x68, 0x65, 0x20, 0x66, 0x69, 0x72, 0x73, 0x74, 0x20, 0x61, 0x6e, 0x64, 0x20, 0x74, 0x68, 
+0x65, 0x20, 0x6c, 0x61, 0x73, 0x74, 0x20, 0x63, 0x65, 0x6c, 0x6c, 0x20, 0x61, 0x6e, 0x64, 
+0x20, 0x74, 0x77, 0x6f, 0x20, 0x6f, 0x66, 0x20, 0x74, 0x68, 0x65, 0x6d, 0x20, 0x63, 0x61, 
+0x6e, 0x20, 0x6f, 0x6e, 0x6c, 0x79, 0x20, 0x73, 0x68, 0x61, 0x72, 0x65, 0x20, 0x61, 0x20, 
+0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x20, 0x69, 0x66, 0x20, 0x74, 0x68, 0x6f, 0x73, 0x65, 
+0x20, 0x61, 0x72, 0x65, 0x20, 0x61, 0x74, 0x0d, 0x0a, 0x09, 0x09, 0x2f, 0x2f, 0x6c, 0x65, 
+0x61, 0x73, 0x74, 0x20, 0x74, 0x68, 0x65, 0x20, 0x68, 0x61, 0x73, 0x68, 0x20, 0x6d, 0x61, 
+0x70, 0x20, 0x73, 0x69, 0x7a, 0x65, 0x20, 0x61, 0x70, 0x61, 0x72, 0x74, 0x2e, 0x20, 0x54, 
+0x68, 0x65, 0x20, 0x48, 0x69, 0x6c, 0x62, 0x65, 0x72, 0x74, 0x20, 0x63, 0x6f, 0x64, 0x65, 
+0x20, 0x64, 0x6f, 0x65, 0x73, 0x6e, 0x27, 0x74, 0x2c, 0x20, 0x73, 0x6f, 0x20, 0x69, 0x74, 
+0x73, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x20, 0x61, 0x72, 0x65, 0x20, 0x61, 
+0x6c, 0x77, 0x61, 0x79, 0x73, 0x20, 0x64, 0x65, 0x64, 0x75, 0x70, 0x6c, 0x69, 0x63, 0x61, 
+0x74, 0x65, 0x64, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x75, 0x20, 0x63, 0x65, 
+0x6c, 0x6c, 0x20, 0x3d, 0x20, 0x47, 0x65, 0x74, 0x43, 0x65, 0x6c, 0x6c, 0x28, 0x56, 0x65, 
+0x63, 0x33, 0x66, 0x28, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x58, 0x2c, 0x20, 
+0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x59, 0x2c, 0x20, 0x70, 0x6f, 0x73, 0x69, 
+0x74, 0x69, 0x6f, 0x6e, 0x5a, 0x29, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 
+0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 
+0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x3b, 0x0d, 
+0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x75, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x43, 
+0x65, 0x6c, 0x6c, 0x20, 0x3d, 0x20, 0x63, 0x65, 0x6c, 0x6c, 0x20, 0x2d, 0x20, 0x56, 0x65, 
+0x63, 0x33, 0x75, 0x28, 0x31, 0x2c, 0x20, 0x31, 0x2c, 0x20, 0x31, 0x29, 0x3b, 0x0d, 0x0a, 
+0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x75, 0x20, 0x6c, 0x61, 0x73, 0x74, 0x43, 0x65, 0x6c, 
+0x6c, 0x20, 0x3d, 0x20, 0x63, 0x65, 0x6c, 0x6c, 0x20, 0x2b, 0x20, 0x56, 0x65, 0x63, 0x33, 
+0x75, 0x28, 0x31, 0x2c, 0x20, 0x31, 0x2c, 0x20, 0x31, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x69, 0x66, 0x20, 0x28, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 
+0x3e, 0x63, 0x65, 0x6c, 0x6c, 0x43, 0x75, 0x72, 0x76, 0x65, 0x20, 0x3d, 0x3d, 0x20, 0x30, 
+0x20, 0x26, 0x26, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x43, 0x65, 
+0x6c, 0x6c, 0x2e, 0x78, 0x20, 0x3c, 0x20, 0x6c, 0x61, 0x73, 0x74, 0x43, 0x65, 0x6c, 0x6c, 
+0x2e, 0x78, 0x20, 0x26, 0x26, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x43, 0x65, 0x6c, 0x6c, 
+0x2e, 0x79, 0x20, 0x3c, 0x20, 0x6c, 0x61, 0x73, 0x74, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x79, 
+0x20, 0x26, 0x26, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x7a, 
+0x20, 0x3c, 0x20, 0x6c, 0x61, 0x73, 0x74, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x7a, 0x20, 0x26, 
+0x26, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x6c, 0x61, 0x73, 0x74, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 
+0x78, 0x20, 0x3c, 0x20, 0x31, 0x30, 0x32, 0x34, 0x20, 0x26, 0x26, 0x20, 0x6c, 0x61, 0x73, 
+0x74, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x79, 0x20, 0x3c, 0x20, 0x31, 0x30, 0x32, 0x34, 0x20, 
+0x26, 0x26, 0x20, 0x6c, 0x61, 0x73, 0x74, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x7a, 0x20, 0x3c, 
+0x20, 0x31, 0x30, 0x32, 0x34, 0x20, 0x26, 0x26, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x4d, 0x6f, 
+0x72, 0x74, 0x6f, 0x6e, 0x33, 0x44, 0x28, 0x6c, 0x61, 0x73, 0x74, 0x43, 0x65, 0x6c, 0x6c, 
+0x29, 0x20, 0x2d, 0x20, 0x4d, 0x6f, 0x72, 0x74, 0x6f, 0x6e, 0x33, 0x44, 0x28, 0x62, 0x65, 
+0x67, 0x69, 0x6e, 0x43, 0x65, 0x6c, 0x6c, 0x29, 0x20, 0x3c, 0x20, 0x68, 0x61, 0x73, 0x68, 
+0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x72, 0x65, 
+0x74, 0x75, 0x72, 0x6e, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x43, 0x6f, 0x75, 0x6e, 
+0x74, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x73, 0x74, 0x64, 0x3a, 0x3a, 0x73, 0x6f, 
+0x72, 0x74, 0x28, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x2c, 0x20, 0x62, 0x75, 0x63, 
+0x6b, 0x65, 0x74, 0x73, 0x20, 0x2b, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x43, 0x6f, 
+0x75, 0x6e, 0x74, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 
+0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x29, 0x28, 0x73, 0x74, 0x64, 0x3a, 0x3a, 
+0x75, 0x6e, 0x69, 0x71, 0x75, 0x65, 0x28, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x2c, 
+0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x20, 0x2b, 0x20, 0x62, 0x75, 0x63, 0x6b, 
+0x65, 0x74, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x29, 0x20, 0x2d, 0x20, 0x62, 0x75, 0x63, 0x6b, 
+0x65, 0x74, 0x73, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x73, 
+0x74, 0x61, 0x74, 0x69, 0x63, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x53, 0x75, 0x6d, 
+0x53, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 
+0x6e, 0x66, 0x6c, 0x75, 0x65, 0x6e, 0x63, 0x65, 0x28, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 
+0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 
+0x6e, 0x2c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 
+0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 
+0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x53, 
+0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x2a, 0x20, 
+0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 
+0x2c, 0x20, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x48, 0x41, 0x53, 0x48, 0x5f, 0x54, 0x59, 
+0x50, 0x45, 0x2a, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 0x20, 0x63, 0x6f, 
+0x6e, 0x73, 0x74, 0x20, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x42, 0x65, 0x68, 
+0x61, 0x76, 0x69, 0x6f, 0x75, 0x72, 0x50, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 
+0x73, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x29, 0x0d, 
+0x0a, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x62, 
+0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x5b, 0x32, 0x37, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x43, 0x6f, 
+0x75, 0x6e, 0x74, 0x20, 0x3d, 0x20, 0x47, 0x65, 0x74, 0x4e, 0x65, 0x69, 0x67, 0x68, 0x62, 
+0x6f, 0x75, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x28, 
+0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 
+0x6e, 0x2e, 0x78, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 
+0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x2e, 0x79, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x2e, 0x7a, 0x2c, 0x20, 
+0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 
+0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x70, 0x61, 
+0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2c, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 
+0x74, 0x73, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 
+0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x49, 0x6e, 0x66, 0x6c, 0x75, 0x65, 0x6e, 0x63, 0x65, 0x53, 0x75, 0x6d, 0x20, 0x3d, 0x20, 
+0x30, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x75, 0x69, 
+0x6e, 0x74, 0x33, 0x32, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x49, 0x6e, 0x64, 0x65, 
+0x78, 0x20, 0x3d, 0x20, 0x30, 0x3b, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x49, 0x6e, 
+0x64, 0x65, 0x78, 0x20, 0x3c, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x43, 0x6f, 0x75, 
+0x6e, 0x74, 0x3b, 0x20, 0x2b, 0x2b, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x49, 0x6e, 0x64, 
+0x65, 0x78, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x75, 0x69, 
+0x6e, 0x74, 0x33, 0x32, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 0x6e, 0x64, 0x65, 0x78, 
+0x20, 0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x5b, 0x62, 0x75, 0x63, 0x6b, 
+0x65, 0x74, 0x73, 0x5b, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x49, 0x6e, 0x64, 0x65, 0x78, 
+0x5d, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 
+0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 
+0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 
+0x4d, 0x61, 0x70, 0x5b, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x5b, 0x62, 0x75, 0x63, 
+0x6b, 0x65, 0x74, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x20, 0x2b, 0x20, 0x31, 0x5d, 0x3b, 
+0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x75, 0x69, 0x6e, 
+0x74, 0x33, 0x32, 0x20, 0x69, 0x20, 0x3d, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 0x6e, 
+0x64, 0x65, 0x78, 0x3b, 0x20, 0x69, 0x20, 0x3c, 0x20, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 
+0x65, 0x78, 0x3b, 0x20, 0x2b, 0x2b, 0x69, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x7b, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x64, 0x69, 0x72, 0x20, 
+0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x73, 0x5b, 0x69, 0x5d, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x41, 
+0x6e, 0x64, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x2e, 0x78, 0x79, 0x7a, 0x28, 
+0x29, 0x20, 0x2d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 
+0x69, 0x74, 0x69, 0x6f, 0x6e, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6c, 0x6f, 
+0x61, 0x74, 0x20, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x20, 0x3d, 0x20, 0x64, 0x6f, 
+0x74, 0x28, 0x64, 0x69, 0x72, 0x2c, 0x20, 0x64, 0x69, 0x72, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 
+0x72, 0x20, 0x3e, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 
+0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 
+0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 
+0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 
+0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 
+0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x74, 0x69, 0x6e, 0x75, 
+0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 
+0x20, 0x64, 0x69, 0x73, 0x74, 0x20, 0x3d, 0x20, 0x73, 0x71, 0x72, 0x74, 0x28, 0x64, 0x69, 
+0x73, 0x74, 0x53, 0x71, 0x72, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 
+0x6e, 0x66, 0x6c, 0x75, 0x65, 0x6e, 0x63, 0x65, 0x53, 0x75, 0x6d, 0x20, 0x2b, 0x3d, 0x20, 
+0x53, 0x6d, 0x6f, 0x6f, 0x74, 0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 
+0x44, 0x30, 0x28, 0x64, 0x69, 0x73, 0x74, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 
 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 
 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x3b, 
-0x0d, 0x0a, 0x09, 0x09, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x48, 0x61, 0x73, 
-0x68, 0x20, 0x3d, 0x20, 0x47, 0x65, 0x74, 0x48, 0x61, 0x73, 0x68, 0x28, 0x63, 0x65, 0x6c, 
-0x6c, 0x29, 0x20, 0x25, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 
-0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 
-0x7a, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x23, 0x69, 0x66, 0x64, 0x65, 0x66, 0x20, 0x43, 
-0x4c, 0x5f, 0x43, 0x4f, 0x4d, 0x50, 0x49, 0x4c, 0x45, 0x52, 0x0d, 0x0a, 0x09, 0x09, 0x6f, 
-0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x74, 0x72, 0x2d, 0x3e, 
-0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x41, 0x6e, 0x64, 0x50, 0x72, 0x65, 0x73, 
-0x73, 0x75, 0x72, 0x65, 0x2e, 0x78, 0x79, 0x7a, 0x20, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x74, 
-0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x3b, 0x0d, 0x0a, 
-0x09, 0x09, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x74, 
-0x72, 0x2d, 0x3e, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x41, 0x6e, 0x64, 0x48, 
-0x61, 0x73, 0x68, 0x2e, 0x78, 0x79, 0x7a, 0x20, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 
-0x63, 0x6c, 0x65, 0x56, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x3b, 0x0d, 0x0a, 0x09, 
-0x09, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x74, 0x72, 
-0x2d, 0x3e, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x41, 0x6e, 0x64, 0x48, 0x61, 
-0x73, 0x68, 0x2e, 0x77, 0x20, 0x3d, 0x20, 0x61, 0x73, 0x5f, 0x66, 0x6c, 0x6f, 0x61, 0x74, 
-0x28, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x29, 0x3b, 
-0x0d, 0x0a, 0x23, 0x65, 0x6c, 0x73, 0x65, 0x0d, 0x0a, 0x09, 0x09, 0x6f, 0x75, 0x74, 0x50, 
-0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x74, 0x72, 0x2d, 0x3e, 0x70, 0x6f, 0x73, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 
+0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x66, 0x6c, 0x75, 0x65, 0x6e, 
+0x63, 0x65, 0x53, 0x75, 0x6d, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 
+0x2f, 0x2f, 0x52, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x73, 0x20, 0x74, 0x68, 0x65, 0x20, 0x6c, 
+0x61, 0x72, 0x67, 0x65, 0x73, 0x74, 0x20, 0x6e, 0x75, 0x6d, 0x62, 0x65, 0x72, 0x20, 0x6f, 
+0x66, 0x20, 0x63, 0x6f, 0x6e, 0x74, 0x72, 0x69, 0x62, 0x75, 0x74, 0x69, 0x6f, 0x6e, 0x73, 
+0x20, 0x74, 0x68, 0x65, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x20, 0x63, 
+0x61, 0x6e, 0x20, 0x61, 0x64, 0x64, 0x20, 0x74, 0x6f, 0x20, 0x74, 0x68, 0x65, 0x20, 0x70, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x20, 0x61, 0x66, 0x74, 0x65, 0x72, 0x20, 
+0x74, 0x68, 0x65, 0x20, 0x72, 0x61, 0x6e, 0x67, 0x65, 0x20, 0x6f, 0x66, 0x20, 0x74, 0x68, 
+0x65, 0x20, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x0d, 0x0a, 0x09, 0x73, 0x74, 0x61, 0x74, 
+0x69, 0x63, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x47, 0x65, 0x74, 0x4d, 0x61, 
+0x78, 0x50, 0x61, 0x69, 0x72, 0x43, 0x6f, 0x6e, 0x74, 0x72, 0x69, 0x62, 0x75, 0x74, 0x69, 
+0x6f, 0x6e, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x28, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x75, 
+0x69, 0x6e, 0x74, 0x33, 0x32, 0x2a, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x2c, 
+0x20, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x43, 
+0x6f, 0x75, 0x6e, 0x74, 0x2c, 0x20, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x48, 0x41, 0x53, 
+0x48, 0x5f, 0x54, 0x59, 0x50, 0x45, 0x2a, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 
+0x2c, 0x20, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x50, 0x61, 0x69, 0x72, 0x49, 0x6e, 0x74, 
+0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x53, 0x75, 0x6d, 0x73, 0x26, 0x20, 0x73, 
+0x75, 0x6d, 0x73, 0x29, 0x0d, 0x0a, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 
+0x74, 0x36, 0x34, 0x20, 0x63, 0x6f, 0x75, 0x6e, 0x74, 0x20, 0x3d, 0x20, 0x30, 0x3b, 0x0d, 
+0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 
+0x32, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 
+0x20, 0x30, 0x3b, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x49, 0x6e, 0x64, 0x65, 0x78, 
+0x20, 0x3c, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x3b, 
+0x20, 0x2b, 0x2b, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x29, 
+0x0d, 0x0a, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 
+0x32, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 
+0x73, 0x74, 0x64, 0x3a, 0x3a, 0x6d, 0x61, 0x78, 0x3c, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 
+0x3e, 0x28, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x5b, 0x62, 0x75, 0x63, 0x6b, 0x65, 
+0x74, 0x73, 0x5b, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 
+0x5d, 0x2c, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x29, 0x73, 0x75, 0x6d, 0x73, 
+0x2e, 0x72, 0x61, 0x6e, 0x67, 0x65, 0x45, 0x6e, 0x64, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 
+0x78, 0x20, 0x3d, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x5b, 0x62, 0x75, 0x63, 
+0x6b, 0x65, 0x74, 0x73, 0x5b, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x49, 0x6e, 0x64, 0x65, 
+0x78, 0x5d, 0x20, 0x2b, 0x20, 0x31, 0x5d, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x69, 0x66, 0x20, 0x28, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 
+0x3c, 0x20, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x29, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x09, 0x63, 0x6f, 0x75, 0x6e, 0x74, 0x20, 0x2b, 0x3d, 0x20, 0x65, 0x6e, 0x64, 0x49, 
+0x6e, 0x64, 0x65, 0x78, 0x20, 0x2d, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 0x6e, 0x64, 
+0x65, 0x78, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x72, 
+0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x63, 0x6f, 0x75, 0x6e, 0x74, 0x3b, 0x0d, 0x0a, 0x09, 
+0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x62, 0x6f, 0x6f, 0x6c, 0x20, 0x41, 0x63, 0x63, 0x75, 
+0x6d, 0x75, 0x6c, 0x61, 0x74, 0x65, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 
+0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x50, 0x61, 0x69, 0x72, 0x73, 0x28, 0x0d, 0x0a, 
+0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x73, 0x6f, 0x72, 0x74, 0x65, 0x64, 
+0x49, 0x6e, 0x64, 0x65, 0x78, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 
+0x34, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 
+0x0d, 0x0a, 0x09, 0x09, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x53, 0x74, 0x72, 0x65, 0x61, 0x6d, 0x73, 0x20, 0x69, 0x6e, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 
+0x6e, 0x73, 0x74, 0x20, 0x48, 0x41, 0x53, 0x48, 0x5f, 0x54, 0x59, 0x50, 0x45, 0x2a, 0x20, 
+0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 
+0x73, 0x74, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x70, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 
+0x73, 0x74, 0x20, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x42, 0x65, 0x68, 0x61, 
+0x76, 0x69, 0x6f, 0x75, 0x72, 0x50, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 
+0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2c, 0x0d, 0x0a, 
+0x09, 0x09, 0x50, 0x61, 0x69, 0x72, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 
+0x6f, 0x6e, 0x53, 0x75, 0x6d, 0x73, 0x26, 0x20, 0x73, 0x75, 0x6d, 0x73, 0x0d, 0x0a, 0x09, 
+0x29, 0x20, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x70, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 
+0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x70, 0x5b, 0x73, 0x6f, 0x72, 
+0x74, 0x65, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x56, 
+0x65, 0x63, 0x33, 0x66, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 
+0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x3d, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x28, 
+0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 
+0x69, 0x74, 0x69, 0x6f, 0x6e, 0x58, 0x5b, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x59, 0x5b, 
+0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x2c, 
+0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 
+0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x5a, 0x5b, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 
+0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x5b, 
+0x32, 0x37, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 
+0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x20, 0x3d, 0x20, 0x47, 
+0x65, 0x74, 0x55, 0x6e, 0x69, 0x71, 0x75, 0x65, 0x4e, 0x65, 0x69, 0x67, 0x68, 0x62, 0x6f, 
+0x75, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x28, 0x70, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 
+0x2e, 0x78, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 
+0x69, 0x74, 0x69, 0x6f, 0x6e, 0x2e, 0x79, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x2e, 0x7a, 0x2c, 0x20, 0x64, 
+0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 
+0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x70, 0x61, 
+0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2c, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 
+0x74, 0x73, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x73, 
+0x75, 0x6d, 0x73, 0x2e, 0x63, 0x6f, 0x6e, 0x74, 0x72, 0x69, 0x62, 0x75, 0x74, 0x69, 0x6f, 
+0x6e, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x20, 0x2b, 0x20, 0x47, 0x65, 0x74, 0x4d, 0x61, 0x78, 
+0x50, 0x61, 0x69, 0x72, 0x43, 0x6f, 0x6e, 0x74, 0x72, 0x69, 0x62, 0x75, 0x74, 0x69, 0x6f, 
+0x6e, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x28, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x2c, 
+0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x2c, 0x20, 0x68, 
+0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 0x20, 0x73, 0x75, 0x6d, 0x73, 0x29, 0x20, 0x3e, 
+0x20, 0x73, 0x75, 0x6d, 0x73, 0x2e, 0x63, 0x6f, 0x6e, 0x74, 0x72, 0x69, 0x62, 0x75, 0x74, 
+0x69, 0x6f, 0x6e, 0x43, 0x61, 0x70, 0x61, 0x63, 0x69, 0x74, 0x79, 0x29, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x66, 0x61, 0x6c, 0x73, 0x65, 0x3b, 
+0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x70, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x66, 0x6c, 0x75, 0x65, 0x6e, 0x63, 0x65, 0x53, 
+0x75, 0x6d, 0x20, 0x3d, 0x20, 0x30, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6f, 
+0x72, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 
+0x74, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x30, 0x3b, 0x20, 0x62, 0x75, 0x63, 
+0x6b, 0x65, 0x74, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3c, 0x20, 0x62, 0x75, 0x63, 0x6b, 
+0x65, 0x74, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x3b, 0x20, 0x2b, 0x2b, 0x62, 0x75, 0x63, 0x6b, 
+0x65, 0x74, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x2f, 0x2f, 0x50, 0x61, 0x69, 0x72, 0x73, 0x20, 0x77, 0x69, 0x74, 0x68, 
+0x20, 0x61, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x20, 0x74, 0x68, 0x61, 
+0x74, 0x20, 0x69, 0x73, 0x20, 0x65, 0x61, 0x72, 0x6c, 0x69, 0x65, 0x72, 0x20, 0x69, 0x6e, 
+0x20, 0x74, 0x68, 0x65, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x20, 0x6d, 
+0x61, 0x70, 0x20, 0x61, 0x72, 0x65, 0x20, 0x68, 0x61, 0x6e, 0x64, 0x6c, 0x65, 0x64, 0x20, 
+0x62, 0x79, 0x20, 0x74, 0x68, 0x61, 0x74, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x62, 0x65, 
+0x67, 0x69, 0x6e, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x73, 0x74, 0x64, 0x3a, 
+0x3a, 0x6d, 0x61, 0x78, 0x3c, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x3e, 0x28, 0x68, 0x61, 
+0x73, 0x68, 0x4d, 0x61, 0x70, 0x5b, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x5b, 0x62, 
+0x75, 0x63, 0x6b, 0x65, 0x74, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x5d, 0x2c, 0x20, 0x28, 
+0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x29, 0x73, 0x6f, 0x72, 0x74, 0x65, 0x64, 0x49, 0x6e, 
+0x64, 0x65, 0x78, 0x20, 0x2b, 0x20, 0x31, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x75, 
+0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 
+0x3d, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x5b, 0x62, 0x75, 0x63, 0x6b, 0x65, 
+0x74, 0x73, 0x5b, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 
+0x20, 0x2b, 0x20, 0x31, 0x5d, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x66, 0x6f, 
+0x72, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x69, 0x20, 0x3d, 0x20, 0x62, 
+0x65, 0x67, 0x69, 0x6e, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x3b, 0x20, 0x69, 0x20, 0x3c, 0x20, 
+0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x3b, 0x20, 0x2b, 0x2b, 0x69, 0x29, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 
+0x33, 0x32, 0x20, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x70, 0x5b, 0x69, 0x5d, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x64, 0x69, 0x72, 0x20, 0x3d, 
+0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x28, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x58, 0x5b, 0x69, 
+0x6e, 0x64, 0x65, 0x78, 0x5d, 0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x59, 0x5b, 0x69, 
+0x6e, 0x64, 0x65, 0x78, 0x5d, 0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x5a, 0x5b, 0x69, 
+0x6e, 0x64, 0x65, 0x78, 0x5d, 0x29, 0x20, 0x2d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 
+0x20, 0x3d, 0x20, 0x64, 0x6f, 0x74, 0x28, 0x64, 0x69, 0x72, 0x2c, 0x20, 0x64, 0x69, 0x72, 
+0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x64, 
+0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x20, 0x3e, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 
+0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 
+0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x20, 0x2a, 
+0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 
+0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 
+0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x63, 0x6f, 
+0x6e, 0x74, 0x69, 0x6e, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x69, 0x73, 0x74, 0x20, 0x3d, 0x20, 0x73, 0x71, 
+0x72, 0x74, 0x28, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x49, 0x6e, 0x66, 0x6c, 0x75, 0x65, 0x6e, 0x63, 0x65, 0x20, 0x3d, 0x20, 0x53, 
+0x6d, 0x6f, 0x6f, 0x74, 0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x44, 
+0x30, 0x28, 0x64, 0x69, 0x73, 0x74, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 
+0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 
+0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x3b, 0x0d, 
+0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x49, 0x6e, 0x66, 0x6c, 0x75, 0x65, 0x6e, 0x63, 0x65, 0x53, 0x75, 0x6d, 0x20, 0x2b, 0x3d, 
+0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x66, 0x6c, 0x75, 0x65, 
+0x6e, 0x63, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 
+0x28, 0x69, 0x20, 0x3c, 0x20, 0x73, 0x75, 0x6d, 0x73, 0x2e, 0x72, 0x61, 0x6e, 0x67, 0x65, 
+0x45, 0x6e, 0x64, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x73, 0x75, 0x6d, 0x73, 
+0x2e, 0x69, 0x6e, 0x66, 0x6c, 0x75, 0x65, 0x6e, 0x63, 0x65, 0x5b, 0x69, 0x5d, 0x20, 0x2b, 
+0x3d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x66, 0x6c, 0x75, 
+0x65, 0x6e, 0x63, 0x65, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x65, 0x6c, 0x73, 0x65, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x73, 
+0x75, 0x6d, 0x73, 0x2e, 0x63, 0x6f, 0x6e, 0x74, 0x72, 0x69, 0x62, 0x75, 0x74, 0x69, 0x6f, 
+0x6e, 0x49, 0x6e, 0x64, 0x69, 0x63, 0x65, 0x73, 0x5b, 0x73, 0x75, 0x6d, 0x73, 0x2e, 0x63, 
+0x6f, 0x6e, 0x74, 0x72, 0x69, 0x62, 0x75, 0x74, 0x69, 0x6f, 0x6e, 0x43, 0x6f, 0x75, 0x6e, 
+0x74, 0x5d, 0x20, 0x3d, 0x20, 0x69, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x73, 
+0x75, 0x6d, 0x73, 0x2e, 0x63, 0x6f, 0x6e, 0x74, 0x72, 0x69, 0x62, 0x75, 0x74, 0x69, 0x6f, 
+0x6e, 0x56, 0x61, 0x6c, 0x75, 0x65, 0x73, 0x5b, 0x73, 0x75, 0x6d, 0x73, 0x2e, 0x63, 0x6f, 
+0x6e, 0x74, 0x72, 0x69, 0x62, 0x75, 0x74, 0x69, 0x6f, 0x6e, 0x43, 0x6f, 0x75, 0x6e, 0x74, 
+0x5d, 0x20, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x66, 
+0x6c, 0x75, 0x65, 0x6e, 0x63, 0x65, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x2b, 
+0x2b, 0x73, 0x75, 0x6d, 0x73, 0x2e, 0x63, 0x6f, 0x6e, 0x74, 0x72, 0x69, 0x62, 0x75, 0x74, 
+0x69, 0x6f, 0x6e, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x7d, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 
+0x0a, 0x09, 0x09, 0x73, 0x75, 0x6d, 0x73, 0x2e, 0x69, 0x6e, 0x66, 0x6c, 0x75, 0x65, 0x6e, 
+0x63, 0x65, 0x5b, 0x73, 0x6f, 0x72, 0x74, 0x65, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 
+0x20, 0x2b, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x66, 
+0x6c, 0x75, 0x65, 0x6e, 0x63, 0x65, 0x53, 0x75, 0x6d, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 
+0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x74, 0x72, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 
+0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x76, 0x6f, 0x69, 0x64, 0x20, 0x55, 0x70, 0x64, 
+0x61, 0x74, 0x65, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 
+0x73, 0x75, 0x72, 0x65, 0x46, 0x72, 0x6f, 0x6d, 0x50, 0x61, 0x69, 0x72, 0x73, 0x28, 0x0d, 
+0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x73, 0x6f, 0x72, 0x74, 0x65, 
+0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 
+0x36, 0x34, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x73, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 
+0x6e, 0x74, 0x36, 0x34, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 
+0x65, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x53, 0x74, 0x72, 0x65, 0x61, 0x6d, 0x73, 0x20, 0x69, 
+0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 
+0x66, 0x6c, 0x6f, 0x61, 0x74, 0x2a, 0x20, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x73, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x2c, 0x0d, 0x0a, 
+0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x2a, 
+0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x70, 0x2c, 0x0d, 0x0a, 
+0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x53, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x2a, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 
+0x6f, 0x6e, 0x73, 0x74, 0x20, 0x48, 0x41, 0x53, 0x48, 0x5f, 0x54, 0x59, 0x50, 0x45, 0x2a, 
+0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 
+0x6e, 0x73, 0x74, 0x20, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x42, 0x65, 0x68, 
+0x61, 0x76, 0x69, 0x6f, 0x75, 0x72, 0x50, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 
+0x73, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2c, 0x0d, 
+0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x50, 0x61, 0x69, 0x72, 0x49, 0x6e, 
+0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x53, 0x75, 0x6d, 0x73, 0x26, 0x20, 
+0x73, 0x75, 0x6d, 0x73, 0x0d, 0x0a, 0x09, 0x29, 0x20, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x75, 
+0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x20, 
+0x3d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x70, 0x5b, 0x73, 
+0x6f, 0x72, 0x74, 0x65, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x3b, 0x0d, 0x0a, 0x0d, 
+0x0a, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 
+0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x66, 0x6c, 0x75, 0x65, 
+0x6e, 0x63, 0x65, 0x53, 0x75, 0x6d, 0x20, 0x3d, 0x20, 0x73, 0x75, 0x6d, 0x73, 0x2e, 0x69, 
+0x6e, 0x66, 0x6c, 0x75, 0x65, 0x6e, 0x63, 0x65, 0x5b, 0x73, 0x6f, 0x72, 0x74, 0x65, 0x64, 
+0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6c, 
+0x6f, 0x61, 0x74, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x49, 0x6e, 0x66, 0x6c, 0x75, 0x65, 0x6e, 0x63, 0x65, 0x53, 0x75, 0x6d, 
+0x20, 0x3d, 0x20, 0x30, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x73, 0x74, 
+0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x43, 0x6f, 
+0x75, 0x6e, 0x74, 0x20, 0x21, 0x3d, 0x20, 0x30, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x7b, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x3d, 0x20, 0x56, 
+0x65, 0x63, 0x33, 0x66, 0x28, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x73, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x58, 0x5b, 0x74, 0x68, 0x72, 
+0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x59, 0x5b, 
+0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 
+0x6e, 0x5a, 0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 0x29, 0x3b, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x49, 0x6e, 0x66, 0x6c, 0x75, 0x65, 0x6e, 0x63, 0x65, 0x53, 0x75, 0x6d, 
+0x20, 0x3d, 0x20, 0x53, 0x75, 0x6d, 0x53, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x66, 0x6c, 0x75, 0x65, 0x6e, 0x63, 0x65, 0x28, 
+0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 
+0x6e, 0x2c, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 
+0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x73, 0x2c, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 0x20, 0x70, 0x61, 0x72, 
+0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x7d, 0x0d, 
+0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x70, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x44, 0x65, 0x6e, 0x73, 0x69, 0x74, 0x79, 0x20, 0x3d, 0x20, 0x70, 
+0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x73, 0x65, 0x6c, 0x66, 
+0x44, 0x65, 0x6e, 0x73, 0x69, 0x74, 0x79, 0x20, 0x2b, 0x20, 0x28, 0x64, 0x79, 0x6e, 0x61, 
+0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x66, 0x6c, 
+0x75, 0x65, 0x6e, 0x63, 0x65, 0x53, 0x75, 0x6d, 0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 
+0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x4d, 0x61, 0x73, 0x73, 0x20, 0x2b, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x66, 0x6c, 0x75, 0x65, 0x6e, 0x63, 
+0x65, 0x53, 0x75, 0x6d, 0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 
+0x72, 0x73, 0x2d, 0x3e, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x73, 
+0x73, 0x29, 0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 
+0x2d, 0x3e, 0x73, 0x6d, 0x6f, 0x6f, 0x74, 0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 0x6e, 
+0x65, 0x6c, 0x43, 0x6f, 0x6e, 0x73, 0x74, 0x61, 0x6e, 0x74, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 
+0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x20, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 
+0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x67, 0x61, 0x73, 0x43, 0x6f, 0x6e, 0x73, 0x74, 
+0x61, 0x6e, 0x74, 0x20, 0x2a, 0x20, 0x28, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x44, 0x65, 0x6e, 0x73, 0x69, 0x74, 0x79, 0x20, 0x2d, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 
+0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x72, 0x65, 0x73, 0x74, 0x44, 0x65, 0x6e, 0x73, 
+0x69, 0x74, 0x79, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x6f, 0x75, 0x74, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 
+0x65, 0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 0x20, 0x3d, 0x20, 0x70, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 
+0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x62, 0x6f, 0x6f, 0x6c, 0x20, 
+0x41, 0x63, 0x63, 0x75, 0x6d, 0x75, 0x6c, 0x61, 0x74, 0x65, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x73, 0x50, 0x61, 0x69, 0x72, 
+0x73, 0x28, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x73, 0x6f, 
+0x72, 0x74, 0x65, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x75, 
+0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 
+0x69, 0x7a, 0x65, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x53, 0x74, 0x72, 0x65, 0x61, 0x6d, 0x73, 
+0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x0d, 0x0a, 
+0x09, 0x09, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x53, 0x74, 0x72, 0x65, 0x61, 0x6d, 0x73, 0x20, 0x6f, 0x75, 0x74, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 
+0x73, 0x74, 0x20, 0x48, 0x41, 0x53, 0x48, 0x5f, 0x54, 0x59, 0x50, 0x45, 0x2a, 0x20, 0x68, 
+0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 
+0x74, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x4d, 0x61, 0x70, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 
+0x74, 0x20, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x42, 0x65, 0x68, 0x61, 0x76, 
+0x69, 0x6f, 0x75, 0x72, 0x50, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2a, 
+0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 
+0x09, 0x50, 0x61, 0x69, 0x72, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 
+0x6e, 0x53, 0x75, 0x6d, 0x73, 0x26, 0x20, 0x73, 0x75, 0x6d, 0x73, 0x0d, 0x0a, 0x09, 0x29, 
+0x20, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x70, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x70, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x70, 0x5b, 0x73, 0x6f, 0x72, 0x74, 
+0x65, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 
+0x63, 0x33, 0x66, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 
+0x69, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x3d, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x28, 0x69, 
+0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 0x69, 
+0x74, 0x69, 0x6f, 0x6e, 0x58, 0x5b, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 
+0x6e, 0x64, 0x65, 0x78, 0x5d, 0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x59, 0x5b, 0x70, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x2c, 0x20, 
+0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 
+0x69, 0x74, 0x69, 0x6f, 0x6e, 0x5a, 0x5b, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6c, 0x6f, 
+0x61, 0x74, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 
+0x73, 0x75, 0x72, 0x65, 0x20, 0x3d, 0x20, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x5b, 0x70, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x3b, 0x0d, 
+0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x56, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x20, 0x3d, 0x20, 0x56, 0x65, 
+0x63, 0x33, 0x66, 0x28, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 
+0x2e, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x58, 0x5b, 0x70, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x2c, 0x20, 0x69, 0x6e, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 
+0x74, 0x79, 0x59, 0x5b, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x64, 
+0x65, 0x78, 0x5d, 0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x73, 0x2e, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x5a, 0x5b, 0x70, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x29, 0x3b, 0x0d, 0x0a, 
+0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x62, 0x75, 0x63, 0x6b, 
+0x65, 0x74, 0x73, 0x5b, 0x32, 0x37, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 
+0x74, 0x33, 0x32, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x43, 0x6f, 0x75, 0x6e, 0x74, 
+0x20, 0x3d, 0x20, 0x47, 0x65, 0x74, 0x55, 0x6e, 0x69, 0x71, 0x75, 0x65, 0x4e, 0x65, 0x69, 
+0x67, 0x68, 0x62, 0x6f, 0x75, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x42, 0x75, 0x63, 0x6b, 0x65, 
+0x74, 0x73, 0x28, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 
+0x74, 0x69, 0x6f, 0x6e, 0x2e, 0x78, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x2e, 0x79, 0x2c, 0x20, 0x70, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x2e, 
+0x7a, 0x2c, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 
+0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2c, 0x20, 0x62, 
+0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x69, 
+0x66, 0x20, 0x28, 0x73, 0x75, 0x6d, 0x73, 0x2e, 0x63, 0x6f, 0x6e, 0x74, 0x72, 0x69, 0x62, 
+0x75, 0x74, 0x69, 0x6f, 0x6e, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x20, 0x2b, 0x20, 0x47, 0x65, 
+0x74, 0x4d, 0x61, 0x78, 0x50, 0x61, 0x69, 0x72, 0x43, 0x6f, 0x6e, 0x74, 0x72, 0x69, 0x62, 
+0x75, 0x74, 0x69, 0x6f, 0x6e, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x28, 0x62, 0x75, 0x63, 0x6b, 
+0x65, 0x74, 0x73, 0x2c, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x43, 0x6f, 0x75, 0x6e, 
+0x74, 0x2c, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 0x20, 0x73, 0x75, 0x6d, 
+0x73, 0x29, 0x20, 0x3e, 0x20, 0x73, 0x75, 0x6d, 0x73, 0x2e, 0x63, 0x6f, 0x6e, 0x74, 0x72, 
+0x69, 0x62, 0x75, 0x74, 0x69, 0x6f, 0x6e, 0x43, 0x61, 0x70, 0x61, 0x63, 0x69, 0x74, 0x79, 
+0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x66, 0x61, 
+0x6c, 0x73, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 
+0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 
+0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x3d, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 
+0x28, 0x30, 0x2e, 0x30, 0x66, 0x2c, 0x20, 0x30, 0x2e, 0x30, 0x66, 0x2c, 0x20, 0x30, 0x2e, 
+0x30, 0x66, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x70, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 
+0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x3d, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x28, 
+0x30, 0x2e, 0x30, 0x66, 0x2c, 0x20, 0x30, 0x2e, 0x30, 0x66, 0x2c, 0x20, 0x30, 0x2e, 0x30, 
+0x66, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x75, 
+0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x49, 0x6e, 0x64, 
+0x65, 0x78, 0x20, 0x3d, 0x20, 0x30, 0x3b, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x49, 
+0x6e, 0x64, 0x65, 0x78, 0x20, 0x3c, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x43, 0x6f, 
+0x75, 0x6e, 0x74, 0x3b, 0x20, 0x2b, 0x2b, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x49, 0x6e, 
+0x64, 0x65, 0x78, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x2f, 
+0x2f, 0x50, 0x61, 0x69, 0x72, 0x73, 0x20, 0x77, 0x69, 0x74, 0x68, 0x20, 0x61, 0x20, 0x70, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x20, 0x74, 0x68, 0x61, 0x74, 0x20, 0x69, 0x73, 
+0x20, 0x65, 0x61, 0x72, 0x6c, 0x69, 0x65, 0x72, 0x20, 0x69, 0x6e, 0x20, 0x74, 0x68, 0x65, 
+0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x20, 0x6d, 0x61, 0x70, 0x20, 0x61, 
+0x72, 0x65, 0x20, 0x68, 0x61, 0x6e, 0x64, 0x6c, 0x65, 0x64, 0x20, 0x62, 0x79, 0x20, 0x74, 
+0x68, 0x61, 0x74, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 
+0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x73, 0x74, 0x64, 0x3a, 0x3a, 0x6d, 0x61, 0x78, 
+0x3c, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x3e, 0x28, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 
+0x70, 0x5b, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x5b, 0x62, 0x75, 0x63, 0x6b, 0x65, 
+0x74, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x5d, 0x2c, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 
+0x33, 0x32, 0x29, 0x73, 0x6f, 0x72, 0x74, 0x65, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 
+0x2b, 0x20, 0x31, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 
+0x32, 0x20, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x68, 0x61, 
+0x73, 0x68, 0x4d, 0x61, 0x70, 0x5b, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x5b, 0x62, 
+0x75, 0x63, 0x6b, 0x65, 0x74, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x20, 0x2b, 0x20, 0x31, 
+0x5d, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x75, 
+0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x69, 0x20, 0x3d, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 
+0x49, 0x6e, 0x64, 0x65, 0x78, 0x3b, 0x20, 0x69, 0x20, 0x3c, 0x20, 0x65, 0x6e, 0x64, 0x49, 
+0x6e, 0x64, 0x65, 0x78, 0x3b, 0x20, 0x2b, 0x2b, 0x69, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x69, 
+0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x4d, 0x61, 0x70, 0x5b, 0x69, 0x5d, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x3d, 0x20, 
+0x56, 0x65, 0x63, 0x33, 0x66, 0x28, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x58, 0x5b, 0x69, 0x6e, 
+0x64, 0x65, 0x78, 0x5d, 0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x59, 0x5b, 0x69, 0x6e, 
+0x64, 0x65, 0x78, 0x5d, 0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x5a, 0x5b, 0x69, 0x6e, 
+0x64, 0x65, 0x78, 0x5d, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x56, 
+0x65, 0x63, 0x33, 0x66, 0x20, 0x64, 0x69, 0x72, 0x20, 0x3d, 0x20, 0x6f, 0x74, 0x68, 0x65, 
+0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 
+0x6f, 0x6e, 0x20, 0x2d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 
+0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6c, 
+0x6f, 0x61, 0x74, 0x20, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x20, 0x3d, 0x20, 0x64, 
+0x6f, 0x74, 0x28, 0x64, 0x69, 0x72, 0x2c, 0x20, 0x64, 0x69, 0x72, 0x29, 0x3b, 0x0d, 0x0a, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x64, 0x69, 0x73, 0x74, 0x53, 
+0x71, 0x72, 0x20, 0x3e, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 
+0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 
+0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 
+0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 
+0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 
+0x65, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x74, 0x69, 0x6e, 
+0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 
+0x74, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x20, 0x3d, 0x20, 0x6f, 0x75, 0x74, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x72, 0x65, 0x73, 0x73, 0x75, 
+0x72, 0x65, 0x5b, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x20, 0x3d, 
+0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x28, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x73, 0x2e, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x58, 0x5b, 0x69, 
+0x6e, 0x64, 0x65, 0x78, 0x5d, 0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x73, 0x2e, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x59, 0x5b, 0x69, 
+0x6e, 0x64, 0x65, 0x78, 0x5d, 0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x73, 0x2e, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x5a, 0x5b, 0x69, 
+0x6e, 0x64, 0x65, 0x78, 0x5d, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x69, 0x73, 0x74, 0x20, 0x3d, 0x20, 0x73, 0x71, 
+0x72, 0x74, 0x28, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 
+0x72, 0x20, 0x3d, 0x3d, 0x20, 0x30, 0x20, 0x7c, 0x7c, 0x20, 0x64, 0x69, 0x73, 0x74, 0x20, 
+0x3d, 0x3d, 0x20, 0x30, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x64, 0x69, 0x72, 0x20, 0x3d, 0x20, 0x52, 0x61, 0x6e, 0x64, 0x6f, 
+0x6d, 0x44, 0x69, 0x72, 0x65, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x28, 0x28, 0x66, 0x6c, 0x6f, 
+0x61, 0x74, 0x29, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x64, 0x65, 
+0x78, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x70, 0x72, 0x69, 0x6e, 0x74, 
+0x66, 0x28, 0x22, 0x54, 0x77, 0x6f, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x20, 
+0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x20, 0x68, 0x61, 0x76, 0x65, 0x20, 
+0x74, 0x68, 0x65, 0x20, 0x73, 0x61, 0x6d, 0x65, 0x20, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 
+0x6f, 0x6e, 0x2e, 0x20, 0x53, 0x69, 0x6d, 0x75, 0x6c, 0x61, 0x74, 0x69, 0x6f, 0x6e, 0x20, 
+0x77, 0x6f, 0x6e, 0x74, 0x20, 0x62, 0x65, 0x20, 0x64, 0x65, 0x74, 0x65, 0x72, 0x6d, 0x69, 
+0x6e, 0x69, 0x73, 0x74, 0x69, 0x63, 0x2e, 0x20, 0x69, 0x31, 0x3a, 0x20, 0x25, 0x75, 0x3b, 
+0x20, 0x69, 0x32, 0x3a, 0x20, 0x25, 0x75, 0x22, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x2c, 0x20, 0x69, 0x6e, 0x64, 0x65, 0x78, 
+0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x65, 0x6c, 0x73, 0x65, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x64, 0x69, 0x72, 0x20, 
+0x2f, 0x3d, 0x20, 0x64, 0x69, 0x73, 0x74, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x2f, 0x2f, 0x42, 0x6f, 0x74, 0x68, 0x20, 0x66, 0x6f, 0x72, 0x63, 0x65, 0x73, 0x20, 
+0x61, 0x72, 0x65, 0x20, 0x61, 0x6e, 0x74, 0x69, 0x73, 0x79, 0x6d, 0x6d, 0x65, 0x74, 0x72, 
+0x69, 0x63, 0x2c, 0x20, 0x74, 0x68, 0x65, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x20, 0x70, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x20, 0x67, 0x65, 0x74, 0x73, 0x20, 0x74, 0x68, 
+0x65, 0x20, 0x6e, 0x65, 0x67, 0x61, 0x74, 0x65, 0x64, 0x20, 0x66, 0x6f, 0x72, 0x63, 0x65, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x70, 0x72, 0x65, 
+0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x3d, 0x20, 0x64, 0x69, 
+0x72, 0x20, 0x2a, 0x20, 0x28, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 
+0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x20, 0x2b, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 
+0x29, 0x20, 0x2a, 0x20, 0x53, 0x6d, 0x6f, 0x6f, 0x74, 0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 
+0x72, 0x6e, 0x65, 0x6c, 0x44, 0x31, 0x28, 0x64, 0x69, 0x73, 0x74, 0x2c, 0x20, 0x70, 0x61, 
+0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 
+0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 
+0x63, 0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 
+0x20, 0x76, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 
+0x20, 0x3d, 0x20, 0x28, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x56, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x20, 0x2d, 0x20, 0x70, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x29, 
+0x20, 0x2a, 0x20, 0x53, 0x6d, 0x6f, 0x6f, 0x74, 0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 
+0x6e, 0x65, 0x6c, 0x44, 0x32, 0x28, 0x64, 0x69, 0x73, 0x74, 0x2c, 0x20, 0x70, 0x61, 0x72, 
+0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 
+0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 
+0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x70, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 
+0x63, 0x65, 0x20, 0x2b, 0x3d, 0x20, 0x70, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 
+0x6f, 0x72, 0x63, 0x65, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x70, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 
+0x72, 0x63, 0x65, 0x20, 0x2b, 0x3d, 0x20, 0x76, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 
+0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x66, 0x6c, 0x6f, 0x61, 0x74, 0x2a, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x73, 0x3b, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x69, 0x20, 0x3c, 0x20, 0x73, 0x75, 0x6d, 0x73, 
+0x2e, 0x72, 0x61, 0x6e, 0x67, 0x65, 0x45, 0x6e, 0x64, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x46, 0x6f, 0x72, 0x63, 0x65, 0x73, 0x20, 0x3d, 0x20, 0x73, 0x75, 0x6d, 0x73, 0x2e, 0x66, 
+0x6f, 0x72, 0x63, 0x65, 0x73, 0x20, 0x2b, 0x20, 0x69, 0x20, 0x2a, 0x20, 0x36, 0x3b, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x09, 0x65, 0x6c, 0x73, 0x65, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x73, 0x75, 0x6d, 0x73, 0x2e, 0x63, 0x6f, 
+0x6e, 0x74, 0x72, 0x69, 0x62, 0x75, 0x74, 0x69, 0x6f, 0x6e, 0x49, 0x6e, 0x64, 0x69, 0x63, 
+0x65, 0x73, 0x5b, 0x73, 0x75, 0x6d, 0x73, 0x2e, 0x63, 0x6f, 0x6e, 0x74, 0x72, 0x69, 0x62, 
+0x75, 0x74, 0x69, 0x6f, 0x6e, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x5d, 0x20, 0x3d, 0x20, 0x69, 
+0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x73, 0x20, 0x3d, 0x20, 
+0x73, 0x75, 0x6d, 0x73, 0x2e, 0x63, 0x6f, 0x6e, 0x74, 0x72, 0x69, 0x62, 0x75, 0x74, 0x69, 
+0x6f, 0x6e, 0x56, 0x61, 0x6c, 0x75, 0x65, 0x73, 0x20, 0x2b, 0x20, 0x73, 0x75, 0x6d, 0x73, 
+0x2e, 0x63, 0x6f, 0x6e, 0x74, 0x72, 0x69, 0x62, 0x75, 0x74, 0x69, 0x6f, 0x6e, 0x43, 0x6f, 
+0x75, 0x6e, 0x74, 0x20, 0x2a, 0x20, 0x36, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x73, 0x74, 0x64, 0x3a, 0x3a, 0x66, 0x69, 0x6c, 0x6c, 0x5f, 0x6e, 0x28, 0x6f, 0x74, 0x68, 
+0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 
+0x73, 0x2c, 0x20, 0x36, 0x2c, 0x20, 0x30, 0x2e, 0x30, 0x66, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x2b, 0x2b, 0x73, 0x75, 0x6d, 0x73, 0x2e, 0x63, 0x6f, 0x6e, 0x74, 
+0x72, 0x69, 0x62, 0x75, 0x74, 0x69, 0x6f, 0x6e, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x3b, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x6f, 
+0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x46, 0x6f, 0x72, 
+0x63, 0x65, 0x73, 0x5b, 0x30, 0x5d, 0x20, 0x2d, 0x3d, 0x20, 0x70, 0x72, 0x65, 0x73, 0x73, 
+0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x2e, 0x78, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x09, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x46, 0x6f, 0x72, 0x63, 0x65, 0x73, 0x5b, 0x31, 0x5d, 0x20, 0x2d, 0x3d, 0x20, 0x70, 0x72, 
+0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x2e, 0x79, 0x3b, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x09, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x73, 0x5b, 0x32, 0x5d, 0x20, 0x2d, 0x3d, 
+0x20, 0x70, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x2e, 
+0x7a, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x73, 0x5b, 0x33, 0x5d, 
+0x20, 0x2d, 0x3d, 0x20, 0x76, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 
+0x72, 0x63, 0x65, 0x2e, 0x78, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x6f, 0x74, 0x68, 
+0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 
+0x73, 0x5b, 0x34, 0x5d, 0x20, 0x2d, 0x3d, 0x20, 0x76, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 
+0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x2e, 0x79, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x46, 
+0x6f, 0x72, 0x63, 0x65, 0x73, 0x5b, 0x35, 0x5d, 0x20, 0x2d, 0x3d, 0x20, 0x76, 0x69, 0x73, 
+0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x2e, 0x7a, 0x3b, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 
+0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x73, 0x20, 0x3d, 0x20, 0x73, 0x75, 0x6d, 0x73, 0x2e, 
+0x66, 0x6f, 0x72, 0x63, 0x65, 0x73, 0x20, 0x2b, 0x20, 0x73, 0x6f, 0x72, 0x74, 0x65, 0x64, 
+0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x2a, 0x20, 0x36, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x70, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x73, 0x5b, 0x30, 
+0x5d, 0x20, 0x2b, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 
+0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x2e, 0x78, 0x3b, 0x0d, 
+0x0a, 0x09, 0x09, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x46, 0x6f, 0x72, 0x63, 
+0x65, 0x73, 0x5b, 0x31, 0x5d, 0x20, 0x2b, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 
+0x2e, 0x79, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x46, 0x6f, 0x72, 0x63, 0x65, 0x73, 0x5b, 0x32, 0x5d, 0x20, 0x2b, 0x3d, 0x20, 0x70, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 
+0x6f, 0x72, 0x63, 0x65, 0x2e, 0x7a, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x70, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x73, 0x5b, 0x33, 0x5d, 0x20, 0x2b, 
+0x3d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 
+0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x2e, 0x78, 0x3b, 0x0d, 0x0a, 0x09, 
+0x09, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x73, 
+0x5b, 0x34, 0x5d, 0x20, 0x2b, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x2e, 
+0x79, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x46, 
+0x6f, 0x72, 0x63, 0x65, 0x73, 0x5b, 0x35, 0x5d, 0x20, 0x2b, 0x3d, 0x20, 0x70, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 
+0x6f, 0x72, 0x63, 0x65, 0x2e, 0x7a, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x72, 0x65, 
+0x74, 0x75, 0x72, 0x6e, 0x20, 0x74, 0x72, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 
+0x0a, 0x0d, 0x0a, 0x09, 0x76, 0x6f, 0x69, 0x64, 0x20, 0x55, 0x70, 0x64, 0x61, 0x74, 0x65, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 
+0x73, 0x46, 0x72, 0x6f, 0x6d, 0x50, 0x61, 0x69, 0x72, 0x73, 0x28, 0x0d, 0x0a, 0x09, 0x09, 
+0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x73, 0x6f, 0x72, 0x74, 0x65, 0x64, 0x49, 0x6e, 
+0x64, 0x65, 0x78, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 
+0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x0d, 0x0a, 
+0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x2c, 
+0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x73, 0x74, 0x61, 0x74, 
+0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 
+0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x44, 0x79, 0x6e, 
+0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x53, 0x74, 0x72, 
+0x65, 0x61, 0x6d, 0x73, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x53, 0x74, 0x72, 0x65, 0x61, 0x6d, 0x73, 0x20, 0x6f, 
+0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 
+0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x2a, 0x20, 
+0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x70, 0x2c, 0x0d, 0x0a, 0x09, 
+0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x53, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x2a, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 
+0x6e, 0x73, 0x74, 0x20, 0x48, 0x41, 0x53, 0x48, 0x5f, 0x54, 0x59, 0x50, 0x45, 0x2a, 0x20, 
+0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 
+0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 
+0x73, 0x74, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x65, 0x6c, 0x74, 0x61, 0x54, 
+0x69, 0x6d, 0x65, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x42, 0x65, 0x68, 0x61, 0x76, 0x69, 0x6f, 0x75, 
+0x72, 0x50, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2a, 0x20, 0x70, 0x61, 
+0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 
+0x6e, 0x73, 0x74, 0x20, 0x50, 0x61, 0x69, 0x72, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 
+0x74, 0x69, 0x6f, 0x6e, 0x53, 0x75, 0x6d, 0x73, 0x26, 0x20, 0x73, 0x75, 0x6d, 0x73, 0x2c, 
+0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x74, 0x72, 0x69, 0x61, 
+0x6e, 0x67, 0x6c, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 
+0x6f, 0x6e, 0x73, 0x74, 0x20, 0x54, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x2a, 0x20, 
+0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x75, 
+0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x48, 
+0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 
+0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x2a, 0x20, 0x74, 
+0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 
+0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x33, 
+0x32, 0x2a, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x4d, 0x61, 0x70, 0x0d, 
+0x0a, 0x09, 0x29, 0x20, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 
+0x20, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x20, 0x3d, 0x20, 0x70, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x70, 0x5b, 0x73, 0x6f, 0x72, 0x74, 0x65, 0x64, 
+0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 
+0x6f, 0x6e, 0x53, 0x75, 0x6d, 0x73, 0x20, 0x69, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 
+0x69, 0x6f, 0x6e, 0x53, 0x75, 0x6d, 0x73, 0x20, 0x3d, 0x20, 0x7b, 0x20, 0x7d, 0x3b, 0x0d, 
+0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x66, 0x6c, 0x6f, 0x61, 
+0x74, 0x2a, 0x20, 0x66, 0x6f, 0x72, 0x63, 0x65, 0x73, 0x20, 0x3d, 0x20, 0x73, 0x75, 0x6d, 
+0x73, 0x2e, 0x66, 0x6f, 0x72, 0x63, 0x65, 0x73, 0x20, 0x2b, 0x20, 0x73, 0x6f, 0x72, 0x74, 
+0x65, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x2a, 0x20, 0x36, 0x3b, 0x0d, 0x0a, 0x09, 
+0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x6a, 0x20, 
+0x3d, 0x20, 0x30, 0x3b, 0x20, 0x6a, 0x20, 0x3c, 0x20, 0x33, 0x3b, 0x20, 0x2b, 0x2b, 0x6a, 
+0x29, 0x0d, 0x0a, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x69, 0x6e, 0x74, 0x65, 
+0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x53, 0x75, 0x6d, 0x73, 0x2e, 0x64, 0x79, 0x6e, 
+0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 
+0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x5b, 0x6a, 0x5d, 0x20, 0x3d, 
+0x20, 0x66, 0x6f, 0x72, 0x63, 0x65, 0x73, 0x5b, 0x6a, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x69, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x53, 0x75, 0x6d, 
+0x73, 0x2e, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 
+0x65, 0x5b, 0x6a, 0x5d, 0x20, 0x3d, 0x20, 0x66, 0x6f, 0x72, 0x63, 0x65, 0x73, 0x5b, 0x33, 
+0x20, 0x2b, 0x20, 0x6a, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 
+0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x20, 0x21, 0x3d, 0x20, 
+0x30, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 
+0x33, 0x66, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 
+0x74, 0x69, 0x6f, 0x6e, 0x20, 0x3d, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x28, 0x69, 0x6e, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 
+0x69, 0x6f, 0x6e, 0x58, 0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 0x2c, 
+0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 
+0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x59, 0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 
+0x44, 0x5d, 0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 
+0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x5a, 0x5b, 0x74, 0x68, 0x72, 0x65, 
+0x61, 0x64, 0x49, 0x44, 0x5d, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x66, 0x6c, 0x6f, 
+0x61, 0x74, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 
+0x73, 0x75, 0x72, 0x65, 0x20, 0x3d, 0x20, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x5b, 0x74, 
+0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x56, 
+0x65, 0x63, 0x33, 0x66, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x65, 
+0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x20, 0x3d, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x28, 
+0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x76, 0x65, 0x6c, 
+0x6f, 0x63, 0x69, 0x74, 0x79, 0x58, 0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 
+0x5d, 0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 
+0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x59, 0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 
+0x64, 0x49, 0x44, 0x5d, 0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x73, 0x2e, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x5a, 0x5b, 0x74, 0x68, 
+0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 
+0x6f, 0x72, 0x63, 0x65, 0x20, 0x3d, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x28, 0x30, 0x2e, 
+0x30, 0x66, 0x2c, 0x20, 0x30, 0x2e, 0x30, 0x66, 0x2c, 0x20, 0x30, 0x2e, 0x30, 0x66, 0x29, 
+0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x73, 0x74, 0x61, 
+0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 
+0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x3d, 0x20, 0x56, 0x65, 
+0x63, 0x33, 0x66, 0x28, 0x30, 0x2e, 0x30, 0x66, 0x2c, 0x20, 0x30, 0x2e, 0x30, 0x66, 0x2c, 
+0x20, 0x30, 0x2e, 0x30, 0x66, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x75, 
+0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x5b, 0x32, 
+0x37, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 
+0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x20, 0x3d, 0x20, 0x47, 
+0x65, 0x74, 0x4e, 0x65, 0x69, 0x67, 0x68, 0x62, 0x6f, 0x75, 0x72, 0x43, 0x65, 0x6c, 0x6c, 
+0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x28, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x2e, 0x78, 0x2c, 0x20, 0x70, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x2e, 
+0x79, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 
+0x74, 0x69, 0x6f, 0x6e, 0x2e, 0x7a, 0x2c, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 
+0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 
+0x73, 0x2c, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 
+0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 
+0x30, 0x3b, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 
+0x3c, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x3b, 0x20, 
+0x2b, 0x2b, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x29, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 
+0x33, 0x32, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 
+0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x5b, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 
+0x73, 0x5b, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x5d, 
+0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x65, 
+0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 
+0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 
+0x61, 0x70, 0x5b, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x5b, 0x62, 0x75, 0x63, 0x6b, 
+0x65, 0x74, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x20, 0x2b, 0x20, 0x31, 0x5d, 0x3b, 0x0d, 
+0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x75, 0x69, 0x6e, 
+0x74, 0x33, 0x32, 0x20, 0x69, 0x20, 0x3d, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 0x6e, 
+0x64, 0x65, 0x78, 0x3b, 0x20, 0x69, 0x20, 0x3c, 0x20, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 
+0x65, 0x78, 0x3b, 0x20, 0x2b, 0x2b, 0x69, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x7b, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x64, 0x69, 
+0x72, 0x20, 0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x73, 0x5b, 0x69, 0x5d, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 
+0x6e, 0x41, 0x6e, 0x64, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x2e, 0x78, 0x79, 
+0x7a, 0x28, 0x29, 0x20, 0x2d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 
+0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x20, 0x3d, 
+0x20, 0x64, 0x6f, 0x74, 0x28, 0x64, 0x69, 0x72, 0x2c, 0x20, 0x64, 0x69, 0x72, 0x29, 0x3b, 
+0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x64, 0x69, 
+0x73, 0x74, 0x53, 0x71, 0x72, 0x20, 0x3e, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 
+0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 
+0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x20, 0x2a, 0x20, 
+0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 
+0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 
+0x61, 0x6e, 0x63, 0x65, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x63, 0x6f, 
+0x6e, 0x74, 0x69, 0x6e, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x69, 0x73, 0x74, 0x20, 0x3d, 0x20, 0x73, 
+0x71, 0x72, 0x74, 0x28, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x29, 0x3b, 0x0d, 0x0a, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x64, 0x69, 0x73, 0x74, 
+0x53, 0x71, 0x72, 0x20, 0x3d, 0x3d, 0x20, 0x30, 0x20, 0x7c, 0x7c, 0x20, 0x64, 0x69, 0x73, 
+0x74, 0x20, 0x3d, 0x3d, 0x20, 0x30, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7b, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x64, 0x69, 0x72, 0x20, 0x3d, 0x20, 0x52, 
+0x61, 0x6e, 0x64, 0x6f, 0x6d, 0x44, 0x69, 0x72, 0x65, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x28, 
+0x28, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x29, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 
+0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x70, 0x72, 0x69, 0x6e, 0x74, 
+0x66, 0x28, 0x22, 0x41, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x20, 0x70, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x20, 0x61, 0x6e, 0x64, 0x20, 0x61, 0x20, 0x73, 0x74, 
+0x61, 0x74, 0x69, 0x63, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x20, 0x68, 
+0x61, 0x76, 0x65, 0x20, 0x74, 0x68, 0x65, 0x20, 0x73, 0x61, 0x6d, 0x65, 0x20, 0x70, 0x6f, 
+0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x2e, 0x20, 0x53, 0x69, 0x6d, 0x75, 0x6c, 0x61, 0x74, 
+0x69, 0x6f, 0x6e, 0x20, 0x77, 0x6f, 0x6e, 0x74, 0x20, 0x62, 0x65, 0x20, 0x64, 0x65, 0x74, 
+0x65, 0x72, 0x6d, 0x69, 0x6e, 0x69, 0x73, 0x74, 0x69, 0x63, 0x2e, 0x20, 0x69, 0x31, 0x3a, 
+0x20, 0x25, 0x75, 0x3b, 0x20, 0x69, 0x32, 0x3a, 0x20, 0x25, 0x75, 0x22, 0x2c, 0x20, 0x28, 
+0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x29, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 
+0x2c, 0x20, 0x69, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x65, 0x6c, 0x73, 0x65, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x64, 0x69, 0x72, 0x20, 0x2f, 0x3d, 0x20, 0x64, 0x69, 0x73, 0x74, 0x3b, 0x0d, 
+0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x2f, 0x2f, 0x61, 0x70, 0x70, 0x6c, 0x79, 
+0x20, 0x70, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x20, 0x66, 0x6f, 0x72, 0x63, 0x65, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 
+0x6f, 0x72, 0x63, 0x65, 0x20, 0x2b, 0x3d, 0x20, 0x64, 0x69, 0x72, 0x20, 0x2a, 0x20, 0x66, 
+0x61, 0x62, 0x73, 0x28, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 
+0x73, 0x73, 0x75, 0x72, 0x65, 0x29, 0x20, 0x2a, 0x20, 0x53, 0x6d, 0x6f, 0x6f, 0x74, 0x68, 
+0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x44, 0x31, 0x28, 0x64, 0x69, 0x73, 
+0x74, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 
+0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 
+0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x2f, 0x2f, 0x61, 0x70, 0x70, 0x6c, 0x79, 0x20, 0x76, 0x69, 0x73, 0x63, 
+0x6f, 0x73, 0x69, 0x74, 0x79, 0x20, 0x66, 0x6f, 0x72, 0x63, 0x65, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 
+0x65, 0x20, 0x2b, 0x3d, 0x20, 0x2d, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 
+0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x20, 0x2a, 0x20, 0x53, 0x6d, 0x6f, 0x6f, 0x74, 
+0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x44, 0x32, 0x28, 0x64, 0x69, 
+0x73, 0x74, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 
+0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 
+0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x69, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x53, 0x75, 0x6d, 0x73, 
+0x2e, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x5b, 0x30, 
+0x5d, 0x20, 0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 
+0x65, 0x2e, 0x78, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x69, 0x6e, 0x74, 0x65, 0x72, 0x61, 
+0x63, 0x74, 0x69, 0x6f, 0x6e, 0x53, 0x75, 0x6d, 0x73, 0x2e, 0x73, 0x74, 0x61, 0x74, 0x69, 
+0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 
+0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x5b, 0x31, 0x5d, 0x20, 0x3d, 0x20, 0x73, 0x74, 
+0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 
+0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x2e, 0x79, 0x3b, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x69, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x53, 
+0x75, 0x6d, 0x73, 0x2e, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 
+0x65, 0x5b, 0x32, 0x5d, 0x20, 0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 
+0x6f, 0x72, 0x63, 0x65, 0x2e, 0x7a, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x69, 0x6e, 0x74, 
+0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x53, 0x75, 0x6d, 0x73, 0x2e, 0x73, 0x74, 
+0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 
+0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x5b, 0x30, 0x5d, 0x20, 
+0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 
+0x2e, 0x78, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x69, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 
+0x74, 0x69, 0x6f, 0x6e, 0x53, 0x75, 0x6d, 0x73, 0x2e, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 
+0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x5b, 0x31, 0x5d, 0x20, 0x3d, 0x20, 0x73, 0x74, 
+0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 
+0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x2e, 0x79, 0x3b, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x69, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 
+0x53, 0x75, 0x6d, 0x73, 0x2e, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 
+0x72, 0x63, 0x65, 0x5b, 0x32, 0x5d, 0x20, 0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 
+0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x2e, 0x7a, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x7d, 
+0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x49, 0x6e, 0x74, 0x65, 0x67, 0x72, 0x61, 0x74, 0x65, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x28, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 
+0x49, 0x44, 0x2c, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 
+0x65, 0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 
+0x20, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x20, 
+0x69, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x53, 0x75, 0x6d, 0x73, 
+0x2c, 0x20, 0x64, 0x65, 0x6c, 0x74, 0x61, 0x54, 0x69, 0x6d, 0x65, 0x2c, 0x20, 0x70, 0x61, 
+0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2c, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 
+0x67, 0x6c, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x2c, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 
+0x67, 0x6c, 0x65, 0x73, 0x2c, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x48, 
+0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x74, 0x72, 0x69, 
+0x61, 0x6e, 0x67, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 0x20, 0x74, 
+0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x4d, 0x61, 0x70, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 
+0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x47, 0x65, 
+0x74, 0x55, 0x6e, 0x69, 0x71, 0x75, 0x65, 0x43, 0x65, 0x6c, 0x6c, 0x42, 0x75, 0x63, 0x6b, 
+0x65, 0x74, 0x73, 0x49, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x28, 0x66, 
+0x6c, 0x6f, 0x61, 0x74, 0x20, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x58, 0x2c, 
+0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 
+0x59, 0x2c, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 
+0x6f, 0x6e, 0x5a, 0x2c, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x69, 0x73, 0x74, 
+0x61, 0x6e, 0x63, 0x65, 0x2c, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x68, 0x61, 
+0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x63, 0x6f, 0x6e, 0x73, 
+0x74, 0x20, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x42, 0x65, 0x68, 0x61, 0x76, 
+0x69, 0x6f, 0x75, 0x72, 0x50, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2a, 
+0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2c, 0x20, 0x75, 0x69, 
+0x6e, 0x74, 0x33, 0x32, 0x2a, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x29, 0x0d, 
+0x0a, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x70, 0x6f, 
+0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x3d, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x28, 
+0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x58, 0x2c, 0x20, 0x70, 0x6f, 0x73, 0x69, 
+0x74, 0x69, 0x6f, 0x6e, 0x59, 0x2c, 0x20, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 
+0x5a, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x75, 0x20, 
+0x62, 0x65, 0x67, 0x69, 0x6e, 0x43, 0x65, 0x6c, 0x6c, 0x20, 0x3d, 0x20, 0x47, 0x65, 0x74, 
+0x43, 0x65, 0x6c, 0x6c, 0x28, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x2d, 
+0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x28, 0x64, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 
+0x2c, 0x20, 0x64, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x2c, 0x20, 0x64, 0x69, 0x73, 
+0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 
+0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 
+0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x3b, 0x0d, 
+0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x75, 0x20, 0x65, 0x6e, 0x64, 0x43, 0x65, 0x6c, 
+0x6c, 0x20, 0x3d, 0x20, 0x47, 0x65, 0x74, 0x43, 0x65, 0x6c, 0x6c, 0x28, 0x70, 0x6f, 0x73, 
+0x69, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x2b, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x28, 0x64, 
+0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x2c, 0x20, 0x64, 0x69, 0x73, 0x74, 0x61, 0x6e, 
+0x63, 0x65, 0x2c, 0x20, 0x64, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x2c, 0x20, 
+0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 
+0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 
+0x61, 0x6e, 0x63, 0x65, 0x29, 0x20, 0x2b, 0x20, 0x56, 0x65, 0x63, 0x33, 0x75, 0x28, 0x31, 
+0x2c, 0x20, 0x31, 0x2c, 0x20, 0x31, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x2f, 
+0x2f, 0x54, 0x68, 0x65, 0x20, 0x64, 0x69, 0x66, 0x66, 0x65, 0x72, 0x65, 0x6e, 0x63, 0x65, 
+0x73, 0x20, 0x61, 0x72, 0x65, 0x20, 0x75, 0x6e, 0x73, 0x69, 0x67, 0x6e, 0x65, 0x64, 0x20, 
+0x73, 0x6f, 0x20, 0x74, 0x68, 0x61, 0x74, 0x20, 0x63, 0x65, 0x6c, 0x6c, 0x73, 0x20, 0x77, 
+0x72, 0x61, 0x70, 0x70, 0x69, 0x6e, 0x67, 0x20, 0x61, 0x72, 0x6f, 0x75, 0x6e, 0x64, 0x20, 
+0x30, 0x20, 0x61, 0x72, 0x65, 0x20, 0x68, 0x61, 0x6e, 0x64, 0x6c, 0x65, 0x64, 0x20, 0x74, 
+0x6f, 0x6f, 0x0d, 0x0a, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x65, 0x6e, 0x64, 0x43, 0x65, 
+0x6c, 0x6c, 0x2e, 0x78, 0x20, 0x2d, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x43, 0x65, 0x6c, 
+0x6c, 0x2e, 0x78, 0x20, 0x3e, 0x20, 0x4d, 0x61, 0x78, 0x43, 0x65, 0x6c, 0x6c, 0x73, 0x50, 
+0x65, 0x72, 0x41, 0x78, 0x69, 0x73, 0x49, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 
+0x65, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x65, 0x6e, 0x64, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 
+0x78, 0x20, 0x3d, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x78, 
+0x20, 0x2b, 0x20, 0x4d, 0x61, 0x78, 0x43, 0x65, 0x6c, 0x6c, 0x73, 0x50, 0x65, 0x72, 0x41, 
+0x78, 0x69, 0x73, 0x49, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x3b, 0x0d, 
+0x0a, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x65, 0x6e, 0x64, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 
+0x79, 0x20, 0x2d, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x79, 
+0x20, 0x3e, 0x20, 0x4d, 0x61, 0x78, 0x43, 0x65, 0x6c, 0x6c, 0x73, 0x50, 0x65, 0x72, 0x41, 
+0x78, 0x69, 0x73, 0x49, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x65, 0x6e, 0x64, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x79, 0x20, 0x3d, 
+0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x79, 0x20, 0x2b, 0x20, 
+0x4d, 0x61, 0x78, 0x43, 0x65, 0x6c, 0x6c, 0x73, 0x50, 0x65, 0x72, 0x41, 0x78, 0x69, 0x73, 
+0x49, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x69, 0x66, 0x20, 0x28, 0x65, 0x6e, 0x64, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x7a, 0x20, 0x2d, 
+0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x7a, 0x20, 0x3e, 0x20, 
+0x4d, 0x61, 0x78, 0x43, 0x65, 0x6c, 0x6c, 0x73, 0x50, 0x65, 0x72, 0x41, 0x78, 0x69, 0x73, 
+0x49, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x65, 0x6e, 0x64, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x7a, 0x20, 0x3d, 0x20, 0x62, 0x65, 
+0x67, 0x69, 0x6e, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x7a, 0x20, 0x2b, 0x20, 0x4d, 0x61, 0x78, 
+0x43, 0x65, 0x6c, 0x6c, 0x73, 0x50, 0x65, 0x72, 0x41, 0x78, 0x69, 0x73, 0x49, 0x6e, 0x44, 
+0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x75, 
+0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x43, 0x6f, 0x75, 
+0x6e, 0x74, 0x20, 0x3d, 0x20, 0x30, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x62, 0x6f, 0x6f, 0x6c, 
+0x20, 0x6f, 0x75, 0x74, 0x73, 0x69, 0x64, 0x65, 0x47, 0x72, 0x69, 0x64, 0x42, 0x75, 0x63, 
+0x6b, 0x65, 0x74, 0x56, 0x69, 0x73, 0x69, 0x74, 0x65, 0x64, 0x20, 0x3d, 0x20, 0x66, 0x61, 
+0x6c, 0x73, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x75, 
+0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x66, 0x6f, 0x72, 0x20, 0x28, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 
+0x78, 0x20, 0x3d, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x78, 
+0x3b, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x78, 0x20, 0x21, 
+0x3d, 0x20, 0x65, 0x6e, 0x64, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x78, 0x3b, 0x20, 0x2b, 0x2b, 
+0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x78, 0x29, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 
+0x6c, 0x2e, 0x79, 0x20, 0x3d, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x43, 0x65, 0x6c, 0x6c, 
+0x2e, 0x79, 0x3b, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x79, 
+0x20, 0x21, 0x3d, 0x20, 0x65, 0x6e, 0x64, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x79, 0x3b, 0x20, 
+0x2b, 0x2b, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x79, 0x29, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x6f, 0x74, 0x68, 0x65, 0x72, 
+0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x7a, 0x20, 0x3d, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x43, 
+0x65, 0x6c, 0x6c, 0x2e, 0x7a, 0x3b, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 
+0x6c, 0x2e, 0x7a, 0x20, 0x21, 0x3d, 0x20, 0x65, 0x6e, 0x64, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 
+0x7a, 0x3b, 0x20, 0x2b, 0x2b, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 
+0x7a, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x20, 
+0x3d, 0x20, 0x47, 0x65, 0x74, 0x43, 0x65, 0x6c, 0x6c, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 
+0x28, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2c, 0x20, 0x68, 0x61, 0x73, 
+0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 
+0x65, 0x74, 0x65, 0x72, 0x73, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x69, 0x66, 0x20, 0x28, 0x49, 0x73, 0x4f, 0x75, 0x74, 0x73, 0x69, 0x64, 0x65, 0x47, 
+0x72, 0x69, 0x64, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x28, 0x62, 0x75, 0x63, 0x6b, 0x65, 
+0x74, 0x2c, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 
+0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x29, 0x29, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 
+0x66, 0x20, 0x28, 0x6f, 0x75, 0x74, 0x73, 0x69, 0x64, 0x65, 0x47, 0x72, 0x69, 0x64, 0x42, 
+0x75, 0x63, 0x6b, 0x65, 0x74, 0x56, 0x69, 0x73, 0x69, 0x74, 0x65, 0x64, 0x29, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x74, 0x69, 0x6e, 0x75, 0x65, 
+0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x6f, 0x75, 0x74, 0x73, 
+0x69, 0x64, 0x65, 0x47, 0x72, 0x69, 0x64, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x56, 0x69, 
+0x73, 0x69, 0x74, 0x65, 0x64, 0x20, 0x3d, 0x20, 0x74, 0x72, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x5b, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x43, 
+0x6f, 0x75, 0x6e, 0x74, 0x2b, 0x2b, 0x5d, 0x20, 0x3d, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 
+0x74, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 
+0x69, 0x66, 0x20, 0x28, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 
+0x3e, 0x67, 0x72, 0x69, 0x64, 0x53, 0x69, 0x7a, 0x65, 0x58, 0x20, 0x21, 0x3d, 0x20, 0x30, 
+0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x62, 0x75, 
+0x63, 0x6b, 0x65, 0x74, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 
+0x09, 0x73, 0x74, 0x64, 0x3a, 0x3a, 0x73, 0x6f, 0x72, 0x74, 0x28, 0x62, 0x75, 0x63, 0x6b, 
+0x65, 0x74, 0x73, 0x2c, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x20, 0x2b, 0x20, 
+0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x29, 0x3b, 0x0d, 0x0a, 
+0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 
+0x32, 0x29, 0x28, 0x73, 0x74, 0x64, 0x3a, 0x3a, 0x75, 0x6e, 0x69, 0x71, 0x75, 0x65, 0x28, 
+0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x2c, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 
+0x73, 0x20, 0x2b, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x43, 0x6f, 0x75, 0x6e, 0x74, 
+0x29, 0x20, 0x2d, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x29, 0x3b, 0x0d, 0x0a, 
+0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x76, 0x6f, 0x69, 0x64, 0x20, 0x55, 0x70, 0x64, 
+0x61, 0x74, 0x65, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 
+0x73, 0x75, 0x72, 0x65, 0x46, 0x72, 0x6f, 0x6d, 0x4c, 0x69, 0x73, 0x74, 0x28, 0x0d, 0x0a, 
+0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 
+0x49, 0x44, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x53, 0x74, 0x72, 0x65, 0x61, 0x6d, 0x73, 0x20, 
+0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 
+0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x2a, 0x20, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x73, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x2c, 0x0d, 
+0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x53, 0x74, 0x61, 0x74, 0x69, 0x63, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x2a, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 
+0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 
+0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x42, 
+0x65, 0x68, 0x61, 0x76, 0x69, 0x6f, 0x75, 0x72, 0x50, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 
+0x65, 0x72, 0x73, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 
+0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x75, 0x69, 0x6e, 0x74, 
+0x33, 0x32, 0x2a, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x4e, 0x65, 0x69, 0x67, 
+0x68, 0x62, 0x6f, 0x75, 0x72, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 
+0x33, 0x32, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x4e, 0x65, 0x69, 0x67, 0x68, 
+0x62, 0x6f, 0x75, 0x72, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 
+0x6f, 0x6e, 0x73, 0x74, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x2a, 0x20, 0x73, 0x74, 
+0x61, 0x74, 0x69, 0x63, 0x4e, 0x65, 0x69, 0x67, 0x68, 0x62, 0x6f, 0x75, 0x72, 0x73, 0x2c, 
+0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x73, 0x74, 0x61, 0x74, 
+0x69, 0x63, 0x4e, 0x65, 0x69, 0x67, 0x68, 0x62, 0x6f, 0x75, 0x72, 0x43, 0x6f, 0x75, 0x6e, 
+0x74, 0x0d, 0x0a, 0x09, 0x29, 0x20, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 
+0x66, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 
+0x69, 0x6f, 0x6e, 0x20, 0x3d, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x28, 0x69, 0x6e, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 
+0x6f, 0x6e, 0x58, 0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 0x2c, 0x20, 
+0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 
+0x69, 0x74, 0x69, 0x6f, 0x6e, 0x59, 0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 
+0x5d, 0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 
+0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x5a, 0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 
+0x64, 0x49, 0x44, 0x5d, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6c, 0x6f, 
+0x61, 0x74, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x49, 0x6e, 0x66, 0x6c, 0x75, 0x65, 0x6e, 0x63, 0x65, 0x53, 0x75, 0x6d, 
+0x20, 0x3d, 0x20, 0x30, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 
+0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 
+0x6e, 0x66, 0x6c, 0x75, 0x65, 0x6e, 0x63, 0x65, 0x53, 0x75, 0x6d, 0x20, 0x3d, 0x20, 0x30, 
+0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x2f, 0x2f, 0x54, 0x68, 0x65, 0x20, 0x6c, 0x69, 
+0x73, 0x74, 0x73, 0x20, 0x61, 0x6c, 0x73, 0x6f, 0x20, 0x63, 0x6f, 0x6e, 0x74, 0x61, 0x69, 
+0x6e, 0x20, 0x74, 0x68, 0x65, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 
+0x20, 0x77, 0x69, 0x74, 0x68, 0x69, 0x6e, 0x20, 0x74, 0x68, 0x65, 0x20, 0x73, 0x6b, 0x69, 
+0x6e, 0x20, 0x64, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x2c, 0x20, 0x73, 0x6f, 0x20, 
+0x74, 0x68, 0x65, 0x20, 0x64, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x20, 0x69, 0x73, 
+0x20, 0x73, 0x74, 0x69, 0x6c, 0x6c, 0x20, 0x63, 0x68, 0x65, 0x63, 0x6b, 0x65, 0x64, 0x0d, 
+0x0a, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 
+0x69, 0x20, 0x3d, 0x20, 0x30, 0x3b, 0x20, 0x69, 0x20, 0x3c, 0x20, 0x64, 0x79, 0x6e, 0x61, 
+0x6d, 0x69, 0x63, 0x4e, 0x65, 0x69, 0x67, 0x68, 0x62, 0x6f, 0x75, 0x72, 0x43, 0x6f, 0x75, 
+0x6e, 0x74, 0x3b, 0x20, 0x2b, 0x2b, 0x69, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x69, 0x6e, 0x64, 0x65, 0x78, 
+0x20, 0x3d, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x4e, 0x65, 0x69, 0x67, 0x68, 
+0x62, 0x6f, 0x75, 0x72, 0x73, 0x5b, 0x69, 0x5d, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x64, 0x69, 0x72, 0x20, 0x3d, 0x20, 0x56, 0x65, 
+0x63, 0x33, 0x66, 0x28, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 
+0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x58, 0x5b, 0x69, 0x6e, 0x64, 0x65, 
+0x78, 0x5d, 0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 
+0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x59, 0x5b, 0x69, 0x6e, 0x64, 0x65, 
+0x78, 0x5d, 0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 
+0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x5a, 0x5b, 0x69, 0x6e, 0x64, 0x65, 
+0x78, 0x5d, 0x29, 0x20, 0x2d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 
+0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x66, 0x6c, 
+0x6f, 0x61, 0x74, 0x20, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x20, 0x3d, 0x20, 0x64, 
+0x6f, 0x74, 0x28, 0x64, 0x69, 0x72, 0x2c, 0x20, 0x64, 0x69, 0x72, 0x29, 0x3b, 0x0d, 0x0a, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 
+0x72, 0x20, 0x3e, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 
+0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 
+0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 
+0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 
+0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 
+0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x74, 0x69, 0x6e, 0x75, 0x65, 
+0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 
+0x69, 0x73, 0x74, 0x20, 0x3d, 0x20, 0x73, 0x71, 0x72, 0x74, 0x28, 0x64, 0x69, 0x73, 0x74, 
+0x53, 0x71, 0x72, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x64, 0x79, 0x6e, 
+0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x66, 
+0x6c, 0x75, 0x65, 0x6e, 0x63, 0x65, 0x53, 0x75, 0x6d, 0x20, 0x2b, 0x3d, 0x20, 0x53, 0x6d, 
+0x6f, 0x6f, 0x74, 0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x44, 0x30, 
+0x28, 0x64, 0x69, 0x73, 0x74, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 
+0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 
+0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x3b, 0x0d, 0x0a, 
+0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x75, 
+0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x69, 0x20, 0x3d, 0x20, 0x30, 0x3b, 0x20, 0x69, 0x20, 
+0x3c, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x4e, 0x65, 0x69, 0x67, 0x68, 0x62, 0x6f, 
+0x75, 0x72, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x3b, 0x20, 0x2b, 0x2b, 0x69, 0x29, 0x0d, 0x0a, 
+0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x64, 
+0x69, 0x72, 0x20, 0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x73, 0x5b, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x4e, 0x65, 0x69, 
+0x67, 0x68, 0x62, 0x6f, 0x75, 0x72, 0x73, 0x5b, 0x69, 0x5d, 0x5d, 0x2e, 0x70, 0x6f, 0x73, 
 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x41, 0x6e, 0x64, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 
-0x65, 0x20, 0x3d, 0x20, 0x56, 0x65, 0x63, 0x34, 0x66, 0x28, 0x70, 0x61, 0x72, 0x74, 0x69, 
-0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x2c, 0x20, 0x70, 0x61, 
-0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x29, 
-0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
-0x65, 0x50, 0x74, 0x72, 0x2d, 0x3e, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x41, 
-0x6e, 0x64, 0x48, 0x61, 0x73, 0x68, 0x20, 0x3d, 0x20, 0x56, 0x65, 0x63, 0x34, 0x66, 0x28, 
+0x65, 0x2e, 0x78, 0x79, 0x7a, 0x28, 0x29, 0x20, 0x2d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x3b, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 
+0x20, 0x3d, 0x20, 0x64, 0x6f, 0x74, 0x28, 0x64, 0x69, 0x72, 0x2c, 0x20, 0x64, 0x69, 0x72, 
+0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x64, 0x69, 
+0x73, 0x74, 0x53, 0x71, 0x72, 0x20, 0x3e, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 
+0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 
+0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x20, 0x2a, 0x20, 
+0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 
+0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 
+0x61, 0x6e, 0x63, 0x65, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x74, 
+0x69, 0x6e, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x66, 0x6c, 0x6f, 
+0x61, 0x74, 0x20, 0x64, 0x69, 0x73, 0x74, 0x20, 0x3d, 0x20, 0x73, 0x71, 0x72, 0x74, 0x28, 
+0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x49, 0x6e, 0x66, 0x6c, 0x75, 0x65, 0x6e, 0x63, 0x65, 0x53, 0x75, 0x6d, 0x20, 0x2b, 0x3d, 
+0x20, 0x53, 0x6d, 0x6f, 0x6f, 0x74, 0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 0x6e, 0x65, 
+0x6c, 0x44, 0x30, 0x28, 0x64, 0x69, 0x73, 0x74, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 
+0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 
+0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 
+0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6c, 0x6f, 
+0x61, 0x74, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x44, 0x65, 0x6e, 0x73, 
+0x69, 0x74, 0x79, 0x20, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 
+0x73, 0x2d, 0x3e, 0x73, 0x65, 0x6c, 0x66, 0x44, 0x65, 0x6e, 0x73, 0x69, 0x74, 0x79, 0x20, 
+0x2b, 0x20, 0x28, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x49, 0x6e, 0x66, 0x6c, 0x75, 0x65, 0x6e, 0x63, 0x65, 0x53, 0x75, 0x6d, 
+0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 
+0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x73, 0x73, 0x20, 0x2b, 0x20, 
+0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 
+0x6e, 0x66, 0x6c, 0x75, 0x65, 0x6e, 0x63, 0x65, 0x53, 0x75, 0x6d, 0x20, 0x2a, 0x20, 0x70, 
+0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x70, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x73, 0x73, 0x29, 0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 
+0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x73, 0x6d, 0x6f, 0x6f, 0x74, 0x68, 
+0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x43, 0x6f, 0x6e, 0x73, 0x74, 0x61, 
+0x6e, 0x74, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x70, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x20, 
+0x3d, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x67, 
+0x61, 0x73, 0x43, 0x6f, 0x6e, 0x73, 0x74, 0x61, 0x6e, 0x74, 0x20, 0x2a, 0x20, 0x28, 0x70, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x44, 0x65, 0x6e, 0x73, 0x69, 0x74, 0x79, 0x20, 
+0x2d, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x72, 
+0x65, 0x73, 0x74, 0x44, 0x65, 0x6e, 0x73, 0x69, 0x74, 0x79, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 
+0x0a, 0x09, 0x09, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 
+0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 
+0x49, 0x44, 0x5d, 0x20, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 
+0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 
+0x0a, 0x09, 0x76, 0x6f, 0x69, 0x64, 0x20, 0x55, 0x70, 0x64, 0x61, 0x74, 0x65, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x73, 0x46, 
+0x72, 0x6f, 0x6d, 0x4c, 0x69, 0x73, 0x74, 0x28, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 
+0x74, 0x36, 0x34, 0x20, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x2c, 0x0d, 0x0a, 
+0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 
+0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 
+0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x44, 0x79, 0x6e, 0x61, 
+0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x53, 0x74, 0x72, 0x65, 
+0x61, 0x6d, 0x73, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 
+0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x53, 0x74, 0x72, 0x65, 0x61, 0x6d, 0x73, 0x20, 0x6f, 0x75, 
+0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 
+0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x53, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x2a, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 
+0x73, 0x74, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x65, 0x6c, 0x74, 0x61, 0x54, 
+0x69, 0x6d, 0x65, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x42, 0x65, 0x68, 0x61, 0x76, 0x69, 0x6f, 0x75, 
+0x72, 0x50, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2a, 0x20, 0x70, 0x61, 
+0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 
+0x6e, 0x73, 0x74, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x2a, 0x20, 0x64, 0x79, 0x6e, 
+0x61, 0x6d, 0x69, 0x63, 0x4e, 0x65, 0x69, 0x67, 0x68, 0x62, 0x6f, 0x75, 0x72, 0x73, 0x2c, 
+0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x64, 0x79, 0x6e, 0x61, 
+0x6d, 0x69, 0x63, 0x4e, 0x65, 0x69, 0x67, 0x68, 0x62, 0x6f, 0x75, 0x72, 0x43, 0x6f, 0x75, 
+0x6e, 0x74, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x75, 0x69, 
+0x6e, 0x74, 0x33, 0x32, 0x2a, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x4e, 0x65, 0x69, 
+0x67, 0x68, 0x62, 0x6f, 0x75, 0x72, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 
+0x74, 0x33, 0x32, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x4e, 0x65, 0x69, 0x67, 0x68, 
+0x62, 0x6f, 0x75, 0x72, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x75, 
+0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x43, 
+0x6f, 0x75, 0x6e, 0x74, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 
+0x54, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x2a, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 
+0x67, 0x6c, 0x65, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 
+0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 
+0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 
+0x20, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x2a, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 
+0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 
+0x6f, 0x6e, 0x73, 0x74, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x2a, 0x20, 0x74, 0x72, 
+0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x4d, 0x61, 0x70, 0x0d, 0x0a, 0x09, 0x29, 0x20, 0x7b, 
+0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x3d, 0x20, 0x56, 
+0x65, 0x63, 0x33, 0x66, 0x28, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x73, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x58, 0x5b, 0x74, 0x68, 0x72, 
+0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x59, 0x5b, 
+0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 
+0x6e, 0x5a, 0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 0x29, 0x3b, 0x0d, 
+0x0a, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x20, 0x3d, 0x20, 0x6f, 0x75, 
+0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x72, 0x65, 0x73, 
+0x73, 0x75, 0x72, 0x65, 0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 0x3b, 
+0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x56, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x20, 0x3d, 0x20, 0x56, 
+0x65, 0x63, 0x33, 0x66, 0x28, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x73, 0x2e, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x58, 0x5b, 0x74, 0x68, 0x72, 
+0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x73, 0x2e, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x59, 0x5b, 
+0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 
+0x79, 0x5a, 0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 0x29, 0x3b, 0x0d, 
+0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x64, 0x79, 0x6e, 0x61, 
+0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 
+0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x3d, 0x20, 0x56, 0x65, 0x63, 
+0x33, 0x66, 0x28, 0x30, 0x2e, 0x30, 0x66, 0x2c, 0x20, 0x30, 0x2e, 0x30, 0x66, 0x2c, 0x20, 
+0x30, 0x2e, 0x30, 0x66, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 
+0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 
+0x20, 0x3d, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x28, 0x30, 0x2e, 0x30, 0x66, 0x2c, 0x20, 
+0x30, 0x2e, 0x30, 0x66, 0x2c, 0x20, 0x30, 0x2e, 0x30, 0x66, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 
+0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 
+0x6f, 0x72, 0x63, 0x65, 0x20, 0x3d, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x28, 0x30, 0x2e, 
+0x30, 0x66, 0x2c, 0x20, 0x30, 0x2e, 0x30, 0x66, 0x2c, 0x20, 0x30, 0x2e, 0x30, 0x66, 0x29, 
+0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x73, 0x74, 0x61, 0x74, 
+0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 
+0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x3d, 0x20, 0x56, 0x65, 0x63, 
+0x33, 0x66, 0x28, 0x30, 0x2e, 0x30, 0x66, 0x2c, 0x20, 0x30, 0x2e, 0x30, 0x66, 0x2c, 0x20, 
+0x30, 0x2e, 0x30, 0x66, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6f, 0x72, 
+0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x69, 0x20, 0x3d, 0x20, 0x30, 0x3b, 
+0x20, 0x69, 0x20, 0x3c, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x4e, 0x65, 0x69, 
+0x67, 0x68, 0x62, 0x6f, 0x75, 0x72, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x3b, 0x20, 0x2b, 0x2b, 
+0x69, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 
+0x74, 0x33, 0x32, 0x20, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x64, 0x79, 0x6e, 
+0x61, 0x6d, 0x69, 0x63, 0x4e, 0x65, 0x69, 0x67, 0x68, 0x62, 0x6f, 0x75, 0x72, 0x73, 0x5b, 
+0x69, 0x5d, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 
+0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 
+0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x3d, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 
+0x28, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 
+0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x58, 0x5b, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x2c, 
+0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 
+0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x59, 0x5b, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x2c, 
+0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 
+0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x5a, 0x5b, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x29, 
+0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x64, 
+0x69, 0x72, 0x20, 0x3d, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x2d, 0x20, 0x70, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 
+0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x69, 0x73, 
+0x74, 0x53, 0x71, 0x72, 0x20, 0x3d, 0x20, 0x64, 0x6f, 0x74, 0x28, 0x64, 0x69, 0x72, 0x2c, 
+0x20, 0x64, 0x69, 0x72, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x69, 0x66, 
+0x20, 0x28, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x20, 0x3e, 0x20, 0x70, 0x61, 0x72, 
+0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 
+0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 
+0x65, 0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 
+0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 
+0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x63, 0x6f, 0x6e, 0x74, 0x69, 0x6e, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x20, 0x3d, 
+0x20, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 
+0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x5b, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x3b, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x6f, 0x74, 0x68, 0x65, 
+0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x65, 0x6c, 0x6f, 0x63, 0x69, 
+0x74, 0x79, 0x20, 0x3d, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x28, 0x69, 0x6e, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 
+0x79, 0x58, 0x5b, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 
+0x79, 0x59, 0x5b, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 
+0x79, 0x5a, 0x5b, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x69, 0x73, 0x74, 0x20, 0x3d, 
+0x20, 0x73, 0x71, 0x72, 0x74, 0x28, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x29, 0x3b, 
+0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x64, 0x69, 0x73, 0x74, 
+0x53, 0x71, 0x72, 0x20, 0x3d, 0x3d, 0x20, 0x30, 0x20, 0x7c, 0x7c, 0x20, 0x64, 0x69, 0x73, 
+0x74, 0x20, 0x3d, 0x3d, 0x20, 0x30, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x64, 0x69, 0x72, 0x20, 0x3d, 0x20, 0x52, 0x61, 0x6e, 0x64, 0x6f, 
+0x6d, 0x44, 0x69, 0x72, 0x65, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x28, 0x28, 0x66, 0x6c, 0x6f, 
+0x61, 0x74, 0x29, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x29, 0x3b, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x70, 0x72, 0x69, 0x6e, 0x74, 0x66, 0x28, 0x22, 0x54, 0x77, 0x6f, 
+0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x73, 0x20, 0x68, 0x61, 0x76, 0x65, 0x20, 0x74, 0x68, 0x65, 0x20, 0x73, 0x61, 
+0x6d, 0x65, 0x20, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x2e, 0x20, 0x53, 0x69, 
+0x6d, 0x75, 0x6c, 0x61, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x77, 0x6f, 0x6e, 0x74, 0x20, 0x62, 
+0x65, 0x20, 0x64, 0x65, 0x74, 0x65, 0x72, 0x6d, 0x69, 0x6e, 0x69, 0x73, 0x74, 0x69, 0x63, 
+0x2e, 0x20, 0x69, 0x31, 0x3a, 0x20, 0x25, 0x75, 0x3b, 0x20, 0x69, 0x32, 0x3a, 0x20, 0x25, 
+0x75, 0x22, 0x2c, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x29, 0x74, 0x68, 0x72, 
+0x65, 0x61, 0x64, 0x49, 0x44, 0x2c, 0x20, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x29, 0x3b, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x65, 0x6c, 0x73, 0x65, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x09, 0x64, 0x69, 0x72, 0x20, 0x2f, 0x3d, 0x20, 0x64, 0x69, 0x73, 
+0x74, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x2f, 0x2f, 0x61, 0x70, 0x70, 0x6c, 
+0x79, 0x20, 0x70, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x20, 0x66, 0x6f, 0x72, 0x63, 
+0x65, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 
+0x6f, 0x72, 0x63, 0x65, 0x20, 0x2b, 0x3d, 0x20, 0x64, 0x69, 0x72, 0x20, 0x2a, 0x20, 0x28, 
+0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 
+0x65, 0x20, 0x2b, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x29, 0x20, 0x2a, 0x20, 0x53, 
+0x6d, 0x6f, 0x6f, 0x74, 0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x44, 
+0x31, 0x28, 0x64, 0x69, 0x73, 0x74, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 
+0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 
+0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x3b, 0x0d, 
+0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x2f, 0x2f, 0x61, 0x70, 0x70, 0x6c, 0x79, 0x20, 0x76, 
+0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x20, 0x66, 0x6f, 0x72, 0x63, 0x65, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 
+0x72, 0x63, 0x65, 0x20, 0x2b, 0x3d, 0x20, 0x28, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x20, 
+0x2d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x65, 0x6c, 0x6f, 0x63, 
+0x69, 0x74, 0x79, 0x29, 0x20, 0x2a, 0x20, 0x53, 0x6d, 0x6f, 0x6f, 0x74, 0x68, 0x69, 0x6e, 
+0x67, 0x4b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x44, 0x32, 0x28, 0x64, 0x69, 0x73, 0x74, 0x2c, 
+0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 
+0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 
+0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 
+0x0a, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 
+0x69, 0x20, 0x3d, 0x20, 0x30, 0x3b, 0x20, 0x69, 0x20, 0x3c, 0x20, 0x73, 0x74, 0x61, 0x74, 
+0x69, 0x63, 0x4e, 0x65, 0x69, 0x67, 0x68, 0x62, 0x6f, 0x75, 0x72, 0x43, 0x6f, 0x75, 0x6e, 
+0x74, 0x3b, 0x20, 0x2b, 0x2b, 0x69, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x64, 0x69, 0x72, 0x20, 0x3d, 0x20, 0x73, 
+0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x5b, 
+0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x4e, 0x65, 0x69, 0x67, 0x68, 0x62, 0x6f, 0x75, 0x72, 
+0x73, 0x5b, 0x69, 0x5d, 0x5d, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x41, 
+0x6e, 0x64, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x2e, 0x78, 0x79, 0x7a, 0x28, 
+0x29, 0x20, 0x2d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 
+0x69, 0x74, 0x69, 0x6f, 0x6e, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 
+0x74, 0x20, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x20, 0x3d, 0x20, 0x64, 0x6f, 0x74, 
+0x28, 0x64, 0x69, 0x72, 0x2c, 0x20, 0x64, 0x69, 0x72, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x20, 
+0x3e, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 
+0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 
+0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 
+0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 
+0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x74, 0x69, 0x6e, 0x75, 0x65, 0x3b, 0x0d, 
+0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x69, 0x73, 
+0x74, 0x20, 0x3d, 0x20, 0x73, 0x71, 0x72, 0x74, 0x28, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 
+0x72, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x64, 
+0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x20, 0x3d, 0x3d, 0x20, 0x30, 0x20, 0x7c, 0x7c, 0x20, 
+0x64, 0x69, 0x73, 0x74, 0x20, 0x3d, 0x3d, 0x20, 0x30, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x64, 0x69, 0x72, 0x20, 0x3d, 0x20, 0x52, 0x61, 
+0x6e, 0x64, 0x6f, 0x6d, 0x44, 0x69, 0x72, 0x65, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x28, 0x28, 
+0x66, 0x6c, 0x6f, 0x61, 0x74, 0x29, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x29, 
+0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x70, 0x72, 0x69, 0x6e, 0x74, 0x66, 0x28, 0x22, 
+0x41, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x20, 0x61, 0x6e, 0x64, 0x20, 0x61, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 
+0x63, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x20, 0x68, 0x61, 0x76, 0x65, 
+0x20, 0x74, 0x68, 0x65, 0x20, 0x73, 0x61, 0x6d, 0x65, 0x20, 0x70, 0x6f, 0x73, 0x69, 0x74, 
+0x69, 0x6f, 0x6e, 0x2e, 0x20, 0x53, 0x69, 0x6d, 0x75, 0x6c, 0x61, 0x74, 0x69, 0x6f, 0x6e, 
+0x20, 0x77, 0x6f, 0x6e, 0x74, 0x20, 0x62, 0x65, 0x20, 0x64, 0x65, 0x74, 0x65, 0x72, 0x6d, 
+0x69, 0x6e, 0x69, 0x73, 0x74, 0x69, 0x63, 0x2e, 0x20, 0x69, 0x31, 0x3a, 0x20, 0x25, 0x75, 
+0x3b, 0x20, 0x69, 0x32, 0x3a, 0x20, 0x25, 0x75, 0x22, 0x2c, 0x20, 0x28, 0x75, 0x69, 0x6e, 
+0x74, 0x33, 0x32, 0x29, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x2c, 0x20, 0x73, 
+0x74, 0x61, 0x74, 0x69, 0x63, 0x4e, 0x65, 0x69, 0x67, 0x68, 0x62, 0x6f, 0x75, 0x72, 0x73, 
+0x5b, 0x69, 0x5d, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x65, 0x6c, 0x73, 0x65, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x64, 0x69, 0x72, 0x20, 
+0x2f, 0x3d, 0x20, 0x64, 0x69, 0x73, 0x74, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x2f, 0x2f, 0x61, 0x70, 0x70, 0x6c, 0x79, 0x20, 0x70, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 
+0x65, 0x20, 0x66, 0x6f, 0x72, 0x63, 0x65, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x73, 0x74, 0x61, 
+0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 
+0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x2b, 0x3d, 0x20, 0x64, 0x69, 
+0x72, 0x20, 0x2a, 0x20, 0x66, 0x61, 0x62, 0x73, 0x28, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x29, 0x20, 0x2a, 0x20, 0x53, 
+0x6d, 0x6f, 0x6f, 0x74, 0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x44, 
+0x31, 0x28, 0x64, 0x69, 0x73, 0x74, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 
+0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 
+0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x3b, 0x0d, 
+0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x2f, 0x2f, 0x61, 0x70, 0x70, 0x6c, 0x79, 0x20, 0x76, 
+0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x20, 0x66, 0x6f, 0x72, 0x63, 0x65, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 
+0x63, 0x65, 0x20, 0x2b, 0x3d, 0x20, 0x2d, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x56, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x20, 0x2a, 0x20, 0x53, 0x6d, 0x6f, 0x6f, 
+0x74, 0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x44, 0x32, 0x28, 0x64, 
+0x69, 0x73, 0x74, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 
+0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 
+0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x53, 0x75, 0x6d, 0x73, 
+0x20, 0x73, 0x75, 0x6d, 0x73, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x73, 0x75, 0x6d, 0x73, 0x2e, 
+0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x5b, 0x30, 
+0x5d, 0x20, 0x3d, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 
+0x63, 0x65, 0x2e, 0x78, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x73, 0x75, 0x6d, 0x73, 0x2e, 0x64, 
+0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 
+0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x5b, 0x31, 0x5d, 
+0x20, 0x3d, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 
+0x65, 0x2e, 0x79, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x73, 0x75, 0x6d, 0x73, 0x2e, 0x64, 0x79, 
+0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 
+0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x5b, 0x32, 0x5d, 0x20, 
+0x3d, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 
+0x2e, 0x7a, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x73, 0x75, 0x6d, 0x73, 0x2e, 0x64, 0x79, 0x6e, 
+0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 
+0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x5b, 0x30, 0x5d, 0x20, 
+0x3d, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 
+0x65, 0x2e, 0x78, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x73, 0x75, 0x6d, 0x73, 0x2e, 0x64, 0x79, 
+0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 
+0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x5b, 0x31, 0x5d, 
+0x20, 0x3d, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 
+0x63, 0x65, 0x2e, 0x79, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x73, 0x75, 0x6d, 0x73, 0x2e, 0x64, 
+0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 
+0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x5b, 0x32, 
+0x5d, 0x20, 0x3d, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 
+0x72, 0x63, 0x65, 0x2e, 0x7a, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x73, 0x75, 0x6d, 0x73, 0x2e, 
+0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 
+0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x5b, 0x30, 0x5d, 
+0x20, 0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 
+0x2e, 0x78, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x73, 0x75, 0x6d, 0x73, 0x2e, 0x73, 0x74, 0x61, 
+0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 
+0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x5b, 0x31, 0x5d, 0x20, 0x3d, 0x20, 
+0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 
+0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x2e, 0x79, 0x3b, 
+0x0d, 0x0a, 0x09, 0x09, 0x73, 0x75, 0x6d, 0x73, 0x2e, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 
+0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x5b, 0x32, 0x5d, 0x20, 0x3d, 0x20, 0x73, 0x74, 0x61, 
+0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 
+0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x2e, 0x7a, 0x3b, 0x0d, 0x0a, 0x09, 
+0x09, 0x73, 0x75, 0x6d, 0x73, 0x2e, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 
+0x6f, 0x72, 0x63, 0x65, 0x5b, 0x30, 0x5d, 0x20, 0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 
+0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 
+0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x2e, 0x78, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x73, 0x75, 0x6d, 0x73, 0x2e, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 
+0x72, 0x63, 0x65, 0x5b, 0x31, 0x5d, 0x20, 0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 
+0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x2e, 0x79, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x73, 
+0x75, 0x6d, 0x73, 0x2e, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 
+0x63, 0x65, 0x5b, 0x32, 0x5d, 0x20, 0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 
+0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x2e, 0x7a, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 
+0x49, 0x6e, 0x74, 0x65, 0x67, 0x72, 0x61, 0x74, 0x65, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x28, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x2c, 0x20, 0x64, 0x79, 
+0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 
+0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x69, 0x6e, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x20, 0x6f, 0x75, 0x74, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x20, 0x73, 0x75, 0x6d, 0x73, 0x2c, 0x20, 
+0x64, 0x65, 0x6c, 0x74, 0x61, 0x54, 0x69, 0x6d, 0x65, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 
+0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2c, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 
+0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x2c, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 
+0x65, 0x73, 0x2c, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x48, 0x61, 0x73, 
+0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 
+0x67, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 0x20, 0x74, 0x72, 0x69, 
+0x61, 0x6e, 0x67, 0x6c, 0x65, 0x4d, 0x61, 0x70, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 
+0x0a, 0x0d, 0x0a, 0x09, 0x2f, 0x2f, 0x57, 0x72, 0x69, 0x74, 0x65, 0x73, 0x20, 0x74, 0x68, 
+0x65, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x20, 0x61, 0x6e, 0x64, 0x20, 0x73, 
+0x74, 0x61, 0x74, 0x69, 0x63, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x20, 0x6f, 
+0x66, 0x20, 0x74, 0x68, 0x65, 0x20, 0x63, 0x65, 0x6c, 0x6c, 0x73, 0x20, 0x61, 0x72, 0x6f, 
+0x75, 0x6e, 0x64, 0x20, 0x74, 0x68, 0x65, 0x20, 0x63, 0x65, 0x6c, 0x6c, 0x20, 0x69, 0x6e, 
+0x20, 0x74, 0x68, 0x65, 0x20, 0x6f, 0x72, 0x64, 0x65, 0x72, 0x20, 0x74, 0x68, 0x65, 0x20, 
+0x73, 0x63, 0x61, 0x6c, 0x61, 0x72, 0x20, 0x66, 0x75, 0x6e, 0x63, 0x74, 0x69, 0x6f, 0x6e, 
+0x73, 0x20, 0x76, 0x69, 0x73, 0x69, 0x74, 0x20, 0x74, 0x68, 0x65, 0x6d, 0x0d, 0x0a, 0x09, 
+0x2f, 0x2f, 0x61, 0x6e, 0x64, 0x20, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x73, 0x20, 0x74, 
+0x68, 0x65, 0x69, 0x72, 0x20, 0x63, 0x6f, 0x75, 0x6e, 0x74, 0x2e, 0x20, 0x54, 0x68, 0x65, 
+0x20, 0x63, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x20, 0x63, 0x6f, 0x75, 0x6e, 
+0x74, 0x73, 0x20, 0x61, 0x72, 0x65, 0x20, 0x73, 0x65, 0x74, 0x20, 0x74, 0x6f, 0x20, 0x74, 
+0x68, 0x65, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x20, 0x69, 0x6e, 
+0x20, 0x74, 0x68, 0x6f, 0x73, 0x65, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x0d, 
+0x0a, 0x09, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 
+0x20, 0x47, 0x65, 0x74, 0x43, 0x65, 0x6c, 0x6c, 0x4e, 0x65, 0x69, 0x67, 0x68, 0x62, 0x6f, 
+0x75, 0x72, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x28, 0x0d, 0x0a, 0x09, 0x09, 0x56, 
+0x65, 0x63, 0x33, 0x75, 0x20, 0x63, 0x65, 0x6c, 0x6c, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x75, 
+0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 
+0x69, 0x7a, 0x65, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 
+0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 
+0x43, 0x6f, 0x75, 0x6e, 0x74, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 
+0x34, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x0d, 
+0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x48, 0x41, 0x53, 0x48, 0x5f, 0x54, 
+0x59, 0x50, 0x45, 0x2a, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 0x0d, 0x0a, 
+0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x48, 0x41, 0x53, 0x48, 0x5f, 0x54, 0x59, 
+0x50, 0x45, 0x2a, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 0x0d, 0x0a, 0x09, 
+0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x42, 0x65, 0x68, 0x61, 0x76, 0x69, 0x6f, 0x75, 0x72, 0x50, 0x61, 0x72, 0x61, 0x6d, 0x65, 
+0x74, 0x65, 0x72, 0x73, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 
+0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x2a, 0x20, 0x64, 
+0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x2c, 0x0d, 
+0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x2a, 0x20, 0x73, 0x74, 0x61, 0x74, 
+0x69, 0x63, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x75, 
+0x69, 0x6e, 0x74, 0x36, 0x34, 0x26, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x43, 
+0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x2c, 0x0d, 
+0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x26, 0x20, 0x73, 0x74, 0x61, 0x74, 
+0x69, 0x63, 0x43, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x43, 0x6f, 0x75, 0x6e, 
+0x74, 0x0d, 0x0a, 0x09, 0x29, 0x20, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 
+0x75, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x43, 0x65, 0x6c, 0x6c, 0x20, 0x3d, 0x20, 0x63, 
+0x65, 0x6c, 0x6c, 0x20, 0x2d, 0x20, 0x56, 0x65, 0x63, 0x33, 0x75, 0x28, 0x31, 0x2c, 0x20, 
+0x31, 0x2c, 0x20, 0x31, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x75, 
+0x20, 0x65, 0x6e, 0x64, 0x43, 0x65, 0x6c, 0x6c, 0x20, 0x3d, 0x20, 0x63, 0x65, 0x6c, 0x6c, 
+0x20, 0x2b, 0x20, 0x56, 0x65, 0x63, 0x33, 0x75, 0x28, 0x32, 0x2c, 0x20, 0x32, 0x2c, 0x20, 
+0x32, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 
+0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x20, 0x3d, 0x20, 
+0x30, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x62, 0x6f, 0x6f, 0x6c, 0x20, 0x6f, 0x75, 0x74, 0x73, 
+0x69, 0x64, 0x65, 0x47, 0x72, 0x69, 0x64, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x56, 0x69, 
+0x73, 0x69, 0x74, 0x65, 0x64, 0x20, 0x3d, 0x20, 0x66, 0x61, 0x6c, 0x73, 0x65, 0x3b, 0x0d, 
+0x0a, 0x09, 0x09, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x43, 0x61, 0x6e, 0x64, 0x69, 
+0x64, 0x61, 0x74, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x20, 0x3d, 0x20, 0x30, 0x3b, 0x0d, 
+0x0a, 0x09, 0x09, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x43, 0x61, 0x6e, 0x64, 0x69, 0x64, 
+0x61, 0x74, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x20, 0x3d, 0x20, 0x30, 0x3b, 0x0d, 0x0a, 
+0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x75, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 
+0x43, 0x65, 0x6c, 0x6c, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x6f, 
+0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x78, 0x20, 0x3d, 0x20, 0x62, 0x65, 
+0x67, 0x69, 0x6e, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x78, 0x3b, 0x20, 0x6f, 0x74, 0x68, 0x65, 
+0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x78, 0x20, 0x21, 0x3d, 0x20, 0x65, 0x6e, 0x64, 0x43, 
+0x65, 0x6c, 0x6c, 0x2e, 0x78, 0x3b, 0x20, 0x2b, 0x2b, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 
+0x65, 0x6c, 0x6c, 0x2e, 0x78, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 
+0x28, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x79, 0x20, 0x3d, 0x20, 
+0x62, 0x65, 0x67, 0x69, 0x6e, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x79, 0x3b, 0x20, 0x6f, 0x74, 
+0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x79, 0x20, 0x21, 0x3d, 0x20, 0x65, 0x6e, 
+0x64, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x79, 0x3b, 0x20, 0x2b, 0x2b, 0x6f, 0x74, 0x68, 0x65, 
+0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x79, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x66, 
+0x6f, 0x72, 0x20, 0x28, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x7a, 
+0x20, 0x3d, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x7a, 0x3b, 
+0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x7a, 0x20, 0x21, 0x3d, 
+0x20, 0x65, 0x6e, 0x64, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x7a, 0x3b, 0x20, 0x2b, 0x2b, 0x6f, 
+0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 0x7a, 0x29, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 
+0x32, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x20, 0x3d, 0x20, 0x47, 0x65, 0x74, 0x43, 
+0x65, 0x6c, 0x6c, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x28, 0x6f, 0x74, 0x68, 0x65, 0x72, 
+0x43, 0x65, 0x6c, 0x6c, 0x2c, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 
+0x69, 0x7a, 0x65, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 
+0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 
+0x49, 0x73, 0x4f, 0x75, 0x74, 0x73, 0x69, 0x64, 0x65, 0x47, 0x72, 0x69, 0x64, 0x42, 0x75, 
+0x63, 0x6b, 0x65, 0x74, 0x28, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x2c, 0x20, 0x64, 0x79, 
+0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 
+0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x70, 0x61, 0x72, 
+0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x29, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x6f, 
+0x75, 0x74, 0x73, 0x69, 0x64, 0x65, 0x47, 0x72, 0x69, 0x64, 0x42, 0x75, 0x63, 0x6b, 0x65, 
+0x74, 0x56, 0x69, 0x73, 0x69, 0x74, 0x65, 0x64, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x74, 0x69, 0x6e, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x6f, 0x75, 0x74, 0x73, 0x69, 0x64, 0x65, 0x47, 
+0x72, 0x69, 0x64, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x56, 0x69, 0x73, 0x69, 0x74, 0x65, 
+0x64, 0x20, 0x3d, 0x20, 0x74, 0x72, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 
+0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x64, 0x79, 0x6e, 0x61, 
+0x6d, 0x69, 0x63, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x5b, 0x62, 0x75, 0x63, 0x6b, 
+0x65, 0x74, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x5d, 0x20, 0x3d, 0x20, 0x62, 0x75, 0x63, 0x6b, 
+0x65, 0x74, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x64, 0x79, 0x6e, 0x61, 0x6d, 
+0x69, 0x63, 0x43, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x43, 0x6f, 0x75, 0x6e, 
+0x74, 0x20, 0x2b, 0x3d, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x5b, 0x62, 0x75, 
+0x63, 0x6b, 0x65, 0x74, 0x20, 0x2b, 0x20, 0x31, 0x5d, 0x20, 0x2d, 0x20, 0x68, 0x61, 0x73, 
+0x68, 0x4d, 0x61, 0x70, 0x5b, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x5d, 0x3b, 0x0d, 0x0a, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x73, 0x74, 0x61, 0x74, 
+0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x43, 0x6f, 0x75, 0x6e, 
+0x74, 0x20, 0x21, 0x3d, 0x20, 0x30, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7b, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 
+0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x20, 0x3d, 0x20, 
+0x47, 0x65, 0x74, 0x43, 0x65, 0x6c, 0x6c, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x28, 0x6f, 
+0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x2c, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 
+0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 
+0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 
+0x65, 0x72, 0x73, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x09, 0x73, 0x74, 
+0x61, 0x74, 0x69, 0x63, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x5b, 0x62, 0x75, 0x63, 
+0x6b, 0x65, 0x74, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x5d, 0x20, 0x3d, 0x20, 0x73, 0x74, 0x61, 
+0x74, 0x69, 0x63, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x09, 0x09, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x43, 0x61, 0x6e, 0x64, 0x69, 0x64, 
+0x61, 0x74, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x20, 0x2b, 0x3d, 0x20, 0x73, 0x74, 0x61, 
+0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 
+0x68, 0x4d, 0x61, 0x70, 0x5b, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x42, 0x75, 0x63, 0x6b, 
+0x65, 0x74, 0x20, 0x2b, 0x20, 0x31, 0x5d, 0x20, 0x2d, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 
+0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 
+0x61, 0x70, 0x5b, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 
+0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x2b, 0x2b, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x43, 0x6f, 0x75, 
+0x6e, 0x74, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 
+0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x43, 
+0x6f, 0x75, 0x6e, 0x74, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x2f, 
+0x2f, 0x54, 0x68, 0x65, 0x20, 0x70, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x73, 0x20, 
+0x61, 0x6e, 0x64, 0x20, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x69, 0x65, 0x73, 0x20, 
+0x61, 0x72, 0x65, 0x20, 0x6f, 0x6e, 0x6c, 0x79, 0x20, 0x67, 0x61, 0x74, 0x68, 0x65, 0x72, 
+0x65, 0x64, 0x20, 0x77, 0x68, 0x65, 0x6e, 0x20, 0x27, 0x70, 0x72, 0x65, 0x73, 0x73, 0x75, 
+0x72, 0x65, 0x27, 0x20, 0x69, 0x73, 0x6e, 0x27, 0x74, 0x20, 0x6e, 0x75, 0x6c, 0x6c, 0x70, 
+0x74, 0x72, 0x0d, 0x0a, 0x09, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x20, 0x76, 0x6f, 0x69, 
+0x64, 0x20, 0x47, 0x61, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x4e, 0x65, 0x69, 
+0x67, 0x68, 0x62, 0x6f, 0x75, 0x72, 0x43, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 
+0x73, 0x28, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x75, 0x69, 0x6e, 
+0x74, 0x33, 0x32, 0x2a, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x42, 0x75, 0x63, 
+0x6b, 0x65, 0x74, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 
+0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x2a, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x42, 
+0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 
+0x33, 0x32, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x2c, 
+0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x73, 0x74, 0x61, 0x74, 
+0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x43, 0x6f, 0x75, 0x6e, 
+0x74, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x53, 0x74, 0x72, 0x65, 0x61, 0x6d, 0x73, 0x20, 0x69, 
+0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 
+0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x2a, 0x20, 0x70, 0x72, 
+0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 
+0x74, 0x20, 0x48, 0x41, 0x53, 0x48, 0x5f, 0x54, 0x59, 0x50, 0x45, 0x2a, 0x20, 0x68, 0x61, 
+0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 
+0x20, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x4d, 0x61, 0x70, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 
+0x20, 0x53, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x2a, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x48, 0x41, 
+0x53, 0x48, 0x5f, 0x54, 0x59, 0x50, 0x45, 0x2a, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 
+0x70, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x43, 0x65, 0x6c, 0x6c, 0x4e, 0x65, 0x69, 0x67, 0x68, 
+0x62, 0x6f, 0x75, 0x72, 0x43, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x73, 0x26, 
+0x20, 0x63, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x73, 0x0d, 0x0a, 0x09, 0x29, 
+0x20, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 
+0x73, 0x2e, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x20, 
+0x3d, 0x20, 0x30, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 
+0x74, 0x65, 0x73, 0x2e, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x43, 0x6f, 0x75, 0x6e, 0x74, 
+0x20, 0x3d, 0x20, 0x30, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 
+0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x49, 
+0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x30, 0x3b, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 
+0x74, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3c, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 
+0x43, 0x6f, 0x75, 0x6e, 0x74, 0x3b, 0x20, 0x2b, 0x2b, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 
+0x49, 0x6e, 0x64, 0x65, 0x78, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 0x6e, 
+0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x5b, 0x64, 
+0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x5b, 0x62, 
+0x75, 0x63, 0x6b, 0x65, 0x74, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x5d, 0x3b, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x65, 0x6e, 0x64, 0x49, 0x6e, 
+0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x5b, 0x64, 
+0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x5b, 0x62, 
+0x75, 0x63, 0x6b, 0x65, 0x74, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x20, 0x2b, 0x20, 0x31, 
+0x5d, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x75, 
+0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x69, 0x20, 0x3d, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 
+0x49, 0x6e, 0x64, 0x65, 0x78, 0x3b, 0x20, 0x69, 0x20, 0x3c, 0x20, 0x65, 0x6e, 0x64, 0x49, 
+0x6e, 0x64, 0x65, 0x78, 0x3b, 0x20, 0x2b, 0x2b, 0x69, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x69, 
+0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x4d, 0x61, 0x70, 0x5b, 0x69, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x75, 0x69, 
+0x6e, 0x74, 0x36, 0x34, 0x20, 0x6a, 0x20, 0x3d, 0x20, 0x63, 0x61, 0x6e, 0x64, 0x69, 0x64, 
+0x61, 0x74, 0x65, 0x73, 0x2e, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x43, 0x6f, 0x75, 
+0x6e, 0x74, 0x2b, 0x2b, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x63, 0x61, 
+0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x73, 0x2e, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 
+0x63, 0x49, 0x6e, 0x64, 0x69, 0x63, 0x65, 0x73, 0x5b, 0x6a, 0x5d, 0x20, 0x3d, 0x20, 0x69, 
+0x6e, 0x64, 0x65, 0x78, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x63, 0x61, 0x6e, 0x64, 
+0x69, 0x64, 0x61, 0x74, 0x65, 0x73, 0x2e, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 
+0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x58, 0x5b, 0x6a, 0x5d, 0x20, 0x3d, 0x20, 0x69, 
+0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 0x69, 
+0x74, 0x69, 0x6f, 0x6e, 0x58, 0x5b, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x3b, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x63, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x73, 0x2e, 
+0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 
+0x59, 0x5b, 0x6a, 0x5d, 0x20, 0x3d, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x59, 0x5b, 0x69, 
+0x6e, 0x64, 0x65, 0x78, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x63, 0x61, 0x6e, 
+0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x73, 0x2e, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 
+0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x5a, 0x5b, 0x6a, 0x5d, 0x20, 0x3d, 0x20, 
+0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 
+0x69, 0x74, 0x69, 0x6f, 0x6e, 0x5a, 0x5b, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x3b, 0x0d, 
+0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x70, 0x72, 0x65, 0x73, 
+0x73, 0x75, 0x72, 0x65, 0x20, 0x21, 0x3d, 0x20, 0x6e, 0x75, 0x6c, 0x6c, 0x70, 0x74, 0x72, 
+0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 
+0x63, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x73, 0x2e, 0x64, 0x79, 0x6e, 0x61, 
+0x6d, 0x69, 0x63, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x5b, 0x6a, 0x5d, 0x20, 
+0x3d, 0x20, 0x70, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x5b, 0x69, 0x6e, 0x64, 0x65, 
+0x78, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x63, 0x61, 0x6e, 0x64, 0x69, 
+0x64, 0x61, 0x74, 0x65, 0x73, 0x2e, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x56, 0x65, 
+0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x58, 0x5b, 0x6a, 0x5d, 0x20, 0x3d, 0x20, 0x69, 0x6e, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x76, 0x65, 0x6c, 0x6f, 0x63, 
+0x69, 0x74, 0x79, 0x58, 0x5b, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x09, 0x63, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x73, 0x2e, 
+0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x56, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 
+0x59, 0x5b, 0x6a, 0x5d, 0x20, 0x3d, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x73, 0x2e, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x59, 0x5b, 0x69, 
+0x6e, 0x64, 0x65, 0x78, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x09, 0x63, 0x61, 
+0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x73, 0x2e, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 
+0x63, 0x56, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x5a, 0x5b, 0x6a, 0x5d, 0x20, 0x3d, 
+0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x76, 0x65, 
+0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x5a, 0x5b, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x3b, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x20, 
+0x3d, 0x3d, 0x20, 0x30, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x74, 
+0x69, 0x6e, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x62, 0x65, 0x67, 
+0x69, 0x6e, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 
+0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 
+0x61, 0x70, 0x5b, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 
+0x73, 0x5b, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x5d, 
+0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 
+0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x5b, 0x73, 0x74, 0x61, 0x74, 0x69, 
+0x63, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x5b, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 
+0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x20, 0x2b, 0x20, 0x31, 0x5d, 0x3b, 0x0d, 0x0a, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 
+0x20, 0x69, 0x20, 0x3d, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 0x6e, 0x64, 0x65, 0x78, 
+0x3b, 0x20, 0x69, 0x20, 0x3c, 0x20, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x3b, 
+0x20, 0x2b, 0x2b, 0x69, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x6a, 0x20, 0x3d, 0x20, 0x63, 0x61, 
+0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x73, 0x2e, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 
+0x43, 0x6f, 0x75, 0x6e, 0x74, 0x2b, 0x2b, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x63, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x73, 0x2e, 0x73, 0x74, 0x61, 
+0x74, 0x69, 0x63, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x58, 0x5b, 0x6a, 0x5d, 
+0x20, 0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x73, 0x5b, 0x69, 0x5d, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 
+0x41, 0x6e, 0x64, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x2e, 0x78, 0x3b, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x09, 0x63, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x73, 
+0x2e, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 
+0x59, 0x5b, 0x6a, 0x5d, 0x20, 0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x5b, 0x69, 0x5d, 0x2e, 0x70, 0x6f, 0x73, 0x69, 
+0x74, 0x69, 0x6f, 0x6e, 0x41, 0x6e, 0x64, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 
+0x2e, 0x79, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x63, 0x61, 0x6e, 0x64, 0x69, 0x64, 
+0x61, 0x74, 0x65, 0x73, 0x2e, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x6f, 0x73, 0x69, 
+0x74, 0x69, 0x6f, 0x6e, 0x5a, 0x5b, 0x6a, 0x5d, 0x20, 0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 
+0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x5b, 0x69, 0x5d, 0x2e, 
+0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x41, 0x6e, 0x64, 0x50, 0x72, 0x65, 0x73, 
+0x73, 0x75, 0x72, 0x65, 0x2e, 0x7a, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 
+0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x73, 0x74, 0x61, 
+0x74, 0x69, 0x63, 0x20, 0x76, 0x6f, 0x69, 0x64, 0x20, 0x55, 0x70, 0x64, 0x61, 0x74, 0x65, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 
+0x65, 0x46, 0x72, 0x6f, 0x6d, 0x43, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x73, 
+0x28, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x74, 0x68, 0x72, 
+0x65, 0x61, 0x64, 0x49, 0x44, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x44, 0x79, 0x6e, 0x61, 0x6d, 
+0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x53, 0x74, 0x72, 0x65, 0x61, 
+0x6d, 0x73, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 
+0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x2a, 0x20, 0x6f, 0x75, 0x74, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 
+0x65, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x42, 0x65, 0x68, 0x61, 0x76, 0x69, 0x6f, 0x75, 0x72, 0x50, 
+0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 
+0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 
+0x74, 0x20, 0x43, 0x65, 0x6c, 0x6c, 0x4e, 0x65, 0x69, 0x67, 0x68, 0x62, 0x6f, 0x75, 0x72, 
+0x43, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x73, 0x26, 0x20, 0x63, 0x61, 0x6e, 
+0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x73, 0x0d, 0x0a, 0x09, 0x29, 0x20, 0x7b, 0x0d, 0x0a, 
+0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x3d, 0x20, 0x56, 0x65, 0x63, 
+0x33, 0x66, 0x28, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 
+0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x58, 0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 
+0x64, 0x49, 0x44, 0x5d, 0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x59, 0x5b, 0x74, 0x68, 
+0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x5a, 
+0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 
+0x0a, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 
+0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x66, 0x6c, 0x75, 0x65, 
+0x6e, 0x63, 0x65, 0x53, 0x75, 0x6d, 0x20, 0x3d, 0x20, 0x30, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x66, 0x6c, 0x75, 0x65, 0x6e, 0x63, 0x65, 0x53, 
+0x75, 0x6d, 0x20, 0x3d, 0x20, 0x30, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6f, 
+0x72, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x69, 0x20, 0x3d, 0x20, 0x30, 
+0x3b, 0x20, 0x69, 0x20, 0x3c, 0x20, 0x63, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 
+0x73, 0x2e, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x3b, 
+0x20, 0x2b, 0x2b, 0x69, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x69, 0x66, 0x20, 0x28, 0x63, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x73, 0x2e, 
+0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x49, 0x6e, 0x64, 0x69, 0x63, 0x65, 0x73, 0x5b, 
+0x69, 0x5d, 0x20, 0x3d, 0x3d, 0x20, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x29, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x74, 0x69, 0x6e, 0x75, 0x65, 0x3b, 
+0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x64, 0x69, 
+0x72, 0x20, 0x3d, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x28, 0x63, 0x61, 0x6e, 0x64, 0x69, 
+0x64, 0x61, 0x74, 0x65, 0x73, 0x2e, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x6f, 
+0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x58, 0x5b, 0x69, 0x5d, 0x2c, 0x20, 0x63, 0x61, 0x6e, 
+0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x73, 0x2e, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 
+0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x59, 0x5b, 0x69, 0x5d, 0x2c, 0x20, 0x63, 
+0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x73, 0x2e, 0x64, 0x79, 0x6e, 0x61, 0x6d, 
+0x69, 0x63, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x5a, 0x5b, 0x69, 0x5d, 0x29, 
+0x20, 0x2d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 
+0x74, 0x69, 0x6f, 0x6e, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 
+0x20, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x20, 0x3d, 0x20, 0x64, 0x6f, 0x74, 0x28, 
+0x64, 0x69, 0x72, 0x2c, 0x20, 0x64, 0x69, 0x72, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x20, 0x3e, 
+0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 
+0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 
+0x74, 0x61, 0x6e, 0x63, 0x65, 0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 
+0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 
+0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x0d, 0x0a, 
+0x09, 0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x74, 0x69, 0x6e, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x69, 0x73, 0x74, 
+0x20, 0x3d, 0x20, 0x73, 0x71, 0x72, 0x74, 0x28, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 
+0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 
+0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x66, 0x6c, 0x75, 0x65, 
+0x6e, 0x63, 0x65, 0x53, 0x75, 0x6d, 0x20, 0x2b, 0x3d, 0x20, 0x53, 0x6d, 0x6f, 0x6f, 0x74, 
+0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x44, 0x30, 0x28, 0x64, 0x69, 
+0x73, 0x74, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 
+0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 
+0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x7d, 
+0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 
+0x36, 0x34, 0x20, 0x69, 0x20, 0x3d, 0x20, 0x30, 0x3b, 0x20, 0x69, 0x20, 0x3c, 0x20, 0x63, 
+0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x73, 0x2e, 0x73, 0x74, 0x61, 0x74, 0x69, 
+0x63, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x3b, 0x20, 0x2b, 0x2b, 0x69, 0x29, 0x0d, 0x0a, 0x09, 
+0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x64, 0x69, 
+0x72, 0x20, 0x3d, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x28, 0x63, 0x61, 0x6e, 0x64, 0x69, 
+0x64, 0x61, 0x74, 0x65, 0x73, 0x2e, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x6f, 0x73, 
+0x69, 0x74, 0x69, 0x6f, 0x6e, 0x58, 0x5b, 0x69, 0x5d, 0x2c, 0x20, 0x63, 0x61, 0x6e, 0x64, 
+0x69, 0x64, 0x61, 0x74, 0x65, 0x73, 0x2e, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x6f, 
+0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x59, 0x5b, 0x69, 0x5d, 0x2c, 0x20, 0x63, 0x61, 0x6e, 
+0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x73, 0x2e, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 
+0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x5a, 0x5b, 0x69, 0x5d, 0x29, 0x20, 0x2d, 0x20, 
+0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 
+0x6e, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x69, 
+0x73, 0x74, 0x53, 0x71, 0x72, 0x20, 0x3d, 0x20, 0x64, 0x6f, 0x74, 0x28, 0x64, 0x69, 0x72, 
+0x2c, 0x20, 0x64, 0x69, 0x72, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x69, 
+0x66, 0x20, 0x28, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x20, 0x3e, 0x20, 0x70, 0x61, 
+0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 
+0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 
+0x63, 0x65, 0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 
+0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 
+0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x09, 0x63, 0x6f, 0x6e, 0x74, 0x69, 0x6e, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x69, 0x73, 0x74, 0x20, 0x3d, 0x20, 
+0x73, 0x71, 0x72, 0x74, 0x28, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x29, 0x3b, 0x0d, 
+0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x66, 0x6c, 0x75, 0x65, 0x6e, 0x63, 0x65, 0x53, 
+0x75, 0x6d, 0x20, 0x2b, 0x3d, 0x20, 0x53, 0x6d, 0x6f, 0x6f, 0x74, 0x68, 0x69, 0x6e, 0x67, 
+0x4b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x44, 0x30, 0x28, 0x64, 0x69, 0x73, 0x74, 0x2c, 0x20, 
+0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 
+0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 
+0x61, 0x6e, 0x63, 0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 
+0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x44, 0x65, 0x6e, 0x73, 0x69, 0x74, 0x79, 0x20, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x61, 
+0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x73, 0x65, 0x6c, 0x66, 0x44, 0x65, 0x6e, 
+0x73, 0x69, 0x74, 0x79, 0x20, 0x2b, 0x20, 0x28, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x66, 0x6c, 0x75, 0x65, 0x6e, 
+0x63, 0x65, 0x53, 0x75, 0x6d, 0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 
+0x65, 0x72, 0x73, 0x2d, 0x3e, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 
+0x73, 0x73, 0x20, 0x2b, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x66, 0x6c, 0x75, 0x65, 0x6e, 0x63, 0x65, 0x53, 0x75, 
+0x6d, 0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 
+0x3e, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x73, 0x73, 0x29, 0x20, 
+0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x73, 
+0x6d, 0x6f, 0x6f, 0x74, 0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x43, 
+0x6f, 0x6e, 0x73, 0x74, 0x61, 0x6e, 0x74, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6c, 0x6f, 
+0x61, 0x74, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 
+0x73, 0x75, 0x72, 0x65, 0x20, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 
+0x72, 0x73, 0x2d, 0x3e, 0x67, 0x61, 0x73, 0x43, 0x6f, 0x6e, 0x73, 0x74, 0x61, 0x6e, 0x74, 
+0x20, 0x2a, 0x20, 0x28, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x44, 0x65, 0x6e, 
+0x73, 0x69, 0x74, 0x79, 0x20, 0x2d, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 
+0x72, 0x73, 0x2d, 0x3e, 0x72, 0x65, 0x73, 0x74, 0x44, 0x65, 0x6e, 0x73, 0x69, 0x74, 0x79, 
+0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x73, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x5b, 0x74, 
+0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 0x20, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x3b, 0x0d, 0x0a, 
+0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x20, 0x76, 
+0x6f, 0x69, 0x64, 0x20, 0x55, 0x70, 0x64, 0x61, 0x74, 0x65, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x73, 0x46, 0x72, 0x6f, 0x6d, 
+0x43, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x73, 0x28, 0x0d, 0x0a, 0x09, 0x09, 
+0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 
+0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x64, 0x79, 0x6e, 
+0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 
+0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x44, 
+0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x53, 
+0x74, 0x72, 0x65, 0x61, 0x6d, 0x73, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x53, 0x74, 0x72, 0x65, 0x61, 0x6d, 0x73, 
+0x20, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x0d, 
+0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 
+0x64, 0x65, 0x6c, 0x74, 0x61, 0x54, 0x69, 0x6d, 0x65, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 
+0x6f, 0x6e, 0x73, 0x74, 0x20, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x42, 0x65, 
+0x68, 0x61, 0x76, 0x69, 0x6f, 0x75, 0x72, 0x50, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 
+0x72, 0x73, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2c, 
+0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x43, 0x65, 0x6c, 0x6c, 0x4e, 
+0x65, 0x69, 0x67, 0x68, 0x62, 0x6f, 0x75, 0x72, 0x43, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 
+0x74, 0x65, 0x73, 0x26, 0x20, 0x63, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x73, 
+0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x74, 0x72, 0x69, 
+0x61, 0x6e, 0x67, 0x6c, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 
+0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x54, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x2a, 
+0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 
+0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 
+0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x0d, 0x0a, 0x09, 
+0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x2a, 0x20, 
+0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 
+0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x75, 0x69, 0x6e, 0x74, 
+0x33, 0x32, 0x2a, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x4d, 0x61, 0x70, 
+0x0d, 0x0a, 0x09, 0x29, 0x20, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 
+0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 
+0x6f, 0x6e, 0x20, 0x3d, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x28, 0x69, 0x6e, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 
+0x6e, 0x58, 0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 0x2c, 0x20, 0x69, 
+0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 0x69, 
+0x74, 0x69, 0x6f, 0x6e, 0x59, 0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 
+0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 
+0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x5a, 0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 
+0x49, 0x44, 0x5d, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 
+0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 
+0x65, 0x20, 0x3d, 0x20, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x73, 0x2e, 0x70, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x5b, 0x74, 0x68, 0x72, 0x65, 
+0x61, 0x64, 0x49, 0x44, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 
+0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x65, 0x6c, 0x6f, 0x63, 0x69, 
+0x74, 0x79, 0x20, 0x3d, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x28, 0x69, 0x6e, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x76, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 
+0x79, 0x58, 0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 0x2c, 0x20, 0x69, 
+0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x76, 0x65, 0x6c, 0x6f, 
+0x63, 0x69, 0x74, 0x79, 0x59, 0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x5d, 
+0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x76, 
+0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x5a, 0x5b, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 
+0x49, 0x44, 0x5d, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 
+0x66, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 
+0x20, 0x3d, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x28, 0x30, 0x2e, 0x30, 0x66, 0x2c, 0x20, 
+0x30, 0x2e, 0x30, 0x66, 0x2c, 0x20, 0x30, 0x2e, 0x30, 0x66, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 
+0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 
+0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x3d, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x28, 
+0x30, 0x2e, 0x30, 0x66, 0x2c, 0x20, 0x30, 0x2e, 0x30, 0x66, 0x2c, 0x20, 0x30, 0x2e, 0x30, 
+0x66, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x73, 0x74, 
+0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 
+0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x3d, 0x20, 0x56, 0x65, 
+0x63, 0x33, 0x66, 0x28, 0x30, 0x2e, 0x30, 0x66, 0x2c, 0x20, 0x30, 0x2e, 0x30, 0x66, 0x2c, 
+0x20, 0x30, 0x2e, 0x30, 0x66, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 
+0x66, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 
+0x20, 0x3d, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 0x28, 0x30, 0x2e, 0x30, 0x66, 0x2c, 0x20, 
+0x30, 0x2e, 0x30, 0x66, 0x2c, 0x20, 0x30, 0x2e, 0x30, 0x66, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 
+0x0a, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 
+0x69, 0x20, 0x3d, 0x20, 0x30, 0x3b, 0x20, 0x69, 0x20, 0x3c, 0x20, 0x63, 0x61, 0x6e, 0x64, 
+0x69, 0x64, 0x61, 0x74, 0x65, 0x73, 0x2e, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x43, 
+0x6f, 0x75, 0x6e, 0x74, 0x3b, 0x20, 0x2b, 0x2b, 0x69, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x7b, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x69, 0x6e, 0x64, 
+0x65, 0x78, 0x20, 0x3d, 0x20, 0x63, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x73, 
+0x2e, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x49, 0x6e, 0x64, 0x69, 0x63, 0x65, 0x73, 
+0x5b, 0x69, 0x5d, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 
+0x69, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x3d, 0x20, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 
+0x49, 0x44, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x74, 0x69, 0x6e, 
+0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 
+0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 
+0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x3d, 0x20, 0x56, 0x65, 0x63, 0x33, 0x66, 
+0x28, 0x63, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x73, 0x2e, 0x64, 0x79, 0x6e, 
+0x61, 0x6d, 0x69, 0x63, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x58, 0x5b, 0x69, 
+0x5d, 0x2c, 0x20, 0x63, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x73, 0x2e, 0x64, 
+0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x59, 
+0x5b, 0x69, 0x5d, 0x2c, 0x20, 0x63, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x73, 
+0x2e, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 
+0x6e, 0x5a, 0x5b, 0x69, 0x5d, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x56, 
+0x65, 0x63, 0x33, 0x66, 0x20, 0x64, 0x69, 0x72, 0x20, 0x3d, 0x20, 0x6f, 0x74, 0x68, 0x65, 
+0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 
+0x6f, 0x6e, 0x20, 0x2d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x6f, 
+0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x66, 0x6c, 0x6f, 
+0x61, 0x74, 0x20, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x20, 0x3d, 0x20, 0x64, 0x6f, 
+0x74, 0x28, 0x64, 0x69, 0x72, 0x2c, 0x20, 0x64, 0x69, 0x72, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 
+0x20, 0x3e, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 
+0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 
+0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x20, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 
+0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 
+0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x74, 0x69, 0x6e, 0x75, 0x65, 0x3b, 
+0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x6f, 0x74, 
+0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 
+0x73, 0x75, 0x72, 0x65, 0x20, 0x3d, 0x20, 0x63, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 
+0x65, 0x73, 0x2e, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x72, 0x65, 0x73, 0x73, 
+0x75, 0x72, 0x65, 0x5b, 0x69, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x56, 0x65, 0x63, 
+0x33, 0x66, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x56, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x20, 0x3d, 0x20, 0x56, 0x65, 0x63, 
+0x33, 0x66, 0x28, 0x63, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x73, 0x2e, 0x64, 
+0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x56, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x58, 
+0x5b, 0x69, 0x5d, 0x2c, 0x20, 0x63, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x73, 
+0x2e, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x56, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 
+0x79, 0x59, 0x5b, 0x69, 0x5d, 0x2c, 0x20, 0x63, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 
+0x65, 0x73, 0x2e, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x56, 0x65, 0x6c, 0x6f, 0x63, 
+0x69, 0x74, 0x79, 0x5a, 0x5b, 0x69, 0x5d, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x69, 0x73, 0x74, 0x20, 0x3d, 0x20, 0x73, 
+0x71, 0x72, 0x74, 0x28, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x29, 0x3b, 0x0d, 0x0a, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 
+0x72, 0x20, 0x3d, 0x3d, 0x20, 0x30, 0x20, 0x7c, 0x7c, 0x20, 0x64, 0x69, 0x73, 0x74, 0x20, 
+0x3d, 0x3d, 0x20, 0x30, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x09, 0x64, 0x69, 0x72, 0x20, 0x3d, 0x20, 0x52, 0x61, 0x6e, 0x64, 0x6f, 0x6d, 0x44, 
+0x69, 0x72, 0x65, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x28, 0x28, 0x66, 0x6c, 0x6f, 0x61, 0x74, 
+0x29, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x09, 0x70, 0x72, 0x69, 0x6e, 0x74, 0x66, 0x28, 0x22, 0x54, 0x77, 0x6f, 0x20, 0x64, 
+0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x73, 0x20, 0x68, 0x61, 0x76, 0x65, 0x20, 0x74, 0x68, 0x65, 0x20, 0x73, 0x61, 0x6d, 0x65, 
+0x20, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x2e, 0x20, 0x53, 0x69, 0x6d, 0x75, 
+0x6c, 0x61, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x77, 0x6f, 0x6e, 0x74, 0x20, 0x62, 0x65, 0x20, 
+0x64, 0x65, 0x74, 0x65, 0x72, 0x6d, 0x69, 0x6e, 0x69, 0x73, 0x74, 0x69, 0x63, 0x2e, 0x20, 
+0x69, 0x31, 0x3a, 0x20, 0x25, 0x75, 0x3b, 0x20, 0x69, 0x32, 0x3a, 0x20, 0x25, 0x75, 0x22, 
+0x2c, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x29, 0x74, 0x68, 0x72, 0x65, 0x61, 
+0x64, 0x49, 0x44, 0x2c, 0x20, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x65, 0x6c, 0x73, 0x65, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x64, 0x69, 0x72, 0x20, 0x2f, 0x3d, 0x20, 0x64, 0x69, 0x73, 0x74, 0x3b, 
+0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x2f, 0x2f, 0x61, 0x70, 0x70, 0x6c, 0x79, 0x20, 
+0x70, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x20, 0x66, 0x6f, 0x72, 0x63, 0x65, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 
+0x63, 0x65, 0x20, 0x2b, 0x3d, 0x20, 0x64, 0x69, 0x72, 0x20, 0x2a, 0x20, 0x28, 0x70, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x20, 
+0x2b, 0x20, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x29, 0x20, 0x2a, 0x20, 0x53, 0x6d, 0x6f, 
+0x6f, 0x74, 0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x44, 0x31, 0x28, 
+0x64, 0x69, 0x73, 0x74, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 
+0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 
+0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x2f, 0x2f, 0x61, 0x70, 0x70, 0x6c, 0x79, 0x20, 0x76, 0x69, 0x73, 
+0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x20, 0x66, 0x6f, 0x72, 0x63, 0x65, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 
+0x65, 0x20, 0x2b, 0x3d, 0x20, 0x28, 0x6f, 0x74, 0x68, 0x65, 0x72, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x56, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 0x20, 0x2d, 0x20, 
 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 
-0x79, 0x2c, 0x20, 0x2a, 0x28, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x2a, 0x29, 0x26, 0x70, 0x61, 
-0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x29, 0x3b, 0x0d, 0x0a, 0x23, 
-0x65, 0x6e, 0x64, 0x69, 0x66, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 
-0x23, 0x69, 0x66, 0x6e, 0x64, 0x65, 0x66, 0x20, 0x43, 0x4c, 0x5f, 0x43, 0x4f, 0x4d, 0x50, 
-0x49, 0x4c, 0x45, 0x52, 0x0d, 0x0a, 0x7d, 0x0d, 0x0a, 0x23, 0x65, 0x6e, 0x64, 0x69, 0x66, 
-0x0d, 0x0a, '\0' };
+0x79, 0x29, 0x20, 0x2a, 0x20, 0x53, 0x6d, 0x6f, 0x6f, 0x74, 0x68, 0x69, 0x6e, 0x67, 0x4b, 
+0x65, 0x72, 0x6e, 0x65, 0x6c, 0x44, 0x32, 0x28, 0x64, 0x69, 0x73, 0x74, 0x2c, 0x20, 0x70, 
+0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 
+0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 
+0x6e, 0x63, 0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 
+0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x69, 0x20, 
+0x3d, 0x20, 0x30, 0x3b, 0x20, 0x69, 0x20, 0x3c, 0x20, 0x63, 0x61, 0x6e, 0x64, 0x69, 0x64, 
+0x61, 0x74, 0x65, 0x73, 0x2e, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x43, 0x6f, 0x75, 0x6e, 
+0x74, 0x3b, 0x20, 0x2b, 0x2b, 0x69, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x66, 0x20, 0x64, 0x69, 0x72, 0x20, 0x3d, 0x20, 0x56, 
+0x65, 0x63, 0x33, 0x66, 0x28, 0x63, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x73, 
+0x2e, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 
+0x58, 0x5b, 0x69, 0x5d, 0x2c, 0x20, 0x63, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 
+0x73, 0x2e, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 
+0x6e, 0x59, 0x5b, 0x69, 0x5d, 0x2c, 0x20, 0x63, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 
+0x65, 0x73, 0x2e, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 
+0x6f, 0x6e, 0x5a, 0x5b, 0x69, 0x5d, 0x29, 0x20, 0x2d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x50, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x3b, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 
+0x20, 0x3d, 0x20, 0x64, 0x6f, 0x74, 0x28, 0x64, 0x69, 0x72, 0x2c, 0x20, 0x64, 0x69, 0x72, 
+0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x64, 0x69, 
+0x73, 0x74, 0x53, 0x71, 0x72, 0x20, 0x3e, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 
+0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 
+0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x20, 0x2a, 0x20, 
+0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 
+0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 
+0x61, 0x6e, 0x63, 0x65, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x74, 
+0x69, 0x6e, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x66, 0x6c, 0x6f, 
+0x61, 0x74, 0x20, 0x64, 0x69, 0x73, 0x74, 0x20, 0x3d, 0x20, 0x73, 0x71, 0x72, 0x74, 0x28, 
+0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x69, 0x66, 0x20, 0x28, 0x64, 0x69, 0x73, 0x74, 0x53, 0x71, 0x72, 0x20, 0x3d, 0x3d, 
+0x20, 0x30, 0x20, 0x7c, 0x7c, 0x20, 0x64, 0x69, 0x73, 0x74, 0x20, 0x3d, 0x3d, 0x20, 0x30, 
+0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x64, 0x69, 
+0x72, 0x20, 0x3d, 0x20, 0x52, 0x61, 0x6e, 0x64, 0x6f, 0x6d, 0x44, 0x69, 0x72, 0x65, 0x63, 
+0x74, 0x69, 0x6f, 0x6e, 0x28, 0x28, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x29, 0x74, 0x68, 0x72, 
+0x65, 0x61, 0x64, 0x49, 0x44, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x70, 0x72, 
+0x69, 0x6e, 0x74, 0x66, 0x28, 0x22, 0x41, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 
+0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x20, 0x61, 0x6e, 0x64, 0x20, 0x61, 
+0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x20, 0x68, 0x61, 0x76, 0x65, 0x20, 0x74, 0x68, 0x65, 0x20, 0x73, 0x61, 0x6d, 0x65, 
+0x20, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x2e, 0x20, 0x53, 0x69, 0x6d, 0x75, 
+0x6c, 0x61, 0x74, 0x69, 0x6f, 0x6e, 0x20, 0x77, 0x6f, 0x6e, 0x74, 0x20, 0x62, 0x65, 0x20, 
+0x64, 0x65, 0x74, 0x65, 0x72, 0x6d, 0x69, 0x6e, 0x69, 0x73, 0x74, 0x69, 0x63, 0x2e, 0x20, 
+0x69, 0x31, 0x3a, 0x20, 0x25, 0x75, 0x22, 0x2c, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 
+0x32, 0x29, 0x74, 0x68, 0x72, 0x65, 0x61, 0x64, 0x49, 0x44, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x65, 0x6c, 0x73, 0x65, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x09, 0x64, 0x69, 0x72, 0x20, 0x2f, 0x3d, 0x20, 0x64, 0x69, 0x73, 0x74, 0x3b, 
+0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x2f, 0x2f, 0x61, 0x70, 0x70, 0x6c, 0x79, 0x20, 
+0x70, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x20, 0x66, 0x6f, 0x72, 0x63, 0x65, 0x0d, 
+0x0a, 0x09, 0x09, 0x09, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 
+0x65, 0x20, 0x2b, 0x3d, 0x20, 0x64, 0x69, 0x72, 0x20, 0x2a, 0x20, 0x66, 0x61, 0x62, 0x73, 
+0x28, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 
+0x72, 0x65, 0x29, 0x20, 0x2a, 0x20, 0x53, 0x6d, 0x6f, 0x6f, 0x74, 0x68, 0x69, 0x6e, 0x67, 
+0x4b, 0x65, 0x72, 0x6e, 0x65, 0x6c, 0x44, 0x31, 0x28, 0x64, 0x69, 0x73, 0x74, 0x2c, 0x20, 
+0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 
+0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 
+0x61, 0x6e, 0x63, 0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x2f, 0x2f, 
+0x61, 0x70, 0x70, 0x6c, 0x79, 0x20, 0x76, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 
+0x20, 0x66, 0x6f, 0x72, 0x63, 0x65, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x73, 0x74, 0x61, 0x74, 
+0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 
+0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x20, 0x2b, 0x3d, 0x20, 0x2d, 0x70, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x65, 0x6c, 0x6f, 0x63, 0x69, 0x74, 0x79, 
+0x20, 0x2a, 0x20, 0x53, 0x6d, 0x6f, 0x6f, 0x74, 0x68, 0x69, 0x6e, 0x67, 0x4b, 0x65, 0x72, 
+0x6e, 0x65, 0x6c, 0x44, 0x32, 0x28, 0x64, 0x69, 0x73, 0x74, 0x2c, 0x20, 0x70, 0x61, 0x72, 
+0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 
+0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 
+0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 
+0x69, 0x6f, 0x6e, 0x53, 0x75, 0x6d, 0x73, 0x20, 0x73, 0x75, 0x6d, 0x73, 0x3b, 0x0d, 0x0a, 
+0x09, 0x09, 0x73, 0x75, 0x6d, 0x73, 0x2e, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 
+0x46, 0x6f, 0x72, 0x63, 0x65, 0x5b, 0x30, 0x5d, 0x20, 0x3d, 0x20, 0x64, 0x79, 0x6e, 0x61, 
+0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 
+0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x2e, 0x78, 0x3b, 0x0d, 0x0a, 0x09, 
+0x09, 0x73, 0x75, 0x6d, 0x73, 0x2e, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 
+0x6f, 0x72, 0x63, 0x65, 0x5b, 0x31, 0x5d, 0x20, 0x3d, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 
+0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 
+0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x2e, 0x79, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x73, 0x75, 0x6d, 0x73, 0x2e, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 
+0x72, 0x63, 0x65, 0x5b, 0x32, 0x5d, 0x20, 0x3d, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 
+0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 
+0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x2e, 0x7a, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x73, 
+0x75, 0x6d, 0x73, 0x2e, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 
+0x72, 0x63, 0x65, 0x5b, 0x30, 0x5d, 0x20, 0x3d, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 
+0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 
+0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x2e, 0x78, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x73, 0x75, 0x6d, 0x73, 0x2e, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 
+0x6f, 0x72, 0x63, 0x65, 0x5b, 0x31, 0x5d, 0x20, 0x3d, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 
+0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 
+0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x2e, 0x79, 0x3b, 0x0d, 0x0a, 0x09, 
+0x09, 0x73, 0x75, 0x6d, 0x73, 0x2e, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 
+0x46, 0x6f, 0x72, 0x63, 0x65, 0x5b, 0x32, 0x5d, 0x20, 0x3d, 0x20, 0x64, 0x79, 0x6e, 0x61, 
+0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 
+0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x2e, 0x7a, 0x3b, 0x0d, 0x0a, 
+0x09, 0x09, 0x73, 0x75, 0x6d, 0x73, 0x2e, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 
+0x6f, 0x72, 0x63, 0x65, 0x5b, 0x30, 0x5d, 0x20, 0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 
+0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 
+0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x2e, 0x78, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x73, 
+0x75, 0x6d, 0x73, 0x2e, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 
+0x65, 0x5b, 0x31, 0x5d, 0x20, 0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 
+0x6f, 0x72, 0x63, 0x65, 0x2e, 0x79, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x73, 0x75, 0x6d, 0x73, 
+0x2e, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x5b, 0x32, 
+0x5d, 0x20, 0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x6f, 0x72, 0x63, 
+0x65, 0x2e, 0x7a, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x73, 0x75, 0x6d, 0x73, 0x2e, 0x73, 0x74, 
+0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 
+0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x5b, 0x30, 0x5d, 0x20, 
+0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 
+0x2e, 0x78, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x73, 0x75, 0x6d, 0x73, 0x2e, 0x73, 0x74, 0x61, 
+0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 
+0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x5b, 0x31, 0x5d, 0x20, 0x3d, 
+0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x56, 0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x2e, 
+0x79, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x73, 0x75, 0x6d, 0x73, 0x2e, 0x73, 0x74, 0x61, 0x74, 
+0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 0x69, 0x73, 0x63, 0x6f, 
+0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x5b, 0x32, 0x5d, 0x20, 0x3d, 0x20, 
+0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x56, 
+0x69, 0x73, 0x63, 0x6f, 0x73, 0x69, 0x74, 0x79, 0x46, 0x6f, 0x72, 0x63, 0x65, 0x2e, 0x7a, 
+0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x49, 0x6e, 0x74, 0x65, 0x67, 0x72, 0x61, 0x74, 
+0x65, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x28, 0x74, 0x68, 0x72, 0x65, 0x61, 
+0x64, 0x49, 0x44, 0x2c, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 
+0x7a, 0x65, 0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 
+0x2c, 0x20, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 
+0x20, 0x73, 0x75, 0x6d, 0x73, 0x2c, 0x20, 0x64, 0x65, 0x6c, 0x74, 0x61, 0x54, 0x69, 0x6d, 
+0x65, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2c, 0x20, 
+0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x2c, 0x20, 
+0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x73, 0x2c, 0x20, 0x74, 0x72, 0x69, 0x61, 
+0x6e, 0x67, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 
+0x2c, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x4d, 
+0x61, 0x70, 0x2c, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x4d, 0x61, 0x70, 
+0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x73, 0x74, 0x61, 0x74, 
+0x69, 0x63, 0x20, 0x62, 0x6f, 0x6f, 0x6c, 0x20, 0x49, 0x73, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x49, 0x6e, 0x43, 0x65, 0x6c, 0x6c, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 
+0x32, 0x20, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x2c, 0x20, 0x56, 0x65, 0x63, 0x33, 0x75, 0x20, 
+0x63, 0x65, 0x6c, 0x6c, 0x2c, 0x20, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x53, 0x74, 0x72, 0x65, 0x61, 0x6d, 0x73, 0x20, 0x70, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x20, 0x63, 0x6f, 0x6e, 0x73, 0x74, 
+0x20, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x42, 0x65, 0x68, 0x61, 0x76, 0x69, 
+0x6f, 0x75, 0x72, 0x50, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2a, 0x20, 
+0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x29, 0x0d, 0x0a, 0x09, 0x7b, 
+0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x75, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x43, 0x65, 0x6c, 0x6c, 0x20, 0x3d, 0x20, 0x47, 0x65, 0x74, 0x43, 0x65, 
+0x6c, 0x6c, 0x28, 0x56, 0x65, 0x63, 0x33, 0x66, 0x28, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x58, 0x5b, 0x69, 
+0x6e, 0x64, 0x65, 0x78, 0x5d, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x73, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x59, 0x5b, 0x69, 0x6e, 0x64, 
+0x65, 0x78, 0x5d, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 
+0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x5a, 0x5b, 0x69, 0x6e, 0x64, 0x65, 0x78, 
+0x5d, 0x29, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 
+0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 
+0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x72, 
+0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x43, 
+0x65, 0x6c, 0x6c, 0x2e, 0x78, 0x20, 0x3d, 0x3d, 0x20, 0x63, 0x65, 0x6c, 0x6c, 0x2e, 0x78, 
+0x20, 0x26, 0x26, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x43, 0x65, 0x6c, 
+0x6c, 0x2e, 0x79, 0x20, 0x3d, 0x3d, 0x20, 0x63, 0x65, 0x6c, 0x6c, 0x2e, 0x79, 0x20, 0x26, 
+0x26, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x43, 0x65, 0x6c, 0x6c, 0x2e, 
+0x7a, 0x20, 0x3d, 0x3d, 0x20, 0x63, 0x65, 0x6c, 0x6c, 0x2e, 0x7a, 0x3b, 0x0d, 0x0a, 0x09, 
+0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x62, 0x6f, 0x6f, 0x6c, 0x20, 0x55, 0x70, 0x64, 0x61, 
+0x74, 0x65, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x73, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x28, 0x0d, 0x0a, 0x09, 0x09, 
+0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x2c, 0x0d, 
+0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 
+0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x43, 0x6f, 0x75, 0x6e, 
+0x74, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x64, 0x79, 
+0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 
+0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 
+0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x2c, 0x0d, 0x0a, 
+0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 
+0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x44, 0x79, 0x6e, 0x61, 0x6d, 
+0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x53, 0x74, 0x72, 0x65, 0x61, 
+0x6d, 0x73, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 
+0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x2a, 0x20, 0x6f, 0x75, 0x74, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 
+0x65, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x48, 0x41, 0x53, 
+0x48, 0x5f, 0x54, 0x59, 0x50, 0x45, 0x2a, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 
+0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x75, 0x69, 0x6e, 0x74, 
+0x33, 0x32, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x70, 
+0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x53, 0x74, 0x61, 0x74, 
+0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x2a, 0x20, 0x73, 0x74, 0x61, 
+0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x0d, 0x0a, 
+0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x48, 0x41, 0x53, 0x48, 0x5f, 0x54, 0x59, 
+0x50, 0x45, 0x2a, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 0x0d, 0x0a, 0x09, 
+0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x42, 0x65, 0x68, 0x61, 0x76, 0x69, 0x6f, 0x75, 0x72, 0x50, 0x61, 0x72, 0x61, 0x6d, 0x65, 
+0x74, 0x65, 0x72, 0x73, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 
+0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x43, 0x65, 0x6c, 0x6c, 0x4e, 0x65, 0x69, 0x67, 0x68, 
+0x62, 0x6f, 0x75, 0x72, 0x43, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x73, 0x26, 
+0x20, 0x63, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x73, 0x0d, 0x0a, 0x09, 0x29, 
+0x20, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x62, 0x65, 
+0x67, 0x69, 0x6e, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x68, 0x61, 0x73, 0x68, 
+0x4d, 0x61, 0x70, 0x5b, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 
+0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 
+0x78, 0x20, 0x3d, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x5b, 0x62, 0x75, 0x63, 
+0x6b, 0x65, 0x74, 0x20, 0x2b, 0x20, 0x31, 0x5d, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 
+0x69, 0x66, 0x20, 0x28, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 
+0x3d, 0x3d, 0x20, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x29, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x74, 0x72, 0x75, 0x65, 0x3b, 0x0d, 
+0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x66, 0x69, 0x72, 
+0x73, 0x74, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x4d, 0x61, 0x70, 0x5b, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 0x6e, 0x64, 
+0x65, 0x78, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x75, 0x20, 0x63, 
+0x65, 0x6c, 0x6c, 0x20, 0x3d, 0x20, 0x47, 0x65, 0x74, 0x43, 0x65, 0x6c, 0x6c, 0x28, 0x56, 
+0x65, 0x63, 0x33, 0x66, 0x28, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x73, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x58, 0x5b, 0x66, 0x69, 0x72, 
+0x73, 0x74, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 
+0x59, 0x5b, 0x66, 0x69, 0x72, 0x73, 0x74, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x2c, 0x20, 
+0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 
+0x69, 0x74, 0x69, 0x6f, 0x6e, 0x5a, 0x5b, 0x66, 0x69, 0x72, 0x73, 0x74, 0x49, 0x6e, 0x64, 
+0x65, 0x78, 0x5d, 0x29, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 
+0x73, 0x2d, 0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 
+0x6f, 0x6e, 0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 
+0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 
+0x69, 0x63, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x5b, 0x32, 0x37, 0x5d, 0x3b, 0x0d, 
+0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 
+0x63, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x5b, 0x32, 0x37, 0x5d, 0x3b, 0x0d, 0x0a, 
+0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 
+0x63, 0x43, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 
+0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x73, 0x74, 0x61, 
+0x74, 0x69, 0x63, 0x43, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x43, 0x6f, 0x75, 
+0x6e, 0x74, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x62, 
+0x75, 0x63, 0x6b, 0x65, 0x74, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x20, 0x3d, 0x20, 0x47, 0x65, 
+0x74, 0x43, 0x65, 0x6c, 0x6c, 0x4e, 0x65, 0x69, 0x67, 0x68, 0x62, 0x6f, 0x75, 0x72, 0x42, 
+0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x28, 0x63, 0x65, 0x6c, 0x6c, 0x2c, 0x20, 0x64, 0x79, 
+0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 
+0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x73, 0x74, 0x61, 
+0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x43, 0x6f, 0x75, 
+0x6e, 0x74, 0x2c, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 
+0x2c, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 0x20, 0x73, 0x74, 0x61, 0x74, 
+0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 
+0x4d, 0x61, 0x70, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 
+0x2c, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 
+0x73, 0x2c, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 
+0x73, 0x2c, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x43, 0x61, 0x6e, 0x64, 0x69, 
+0x64, 0x61, 0x74, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x2c, 0x20, 0x73, 0x74, 0x61, 0x74, 
+0x69, 0x63, 0x43, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x43, 0x6f, 0x75, 0x6e, 
+0x74, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x64, 0x79, 
+0x6e, 0x61, 0x6d, 0x69, 0x63, 0x43, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x43, 
+0x6f, 0x75, 0x6e, 0x74, 0x20, 0x3e, 0x20, 0x63, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 
+0x65, 0x73, 0x2e, 0x63, 0x61, 0x70, 0x61, 0x63, 0x69, 0x74, 0x79, 0x20, 0x7c, 0x7c, 0x20, 
+0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x43, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 
+0x43, 0x6f, 0x75, 0x6e, 0x74, 0x20, 0x3e, 0x20, 0x63, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 
+0x74, 0x65, 0x73, 0x2e, 0x63, 0x61, 0x70, 0x61, 0x63, 0x69, 0x74, 0x79, 0x29, 0x0d, 0x0a, 
+0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x63, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 
+0x74, 0x65, 0x73, 0x2e, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x43, 0x6f, 0x75, 0x6e, 
+0x74, 0x20, 0x3d, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x43, 0x61, 0x6e, 0x64, 
+0x69, 0x64, 0x61, 0x74, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x63, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x73, 0x2e, 0x73, 0x74, 0x61, 
+0x74, 0x69, 0x63, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x20, 0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 
+0x69, 0x63, 0x43, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x43, 0x6f, 0x75, 0x6e, 
+0x74, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x66, 
+0x61, 0x6c, 0x73, 0x65, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 
+0x09, 0x47, 0x61, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x4e, 0x65, 0x69, 0x67, 
+0x68, 0x62, 0x6f, 0x75, 0x72, 0x43, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x73, 
+0x28, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 
+0x2c, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 
+0x2c, 0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x2c, 0x20, 
+0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 
+0x43, 0x6f, 0x75, 0x6e, 0x74, 0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x73, 0x2c, 0x20, 0x6e, 0x75, 0x6c, 0x6c, 0x70, 0x74, 0x72, 0x2c, 0x20, 0x68, 
+0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x4d, 0x61, 0x70, 0x2c, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 
+0x2c, 0x20, 0x63, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x73, 0x29, 0x3b, 0x0d, 
+0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 
+0x32, 0x20, 0x69, 0x20, 0x3d, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 0x6e, 0x64, 0x65, 
+0x78, 0x3b, 0x20, 0x69, 0x20, 0x3c, 0x20, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 
+0x3b, 0x20, 0x2b, 0x2b, 0x69, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 
+0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x70, 0x5b, 0x69, 0x5d, 
+0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x49, 0x73, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x43, 0x65, 0x6c, 0x6c, 0x28, 0x69, 
+0x6e, 0x64, 0x65, 0x78, 0x2c, 0x20, 0x63, 0x65, 0x6c, 0x6c, 0x2c, 0x20, 0x69, 0x6e, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 
+0x65, 0x74, 0x65, 0x72, 0x73, 0x29, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x55, 0x70, 
+0x64, 0x61, 0x74, 0x65, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 
+0x73, 0x73, 0x75, 0x72, 0x65, 0x46, 0x72, 0x6f, 0x6d, 0x43, 0x61, 0x6e, 0x64, 0x69, 0x64, 
+0x61, 0x74, 0x65, 0x73, 0x28, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x2c, 0x20, 0x69, 0x6e, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x20, 0x6f, 0x75, 0x74, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 
+0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2c, 0x20, 0x63, 
+0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x73, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x09, 0x65, 0x6c, 0x73, 0x65, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x55, 0x70, 0x64, 0x61, 
+0x74, 0x65, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x50, 0x72, 0x65, 0x73, 0x73, 
+0x75, 0x72, 0x65, 0x28, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x2c, 0x20, 0x64, 0x79, 0x6e, 0x61, 
+0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x43, 0x6f, 0x75, 
+0x6e, 0x74, 0x2c, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 
+0x65, 0x2c, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x73, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x2c, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 
+0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 
+0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x73, 0x2c, 0x20, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x73, 0x50, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x2c, 0x20, 0x68, 0x61, 
+0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x4d, 0x61, 0x70, 0x2c, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 
+0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x29, 0x3b, 0x0d, 0x0a, 
+0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 
+0x20, 0x74, 0x72, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 
+0x62, 0x6f, 0x6f, 0x6c, 0x20, 0x55, 0x70, 0x64, 0x61, 0x74, 0x65, 0x42, 0x75, 0x63, 0x6b, 
+0x65, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x44, 0x79, 0x6e, 0x61, 
+0x6d, 0x69, 0x63, 0x73, 0x28, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 
+0x20, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 
+0x74, 0x36, 0x34, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x73, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 
+0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 
+0x53, 0x69, 0x7a, 0x65, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 
+0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x73, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 
+0x36, 0x34, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 
+0x0d, 0x0a, 0x09, 0x09, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x53, 0x74, 0x72, 0x65, 0x61, 0x6d, 0x73, 0x20, 0x69, 0x6e, 0x50, 
+0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x44, 0x79, 
+0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x53, 0x74, 
+0x72, 0x65, 0x61, 0x6d, 0x73, 0x20, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x48, 
+0x41, 0x53, 0x48, 0x5f, 0x54, 0x59, 0x50, 0x45, 0x2a, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 
+0x61, 0x70, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x75, 0x69, 
+0x6e, 0x74, 0x33, 0x32, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 
+0x61, 0x70, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x53, 0x74, 
+0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x2a, 0x20, 0x73, 
+0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 
+0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x48, 0x41, 0x53, 0x48, 0x5f, 
+0x54, 0x59, 0x50, 0x45, 0x2a, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 0x0d, 
+0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 0x66, 0x6c, 0x6f, 0x61, 0x74, 0x20, 
+0x64, 0x65, 0x6c, 0x74, 0x61, 0x54, 0x69, 0x6d, 0x65, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 
+0x6f, 0x6e, 0x73, 0x74, 0x20, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x42, 0x65, 
+0x68, 0x61, 0x76, 0x69, 0x6f, 0x75, 0x72, 0x50, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 
+0x72, 0x73, 0x2a, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2c, 
+0x0d, 0x0a, 0x09, 0x09, 0x43, 0x65, 0x6c, 0x6c, 0x4e, 0x65, 0x69, 0x67, 0x68, 0x62, 0x6f, 
+0x75, 0x72, 0x43, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x73, 0x26, 0x20, 0x63, 
+0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x75, 
+0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x43, 
+0x6f, 0x75, 0x6e, 0x74, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 0x20, 
+0x54, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x2a, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 
+0x67, 0x6c, 0x65, 0x73, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 
+0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 
+0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 0x6f, 0x6e, 0x73, 0x74, 
+0x20, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x2a, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 
+0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 0x0d, 0x0a, 0x09, 0x09, 0x63, 
+0x6f, 0x6e, 0x73, 0x74, 0x20, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x2a, 0x20, 0x74, 0x72, 
+0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x4d, 0x61, 0x70, 0x0d, 0x0a, 0x09, 0x29, 0x20, 0x7b, 
+0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x62, 0x65, 0x67, 0x69, 
+0x6e, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 
+0x70, 0x5b, 0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x75, 
+0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 
+0x3d, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x5b, 0x62, 0x75, 0x63, 0x6b, 0x65, 
+0x74, 0x20, 0x2b, 0x20, 0x31, 0x5d, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x69, 0x66, 
+0x20, 0x28, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x3d, 
+0x20, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 
+0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x74, 0x72, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x0d, 
+0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x66, 0x69, 0x72, 0x73, 0x74, 
+0x49, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x4d, 0x61, 0x70, 0x5b, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 0x6e, 0x64, 0x65, 0x78, 
+0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x56, 0x65, 0x63, 0x33, 0x75, 0x20, 0x63, 0x65, 0x6c, 
+0x6c, 0x20, 0x3d, 0x20, 0x47, 0x65, 0x74, 0x43, 0x65, 0x6c, 0x6c, 0x28, 0x56, 0x65, 0x63, 
+0x33, 0x66, 0x28, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 
+0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x58, 0x5b, 0x66, 0x69, 0x72, 0x73, 0x74, 
+0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x59, 0x5b, 
+0x66, 0x69, 0x72, 0x73, 0x74, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x5d, 0x2c, 0x20, 0x69, 0x6e, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2e, 0x70, 0x6f, 0x73, 0x69, 0x74, 
+0x69, 0x6f, 0x6e, 0x5a, 0x5b, 0x66, 0x69, 0x72, 0x73, 0x74, 0x49, 0x6e, 0x64, 0x65, 0x78, 
+0x5d, 0x29, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2d, 
+0x3e, 0x6d, 0x61, 0x78, 0x49, 0x6e, 0x74, 0x65, 0x72, 0x61, 0x63, 0x74, 0x69, 0x6f, 0x6e, 
+0x44, 0x69, 0x73, 0x74, 0x61, 0x6e, 0x63, 0x65, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 
+0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 
+0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x5b, 0x32, 0x37, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 
+0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x42, 
+0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x5b, 0x32, 0x37, 0x5d, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 
+0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x43, 
+0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x3b, 0x0d, 
+0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x36, 0x34, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 
+0x63, 0x43, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 
+0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x62, 0x75, 0x63, 
+0x6b, 0x65, 0x74, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x20, 0x3d, 0x20, 0x47, 0x65, 0x74, 0x43, 
+0x65, 0x6c, 0x6c, 0x4e, 0x65, 0x69, 0x67, 0x68, 0x62, 0x6f, 0x75, 0x72, 0x42, 0x75, 0x63, 
+0x6b, 0x65, 0x74, 0x73, 0x28, 0x63, 0x65, 0x6c, 0x6c, 0x2c, 0x20, 0x64, 0x79, 0x6e, 0x61, 
+0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 
+0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 
+0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x43, 0x6f, 0x75, 0x6e, 0x74, 
+0x2c, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 
+0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 
+0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 
+0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 
+0x70, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2c, 0x20, 
+0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x2c, 
+0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x2c, 
+0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x43, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 
+0x74, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x2c, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 
+0x43, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x29, 
+0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x64, 0x79, 0x6e, 0x61, 
+0x6d, 0x69, 0x63, 0x43, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x43, 0x6f, 0x75, 
+0x6e, 0x74, 0x20, 0x3e, 0x20, 0x63, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x73, 
+0x2e, 0x63, 0x61, 0x70, 0x61, 0x63, 0x69, 0x74, 0x79, 0x20, 0x7c, 0x7c, 0x20, 0x73, 0x74, 
+0x61, 0x74, 0x69, 0x63, 0x43, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x43, 0x6f, 
+0x75, 0x6e, 0x74, 0x20, 0x3e, 0x20, 0x63, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 
+0x73, 0x2e, 0x63, 0x61, 0x70, 0x61, 0x63, 0x69, 0x74, 0x79, 0x29, 0x0d, 0x0a, 0x09, 0x09, 
+0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x63, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 
+0x73, 0x2e, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x20, 
+0x3d, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x43, 0x61, 0x6e, 0x64, 0x69, 0x64, 
+0x61, 0x74, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x63, 
+0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x73, 0x2e, 0x73, 0x74, 0x61, 0x74, 0x69, 
+0x63, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x20, 0x3d, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 
+0x43, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x3b, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x66, 0x61, 0x6c, 
+0x73, 0x65, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 0x47, 
+0x61, 0x74, 0x68, 0x65, 0x72, 0x43, 0x65, 0x6c, 0x6c, 0x4e, 0x65, 0x69, 0x67, 0x68, 0x62, 
+0x6f, 0x75, 0x72, 0x43, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x73, 0x28, 0x64, 
+0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x2c, 0x20, 
+0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x42, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x73, 0x2c, 0x20, 
+0x62, 0x75, 0x63, 0x6b, 0x65, 0x74, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x2c, 0x20, 0x73, 0x74, 
+0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x43, 0x6f, 
+0x75, 0x6e, 0x74, 0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 
+0x73, 0x2c, 0x20, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 
+0x2e, 0x70, 0x72, 0x65, 0x73, 0x73, 0x75, 0x72, 0x65, 0x2c, 0x20, 0x68, 0x61, 0x73, 0x68, 
+0x4d, 0x61, 0x70, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 
+0x70, 0x2c, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x73, 0x2c, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 0x20, 0x63, 
+0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x73, 0x29, 0x3b, 0x0d, 0x0a, 0x0d, 0x0a, 
+0x09, 0x09, 0x66, 0x6f, 0x72, 0x20, 0x28, 0x75, 0x69, 0x6e, 0x74, 0x33, 0x32, 0x20, 0x69, 
+0x20, 0x3d, 0x20, 0x62, 0x65, 0x67, 0x69, 0x6e, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x3b, 0x20, 
+0x69, 0x20, 0x3c, 0x20, 0x65, 0x6e, 0x64, 0x49, 0x6e, 0x64, 0x65, 0x78, 0x3b, 0x20, 0x2b, 
+0x2b, 0x69, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x7b, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x75, 0x69, 
+0x6e, 0x74, 0x33, 0x32, 0x20, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x20, 0x3d, 0x20, 0x70, 0x61, 
+0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x70, 0x5b, 0x69, 0x5d, 0x3b, 0x0d, 0x0a, 
+0x0d, 0x0a, 0x09, 0x09, 0x09, 0x69, 0x66, 0x20, 0x28, 0x49, 0x73, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x49, 0x6e, 0x43, 0x65, 0x6c, 0x6c, 0x28, 0x69, 0x6e, 0x64, 0x65, 
+0x78, 0x2c, 0x20, 0x63, 0x65, 0x6c, 0x6c, 0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 
+0x72, 0x73, 0x29, 0x29, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x55, 0x70, 0x64, 0x61, 0x74, 
+0x65, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x44, 0x79, 0x6e, 0x61, 0x6d, 0x69, 
+0x63, 0x73, 0x46, 0x72, 0x6f, 0x6d, 0x43, 0x61, 0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 
+0x73, 0x28, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x2c, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 
+0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 
+0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x73, 0x2c, 0x20, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 
+0x6c, 0x65, 0x73, 0x2c, 0x20, 0x64, 0x65, 0x6c, 0x74, 0x61, 0x54, 0x69, 0x6d, 0x65, 0x2c, 
+0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 0x2c, 0x20, 0x63, 0x61, 
+0x6e, 0x64, 0x69, 0x64, 0x61, 0x74, 0x65, 0x73, 0x2c, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 
+0x67, 0x6c, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x2c, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 
+0x67, 0x6c, 0x65, 0x73, 0x2c, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x48, 
+0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x74, 0x72, 0x69, 
+0x61, 0x6e, 0x67, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 0x20, 0x74, 
+0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x4d, 0x61, 0x70, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 
+0x09, 0x09, 0x65, 0x6c, 0x73, 0x65, 0x0d, 0x0a, 0x09, 0x09, 0x09, 0x09, 0x55, 0x70, 0x64, 
+0x61, 0x74, 0x65, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x44, 0x79, 0x6e, 0x61, 
+0x6d, 0x69, 0x63, 0x73, 0x28, 0x69, 0x6e, 0x64, 0x65, 0x78, 0x2c, 0x20, 0x64, 0x79, 0x6e, 
+0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x43, 0x6f, 
+0x75, 0x6e, 0x74, 0x2c, 0x20, 0x64, 0x79, 0x6e, 0x61, 0x6d, 0x69, 0x63, 0x50, 0x61, 0x72, 
+0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 
+0x7a, 0x65, 0x2c, 0x20, 0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x73, 0x43, 0x6f, 0x75, 0x6e, 0x74, 0x2c, 0x20, 0x73, 0x74, 0x61, 0x74, 
+0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x48, 0x61, 0x73, 0x68, 
+0x4d, 0x61, 0x70, 0x53, 0x69, 0x7a, 0x65, 0x2c, 0x20, 0x69, 0x6e, 0x50, 0x61, 0x72, 0x74, 
+0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x20, 0x6f, 0x75, 0x74, 0x50, 0x61, 0x72, 0x74, 0x69, 
+0x63, 0x6c, 0x65, 0x73, 0x2c, 0x20, 0x68, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 0x20, 
+0x70, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x4d, 0x61, 0x70, 0x2c, 0x20, 0x73, 0x74, 
+0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 0x2c, 0x20, 
+0x73, 0x74, 0x61, 0x74, 0x69, 0x63, 0x50, 0x61, 0x72, 0x74, 0x69, 0x63, 0x6c, 0x65, 0x73, 
+0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x2c, 0x20, 0x64, 0x65, 0x6c, 0x74, 0x61, 0x54, 
+0x69, 0x6d, 0x65, 0x2c, 0x20, 0x70, 0x61, 0x72, 0x61, 0x6d, 0x65, 0x74, 0x65, 0x72, 0x73, 
+0x2c, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x43, 0x6f, 0x75, 0x6e, 0x74, 
+0x2c, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x73, 0x2c, 0x20, 0x74, 0x72, 
+0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x48, 0x61, 0x73, 0x68, 0x4d, 0x61, 0x70, 0x53, 0x69, 
+0x7a, 0x65, 0x2c, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x48, 0x61, 0x73, 
+0x68, 0x4d, 0x61, 0x70, 0x2c, 0x20, 0x74, 0x72, 0x69, 0x61, 0x6e, 0x67, 0x6c, 0x65, 0x4d, 
+0x61, 0x70, 0x29, 0x3b, 0x0d, 0x0a, 0x09, 0x09, 0x7d, 0x0d, 0x0a, 0x0d, 0x0a, 0x09, 0x09, 
+0x72, 0x65, 0x74, 0x75, 0x72, 0x6e, 0x20, 0x74, 0x72, 0x75, 0x65, 0x3b, 0x0d, 0x0a, 0x09, 
+0x7d, 0x0d, 0x0a, 0x23, 0x65, 0x6e, 0x64, 0x69, 0x66, 0x0d, 0x0a, 0x0d, 0x0a, 0x23, 0x69, 
+0x66, 0x6e, 0x64, 0x65, 0x66, 0x20, 0x43, 0x4c, 0x5f, 0x43, 0x4f, 0x4d, 0x50, 0x49, 0x4c, 
+0x45, 0x52, 0x0d, 0x0a, 0x7d, 0x0d, 0x0a, 0x23, 0x65, 0x6e, 0x64, 0x69, 0x66, 0x0d, 0x0a, 
+'\0' };
 	const Blaze::StringView SPHKernelSource = Blaze::StringView(SPHKernelSource_str);
 }
\ No newline at end of file
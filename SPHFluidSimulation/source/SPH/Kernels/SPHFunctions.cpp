@@ -38,6 +38,16 @@ namespace SPH
 		//Constants
 		float selfDensity;
 		float smoothingKernelConstant;
+
+		//Dense grid
+		uint32 gridOriginX;
+		uint32 gridOriginY;
+		uint32 gridOriginZ;
+		uint32 gridSizeX;
+		uint32 gridSizeY;
+		uint32 gridSizeZ;
+
+		uint32 cellCurve;
 	};	
 
 	struct PACKED Triangle
@@ -62,15 +72,65 @@ namespace SPH::Details
 
 //#define DEBUG_BUFFERS_KERNEL
 
+/*
+	Scene constants of the neighbour functions. The GPU engine builds a variant of the program for the scene it's
+	initialized with that defines SCENE_MAX_INTERACTION_DISTANCE, SCENE_DYNAMIC_PARTICLES_HASH_MAP_SIZE,
+	SCENE_STATIC_PARTICLES_HASH_MAP_SIZE, SCENE_HAS_STATIC_PARTICLES and SCENE_HAS_TRIANGLES, so that the compiler can
+	fold them, drop the branches that the scene never takes and replace the modulo of the hash by a multiplication.
+	The values of the arguments are used for the ones that aren't defined. In the C++ build the presence of static
+	particles and triangles are template parameters instead, the CPU engine selects the instantiation for the scene
+	through GetUpdateParticlePressureVariant and GetUpdateParticleDynamicsVariant
+*/
+#ifdef CL_COMPILER
+#define SCENE_TEMPLATE(...)
+
+#ifdef SCENE_MAX_INTERACTION_DISTANCE
+#define MAX_INTERACTION_DISTANCE(parameters) (SCENE_MAX_INTERACTION_DISTANCE)
+#else
+#define MAX_INTERACTION_DISTANCE(parameters) ((parameters)->maxInteractionDistance)
+#endif
+
+#ifdef SCENE_DYNAMIC_PARTICLES_HASH_MAP_SIZE
+#define DYNAMIC_PARTICLES_HASH_MAP_SIZE(size) ((uint64)SCENE_DYNAMIC_PARTICLES_HASH_MAP_SIZE)
+#else
+#define DYNAMIC_PARTICLES_HASH_MAP_SIZE(size) (size)
+#endif
+
+#ifdef SCENE_STATIC_PARTICLES_HASH_MAP_SIZE
+#define STATIC_PARTICLES_HASH_MAP_SIZE(size) ((uint64)SCENE_STATIC_PARTICLES_HASH_MAP_SIZE)
+#else
+#define STATIC_PARTICLES_HASH_MAP_SIZE(size) (size)
+#endif
+
+#ifdef SCENE_HAS_STATIC_PARTICLES
+#define HAS_STATIC_PARTICLES(count) (SCENE_HAS_STATIC_PARTICLES)
+#else
+#define HAS_STATIC_PARTICLES(count) ((count) != 0)
+#endif
+
+#ifdef SCENE_HAS_TRIANGLES
+#define HAS_TRIANGLES(count) (SCENE_HAS_TRIANGLES)
+#else
+#define HAS_TRIANGLES(count) ((count) != 0)
+#endif
+#else
+#define SCENE_TEMPLATE(...) template<__VA_ARGS__>
+#define MAX_INTERACTION_DISTANCE(parameters) ((parameters)->maxInteractionDistance)
+#define DYNAMIC_PARTICLES_HASH_MAP_SIZE(size) (size)
+#define STATIC_PARTICLES_HASH_MAP_SIZE(size) (size)
+#define HAS_STATIC_PARTICLES(count) (HasStaticParticles)
+#define HAS_TRIANGLES(count) (HasTriangles)
+#endif
+
 	Vec3u Floor(Vec3f value)
 	{
 #ifdef CL_COMPILER
 		return as_uint3(convert_int3_rtn(value));
 #else
 		return Vec3u(
-			static_cast<uint>(std::floorf(value.x)), 
-			static_cast<uint>(std::floorf(value.y)), 
-			static_cast<uint>(std::floorf(value.z))
+			static_cast<uint>(std::floor(value.x)), 
+			static_cast<uint>(std::floor(value.y)), 
+			static_cast<uint>(std::floor(value.z))
 		);
 #endif
 	}
@@ -95,6 +155,55 @@ namespace SPH::Details
 		uint32 zz = ExpandBits(value.z & 0x000003FFu);
 		return xx + yy * 2 + zz * 4;
 	}
+	//Skilling's transform of the cell into the transposed Hilbert index, whose bits are then interleaved the same way
+	//as the ones of the Morton code. Unlike with the Morton code, cells with consecutive codes are always neighbours
+	uint32 Hilbert3D(Vec3u value)
+	{
+		uint32 x = value.x & 0x000003FFu;
+		uint32 y = value.y & 0x000003FFu;
+		uint32 z = value.z & 0x000003FFu;
+
+		for (uint32 q = 1u << 9; q > 1; q >>= 1)
+		{
+			uint32 p = q - 1;
+			uint32 t;
+
+			if ((x & q) != 0)
+				x ^= p;
+
+			if ((y & q) != 0)
+				x ^= p;
+			else
+			{
+				t = (x ^ y) & p;
+				x ^= t;
+				y ^= t;
+			}
+
+			if ((z & q) != 0)
+				x ^= p;
+			else
+			{
+				t = (x ^ z) & p;
+				x ^= t;
+				z ^= t;
+			}
+		}
+
+		y ^= x;
+		z ^= y;
+
+		uint32 t = 0;
+		for (uint32 q = 1u << 9; q > 1; q >>= 1)
+			if ((z & q) != 0)
+				t ^= q - 1;
+
+		x ^= t;
+		y ^= t;
+		z ^= t;
+
+		return ExpandBits(z) + ExpandBits(y) * 2 + ExpandBits(x) * 4;
+	}
 
 	inline Vec3u GetCell(Vec3f position, float maxInteractionDistance)
 	{		
@@ -112,6 +221,24 @@ namespace SPH::Details
 		//	(((uint32)cell.z) * 83492791)
 		//	);
 	}
+	//Returns the bucket the particles of the cell are stored in. With the dense grid every cell inside of it has its own
+	//bucket and all cells outside of it share the last bucket
+	inline uint32 GetCellBucket(Vec3u cell, uint64 hashMapSize, CONSTANT STRUCT ParticleBehaviourParameters* parameters)
+	{
+		if (parameters->gridSizeX == 0)
+			return (parameters->cellCurve == 1 ? Hilbert3D(cell) : GetHash(cell)) % hashMapSize;
+
+		Vec3u gridCell = cell - NEW_VEC3U(parameters->gridOriginX, parameters->gridOriginY, parameters->gridOriginZ);
+
+		if (gridCell.x >= parameters->gridSizeX || gridCell.y >= parameters->gridSizeY || gridCell.z >= parameters->gridSizeZ)
+			return (uint32)hashMapSize - 1;
+
+		return gridCell.x + parameters->gridSizeX * (gridCell.y + parameters->gridSizeY * gridCell.z);
+	}
+	inline bool IsOutsideGridBucket(uint32 bucket, uint64 hashMapSize, CONSTANT STRUCT ParticleBehaviourParameters* parameters)
+	{
+		return parameters->gridSizeX != 0 && bucket == hashMapSize - 1;
+	}
 	float SmoothingKernelConstant(float h)
 	{
 		return 15.0f / (3.1415f * h * h * h * h * h * h);
@@ -199,19 +326,19 @@ namespace SPH::Details
 		const float w = vc * denom;
 		return a + ab * v + ac * w; //#0
 	}
+	float TriangleInteractionDistance()
+	{
+		return 2.5f;
+	}
 	inline float CalculateTriangleForceAmplitude(float dist)
 	{
 		float t = 1 / dist - 1;
 		return t * t;
 	}
-	inline Vec3f CalculateTriangleForce(const Vec3f point, const STRUCT Triangle triangle)
+	inline Vec3f CalculateTriangleForce(const Vec3f point, const Vec3f closestPoint)
 	{
-		const float interactionDistance = 2.5f;		
-#ifdef CL_COMPILER
-		Vec3f vecToTriangle = ClosestPointOnTriangle(point, triangle.p1.xyz(), triangle.p2.xyz(), triangle.p3.xyz()) - point;
-#else
-		Vec3f vecToTriangle = ClosestPointOnTriangle(point, triangle.p1, triangle.p2, triangle.p3) - point;
-#endif
+		const float interactionDistance = TriangleInteractionDistance();
+		Vec3f vecToTriangle = closestPoint - point;
 		float dist = sqrt(dot(vecToTriangle, vecToTriangle));
 
 		Vec3f forceDir = -vecToTriangle / dist;
@@ -221,6 +348,66 @@ namespace SPH::Details
 		
 		return forceDir * CalculateTriangleForceAmplitude(dist / interactionDistance) * 50;		
 	}
+	//The triangles are binned into every cell (with the size of the triangle interaction distance) that their
+	//bounding box overlaps, so only the 27 cells around the particle need to be checked. Because a triangle can be 
+	//stored in more than one of those cells it is only applied from the bucket of the cell that contains the
+	//closest point on the triangle.
+	inline Vec3f CalculateBoundaryForce(
+		const Vec3f point,
+		uint64 triangleHashMapSize,
+		CONSTANT uint32* triangleHashMap,
+		CONSTANT uint32* triangleMap,
+		CONSTANT STRUCT Triangle* triangles
+	) {
+		const float interactionDistance = TriangleInteractionDistance();
+
+		Vec3f force = NEW_VEC3F(0, 0, 0);
+
+		Vec3u cell = GetCell(point, interactionDistance);
+		Vec3u beginCell = cell - NEW_VEC3U(1, 1, 1);
+		Vec3u endCell = cell + NEW_VEC3U(2, 2, 2);
+
+		uint32 visitedHashes[27];
+		uint32 visitedHashCount = 0;
+
+		Vec3u otherCell;
+		for (otherCell.x = beginCell.x; otherCell.x != endCell.x; ++otherCell.x)
+			for (otherCell.y = beginCell.y; otherCell.y != endCell.y; ++otherCell.y)
+				for (otherCell.z = beginCell.z; otherCell.z != endCell.z; ++otherCell.z)
+				{
+					uint32 otherHashMod = GetHash(otherCell) % triangleHashMapSize;
+
+					//Two neighbouring cells can land in the same bucket, it must be checked only once
+					bool visited = false;
+					for (uint32 i = 0; i < visitedHashCount; ++i)
+						visited = visited || visitedHashes[i] == otherHashMod;
+
+					if (visited)
+						continue;
+
+					visitedHashes[visitedHashCount++] = otherHashMod;
+
+					uint32 beginIndex = triangleHashMap[otherHashMod];
+					uint32 endIndex = triangleHashMap[otherHashMod + 1];
+
+					for (uint32 i = beginIndex; i < endIndex; ++i)
+					{
+						CONSTANT STRUCT Triangle* triangle = triangles + triangleMap[i];
+#ifdef CL_COMPILER
+						Vec3f closestPoint = ClosestPointOnTriangle(point, triangle->p1.xyz(), triangle->p2.xyz(), triangle->p3.xyz());
+#else
+						Vec3f closestPoint = ClosestPointOnTriangle(point, triangle->p1, triangle->p2, triangle->p3);
+#endif
+
+						if (GetHash(GetCell(closestPoint, interactionDistance)) % triangleHashMapSize != otherHashMod)
+							continue;
+
+						force += CalculateTriangleForce(point, closestPoint);
+					}
+				}
+
+		return force;
+	}
 
 #ifdef CL_COMPILER
 	//array should be sized get_enqueued_local_size(0) * get_num_groups(0) * 2
@@ -292,6 +479,241 @@ namespace SPH::Details
 
 		arrays[(index + get_local_id(0) + 1) * scale - 1] += inc;
 	}
+
+	/*
+		Reduce-then-scan of an array of any size in three dispatches. The array is split into one tile per work group,
+		every tile is a multiple of the work group size. The first pass sums every tile, the second scans the tile sums
+		in a single work group and the third scans every tile starting from the sum of the tiles before it. All work
+		groups must be full, the work items past the end of the array use 0.
+	*/
+
+	//Inclusive scan of one value per work item of the group, 'temp' must hold get_local_size(0) values. The sum of all
+	//the values is written into 'total'
+	uint WorkGroupInclusiveScan(local uint* temp, uint value, uint* total)
+	{
+		uint localID = get_local_id(0);
+		uint localSize = get_local_size(0);
+
+		temp[localID] = value;
+
+		for (uint offset = 1; offset < localSize; offset <<= 1)
+		{
+			barrier(CLK_LOCAL_MEM_FENCE);
+			uint other = localID >= offset ? temp[localID - offset] : 0;
+			barrier(CLK_LOCAL_MEM_FENCE);
+			temp[localID] += other;
+		}
+
+		barrier(CLK_LOCAL_MEM_FENCE);
+		value = temp[localID];
+		*total = temp[localSize - 1];
+		//'temp' can be reused after the function returns
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		return value;
+	}
+	void kernel InclusiveScanReduceTiles(local uint* temp, global uint* array, uint64 size, uint64 tileSize, global uint* tileSums)
+	{
+		uint64 tileBegin = get_group_id(0) * tileSize;
+		uint64 tileEnd = min(tileBegin + tileSize, size);
+
+		uint sum = 0;
+		for (uint64 i = tileBegin + get_local_id(0); i < tileEnd; i += get_local_size(0))
+			sum += array[i];
+
+		uint total;
+		WorkGroupInclusiveScan(temp, sum, &total);
+
+		if (get_local_id(0) == 0)
+			tileSums[get_group_id(0)] = total;
+	}
+	//Launched with a single work group, replaces the tile sums with the sums of the tiles before them
+	void kernel InclusiveScanTileSums(local uint* temp, global uint* tileSums, uint64 tileCount)
+	{
+		uint carry = 0;
+		for (uint64 chunkBegin = 0; chunkBegin < tileCount; chunkBegin += get_local_size(0))
+		{
+			uint64 i = chunkBegin + get_local_id(0);
+			uint value = i < tileCount ? tileSums[i] : 0;
+
+			uint total;
+			uint sum = WorkGroupInclusiveScan(temp, value, &total);
+
+			if (i < tileCount)
+				tileSums[i] = carry + sum - value;
+
+			carry += total;
+		}
+	}
+	void kernel InclusiveScanTiles(local uint* temp, global uint* array, uint64 size, uint64 tileSize, global uint* tileSums)
+	{
+		uint64 tileBegin = get_group_id(0) * tileSize;
+		uint64 tileEnd = min(tileBegin + tileSize, size);
+
+		uint carry = tileSums[get_group_id(0)];
+		for (uint64 chunkBegin = tileBegin; chunkBegin < tileEnd; chunkBegin += get_local_size(0))
+		{
+			uint64 i = chunkBegin + get_local_id(0);
+			uint value = i < tileEnd ? array[i] : 0;
+
+			uint total;
+			uint sum = WorkGroupInclusiveScan(temp, value, &total);
+
+			if (i < tileEnd)
+				array[i] = carry + sum;
+
+			carry += total;
+		}
+	}
+
+	/*
+		Stable LSD radix sort of 32 bit keys with 32 bit values, 4 bits of the keys per pass. The array is split into tiles
+		like for the reduce-then-scan above. RadixSortHistogram counts the digits of every tile into 'histogram' digit
+		major, so that its inclusive scan ends right before where the elements of the next digit and tile go.
+		RadixSortScatter then moves the elements of its tile a chunk of one element per work item at a time, sorting
+		the chunk by the digit in local memory first, with a split on every bit of the digit. The result doesn't depend
+		on how the work items are scheduled
+	*/
+#define RADIX_SORT_DIGIT_BITS 4
+#define RADIX_SORT_DIGIT_COUNT (1 << RADIX_SORT_DIGIT_BITS)
+
+	void kernel RadixSortHistogram(global uint* keys, uint64 size, uint64 tileSize, uint shift, global uint* histogram)
+	{
+		local uint digitCounts[RADIX_SORT_DIGIT_COUNT];
+
+		for (uint digit = get_local_id(0); digit < RADIX_SORT_DIGIT_COUNT; digit += get_local_size(0))
+			digitCounts[digit] = 0;
+
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		uint64 tileBegin = get_group_id(0) * tileSize;
+		uint64 tileEnd = min(tileBegin + tileSize, size);
+
+		for (uint64 i = tileBegin + get_local_id(0); i < tileEnd; i += get_local_size(0))
+			atomic_inc(digitCounts + ((keys[i] >> shift) & (RADIX_SORT_DIGIT_COUNT - 1)));
+
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		for (uint digit = get_local_id(0); digit < RADIX_SORT_DIGIT_COUNT; digit += get_local_size(0))
+			histogram[digit * get_num_groups(0) + get_group_id(0)] = digitCounts[digit];
+	}
+	//'histogram' must be scanned, 'tempScan', 'tempKeys' and 'tempValues' must hold get_local_size(0) values
+	void kernel RadixSortScatter(local uint* tempScan, local uint* tempKeys, local uint* tempValues, global uint* keys, global uint* values, global uint* outKeys, global uint* outValues, uint64 size, uint64 tileSize, uint shift, global uint* histogram)
+	{
+		//Where the next element of every digit of the tile goes
+		local uint digitOutputIndices[RADIX_SORT_DIGIT_COUNT];
+		local uint chunkDigitCounts[RADIX_SORT_DIGIT_COUNT];
+		local uint chunkDigitBegins[RADIX_SORT_DIGIT_COUNT];
+
+		uint localID = get_local_id(0);
+		uint localSize = get_local_size(0);
+
+		for (uint digit = localID; digit < RADIX_SORT_DIGIT_COUNT; digit += localSize)
+		{
+			uint histogramIndex = digit * get_num_groups(0) + get_group_id(0);
+			digitOutputIndices[digit] = histogramIndex == 0 ? 0 : histogram[histogramIndex - 1];
+		}
+
+		uint64 tileBegin = get_group_id(0) * tileSize;
+		uint64 tileEnd = min(tileBegin + tileSize, size);
+
+		for (uint64 chunkBegin = tileBegin; chunkBegin < tileEnd; chunkBegin += localSize)
+		{
+			uint chunkSize = min(tileEnd - chunkBegin, (uint64)localSize);
+
+			for (uint digit = localID; digit < RADIX_SORT_DIGIT_COUNT; digit += localSize)
+				chunkDigitCounts[digit] = 0;
+
+			barrier(CLK_LOCAL_MEM_FENCE);
+
+			//The work items past the end get the largest digit, they stay behind all the elements of the chunk
+			bool valid = localID < chunkSize;
+			uint key = valid ? keys[chunkBegin + localID] : UINT_MAX;
+			uint value = valid ? values[chunkBegin + localID] : 0;
+			uint digit = (key >> shift) & (RADIX_SORT_DIGIT_COUNT - 1);
+
+			if (valid)
+				atomic_inc(chunkDigitCounts + digit);
+
+			//Every split moves the elements with the bit cleared in front of the ones with it set, keeping their order
+			for (uint bit = 0; bit < RADIX_SORT_DIGIT_BITS; ++bit)
+			{
+				uint isZero = ((digit >> bit) & 1) == 0 ? 1 : 0;
+
+				uint zeroCount;
+				uint zerosUpToThis = WorkGroupInclusiveScan(tempScan, isZero, &zeroCount);
+				uint position = isZero ? zerosUpToThis - 1 : zeroCount + localID - zerosUpToThis;
+
+				tempKeys[position] = key;
+				tempValues[position] = value;
+
+				barrier(CLK_LOCAL_MEM_FENCE);
+
+				key = tempKeys[localID];
+				value = tempValues[localID];
+				digit = (key >> shift) & (RADIX_SORT_DIGIT_COUNT - 1);
+
+				barrier(CLK_LOCAL_MEM_FENCE);
+			}
+
+			if (localID == 0)
+			{
+				uint sum = 0;
+				for (uint i = 0; i < RADIX_SORT_DIGIT_COUNT; ++i)
+				{
+					chunkDigitBegins[i] = sum;
+					sum += chunkDigitCounts[i];
+				}
+			}
+
+			barrier(CLK_LOCAL_MEM_FENCE);
+
+			if (localID < chunkSize)
+			{
+				uint outIndex = digitOutputIndices[digit] + localID - chunkDigitBegins[digit];
+				outKeys[outIndex] = key;
+				outValues[outIndex] = value;
+			}
+
+			barrier(CLK_LOCAL_MEM_FENCE);
+
+			for (uint i = localID; i < RADIX_SORT_DIGIT_COUNT; i += localSize)
+				digitOutputIndices[i] += chunkDigitCounts[i];
+
+			barrier(CLK_LOCAL_MEM_FENCE);
+		}
+	}
+	//The radix sort keys of the dynamic particles are their hashes, the values their indices
+	void kernel PrepareDynamicParticlesSort(CONSTANT STRUCT DynamicParticle* particles, global uint* keys, global uint* values, uint64 particleCount)
+	{
+		STOP_EXTENSIVE_WORK_ITEMS(particleCount)
+
+		uint index = get_global_id(0);
+		keys[index] = as_uint(particles[index].velocityAndHash.w);
+		values[index] = index;
+	}
+	//Launched with one work item more than there are keys. Every bucket gets the index of the first sorted key that
+	//isn't smaller than it, or the key count
+	void kernel FinishSortedHashMap(global HASH_TYPE* hashMap, uint64 hashMapSize, global uint* sortedKeys, uint64 keyCount)
+	{
+		STOP_EXTENSIVE_WORK_ITEMS(keyCount + 1)
+
+		uint index = get_global_id(0);
+		uint bucketBegin = index == 0 ? 0 : sortedKeys[index - 1] + 1;
+		uint bucketEnd = index == keyCount ? hashMapSize + 1 : sortedKeys[index] + 1;
+
+		for (uint bucket = bucketBegin; bucket < bucketEnd; ++bucket)
+			hashMap[bucket] = index;
+	}
+	//Moves the particles into the order of the sorted particle map, which is then reset to the identity
+	void kernel GatherSortedDynamicParticles(global uint* particleMap, CONSTANT STRUCT DynamicParticle* inParticles, GLOBAL STRUCT DynamicParticle* outParticles, uint64 particleCount)
+	{
+		STOP_EXTENSIVE_WORK_ITEMS(particleCount)
+
+		uint index = get_global_id(0);
+		outParticles[index] = inParticles[particleMap[index]];
+		particleMap[index] = index;
+	}
 #endif
 
 	void KERNEL PrepareStaticParticlesHashMap(uint64 threadID, volatile GLOBAL HASH_TYPE* hashMap, uint64 hashMapSize, CONSTANT STRUCT StaticParticle* inParticles, float maxInteractionDistance, uint64 particleCount)
@@ -355,6 +777,7 @@ namespace SPH::Details
 		particleMap[index] = (uint32)threadID;
 	}
 
+	SCENE_TEMPLATE(bool HasStaticParticles)
 	void KERNEL UpdateParticlePressure(
 		uint64 threadID,
 		uint64 dynamicParticlesCount,
@@ -385,7 +808,7 @@ namespace SPH::Details
 
 		Vec3f particlePosition = inParticlePtr->positionAndPressure.xyz();
 
-		Vec3u cell = GetCell(particlePosition, parameters->maxInteractionDistance);
+		Vec3u cell = GetCell(particlePosition, MAX_INTERACTION_DISTANCE(parameters));
 
 		Vec3u beginCell = cell - NEW_VEC3U(1, 1, 1);
 		Vec3u endCell = cell + NEW_VEC3U(2, 2, 2);
@@ -393,15 +816,25 @@ namespace SPH::Details
 		float dynamicParticleInfluenceSum = 0;
 		float staticParticleInfluenceSum = 0;
 
+		bool outsideGridBucketVisited = false;
+
 		Vec3u otherCell;
 		for (otherCell.x = beginCell.x; otherCell.x != endCell.x; ++otherCell.x)
 			for (otherCell.y = beginCell.y; otherCell.y != endCell.y; ++otherCell.y)
 				for (otherCell.z = beginCell.z; otherCell.z != endCell.z; ++otherCell.z)
 				{
-					uint32 otherHash = GetHash(otherCell);
+					uint32 otherHashMod = GetCellBucket(otherCell, DYNAMIC_PARTICLES_HASH_MAP_SIZE(dynamicParticlesHashMapSize), parameters);
+
+					//With the dense grid all cells outside of it share one bucket, it must be checked only once
+					if (IsOutsideGridBucket(otherHashMod, DYNAMIC_PARTICLES_HASH_MAP_SIZE(dynamicParticlesHashMapSize), parameters))
+					{
+						if (outsideGridBucketVisited)
+							continue;
+
+						outsideGridBucketVisited = true;
+					}
 
 					//Calculating dynamic particle pressure
-					uint32 otherHashMod = otherHash % dynamicParticlesHashMapSize;
 					uint32 beginIndex = hashMap[otherHashMod];
 					uint32 endIndex = hashMap[otherHashMod + 1];
 
@@ -444,19 +877,19 @@ namespace SPH::Details
 						Vec3f dir = otherParticlePtr->positionAndPressure.xyz() - particlePosition;
 						float distSqr = dot(dir, dir);
 
-						if (distSqr > parameters->maxInteractionDistance * parameters->maxInteractionDistance)
+						if (distSqr > MAX_INTERACTION_DISTANCE(parameters) * MAX_INTERACTION_DISTANCE(parameters))
 							continue;
 
 						float dist = sqrt(distSqr);
 
-						dynamicParticleInfluenceSum += SmoothingKernelD0(dist, parameters->maxInteractionDistance);
+						dynamicParticleInfluenceSum += SmoothingKernelD0(dist, MAX_INTERACTION_DISTANCE(parameters));
 					}
 
-					if (staticParticlesCount == 0)
+					if (!HAS_STATIC_PARTICLES(staticParticlesCount))
 						continue;
 
 					//Calculating static particle pressure
-					otherHashMod = otherHash % staticParticlesHashMapSize;
+					otherHashMod = GetCellBucket(otherCell, STATIC_PARTICLES_HASH_MAP_SIZE(staticParticlesHashMapSize), parameters);
 					beginIndex = staticParticlesHashMap[otherHashMod];
 					endIndex = staticParticlesHashMap[otherHashMod + 1];
 
@@ -485,12 +918,12 @@ namespace SPH::Details
 						Vec3f dir = otherParticlePtr->positionAndPressure.xyz() - particlePosition;
 						float distSqr = dot(dir, dir);
 
-						if (distSqr > parameters->maxInteractionDistance * parameters->maxInteractionDistance)
+						if (distSqr > MAX_INTERACTION_DISTANCE(parameters) * MAX_INTERACTION_DISTANCE(parameters))
 							continue;
 
 						float dist = sqrt(distSqr);
 
-						staticParticleInfluenceSum += SmoothingKernelD0(dist, parameters->maxInteractionDistance);
+						staticParticleInfluenceSum += SmoothingKernelD0(dist, MAX_INTERACTION_DISTANCE(parameters));
 					}
 				}
 
@@ -500,6 +933,7 @@ namespace SPH::Details
 		outParticlePtr->positionAndPressure.w = particlePressure;
 	}
 
+	SCENE_TEMPLATE(bool HasStaticParticles, bool HasTriangles)
 	void KERNEL UpdateParticleDynamics(
 		uint64 threadID,
 		uint64 dynamicParticlesCount,
@@ -515,7 +949,10 @@ namespace SPH::Details
 		const float deltaTime,
 		CONSTANT STRUCT ParticleBehaviourParameters* parameters,
 		uint64 triangleCount,
-		CONSTANT STRUCT Triangle* triangles
+		CONSTANT STRUCT Triangle* triangles,
+		uint64 triangleHashMapSize,
+		CONSTANT uint32* triangleHashMap,
+		CONSTANT uint32* triangleMap
 	) {
 		STOP_EXTENSIVE_WORK_ITEMS(dynamicParticlesCount)
 		INITIALIZE_THREAD_ID();
@@ -531,7 +968,7 @@ namespace SPH::Details
 		float particleHash_FLOAT = inParticlePtr->velocityAndHash.w;
 		uint32 particleHash = *(uint32*)&particleHash_FLOAT;
 
-		Vec3u cell = GetCell(particlePosition, parameters->maxInteractionDistance);
+		Vec3u cell = GetCell(particlePosition, MAX_INTERACTION_DISTANCE(parameters));
 
 		Vec3u beginCell = cell - NEW_VEC3U(1, 1, 1);
 		Vec3u endCell = cell + NEW_VEC3U(2, 2, 2);
@@ -543,14 +980,24 @@ namespace SPH::Details
 
 		float particleDensity = particlePressure / parameters->gasConstant + parameters->restDensity;
 
+		bool outsideGridBucketVisited = false;
+
 		Vec3u otherCell;
 		for (otherCell.x = beginCell.x; otherCell.x != endCell.x; ++otherCell.x)
 			for (otherCell.y = beginCell.y; otherCell.y != endCell.y; ++otherCell.y)
 				for (otherCell.z = beginCell.z; otherCell.z != endCell.z; ++otherCell.z)
 				{
-					uint32 otherHash = GetHash(otherCell);
+					uint32 otherHashMod = GetCellBucket(otherCell, DYNAMIC_PARTICLES_HASH_MAP_SIZE(dynamicParticlesHashMapSize), parameters);
+
+					//With the dense grid all cells outside of it share one bucket, it must be checked only once
+					if (IsOutsideGridBucket(otherHashMod, DYNAMIC_PARTICLES_HASH_MAP_SIZE(dynamicParticlesHashMapSize), parameters))
+					{
+						if (outsideGridBucketVisited)
+							continue;
+
+						outsideGridBucketVisited = true;
+					}
 
-					uint32 otherHashMod = otherHash % dynamicParticlesHashMapSize;
 					uint32 beginIndex = hashMap[otherHashMod];
 					uint32 endIndex = hashMap[otherHashMod + 1];
 
@@ -568,7 +1015,7 @@ namespace SPH::Details
 						Vec3f dir = otherParticlePosition - particlePosition;
 						float distSqr = dot(dir, dir);
 
-						if (distSqr > parameters->maxInteractionDistance * parameters->maxInteractionDistance)
+						if (distSqr > MAX_INTERACTION_DISTANCE(parameters) * MAX_INTERACTION_DISTANCE(parameters))
 							continue;
 
 						float dist = sqrt(distSqr);
@@ -582,16 +1029,16 @@ namespace SPH::Details
 							dir /= dist;
 
 						//apply pressure force					
-						dynamicParticlePressureForce += dir * (particlePressure + otherParticlePressure) * SmoothingKernelD1(dist, parameters->maxInteractionDistance);
+						dynamicParticlePressureForce += dir * (particlePressure + otherParticlePressure) * SmoothingKernelD1(dist, MAX_INTERACTION_DISTANCE(parameters));
 
 						//apply viscosity force					
-						dynamicParticleViscosityForce += (otherParticleVelocity - particleVelocity) * SmoothingKernelD2(dist, parameters->maxInteractionDistance);
+						dynamicParticleViscosityForce += (otherParticleVelocity - particleVelocity) * SmoothingKernelD2(dist, MAX_INTERACTION_DISTANCE(parameters));
 					}
 
-					if (staticParticlesCount == 0)
+					if (!HAS_STATIC_PARTICLES(staticParticlesCount))
 						continue;
 
-					otherHashMod = otherHash % staticParticlesHashMapSize;
+					otherHashMod = GetCellBucket(otherCell, STATIC_PARTICLES_HASH_MAP_SIZE(staticParticlesHashMapSize), parameters);
 					beginIndex = staticParticlesHashMap[otherHashMod];
 					endIndex = staticParticlesHashMap[otherHashMod + 1];
 
@@ -602,7 +1049,7 @@ namespace SPH::Details
 						Vec3f dir = otherParticle.positionAndPressure.xyz() - particlePosition;
 						float distSqr = dot(dir, dir);
 
-						if (distSqr > parameters->maxInteractionDistance * parameters->maxInteractionDistance)
+						if (distSqr > MAX_INTERACTION_DISTANCE(parameters) * MAX_INTERACTION_DISTANCE(parameters))
 							continue;
 
 						float dist = sqrt(distSqr);
@@ -616,10 +1063,10 @@ namespace SPH::Details
 							dir /= dist;
 
 						//apply pressure force					
-						staticParticlePressureForce += dir * fabs(particlePressure) * SmoothingKernelD1(dist, parameters->maxInteractionDistance);
+						staticParticlePressureForce += dir * fabs(particlePressure) * SmoothingKernelD1(dist, MAX_INTERACTION_DISTANCE(parameters));
 
 						//apply viscosity force					
-						staticParticleViscosityForce += -particleVelocity * SmoothingKernelD2(dist, parameters->maxInteractionDistance);
+						staticParticleViscosityForce += -particleVelocity * SmoothingKernelD2(dist, MAX_INTERACTION_DISTANCE(parameters));
 					}
 				}
 
@@ -633,16 +1080,16 @@ namespace SPH::Details
 		particleForce += dynamicParticleViscosityForce;
 		particleForce += staticParticlePressureForce;
 		particleForce += staticParticleViscosityForce;
-		for (uintMem i = 0; i < triangleCount; ++i)
-			particleForce += CalculateTriangleForce(particlePosition, triangles[i]);
+		if (HAS_TRIANGLES(triangleCount))
+			particleForce += CalculateBoundaryForce(particlePosition, triangleHashMapSize, triangleHashMap, triangleMap, triangles);
 		Vec3f acceleration = particleForce / particleDensity + NEW_VEC3F(parameters->gravityX, parameters->gravityY, parameters->gravityZ);
 
 		//Integrate
 		particleVelocity += acceleration * deltaTime;
 		particlePosition += particleVelocity * deltaTime;
 
-		cell = GetCell(particlePosition, parameters->maxInteractionDistance);
-		particleHash = GetHash(cell) % dynamicParticlesHashMapSize;
+		cell = GetCell(particlePosition, MAX_INTERACTION_DISTANCE(parameters));
+		particleHash = GetCellBucket(cell, DYNAMIC_PARTICLES_HASH_MAP_SIZE(dynamicParticlesHashMapSize), parameters);
 
 #ifdef CL_COMPILER
 		outParticlePtr->positionAndPressure.xyz = particlePosition;
@@ -655,6 +1102,1775 @@ namespace SPH::Details
 
 	}
 
+#ifdef CL_COMPILER
+	/*
+		Versions of UpdateParticlePressure and UpdateParticleDynamics that stage the neighbours in local memory. A work
+		group evaluates the particles of one bucket of the dynamic particles hash map at a time, these all have the same
+		neighbour buckets. The particles of every neighbour bucket are loaded into local memory in tiles of one particle
+		per work item and every work item of the group reads them from there instead of from global memory. When hashes
+		collide a bucket holds particles of different cells, their neighbour buckets differ, so the cells of a bucket
+		are evaluated one after another. The work groups take the buckets listed by ListOccupiedBuckets in turns. The
+		neighbours are visited in the same order as by the kernels above
+	*/
+
+	//Writes the buckets of the dynamic particles hash map that hold any particles into 'occupiedBuckets' in no
+	//particular order. 'occupiedBucketCount' must be 0 before
+	void kernel ListOccupiedBuckets(global uint* occupiedBuckets, volatile global uint* occupiedBucketCount, CONSTANT HASH_TYPE* hashMap, CONSTANT uint32* particleMap, CONSTANT STRUCT DynamicParticle* particles, uint64 particleCount)
+	{
+		STOP_EXTENSIVE_WORK_ITEMS(particleCount)
+
+		uint32 index = get_global_id(0);
+		uint32 particleHash = as_uint(particles[particleMap[index]].velocityAndHash.w);
+
+		//Only the first particle of a bucket lists it
+		if (hashMap[particleHash] == index)
+			occupiedBuckets[atomic_inc(occupiedBucketCount)] = particleHash;
+	}
+	//Returns the local ID of a work item that has 'pending' set, or UINT_MAX when none has it. All work items of the
+	//group get the same value
+	uint32 SelectPendingWorkItem(volatile local uint32* selected, bool pending)
+	{
+		if (get_local_id(0) == 0)
+			*selected = UINT_MAX;
+
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		if (pending)
+			atomic_min(selected, (uint32)get_local_id(0));
+
+		barrier(CLK_LOCAL_MEM_FENCE);
+		uint32 value = *selected;
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		return value;
+	}
+	void kernel UpdateParticlePressureTiled(
+		uint64 dynamicParticlesHashMapSize,
+		uint64 staticParticlesCount,
+		uint64 staticParticlesHashMapSize,
+		CONSTANT STRUCT DynamicParticle* inParticles,
+		GLOBAL STRUCT DynamicParticle* outParticles,
+		CONSTANT HASH_TYPE* hashMap,
+		CONSTANT uint32* particleMap,
+		CONSTANT STRUCT StaticParticle* staticParticles,
+		CONSTANT HASH_TYPE* staticParticlesHashMap,
+		CONSTANT STRUCT ParticleBehaviourParameters* parameters,
+		CONSTANT uint32* occupiedBuckets,
+		CONSTANT uint32* occupiedBucketCount,
+		local Vec4f* tilePositions,
+		local uint32* tileIndices
+	) {
+		local uint32 selectedWorkItem;
+		local Vec3u selectedCell;
+
+		uint32 localID = get_local_id(0);
+		uint32 localSize = get_local_size(0);
+		float maxInteractionDistanceSqr = MAX_INTERACTION_DISTANCE(parameters) * MAX_INTERACTION_DISTANCE(parameters);
+
+		for (uint32 occupiedBucketIndex = get_group_id(0); occupiedBucketIndex < *occupiedBucketCount; occupiedBucketIndex += get_num_groups(0))
+		{
+			uint32 bucket = occupiedBuckets[occupiedBucketIndex];
+			uint32 bucketBegin = hashMap[bucket];
+			uint32 bucketEnd = hashMap[bucket + 1];
+
+			for (uint32 chunkBegin = bucketBegin; chunkBegin < bucketEnd; chunkBegin += localSize)
+			{
+				bool pending = chunkBegin + localID < bucketEnd;
+				uint32 particleIndex = pending ? particleMap[chunkBegin + localID] : 0;
+				Vec3f particlePosition = inParticles[particleIndex].positionAndPressure.xyz;
+				Vec3u particleCell = GetCell(particlePosition, MAX_INTERACTION_DISTANCE(parameters));
+
+				//Usually all the particles of a bucket are in one cell and this runs once
+				while (true)
+				{
+					uint32 selected = SelectPendingWorkItem(&selectedWorkItem, pending);
+
+					if (selected == UINT_MAX)
+						break;
+
+					if (localID == selected)
+						selectedCell = particleCell;
+
+					barrier(CLK_LOCAL_MEM_FENCE);
+
+					Vec3u cell = selectedCell;
+					bool active = pending && all(particleCell == cell);
+
+					Vec3u beginCell = cell - NEW_VEC3U(1, 1, 1);
+					Vec3u endCell = cell + NEW_VEC3U(2, 2, 2);
+
+					float dynamicParticleInfluenceSum = 0;
+					float staticParticleInfluenceSum = 0;
+
+					bool outsideGridBucketVisited = false;
+
+					Vec3u otherCell;
+					for (otherCell.x = beginCell.x; otherCell.x != endCell.x; ++otherCell.x)
+						for (otherCell.y = beginCell.y; otherCell.y != endCell.y; ++otherCell.y)
+							for (otherCell.z = beginCell.z; otherCell.z != endCell.z; ++otherCell.z)
+							{
+								uint32 otherHashMod = GetCellBucket(otherCell, DYNAMIC_PARTICLES_HASH_MAP_SIZE(dynamicParticlesHashMapSize), parameters);
+
+								if (IsOutsideGridBucket(otherHashMod, DYNAMIC_PARTICLES_HASH_MAP_SIZE(dynamicParticlesHashMapSize), parameters))
+								{
+									if (outsideGridBucketVisited)
+										continue;
+
+									outsideGridBucketVisited = true;
+								}
+
+								uint32 beginIndex = hashMap[otherHashMod];
+								uint32 endIndex = hashMap[otherHashMod + 1];
+
+								for (uint32 tileBegin = beginIndex; tileBegin < endIndex; tileBegin += localSize)
+								{
+									uint32 tileSize = min(endIndex - tileBegin, localSize);
+
+									//The previous tile must be read by all work items before it's overwritten
+									barrier(CLK_LOCAL_MEM_FENCE);
+
+									if (localID < tileSize)
+									{
+										uint32 index = particleMap[tileBegin + localID];
+										tileIndices[localID] = index;
+										tilePositions[localID] = inParticles[index].positionAndPressure;
+									}
+
+									barrier(CLK_LOCAL_MEM_FENCE);
+
+									if (!active)
+										continue;
+
+									for (uint32 i = 0; i < tileSize; ++i)
+									{
+										if (tileIndices[i] == particleIndex)
+											continue;
+
+										Vec3f dir = tilePositions[i].xyz - particlePosition;
+										float distSqr = dot(dir, dir);
+
+										if (distSqr > maxInteractionDistanceSqr)
+											continue;
+
+										float dist = sqrt(distSqr);
+
+										dynamicParticleInfluenceSum += SmoothingKernelD0(dist, MAX_INTERACTION_DISTANCE(parameters));
+									}
+								}
+
+								if (!HAS_STATIC_PARTICLES(staticParticlesCount))
+									continue;
+
+								otherHashMod = GetCellBucket(otherCell, STATIC_PARTICLES_HASH_MAP_SIZE(staticParticlesHashMapSize), parameters);
+								beginIndex = staticParticlesHashMap[otherHashMod];
+								endIndex = staticParticlesHashMap[otherHashMod + 1];
+
+								for (uint32 tileBegin = beginIndex; tileBegin < endIndex; tileBegin += localSize)
+								{
+									uint32 tileSize = min(endIndex - tileBegin, localSize);
+
+									barrier(CLK_LOCAL_MEM_FENCE);
+
+									if (localID < tileSize)
+										tilePositions[localID] = staticParticles[tileBegin + localID].positionAndPressure;
+
+									barrier(CLK_LOCAL_MEM_FENCE);
+
+									if (!active)
+										continue;
+
+									for (uint32 i = 0; i < tileSize; ++i)
+									{
+										Vec3f dir = tilePositions[i].xyz - particlePosition;
+										float distSqr = dot(dir, dir);
+
+										if (distSqr > maxInteractionDistanceSqr)
+											continue;
+
+										float dist = sqrt(distSqr);
+
+										staticParticleInfluenceSum += SmoothingKernelD0(dist, MAX_INTERACTION_DISTANCE(parameters));
+									}
+								}
+							}
+
+					if (active)
+					{
+						float particleDensity = parameters->selfDensity + (dynamicParticleInfluenceSum * parameters->particleMass + staticParticleInfluenceSum * parameters->particleMass) * parameters->smoothingKernelConstant;
+						float particlePressure = parameters->gasConstant * (particleDensity - parameters->restDensity);
+
+						outParticles[particleIndex].positionAndPressure.w = particlePressure;
+						pending = false;
+					}
+				}
+			}
+		}
+	}
+	void kernel UpdateParticleDynamicsTiled(
+		uint64 dynamicParticlesHashMapSize,
+		uint64 staticParticlesCount,
+		uint64 staticParticlesHashMapSize,
+		CONSTANT STRUCT DynamicParticle* inParticles,
+		GLOBAL STRUCT DynamicParticle* outParticles,
+		CONSTANT HASH_TYPE* hashMap,
+		CONSTANT uint32* particleMap,
+		CONSTANT STRUCT StaticParticle* staticParticles,
+		CONSTANT HASH_TYPE* staticParticlesHashMap,
+		const float deltaTime,
+		CONSTANT STRUCT ParticleBehaviourParameters* parameters,
+		uint64 triangleCount,
+		CONSTANT STRUCT Triangle* triangles,
+		uint64 triangleHashMapSize,
+		CONSTANT uint32* triangleHashMap,
+		CONSTANT uint32* triangleMap,
+		CONSTANT uint32* occupiedBuckets,
+		CONSTANT uint32* occupiedBucketCount,
+		local Vec4f* tilePositions,
+		local Vec4f* tileVelocities,
+		local uint32* tileIndices
+	) {
+		local uint32 selectedWorkItem;
+		local Vec3u selectedCell;
+
+		uint32 localID = get_local_id(0);
+		uint32 localSize = get_local_size(0);
+		float maxInteractionDistanceSqr = MAX_INTERACTION_DISTANCE(parameters) * MAX_INTERACTION_DISTANCE(parameters);
+
+		for (uint32 occupiedBucketIndex = get_group_id(0); occupiedBucketIndex < *occupiedBucketCount; occupiedBucketIndex += get_num_groups(0))
+		{
+			uint32 bucket = occupiedBuckets[occupiedBucketIndex];
+			uint32 bucketBegin = hashMap[bucket];
+			uint32 bucketEnd = hashMap[bucket + 1];
+
+			for (uint32 chunkBegin = bucketBegin; chunkBegin < bucketEnd; chunkBegin += localSize)
+			{
+				bool pending = chunkBegin + localID < bucketEnd;
+				uint32 particleIndex = pending ? particleMap[chunkBegin + localID] : 0;
+
+				Vec3f particlePosition = inParticles[particleIndex].positionAndPressure.xyz;
+				float particlePressure = outParticles[particleIndex].positionAndPressure.w;
+				Vec3f particleVelocity = inParticles[particleIndex].velocityAndHash.xyz;
+				Vec3u particleCell = GetCell(particlePosition, MAX_INTERACTION_DISTANCE(parameters));
+
+				float particleDensity = particlePressure / parameters->gasConstant + parameters->restDensity;
+
+				while (true)
+				{
+					uint32 selected = SelectPendingWorkItem(&selectedWorkItem, pending);
+
+					if (selected == UINT_MAX)
+						break;
+
+					if (localID == selected)
+						selectedCell = particleCell;
+
+					barrier(CLK_LOCAL_MEM_FENCE);
+
+					Vec3u cell = selectedCell;
+					bool active = pending && all(particleCell == cell);
+
+					Vec3u beginCell = cell - NEW_VEC3U(1, 1, 1);
+					Vec3u endCell = cell + NEW_VEC3U(2, 2, 2);
+
+					Vec3f dynamicParticlePressureForce = NEW_VEC3F(0.0f, 0.0f, 0.0f);
+					Vec3f dynamicParticleViscosityForce = NEW_VEC3F(0.0f, 0.0f, 0.0f);
+					Vec3f staticParticlePressureForce = NEW_VEC3F(0.0f, 0.0f, 0.0f);
+					Vec3f staticParticleViscosityForce = NEW_VEC3F(0.0f, 0.0f, 0.0f);
+
+					bool outsideGridBucketVisited = false;
+
+					Vec3u otherCell;
+					for (otherCell.x = beginCell.x; otherCell.x != endCell.x; ++otherCell.x)
+						for (otherCell.y = beginCell.y; otherCell.y != endCell.y; ++otherCell.y)
+							for (otherCell.z = beginCell.z; otherCell.z != endCell.z; ++otherCell.z)
+							{
+								uint32 otherHashMod = GetCellBucket(otherCell, DYNAMIC_PARTICLES_HASH_MAP_SIZE(dynamicParticlesHashMapSize), parameters);
+
+								if (IsOutsideGridBucket(otherHashMod, DYNAMIC_PARTICLES_HASH_MAP_SIZE(dynamicParticlesHashMapSize), parameters))
+								{
+									if (outsideGridBucketVisited)
+										continue;
+
+									outsideGridBucketVisited = true;
+								}
+
+								uint32 beginIndex = hashMap[otherHashMod];
+								uint32 endIndex = hashMap[otherHashMod + 1];
+
+								for (uint32 tileBegin = beginIndex; tileBegin < endIndex; tileBegin += localSize)
+								{
+									uint32 tileSize = min(endIndex - tileBegin, localSize);
+
+									barrier(CLK_LOCAL_MEM_FENCE);
+
+									if (localID < tileSize)
+									{
+										uint32 index = particleMap[tileBegin + localID];
+										//The pressure was computed into the output particles
+										Vec4f positionAndPressure = inParticles[index].positionAndPressure;
+										positionAndPressure.w = outParticles[index].positionAndPressure.w;
+
+										tileIndices[localID] = index;
+										tilePositions[localID] = positionAndPressure;
+										tileVelocities[localID] = inParticles[index].velocityAndHash;
+									}
+
+									barrier(CLK_LOCAL_MEM_FENCE);
+
+									if (!active)
+										continue;
+
+									for (uint32 i = 0; i < tileSize; ++i)
+									{
+										uint32 index = tileIndices[i];
+
+										if (index == particleIndex)
+											continue;
+
+										Vec4f otherParticlePositionAndPressure = tilePositions[i];
+										Vec3f otherParticlePosition = otherParticlePositionAndPressure.xyz;
+										Vec3f otherParticleVelocity = tileVelocities[i].xyz;
+
+										Vec3f dir = otherParticlePosition - particlePosition;
+										float distSqr = dot(dir, dir);
+
+										if (distSqr > maxInteractionDistanceSqr)
+											continue;
+
+										float dist = sqrt(distSqr);
+
+										if (distSqr == 0 || dist == 0)
+										{
+											dir = RandomDirection((float)particleIndex);
+											printf("Two dynamic particles have the same position. Simulation wont be deterministic. First position: % 3.3v3f; second position: % 3.3v3f; i1: %u; i2: %u", particlePosition, otherParticlePosition, particleIndex, index);
+										}
+										else
+											dir /= dist;
+
+										dynamicParticlePressureForce += dir * (particlePressure + otherParticlePositionAndPressure.w) * SmoothingKernelD1(dist, MAX_INTERACTION_DISTANCE(parameters));
+										dynamicParticleViscosityForce += (otherParticleVelocity - particleVelocity) * SmoothingKernelD2(dist, MAX_INTERACTION_DISTANCE(parameters));
+									}
+								}
+
+								if (!HAS_STATIC_PARTICLES(staticParticlesCount))
+									continue;
+
+								otherHashMod = GetCellBucket(otherCell, STATIC_PARTICLES_HASH_MAP_SIZE(staticParticlesHashMapSize), parameters);
+								beginIndex = staticParticlesHashMap[otherHashMod];
+								endIndex = staticParticlesHashMap[otherHashMod + 1];
+
+								for (uint32 tileBegin = beginIndex; tileBegin < endIndex; tileBegin += localSize)
+								{
+									uint32 tileSize = min(endIndex - tileBegin, localSize);
+
+									barrier(CLK_LOCAL_MEM_FENCE);
+
+									if (localID < tileSize)
+										tilePositions[localID] = staticParticles[tileBegin + localID].positionAndPressure;
+
+									barrier(CLK_LOCAL_MEM_FENCE);
+
+									if (!active)
+										continue;
+
+									for (uint32 i = 0; i < tileSize; ++i)
+									{
+										Vec3f otherParticlePosition = tilePositions[i].xyz;
+
+										Vec3f dir = otherParticlePosition - particlePosition;
+										float distSqr = dot(dir, dir);
+
+										if (distSqr > maxInteractionDistanceSqr)
+											continue;
+
+										float dist = sqrt(distSqr);
+
+										if (distSqr == 0 || dist == 0)
+										{
+											dir = RandomDirection((float)particleIndex);
+											printf("A dynamic particle and a static particle have the same position. Simulation wont be deterministic. First position: % 3.3v3f; second position: % 3.3v3f", particlePosition, otherParticlePosition);
+										}
+										else
+											dir /= dist;
+
+										staticParticlePressureForce += dir * fabs(particlePressure) * SmoothingKernelD1(dist, MAX_INTERACTION_DISTANCE(parameters));
+										staticParticleViscosityForce += -particleVelocity * SmoothingKernelD2(dist, MAX_INTERACTION_DISTANCE(parameters));
+									}
+								}
+							}
+
+					if (!active)
+						continue;
+
+					pending = false;
+
+					dynamicParticlePressureForce *= parameters->particleMass / (2 * particleDensity) * parameters->smoothingKernelConstant;
+					dynamicParticleViscosityForce *= parameters->viscosity * parameters->particleMass * parameters->smoothingKernelConstant;
+					staticParticlePressureForce *= parameters->particleMass / (2 * particleDensity) * parameters->smoothingKernelConstant * 1.0f;
+					staticParticleViscosityForce *= parameters->viscosity * parameters->particleMass * parameters->smoothingKernelConstant * 0.0f;
+
+					Vec3f particleForce = NEW_VEC3F(0, 0, 0);
+					particleForce += dynamicParticlePressureForce;
+					particleForce += dynamicParticleViscosityForce;
+					particleForce += staticParticlePressureForce;
+					particleForce += staticParticleViscosityForce;
+					if (HAS_TRIANGLES(triangleCount))
+						particleForce += CalculateBoundaryForce(particlePosition, triangleHashMapSize, triangleHashMap, triangleMap, triangles);
+					Vec3f acceleration = particleForce / particleDensity + NEW_VEC3F(parameters->gravityX, parameters->gravityY, parameters->gravityZ);
+
+					Vec3f newParticleVelocity = particleVelocity + acceleration * deltaTime;
+					Vec3f newParticlePosition = particlePosition + newParticleVelocity * deltaTime;
+
+					uint32 particleHash = GetCellBucket(GetCell(newParticlePosition, MAX_INTERACTION_DISTANCE(parameters)), dynamicParticlesHashMapSize, parameters);
+
+					outParticles[particleIndex].positionAndPressure.xyz = newParticlePosition;
+					outParticles[particleIndex].velocityAndHash.xyz = newParticleVelocity;
+					outParticles[particleIndex].velocityAndHash.w = as_float(particleHash);
+				}
+			}
+		}
+	}
+#endif
+
+#ifndef CL_COMPILER
+	//Version of ComputeDynamicParticlesHashAndPrepareHashMap that can also use the dense grid. It is used by the CPU
+	//engine
+	void ComputeDynamicParticlesHashAndPrepareHashMap(uint64 threadID, volatile HASH_TYPE* hashMap, uint64 hashMapSize, DynamicParticle* particles, const ParticleBehaviourParameters* parameters, uint64 particleCount)
+	{
+		uint32 particleHash = GetCellBucket(GetCell(particles[threadID].positionAndPressure.xyz(), parameters->maxInteractionDistance), hashMapSize, parameters);
+
+		particles[threadID].velocityAndHash.w = *(float*)&particleHash;
+
+		atomic_inc(hashMap + particleHash);
+	}
+
+	//Versions of the dynamic particle functions for particles stored in the StructOfArrays layout. They are only used
+	//by the CPU engine. The neighbour loops read only the streams they need instead of whole particles
+
+	DynamicParticleStreams GetDynamicParticleStreams(void* particles, uint64 particleCount)
+	{
+		float* streams = (float*)particles;
+
+		DynamicParticleStreams out;
+		out.positionX = streams + particleCount * 0;
+		out.positionY = streams + particleCount * 1;
+		out.positionZ = streams + particleCount * 2;
+		out.pressure = streams + particleCount * 3;
+		out.velocityX = streams + particleCount * 4;
+		out.velocityY = streams + particleCount * 5;
+		out.velocityZ = streams + particleCount * 6;
+		out.hash = (uint32*)(streams + particleCount * 7);
+		return out;
+	}
+	void ComputeDynamicParticlesHashAndPrepareHashMap(uint64 threadID, volatile HASH_TYPE* hashMap, uint64 hashMapSize, DynamicParticleStreams particles, const ParticleBehaviourParameters* parameters, uint64 particleCount)
+	{
+		Vec3f particlePosition = Vec3f(particles.positionX[threadID], particles.positionY[threadID], particles.positionZ[threadID]);
+
+		uint32 particleHash = GetCellBucket(GetCell(particlePosition, parameters->maxInteractionDistance), hashMapSize, parameters);
+
+		particles.hash[threadID] = particleHash;
+
+		atomic_inc(hashMap + particleHash);
+	}
+	void ReorderDynamicParticlesAndFinishHashMap(uint64 threadID, uint32* particleMap, volatile HASH_TYPE* hashMap, DynamicParticleStreams inParticles, DynamicParticleStreams outParticles, uint64 particleCount)
+	{
+		size_t oldIndex = threadID;
+
+		uint32 particleHash = inParticles.hash[oldIndex];
+
+		size_t newIndex = (size_t)(atomic_dec(hashMap + particleHash) - 1);
+
+		particleMap[threadID] = (uint32)threadID;
+		outParticles.positionX[newIndex] = inParticles.positionX[oldIndex];
+		outParticles.positionY[newIndex] = inParticles.positionY[oldIndex];
+		outParticles.positionZ[newIndex] = inParticles.positionZ[oldIndex];
+		outParticles.pressure[newIndex] = inParticles.pressure[oldIndex];
+		outParticles.velocityX[newIndex] = inParticles.velocityX[oldIndex];
+		outParticles.velocityY[newIndex] = inParticles.velocityY[oldIndex];
+		outParticles.velocityZ[newIndex] = inParticles.velocityZ[oldIndex];
+		outParticles.hash[newIndex] = particleHash;
+	}
+	void FillDynamicParticleMapAndFinishHashMap(uint64 threadID, uint32* particleMap, volatile HASH_TYPE* hashMap, const uint32* particleHashes, uint64 particleCount)
+	{
+		uint32 particleHash = particleHashes[threadID];
+
+		uint32 index = atomic_dec(hashMap + particleHash) - 1;
+
+		particleMap[index] = (uint32)threadID;
+	}
+
+	template<bool HasStaticParticles>
+	void UpdateParticlePressure(
+		uint64 threadID,
+		uint64 dynamicParticlesCount,
+		uint64 dynamicParticlesHashMapSize,
+		uint64 staticParticlesCount,
+		uint64 staticParticlesHashMapSize,
+		DynamicParticleStreams inParticles,
+		float* outParticlesPressure,
+		const HASH_TYPE* hashMap,
+		const uint32* particleMap,
+		const StaticParticle* staticParticles,
+		const HASH_TYPE* staticParticlesHashMap,
+		const ParticleBehaviourParameters* parameters
+	) {
+		Vec3f particlePosition = Vec3f(inParticles.positionX[threadID], inParticles.positionY[threadID], inParticles.positionZ[threadID]);
+
+		Vec3u cell = GetCell(particlePosition, parameters->maxInteractionDistance);
+
+		Vec3u beginCell = cell - Vec3u(1, 1, 1);
+		Vec3u endCell = cell + Vec3u(2, 2, 2);
+
+		float dynamicParticleInfluenceSum = 0;
+		float staticParticleInfluenceSum = 0;
+
+		bool outsideGridBucketVisited = false;
+
+		Vec3u otherCell;
+		for (otherCell.x = beginCell.x; otherCell.x != endCell.x; ++otherCell.x)
+			for (otherCell.y = beginCell.y; otherCell.y != endCell.y; ++otherCell.y)
+				for (otherCell.z = beginCell.z; otherCell.z != endCell.z; ++otherCell.z)
+				{
+					uint32 otherHashMod = GetCellBucket(otherCell, dynamicParticlesHashMapSize, parameters);
+
+					//With the dense grid all cells outside of it share one bucket, it must be checked only once
+					if (IsOutsideGridBucket(otherHashMod, dynamicParticlesHashMapSize, parameters))
+					{
+						if (outsideGridBucketVisited)
+							continue;
+
+						outsideGridBucketVisited = true;
+					}
+
+					//Calculating dynamic particle pressure
+					uint32 beginIndex = hashMap[otherHashMod];
+					uint32 endIndex = hashMap[otherHashMod + 1];
+
+					for (uint32 i = beginIndex; i < endIndex; ++i)
+					{
+						uint32 index = particleMap[i];
+
+						if (index == threadID)
+							continue;
+
+						Vec3f dir = Vec3f(inParticles.positionX[index], inParticles.positionY[index], inParticles.positionZ[index]) - particlePosition;
+						float distSqr = dot(dir, dir);
+
+						if (distSqr > parameters->maxInteractionDistance * parameters->maxInteractionDistance)
+							continue;
+
+						float dist = sqrt(distSqr);
+
+						dynamicParticleInfluenceSum += SmoothingKernelD0(dist, parameters->maxInteractionDistance);
+					}
+
+					if (!HAS_STATIC_PARTICLES(staticParticlesCount))
+						continue;
+
+					//Calculating static particle pressure
+					otherHashMod = GetCellBucket(otherCell, staticParticlesHashMapSize, parameters);
+					beginIndex = staticParticlesHashMap[otherHashMod];
+					endIndex = staticParticlesHashMap[otherHashMod + 1];
+
+					for (uint32 i = beginIndex; i < endIndex; ++i)
+					{
+						Vec3f dir = staticParticles[i].positionAndPressure.xyz() - particlePosition;
+						float distSqr = dot(dir, dir);
+
+						if (distSqr > parameters->maxInteractionDistance * parameters->maxInteractionDistance)
+							continue;
+
+						float dist = sqrt(distSqr);
+
+						staticParticleInfluenceSum += SmoothingKernelD0(dist, parameters->maxInteractionDistance);
+					}
+				}
+
+		float particleDensity = parameters->selfDensity + (dynamicParticleInfluenceSum * parameters->particleMass + staticParticleInfluenceSum * parameters->particleMass) * parameters->smoothingKernelConstant;
+		float particlePressure = parameters->gasConstant * (particleDensity - parameters->restDensity);
+
+		outParticlesPressure[threadID] = particlePressure;
+	}
+
+	template<bool HasStaticParticles, bool HasTriangles>
+	void UpdateParticleDynamics(
+		uint64 threadID,
+		uint64 dynamicParticlesCount,
+		uint64 dynamicParticlesHashMapSize,
+		uint64 staticParticlesCount,
+		uint64 staticParticlesHashMapSize,
+		DynamicParticleStreams inParticles,
+		DynamicParticleStreams outParticles,
+		const HASH_TYPE* hashMap,
+		const uint32* particleMap,
+		const StaticParticle* staticParticles,
+		const HASH_TYPE* staticParticlesHashMap,
+		const float deltaTime,
+		const ParticleBehaviourParameters* parameters,
+		uint64 triangleCount,
+		const Triangle* triangles,
+		uint64 triangleHashMapSize,
+		const uint32* triangleHashMap,
+		const uint32* triangleMap
+	) {
+		Vec3f particlePosition = Vec3f(inParticles.positionX[threadID], inParticles.positionY[threadID], inParticles.positionZ[threadID]);
+		float particlePressure = outParticles.pressure[threadID];
+		Vec3f particleVelocity = Vec3f(inParticles.velocityX[threadID], inParticles.velocityY[threadID], inParticles.velocityZ[threadID]);
+
+		Vec3u cell = GetCell(particlePosition, parameters->maxInteractionDistance);
+
+		Vec3u beginCell = cell - Vec3u(1, 1, 1);
+		Vec3u endCell = cell + Vec3u(2, 2, 2);
+
+		Vec3f dynamicParticlePressureForce = Vec3f(0.0f, 0.0f, 0.0f);
+		Vec3f dynamicParticleViscosityForce = Vec3f(0.0f, 0.0f, 0.0f);
+		Vec3f staticParticlePressureForce = Vec3f(0.0f, 0.0f, 0.0f);
+		Vec3f staticParticleViscosityForce = Vec3f(0.0f, 0.0f, 0.0f);
+
+		bool outsideGridBucketVisited = false;
+
+		Vec3u otherCell;
+		for (otherCell.x = beginCell.x; otherCell.x != endCell.x; ++otherCell.x)
+			for (otherCell.y = beginCell.y; otherCell.y != endCell.y; ++otherCell.y)
+				for (otherCell.z = beginCell.z; otherCell.z != endCell.z; ++otherCell.z)
+				{
+					uint32 otherHashMod = GetCellBucket(otherCell, dynamicParticlesHashMapSize, parameters);
+
+					//With the dense grid all cells outside of it share one bucket, it must be checked only once
+					if (IsOutsideGridBucket(otherHashMod, dynamicParticlesHashMapSize, parameters))
+					{
+						if (outsideGridBucketVisited)
+							continue;
+
+						outsideGridBucketVisited = true;
+					}
+
+					uint32 beginIndex = hashMap[otherHashMod];
+					uint32 endIndex = hashMap[otherHashMod + 1];
+
+					for (uint32 i = beginIndex; i < endIndex; ++i)
+					{
+						uint32 index = particleMap[i];
+
+						if (index == threadID)
+							continue;
+
+						Vec3f otherParticlePosition = Vec3f(inParticles.positionX[index], inParticles.positionY[index], inParticles.positionZ[index]);
+
+						Vec3f dir = otherParticlePosition - particlePosition;
+						float distSqr = dot(dir, dir);
+
+						if (distSqr > parameters->maxInteractionDistance * parameters->maxInteractionDistance)
+							continue;
+
+						float otherParticlePressure = outParticles.pressure[index];
+						Vec3f otherParticleVelocity = Vec3f(inParticles.velocityX[index], inParticles.velocityY[index], inParticles.velocityZ[index]);
+
+						float dist = sqrt(distSqr);
+
+						if (distSqr == 0 || dist == 0)
+						{
+							dir = RandomDirection((float)threadID);
+							printf("Two dynamic particles have the same position. Simulation wont be deterministic. i1: %u; i2: %u", (uint32)threadID, index);
+						}
+						else
+							dir /= dist;
+
+						//apply pressure force
+						dynamicParticlePressureForce += dir * (particlePressure + otherParticlePressure) * SmoothingKernelD1(dist, parameters->maxInteractionDistance);
+
+						//apply viscosity force
+						dynamicParticleViscosityForce += (otherParticleVelocity - particleVelocity) * SmoothingKernelD2(dist, parameters->maxInteractionDistance);
+					}
+
+					if (!HAS_STATIC_PARTICLES(staticParticlesCount))
+						continue;
+
+					otherHashMod = GetCellBucket(otherCell, staticParticlesHashMapSize, parameters);
+					beginIndex = staticParticlesHashMap[otherHashMod];
+					endIndex = staticParticlesHashMap[otherHashMod + 1];
+
+					for (uint32 i = beginIndex; i < endIndex; ++i)
+					{
+						Vec3f dir = staticParticles[i].positionAndPressure.xyz() - particlePosition;
+						float distSqr = dot(dir, dir);
+
+						if (distSqr > parameters->maxInteractionDistance * parameters->maxInteractionDistance)
+							continue;
+
+						float dist = sqrt(distSqr);
+
+						if (distSqr == 0 || dist == 0)
+						{
+							dir = RandomDirection((float)threadID);
+							printf("A dynamic particle and a static particle have the same position. Simulation wont be deterministic. i1: %u; i2: %u", (uint32)threadID, i);
+						}
+						else
+							dir /= dist;
+
+						//apply pressure force
+						staticParticlePressureForce += dir * fabs(particlePressure) * SmoothingKernelD1(dist, parameters->maxInteractionDistance);
+
+						//apply viscosity force
+						staticParticleViscosityForce += -particleVelocity * SmoothingKernelD2(dist, parameters->maxInteractionDistance);
+					}
+				}
+
+		ParticleInteractionSums sums;
+		sums.dynamicParticlePressureForce[0] = dynamicParticlePressureForce.x;
+		sums.dynamicParticlePressureForce[1] = dynamicParticlePressureForce.y;
+		sums.dynamicParticlePressureForce[2] = dynamicParticlePressureForce.z;
+		sums.dynamicParticleViscosityForce[0] = dynamicParticleViscosityForce.x;
+		sums.dynamicParticleViscosityForce[1] = dynamicParticleViscosityForce.y;
+		sums.dynamicParticleViscosityForce[2] = dynamicParticleViscosityForce.z;
+		sums.staticParticlePressureForce[0] = staticParticlePressureForce.x;
+		sums.staticParticlePressureForce[1] = staticParticlePressureForce.y;
+		sums.staticParticlePressureForce[2] = staticParticlePressureForce.z;
+		sums.staticParticleViscosityForce[0] = staticParticleViscosityForce.x;
+		sums.staticParticleViscosityForce[1] = staticParticleViscosityForce.y;
+		sums.staticParticleViscosityForce[2] = staticParticleViscosityForce.z;
+
+		IntegrateParticle(threadID, dynamicParticlesHashMapSize, inParticles, outParticles, sums, deltaTime, parameters, HAS_TRIANGLES(triangleCount) ? triangleCount : 0, triangles, triangleHashMapSize, triangleHashMap, triangleMap);
+	}
+
+	UpdateParticlePressureAoSFunction GetUpdateParticlePressureAoSVariant(bool hasStaticParticles)
+	{
+		static constexpr UpdateParticlePressureAoSFunction variants[2] = { UpdateParticlePressure<false>, UpdateParticlePressure<true> };
+
+		return variants[hasStaticParticles];
+	}
+	UpdateParticleDynamicsAoSFunction GetUpdateParticleDynamicsAoSVariant(bool hasStaticParticles, bool hasTriangles)
+	{
+		static constexpr UpdateParticleDynamicsAoSFunction variants[2][2] = {
+			{ UpdateParticleDynamics<false, false>, UpdateParticleDynamics<false, true> },
+			{ UpdateParticleDynamics<true, false>, UpdateParticleDynamics<true, true> },
+		};
+
+		return variants[hasStaticParticles][hasTriangles];
+	}
+	UpdateParticlePressureFunction GetUpdateParticlePressureVariant(bool hasStaticParticles)
+	{
+		static constexpr UpdateParticlePressureFunction variants[2] = { UpdateParticlePressure<false>, UpdateParticlePressure<true> };
+
+		return variants[hasStaticParticles];
+	}
+	UpdateParticleDynamicsFunction GetUpdateParticleDynamicsVariant(bool hasStaticParticles, bool hasTriangles)
+	{
+		static constexpr UpdateParticleDynamicsFunction variants[2][2] = {
+			{ UpdateParticleDynamics<false, false>, UpdateParticleDynamics<false, true> },
+			{ UpdateParticleDynamics<true, false>, UpdateParticleDynamics<true, true> },
+		};
+
+		return variants[hasStaticParticles][hasTriangles];
+	}
+
+	void UpdateParticlePressure(uint64 threadID, uint64 dynamicParticlesCount, uint64 dynamicParticlesHashMapSize, uint64 staticParticlesCount, uint64 staticParticlesHashMapSize, const DynamicParticle* inParticles, DynamicParticle* outParticles, const HASH_TYPE* hashMap, const uint32* particleMap, const StaticParticle* staticParticles, const HASH_TYPE* staticParticleHashMap, const ParticleBehaviourParameters* parameters)
+	{
+		GetUpdateParticlePressureAoSVariant(staticParticlesCount != 0)(threadID, dynamicParticlesCount, dynamicParticlesHashMapSize, staticParticlesCount, staticParticlesHashMapSize, inParticles, outParticles, hashMap, particleMap, staticParticles, staticParticleHashMap, parameters);
+	}
+	void UpdateParticleDynamics(uint64 threadID, uint64 dynamicParticlesCount, uint64 dynamicParticlesHashMapSize, uint64 staticParticlesCount, uint64 staticParticlesHashMapSize, const DynamicParticle* inParticles, DynamicParticle* outParticles, const HASH_TYPE* hashMap, const uint32* particleMap, const StaticParticle* staticParticles, const HASH_TYPE* staticParticlesHashMap, const float deltaTime, const ParticleBehaviourParameters* parameters, uint64 triangleCount, const Triangle* triangles, uint64 triangleHashMapSize, const uint32* triangleHashMap, const uint32* triangleMap)
+	{
+		GetUpdateParticleDynamicsAoSVariant(staticParticlesCount != 0, triangleCount != 0)(threadID, dynamicParticlesCount, dynamicParticlesHashMapSize, staticParticlesCount, staticParticlesHashMapSize, inParticles, outParticles, hashMap, particleMap, staticParticles, staticParticlesHashMap, deltaTime, parameters, triangleCount, triangles, triangleHashMapSize, triangleHashMap, triangleMap);
+	}
+	void UpdateParticlePressure(uint64 threadID, uint64 dynamicParticlesCount, uint64 dynamicParticlesHashMapSize, uint64 staticParticlesCount, uint64 staticParticlesHashMapSize, DynamicParticleStreams inParticles, float* outParticlesPressure, const HASH_TYPE* hashMap, const uint32* particleMap, const StaticParticle* staticParticles, const HASH_TYPE* staticParticleHashMap, const ParticleBehaviourParameters* parameters)
+	{
+		GetUpdateParticlePressureVariant(staticParticlesCount != 0)(threadID, dynamicParticlesCount, dynamicParticlesHashMapSize, staticParticlesCount, staticParticlesHashMapSize, inParticles, outParticlesPressure, hashMap, particleMap, staticParticles, staticParticleHashMap, parameters);
+	}
+	void UpdateParticleDynamics(uint64 threadID, uint64 dynamicParticlesCount, uint64 dynamicParticlesHashMapSize, uint64 staticParticlesCount, uint64 staticParticlesHashMapSize, DynamicParticleStreams inParticles, DynamicParticleStreams outParticles, const HASH_TYPE* hashMap, const uint32* particleMap, const StaticParticle* staticParticles, const HASH_TYPE* staticParticlesHashMap, const float deltaTime, const ParticleBehaviourParameters* parameters, uint64 triangleCount, const Triangle* triangles, uint64 triangleHashMapSize, const uint32* triangleHashMap, const uint32* triangleMap)
+	{
+		GetUpdateParticleDynamicsVariant(staticParticlesCount != 0, triangleCount != 0)(threadID, dynamicParticlesCount, dynamicParticlesHashMapSize, staticParticlesCount, staticParticlesHashMapSize, inParticles, outParticles, hashMap, particleMap, staticParticles, staticParticlesHashMap, deltaTime, parameters, triangleCount, triangles, triangleHashMapSize, triangleHashMap, triangleMap);
+	}
+
+	uint32 GetNeighbourCellBuckets(float positionX, float positionY, float positionZ, uint64 hashMapSize, const ParticleBehaviourParameters* parameters, uint32* buckets)
+	{
+		Vec3u cell = GetCell(Vec3f(positionX, positionY, positionZ), parameters->maxInteractionDistance);
+
+		Vec3u beginCell = cell - Vec3u(1, 1, 1);
+		Vec3u endCell = cell + Vec3u(2, 2, 2);
+
+		uint32 bucketCount = 0;
+		bool outsideGridBucketVisited = false;
+
+		Vec3u otherCell;
+		for (otherCell.x = beginCell.x; otherCell.x != endCell.x; ++otherCell.x)
+			for (otherCell.y = beginCell.y; otherCell.y != endCell.y; ++otherCell.y)
+				for (otherCell.z = beginCell.z; otherCell.z != endCell.z; ++otherCell.z)
+				{
+					uint32 bucket = GetCellBucket(otherCell, hashMapSize, parameters);
+
+					if (IsOutsideGridBucket(bucket, hashMapSize, parameters))
+					{
+						if (outsideGridBucketVisited)
+							continue;
+
+						outsideGridBucketVisited = true;
+					}
+
+					buckets[bucketCount++] = bucket;
+				}
+
+		return bucketCount;
+	}
+
+	void IntegrateParticle(
+		uint64 threadID,
+		uint64 dynamicParticlesHashMapSize,
+		DynamicParticleStreams inParticles,
+		DynamicParticleStreams outParticles,
+		const ParticleInteractionSums& sums,
+		const float deltaTime,
+		const ParticleBehaviourParameters* parameters,
+		uint64 triangleCount,
+		const Triangle* triangles,
+		uint64 triangleHashMapSize,
+		const uint32* triangleHashMap,
+		const uint32* triangleMap
+	) {
+		Vec3f particlePosition = Vec3f(inParticles.positionX[threadID], inParticles.positionY[threadID], inParticles.positionZ[threadID]);
+		float particlePressure = outParticles.pressure[threadID];
+		Vec3f particleVelocity = Vec3f(inParticles.velocityX[threadID], inParticles.velocityY[threadID], inParticles.velocityZ[threadID]);
+
+		float particleDensity = particlePressure / parameters->gasConstant + parameters->restDensity;
+
+		Vec3f dynamicParticlePressureForce = Vec3f(sums.dynamicParticlePressureForce[0], sums.dynamicParticlePressureForce[1], sums.dynamicParticlePressureForce[2]);
+		Vec3f dynamicParticleViscosityForce = Vec3f(sums.dynamicParticleViscosityForce[0], sums.dynamicParticleViscosityForce[1], sums.dynamicParticleViscosityForce[2]);
+		Vec3f staticParticlePressureForce = Vec3f(sums.staticParticlePressureForce[0], sums.staticParticlePressureForce[1], sums.staticParticlePressureForce[2]);
+		Vec3f staticParticleViscosityForce = Vec3f(sums.staticParticleViscosityForce[0], sums.staticParticleViscosityForce[1], sums.staticParticleViscosityForce[2]);
+
+		dynamicParticlePressureForce *= parameters->particleMass / (2 * particleDensity) * parameters->smoothingKernelConstant;
+		dynamicParticleViscosityForce *= parameters->viscosity * parameters->particleMass * parameters->smoothingKernelConstant;
+		staticParticlePressureForce *= parameters->particleMass / (2 * particleDensity) * parameters->smoothingKernelConstant * 1.0f;
+		staticParticleViscosityForce *= parameters->viscosity * parameters->particleMass * parameters->smoothingKernelConstant * 0.0f;
+
+		Vec3f particleForce = Vec3f(0, 0, 0);
+		particleForce += dynamicParticlePressureForce;
+		particleForce += dynamicParticleViscosityForce;
+		particleForce += staticParticlePressureForce;
+		particleForce += staticParticleViscosityForce;
+		if (triangleCount != 0)
+			particleForce += CalculateBoundaryForce(particlePosition, triangleHashMapSize, triangleHashMap, triangleMap, triangles);
+		Vec3f acceleration = particleForce / particleDensity + Vec3f(parameters->gravityX, parameters->gravityY, parameters->gravityZ);
+
+		//Integrate
+		particleVelocity += acceleration * deltaTime;
+		particlePosition += particleVelocity * deltaTime;
+
+		Vec3u cell = GetCell(particlePosition, parameters->maxInteractionDistance);
+		uint32 particleHash = GetCellBucket(cell, dynamicParticlesHashMapSize, parameters);
+
+		outParticles.positionX[threadID] = particlePosition.x;
+		outParticles.positionY[threadID] = particlePosition.y;
+		outParticles.positionZ[threadID] = particlePosition.z;
+		outParticles.velocityX[threadID] = particleVelocity.x;
+		outParticles.velocityY[threadID] = particleVelocity.y;
+		outParticles.velocityZ[threadID] = particleVelocity.z;
+		outParticles.hash[threadID] = particleHash;
+	}
+
+	uint32 GetUniqueNeighbourCellBuckets(float positionX, float positionY, float positionZ, uint64 hashMapSize, const ParticleBehaviourParameters* parameters, uint32* buckets)
+	{
+		uint32 bucketCount = GetNeighbourCellBuckets(positionX, positionY, positionZ, hashMapSize, parameters, buckets);
+
+		//Only the hash map can put two neighbour cells into the same bucket
+		if (parameters->gridSizeX != 0)
+			return bucketCount;
+
+		//The Morton code grows with every coordinate, so when none of them wraps around the codes of the cells are
+		//between the ones of the first and the last cell and two of them can only share a bucket if those are at
+		//least the hash map size apart. The Hilbert code doesn't, so its buckets are always deduplicated
+		Vec3u cell = GetCell(Vec3f(positionX, positionY, positionZ), parameters->maxInteractionDistance);
+		Vec3u beginCell = cell - Vec3u(1, 1, 1);
+		Vec3u lastCell = cell + Vec3u(1, 1, 1);
+		if (parameters->cellCurve == 0 &&
+			beginCell.x < lastCell.x && beginCell.y < lastCell.y && beginCell.z < lastCell.z &&
+			lastCell.x < 1024 && lastCell.y < 1024 && lastCell.z < 1024 &&
+			Morton3D(lastCell) - Morton3D(beginCell) < hashMapSize)
+			return bucketCount;
+
+		std::sort(buckets, buckets + bucketCount);
+		return (uint32)(std::unique(buckets, buckets + bucketCount) - buckets);
+	}
+
+	static float SumStaticParticleInfluence(Vec3f particlePosition, uint64 staticParticlesHashMapSize, const StaticParticle* staticParticles, const HASH_TYPE* staticParticlesHashMap, const ParticleBehaviourParameters* parameters)
+	{
+		uint32 buckets[27];
+		uint32 bucketCount = GetNeighbourCellBuckets(particlePosition.x, particlePosition.y, particlePosition.z, staticParticlesHashMapSize, parameters, buckets);
+
+		float staticParticleInfluenceSum = 0;
+
+		for (uint32 bucketIndex = 0; bucketIndex < bucketCount; ++bucketIndex)
+		{
+			uint32 beginIndex = staticParticlesHashMap[buckets[bucketIndex]];
+			uint32 endIndex = staticParticlesHashMap[buckets[bucketIndex] + 1];
+
+			for (uint32 i = beginIndex; i < endIndex; ++i)
+			{
+				Vec3f dir = staticParticles[i].positionAndPressure.xyz() - particlePosition;
+				float distSqr = dot(dir, dir);
+
+				if (distSqr > parameters->maxInteractionDistance * parameters->maxInteractionDistance)
+					continue;
+
+				float dist = sqrt(distSqr);
+
+				staticParticleInfluenceSum += SmoothingKernelD0(dist, parameters->maxInteractionDistance);
+			}
+		}
+
+		return staticParticleInfluenceSum;
+	}
+
+	//Returns the largest number of contributions the particle can add to the particles after the range of the thread
+	static uint64 GetMaxPairContributionCount(const uint32* buckets, uint32 bucketCount, const HASH_TYPE* hashMap, const PairInteractionSums& sums)
+	{
+		uint64 count = 0;
+
+		for (uint32 bucketIndex = 0; bucketIndex < bucketCount; ++bucketIndex)
+		{
+			uint32 beginIndex = std::max<uint32>(hashMap[buckets[bucketIndex]], (uint32)sums.rangeEnd);
+			uint32 endIndex = hashMap[buckets[bucketIndex] + 1];
+
+			if (beginIndex < endIndex)
+				count += endIndex - beginIndex;
+		}
+
+		return count;
+	}
+
+	bool AccumulateParticlePressurePairs(
+		uint64 sortedIndex,
+		uint64 dynamicParticlesHashMapSize,
+		DynamicParticleStreams inParticles,
+		const HASH_TYPE* hashMap,
+		const uint32* particleMap,
+		const ParticleBehaviourParameters* parameters,
+		PairInteractionSums& sums
+	) {
+		uint32 particleIndex = particleMap[sortedIndex];
+		Vec3f particlePosition = Vec3f(inParticles.positionX[particleIndex], inParticles.positionY[particleIndex], inParticles.positionZ[particleIndex]);
+
+		uint32 buckets[27];
+		uint32 bucketCount = GetUniqueNeighbourCellBuckets(particlePosition.x, particlePosition.y, particlePosition.z, dynamicParticlesHashMapSize, parameters, buckets);
+
+		if (sums.contributionCount + GetMaxPairContributionCount(buckets, bucketCount, hashMap, sums) > sums.contributionCapacity)
+			return false;
+
+		float particleInfluenceSum = 0;
+
+		for (uint32 bucketIndex = 0; bucketIndex < bucketCount; ++bucketIndex)
+		{
+			//Pairs with a particle that is earlier in the particle map are handled by that particle
+			uint32 beginIndex = std::max<uint32>(hashMap[buckets[bucketIndex]], (uint32)sortedIndex + 1);
+			uint32 endIndex = hashMap[buckets[bucketIndex] + 1];
+
+			for (uint32 i = beginIndex; i < endIndex; ++i)
+			{
+				uint32 index = particleMap[i];
+
+				Vec3f dir = Vec3f(inParticles.positionX[index], inParticles.positionY[index], inParticles.positionZ[index]) - particlePosition;
+				float distSqr = dot(dir, dir);
+
+				if (distSqr > parameters->maxInteractionDistance * parameters->maxInteractionDistance)
+					continue;
+
+				float dist = sqrt(distSqr);
+				float particleInfluence = SmoothingKernelD0(dist, parameters->maxInteractionDistance);
+
+				particleInfluenceSum += particleInfluence;
+
+				if (i < sums.rangeEnd)
+					sums.influence[i] += particleInfluence;
+				else
+				{
+					sums.contributionIndices[sums.contributionCount] = i;
+					sums.contributionValues[sums.contributionCount] = particleInfluence;
+					++sums.contributionCount;
+				}
+			}
+		}
+
+		sums.influence[sortedIndex] += particleInfluenceSum;
+
+		return true;
+	}
+
+	void UpdateParticlePressureFromPairs(
+		uint64 sortedIndex,
+		uint64 staticParticlesCount,
+		uint64 staticParticlesHashMapSize,
+		DynamicParticleStreams inParticles,
+		float* outParticlesPressure,
+		const uint32* particleMap,
+		const StaticParticle* staticParticles,
+		const HASH_TYPE* staticParticlesHashMap,
+		const ParticleBehaviourParameters* parameters,
+		const PairInteractionSums& sums
+	) {
+		uint32 threadID = particleMap[sortedIndex];
+
+		float dynamicParticleInfluenceSum = sums.influence[sortedIndex];
+
+		float staticParticleInfluenceSum = 0;
+		if (staticParticlesCount != 0)
+		{
+			Vec3f particlePosition = Vec3f(inParticles.positionX[threadID], inParticles.positionY[threadID], inParticles.positionZ[threadID]);
+			staticParticleInfluenceSum = SumStaticParticleInfluence(particlePosition, staticParticlesHashMapSize, staticParticles, staticParticlesHashMap, parameters);
+		}
+
+		float particleDensity = parameters->selfDensity + (dynamicParticleInfluenceSum * parameters->particleMass + staticParticleInfluenceSum * parameters->particleMass) * parameters->smoothingKernelConstant;
+		float particlePressure = parameters->gasConstant * (particleDensity - parameters->restDensity);
+
+		outParticlesPressure[threadID] = particlePressure;
+	}
+
+	bool AccumulateParticleDynamicsPairs(
+		uint64 sortedIndex,
+		uint64 dynamicParticlesHashMapSize,
+		DynamicParticleStreams inParticles,
+		DynamicParticleStreams outParticles,
+		const HASH_TYPE* hashMap,
+		const uint32* particleMap,
+		const ParticleBehaviourParameters* parameters,
+		PairInteractionSums& sums
+	) {
+		uint32 particleIndex = particleMap[sortedIndex];
+		Vec3f particlePosition = Vec3f(inParticles.positionX[particleIndex], inParticles.positionY[particleIndex], inParticles.positionZ[particleIndex]);
+		float particlePressure = outParticles.pressure[particleIndex];
+		Vec3f particleVelocity = Vec3f(inParticles.velocityX[particleIndex], inParticles.velocityY[particleIndex], inParticles.velocityZ[particleIndex]);
+
+		uint32 buckets[27];
+		uint32 bucketCount = GetUniqueNeighbourCellBuckets(particlePosition.x, particlePosition.y, particlePosition.z, dynamicParticlesHashMapSize, parameters, buckets);
+
+		if (sums.contributionCount + GetMaxPairContributionCount(buckets, bucketCount, hashMap, sums) > sums.contributionCapacity)
+			return false;
+
+		Vec3f particlePressureForce = Vec3f(0.0f, 0.0f, 0.0f);
+		Vec3f particleViscosityForce = Vec3f(0.0f, 0.0f, 0.0f);
+
+		for (uint32 bucketIndex = 0; bucketIndex < bucketCount; ++bucketIndex)
+		{
+			//Pairs with a particle that is earlier in the particle map are handled by that particle
+			uint32 beginIndex = std::max<uint32>(hashMap[buckets[bucketIndex]], (uint32)sortedIndex + 1);
+			uint32 endIndex = hashMap[buckets[bucketIndex] + 1];
+
+			for (uint32 i = beginIndex; i < endIndex; ++i)
+			{
+				uint32 index = particleMap[i];
+
+				Vec3f otherParticlePosition = Vec3f(inParticles.positionX[index], inParticles.positionY[index], inParticles.positionZ[index]);
+
+				Vec3f dir = otherParticlePosition - particlePosition;
+				float distSqr = dot(dir, dir);
+
+				if (distSqr > parameters->maxInteractionDistance * parameters->maxInteractionDistance)
+					continue;
+
+				float otherParticlePressure = outParticles.pressure[index];
+				Vec3f otherParticleVelocity = Vec3f(inParticles.velocityX[index], inParticles.velocityY[index], inParticles.velocityZ[index]);
+
+				float dist = sqrt(distSqr);
+
+				if (distSqr == 0 || dist == 0)
+				{
+					dir = RandomDirection((float)particleIndex);
+					printf("Two dynamic particles have the same position. Simulation wont be deterministic. i1: %u; i2: %u", particleIndex, index);
+				}
+				else
+					dir /= dist;
+
+				//Both forces are antisymmetric, the other particle gets the negated force
+				Vec3f pressureForce = dir * (particlePressure + otherParticlePressure) * SmoothingKernelD1(dist, parameters->maxInteractionDistance);
+				Vec3f viscosityForce = (otherParticleVelocity - particleVelocity) * SmoothingKernelD2(dist, parameters->maxInteractionDistance);
+
+				particlePressureForce += pressureForce;
+				particleViscosityForce += viscosityForce;
+
+				float* otherParticleForces;
+				if (i < sums.rangeEnd)
+					otherParticleForces = sums.forces + i * 6;
+				else
+				{
+					sums.contributionIndices[sums.contributionCount] = i;
+					otherParticleForces = sums.contributionValues + sums.contributionCount * 6;
+					std::fill_n(otherParticleForces, 6, 0.0f);
+					++sums.contributionCount;
+				}
+
+				otherParticleForces[0] -= pressureForce.x;
+				otherParticleForces[1] -= pressureForce.y;
+				otherParticleForces[2] -= pressureForce.z;
+				otherParticleForces[3] -= viscosityForce.x;
+				otherParticleForces[4] -= viscosityForce.y;
+				otherParticleForces[5] -= viscosityForce.z;
+			}
+		}
+
+		float* particleForces = sums.forces + sortedIndex * 6;
+		particleForces[0] += particlePressureForce.x;
+		particleForces[1] += particlePressureForce.y;
+		particleForces[2] += particlePressureForce.z;
+		particleForces[3] += particleViscosityForce.x;
+		particleForces[4] += particleViscosityForce.y;
+		particleForces[5] += particleViscosityForce.z;
+
+		return true;
+	}
+
+	void UpdateParticleDynamicsFromPairs(
+		uint64 sortedIndex,
+		uint64 dynamicParticlesHashMapSize,
+		uint64 staticParticlesCount,
+		uint64 staticParticlesHashMapSize,
+		DynamicParticleStreams inParticles,
+		DynamicParticleStreams outParticles,
+		const uint32* particleMap,
+		const StaticParticle* staticParticles,
+		const HASH_TYPE* staticParticlesHashMap,
+		const float deltaTime,
+		const ParticleBehaviourParameters* parameters,
+		const PairInteractionSums& sums,
+		uint64 triangleCount,
+		const Triangle* triangles,
+		uint64 triangleHashMapSize,
+		const uint32* triangleHashMap,
+		const uint32* triangleMap
+	) {
+		uint32 threadID = particleMap[sortedIndex];
+
+		ParticleInteractionSums interactionSums = { };
+
+		const float* forces = sums.forces + sortedIndex * 6;
+		for (uint32 j = 0; j < 3; ++j)
+		{
+			interactionSums.dynamicParticlePressureForce[j] = forces[j];
+			interactionSums.dynamicParticleViscosityForce[j] = forces[3 + j];
+		}
+
+		if (staticParticlesCount != 0)
+		{
+			Vec3f particlePosition = Vec3f(inParticles.positionX[threadID], inParticles.positionY[threadID], inParticles.positionZ[threadID]);
+			float particlePressure = outParticles.pressure[threadID];
+			Vec3f particleVelocity = Vec3f(inParticles.velocityX[threadID], inParticles.velocityY[threadID], inParticles.velocityZ[threadID]);
+
+			Vec3f staticParticlePressureForce = Vec3f(0.0f, 0.0f, 0.0f);
+			Vec3f staticParticleViscosityForce = Vec3f(0.0f, 0.0f, 0.0f);
+
+			uint32 buckets[27];
+			uint32 bucketCount = GetNeighbourCellBuckets(particlePosition.x, particlePosition.y, particlePosition.z, staticParticlesHashMapSize, parameters, buckets);
+
+			for (uint32 bucketIndex = 0; bucketIndex < bucketCount; ++bucketIndex)
+			{
+				uint32 beginIndex = staticParticlesHashMap[buckets[bucketIndex]];
+				uint32 endIndex = staticParticlesHashMap[buckets[bucketIndex] + 1];
+
+				for (uint32 i = beginIndex; i < endIndex; ++i)
+				{
+					Vec3f dir = staticParticles[i].positionAndPressure.xyz() - particlePosition;
+					float distSqr = dot(dir, dir);
+
+					if (distSqr > parameters->maxInteractionDistance * parameters->maxInteractionDistance)
+						continue;
+
+					float dist = sqrt(distSqr);
+
+					if (distSqr == 0 || dist == 0)
+					{
+						dir = RandomDirection((float)threadID);
+						printf("A dynamic particle and a static particle have the same position. Simulation wont be deterministic. i1: %u; i2: %u", (uint32)threadID, i);
+					}
+					else
+						dir /= dist;
+
+					//apply pressure force
+					staticParticlePressureForce += dir * fabs(particlePressure) * SmoothingKernelD1(dist, parameters->maxInteractionDistance);
+
+					//apply viscosity force
+					staticParticleViscosityForce += -particleVelocity * SmoothingKernelD2(dist, parameters->maxInteractionDistance);
+				}
+			}
+
+			interactionSums.staticParticlePressureForce[0] = staticParticlePressureForce.x;
+			interactionSums.staticParticlePressureForce[1] = staticParticlePressureForce.y;
+			interactionSums.staticParticlePressureForce[2] = staticParticlePressureForce.z;
+			interactionSums.staticParticleViscosityForce[0] = staticParticleViscosityForce.x;
+			interactionSums.staticParticleViscosityForce[1] = staticParticleViscosityForce.y;
+			interactionSums.staticParticleViscosityForce[2] = staticParticleViscosityForce.z;
+		}
+
+		IntegrateParticle(threadID, dynamicParticlesHashMapSize, inParticles, outParticles, interactionSums, deltaTime, parameters, triangleCount, triangles, triangleHashMapSize, triangleHashMap, triangleMap);
+	}
+
+	uint32 GetUniqueCellBucketsInDistance(float positionX, float positionY, float positionZ, float distance, uint64 hashMapSize, const ParticleBehaviourParameters* parameters, uint32* buckets)
+	{
+		Vec3f position = Vec3f(positionX, positionY, positionZ);
+
+		Vec3u beginCell = GetCell(position - Vec3f(distance, distance, distance), parameters->maxInteractionDistance);
+		Vec3u endCell = GetCell(position + Vec3f(distance, distance, distance), parameters->maxInteractionDistance) + Vec3u(1, 1, 1);
+
+		//The differences are unsigned so that cells wrapping around 0 are handled too
+		if (endCell.x - beginCell.x > MaxCellsPerAxisInDistance)
+			endCell.x = beginCell.x + MaxCellsPerAxisInDistance;
+		if (endCell.y - beginCell.y > MaxCellsPerAxisInDistance)
+			endCell.y = beginCell.y + MaxCellsPerAxisInDistance;
+		if (endCell.z - beginCell.z > MaxCellsPerAxisInDistance)
+			endCell.z = beginCell.z + MaxCellsPerAxisInDistance;
+
+		uint32 bucketCount = 0;
+		bool outsideGridBucketVisited = false;
+
+		Vec3u otherCell;
+		for (otherCell.x = beginCell.x; otherCell.x != endCell.x; ++otherCell.x)
+			for (otherCell.y = beginCell.y; otherCell.y != endCell.y; ++otherCell.y)
+				for (otherCell.z = beginCell.z; otherCell.z != endCell.z; ++otherCell.z)
+				{
+					uint32 bucket = GetCellBucket(otherCell, hashMapSize, parameters);
+
+					if (IsOutsideGridBucket(bucket, hashMapSize, parameters))
+					{
+						if (outsideGridBucketVisited)
+							continue;
+
+						outsideGridBucketVisited = true;
+					}
+
+					buckets[bucketCount++] = bucket;
+				}
+
+		if (parameters->gridSizeX != 0)
+			return bucketCount;
+
+		std::sort(buckets, buckets + bucketCount);
+		return (uint32)(std::unique(buckets, buckets + bucketCount) - buckets);
+	}
+
+	void UpdateParticlePressureFromList(
+		uint64 threadID,
+		DynamicParticleStreams inParticles,
+		float* outParticlesPressure,
+		const StaticParticle* staticParticles,
+		const ParticleBehaviourParameters* parameters,
+		const uint32* dynamicNeighbours,
+		uint32 dynamicNeighbourCount,
+		const uint32* staticNeighbours,
+		uint32 staticNeighbourCount
+	) {
+		Vec3f particlePosition = Vec3f(inParticles.positionX[threadID], inParticles.positionY[threadID], inParticles.positionZ[threadID]);
+
+		float dynamicParticleInfluenceSum = 0;
+		float staticParticleInfluenceSum = 0;
+
+		//The lists also contain the particles within the skin distance, so the distance is still checked
+		for (uint32 i = 0; i < dynamicNeighbourCount; ++i)
+		{
+			uint32 index = dynamicNeighbours[i];
+
+			Vec3f dir = Vec3f(inParticles.positionX[index], inParticles.positionY[index], inParticles.positionZ[index]) - particlePosition;
+			float distSqr = dot(dir, dir);
+
+			if (distSqr > parameters->maxInteractionDistance * parameters->maxInteractionDistance)
+				continue;
+
+			float dist = sqrt(distSqr);
+
+			dynamicParticleInfluenceSum += SmoothingKernelD0(dist, parameters->maxInteractionDistance);
+		}
+
+		for (uint32 i = 0; i < staticNeighbourCount; ++i)
+		{
+			Vec3f dir = staticParticles[staticNeighbours[i]].positionAndPressure.xyz() - particlePosition;
+			float distSqr = dot(dir, dir);
+
+			if (distSqr > parameters->maxInteractionDistance * parameters->maxInteractionDistance)
+				continue;
+
+			float dist = sqrt(distSqr);
+
+			staticParticleInfluenceSum += SmoothingKernelD0(dist, parameters->maxInteractionDistance);
+		}
+
+		float particleDensity = parameters->selfDensity + (dynamicParticleInfluenceSum * parameters->particleMass + staticParticleInfluenceSum * parameters->particleMass) * parameters->smoothingKernelConstant;
+		float particlePressure = parameters->gasConstant * (particleDensity - parameters->restDensity);
+
+		outParticlesPressure[threadID] = particlePressure;
+	}
+
+	void UpdateParticleDynamicsFromList(
+		uint64 threadID,
+		uint64 dynamicParticlesHashMapSize,
+		DynamicParticleStreams inParticles,
+		DynamicParticleStreams outParticles,
+		const StaticParticle* staticParticles,
+		const float deltaTime,
+		const ParticleBehaviourParameters* parameters,
+		const uint32* dynamicNeighbours,
+		uint32 dynamicNeighbourCount,
+		const uint32* staticNeighbours,
+		uint32 staticNeighbourCount,
+		uint64 triangleCount,
+		const Triangle* triangles,
+		uint64 triangleHashMapSize,
+		const uint32* triangleHashMap,
+		const uint32* triangleMap
+	) {
+		Vec3f particlePosition = Vec3f(inParticles.positionX[threadID], inParticles.positionY[threadID], inParticles.positionZ[threadID]);
+		float particlePressure = outParticles.pressure[threadID];
+		Vec3f particleVelocity = Vec3f(inParticles.velocityX[threadID], inParticles.velocityY[threadID], inParticles.velocityZ[threadID]);
+
+		Vec3f dynamicParticlePressureForce = Vec3f(0.0f, 0.0f, 0.0f);
+		Vec3f dynamicParticleViscosityForce = Vec3f(0.0f, 0.0f, 0.0f);
+		Vec3f staticParticlePressureForce = Vec3f(0.0f, 0.0f, 0.0f);
+		Vec3f staticParticleViscosityForce = Vec3f(0.0f, 0.0f, 0.0f);
+
+		for (uint32 i = 0; i < dynamicNeighbourCount; ++i)
+		{
+			uint32 index = dynamicNeighbours[i];
+
+			Vec3f otherParticlePosition = Vec3f(inParticles.positionX[index], inParticles.positionY[index], inParticles.positionZ[index]);
+
+			Vec3f dir = otherParticlePosition - particlePosition;
+			float distSqr = dot(dir, dir);
+
+			if (distSqr > parameters->maxInteractionDistance * parameters->maxInteractionDistance)
+				continue;
+
+			float otherParticlePressure = outParticles.pressure[index];
+			Vec3f otherParticleVelocity = Vec3f(inParticles.velocityX[index], inParticles.velocityY[index], inParticles.velocityZ[index]);
+
+			float dist = sqrt(distSqr);
+
+			if (distSqr == 0 || dist == 0)
+			{
+				dir = RandomDirection((float)threadID);
+				printf("Two dynamic particles have the same position. Simulation wont be deterministic. i1: %u; i2: %u", (uint32)threadID, index);
+			}
+			else
+				dir /= dist;
+
+			//apply pressure force
+			dynamicParticlePressureForce += dir * (particlePressure + otherParticlePressure) * SmoothingKernelD1(dist, parameters->maxInteractionDistance);
+
+			//apply viscosity force
+			dynamicParticleViscosityForce += (otherParticleVelocity - particleVelocity) * SmoothingKernelD2(dist, parameters->maxInteractionDistance);
+		}
+
+		for (uint32 i = 0; i < staticNeighbourCount; ++i)
+		{
+			Vec3f dir = staticParticles[staticNeighbours[i]].positionAndPressure.xyz() - particlePosition;
+			float distSqr = dot(dir, dir);
+
+			if (distSqr > parameters->maxInteractionDistance * parameters->maxInteractionDistance)
+				continue;
+
+			float dist = sqrt(distSqr);
+
+			if (distSqr == 0 || dist == 0)
+			{
+				dir = RandomDirection((float)threadID);
+				printf("A dynamic particle and a static particle have the same position. Simulation wont be deterministic. i1: %u; i2: %u", (uint32)threadID, staticNeighbours[i]);
+			}
+			else
+				dir /= dist;
+
+			//apply pressure force
+			staticParticlePressureForce += dir * fabs(particlePressure) * SmoothingKernelD1(dist, parameters->maxInteractionDistance);
+
+			//apply viscosity force
+			staticParticleViscosityForce += -particleVelocity * SmoothingKernelD2(dist, parameters->maxInteractionDistance);
+		}
+
+		ParticleInteractionSums sums;
+		sums.dynamicParticlePressureForce[0] = dynamicParticlePressureForce.x;
+		sums.dynamicParticlePressureForce[1] = dynamicParticlePressureForce.y;
+		sums.dynamicParticlePressureForce[2] = dynamicParticlePressureForce.z;
+		sums.dynamicParticleViscosityForce[0] = dynamicParticleViscosityForce.x;
+		sums.dynamicParticleViscosityForce[1] = dynamicParticleViscosityForce.y;
+		sums.dynamicParticleViscosityForce[2] = dynamicParticleViscosityForce.z;
+		sums.staticParticlePressureForce[0] = staticParticlePressureForce.x;
+		sums.staticParticlePressureForce[1] = staticParticlePressureForce.y;
+		sums.staticParticlePressureForce[2] = staticParticlePressureForce.z;
+		sums.staticParticleViscosityForce[0] = staticParticleViscosityForce.x;
+		sums.staticParticleViscosityForce[1] = staticParticleViscosityForce.y;
+		sums.staticParticleViscosityForce[2] = staticParticleViscosityForce.z;
+
+		IntegrateParticle(threadID, dynamicParticlesHashMapSize, inParticles, outParticles, sums, deltaTime, parameters, triangleCount, triangles, triangleHashMapSize, triangleHashMap, triangleMap);
+	}
+
+	//Writes the dynamic and static buckets of the cells around the cell in the order the scalar functions visit them
+	//and returns their count. The candidate counts are set to the particles in those buckets
+	static uint32 GetCellNeighbourBuckets(
+		Vec3u cell,
+		uint64 dynamicParticlesHashMapSize,
+		uint64 staticParticlesCount,
+		uint64 staticParticlesHashMapSize,
+		const HASH_TYPE* hashMap,
+		const HASH_TYPE* staticParticlesHashMap,
+		const ParticleBehaviourParameters* parameters,
+		uint32* dynamicBuckets,
+		uint32* staticBuckets,
+		uint64& dynamicCandidateCount,
+		uint64& staticCandidateCount
+	) {
+		Vec3u beginCell = cell - Vec3u(1, 1, 1);
+		Vec3u endCell = cell + Vec3u(2, 2, 2);
+
+		uint32 bucketCount = 0;
+		bool outsideGridBucketVisited = false;
+		dynamicCandidateCount = 0;
+		staticCandidateCount = 0;
+
+		Vec3u otherCell;
+		for (otherCell.x = beginCell.x; otherCell.x != endCell.x; ++otherCell.x)
+			for (otherCell.y = beginCell.y; otherCell.y != endCell.y; ++otherCell.y)
+				for (otherCell.z = beginCell.z; otherCell.z != endCell.z; ++otherCell.z)
+				{
+					uint32 bucket = GetCellBucket(otherCell, dynamicParticlesHashMapSize, parameters);
+
+					if (IsOutsideGridBucket(bucket, dynamicParticlesHashMapSize, parameters))
+					{
+						if (outsideGridBucketVisited)
+							continue;
+
+						outsideGridBucketVisited = true;
+					}
+
+					dynamicBuckets[bucketCount] = bucket;
+					dynamicCandidateCount += hashMap[bucket + 1] - hashMap[bucket];
+
+					if (staticParticlesCount != 0)
+					{
+						uint32 staticBucket = GetCellBucket(otherCell, staticParticlesHashMapSize, parameters);
+						staticBuckets[bucketCount] = staticBucket;
+						staticCandidateCount += staticParticlesHashMap[staticBucket + 1] - staticParticlesHashMap[staticBucket];
+					}
+
+					++bucketCount;
+				}
+
+		return bucketCount;
+	}
+
+	//The pressures and velocities are only gathered when 'pressure' isn't nullptr
+	static void GatherCellNeighbourCandidates(
+		const uint32* dynamicBuckets,
+		const uint32* staticBuckets,
+		uint32 bucketCount,
+		uint64 staticParticlesCount,
+		DynamicParticleStreams inParticles,
+		const float* pressure,
+		const HASH_TYPE* hashMap,
+		const uint32* particleMap,
+		const StaticParticle* staticParticles,
+		const HASH_TYPE* staticParticlesHashMap,
+		CellNeighbourCandidates& candidates
+	) {
+		candidates.dynamicCount = 0;
+		candidates.staticCount = 0;
+
+		for (uint32 bucketIndex = 0; bucketIndex < bucketCount; ++bucketIndex)
+		{
+			uint32 beginIndex = hashMap[dynamicBuckets[bucketIndex]];
+			uint32 endIndex = hashMap[dynamicBuckets[bucketIndex] + 1];
+
+			for (uint32 i = beginIndex; i < endIndex; ++i)
+			{
+				uint32 index = particleMap[i];
+				uint64 j = candidates.dynamicCount++;
+
+				candidates.dynamicIndices[j] = index;
+				candidates.dynamicPositionX[j] = inParticles.positionX[index];
+				candidates.dynamicPositionY[j] = inParticles.positionY[index];
+				candidates.dynamicPositionZ[j] = inParticles.positionZ[index];
+
+				if (pressure != nullptr)
+				{
+					candidates.dynamicPressure[j] = pressure[index];
+					candidates.dynamicVelocityX[j] = inParticles.velocityX[index];
+					candidates.dynamicVelocityY[j] = inParticles.velocityY[index];
+					candidates.dynamicVelocityZ[j] = inParticles.velocityZ[index];
+				}
+			}
+
+			if (staticParticlesCount == 0)
+				continue;
+
+			beginIndex = staticParticlesHashMap[staticBuckets[bucketIndex]];
+			endIndex = staticParticlesHashMap[staticBuckets[bucketIndex] + 1];
+
+			for (uint32 i = beginIndex; i < endIndex; ++i)
+			{
+				uint64 j = candidates.staticCount++;
+
+				candidates.staticPositionX[j] = staticParticles[i].positionAndPressure.x;
+				candidates.staticPositionY[j] = staticParticles[i].positionAndPressure.y;
+				candidates.staticPositionZ[j] = staticParticles[i].positionAndPressure.z;
+			}
+		}
+	}
+
+	static void UpdateParticlePressureFromCandidates(
+		uint64 threadID,
+		DynamicParticleStreams inParticles,
+		float* outParticlesPressure,
+		const ParticleBehaviourParameters* parameters,
+		const CellNeighbourCandidates& candidates
+	) {
+		Vec3f particlePosition = Vec3f(inParticles.positionX[threadID], inParticles.positionY[threadID], inParticles.positionZ[threadID]);
+
+		float dynamicParticleInfluenceSum = 0;
+		float staticParticleInfluenceSum = 0;
+
+		for (uint64 i = 0; i < candidates.dynamicCount; ++i)
+		{
+			if (candidates.dynamicIndices[i] == threadID)
+				continue;
+
+			Vec3f dir = Vec3f(candidates.dynamicPositionX[i], candidates.dynamicPositionY[i], candidates.dynamicPositionZ[i]) - particlePosition;
+			float distSqr = dot(dir, dir);
+
+			if (distSqr > parameters->maxInteractionDistance * parameters->maxInteractionDistance)
+				continue;
+
+			float dist = sqrt(distSqr);
+
+			dynamicParticleInfluenceSum += SmoothingKernelD0(dist, parameters->maxInteractionDistance);
+		}
+
+		for (uint64 i = 0; i < candidates.staticCount; ++i)
+		{
+			Vec3f dir = Vec3f(candidates.staticPositionX[i], candidates.staticPositionY[i], candidates.staticPositionZ[i]) - particlePosition;
+			float distSqr = dot(dir, dir);
+
+			if (distSqr > parameters->maxInteractionDistance * parameters->maxInteractionDistance)
+				continue;
+
+			float dist = sqrt(distSqr);
+
+			staticParticleInfluenceSum += SmoothingKernelD0(dist, parameters->maxInteractionDistance);
+		}
+
+		float particleDensity = parameters->selfDensity + (dynamicParticleInfluenceSum * parameters->particleMass + staticParticleInfluenceSum * parameters->particleMass) * parameters->smoothingKernelConstant;
+		float particlePressure = parameters->gasConstant * (particleDensity - parameters->restDensity);
+
+		outParticlesPressure[threadID] = particlePressure;
+	}
+
+	static void UpdateParticleDynamicsFromCandidates(
+		uint64 threadID,
+		uint64 dynamicParticlesHashMapSize,
+		DynamicParticleStreams inParticles,
+		DynamicParticleStreams outParticles,
+		const float deltaTime,
+		const ParticleBehaviourParameters* parameters,
+		const CellNeighbourCandidates& candidates,
+		uint64 triangleCount,
+		const Triangle* triangles,
+		uint64 triangleHashMapSize,
+		const uint32* triangleHashMap,
+		const uint32* triangleMap
+	) {
+		Vec3f particlePosition = Vec3f(inParticles.positionX[threadID], inParticles.positionY[threadID], inParticles.positionZ[threadID]);
+		float particlePressure = outParticles.pressure[threadID];
+		Vec3f particleVelocity = Vec3f(inParticles.velocityX[threadID], inParticles.velocityY[threadID], inParticles.velocityZ[threadID]);
+
+		Vec3f dynamicParticlePressureForce = Vec3f(0.0f, 0.0f, 0.0f);
+		Vec3f dynamicParticleViscosityForce = Vec3f(0.0f, 0.0f, 0.0f);
+		Vec3f staticParticlePressureForce = Vec3f(0.0f, 0.0f, 0.0f);
+		Vec3f staticParticleViscosityForce = Vec3f(0.0f, 0.0f, 0.0f);
+
+		for (uint64 i = 0; i < candidates.dynamicCount; ++i)
+		{
+			uint32 index = candidates.dynamicIndices[i];
+
+			if (index == threadID)
+				continue;
+
+			Vec3f otherParticlePosition = Vec3f(candidates.dynamicPositionX[i], candidates.dynamicPositionY[i], candidates.dynamicPositionZ[i]);
+
+			Vec3f dir = otherParticlePosition - particlePosition;
+			float distSqr = dot(dir, dir);
+
+			if (distSqr > parameters->maxInteractionDistance * parameters->maxInteractionDistance)
+				continue;
+
+			float otherParticlePressure = candidates.dynamicPressure[i];
+			Vec3f otherParticleVelocity = Vec3f(candidates.dynamicVelocityX[i], candidates.dynamicVelocityY[i], candidates.dynamicVelocityZ[i]);
+
+			float dist = sqrt(distSqr);
+
+			if (distSqr == 0 || dist == 0)
+			{
+				dir = RandomDirection((float)threadID);
+				printf("Two dynamic particles have the same position. Simulation wont be deterministic. i1: %u; i2: %u", (uint32)threadID, index);
+			}
+			else
+				dir /= dist;
+
+			//apply pressure force
+			dynamicParticlePressureForce += dir * (particlePressure + otherParticlePressure) * SmoothingKernelD1(dist, parameters->maxInteractionDistance);
+
+			//apply viscosity force
+			dynamicParticleViscosityForce += (otherParticleVelocity - particleVelocity) * SmoothingKernelD2(dist, parameters->maxInteractionDistance);
+		}
+
+		for (uint64 i = 0; i < candidates.staticCount; ++i)
+		{
+			Vec3f dir = Vec3f(candidates.staticPositionX[i], candidates.staticPositionY[i], candidates.staticPositionZ[i]) - particlePosition;
+			float distSqr = dot(dir, dir);
+
+			if (distSqr > parameters->maxInteractionDistance * parameters->maxInteractionDistance)
+				continue;
+
+			float dist = sqrt(distSqr);
+
+			if (distSqr == 0 || dist == 0)
+			{
+				dir = RandomDirection((float)threadID);
+				printf("A dynamic particle and a static particle have the same position. Simulation wont be deterministic. i1: %u", (uint32)threadID);
+			}
+			else
+				dir /= dist;
+
+			//apply pressure force
+			staticParticlePressureForce += dir * fabs(particlePressure) * SmoothingKernelD1(dist, parameters->maxInteractionDistance);
+
+			//apply viscosity force
+			staticParticleViscosityForce += -particleVelocity * SmoothingKernelD2(dist, parameters->maxInteractionDistance);
+		}
+
+		ParticleInteractionSums sums;
+		sums.dynamicParticlePressureForce[0] = dynamicParticlePressureForce.x;
+		sums.dynamicParticlePressureForce[1] = dynamicParticlePressureForce.y;
+		sums.dynamicParticlePressureForce[2] = dynamicParticlePressureForce.z;
+		sums.dynamicParticleViscosityForce[0] = dynamicParticleViscosityForce.x;
+		sums.dynamicParticleViscosityForce[1] = dynamicParticleViscosityForce.y;
+		sums.dynamicParticleViscosityForce[2] = dynamicParticleViscosityForce.z;
+		sums.staticParticlePressureForce[0] = staticParticlePressureForce.x;
+		sums.staticParticlePressureForce[1] = staticParticlePressureForce.y;
+		sums.staticParticlePressureForce[2] = staticParticlePressureForce.z;
+		sums.staticParticleViscosityForce[0] = staticParticleViscosityForce.x;
+		sums.staticParticleViscosityForce[1] = staticParticleViscosityForce.y;
+		sums.staticParticleViscosityForce[2] = staticParticleViscosityForce.z;
+
+		IntegrateParticle(threadID, dynamicParticlesHashMapSize, inParticles, outParticles, sums, deltaTime, parameters, triangleCount, triangles, triangleHashMapSize, triangleHashMap, triangleMap);
+	}
+
+	static bool IsParticleInCell(uint32 index, Vec3u cell, DynamicParticleStreams particles, const ParticleBehaviourParameters* parameters)
+	{
+		Vec3u particleCell = GetCell(Vec3f(particles.positionX[index], particles.positionY[index], particles.positionZ[index]), parameters->maxInteractionDistance);
+		return particleCell.x == cell.x && particleCell.y == cell.y && particleCell.z == cell.z;
+	}
+
+	bool UpdateBucketParticlesPressure(
+		uint64 bucket,
+		uint64 dynamicParticlesCount,
+		uint64 dynamicParticlesHashMapSize,
+		uint64 staticParticlesCount,
+		uint64 staticParticlesHashMapSize,
+		DynamicParticleStreams inParticles,
+		float* outParticlesPressure,
+		const HASH_TYPE* hashMap,
+		const uint32* particleMap,
+		const StaticParticle* staticParticles,
+		const HASH_TYPE* staticParticlesHashMap,
+		const ParticleBehaviourParameters* parameters,
+		CellNeighbourCandidates& candidates
+	) {
+		uint32 beginIndex = hashMap[bucket];
+		uint32 endIndex = hashMap[bucket + 1];
+
+		if (beginIndex == endIndex)
+			return true;
+
+		uint32 firstIndex = particleMap[beginIndex];
+		Vec3u cell = GetCell(Vec3f(inParticles.positionX[firstIndex], inParticles.positionY[firstIndex], inParticles.positionZ[firstIndex]), parameters->maxInteractionDistance);
+
+		uint32 dynamicBuckets[27];
+		uint32 staticBuckets[27];
+		uint64 dynamicCandidateCount;
+		uint64 staticCandidateCount;
+		uint32 bucketCount = GetCellNeighbourBuckets(cell, dynamicParticlesHashMapSize, staticParticlesCount, staticParticlesHashMapSize, hashMap, staticParticlesHashMap, parameters, dynamicBuckets, staticBuckets, dynamicCandidateCount, staticCandidateCount);
+
+		if (dynamicCandidateCount > candidates.capacity || staticCandidateCount > candidates.capacity)
+		{
+			candidates.dynamicCount = dynamicCandidateCount;
+			candidates.staticCount = staticCandidateCount;
+			return false;
+		}
+
+		GatherCellNeighbourCandidates(dynamicBuckets, staticBuckets, bucketCount, staticParticlesCount, inParticles, nullptr, hashMap, particleMap, staticParticles, staticParticlesHashMap, candidates);
+
+		for (uint32 i = beginIndex; i < endIndex; ++i)
+		{
+			uint32 index = particleMap[i];
+
+			if (IsParticleInCell(index, cell, inParticles, parameters))
+				UpdateParticlePressureFromCandidates(index, inParticles, outParticlesPressure, parameters, candidates);
+			else
+				UpdateParticlePressure(index, dynamicParticlesCount, dynamicParticlesHashMapSize, staticParticlesCount, staticParticlesHashMapSize, inParticles, outParticlesPressure, hashMap, particleMap, staticParticles, staticParticlesHashMap, parameters);
+		}
+
+		return true;
+	}
+
+	bool UpdateBucketParticlesDynamics(
+		uint64 bucket,
+		uint64 dynamicParticlesCount,
+		uint64 dynamicParticlesHashMapSize,
+		uint64 staticParticlesCount,
+		uint64 staticParticlesHashMapSize,
+		DynamicParticleStreams inParticles,
+		DynamicParticleStreams outParticles,
+		const HASH_TYPE* hashMap,
+		const uint32* particleMap,
+		const StaticParticle* staticParticles,
+		const HASH_TYPE* staticParticlesHashMap,
+		const float deltaTime,
+		const ParticleBehaviourParameters* parameters,
+		CellNeighbourCandidates& candidates,
+		uint64 triangleCount,
+		const Triangle* triangles,
+		uint64 triangleHashMapSize,
+		const uint32* triangleHashMap,
+		const uint32* triangleMap
+	) {
+		uint32 beginIndex = hashMap[bucket];
+		uint32 endIndex = hashMap[bucket + 1];
+
+		if (beginIndex == endIndex)
+			return true;
+
+		uint32 firstIndex = particleMap[beginIndex];
+		Vec3u cell = GetCell(Vec3f(inParticles.positionX[firstIndex], inParticles.positionY[firstIndex], inParticles.positionZ[firstIndex]), parameters->maxInteractionDistance);
+
+		uint32 dynamicBuckets[27];
+		uint32 staticBuckets[27];
+		uint64 dynamicCandidateCount;
+		uint64 staticCandidateCount;
+		uint32 bucketCount = GetCellNeighbourBuckets(cell, dynamicParticlesHashMapSize, staticParticlesCount, staticParticlesHashMapSize, hashMap, staticParticlesHashMap, parameters, dynamicBuckets, staticBuckets, dynamicCandidateCount, staticCandidateCount);
+
+		if (dynamicCandidateCount > candidates.capacity || staticCandidateCount > candidates.capacity)
+		{
+			candidates.dynamicCount = dynamicCandidateCount;
+			candidates.staticCount = staticCandidateCount;
+			return false;
+		}
+
+		GatherCellNeighbourCandidates(dynamicBuckets, staticBuckets, bucketCount, staticParticlesCount, inParticles, outParticles.pressure, hashMap, particleMap, staticParticles, staticParticlesHashMap, candidates);
+
+		for (uint32 i = beginIndex; i < endIndex; ++i)
+		{
+			uint32 index = particleMap[i];
+
+			if (IsParticleInCell(index, cell, inParticles, parameters))
+				UpdateParticleDynamicsFromCandidates(index, dynamicParticlesHashMapSize, inParticles, outParticles, deltaTime, parameters, candidates, triangleCount, triangles, triangleHashMapSize, triangleHashMap, triangleMap);
+			else
+				UpdateParticleDynamics(index, dynamicParticlesCount, dynamicParticlesHashMapSize, staticParticlesCount, staticParticlesHashMapSize, inParticles, outParticles, hashMap, particleMap, staticParticles, staticParticlesHashMap, deltaTime, parameters, triangleCount, triangles, triangleHashMapSize, triangleHashMap, triangleMap);
+		}
+
+		return true;
+	}
+#endif
+
 #ifndef CL_COMPILER
 }
 #endif
@@ -10,9 +10,54 @@ namespace SPH
 
 namespace SPH::Details
 {		
+	//Pointers to the streams of dynamic particles stored in the StructOfArrays layout
+	struct DynamicParticleStreams
+	{
+		float* positionX;
+		float* positionY;
+		float* positionZ;
+		float* pressure;
+		float* velocityX;
+		float* velocityY;
+		float* velocityZ;
+		uint32* hash;
+	};
+
+	//Sums of the dynamic particle pair interactions, used by the half neighbourhood traversal. Each pair is visited once
+	//and its contribution is added to both particles. The sums are a smoothing kernel sum for every particle followed
+	//by the pressure and viscosity forces, 6 values per particle, all indexed by the position of the particle in the
+	//particle map. Every thread owns a range of the particle map and adds to the sums of its range directly, the
+	//contributions to the particles after its range are appended to its contributions instead and added to the sums
+	//by the thread owning those particles
+	struct PairInteractionSums
+	{
+		float* influence;
+		float* forces;
+		uint64 rangeEnd;
+
+		//Particle map indices of the contributions and their values, 1 value per contribution in the pressure pass and 6
+		//in the dynamics pass
+		uint32* contributionIndices;
+		float* contributionValues;
+		uint64 contributionCount;
+		uint64 contributionCapacity;
+
+		static constexpr uint64 ValuesPerParticle = 7;
+	};
+
+	//Unscaled sums of the interactions of one dynamic particle with its neighbours. Vector kernels that compute
+	//the sums themselves pass them to IntegrateParticle
+	struct ParticleInteractionSums
+	{
+		float dynamicParticlePressureForce[3];
+		float dynamicParticleViscosityForce[3];
+		float staticParticlePressureForce[3];
+		float staticParticleViscosityForce[3];
+	};
+
 	void PrepareStaticParticlesHashMap(uint64 threadID, volatile std::atomic_uint32_t* hashMap, uintMem hashMapSize, const StaticParticle* inParticles, float maxInteractionDistance, uint64 particleCount);
 	void ReorderStaticParticlesAndFinishHashMap(uint64 threadID, volatile std::atomic_uint32_t* hashMap, uintMem hashMapSize, const StaticParticle* inParticles, StaticParticle* outParticles, float maxInteractionDistance, uint64 particleCount);
-	void ComputeDynamicParticlesHashAndPrepareHashMap(uint64 threadID, volatile std::atomic_uint32_t* hashMap, uintMem hashMapSize, DynamicParticle* particles, float maxInteractionDistance, uint64 particleCount);
+	void ComputeDynamicParticlesHashAndPrepareHashMap(uint64 threadID, volatile std::atomic_uint32_t* hashMap, uintMem hashMapSize, DynamicParticle* particles, const ParticleBehaviourParameters* parameters, uint64 particleCount);
 	void ReorderDynamicParticlesAndFinishHashMap(uint64 threadID, uint32* particleMap, volatile std::atomic_uint32_t* hashMap, const DynamicParticle* inParticles, DynamicParticle* outParticles, uint64 particleCount);
 	void FillDynamicParticleMapAndFinishHashMap(uint64 threadID, uint32* particleMap, volatile std::atomic_uint32_t* hashMap, const DynamicParticle* inParticles, uint64 particleCount);
 
@@ -46,6 +91,332 @@ namespace SPH::Details
 		const float deltaTime,
 		const ParticleBehaviourParameters* parameters,
 		uint64 triangleCount,
-		const Triangle* triangles
+		const Triangle* triangles,
+		uint64 triangleHashMapSize,
+		const uint32* triangleHashMap,
+		const uint32* triangleMap
+	);
+
+	DynamicParticleStreams GetDynamicParticleStreams(void* particles, uint64 particleCount);
+	void ComputeDynamicParticlesHashAndPrepareHashMap(uint64 threadID, volatile std::atomic_uint32_t* hashMap, uintMem hashMapSize, DynamicParticleStreams particles, const ParticleBehaviourParameters* parameters, uint64 particleCount);
+	void ReorderDynamicParticlesAndFinishHashMap(uint64 threadID, uint32* particleMap, volatile std::atomic_uint32_t* hashMap, DynamicParticleStreams inParticles, DynamicParticleStreams outParticles, uint64 particleCount);
+	void FillDynamicParticleMapAndFinishHashMap(uint64 threadID, uint32* particleMap, volatile std::atomic_uint32_t* hashMap, const uint32* particleHashes, uint64 particleCount);
+
+	void UpdateParticlePressure(
+		uint64 threadID,
+		uint64 dynamicParticlesCount,
+		uint64 dynamicParticlesHashMapSize,
+		uint64 staticParticlesCount,
+		uint64 staticParticlesHashMapSize,
+		DynamicParticleStreams inParticles,
+		float* outParticlesPressure,
+		const std::atomic_uint32_t* hashMap,
+		const uint* particleMap,
+		const StaticParticle* staticParticles,
+		const std::atomic_uint32_t* staticParticleHashMap,
+		const ParticleBehaviourParameters* parameters
+	);
+
+	void UpdateParticleDynamics(
+		uint64 threadID,
+		uint64 dynamicParticlesCount,
+		uint64 dynamicParticlesHashMapSize,
+		uint64 staticParticlesCount,
+		uint64 staticParticlesHashMapSize,
+		DynamicParticleStreams inParticles,
+		DynamicParticleStreams outParticles,
+		const std::atomic_uint32_t* hashMap,
+		const uint* particleMap,
+		const StaticParticle* staticParticles,
+		const std::atomic_uint32_t* staticParticlesHashMap,
+		const float deltaTime,
+		const ParticleBehaviourParameters* parameters,
+		uint64 triangleCount,
+		const Triangle* triangles,
+		uint64 triangleHashMapSize,
+		const uint32* triangleHashMap,
+		const uint32* triangleMap
+	);
+
+	/*
+		UpdateParticlePressure and UpdateParticleDynamics are instantiated for every combination of the scene properties
+		that are checked inside of their neighbour loops, so the checks of the instantiations are constants and their
+		dead branches are removed. The functions declared above select the instantiation for every call, the engine
+		selects it once when the scene is initialized with the ...Variant functions.
+	*/
+	using UpdateParticlePressureAoSFunction = void(*)(
+		uint64 threadID,
+		uint64 dynamicParticlesCount,
+		uint64 dynamicParticlesHashMapSize,
+		uint64 staticParticlesCount,
+		uint64 staticParticlesHashMapSize,
+		const DynamicParticle* inParticles,
+		DynamicParticle* outParticles,
+		const std::atomic_uint32_t* hashMap,
+		const uint* particleMap,
+		const StaticParticle* staticParticles,
+		const std::atomic_uint32_t* staticParticleHashMap,
+		const ParticleBehaviourParameters* parameters
+		);
+
+	using UpdateParticleDynamicsAoSFunction = void(*)(
+		uint64 threadID,
+		uint64 dynamicParticlesCount,
+		uint64 dynamicParticlesHashMapSize,
+		uint64 staticParticlesCount,
+		uint64 staticParticlesHashMapSize,
+		const DynamicParticle* inParticles,
+		DynamicParticle* outParticles,
+		const std::atomic_uint32_t* hashMap,
+		const uint* particleMap,
+		const StaticParticle* staticParticles,
+		const std::atomic_uint32_t* staticParticlesHashMap,
+		const float deltaTime,
+		const ParticleBehaviourParameters* parameters,
+		uint64 triangleCount,
+		const Triangle* triangles,
+		uint64 triangleHashMapSize,
+		const uint32* triangleHashMap,
+		const uint32* triangleMap
+		);
+
+	using UpdateParticlePressureFunction = void(*)(
+		uint64 threadID,
+		uint64 dynamicParticlesCount,
+		uint64 dynamicParticlesHashMapSize,
+		uint64 staticParticlesCount,
+		uint64 staticParticlesHashMapSize,
+		DynamicParticleStreams inParticles,
+		float* outParticlesPressure,
+		const std::atomic_uint32_t* hashMap,
+		const uint* particleMap,
+		const StaticParticle* staticParticles,
+		const std::atomic_uint32_t* staticParticleHashMap,
+		const ParticleBehaviourParameters* parameters
+		);
+
+	using UpdateParticleDynamicsFunction = void(*)(
+		uint64 threadID,
+		uint64 dynamicParticlesCount,
+		uint64 dynamicParticlesHashMapSize,
+		uint64 staticParticlesCount,
+		uint64 staticParticlesHashMapSize,
+		DynamicParticleStreams inParticles,
+		DynamicParticleStreams outParticles,
+		const std::atomic_uint32_t* hashMap,
+		const uint* particleMap,
+		const StaticParticle* staticParticles,
+		const std::atomic_uint32_t* staticParticlesHashMap,
+		const float deltaTime,
+		const ParticleBehaviourParameters* parameters,
+		uint64 triangleCount,
+		const Triangle* triangles,
+		uint64 triangleHashMapSize,
+		const uint32* triangleHashMap,
+		const uint32* triangleMap
+		);
+
+	UpdateParticlePressureAoSFunction GetUpdateParticlePressureAoSVariant(bool hasStaticParticles);
+	UpdateParticleDynamicsAoSFunction GetUpdateParticleDynamicsAoSVariant(bool hasStaticParticles, bool hasTriangles);
+	UpdateParticlePressureFunction GetUpdateParticlePressureVariant(bool hasStaticParticles);
+	UpdateParticleDynamicsFunction GetUpdateParticleDynamicsVariant(bool hasStaticParticles, bool hasTriangles);
+
+	//Writes the buckets of the cells around the position into 'buckets', in the same order the scalar functions visit
+	//them, and returns their count. With the dense grid the bucket shared by the cells outside of it is written once
+	uint32 GetNeighbourCellBuckets(float positionX, float positionY, float positionZ, uint64 hashMapSize, const ParticleBehaviourParameters* parameters, uint32* buckets);
+
+	//Like GetNeighbourCellBuckets but without duplicate buckets, which the hash map can have when two neighbour cells
+	//collide. With the Morton curve that is only possible when the codes of the cells span more than the hash map size,
+	//only then the buckets are sorted to remove the duplicates. With the Hilbert curve they are always sorted
+	uint32 GetUniqueNeighbourCellBuckets(float positionX, float positionY, float positionZ, uint64 hashMapSize, const ParticleBehaviourParameters* parameters, uint32* buckets);
+
+	/*
+		Half neighbourhood traversal. The Accumulate... functions take the index of a particle in the particle map and
+		visit only the neighbours after it in the particle map, so every pair is evaluated once and added to both
+		particles. With the dense grid those are the forward cells of the 27 cell stencil. A function returns false
+		without changing the sums when the contributions to the particles after the range of the thread might not fit
+		into the remaining capacity, the caller has to grow it and call the function again. After the owner of a range
+		zeroed its sums before accumulating and added the contributions of the other threads to them, the ...FromPairs
+		functions add the static particle interactions of a particle and write the result like UpdateParticlePressure
+		and UpdateParticleDynamics do.
+	*/
+	bool AccumulateParticlePressurePairs(
+		uint64 sortedIndex,
+		uint64 dynamicParticlesHashMapSize,
+		DynamicParticleStreams inParticles,
+		const std::atomic_uint32_t* hashMap,
+		const uint* particleMap,
+		const ParticleBehaviourParameters* parameters,
+		PairInteractionSums& sums
+	);
+	void UpdateParticlePressureFromPairs(
+		uint64 sortedIndex,
+		uint64 staticParticlesCount,
+		uint64 staticParticlesHashMapSize,
+		DynamicParticleStreams inParticles,
+		float* outParticlesPressure,
+		const uint* particleMap,
+		const StaticParticle* staticParticles,
+		const std::atomic_uint32_t* staticParticlesHashMap,
+		const ParticleBehaviourParameters* parameters,
+		const PairInteractionSums& sums
+	);
+	bool AccumulateParticleDynamicsPairs(
+		uint64 sortedIndex,
+		uint64 dynamicParticlesHashMapSize,
+		DynamicParticleStreams inParticles,
+		DynamicParticleStreams outParticles,
+		const std::atomic_uint32_t* hashMap,
+		const uint* particleMap,
+		const ParticleBehaviourParameters* parameters,
+		PairInteractionSums& sums
+	);
+	void UpdateParticleDynamicsFromPairs(
+		uint64 sortedIndex,
+		uint64 dynamicParticlesHashMapSize,
+		uint64 staticParticlesCount,
+		uint64 staticParticlesHashMapSize,
+		DynamicParticleStreams inParticles,
+		DynamicParticleStreams outParticles,
+		const uint* particleMap,
+		const StaticParticle* staticParticles,
+		const std::atomic_uint32_t* staticParticlesHashMap,
+		const float deltaTime,
+		const ParticleBehaviourParameters* parameters,
+		const PairInteractionSums& sums,
+		uint64 triangleCount,
+		const Triangle* triangles,
+		uint64 triangleHashMapSize,
+		const uint32* triangleHashMap,
+		const uint32* triangleMap
+	);
+
+	//The most cells GetUniqueCellBucketsInDistance visits along every axis. Twice the interaction distance to both sides
+	//spans 5 cells, the rounding of the cell coordinates can add one more
+	constexpr uint32 MaxCellsPerAxisInDistance = 6;
+
+	//Like GetUniqueNeighbourCellBuckets but for all the cells that overlap the box reaching 'distance' from the position
+	//in each direction. 'buckets' must have space for MaxCellsPerAxisInDistance cubed buckets, so 'distance' can be at
+	//most twice the interaction distance
+	uint32 GetUniqueCellBucketsInDistance(float positionX, float positionY, float positionZ, float distance, uint64 hashMapSize, const ParticleBehaviourParameters* parameters, uint32* buckets);
+
+	/*
+		Verlet list versions of UpdateParticlePressure and UpdateParticleDynamics. Instead of scanning the neighbour
+		cells they take the indices of the dynamic and static particles that were close to the particle when the lists
+		were built. The lists can contain particles that are further than the interaction distance.
+	*/
+	void UpdateParticlePressureFromList(
+		uint64 threadID,
+		DynamicParticleStreams inParticles,
+		float* outParticlesPressure,
+		const StaticParticle* staticParticles,
+		const ParticleBehaviourParameters* parameters,
+		const uint32* dynamicNeighbours,
+		uint32 dynamicNeighbourCount,
+		const uint32* staticNeighbours,
+		uint32 staticNeighbourCount
+	);
+	void UpdateParticleDynamicsFromList(
+		uint64 threadID,
+		uint64 dynamicParticlesHashMapSize,
+		DynamicParticleStreams inParticles,
+		DynamicParticleStreams outParticles,
+		const StaticParticle* staticParticles,
+		const float deltaTime,
+		const ParticleBehaviourParameters* parameters,
+		const uint32* dynamicNeighbours,
+		uint32 dynamicNeighbourCount,
+		const uint32* staticNeighbours,
+		uint32 staticNeighbourCount,
+		uint64 triangleCount,
+		const Triangle* triangles,
+		uint64 triangleHashMapSize,
+		const uint32* triangleHashMap,
+		const uint32* triangleMap
+	);
+
+	/*
+		Cell blocked traversal. All the particles of a cell have the same neighbour cells, so their neighbour candidates
+		are gathered once into contiguous streams and every particle of the cell is evaluated against them. The
+		candidates are in the order UpdateParticlePressure and UpdateParticleDynamics visit them in, so the results are
+		the same as theirs. The UpdateBucket... functions evaluate the particles of a hash map bucket that are in the
+		cell of its first particle this way, the others only share the bucket because of a hash collision or because
+		they are outside of the dense grid and are evaluated with the functions above. A function returns false
+		without changing the particles when the candidates don't fit into the capacity, the counts are then set to the
+		needed ones and the caller has to grow the streams and call it again.
+	*/
+	struct CellNeighbourCandidates
+	{
+		uint32* dynamicIndices;
+		float* dynamicPositionX;
+		float* dynamicPositionY;
+		float* dynamicPositionZ;
+		//Only gathered by UpdateBucketParticlesDynamics
+		float* dynamicPressure;
+		float* dynamicVelocityX;
+		float* dynamicVelocityY;
+		float* dynamicVelocityZ;
+		float* staticPositionX;
+		float* staticPositionY;
+		float* staticPositionZ;
+		uint64 dynamicCount;
+		uint64 staticCount;
+		//Of every stream
+		uint64 capacity;
+
+		static constexpr uint64 FloatStreamCount = 10;
+	};
+	bool UpdateBucketParticlesPressure(
+		uint64 bucket,
+		uint64 dynamicParticlesCount,
+		uint64 dynamicParticlesHashMapSize,
+		uint64 staticParticlesCount,
+		uint64 staticParticlesHashMapSize,
+		DynamicParticleStreams inParticles,
+		float* outParticlesPressure,
+		const std::atomic_uint32_t* hashMap,
+		const uint* particleMap,
+		const StaticParticle* staticParticles,
+		const std::atomic_uint32_t* staticParticlesHashMap,
+		const ParticleBehaviourParameters* parameters,
+		CellNeighbourCandidates& candidates
+	);
+	bool UpdateBucketParticlesDynamics(
+		uint64 bucket,
+		uint64 dynamicParticlesCount,
+		uint64 dynamicParticlesHashMapSize,
+		uint64 staticParticlesCount,
+		uint64 staticParticlesHashMapSize,
+		DynamicParticleStreams inParticles,
+		DynamicParticleStreams outParticles,
+		const std::atomic_uint32_t* hashMap,
+		const uint* particleMap,
+		const StaticParticle* staticParticles,
+		const std::atomic_uint32_t* staticParticlesHashMap,
+		const float deltaTime,
+		const ParticleBehaviourParameters* parameters,
+		CellNeighbourCandidates& candidates,
+		uint64 triangleCount,
+		const Triangle* triangles,
+		uint64 triangleHashMapSize,
+		const uint32* triangleHashMap,
+		const uint32* triangleMap
+	);
+
+	//Applies the forces to the particle and writes its new position, velocity and hash. The pressure is read from
+	//'outParticles', where it was written by UpdateParticlePressure
+	void IntegrateParticle(
+		uint64 threadID,
+		uint64 dynamicParticlesHashMapSize,
+		DynamicParticleStreams inParticles,
+		DynamicParticleStreams outParticles,
+		const ParticleInteractionSums& sums,
+		const float deltaTime,
+		const ParticleBehaviourParameters* parameters,
+		uint64 triangleCount,
+		const Triangle* triangles,
+		uint64 triangleHashMapSize,
+		const uint32* triangleHashMap,
+		const uint32* triangleMap
 	);
 }
\ No newline at end of file
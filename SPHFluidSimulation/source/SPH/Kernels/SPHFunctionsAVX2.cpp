@@ -0,0 +1,90 @@
+//This file is compiled with AVX2 enabled and doesn't use the precompiled header, so that no code shared with the rest
+//of the program is compiled with instructions that might not be supported
+#include "BlazeEngine/Core/BlazeEngineCoreDefines.h"
+#include <atomic>
+#include <immintrin.h>
+#include "SPHFunctionsSIMDImplementation.h"
+
+namespace SPH::Details
+{
+	namespace
+	{
+		struct AVX2Vector
+		{
+			static constexpr uint32 Width = 8;
+
+			using Float = __m256;
+			using Int = __m256i;
+			using Mask = __m256;
+
+			static Float Set(float value) { return _mm256_set1_ps(value); }
+			static Float Zero() { return _mm256_setzero_ps(); }
+			static Mask FirstLanes(uint32 count)
+			{
+				const int laneCount = count < Width ? (int)count : (int)Width;
+				return _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(laneCount), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+			}
+			static Int LoadIndices(const uint32* ptr, Mask mask) { return _mm256_maskload_epi32((const int*)ptr, _mm256_castps_si256(mask)); }
+			static Int StridedIndices(uint32 first, uint32 stride) { return _mm256_mullo_epi32(_mm256_add_epi32(_mm256_set1_epi32((int)first), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)), _mm256_set1_epi32((int)stride)); }
+			static Float Gather(const float* base, Int indices, Mask mask) { return _mm256_mask_i32gather_ps(_mm256_setzero_ps(), base, indices, mask, 4); }
+			static Float Add(Float a, Float b) { return _mm256_add_ps(a, b); }
+			static Float Sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+			static Float Mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+			static Float Div(Float a, Float b) { return _mm256_div_ps(a, b); }
+			static Float Sqrt(Float a) { return _mm256_sqrt_ps(a); }
+			static Mask LessEqual(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+			static Mask Equal(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+			static Mask Equal(Int a, uint32 b) { return _mm256_castsi256_ps(_mm256_cmpeq_epi32(a, _mm256_set1_epi32((int)b))); }
+			static Mask And(Mask a, Mask b) { return _mm256_and_ps(a, b); }
+			static Mask AndNot(Mask a, Mask b) { return _mm256_andnot_ps(b, a); }
+			static bool Any(Mask mask) { return _mm256_movemask_ps(mask) != 0; }
+			static Float Select(Mask mask, Float value) { return _mm256_and_ps(mask, value); }
+			static float ReduceAdd(Float value)
+			{
+				__m128 sum = _mm_add_ps(_mm256_castps256_ps128(value), _mm256_extractf128_ps(value, 1));
+				sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+				sum = _mm_add_ss(sum, _mm_movehdup_ps(sum));
+				return _mm_cvtss_f32(sum);
+			}
+		};
+	}
+
+	void UpdateParticlePressureAVX2(
+		uint64 threadID,
+		uint64 dynamicParticlesCount,
+		uint64 dynamicParticlesHashMapSize,
+		uint64 staticParticlesCount,
+		uint64 staticParticlesHashMapSize,
+		DynamicParticleStreams inParticles,
+		float* outParticlesPressure,
+		const std::atomic_uint32_t* hashMap,
+		const uint* particleMap,
+		const StaticParticle* staticParticles,
+		const std::atomic_uint32_t* staticParticleHashMap,
+		const ParticleBehaviourParameters* parameters
+	) {
+		UpdateParticlePressureSIMD<AVX2Vector>(threadID, dynamicParticlesCount, dynamicParticlesHashMapSize, staticParticlesCount, staticParticlesHashMapSize, inParticles, outParticlesPressure, hashMap, particleMap, staticParticles, staticParticleHashMap, parameters);
+	}
+	void UpdateParticleDynamicsAVX2(
+		uint64 threadID,
+		uint64 dynamicParticlesCount,
+		uint64 dynamicParticlesHashMapSize,
+		uint64 staticParticlesCount,
+		uint64 staticParticlesHashMapSize,
+		DynamicParticleStreams inParticles,
+		DynamicParticleStreams outParticles,
+		const std::atomic_uint32_t* hashMap,
+		const uint* particleMap,
+		const StaticParticle* staticParticles,
+		const std::atomic_uint32_t* staticParticlesHashMap,
+		const float deltaTime,
+		const ParticleBehaviourParameters* parameters,
+		uint64 triangleCount,
+		const Triangle* triangles,
+		uint64 triangleHashMapSize,
+		const uint32* triangleHashMap,
+		const uint32* triangleMap
+	) {
+		UpdateParticleDynamicsSIMD<AVX2Vector>(threadID, dynamicParticlesCount, dynamicParticlesHashMapSize, staticParticlesCount, staticParticlesHashMapSize, inParticles, outParticles, hashMap, particleMap, staticParticles, staticParticlesHashMap, deltaTime, parameters, triangleCount, triangles, triangleHashMapSize, triangleHashMap, triangleMap);
+	}
+}
\ No newline at end of file
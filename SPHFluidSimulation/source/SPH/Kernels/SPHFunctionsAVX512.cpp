@@ -0,0 +1,80 @@
+//This file is compiled with AVX-512 enabled and doesn't use the precompiled header, so that no code shared with the rest
+//of the program is compiled with instructions that might not be supported
+#include "BlazeEngine/Core/BlazeEngineCoreDefines.h"
+#include <atomic>
+#include <immintrin.h>
+#include "SPHFunctionsSIMDImplementation.h"
+
+namespace SPH::Details
+{
+	namespace
+	{
+		struct AVX512Vector
+		{
+			static constexpr uint32 Width = 16;
+
+			using Float = __m512;
+			using Int = __m512i;
+			using Mask = __mmask16;
+
+			static Float Set(float value) { return _mm512_set1_ps(value); }
+			static Float Zero() { return _mm512_setzero_ps(); }
+			static Mask FirstLanes(uint32 count) { return count < Width ? (Mask)((1u << count) - 1) : (Mask)0xFFFF; }
+			static Int LoadIndices(const uint32* ptr, Mask mask) { return _mm512_maskz_loadu_epi32(mask, ptr); }
+			static Int StridedIndices(uint32 first, uint32 stride) { return _mm512_mullo_epi32(_mm512_add_epi32(_mm512_set1_epi32((int)first), _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15)), _mm512_set1_epi32((int)stride)); }
+			static Float Gather(const float* base, Int indices, Mask mask) { return _mm512_mask_i32gather_ps(_mm512_setzero_ps(), mask, indices, base, 4); }
+			static Float Add(Float a, Float b) { return _mm512_add_ps(a, b); }
+			static Float Sub(Float a, Float b) { return _mm512_sub_ps(a, b); }
+			static Float Mul(Float a, Float b) { return _mm512_mul_ps(a, b); }
+			static Float Div(Float a, Float b) { return _mm512_div_ps(a, b); }
+			static Float Sqrt(Float a) { return _mm512_sqrt_ps(a); }
+			static Mask LessEqual(Float a, Float b) { return _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ); }
+			static Mask Equal(Float a, Float b) { return _mm512_cmp_ps_mask(a, b, _CMP_EQ_OQ); }
+			static Mask Equal(Int a, uint32 b) { return _mm512_cmpeq_epi32_mask(a, _mm512_set1_epi32((int)b)); }
+			static Mask And(Mask a, Mask b) { return (Mask)(a & b); }
+			static Mask AndNot(Mask a, Mask b) { return (Mask)(a & ~b); }
+			static bool Any(Mask mask) { return mask != 0; }
+			static Float Select(Mask mask, Float value) { return _mm512_maskz_mov_ps(mask, value); }
+			static float ReduceAdd(Float value) { return _mm512_reduce_add_ps(value); }
+		};
+	}
+
+	void UpdateParticlePressureAVX512(
+		uint64 threadID,
+		uint64 dynamicParticlesCount,
+		uint64 dynamicParticlesHashMapSize,
+		uint64 staticParticlesCount,
+		uint64 staticParticlesHashMapSize,
+		DynamicParticleStreams inParticles,
+		float* outParticlesPressure,
+		const std::atomic_uint32_t* hashMap,
+		const uint* particleMap,
+		const StaticParticle* staticParticles,
+		const std::atomic_uint32_t* staticParticleHashMap,
+		const ParticleBehaviourParameters* parameters
+	) {
+		UpdateParticlePressureSIMD<AVX512Vector>(threadID, dynamicParticlesCount, dynamicParticlesHashMapSize, staticParticlesCount, staticParticlesHashMapSize, inParticles, outParticlesPressure, hashMap, particleMap, staticParticles, staticParticleHashMap, parameters);
+	}
+	void UpdateParticleDynamicsAVX512(
+		uint64 threadID,
+		uint64 dynamicParticlesCount,
+		uint64 dynamicParticlesHashMapSize,
+		uint64 staticParticlesCount,
+		uint64 staticParticlesHashMapSize,
+		DynamicParticleStreams inParticles,
+		DynamicParticleStreams outParticles,
+		const std::atomic_uint32_t* hashMap,
+		const uint* particleMap,
+		const StaticParticle* staticParticles,
+		const std::atomic_uint32_t* staticParticlesHashMap,
+		const float deltaTime,
+		const ParticleBehaviourParameters* parameters,
+		uint64 triangleCount,
+		const Triangle* triangles,
+		uint64 triangleHashMapSize,
+		const uint32* triangleHashMap,
+		const uint32* triangleMap
+	) {
+		UpdateParticleDynamicsSIMD<AVX512Vector>(threadID, dynamicParticlesCount, dynamicParticlesHashMapSize, staticParticlesCount, staticParticlesHashMapSize, inParticles, outParticles, hashMap, particleMap, staticParticles, staticParticlesHashMap, deltaTime, parameters, triangleCount, triangles, triangleHashMapSize, triangleHashMap, triangleMap);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,83 @@
+#include "pch.h"
+#include "SPHFunctionsSIMD.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+namespace SPH::Details
+{
+	static void CPUID(uint32 leaf, uint32 subleaf, uint32 registers[4])
+	{
+#ifdef _MSC_VER
+		int values[4];
+		__cpuidex(values, (int)leaf, (int)subleaf);
+		for (uintMem i = 0; i < 4; ++i)
+			registers[i] = (uint32)values[i];
+#else
+		__cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+	}
+	static uint64 ReadXCR0()
+	{
+#ifdef _MSC_VER
+		return _xgetbv(0);
+#else
+		uint32 eax, edx;
+		__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		return ((uint64)edx << 32) | eax;
+#endif
+	}
+
+	//XCR0 can only be read when the OSXSAVE flag is set, so it is checked together with the leaf 1 flags
+	static bool IsAVXStateEnabled(uint64 xcr0Mask)
+	{
+		uint32 registers[4];
+		CPUID(0, 0, registers);
+
+		if (registers[0] < 7)
+			return false;
+
+		CPUID(1, 0, registers);
+
+		const uint32 fmaFlag = 1u << 12;
+		const uint32 osxsaveFlag = 1u << 27;
+		const uint32 avxFlag = 1u << 28;
+
+		if ((registers[2] & (fmaFlag | osxsaveFlag | avxFlag)) != (fmaFlag | osxsaveFlag | avxFlag))
+			return false;
+
+		return (ReadXCR0() & xcr0Mask) == xcr0Mask;
+	}
+
+	bool IsAVX2Supported()
+	{
+		static const bool supported = [] {
+			//SSE and AVX state
+			if (!IsAVXStateEnabled(0x6))
+				return false;
+
+			uint32 registers[4];
+			CPUID(7, 0, registers);
+			return (registers[1] & (1u << 5)) != 0;
+			}();
+
+		return supported;
+	}
+	bool IsAVX512Supported()
+	{
+		static const bool supported = [] {
+			//SSE, AVX, opmask and both halves of the ZMM state
+			if (!IsAVXStateEnabled(0xE6))
+				return false;
+
+			uint32 registers[4];
+			CPUID(7, 0, registers);
+			return (registers[1] & (1u << 5)) != 0 && (registers[1] & (1u << 16)) != 0;
+			}();
+
+		return supported;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,84 @@
+#pragma once
+#include "SPHFunctions.h"
+
+//Vectorized versions of the neighbour loops of the StructOfArrays dynamic particle functions. Every function processes
+//one particle, like the scalar ones, but handles 8 (AVX2) or 16 (AVX-512) neighbours at once. The results differ from
+//the scalar functions only in the order of the summation. The functions must only be called when the matching
+//Is...Supported function returns true
+
+namespace SPH::Details
+{
+	//Checks the CPUID flags and whether the operating system saves the vector registers
+	bool IsAVX2Supported();
+	bool IsAVX512Supported();
+
+	void UpdateParticlePressureAVX2(
+		uint64 threadID,
+		uint64 dynamicParticlesCount,
+		uint64 dynamicParticlesHashMapSize,
+		uint64 staticParticlesCount,
+		uint64 staticParticlesHashMapSize,
+		DynamicParticleStreams inParticles,
+		float* outParticlesPressure,
+		const std::atomic_uint32_t* hashMap,
+		const uint* particleMap,
+		const StaticParticle* staticParticles,
+		const std::atomic_uint32_t* staticParticleHashMap,
+		const ParticleBehaviourParameters* parameters
+	);
+	void UpdateParticleDynamicsAVX2(
+		uint64 threadID,
+		uint64 dynamicParticlesCount,
+		uint64 dynamicParticlesHashMapSize,
+		uint64 staticParticlesCount,
+		uint64 staticParticlesHashMapSize,
+		DynamicParticleStreams inParticles,
+		DynamicParticleStreams outParticles,
+		const std::atomic_uint32_t* hashMap,
+		const uint* particleMap,
+		const StaticParticle* staticParticles,
+		const std::atomic_uint32_t* staticParticlesHashMap,
+		const float deltaTime,
+		const ParticleBehaviourParameters* parameters,
+		uint64 triangleCount,
+		const Triangle* triangles,
+		uint64 triangleHashMapSize,
+		const uint32* triangleHashMap,
+		const uint32* triangleMap
+	);
+
+	void UpdateParticlePressureAVX512(
+		uint64 threadID,
+		uint64 dynamicParticlesCount,
+		uint64 dynamicParticlesHashMapSize,
+		uint64 staticParticlesCount,
+		uint64 staticParticlesHashMapSize,
+		DynamicParticleStreams inParticles,
+		float* outParticlesPressure,
+		const std::atomic_uint32_t* hashMap,
+		const uint* particleMap,
+		const StaticParticle* staticParticles,
+		const std::atomic_uint32_t* staticParticleHashMap,
+		const ParticleBehaviourParameters* parameters
+	);
+	void UpdateParticleDynamicsAVX512(
+		uint64 threadID,
+		uint64 dynamicParticlesCount,
+		uint64 dynamicParticlesHashMapSize,
+		uint64 staticParticlesCount,
+		uint64 staticParticlesHashMapSize,
+		DynamicParticleStreams inParticles,
+		DynamicParticleStreams outParticles,
+		const std::atomic_uint32_t* hashMap,
+		const uint* particleMap,
+		const StaticParticle* staticParticles,
+		const std::atomic_uint32_t* staticParticlesHashMap,
+		const float deltaTime,
+		const ParticleBehaviourParameters* parameters,
+		uint64 triangleCount,
+		const Triangle* triangles,
+		uint64 triangleHashMapSize,
+		const uint32* triangleHashMap,
+		const uint32* triangleMap
+	);
+}
\ No newline at end of file
@@ -0,0 +1,302 @@
+#pragma once
+#include "SPHFunctionsSIMD.h"
+#include "SPH/Core/Particles.h"
+
+//Shared implementation of the vectorized neighbour loops. It is included only by the files that are compiled with the
+//matching instruction set, each of which defines a vector type with the following static members:
+//	Width													 - number of lanes
+//	Float, Int, Mask										 - vector and mask types
+//	Set(float), Zero()
+//	FirstLanes(count)										 - mask with the first min(count, Width) lanes set
+//	LoadIndices(ptr, mask)									 - loads uint32 values, zero in lanes outside the mask
+//	StridedIndices(first, stride)							 - (first + lane) * stride
+//	Gather(base, indices, mask)								 - loads base[indices], zero in lanes outside the mask
+//	Add, Sub, Mul, Div, Sqrt
+//	LessEqual(Float, Float), Equal(Float, Float), Equal(Int, uint32)
+//	And(Mask, Mask), AndNot(Mask, Mask)						 - AndNot returns the first mask without the second one
+//	Any(Mask), Select(mask, Float)							 - Select returns zero in lanes outside the mask
+//	ReduceAdd(Float)
+//Nothing here may be a non-template inline function, because the code is compiled once for every instruction set
+
+namespace SPH::Details
+{
+	template<typename V>
+	void UpdateParticlePressureSIMD(
+		uint64 threadID,
+		uint64 dynamicParticlesCount,
+		uint64 dynamicParticlesHashMapSize,
+		uint64 staticParticlesCount,
+		uint64 staticParticlesHashMapSize,
+		DynamicParticleStreams inParticles,
+		float* outParticlesPressure,
+		const std::atomic_uint32_t* hashMap,
+		const uint* particleMap,
+		const StaticParticle* staticParticles,
+		const std::atomic_uint32_t* staticParticlesHashMap,
+		const ParticleBehaviourParameters* parameters
+	) {
+		using Float = typename V::Float;
+		using Int = typename V::Int;
+		using Mask = typename V::Mask;
+
+		const float particlePositionX = inParticles.positionX[threadID];
+		const float particlePositionY = inParticles.positionY[threadID];
+		const float particlePositionZ = inParticles.positionZ[threadID];
+
+		const Float positionX = V::Set(particlePositionX);
+		const Float positionY = V::Set(particlePositionY);
+		const Float positionZ = V::Set(particlePositionZ);
+		const Float maxInteractionDistance = V::Set(parameters->maxInteractionDistance);
+		const Float maxInteractionDistanceSqr = V::Set(parameters->maxInteractionDistance * parameters->maxInteractionDistance);
+
+		const float* staticParticlesPositionX = (const float*)staticParticles + 0;
+		const float* staticParticlesPositionY = (const float*)staticParticles + 1;
+		const float* staticParticlesPositionZ = (const float*)staticParticles + 2;
+
+		Float dynamicParticleInfluenceSum = V::Zero();
+		Float staticParticleInfluenceSum = V::Zero();
+
+		uint32 cellBuckets[27];
+		uint32 cellBucketCount = GetNeighbourCellBuckets(particlePositionX, particlePositionY, particlePositionZ, dynamicParticlesHashMapSize, parameters, cellBuckets);
+
+		for (uint32 cellIndex = 0; cellIndex < cellBucketCount; ++cellIndex)
+		{
+			uint32 beginIndex = hashMap[cellBuckets[cellIndex]];
+			uint32 endIndex = hashMap[cellBuckets[cellIndex] + 1];
+
+			for (uint32 i = beginIndex; i < endIndex; i += V::Width)
+			{
+				Mask mask = V::FirstLanes(endIndex - i);
+				Int indices = V::LoadIndices(particleMap + i, mask);
+				mask = V::AndNot(mask, V::Equal(indices, (uint32)threadID));
+
+				Float dirX = V::Sub(V::Gather(inParticles.positionX, indices, mask), positionX);
+				Float dirY = V::Sub(V::Gather(inParticles.positionY, indices, mask), positionY);
+				Float dirZ = V::Sub(V::Gather(inParticles.positionZ, indices, mask), positionZ);
+				Float distSqr = V::Add(V::Add(V::Mul(dirX, dirX), V::Mul(dirY, dirY)), V::Mul(dirZ, dirZ));
+
+				mask = V::And(mask, V::LessEqual(distSqr, maxInteractionDistanceSqr));
+
+				Float t = V::Sub(maxInteractionDistance, V::Sqrt(distSqr));
+				dynamicParticleInfluenceSum = V::Add(dynamicParticleInfluenceSum, V::Select(mask, V::Mul(V::Mul(t, t), t)));
+			}
+		}
+
+		if (staticParticlesCount != 0)
+			cellBucketCount = GetNeighbourCellBuckets(particlePositionX, particlePositionY, particlePositionZ, staticParticlesHashMapSize, parameters, cellBuckets);
+		else
+			cellBucketCount = 0;
+
+		for (uint32 cellIndex = 0; cellIndex < cellBucketCount; ++cellIndex)
+		{
+			uint32 beginIndex = staticParticlesHashMap[cellBuckets[cellIndex]];
+			uint32 endIndex = staticParticlesHashMap[cellBuckets[cellIndex] + 1];
+
+			for (uint32 i = beginIndex; i < endIndex; i += V::Width)
+			{
+				Mask mask = V::FirstLanes(endIndex - i);
+				Int indices = V::StridedIndices(i, sizeof(StaticParticle) / sizeof(float));
+
+				Float dirX = V::Sub(V::Gather(staticParticlesPositionX, indices, mask), positionX);
+				Float dirY = V::Sub(V::Gather(staticParticlesPositionY, indices, mask), positionY);
+				Float dirZ = V::Sub(V::Gather(staticParticlesPositionZ, indices, mask), positionZ);
+				Float distSqr = V::Add(V::Add(V::Mul(dirX, dirX), V::Mul(dirY, dirY)), V::Mul(dirZ, dirZ));
+
+				mask = V::And(mask, V::LessEqual(distSqr, maxInteractionDistanceSqr));
+
+				Float t = V::Sub(maxInteractionDistance, V::Sqrt(distSqr));
+				staticParticleInfluenceSum = V::Add(staticParticleInfluenceSum, V::Select(mask, V::Mul(V::Mul(t, t), t)));
+			}
+		}
+
+		float particleDensity = parameters->selfDensity + (V::ReduceAdd(dynamicParticleInfluenceSum) * parameters->particleMass + V::ReduceAdd(staticParticleInfluenceSum) * parameters->particleMass) * parameters->smoothingKernelConstant;
+		float particlePressure = parameters->gasConstant * (particleDensity - parameters->restDensity);
+
+		outParticlesPressure[threadID] = particlePressure;
+	}
+
+	template<typename V>
+	void UpdateParticleDynamicsSIMD(
+		uint64 threadID,
+		uint64 dynamicParticlesCount,
+		uint64 dynamicParticlesHashMapSize,
+		uint64 staticParticlesCount,
+		uint64 staticParticlesHashMapSize,
+		DynamicParticleStreams inParticles,
+		DynamicParticleStreams outParticles,
+		const std::atomic_uint32_t* hashMap,
+		const uint* particleMap,
+		const StaticParticle* staticParticles,
+		const std::atomic_uint32_t* staticParticlesHashMap,
+		const float deltaTime,
+		const ParticleBehaviourParameters* parameters,
+		uint64 triangleCount,
+		const Triangle* triangles,
+		uint64 triangleHashMapSize,
+		const uint32* triangleHashMap,
+		const uint32* triangleMap
+	) {
+		using Float = typename V::Float;
+		using Int = typename V::Int;
+		using Mask = typename V::Mask;
+
+		const float particlePositionX = inParticles.positionX[threadID];
+		const float particlePositionY = inParticles.positionY[threadID];
+		const float particlePositionZ = inParticles.positionZ[threadID];
+		const float particlePressure = outParticles.pressure[threadID];
+		const float particleVelocityX = inParticles.velocityX[threadID];
+		const float particleVelocityY = inParticles.velocityY[threadID];
+		const float particleVelocityZ = inParticles.velocityZ[threadID];
+
+		const Float positionX = V::Set(particlePositionX);
+		const Float positionY = V::Set(particlePositionY);
+		const Float positionZ = V::Set(particlePositionZ);
+		const Float pressure = V::Set(particlePressure);
+		const Float absolutePressure = V::Set(particlePressure < 0 ? -particlePressure : particlePressure);
+		const Float velocityX = V::Set(particleVelocityX);
+		const Float velocityY = V::Set(particleVelocityY);
+		const Float velocityZ = V::Set(particleVelocityZ);
+		const Float maxInteractionDistance = V::Set(parameters->maxInteractionDistance);
+		const Float maxInteractionDistanceSqr = V::Set(parameters->maxInteractionDistance * parameters->maxInteractionDistance);
+		const Float d1Factor = V::Set(-3.0f);
+		const Float d2Factor = V::Set(6.0f);
+
+		const float* staticParticlesPositionX = (const float*)staticParticles + 0;
+		const float* staticParticlesPositionY = (const float*)staticParticles + 1;
+		const float* staticParticlesPositionZ = (const float*)staticParticles + 2;
+
+		Float dynamicParticlePressureForceX = V::Zero();
+		Float dynamicParticlePressureForceY = V::Zero();
+		Float dynamicParticlePressureForceZ = V::Zero();
+		Float dynamicParticleViscosityForceX = V::Zero();
+		Float dynamicParticleViscosityForceY = V::Zero();
+		Float dynamicParticleViscosityForceZ = V::Zero();
+		Float staticParticlePressureForceX = V::Zero();
+		Float staticParticlePressureForceY = V::Zero();
+		Float staticParticlePressureForceZ = V::Zero();
+		//The static viscosity force is -velocity * D2 for every static particle, so only the D2 values are summed
+		Float staticParticleViscosityInfluenceSum = V::Zero();
+
+		uint32 cellBuckets[27];
+		uint32 cellBucketCount = GetNeighbourCellBuckets(particlePositionX, particlePositionY, particlePositionZ, dynamicParticlesHashMapSize, parameters, cellBuckets);
+
+		for (uint32 cellIndex = 0; cellIndex < cellBucketCount; ++cellIndex)
+		{
+			uint32 beginIndex = hashMap[cellBuckets[cellIndex]];
+			uint32 endIndex = hashMap[cellBuckets[cellIndex] + 1];
+
+			for (uint32 i = beginIndex; i < endIndex; i += V::Width)
+			{
+				Mask mask = V::FirstLanes(endIndex - i);
+				Int indices = V::LoadIndices(particleMap + i, mask);
+				mask = V::AndNot(mask, V::Equal(indices, (uint32)threadID));
+
+				Float dirX = V::Sub(V::Gather(inParticles.positionX, indices, mask), positionX);
+				Float dirY = V::Sub(V::Gather(inParticles.positionY, indices, mask), positionY);
+				Float dirZ = V::Sub(V::Gather(inParticles.positionZ, indices, mask), positionZ);
+				Float distSqr = V::Add(V::Add(V::Mul(dirX, dirX), V::Mul(dirY, dirY)), V::Mul(dirZ, dirZ));
+
+				mask = V::And(mask, V::LessEqual(distSqr, maxInteractionDistanceSqr));
+
+				if (!V::Any(mask))
+					continue;
+
+				//Particles with the same position get a random direction in the scalar function, which is left to it
+				if (V::Any(V::And(mask, V::Equal(distSqr, V::Zero()))))
+				{
+					UpdateParticleDynamics(threadID, dynamicParticlesCount, dynamicParticlesHashMapSize, staticParticlesCount, staticParticlesHashMapSize, inParticles, outParticles, hashMap, particleMap, staticParticles, staticParticlesHashMap, deltaTime, parameters, triangleCount, triangles, triangleHashMapSize, triangleHashMap, triangleMap);
+					return;
+				}
+
+				Float dist = V::Sqrt(distSqr);
+				dirX = V::Div(dirX, dist);
+				dirY = V::Div(dirY, dist);
+				dirZ = V::Div(dirZ, dist);
+
+				Float otherParticlePressure = V::Gather(outParticles.pressure, indices, mask);
+				Float otherParticleVelocityX = V::Gather(inParticles.velocityX, indices, mask);
+				Float otherParticleVelocityY = V::Gather(inParticles.velocityY, indices, mask);
+				Float otherParticleVelocityZ = V::Gather(inParticles.velocityZ, indices, mask);
+
+				Float t = V::Sub(maxInteractionDistance, dist);
+				Float d1 = V::Mul(V::Mul(d1Factor, t), t);
+				Float d2 = V::Mul(d2Factor, t);
+
+				Float pressureSum = V::Add(pressure, otherParticlePressure);
+				dynamicParticlePressureForceX = V::Add(dynamicParticlePressureForceX, V::Select(mask, V::Mul(V::Mul(dirX, pressureSum), d1)));
+				dynamicParticlePressureForceY = V::Add(dynamicParticlePressureForceY, V::Select(mask, V::Mul(V::Mul(dirY, pressureSum), d1)));
+				dynamicParticlePressureForceZ = V::Add(dynamicParticlePressureForceZ, V::Select(mask, V::Mul(V::Mul(dirZ, pressureSum), d1)));
+
+				dynamicParticleViscosityForceX = V::Add(dynamicParticleViscosityForceX, V::Select(mask, V::Mul(V::Sub(otherParticleVelocityX, velocityX), d2)));
+				dynamicParticleViscosityForceY = V::Add(dynamicParticleViscosityForceY, V::Select(mask, V::Mul(V::Sub(otherParticleVelocityY, velocityY), d2)));
+				dynamicParticleViscosityForceZ = V::Add(dynamicParticleViscosityForceZ, V::Select(mask, V::Mul(V::Sub(otherParticleVelocityZ, velocityZ), d2)));
+			}
+		}
+
+		if (staticParticlesCount != 0)
+			cellBucketCount = GetNeighbourCellBuckets(particlePositionX, particlePositionY, particlePositionZ, staticParticlesHashMapSize, parameters, cellBuckets);
+		else
+			cellBucketCount = 0;
+
+		for (uint32 cellIndex = 0; cellIndex < cellBucketCount; ++cellIndex)
+		{
+			uint32 beginIndex = staticParticlesHashMap[cellBuckets[cellIndex]];
+			uint32 endIndex = staticParticlesHashMap[cellBuckets[cellIndex] + 1];
+
+			for (uint32 i = beginIndex; i < endIndex; i += V::Width)
+			{
+				Mask mask = V::FirstLanes(endIndex - i);
+				Int indices = V::StridedIndices(i, sizeof(StaticParticle) / sizeof(float));
+
+				Float dirX = V::Sub(V::Gather(staticParticlesPositionX, indices, mask), positionX);
+				Float dirY = V::Sub(V::Gather(staticParticlesPositionY, indices, mask), positionY);
+				Float dirZ = V::Sub(V::Gather(staticParticlesPositionZ, indices, mask), positionZ);
+				Float distSqr = V::Add(V::Add(V::Mul(dirX, dirX), V::Mul(dirY, dirY)), V::Mul(dirZ, dirZ));
+
+				mask = V::And(mask, V::LessEqual(distSqr, maxInteractionDistanceSqr));
+
+				if (!V::Any(mask))
+					continue;
+
+				if (V::Any(V::And(mask, V::Equal(distSqr, V::Zero()))))
+				{
+					UpdateParticleDynamics(threadID, dynamicParticlesCount, dynamicParticlesHashMapSize, staticParticlesCount, staticParticlesHashMapSize, inParticles, outParticles, hashMap, particleMap, staticParticles, staticParticlesHashMap, deltaTime, parameters, triangleCount, triangles, triangleHashMapSize, triangleHashMap, triangleMap);
+					return;
+				}
+
+				Float dist = V::Sqrt(distSqr);
+				dirX = V::Div(dirX, dist);
+				dirY = V::Div(dirY, dist);
+				dirZ = V::Div(dirZ, dist);
+
+				Float t = V::Sub(maxInteractionDistance, dist);
+				Float d1 = V::Mul(V::Mul(d1Factor, t), t);
+				Float d2 = V::Mul(d2Factor, t);
+
+				staticParticlePressureForceX = V::Add(staticParticlePressureForceX, V::Select(mask, V::Mul(V::Mul(dirX, absolutePressure), d1)));
+				staticParticlePressureForceY = V::Add(staticParticlePressureForceY, V::Select(mask, V::Mul(V::Mul(dirY, absolutePressure), d1)));
+				staticParticlePressureForceZ = V::Add(staticParticlePressureForceZ, V::Select(mask, V::Mul(V::Mul(dirZ, absolutePressure), d1)));
+
+				staticParticleViscosityInfluenceSum = V::Add(staticParticleViscosityInfluenceSum, V::Select(mask, d2));
+			}
+		}
+
+		const float staticParticleViscosityInfluence = V::ReduceAdd(staticParticleViscosityInfluenceSum);
+
+		ParticleInteractionSums sums;
+		sums.dynamicParticlePressureForce[0] = V::ReduceAdd(dynamicParticlePressureForceX);
+		sums.dynamicParticlePressureForce[1] = V::ReduceAdd(dynamicParticlePressureForceY);
+		sums.dynamicParticlePressureForce[2] = V::ReduceAdd(dynamicParticlePressureForceZ);
+		sums.dynamicParticleViscosityForce[0] = V::ReduceAdd(dynamicParticleViscosityForceX);
+		sums.dynamicParticleViscosityForce[1] = V::ReduceAdd(dynamicParticleViscosityForceY);
+		sums.dynamicParticleViscosityForce[2] = V::ReduceAdd(dynamicParticleViscosityForceZ);
+		sums.staticParticlePressureForce[0] = V::ReduceAdd(staticParticlePressureForceX);
+		sums.staticParticlePressureForce[1] = V::ReduceAdd(staticParticlePressureForceY);
+		sums.staticParticlePressureForce[2] = V::ReduceAdd(staticParticlePressureForceZ);
+		sums.staticParticleViscosityForce[0] = -particleVelocityX * staticParticleViscosityInfluence;
+		sums.staticParticleViscosityForce[1] = -particleVelocityY * staticParticleViscosityInfluence;
+		sums.staticParticleViscosityForce[2] = -particleVelocityZ * staticParticleViscosityInfluence;
+
+		IntegrateParticle(threadID, dynamicParticlesHashMapSize, inParticles, outParticles, sums, deltaTime, parameters, triangleCount, triangles, triangleHashMapSize, triangleHashMap, triangleMap);
+	}
+}
\ No newline at end of file
@@ -100,6 +100,23 @@ OpenCLContext::OpenCLContext(Graphics::OpenGL::GraphicsContext_OpenGL& graphicsC
     //Debug::Logger::LogInfo("Client", "Available OpenCL extensions: \n" + StringView(deviceExtensions.data(), deviceExtensions.size()));
 }
 
+OpenCLContext::OpenCLContext() :
+    supportedCLGLInterop(false)
+{
+    PrintPlatformAndDeviceInfo();
+
+    Set<String> extensions = { "cl_khr_global_int32_base_atomics" };
+
+    if (!SearchAnyPlatformAndDevice(extensions)) return;
+
+    if (!CreateContext()) return;
+
+    auto name = cl::Device(device).getInfo<CL_DEVICE_NAME>();
+    auto version = cl::Device(device).getInfo<CL_DEVICE_VERSION>();
+    auto openCLCVersion = cl::Device(device).getInfo<CL_DEVICE_OPENCL_C_VERSION>();
+    BLAZE_LOG_INFO("Successfully initialized {} ({}) without OpenCL-OpenGL interop with device named \"{}\"", StringView(version.data(), version.size()), StringView(openCLCVersion.data(), openCLCVersion.size()), StringView(name.data(), name.size()));
+}
+
 OpenCLContext::~OpenCLContext()
 {
 }
@@ -321,3 +338,28 @@ bool OpenCLContext::CreateContext(Graphics::OpenGL::GraphicsContext_OpenGL& grap
 
     return true;
 }
+
+bool OpenCLContext::CreateContext()
+{
+    cl_int ret;
+
+    cl_context_properties properties[] =
+    {
+      CL_CONTEXT_PLATFORM, (cl_context_properties)platform,
+      0
+    };
+
+    auto errorCallback = [](const char* errInfo, const void* privateInfo, size_t cv, void* userData) {
+        Debug::Logger::LogFatal("OpenCL", "OpenCL error callback:\n " + StringView(errInfo, strlen(errInfo)));
+        };
+
+    context = clCreateContext(properties, 1, &device, errorCallback, nullptr, &ret);
+    if (ret != CL_SUCCESS)
+    {
+        context = nullptr;
+        PrintOpenCLError(ret);
+        return false;
+    }
+
+    return true;
+}
@@ -5,7 +5,7 @@
 namespace SPH
 {
 	OfflineCPUParticleBufferManager::OfflineCPUParticleBufferManager()
-		: currentBuffer(0), particleSize(0), particleCount(0)
+		: currentBuffer(0), preferredPageSize(PageSize::Default), particleSize(0), particleCount(0), layout(ParticleBufferLayout::ArrayOfStructs)
 	{
 	}
 	OfflineCPUParticleBufferManager::~OfflineCPUParticleBufferManager()
@@ -19,12 +19,13 @@ namespace SPH
 		buffer.Clear();
 		particleSize = 0;
 		particleCount = 0;
+		layout = ParticleBufferLayout::ArrayOfStructs;
 	}
 	void OfflineCPUParticleBufferManager::Advance()
 	{
 		currentBuffer = (currentBuffer + 1) % buffers.Count();
 	}
-	void OfflineCPUParticleBufferManager::Allocate(uintMem newParticleSize, uintMem newParticleCount, void* particles, uintMem newBufferCount)
+	void OfflineCPUParticleBufferManager::Allocate(uintMem newParticleSize, uintMem newParticleCount, void* particles, uintMem newBufferCount, ParticleBufferLayout newLayout)
 	{
 		Clear();
 
@@ -36,16 +37,30 @@ namespace SPH
 
 		particleSize = newParticleSize;
 		particleCount = newParticleCount;
+		layout = newLayout;
 
 		buffers = Array<ParticlesBuffer>(newBufferCount);
-		buffer.Allocate(particleSize * particleCount * newBufferCount);
+		buffer.Allocate(particleSize * particleCount * newBufferCount, preferredPageSize);
 
 		if (particles != nullptr)
-			memcpy(buffer.Ptr(), particles, particleSize * particleCount);
+		{
+			if (layout == ParticleBufferLayout::StructOfArrays)
+				ConvertParticlesToStructOfArrays(particles, buffer.Ptr(), particleSize, particleCount);
+			else
+				memcpy(buffer.Ptr(), particles, particleSize * particleCount);
+		}
 
 		for (uintMem i = 0; i < buffers.Count(); ++i)
 			buffers[i].SetPointer((char*)buffer.Ptr() + particleSize * particleCount * i);
 	}
+	void OfflineCPUParticleBufferManager::SetPreferredPageSize(PageSize pageSize)
+	{
+		preferredPageSize = pageSize;
+	}
+	PageSize OfflineCPUParticleBufferManager::GetPageSize() const
+	{
+		return buffer.GetPageSize();
+	}
 	uintMem OfflineCPUParticleBufferManager::GetBufferCount() const
 	{
 		return buffers.Count();
@@ -58,6 +73,10 @@ namespace SPH
 	{
 		return particleSize;
 	}
+	ParticleBufferLayout OfflineCPUParticleBufferManager::GetLayout() const
+	{
+		return layout;
+	}
 	ResourceLockGuard OfflineCPUParticleBufferManager::LockRead(void* signalEvent)
 	{
 		if (buffers.Empty())
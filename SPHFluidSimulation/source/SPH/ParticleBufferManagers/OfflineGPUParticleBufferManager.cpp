@@ -30,10 +30,16 @@ namespace SPH
 	{
 		currentBuffer = (currentBuffer + 1) % buffers.Count();
 	}
-	void OfflineGPUParticleBufferManager::Allocate(uintMem newParticleSize, uintMem newParticleCount, void* particles, uintMem newBufferCount)
+	void OfflineGPUParticleBufferManager::Allocate(uintMem newParticleSize, uintMem newParticleCount, void* particles, uintMem newBufferCount, ParticleBufferLayout layout)
 	{
 		Clear();
 
+		if (layout != ParticleBufferLayout::ArrayOfStructs)
+		{
+			Debug::Logger::LogFatal("SPH Library", "GPU particle buffer managers only support the ArrayOfStructs layout");
+			return;
+		}
+
 		if (newParticleSize * newParticleCount == 0)
 			return;
 
@@ -83,6 +89,10 @@ namespace SPH
 	{
 		return particleSize;
 	}
+	ParticleBufferLayout OfflineGPUParticleBufferManager::GetLayout() const
+	{
+		return ParticleBufferLayout::ArrayOfStructs;
+	}
 	ResourceLockGuard OfflineGPUParticleBufferManager::LockRead(void* signalEvent)
 	{
 		if (buffers.Empty())
@@ -136,6 +136,11 @@ namespace SPH
 
 		lockState = 0;
 
+		//A reader that keeps locking the buffer while nothing writes to it would fill the events, they only signal the
+		//end of the reads so waiting for the old ones is enough
+		if (!readLockFinishedSignalEvents.CanAppend(waitEvents.Count()))
+			WaitForReadToFinish();
+
 		for (auto event : waitEvents)
 			clRetainEvent(event);
 
@@ -159,6 +164,21 @@ namespace SPH
 		for (auto event : waitEvents)
 			clRetainEvent(event);
 
-		writeLockFinishedSignalEvents = waitEvents;
+		writeLockFinishedSignalEvents.Clear();
+		writeLockFinishedSignalEvents.Append(waitEvents);
+	}
+	void OpenCLLock::SignalEvents::Append(ArrayView<cl_event> appendedEvents)
+	{
+		for (auto event : appendedEvents)
+		{
+			if (count == MaxEventCount)
+			{
+				Debug::Logger::LogFatal("SPH Library", "All lock signal events are exhausted");
+				clReleaseEvent(event);
+				continue;
+			}
+
+			events[count++] = event;
+		}
 	}
 }
\ No newline at end of file
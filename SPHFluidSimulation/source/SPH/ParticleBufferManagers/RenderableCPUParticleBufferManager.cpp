@@ -25,7 +25,7 @@ namespace SPH
 	}
 
 	RenderableCPUParticleBufferManager::RenderableCPUParticleBufferManager()
-		: openGLThreadID(), currentBuffer(0), particleSize(0), particleCount(0), bufferGL(0)
+		: openGLThreadID(), currentBuffer(0), bufferGL(0), preferredPageSize(PageSize::Default), particleSize(0), particleCount(0), layout(ParticleBufferLayout::ArrayOfStructs)
 	{
 	}
 	RenderableCPUParticleBufferManager::~RenderableCPUParticleBufferManager()
@@ -41,15 +41,17 @@ namespace SPH
 		}
 
 		buffers.Clear();
+		buffer.Clear();
 		particleSize = 0;
 		particleCount = 0;
+		layout = ParticleBufferLayout::ArrayOfStructs;
 		currentBuffer = 0;
 	}
 	void RenderableCPUParticleBufferManager::Advance()
 	{
 		currentBuffer = (currentBuffer + 1) % buffers.Count();
 	}
-	void RenderableCPUParticleBufferManager::Allocate(uintMem newParticleSize, uintMem newParticleCount, void* particles, uintMem newBufferCount)
+	void RenderableCPUParticleBufferManager::Allocate(uintMem newParticleSize, uintMem newParticleCount, void* particles, uintMem newBufferCount, ParticleBufferLayout newLayout)
 	{
 		openGLThreadID = std::this_thread::get_id();
 
@@ -64,6 +66,7 @@ namespace SPH
 		buffers = Array<ParticlesBuffer>(newBufferCount);
 		particleSize = newParticleSize;
 		particleCount = newParticleCount;
+		layout = newLayout;
 
 		uintMem bufferSize = particleSize * particleCount;
 
@@ -80,8 +83,29 @@ namespace SPH
 
 		bufferGL.FlushBufferRange(0, bufferSize);
 
-		for (uintMem i = 0; i < buffers.Count(); ++i)
-			buffers[i].SetPointer((char*)map + bufferSize * i, true);
+		if (layout == ParticleBufferLayout::StructOfArrays)
+		{
+			buffer.Allocate(bufferSize * newBufferCount, preferredPageSize);
+
+			if (particles != nullptr)
+				ConvertParticlesToStructOfArrays(particles, buffer.Ptr(), particleSize, particleCount);
+
+			for (uintMem i = 0; i < buffers.Count(); ++i)
+				buffers[i].SetPointer((char*)buffer.Ptr() + bufferSize * i, (char*)map + bufferSize * i, true);
+		}
+		else
+		{
+			for (uintMem i = 0; i < buffers.Count(); ++i)
+				buffers[i].SetPointer((char*)map + bufferSize * i, nullptr, true);
+		}
+	}
+	void RenderableCPUParticleBufferManager::SetPreferredPageSize(PageSize pageSize)
+	{
+		preferredPageSize = pageSize;
+	}
+	PageSize RenderableCPUParticleBufferManager::GetPageSize() const
+	{
+		return buffer.GetPageSize();
 	}
 	uintMem RenderableCPUParticleBufferManager::GetBufferCount() const
 	{
@@ -95,6 +119,10 @@ namespace SPH
 	{
 		return particleSize;
 	}
+	ParticleBufferLayout RenderableCPUParticleBufferManager::GetLayout() const
+	{
+		return layout;
+	}
 	Graphics::OpenGL::GraphicsBuffer* RenderableCPUParticleBufferManager::GetGraphicsBuffer(uintMem index, uintMem& bufferOffset)
 	{
 		bufferOffset = index * particleCount * particleSize;
@@ -119,7 +147,7 @@ namespace SPH
 		if (buffers.Empty())
 			return ResourceLockGuard();
 
-		auto lockGuard = buffers[currentBuffer].LockForRendering(bufferGL, currentBuffer, particleCount * particleSize);
+		auto lockGuard = buffers[currentBuffer].LockForRendering(bufferGL, currentBuffer, particleSize, particleCount);
 
 		CheckAllRenderingFences();
 
@@ -131,7 +159,7 @@ namespace SPH
 			return;
 
 		auto lockGuard = buffers[currentBuffer].LockRead();
-		buffers[currentBuffer].PrepareForRendering(bufferGL, currentBuffer, particleCount * particleSize);
+		buffers[currentBuffer].PrepareForRendering(bufferGL, currentBuffer, particleSize, particleCount);
 		lockGuard.Unlock({ });
 	}
 	void RenderableCPUParticleBufferManager::FlushAllOperations()
@@ -145,12 +173,13 @@ namespace SPH
 			buffer.CheckRenderingFence();
 	}
 	RenderableCPUParticleBufferManager::ParticlesBuffer::ParticlesBuffer()
-		: ptr(nullptr), renderingFenceFlag(true), preparedForRendering(false)
+		: ptr(nullptr), renderPtr(nullptr), renderingFenceFlag(true), preparedForRendering(false)
 	{
 	}
-	void RenderableCPUParticleBufferManager::ParticlesBuffer::SetPointer(void* ptr, bool preparedForRendering)
+	void RenderableCPUParticleBufferManager::ParticlesBuffer::SetPointer(void* ptr, void* renderPtr, bool preparedForRendering)
 	{
 		this->ptr = ptr;
+		this->renderPtr = renderPtr;
 		this->preparedForRendering = preparedForRendering;
 	}
 	ResourceLockGuard RenderableCPUParticleBufferManager::ParticlesBuffer::LockRead()
@@ -179,12 +208,12 @@ namespace SPH
 			((CPULock*)userData)->UnlockWrite();
 			}, ptr, &lock);
 	}
-	ResourceLockGuard RenderableCPUParticleBufferManager::ParticlesBuffer::LockForRendering(Graphics::OpenGL::ImmutableMappedGraphicsBuffer& buffer, uintMem index, uintMem bufferSize)
+	ResourceLockGuard RenderableCPUParticleBufferManager::ParticlesBuffer::LockForRendering(Graphics::OpenGL::ImmutableMappedGraphicsBuffer& buffer, uintMem index, uintMem particleSize, uintMem particleCount)
 	{
 		lock.LockRead();
 
 		if (!preparedForRendering)
-			PrepareForRendering(buffer, index, bufferSize);
+			PrepareForRendering(buffer, index, particleSize, particleCount);
 
 		renderingFenceFlag = false;
 
@@ -208,11 +237,18 @@ namespace SPH
 		renderingFenceFlag = true;
 		lock.NotifyAll();
 	}
-	void RenderableCPUParticleBufferManager::ParticlesBuffer::PrepareForRendering(Graphics::OpenGL::ImmutableMappedGraphicsBuffer& buffer, uintMem index, uintMem bufferSize)
+	void RenderableCPUParticleBufferManager::ParticlesBuffer::PrepareForRendering(Graphics::OpenGL::ImmutableMappedGraphicsBuffer& buffer, uintMem index, uintMem particleSize, uintMem particleCount)
 	{
+		uintMem bufferSize = particleSize * particleCount;
+
 		if (preparedForRendering || bufferSize == 0)
 			return;
 
+		//The graphics buffer can be written to here because it isn't being rendered from. The write lock waits for
+		//the rendering fence before the particles can be changed and 'preparedForRendering' reset
+		if (renderPtr != nullptr)
+			ConvertParticlesToArrayOfStructs(ptr, renderPtr, particleSize, particleCount);
+
 		buffer.FlushBufferRange(bufferSize * index, bufferSize);
 		preparedForRendering = true;
 	}
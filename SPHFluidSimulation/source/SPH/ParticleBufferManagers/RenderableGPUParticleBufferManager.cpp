@@ -54,10 +54,16 @@ namespace SPH
 	{
 		currentBuffer = (currentBuffer + 1) % buffers.Count();
 	}
-	void RenderableGPUParticleBufferManagerWithoutCLGLInterop::Allocate(uintMem newParticleSize, uintMem newParticleCount, void* particles, uintMem newBufferCount)
+	void RenderableGPUParticleBufferManagerWithoutCLGLInterop::Allocate(uintMem newParticleSize, uintMem newParticleCount, void* particles, uintMem newBufferCount, ParticleBufferLayout layout)
 	{
 		Clear();
 
+		if (layout != ParticleBufferLayout::ArrayOfStructs)
+		{
+			Debug::Logger::LogFatal("SPH Library", "GPU particle buffer managers only support the ArrayOfStructs layout");
+			return;
+		}
+
 		if (newParticleSize * newParticleCount == 0)
 			return;
 
@@ -86,6 +92,10 @@ namespace SPH
 	{
 		return particleSize;
 	}
+	ParticleBufferLayout RenderableGPUParticleBufferManagerWithoutCLGLInterop::GetLayout() const
+	{
+		return ParticleBufferLayout::ArrayOfStructs;
+	}
 	Graphics::OpenGL::GraphicsBuffer* RenderableGPUParticleBufferManagerWithoutCLGLInterop::GetGraphicsBuffer(uintMem index, uintMem& bufferOffset)
 	{
 		bufferOffset = 0;
@@ -1,12 +1,32 @@
 #include "pch.h"
 #include "SPH/Core/SceneBlueprint.h"
 #include "SPH/SimulationEngines/SimulationEngineCPU.h"
+#include "SPH/Concurrency/ParallelScan.h"
+#include "SPH/Concurrency/ParallelRadixSort.h"
 #include "SPH/kernels/SPHFunctions.h"
+#include "SPH/kernels/SPHFunctionsSIMD.h"
+#include <bit>
 
-#define DEBUG_BUFFERS_CPU
+//Measures the time of every phase of the simulation steps, see SimulationEngineCPU::GetStatistics. Every thread reads
+//the timestamp counter around each barrier, so it's off by default
+//#define PROFILE_PHASES_CPU
 
 namespace SPH
 {
+	struct FirstTouchDynamicParticlesTask
+	{
+		ParticleBufferManager& particleBufferManager;
+
+		//Copied into the first buffer, the other buffers are cleared
+		Array<DynamicParticle> particles;
+		PageArray<std::atomic_uint32_t>& hashMap;
+		uint32* particleMap;
+		//Cleared by the thread each histogram belongs to, can be empty
+		Array<Array<uint32>>& hashHistograms;
+
+		ResourceLockGuard bufferLockGuard; //Filled by the thread
+		void* buffer;                      //Filled by the thread
+	};
 	struct CalculateHashAndParticleMapTask
 	{
 		ParticleBufferManager& particleBufferManager;
@@ -14,13 +34,26 @@ namespace SPH
 
 		uintMem particleSize;
 
-		Array<std::atomic_uint32_t>& hashMap;
+		PageArray<std::atomic_uint32_t>& hashMap;
 		uint32* particleMap;
+		//Has an entry for every thread
+		uint32* prefixSumBlockSums;
+		//The particles are sorted by their buckets instead of reordered with atomics when these aren't nullptr, see
+		//SimulationEngineCPU::particleSortKeys
+		uint32* particleSortKeys;
+		uint32* particleSortIndices;
+		uint32* particleSortDigitCounts;
+		uint32* particleSortBuckets;
 
 		ResourceLockGuard initialParticlesLockGuard; //Filled by the thread
 		DynamicParticle* initialParticles;		      //Filled by the thread
+		Details::DynamicParticleStreams initialParticleStreams; //Filled by the thread
 		ResourceLockGuard finalParticlesLockGuard; //Filled by the thread
 		DynamicParticle* finalParticles;		      //Filled by the thread
+		Details::DynamicParticleStreams finalParticleStreams; //Filled by the thread
+
+		bool checkIntegrity;
+		std::atomic_uint64_t& integrityErrorCount;
 	};
 	struct SimulateParticlesTimeStepTask
 	{
@@ -28,46 +61,482 @@ namespace SPH
 		ParticleBufferManager& staticParticlesBufferManager;
 		ParticleBehaviourParameters& particleBehaviourParameters;
 
-		Array<std::atomic_uint32_t>& dynamicParticlesHashMap;
+		PageArray<std::atomic_uint32_t>& dynamicParticlesHashMap;
 		Array<std::atomic_uint32_t>& staticParticlesHashMap;
 		uint32* particleMap;
 
 		Array<Graphics::BasicIndexedMesh::Triangle>& triangles;
+		Array<uint32>& triangleHashMap;
+		Array<uint32>& triangleMap;
 
-		//this is nullptr when parallelPartialSum is false
-		std::atomic_uint32_t* hashMapGroupSums;
+		//Has an entry for every thread, this is nullptr when parallelPartialSum is false and thread 0 computes the
+		//prefix sum alone
+		uint32* prefixSumBlockSums;
 
 		uint simulationSteps;
 		float dt;
 
+		//Decided by thread 0 at the beginning of every step, the particles are reordered after the step when it's set
 		bool reorderParticles;
-
+		float& reorderElapsedTime;
+		float reorderTimeInterval;
+		//Has an entry for every thread, the reordering is adaptive instead of by the time interval when this isn't
+		//nullptr, see SimulationEngineCPU::IsAdaptiveReorderingUsed
+		uint64* reorderScatterCounts;
+		float adaptiveReorderCost;
+		double& reorderAccumulatedScatter;
+		ReorderStatistics& reorderStatistics;
+
+		//Used for the particles in the StructOfArrays layout, chosen by the instruction set of the engine
+		Details::UpdateParticlePressureFunction updateParticlePressure;
+		Details::UpdateParticleDynamicsFunction updateParticleDynamics;
+		//Used for the particles in the ArrayOfStructs layout
+		Details::UpdateParticlePressureAoSFunction updateParticlePressureAoS;
+		Details::UpdateParticleDynamicsAoSFunction updateParticleDynamicsAoS;
+
+		//Storage of Details::PairInteractionSums, the half neighbourhood traversal is used instead of the functions above
+		//when this isn't nullptr
+		float* pairInteractionSums;
+		Array<Array<uint32>>& pairContributionIndices;
+		Array<Array<float>>& pairContributionValues;
+		Array<Array<uint32>>& groupedPairContributionIndices;
+		Array<Array<float>>& groupedPairContributionValues;
+		Array<uintMem>& pairContributionOffsets;
+
+		//The hash map is built from a histogram of every thread instead of with atomics when this isn't empty
+		Array<Array<uint32>>& hashHistograms;
+
+		//Storage of the Details::CellNeighbourCandidates of every thread, the cell blocked traversal is used instead of
+		//the functions above when these aren't empty
+		Array<Array<float>>& cellNeighbourCandidateStreams;
+		Array<Array<uint32>>& cellNeighbourCandidateIndices;
+
+		//The pressure and dynamics passes are scheduled dynamically in chunks of this many particles, see
+		//ThreadContext::ParallelFor, when it isn't 0
+		uintMem dynamicSchedulingChunkSize;
+
+		//The particles are sorted by their bucket after every step instead of rebuilding the hash map when these aren't
+		//nullptr, see SimulationEngineCPU::particleSortKeys
+		uint32* particleSortKeys;
+		uint32* particleSortIndices;
+		uint32* particleSortDigitCounts;
+		uint32* particleSortBuckets;
+		//The particles whose bucket changed are sorted apart and merged with the others when there are at most
+		//'particleSortMovedCapacity' of them and these aren't nullptr, see SimulationEngineCPU::particleSortMovedKeys
+		uint32* particleSortMovedKeys;
+		uint32* particleSortMovedIndices;
+		uintMem particleSortMovedCapacity;
+		uint32* particleSortMovedCounts;
+		uint32* particleSortFirstUnmoved;
+		ParticleSortStatistics& particleSortStatistics;
+
+		//The Verlet lists are used instead of the neighbour search when 'verletListStorage' isn't empty
+		Array<Array<uint32>>& verletListStorage;
+		Array<uint32>& verletListRanges;
+		Array<float>& verletListReferencePositions;
+		bool& verletListsValid;
+		std::atomic_bool& verletListRebuildRequested;
+		VerletListStatistics& verletListStatistics;
+		float verletSkinDistance;
+
+		ThreadPhaseRecorder& phaseRecorder;
+
+		//The integrity of the particles and the maps is checked after every step whose index plus one is divisible by
+		//the interval, it is 0 when the checks are off
+		uint64 integrityCheckInterval;
+		uint64 firstStepIndex;
+		uint64& integrityCheckedStepCount;
+		std::atomic_uint64_t& integrityErrorCount;
+
+		//The DynamicParticle pointers are used when the dynamic particles are in the ArrayOfStructs layout and
+		//the streams when they are in the StructOfArrays layout
 		ResourceLockGuard inputParticlesLockGuard;
 		DynamicParticle* inputParticles;
+		Details::DynamicParticleStreams inputParticleStreams;
 		ResourceLockGuard outputParticlesLockGuard;
 		DynamicParticle* outputParticles;
+		Details::DynamicParticleStreams outputParticleStreams;
 		ResourceLockGuard orderedParticlesLockGuard;
 		DynamicParticle* orderedParticles;
+		Details::DynamicParticleStreams orderedParticleStreams;
 		ResourceLockGuard staticParticlesLockGuard;
 		StaticParticle* staticParticles;
 	};
 
+	//The entries of the private hash histograms have the epoch of the step that counted them in the upper bits and the
+	//count in the lower bits. When the hash map is built the count is replaced by the offset of the thread in the
+	//bucket. Entries of other epochs count as 0, so a histogram only has to be cleared when the epochs repeat
+	static constexpr uint32 HashHistogramCountBits = 24;
+	static constexpr uint32 HashHistogramCountMask = (1u << HashHistogramCountBits) - 1;
+	static constexpr uint32 HashHistogramEpochCount = (1u << (32 - HashHistogramCountBits)) - 1;
+
+	//Epoch 0 is never used, so that the zeroed histograms are empty
+	static uint32 GetHashHistogramEpoch(uint64 stepIndex)
+	{
+		return (uint32)(stepIndex % HashHistogramEpochCount) + 1;
+	}
+	static void CountParticleHash(uint32* histogram, uint32 hash, uint32 epoch)
+	{
+		uint32 entry = histogram[hash];
+		histogram[hash] = (entry >> HashHistogramCountBits) == epoch ? entry + 1 : (epoch << HashHistogramCountBits) | 1;
+	}
+
+	//Only one of 'particles' and 'particleStreams' is set, depending on the layout of the buffer manager
+	static void GetDynamicParticles(ResourceLockGuard& lockGuard, ParticleBufferManager& bufferManager, DynamicParticle*& particles, Details::DynamicParticleStreams& particleStreams)
+	{
+		if (bufferManager.GetLayout() == ParticleBufferLayout::StructOfArrays)
+		{
+			particles = nullptr;
+			particleStreams = Details::GetDynamicParticleStreams(lockGuard.GetResource(), bufferManager.GetParticleCount());
+		}
+		else
+		{
+			particles = (DynamicParticle*)lockGuard.GetResource();
+			particleStreams = { };
+		}
+	}
+	/*
+		Checks the dynamic particles in [begin, end) and the hash map buckets in [bucketBegin, bucketEnd) after the hash
+		map and the particle map are finished, so every thread can check its own part in parallel. 'particles' is
+		nullptr when the particles are in the StructOfArrays layout. Returns the number of errors, only the first one is
+		logged.
+	*/
+	static uint64 CheckDynamicParticlesIntegrity(
+		uintMem begin,
+		uintMem end,
+		uintMem bucketBegin,
+		uintMem bucketEnd,
+		const DynamicParticle* particles,
+		const Details::DynamicParticleStreams& particleStreams,
+		uintMem particleCount,
+		const std::atomic_uint32_t* hashMap,
+		uintMem bucketCount,
+		const uint32* particleMap,
+		const ParticleBehaviourParameters& parameters
+	)
+	{
+		auto getParticle = [&](uintMem index) -> DynamicParticle {
+			if (particles != nullptr)
+				return particles[index];
+
+			return DynamicParticle{
+				.position = Vec3f(particleStreams.positionX[index], particleStreams.positionY[index], particleStreams.positionZ[index]),
+				.pressure = particleStreams.pressure[index],
+				.velocity = Vec3f(particleStreams.velocityX[index], particleStreams.velocityY[index], particleStreams.velocityZ[index]),
+				.hash = particleStreams.hash[index]
+			};
+			};
+
+		uint64 errorCount = 0;
+		auto reportError = [&](const char* message) {
+			if (errorCount++ == 0)
+				Debug::Logger::LogError("Client", message);
+			};
+
+		for (uintMem i = begin; i < end; ++i)
+		{
+			DynamicParticle particle = getParticle(i);
+
+			if (!std::isfinite(particle.position.x) || !std::isfinite(particle.position.y) || !std::isfinite(particle.position.z))
+				reportError("One or more of particle position components is nan or inf");
+
+			if (!std::isfinite(particle.velocity.x) || !std::isfinite(particle.velocity.y) || !std::isfinite(particle.velocity.z))
+				reportError("One or more of particle velocity components is nan or inf");
+
+			if (!std::isfinite(particle.pressure))
+				reportError("Particle pressure is nan or inf");
+
+			if (particle.hash != SimulationEngine::GetCellBucket(SimulationEngine::GetCell(particle.position, parameters.maxInteractionDistance), bucketCount, parameters))
+				reportError("Invalid particle hash");
+		}
+
+		if (bucketBegin == 0 && hashMap[0] != 0)
+			reportError("Hash map first value is not 0");
+
+		if (bucketEnd == bucketCount && hashMap[bucketCount] != particleCount)
+			reportError("Hash map last value is not the number of particles");
+
+		for (uintMem i = bucketBegin; i < bucketEnd; ++i)
+		{
+			uint32 first = hashMap[i];
+			uint32 last = hashMap[i + 1];
+
+			if (first > last || last > particleCount)
+			{
+				reportError("Hash map value smaller than the previous value or greater than the particle count");
+				continue;
+			}
+
+			for (uint32 j = first; j < last; ++j)
+				if (particleMap[j] >= particleCount || getParticle(particleMap[j]).hash != i)
+					reportError("Invalid particleMap value");
+		}
+
+		return errorCount;
+	}
+
+	//Phases of a simulation step in the order they are run
+	enum class SimulationPhase
+	{
+		LockBuffers,
+		NeighbourLists,
+		Pressure,
+		Dynamics,
+		ClearHashMap,
+		CountHashes,
+		IntegrityCheck,
+		PrefixSum,
+		ParticleMap,
+		SortParticles,
+		MeasureLocality,
+		UnlockBuffers,
+		Count
+	};
+	static const char* const simulationPhaseNames[]{
+		"lockBuffers",
+		"neighbourLists",
+		"pressure",
+		"dynamics",
+		"clearHashMap",
+		"countHashes",
+		"integrityCheck",
+		"prefixSum",
+		"particleMap",
+		"sortParticles",
+		"measureLocality",
+		"unlockBuffers"
+	};
+	static_assert(std::size(simulationPhaseNames) == (uintMem)SimulationPhase::Count);
+
+	/*
+		Records the phases of one thread. The time between two calls to Begin is added to the earlier phase and the time
+		spent in SyncThreads is added to the waiting time of the current phase. The last phase ends when the timer is
+		destroyed. Without PROFILE_PHASES_CPU it only synchronizes the threads.
+	*/
+	class PhaseTimer
+	{
+	public:
+#ifdef PROFILE_PHASES_CPU
+		PhaseTimer(ThreadPhaseRecorder& recorder, const ThreadContext& context)
+			: recorder(recorder), threadIndex(context.GetThreadIndex()), phase(SimulationPhase::Count), start(0)
+		{
+		}
+		~PhaseTimer()
+		{
+			End();
+		}
+
+		void BeginStep()
+		{
+			if (threadIndex == 0)
+				recorder.AddStep();
+
+			Begin(SimulationPhase::LockBuffers);
+		}
+		void Begin(SimulationPhase newPhase)
+		{
+			uint64 now = ThreadPhaseRecorder::ReadTimestamp();
+
+			if (phase != SimulationPhase::Count)
+				recorder.AddWork(threadIndex, (uintMem)phase, now - start);
+
+			recorder.AddCall(threadIndex, (uintMem)newPhase);
+			phase = newPhase;
+			start = now;
+		}
+		void End()
+		{
+			if (phase != SimulationPhase::Count)
+				recorder.AddWork(threadIndex, (uintMem)phase, ThreadPhaseRecorder::ReadTimestamp() - start);
+
+			phase = SimulationPhase::Count;
+		}
+		void SyncThreads(const ThreadContext& context)
+		{
+			uint64 syncStart = ThreadPhaseRecorder::ReadTimestamp();
+			context.SyncThreads();
+			uint64 syncEnd = ThreadPhaseRecorder::ReadTimestamp();
+
+			recorder.AddWork(threadIndex, (uintMem)phase, syncStart - start);
+			recorder.AddWait(threadIndex, (uintMem)phase, syncEnd - syncStart);
+			start = syncEnd;
+		}
+	private:
+		ThreadPhaseRecorder& recorder;
+		uintMem threadIndex;
+		SimulationPhase phase;
+		uint64 start;
+#else
+		PhaseTimer(ThreadPhaseRecorder& recorder, const ThreadContext& context) { }
+
+		void BeginStep() { }
+		void Begin(SimulationPhase newPhase) { }
+		void End() { }
+		void SyncThreads(const ThreadContext& context) { context.SyncThreads(); }
+#endif
+	};
+
+	/*
+		Sorts the buckets in the first half of 'keys' of the particles whose indices they are, called by every thread of
+		a task after each of them wrote the keys of its block of the particles. The indices are filled here. Both arrays
+		have two halves the radix sort moves them between, returns the offset of the half with the sorted ones.
+	*/
+	template<typename Sync>
+	static uintMem SortParticleBuckets(const ThreadContext& context, uint32* keys, uint32* indices, uint32* digitCounts, uintMem particleCount, uintMem bucketCount, const Sync& sync)
+	{
+		uintMem begin = particleCount * context.GetThreadIndex() / context.GetThreadCount();
+		uintMem end = particleCount * (context.GetThreadIndex() + 1) / context.GetThreadCount();
+
+		for (uintMem i = begin; i < end; ++i)
+			indices[i] = (uint32)i;
+
+		//The radix sort counts the keys of the block of each thread first, so the threads don't have to synchronize
+		//before it
+		bool sortedIntoTemp = ParallelRadixSort(context, keys, indices, keys + particleCount, indices + particleCount, particleCount, (uint32)std::bit_width(bucketCount - 1), digitCounts, sync);
+
+		return sortedIntoTemp ? particleCount : 0;
+	}
+	static void CopyDynamicParticle(
+		uintMem index, uintMem newIndex, uint32 hash,
+		const DynamicParticle* inParticles,
+		const Details::DynamicParticleStreams& inParticleStreams,
+		DynamicParticle* outParticles,
+		const Details::DynamicParticleStreams& outParticleStreams,
+		bool structOfArrays)
+	{
+		if (structOfArrays)
+		{
+			outParticleStreams.positionX[newIndex] = inParticleStreams.positionX[index];
+			outParticleStreams.positionY[newIndex] = inParticleStreams.positionY[index];
+			outParticleStreams.positionZ[newIndex] = inParticleStreams.positionZ[index];
+			outParticleStreams.pressure[newIndex] = inParticleStreams.pressure[index];
+			outParticleStreams.velocityX[newIndex] = inParticleStreams.velocityX[index];
+			outParticleStreams.velocityY[newIndex] = inParticleStreams.velocityY[index];
+			outParticleStreams.velocityZ[newIndex] = inParticleStreams.velocityZ[index];
+			outParticleStreams.hash[newIndex] = hash;
+		}
+		else
+			outParticles[newIndex] = inParticles[index];
+	}
+	//Every bucket begins at the first sorted particle whose bucket isn't smaller, so each thread finds the beginnings of
+	//the buckets from the ones of its own particles
+	static void FillSortedDynamicParticlesHashMap(uintMem begin, uintMem end, const uint32* sortedBuckets, PageArray<std::atomic_uint32_t>& hashMap, uintMem particleCount)
+	{
+		for (uintMem i = begin; i < end; ++i)
+			for (uint32 bucket = i == 0 ? 0 : sortedBuckets[i - 1] + 1; bucket <= sortedBuckets[i]; ++bucket)
+				hashMap[bucket].store((uint32)i, std::memory_order_relaxed);
+
+		//The buckets after the last particle begin at the end
+		if (begin != end && end == particleCount)
+			for (uint32 bucket = sortedBuckets[end - 1] + 1; bucket < hashMap.Count() - 1; ++bucket)
+				hashMap[bucket].store((uint32)particleCount, std::memory_order_relaxed);
+	}
+	/*
+		Copies the particles from 'inParticles' into 'outParticles' in the order of the sorted keys and indices, stores
+		their buckets into 'sortedBuckets' and fills the hash map. The particle map stays the identity.
+	*/
+	static void FinishSortedDynamicParticles(
+		uintMem begin, uintMem end,
+		const uint32* keys,
+		const uint32* indices,
+		uint32* sortedBuckets,
+		PageArray<std::atomic_uint32_t>& hashMap,
+		const DynamicParticle* inParticles,
+		const Details::DynamicParticleStreams& inParticleStreams,
+		DynamicParticle* outParticles,
+		const Details::DynamicParticleStreams& outParticleStreams,
+		uintMem particleCount,
+		bool structOfArrays)
+	{
+		for (uintMem i = begin; i < end; ++i)
+		{
+			CopyDynamicParticle(indices[i], i, keys[i], inParticles, inParticleStreams, outParticles, outParticleStreams, structOfArrays);
+			sortedBuckets[i] = keys[i];
+		}
+
+		FillSortedDynamicParticlesHashMap(begin, end, keys, hashMap, particleCount);
+	}
+	/*
+		Writes the dynamic particle buffers, the hash map and the particle map for the first time, every thread the part
+		of them it updates in the simulation steps. The OS places a page on the NUMA node of the thread that first
+		touches it, so with pinned threads each thread reads and writes its own particles from its own node.
+	*/
+	static void FirstTouchDynamicParticles(const ThreadContext& context, FirstTouchDynamicParticlesTask& task)
+	{
+		bool structOfArrays = task.particleBufferManager.GetLayout() == ParticleBufferLayout::StructOfArrays;
+		uintMem particleCount = task.particleBufferManager.GetParticleCount();
+		uintMem componentCount = sizeof(DynamicParticle) / sizeof(uint32);
+		uintMem begin = particleCount * context.GetThreadIndex() / context.GetThreadCount();
+		uintMem end = particleCount * (context.GetThreadIndex() + 1) / context.GetThreadCount();
+		uintMem hashBegin = (task.hashMap.Count() - 1) * context.GetThreadIndex() / context.GetThreadCount();
+		uintMem hashEnd = (task.hashMap.Count() - 1) * (context.GetThreadIndex() + 1) / context.GetThreadCount();
+
+		for (uintMem i = hashBegin; i < hashEnd; ++i)
+			task.hashMap[i].store(0, std::memory_order_relaxed);
+
+		std::fill(task.particleMap + begin, task.particleMap + end, 0);
+
+		if (!task.hashHistograms.Empty())
+		{
+			Array<uint32>& histogram = task.hashHistograms[context.GetThreadIndex()];
+			std::fill_n(histogram.Ptr(), histogram.Count(), 0);
+		}
+
+		for (uintMem i = 0; i < task.particleBufferManager.GetBufferCount(); ++i)
+		{
+			if (context.GetThreadIndex() == 0)
+			{
+				task.bufferLockGuard = task.particleBufferManager.LockWrite(nullptr);
+				task.buffer = task.bufferLockGuard.GetResource();
+			}
+
+			context.SyncThreads();
+
+			const uint32* in = i == 0 ? (const uint32*)task.particles.Ptr() : nullptr;
+			uint32* out = (uint32*)task.buffer;
+
+			if (structOfArrays)
+			{
+				for (uintMem j = 0; j < componentCount; ++j)
+					for (uintMem k = begin; k < end; ++k)
+						out[j * particleCount + k] = in != nullptr ? in[k * componentCount + j] : 0;
+			}
+			else if (in != nullptr)
+				memcpy(out + begin * componentCount, in + begin * componentCount, (end - begin) * sizeof(DynamicParticle));
+			else
+				memset(out + begin * componentCount, 0, (end - begin) * sizeof(DynamicParticle));
+
+			context.SyncThreads();
+
+			if (context.GetThreadIndex() == 0)
+			{
+				task.buffer = nullptr;
+				task.bufferLockGuard.Unlock({});
+				task.particleBufferManager.Advance();
+			}
+		}
+	}
 	static void CalculateHashAndParticleMap(const ThreadContext& context, CalculateHashAndParticleMapTask& task)
 	{
 		if (context.GetThreadIndex() == 0)
 		{
 			task.initialParticlesLockGuard = task.particleBufferManager.LockWrite(nullptr);
-			task.initialParticles = (DynamicParticle*)task.initialParticlesLockGuard.GetResource();
+			GetDynamicParticles(task.initialParticlesLockGuard, task.particleBufferManager, task.initialParticles, task.initialParticleStreams);
 		}
 
+		bool structOfArrays = task.particleBufferManager.GetLayout() == ParticleBufferLayout::StructOfArrays;
 		uintMem particleCount = task.particleBufferManager.GetParticleCount();
 		uintMem begin = particleCount * context.GetThreadIndex() / context.GetThreadCount();
 		uintMem end = particleCount * (context.GetThreadIndex() + 1) / context.GetThreadCount();
 
 		context.SyncThreads();
 
-		for (uintMem i = begin; i < end; ++i)
-			Details::ComputeDynamicParticlesHashAndPrepareHashMap(i, task.hashMap.Ptr(), task.hashMap.Count() - 1, task.initialParticles, task.particleBehaviourParameters.maxInteractionDistance, particleCount);
+		if (structOfArrays)
+			for (uintMem i = begin; i < end; ++i)
+				Details::ComputeDynamicParticlesHashAndPrepareHashMap(i, task.hashMap.Ptr(), task.hashMap.Count() - 1, task.initialParticleStreams, &task.particleBehaviourParameters, particleCount);
+		else
+			for (uintMem i = begin; i < end; ++i)
+				Details::ComputeDynamicParticlesHashAndPrepareHashMap(i, task.hashMap.Ptr(), task.hashMap.Count() - 1, task.initialParticles, &task.particleBehaviourParameters, particleCount);
 
 		//for (uintMem i = begin; i < end; ++i)
 		//{
@@ -81,260 +550,1252 @@ namespace SPH
 
 		context.SyncThreads();
 
-		if (context.GetThreadIndex() == 0)
+		//The sorted particles are in a deterministic order from the first step on
+		uintMem sortedOffset = 0;
+		if (task.particleSortKeys != nullptr)
 		{
-#ifdef DEBUG_BUFFERS_CPU
-			Array<uint> hashMap;
-			hashMap.Resize(task.hashMap.Count());
-			for (uintMem i = 0; i < task.hashMap.Count(); ++i)
-				hashMap[i] = task.hashMap[i].load();
-
+			for (uintMem i = begin; i < end; ++i)
+				task.particleSortKeys[i] = structOfArrays ? task.initialParticleStreams.hash[i] : task.initialParticles[i].hash;
 
-			SimulationEngine::DebugPrePrefixSumHashes(
-				ArrayView<DynamicParticle>(task.initialParticles, particleCount),
-				std::move(hashMap)
-			);
-#endif
-			uint32 valueSum = 0;
-			for (uintMem i = 0; i < task.hashMap.Count() - 1; ++i)
-			{
-				valueSum += task.hashMap[i];
-				task.hashMap[i] = valueSum;
-			}
+			sortedOffset = SortParticleBuckets(context, task.particleSortKeys, task.particleSortIndices, task.particleSortDigitCounts, particleCount, task.hashMap.Count() - 1, [&]() { context.SyncThreads(); });
+		}
+		else
+			ParallelInclusiveScan(context, task.hashMap.Ptr(), task.hashMap.Count() - 1, task.prefixSumBlockSums, [&]() { context.SyncThreads(); });
 
+		if (context.GetThreadIndex() == 0)
+		{
 			task.particleBufferManager.Advance();
 
 			task.finalParticlesLockGuard = task.particleBufferManager.LockWrite(nullptr);
-			task.finalParticles = (DynamicParticle*)task.finalParticlesLockGuard.GetResource();
+			GetDynamicParticles(task.finalParticlesLockGuard, task.particleBufferManager, task.finalParticles, task.finalParticleStreams);
 		}
 
 		context.SyncThreads();
 
-		for (uintMem i = begin; i < end; ++i)
-			Details::ReorderDynamicParticlesAndFinishHashMap(i, task.particleMap, task.hashMap.Ptr(), task.initialParticles, task.finalParticles, particleCount);
+		if (task.particleSortKeys != nullptr)
+		{
+			for (uintMem i = begin; i < end; ++i)
+				task.particleMap[i] = (uint32)i;
+
+			FinishSortedDynamicParticles(
+				begin, end,
+				task.particleSortKeys + sortedOffset,
+				task.particleSortIndices + sortedOffset,
+				task.particleSortBuckets,
+				task.hashMap,
+				task.initialParticles,
+				task.initialParticleStreams,
+				task.finalParticles,
+				task.finalParticleStreams,
+				particleCount,
+				structOfArrays
+			);
+		}
+		else if (structOfArrays)
+			for (uintMem i = begin; i < end; ++i)
+				Details::ReorderDynamicParticlesAndFinishHashMap(i, task.particleMap, task.hashMap.Ptr(), task.initialParticleStreams, task.finalParticleStreams, particleCount);
+		else
+			for (uintMem i = begin; i < end; ++i)
+				Details::ReorderDynamicParticlesAndFinishHashMap(i, task.particleMap, task.hashMap.Ptr(), task.initialParticles, task.finalParticles, particleCount);
 
 		//for (uintMem i = begin; i < end; ++i)
 		//	task.particleMap[--task.hashMap[task.particles[i].hash]] = i;
 
 		context.SyncThreads();
 
+		if (task.checkIntegrity)
+		{
+			uintMem bucketBegin = (task.hashMap.Count() - 1) * context.GetThreadIndex() / context.GetThreadCount();
+			uintMem bucketEnd = (task.hashMap.Count() - 1) * (context.GetThreadIndex() + 1) / context.GetThreadCount();
+
+			uint64 errorCount = CheckDynamicParticlesIntegrity(begin, end, bucketBegin, bucketEnd, task.finalParticles, task.finalParticleStreams, particleCount, task.hashMap.Ptr(), task.hashMap.Count() - 1, task.particleMap, task.particleBehaviourParameters);
+
+			if (errorCount != 0)
+				task.integrityErrorCount += errorCount;
+
+			context.SyncThreads();
+		}
+
 		if (context.GetThreadIndex() == 0)
 		{
-#ifdef DEBUG_BUFFERS_CPU
-			SimulationEngine::DebugHashAndParticleMap<std::atomic_uint32_t>({ task.finalParticles, particleCount }, task.hashMap, { task.particleMap, particleCount });
-#endif
 			task.initialParticles = nullptr;
+			task.initialParticleStreams = { };
 			task.initialParticlesLockGuard.Unlock({});
 			task.finalParticles = nullptr;
+			task.finalParticleStreams = { };
 			task.finalParticlesLockGuard.Unlock({});
 		}
 	}
-	static void SimulateParticlesTimeStep(const ThreadContext& context, SimulateParticlesTimeStepTask& task)
+	//Returns true if a particle in the range moved more than half of the skin distance since the lists were built
+	static bool VerletListsExpired(uintMem begin, uintMem end, const Details::DynamicParticleStreams& particleStreams, const SimulateParticlesTimeStepTask& task)
 	{
-		if (context.GetThreadIndex() == 0)
+		const float* referencePositions = task.verletListReferencePositions.Ptr();
+		uintMem particleCount = task.dynamicParticlesBufferManager.GetParticleCount();
+		float maxDisplacementSqr = task.verletSkinDistance * task.verletSkinDistance / 4;
+
+		for (uintMem i = begin; i < end; ++i)
 		{
-			task.staticParticlesLockGuard = task.staticParticlesBufferManager.LockRead(nullptr);
-			task.staticParticles = (StaticParticle*)task.staticParticlesLockGuard.GetResource();
+			Vec3f displacement = Vec3f(
+				particleStreams.positionX[i] - referencePositions[i],
+				particleStreams.positionY[i] - referencePositions[particleCount + i],
+				particleStreams.positionZ[i] - referencePositions[particleCount * 2 + i]
+			);
+
+			if (displacement.DotProduct(displacement) > maxDisplacementSqr)
+				return true;
 		}
 
-		for (uint i = 0; i < task.simulationSteps; ++i)
+		return false;
+	}
+	//Builds the lists of the particles in the range into the storage of one thread. The storage only grows, so after a
+	//few rebuilds it doesn't need to be reallocated anymore
+	static void BuildVerletLists(uintMem begin, uintMem end, Array<uint32>& storage, SimulateParticlesTimeStepTask& task)
+	{
+		const ParticleBehaviourParameters& parameters = task.particleBehaviourParameters;
+		uintMem particleCount = task.dynamicParticlesBufferManager.GetParticleCount();
+		uintMem staticParticleCount = task.staticParticlesBufferManager.GetParticleCount();
+		float* referencePositions = task.verletListReferencePositions.Ptr();
+
+		float listDistance = parameters.maxInteractionDistance + task.verletSkinDistance;
+		float listDistanceSqr = listDistance * listDistance;
+
+		uint32 size = 0;
+		auto addNeighbour = [&](uint32 index) {
+			if (size == storage.Count())
+				storage.Resize(std::max<uintMem>(storage.Count() * 2, 1024));
+			storage[size++] = index;
+			};
+
+		for (uintMem i = begin; i < end; ++i)
 		{
-			if (context.GetThreadIndex() == 0)
-			{
-				task.inputParticlesLockGuard = task.dynamicParticlesBufferManager.LockRead(nullptr);
-				task.inputParticles = (DynamicParticle*)task.inputParticlesLockGuard.GetResource();
+			Vec3f position = Vec3f(task.inputParticleStreams.positionX[i], task.inputParticleStreams.positionY[i], task.inputParticleStreams.positionZ[i]);
 
-				task.dynamicParticlesBufferManager.Advance();
+			referencePositions[i] = position.x;
+			referencePositions[particleCount + i] = position.y;
+			referencePositions[particleCount * 2 + i] = position.z;
 
-				task.outputParticlesLockGuard = task.dynamicParticlesBufferManager.LockWrite(nullptr);
-				task.outputParticles = (DynamicParticle*)task.outputParticlesLockGuard.GetResource();
-			}
+			//The skin distance is at most the interaction distance, so the list distance is at most twice of it
+			uint32 buckets[Details::MaxCellsPerAxisInDistance * Details::MaxCellsPerAxisInDistance * Details::MaxCellsPerAxisInDistance];
+			uint32 bucketCount = Details::GetUniqueCellBucketsInDistance(position.x, position.y, position.z, listDistance, task.dynamicParticlesHashMap.Count() - 1, &parameters, buckets);
 
-			uintMem dynamicParticleCount = task.dynamicParticlesBufferManager.GetParticleCount();
-			uintMem staticParticleCount = task.staticParticlesBufferManager.GetParticleCount();
-			uintMem begin = dynamicParticleCount * context.GetThreadIndex() / context.GetThreadCount();
-			uintMem end = dynamicParticleCount * (context.GetThreadIndex() + 1) / context.GetThreadCount();
-			uintMem hashBegin = (task.dynamicParticlesHashMap.Count() - 1) * context.GetThreadIndex() / context.GetThreadCount();
-			uintMem hashEnd = (task.dynamicParticlesHashMap.Count() - 1) * (context.GetThreadIndex() + 1) / context.GetThreadCount();
+			task.verletListRanges[i * 3] = size;
 
-			context.SyncThreads();
+			for (uint32 j = 0; j < bucketCount; ++j)
+				for (uint32 k = task.dynamicParticlesHashMap[buckets[j]]; k < task.dynamicParticlesHashMap[buckets[j] + 1]; ++k)
+				{
+					uint32 index = task.particleMap[k];
 
-			for (uintMem i = begin; i < end; ++i)
+					if (index == i)
+						continue;
+
+					Vec3f dir = Vec3f(task.inputParticleStreams.positionX[index], task.inputParticleStreams.positionY[index], task.inputParticleStreams.positionZ[index]) - position;
+					if (dir.DotProduct(dir) <= listDistanceSqr)
+						addNeighbour(index);
+				}
+
+			task.verletListRanges[i * 3 + 1] = size;
+
+			if (staticParticleCount != 0)
 			{
-				Details::UpdateParticlePressure(
-					i,
-					dynamicParticleCount,
-					task.dynamicParticlesHashMap.Count() - 1,
-					staticParticleCount,
-					task.staticParticlesHashMap.Count() - 1,
-					task.inputParticles,
-					task.outputParticles,
-					task.dynamicParticlesHashMap.Ptr(),
-					task.particleMap,
-					task.staticParticles,
-					task.staticParticlesHashMap.Ptr(),
-					&task.particleBehaviourParameters
-				);
+				bucketCount = Details::GetUniqueCellBucketsInDistance(position.x, position.y, position.z, listDistance, task.staticParticlesHashMap.Count() - 1, &parameters, buckets);
+
+				for (uint32 j = 0; j < bucketCount; ++j)
+					for (uint32 k = task.staticParticlesHashMap[buckets[j]]; k < task.staticParticlesHashMap[buckets[j] + 1]; ++k)
+					{
+						Vec3f dir = task.staticParticles[k].position - position;
+						if (dir.DotProduct(dir) <= listDistanceSqr)
+							addNeighbour(k);
+					}
 			}
 
-			context.SyncThreads();
+			task.verletListRanges[i * 3 + 2] = size;
+		}
+	}
+	static void UpdateVerletListStatistics(SimulateParticlesTimeStepTask& task)
+	{
+		VerletListStatistics& statistics = task.verletListStatistics;
+		uintMem particleCount = task.dynamicParticlesBufferManager.GetParticleCount();
 
-			for (uintMem i = begin; i < end; ++i)
-				Details::UpdateParticleDynamics(
-					i,
-					dynamicParticleCount,
-					task.dynamicParticlesHashMap.Count() - 1,
-					staticParticleCount,
-					task.staticParticlesHashMap.Count() - 1,
-					task.inputParticles,
-					task.outputParticles,
-					task.dynamicParticlesHashMap.Ptr(),
-					task.particleMap,
-					task.staticParticles,
-					task.staticParticlesHashMap.Ptr(),
-					task.dt,
-					&task.particleBehaviourParameters,
-					task.triangles.Count(),
-					(Triangle*)task.triangles.Ptr()
-				);
+		statistics.dynamicNeighbourCount = 0;
+		statistics.staticNeighbourCount = 0;
+		for (uintMem i = 0; i < particleCount; ++i)
+		{
+			statistics.dynamicNeighbourCount += task.verletListRanges[i * 3 + 1] - task.verletListRanges[i * 3];
+			statistics.staticNeighbourCount += task.verletListRanges[i * 3 + 2] - task.verletListRanges[i * 3 + 1];
+		}
 
-			context.SyncThreads();
+		statistics.memoryBytes = task.verletListRanges.Count() * sizeof(uint32) + task.verletListReferencePositions.Count() * sizeof(float);
+		for (auto& storage : task.verletListStorage)
+			statistics.memoryBytes += storage.Count() * sizeof(uint32);
+	}
+	static Details::CellNeighbourCandidates GetCellNeighbourCandidates(Array<float>& streams, Array<uint32>& indices)
+	{
+		uintMem capacity = indices.Count();
+		float* stream = streams.Ptr();
+
+		return {
+			.dynamicIndices = indices.Ptr(),
+			.dynamicPositionX = stream,
+			.dynamicPositionY = stream + capacity,
+			.dynamicPositionZ = stream + capacity * 2,
+			.dynamicPressure = stream + capacity * 3,
+			.dynamicVelocityX = stream + capacity * 4,
+			.dynamicVelocityY = stream + capacity * 5,
+			.dynamicVelocityZ = stream + capacity * 6,
+			.staticPositionX = stream + capacity * 7,
+			.staticPositionY = stream + capacity * 8,
+			.staticPositionZ = stream + capacity * 9,
+			.dynamicCount = 0,
+			.staticCount = 0,
+			.capacity = capacity
+		};
+	}
+	//Grows the candidate streams of the thread to fit the counts a cell blocked function asked for
+	static void GrowCellNeighbourCandidates(const ThreadContext& context, Details::CellNeighbourCandidates& candidates, SimulateParticlesTimeStepTask& task)
+	{
+		Array<float>& streams = task.cellNeighbourCandidateStreams[context.GetThreadIndex()];
+		Array<uint32>& indices = task.cellNeighbourCandidateIndices[context.GetThreadIndex()];
+
+		indices.Resize(std::max<uintMem>({ indices.Count() * 2, candidates.dynamicCount, candidates.staticCount, 1024 }));
+		streams.Resize(indices.Count() * Details::CellNeighbourCandidates::FloatStreamCount);
+
+		candidates = GetCellNeighbourCandidates(streams, indices);
+	}
+	//The cell blocked traversal evaluates the nonempty buckets that begin in the range of the particle map of the
+	//thread, so that every thread gets about the same number of particles
+	static void GetCellBlockedBucketRange(const PageArray<std::atomic_uint32_t>& hashMap, uintMem begin, uintMem end, uintMem& bucketBegin, uintMem& bucketEnd)
+	{
+		const std::atomic_uint32_t* first = hashMap.Ptr();
+		const std::atomic_uint32_t* last = hashMap.Ptr() + hashMap.Count() - 1;
+		auto less = [](const std::atomic_uint32_t& bucketBegin, uintMem index) { return bucketBegin.load(std::memory_order_relaxed) < index; };
+
+		bucketBegin = std::lower_bound(first, last, begin, less) - first;
+		bucketEnd = std::lower_bound(first + bucketBegin, last, end, less) - first;
+	}
+	static void GrowPairContributions(const ThreadContext& context, Details::PairInteractionSums& sums, SimulateParticlesTimeStepTask& task)
+	{
+		Array<uint32>& indices = task.pairContributionIndices[context.GetThreadIndex()];
+		Array<float>& values = task.pairContributionValues[context.GetThreadIndex()];
 
-			for (uintMem i = hashBegin; i < hashEnd; ++i)
-				task.dynamicParticlesHashMap[i].store(0);
+		indices.Resize(std::max<uintMem>(indices.Count() * 2, 1024));
+		values.Resize(indices.Count() * 6);
 
-			if (task.hashMapGroupSums != nullptr)
-				task.hashMapGroupSums[context.GetThreadIndex()] = 0;
+		sums.contributionIndices = indices.Ptr();
+		sums.contributionValues = values.Ptr();
+		sums.contributionCapacity = indices.Count();
+	}
+	//Groups the contributions the thread appended during the half neighbourhood traversal by the thread whose range of
+	//the particle map they belong to. The ranges are split the same way as in SimulateParticlesTimeStep
+	static void GroupPairContributions(const ThreadContext& context, const Details::PairInteractionSums& sums, uint32 valueCount, uintMem particleCount, SimulateParticlesTimeStepTask& task)
+	{
+		uintMem threadCount = context.GetThreadCount();
+		uintMem* offsets = task.pairContributionOffsets.Ptr() + context.GetThreadIndex() * (threadCount + 1);
+		Array<uint32>& groupedIndices = task.groupedPairContributionIndices[context.GetThreadIndex()];
+		Array<float>& groupedValues = task.groupedPairContributionValues[context.GetThreadIndex()];
 
-			context.SyncThreads();
+		if (groupedIndices.Count() < sums.contributionCount)
+		{
+			groupedIndices.Resize(sums.contributionCapacity);
+			groupedValues.Resize(sums.contributionCapacity * 6);
+		}
+
+		//The inverse of the split into ranges, particleCount * threadIndex / threadCount is the beginning of a range
+		auto getThreadIndex = [&](uint32 sortedIndex) { return (((uintMem)sortedIndex + 1) * threadCount - 1) / particleCount; };
+
+		std::fill_n(offsets, threadCount + 1, 0);
+		for (uintMem i = 0; i < sums.contributionCount; ++i)
+			++offsets[getThreadIndex(sums.contributionIndices[i]) + 1];
+
+		for (uintMem i = 0; i < threadCount; ++i)
+			offsets[i + 1] += offsets[i];
+
+		for (uintMem i = 0; i < sums.contributionCount; ++i)
+		{
+			uintMem groupedIndex = offsets[getThreadIndex(sums.contributionIndices[i])]++;
+			groupedIndices[groupedIndex] = sums.contributionIndices[i];
+			std::copy_n(sums.contributionValues + i * valueCount, valueCount, groupedValues.Ptr() + groupedIndex * valueCount);
+		}
 
+		//Every offset was moved to the beginning of the next group by the scatter
+		for (uintMem i = threadCount - 1; i != 0; --i)
+			offsets[i] = offsets[i - 1];
+		offsets[0] = 0;
+	}
+	//Adds the contributions of the threads before this one to the sums of the particles in the range of this thread.
+	//'sums' has 'valueCount' values for every particle
+	static void AddPairContributions(const ThreadContext& context, float* sums, uint32 valueCount, SimulateParticlesTimeStepTask& task)
+	{
+		uintMem threadCount = context.GetThreadCount();
+		uintMem threadIndex = context.GetThreadIndex();
+
+		for (uintMem i = 0; i < threadIndex; ++i)
+		{
+			const uintMem* offsets = task.pairContributionOffsets.Ptr() + i * (threadCount + 1);
+			const uint32* indices = task.groupedPairContributionIndices[i].Ptr();
+			const float* values = task.groupedPairContributionValues[i].Ptr();
+
+			for (uintMem j = offsets[threadIndex]; j < offsets[threadIndex + 1]; ++j)
+				for (uint32 k = 0; k < valueCount; ++k)
+					sums[indices[j] * valueCount + k] += values[j * valueCount + k];
+		}
+	}
+	//Rebuilds the hash map and the particle map of the output particles of a step, reordering them if requested
+	static void RebuildDynamicParticlesHashMap(const ThreadContext& context, SimulateParticlesTimeStepTask& task, PhaseTimer& timer, uintMem begin, uintMem end, uintMem hashBegin, uintMem hashEnd)
+	{
+		bool structOfArrays = task.dynamicParticlesBufferManager.GetLayout() == ParticleBufferLayout::StructOfArrays;
+		uintMem dynamicParticleCount = task.dynamicParticlesBufferManager.GetParticleCount();
+
+		timer.Begin(SimulationPhase::ClearHashMap);
+
+		for (uintMem i = hashBegin; i < hashEnd; ++i)
+			task.dynamicParticlesHashMap[i].store(0);
+
+		timer.SyncThreads(context);
+		timer.Begin(SimulationPhase::CountHashes);
+
+		if (structOfArrays)
+			for (uintMem i = begin; i < end; ++i)
+				++task.dynamicParticlesHashMap[task.outputParticleStreams.hash[i]];
+		else
 			for (uintMem i = begin; i < end; ++i)
 				++task.dynamicParticlesHashMap[task.outputParticles[i].hash];
 
-			context.SyncThreads();
+		timer.SyncThreads(context);
+		timer.Begin(SimulationPhase::PrefixSum);
+
+		if (context.GetThreadIndex() == 0 && task.prefixSumBlockSums == nullptr)
+		{
+			uint32 valueSum = 0;
+			for (uintMem i = 0; i < task.dynamicParticlesHashMap.Count() - 1; ++i)
+			{
+				valueSum += task.dynamicParticlesHashMap[i];
+				task.dynamicParticlesHashMap[i] = valueSum;
+			}
+		}
+
+		if (task.prefixSumBlockSums != nullptr)
+			ParallelInclusiveScan(context, task.dynamicParticlesHashMap.Ptr(), task.dynamicParticlesHashMap.Count() - 1, task.prefixSumBlockSums, [&]() { timer.SyncThreads(context); });
+
+		if (context.GetThreadIndex() == 0)
+		{
+			if (task.reorderParticles)
+			{
+				task.dynamicParticlesBufferManager.Advance();
+				task.orderedParticlesLockGuard = task.dynamicParticlesBufferManager.LockWrite(nullptr);
+				GetDynamicParticles(task.orderedParticlesLockGuard, task.dynamicParticlesBufferManager, task.orderedParticles, task.orderedParticleStreams);
+			}
+		}
+
+		timer.SyncThreads(context);
+		timer.Begin(SimulationPhase::ParticleMap);
+
+		if (task.reorderParticles)
+		{
+			for (uintMem i = begin; i < end; ++i)
+			{
+				if (structOfArrays)
+					Details::ReorderDynamicParticlesAndFinishHashMap(
+						i,
+						task.particleMap,
+						task.dynamicParticlesHashMap.Ptr(),
+						task.outputParticleStreams,
+						task.orderedParticleStreams,
+						dynamicParticleCount
+					);
+				else
+					Details::ReorderDynamicParticlesAndFinishHashMap(
+						i,
+						task.particleMap,
+						task.dynamicParticlesHashMap.Ptr(),
+						task.outputParticles,
+						task.orderedParticles,
+						dynamicParticleCount
+					);
+			}
+		}
+		else
+		{
+			for (uintMem i = begin; i < end; ++i)
+			{
+				if (structOfArrays)
+					Details::FillDynamicParticleMapAndFinishHashMap(
+						i,
+						task.particleMap,
+						task.dynamicParticlesHashMap.Ptr(),
+						task.outputParticleStreams.hash,
+						dynamicParticleCount
+					);
+				else
+					Details::FillDynamicParticleMapAndFinishHashMap(
+						i,
+						task.particleMap,
+						task.dynamicParticlesHashMap.Ptr(),
+						task.outputParticles,
+						dynamicParticleCount
+					);
+			}
+		}
+
+		timer.SyncThreads(context);
+	}
+	/*
+		Version of RebuildDynamicParticlesHashMap for the private hash histograms. The histograms already have the
+		counts of the particles of each thread, unless 'countHashes' is set. Every thread merges the histograms of its
+		block of the hash map and then places its particles at the offsets it got from the merge, so the particles of a
+		bucket are in the order of their indices and no atomics are needed.
+	*/
+	static void RebuildDynamicParticlesHashMapFromHistograms(const ThreadContext& context, SimulateParticlesTimeStepTask& task, PhaseTimer& timer, uintMem begin, uintMem end, uint32 epoch, bool countHashes)
+	{
+		bool structOfArrays = task.dynamicParticlesBufferManager.GetLayout() == ParticleBufferLayout::StructOfArrays;
+		uintMem threadCount = context.GetThreadCount();
+		uint32* histogram = task.hashHistograms[context.GetThreadIndex()].Ptr();
+
+		auto getHash = [&](uintMem index) {
+			return structOfArrays ? task.outputParticleStreams.hash[index] : task.outputParticles[index].hash;
+			};
+
+		timer.Begin(SimulationPhase::CountHashes);
+
+		if (countHashes)
+		{
+			for (uintMem i = begin; i < end; ++i)
+				CountParticleHash(histogram, getHash(i), epoch);
+
+			timer.SyncThreads(context);
+		}
+
+		//The count of bucket i is stored at i + 1, so that the inclusive scan gives the beginning of every bucket and
+		//the last value is the particle count. The blocks are the same as the ones of ParallelInclusiveScan, so the
+		//threads don't have to synchronize before it
+		uintMem valueCount = task.dynamicParticlesHashMap.Count();
+		uintMem valueBegin = valueCount * context.GetThreadIndex() / threadCount;
+		uintMem valueEnd = valueCount * (context.GetThreadIndex() + 1) / threadCount;
+
+		if (valueBegin == 0 && valueEnd != 0)
+		{
+			task.dynamicParticlesHashMap[0].store(0, std::memory_order_relaxed);
+			valueBegin = 1;
+		}
+
+		for (uintMem i = valueBegin; i < valueEnd; ++i)
+		{
+			uint32 bucketCount = 0;
+			for (uintMem j = 0; j < threadCount; ++j)
+			{
+				uint32& entry = task.hashHistograms[j][i - 1];
+
+				if ((entry >> HashHistogramCountBits) == epoch)
+				{
+					uint32 threadBucketCount = entry & HashHistogramCountMask;
+					entry = (epoch << HashHistogramCountBits) | bucketCount;
+					bucketCount += threadBucketCount;
+				}
+			}
+
+			task.dynamicParticlesHashMap[i].store(bucketCount, std::memory_order_relaxed);
+		}
+
+		timer.Begin(SimulationPhase::PrefixSum);
+
+		if (task.prefixSumBlockSums != nullptr)
+			ParallelInclusiveScan(context, task.dynamicParticlesHashMap.Ptr(), valueCount, task.prefixSumBlockSums, [&]() { timer.SyncThreads(context); });
+		else
+		{
+			timer.SyncThreads(context);
+
+			if (context.GetThreadIndex() == 0)
+			{
+				uint32 valueSum = 0;
+				for (uintMem i = 0; i < valueCount; ++i)
+				{
+					valueSum += task.dynamicParticlesHashMap[i];
+					task.dynamicParticlesHashMap[i] = valueSum;
+				}
+			}
+		}
+
+		if (context.GetThreadIndex() == 0)
+		{
+			if (task.reorderParticles)
+			{
+				task.dynamicParticlesBufferManager.Advance();
+				task.orderedParticlesLockGuard = task.dynamicParticlesBufferManager.LockWrite(nullptr);
+				GetDynamicParticles(task.orderedParticlesLockGuard, task.dynamicParticlesBufferManager, task.orderedParticles, task.orderedParticleStreams);
+			}
+		}
+
+		timer.SyncThreads(context);
+		timer.Begin(SimulationPhase::ParticleMap);
+
+		for (uintMem i = begin; i < end; ++i)
+		{
+			uint32 hash = getHash(i);
+			uintMem index = task.dynamicParticlesHashMap[hash].load(std::memory_order_relaxed) + (histogram[hash] & HashHistogramCountMask);
+			++histogram[hash];
+
+			if (!task.reorderParticles)
+				task.particleMap[index] = (uint32)i;
+			else if (structOfArrays)
+			{
+				task.particleMap[i] = (uint32)i;
+				task.orderedParticleStreams.positionX[index] = task.outputParticleStreams.positionX[i];
+				task.orderedParticleStreams.positionY[index] = task.outputParticleStreams.positionY[i];
+				task.orderedParticleStreams.positionZ[index] = task.outputParticleStreams.positionZ[i];
+				task.orderedParticleStreams.pressure[index] = task.outputParticleStreams.pressure[i];
+				task.orderedParticleStreams.velocityX[index] = task.outputParticleStreams.velocityX[i];
+				task.orderedParticleStreams.velocityY[index] = task.outputParticleStreams.velocityY[i];
+				task.orderedParticleStreams.velocityZ[index] = task.outputParticleStreams.velocityZ[i];
+				task.orderedParticleStreams.hash[index] = hash;
+			}
+			else
+			{
+				task.particleMap[i] = (uint32)i;
+				task.orderedParticles[index] = task.outputParticles[i];
+			}
+		}
+
+		timer.SyncThreads(context);
+	}
+	/*
+		Sorts the output particles of a step by their buckets into the ordered buffer, when the engine sorts them every
+		step. The buckets of the particles of the last step are in the half of 'particleSortBuckets' of the step index
+		and the sorted ones are stored into the other half. With the incremental sorting the particles whose bucket
+		changed are counted first. If there are few enough of them only they are sorted, and each thread merges the
+		particles that didn't move from its block with the sorted moved ones that go before the first unmoved particle
+		of the next thread. Both ways the particles are ordered by their bucket and then by their index in the last
+		step, so they give the same order.
+	*/
+	static void SortDynamicParticles(const ThreadContext& context, SimulateParticlesTimeStepTask& task, PhaseTimer& timer, uintMem begin, uintMem end, uint64 stepIndex)
+	{
+		constexpr uint32 NoParticle = UINT32_MAX;
+
+		bool structOfArrays = task.dynamicParticlesBufferManager.GetLayout() == ParticleBufferLayout::StructOfArrays;
+		uintMem dynamicParticleCount = task.dynamicParticlesBufferManager.GetParticleCount();
+		uintMem threadIndex = context.GetThreadIndex();
+		uintMem threadCount = context.GetThreadCount();
+		const uint32* previousBuckets = task.particleSortBuckets + stepIndex % 2 * dynamicParticleCount;
+		uint32* sortedBuckets = task.particleSortBuckets + (stepIndex + 1) % 2 * dynamicParticleCount;
+
+		auto getHash = [&](uintMem index) {
+			return structOfArrays ? task.outputParticleStreams.hash[index] : task.outputParticles[index].hash;
+			};
+
+		timer.Begin(SimulationPhase::SortParticles);
+
+		bool incremental = task.particleSortMovedKeys != nullptr;
+		uintMem movedOffset = 0;
+		uintMem movedCount = 0;
+
+		if (incremental)
+		{
+			uint32 threadMovedCount = 0;
+			for (uintMem i = begin; i < end; ++i)
+				threadMovedCount += getHash(i) != previousBuckets[i];
+			task.particleSortMovedCounts[threadIndex] = threadMovedCount;
+
+			timer.SyncThreads(context);
+
+			for (uintMem i = 0; i < threadCount; ++i)
+			{
+				if (i == threadIndex)
+					movedOffset = movedCount;
+
+				movedCount += task.particleSortMovedCounts[i];
+			}
+
+			incremental = movedCount <= task.particleSortMovedCapacity;
+
+			if (threadIndex == 0)
+			{
+				++task.particleSortStatistics.stepCount;
+				task.particleSortStatistics.movedParticleCount += movedCount;
+				task.particleSortStatistics.maxMovedParticleCount = std::max<uint64>(task.particleSortStatistics.maxMovedParticleCount, movedCount);
+				if (incremental)
+					++task.particleSortStatistics.incrementalStepCount;
+			}
+		}
+
+		uintMem sortedOffset = 0;
+
+		if (incremental)
+		{
+			uint32 firstUnmoved = NoParticle;
+			for (uintMem i = begin; i < end; ++i)
+			{
+				uint32 hash = getHash(i);
+
+				if (hash != previousBuckets[i])
+				{
+					task.particleSortMovedKeys[movedOffset] = hash;
+					task.particleSortMovedIndices[movedOffset] = (uint32)i;
+					++movedOffset;
+				}
+				else if (firstUnmoved == NoParticle)
+					firstUnmoved = (uint32)i;
+			}
+			task.particleSortFirstUnmoved[threadIndex] = firstUnmoved;
+		}
+		else
+			for (uintMem i = begin; i < end; ++i)
+				task.particleSortKeys[i] = getHash(i);
+
+		if (threadIndex == 0)
+		{
+			task.dynamicParticlesBufferManager.Advance();
+			task.orderedParticlesLockGuard = task.dynamicParticlesBufferManager.LockWrite(nullptr);
+			GetDynamicParticles(task.orderedParticlesLockGuard, task.dynamicParticlesBufferManager, task.orderedParticles, task.orderedParticleStreams);
+		}
+
+		//The blocks of the moved particles aren't the ones of the threads that wrote them
+		timer.SyncThreads(context);
+
+		if (!incremental)
+		{
+			sortedOffset = SortParticleBuckets(context, task.particleSortKeys, task.particleSortIndices, task.particleSortDigitCounts, dynamicParticleCount, task.dynamicParticlesHashMap.Count() - 1, [&]() { timer.SyncThreads(context); });
+
+			timer.Begin(SimulationPhase::ParticleMap);
+
+			FinishSortedDynamicParticles(
+				begin, end,
+				task.particleSortKeys + sortedOffset,
+				task.particleSortIndices + sortedOffset,
+				sortedBuckets,
+				task.dynamicParticlesHashMap,
+				task.outputParticles,
+				task.outputParticleStreams,
+				task.orderedParticles,
+				task.orderedParticleStreams,
+				dynamicParticleCount,
+				structOfArrays
+			);
+
+			timer.SyncThreads(context);
+			return;
+		}
+
+		uint32 keyBits = (uint32)std::bit_width(task.dynamicParticlesHashMap.Count() - 2);
+		if (ParallelRadixSort(context, task.particleSortMovedKeys, task.particleSortMovedIndices, task.particleSortMovedKeys + task.particleSortMovedCapacity, task.particleSortMovedIndices + task.particleSortMovedCapacity, movedCount, keyBits, task.particleSortDigitCounts, [&]() { timer.SyncThreads(context); }))
+			sortedOffset = task.particleSortMovedCapacity;
+
+		timer.Begin(SimulationPhase::ParticleMap);
+
+		const uint32* movedKeys = task.particleSortMovedKeys + sortedOffset;
+		const uint32* movedIndices = task.particleSortMovedIndices + sortedOffset;
+
+		//The unmoved particles keep their bucket, so they are still sorted by it and by their index
+		auto movedParticleBefore = [&](uintMem movedIndex, uint32 bucket, uint32 index) {
+			return movedKeys[movedIndex] < bucket || (movedKeys[movedIndex] == bucket && movedIndices[movedIndex] < index);
+			};
+		auto lowerBoundMovedParticles = [&](uint32 index) {
+			uintMem low = 0;
+			uintMem high = movedCount;
+			while (low < high)
+			{
+				uintMem middle = (low + high) / 2;
+				if (movedParticleBefore(middle, previousBuckets[index], index))
+					low = middle + 1;
+				else
+					high = middle;
+			}
+			return low;
+			};
+
+		//Thread 0 also places the moved particles before its first unmoved one, the threads without unmoved particles
+		//place nothing
+		uint32 firstUnmoved = task.particleSortFirstUnmoved[threadIndex];
+		if (threadIndex == 0 || firstUnmoved != NoParticle)
+		{
+			uint32 nextFirstUnmoved = NoParticle;
+			for (uintMem i = threadIndex + 1; i < threadCount && nextFirstUnmoved == NoParticle; ++i)
+				nextFirstUnmoved = task.particleSortFirstUnmoved[i];
+
+			uintMem movedBegin = threadIndex == 0 ? 0 : lowerBoundMovedParticles(firstUnmoved);
+			uintMem movedEnd = nextFirstUnmoved == NoParticle ? movedCount : lowerBoundMovedParticles(nextFirstUnmoved);
+
+			//The particles before this one are the unmoved particles of the blocks before and the moved ones before
+			//'movedBegin'
+			uintMem newIndex = movedBegin;
+			for (uintMem i = 0; i < threadIndex; ++i)
+			{
+				uintMem threadBegin = dynamicParticleCount * i / threadCount;
+				uintMem threadEnd = dynamicParticleCount * (i + 1) / threadCount;
+				newIndex += threadEnd - threadBegin - task.particleSortMovedCounts[i];
+			}
+
+			uintMem movedIndex = movedBegin;
+			uintMem i = begin;
+			while (true)
+			{
+				while (i < end && getHash(i) != previousBuckets[i])
+					++i;
+
+				if (movedIndex < movedEnd && (i == end || movedParticleBefore(movedIndex, previousBuckets[i], (uint32)i)))
+				{
+					CopyDynamicParticle(movedIndices[movedIndex], newIndex, movedKeys[movedIndex], task.outputParticles, task.outputParticleStreams, task.orderedParticles, task.orderedParticleStreams, structOfArrays);
+					sortedBuckets[newIndex++] = movedKeys[movedIndex++];
+				}
+				else if (i < end)
+				{
+					CopyDynamicParticle(i, newIndex, previousBuckets[i], task.outputParticles, task.outputParticleStreams, task.orderedParticles, task.orderedParticleStreams, structOfArrays);
+					sortedBuckets[newIndex++] = previousBuckets[i++];
+				}
+				else
+					break;
+			}
+		}
+
+		timer.SyncThreads(context);
+
+		FillSortedDynamicParticlesHashMap(begin, end, sortedBuckets, task.dynamicParticlesHashMap, dynamicParticleCount);
+
+		timer.SyncThreads(context);
+	}
+	//Called by thread 0 at the beginning of a step
+	static bool ShouldReorderParticles(SimulateParticlesTimeStepTask& task)
+	{
+		if (task.particleSortKeys != nullptr)
+			return true;
+
+		if (task.reorderScatterCounts != nullptr)
+			return task.reorderAccumulatedScatter >= task.adaptiveReorderCost;
+
+		bool reorder = task.reorderElapsedTime > task.reorderTimeInterval;
+		if (reorder)
+			task.reorderElapsedTime -= task.reorderTimeInterval;
+
+		task.reorderElapsedTime += task.dt;
+		return reorder;
+	}
+	//Called by thread 0 at the end of a step. The particle map is the identity after a reordering. The steps that
+	//didn't rebuild the particle map are given the fraction of the last measured one
+	static void AccumulateReorderScatter(SimulateParticlesTimeStepTask& task, uintMem threadCount, bool measured)
+	{
+		ReorderStatistics& statistics = task.reorderStatistics;
+		++statistics.stepCount;
+
+		if (task.reorderParticles)
+		{
+			++statistics.reorderCount;
+			statistics.lastScatteredFraction = 0;
+			task.reorderAccumulatedScatter = 0;
+			return;
+		}
+
+		if (task.reorderScatterCounts == nullptr)
+			return;
+
+		if (measured)
+		{
+			uint64 scatteredCount = 0;
+			for (uintMem i = 0; i < threadCount; ++i)
+				scatteredCount += task.reorderScatterCounts[i];
+
+			statistics.lastScatteredFraction = (double)scatteredCount / (double)task.dynamicParticlesBufferManager.GetParticleCount();
+			statistics.maxScatteredFraction = std::max(statistics.maxScatteredFraction, statistics.lastScatteredFraction);
+			++statistics.measuredStepCount;
+		}
+
+		task.reorderAccumulatedScatter += statistics.lastScatteredFraction;
+	}
+	static void SimulateParticlesTimeStep(const ThreadContext& context, SimulateParticlesTimeStepTask& task)
+	{
+		PhaseTimer timer{ task.phaseRecorder, context };
+
+		if (context.GetThreadIndex() == 0)
+		{
+			task.staticParticlesLockGuard = task.staticParticlesBufferManager.LockRead(nullptr);
+			task.staticParticles = (StaticParticle*)task.staticParticlesLockGuard.GetResource();
+		}
+
+		for (uint i = 0; i < task.simulationSteps; ++i)
+		{
+			timer.BeginStep();
+
+			if (context.GetThreadIndex() == 0)
+			{
+				task.inputParticlesLockGuard = task.dynamicParticlesBufferManager.LockRead(nullptr);
+				GetDynamicParticles(task.inputParticlesLockGuard, task.dynamicParticlesBufferManager, task.inputParticles, task.inputParticleStreams);
+
+				task.dynamicParticlesBufferManager.Advance();
+
+				task.outputParticlesLockGuard = task.dynamicParticlesBufferManager.LockWrite(nullptr);
+				GetDynamicParticles(task.outputParticlesLockGuard, task.dynamicParticlesBufferManager, task.outputParticles, task.outputParticleStreams);
+			}
+
+			bool structOfArrays = task.dynamicParticlesBufferManager.GetLayout() == ParticleBufferLayout::StructOfArrays;
+
+			uintMem dynamicParticleCount = task.dynamicParticlesBufferManager.GetParticleCount();
+			uintMem staticParticleCount = task.staticParticlesBufferManager.GetParticleCount();
+			uintMem begin = dynamicParticleCount * context.GetThreadIndex() / context.GetThreadCount();
+			uintMem end = dynamicParticleCount * (context.GetThreadIndex() + 1) / context.GetThreadCount();
+			uintMem hashBegin = (task.dynamicParticlesHashMap.Count() - 1) * context.GetThreadIndex() / context.GetThreadCount();
+			uintMem hashEnd = (task.dynamicParticlesHashMap.Count() - 1) * (context.GetThreadIndex() + 1) / context.GetThreadCount();
+
+			//The hashes of the particles this thread updates are counted in the dynamics pass
+			uint32 hashHistogramEpoch = GetHashHistogramEpoch(task.firstStepIndex + i);
+			uint32* hashHistogram = nullptr;
+			if (!task.hashHistograms.Empty())
+			{
+				hashHistogram = task.hashHistograms[context.GetThreadIndex()].Ptr();
+
+				if (hashHistogramEpoch == 1)
+					std::fill_n(hashHistogram, task.hashHistograms[context.GetThreadIndex()].Count(), 0);
+			}
+
+			timer.SyncThreads(context);
+
+			//Nothing reads the decision before the end of the dynamics pass, which the threads synchronize after. The
+			//counts of the last step were summed at its end
+			if (context.GetThreadIndex() == 0)
+				task.reorderParticles = ShouldReorderParticles(task);
+
+			Details::PairInteractionSums pairInteractionSums{ };
+			if (task.pairInteractionSums != nullptr)
+				pairInteractionSums = {
+					.influence = task.pairInteractionSums,
+					.forces = task.pairInteractionSums + dynamicParticleCount,
+					.rangeEnd = end,
+					.contributionIndices = task.pairContributionIndices[context.GetThreadIndex()].Ptr(),
+					.contributionValues = task.pairContributionValues[context.GetThreadIndex()].Ptr(),
+					.contributionCount = 0,
+					.contributionCapacity = task.pairContributionIndices[context.GetThreadIndex()].Count()
+				};
+
+			bool verletLists = structOfArrays && !task.verletListStorage.Empty();
+
+			//The particles of a cell are evaluated by the thread whose range of the particle map has the beginning of
+			//their bucket, so the hashes of the particles of each thread are counted when the hash map is rebuilt
+			bool cellBlocked = structOfArrays && !task.cellNeighbourCandidateIndices.Empty();
+			Details::CellNeighbourCandidates cellNeighbourCandidates{ };
+			uintMem bucketBegin = 0;
+			uintMem bucketEnd = 0;
+			if (cellBlocked)
+			{
+				cellNeighbourCandidates = GetCellNeighbourCandidates(task.cellNeighbourCandidateStreams[context.GetThreadIndex()], task.cellNeighbourCandidateIndices[context.GetThreadIndex()]);
+
+				if (task.dynamicSchedulingChunkSize == 0)
+					GetCellBlockedBucketRange(task.dynamicParticlesHashMap, begin, end, bucketBegin, bucketEnd);
+			}
+			bool rebuildVerletLists = false;
+			Array<uint32>* verletListStorage = nullptr;
+
+			//With the dynamic scheduling every thread updates other particles than the ones of its range, so their hashes
+			//are counted when the hash map is rebuilt
+			bool dynamicScheduling = task.dynamicSchedulingChunkSize != 0;
+			uint32* dynamicsHashHistogram = dynamicScheduling ? nullptr : hashHistogram;
+
+			auto forEachParticle = [&](const auto& function) {
+				if (dynamicScheduling)
+					context.ParallelFor(0, dynamicParticleCount, task.dynamicSchedulingChunkSize, [&](uintMem chunkBegin, uintMem chunkEnd) {
+						for (uintMem i = chunkBegin; i < chunkEnd; ++i)
+							function(i);
+						});
+				else
+					for (uintMem i = begin; i < end; ++i)
+						function(i);
+				};
+			auto forEachCellBlockedBucket = [&](const auto& function) {
+				if (dynamicScheduling)
+					context.ParallelFor(0, dynamicParticleCount, task.dynamicSchedulingChunkSize, [&](uintMem chunkBegin, uintMem chunkEnd) {
+						uintMem chunkBucketBegin = 0;
+						uintMem chunkBucketEnd = 0;
+						GetCellBlockedBucketRange(task.dynamicParticlesHashMap, chunkBegin, chunkEnd, chunkBucketBegin, chunkBucketEnd);
+
+						for (uintMem bucket = chunkBucketBegin; bucket < chunkBucketEnd; ++bucket)
+							function(bucket);
+						});
+				else
+					for (uintMem bucket = bucketBegin; bucket < bucketEnd; ++bucket)
+						function(bucket);
+				};
+
+			if (verletLists)
+			{
+				timer.Begin(SimulationPhase::NeighbourLists);
+
+				verletListStorage = &task.verletListStorage[context.GetThreadIndex()];
+
+				//The lists were checked at the end of the last step. They are built and used by the same thread, so no
+				//synchronization is needed after this
+				rebuildVerletLists = !task.verletListsValid || task.verletListRebuildRequested;
+				if (rebuildVerletLists)
+					BuildVerletLists(begin, end, *verletListStorage, task);
+			}
+
+			timer.Begin(SimulationPhase::Pressure);
+
+			if (verletLists)
+			{
+				for (uintMem i = begin; i < end; ++i)
+					Details::UpdateParticlePressureFromList(
+						i,
+						task.inputParticleStreams,
+						task.outputParticleStreams.pressure,
+						task.staticParticles,
+						&task.particleBehaviourParameters,
+						verletListStorage->Ptr() + task.verletListRanges[i * 3],
+						task.verletListRanges[i * 3 + 1] - task.verletListRanges[i * 3],
+						verletListStorage->Ptr() + task.verletListRanges[i * 3 + 1],
+						task.verletListRanges[i * 3 + 2] - task.verletListRanges[i * 3 + 1]
+					);
+			}
+			else if (structOfArrays && task.pairInteractionSums != nullptr)
+			{
+				//Only this thread writes to the sums of its range, the other threads append their contributions
+				std::fill_n(pairInteractionSums.influence + begin, end - begin, 0.0f);
+
+				for (uintMem i = begin; i < end; ++i)
+					while (!Details::AccumulateParticlePressurePairs(
+						i,
+						task.dynamicParticlesHashMap.Count() - 1,
+						task.inputParticleStreams,
+						task.dynamicParticlesHashMap.Ptr(),
+						task.particleMap,
+						&task.particleBehaviourParameters,
+						pairInteractionSums
+					))
+						GrowPairContributions(context, pairInteractionSums, task);
+
+				GroupPairContributions(context, pairInteractionSums, 1, dynamicParticleCount, task);
+
+				timer.SyncThreads(context);
+
+				AddPairContributions(context, pairInteractionSums.influence, 1, task);
+
+				for (uintMem i = begin; i < end; ++i)
+					Details::UpdateParticlePressureFromPairs(
+						i,
+						staticParticleCount,
+						task.staticParticlesHashMap.Count() - 1,
+						task.inputParticleStreams,
+						task.outputParticleStreams.pressure,
+						task.particleMap,
+						task.staticParticles,
+						task.staticParticlesHashMap.Ptr(),
+						&task.particleBehaviourParameters,
+						pairInteractionSums
+					);
+			}
+			else if (cellBlocked)
+			{
+				forEachCellBlockedBucket([&](uintMem bucket) {
+					while (!Details::UpdateBucketParticlesPressure(
+						bucket,
+						dynamicParticleCount,
+						task.dynamicParticlesHashMap.Count() - 1,
+						staticParticleCount,
+						task.staticParticlesHashMap.Count() - 1,
+						task.inputParticleStreams,
+						task.outputParticleStreams.pressure,
+						task.dynamicParticlesHashMap.Ptr(),
+						task.particleMap,
+						task.staticParticles,
+						task.staticParticlesHashMap.Ptr(),
+						&task.particleBehaviourParameters,
+						cellNeighbourCandidates
+					))
+						GrowCellNeighbourCandidates(context, cellNeighbourCandidates, task);
+					});
+			}
+			else if (structOfArrays)
+			{
+				forEachParticle([&](uintMem i) {
+					task.updateParticlePressure(
+						i,
+						dynamicParticleCount,
+						task.dynamicParticlesHashMap.Count() - 1,
+						staticParticleCount,
+						task.staticParticlesHashMap.Count() - 1,
+						task.inputParticleStreams,
+						task.outputParticleStreams.pressure,
+						task.dynamicParticlesHashMap.Ptr(),
+						task.particleMap,
+						task.staticParticles,
+						task.staticParticlesHashMap.Ptr(),
+						&task.particleBehaviourParameters
+					);
+					});
+			}
+			else
+			{
+				forEachParticle([&](uintMem i) {
+					task.updateParticlePressureAoS(
+						i,
+						dynamicParticleCount,
+						task.dynamicParticlesHashMap.Count() - 1,
+						staticParticleCount,
+						task.staticParticlesHashMap.Count() - 1,
+						task.inputParticles,
+						task.outputParticles,
+						task.dynamicParticlesHashMap.Ptr(),
+						task.particleMap,
+						task.staticParticles,
+						task.staticParticlesHashMap.Ptr(),
+						&task.particleBehaviourParameters
+					);
+					});
+			}
+
+			timer.SyncThreads(context);
+			timer.Begin(SimulationPhase::Dynamics);
+
+			if (verletLists && context.GetThreadIndex() == 0)
+			{
+				//Every thread has decided whether to rebuild the lists before the last synchronization
+				++task.verletListStatistics.stepCount;
+
+				if (rebuildVerletLists)
+				{
+					task.verletListsValid = true;
+					task.verletListRebuildRequested = false;
+					++task.verletListStatistics.rebuildCount;
+					UpdateVerletListStatistics(task);
+				}
+			}
+
+			if (verletLists)
+			{
+				for (uintMem i = begin; i < end; ++i)
+				{
+					Details::UpdateParticleDynamicsFromList(
+						i,
+						task.dynamicParticlesHashMap.Count() - 1,
+						task.inputParticleStreams,
+						task.outputParticleStreams,
+						task.staticParticles,
+						task.dt,
+						&task.particleBehaviourParameters,
+						verletListStorage->Ptr() + task.verletListRanges[i * 3],
+						task.verletListRanges[i * 3 + 1] - task.verletListRanges[i * 3],
+						verletListStorage->Ptr() + task.verletListRanges[i * 3 + 1],
+						task.verletListRanges[i * 3 + 2] - task.verletListRanges[i * 3 + 1],
+						task.triangles.Count(),
+						(Triangle*)task.triangles.Ptr(),
+						task.triangleHashMap.Empty() ? 0 : task.triangleHashMap.Count() - 1,
+						task.triangleHashMap.Ptr(),
+						task.triangleMap.Ptr()
+					);
+
+					if (hashHistogram != nullptr)
+						CountParticleHash(hashHistogram, task.outputParticleStreams.hash[i], hashHistogramEpoch);
+				}
+			}
+			else if (structOfArrays && task.pairInteractionSums != nullptr)
+			{
+				std::fill_n(pairInteractionSums.forces + begin * 6, (end - begin) * 6, 0.0f);
+				pairInteractionSums.contributionCount = 0;
+
+				for (uintMem i = begin; i < end; ++i)
+					while (!Details::AccumulateParticleDynamicsPairs(
+						i,
+						task.dynamicParticlesHashMap.Count() - 1,
+						task.inputParticleStreams,
+						task.outputParticleStreams,
+						task.dynamicParticlesHashMap.Ptr(),
+						task.particleMap,
+						&task.particleBehaviourParameters,
+						pairInteractionSums
+					))
+						GrowPairContributions(context, pairInteractionSums, task);
+
+				GroupPairContributions(context, pairInteractionSums, 6, dynamicParticleCount, task);
+
+				timer.SyncThreads(context);
+
+				AddPairContributions(context, pairInteractionSums.forces, 6, task);
+
+				for (uintMem i = begin; i < end; ++i)
+					Details::UpdateParticleDynamicsFromPairs(
+						i,
+						task.dynamicParticlesHashMap.Count() - 1,
+						staticParticleCount,
+						task.staticParticlesHashMap.Count() - 1,
+						task.inputParticleStreams,
+						task.outputParticleStreams,
+						task.particleMap,
+						task.staticParticles,
+						task.staticParticlesHashMap.Ptr(),
+						task.dt,
+						&task.particleBehaviourParameters,
+						pairInteractionSums,
+						task.triangles.Count(),
+						(Triangle*)task.triangles.Ptr(),
+						task.triangleHashMap.Empty() ? 0 : task.triangleHashMap.Count() - 1,
+						task.triangleHashMap.Ptr(),
+						task.triangleMap.Ptr()
+					);
+			}
+			else if (cellBlocked)
+			{
+				forEachCellBlockedBucket([&](uintMem bucket) {
+					while (!Details::UpdateBucketParticlesDynamics(
+						bucket,
+						dynamicParticleCount,
+						task.dynamicParticlesHashMap.Count() - 1,
+						staticParticleCount,
+						task.staticParticlesHashMap.Count() - 1,
+						task.inputParticleStreams,
+						task.outputParticleStreams,
+						task.dynamicParticlesHashMap.Ptr(),
+						task.particleMap,
+						task.staticParticles,
+						task.staticParticlesHashMap.Ptr(),
+						task.dt,
+						&task.particleBehaviourParameters,
+						cellNeighbourCandidates,
+						task.triangles.Count(),
+						(Triangle*)task.triangles.Ptr(),
+						task.triangleHashMap.Empty() ? 0 : task.triangleHashMap.Count() - 1,
+						task.triangleHashMap.Ptr(),
+						task.triangleMap.Ptr()
+					))
+						GrowCellNeighbourCandidates(context, cellNeighbourCandidates, task);
+					});
+			}
+			else if (structOfArrays)
+			{
+				forEachParticle([&](uintMem i) {
+					task.updateParticleDynamics(
+						i,
+						dynamicParticleCount,
+						task.dynamicParticlesHashMap.Count() - 1,
+						staticParticleCount,
+						task.staticParticlesHashMap.Count() - 1,
+						task.inputParticleStreams,
+						task.outputParticleStreams,
+						task.dynamicParticlesHashMap.Ptr(),
+						task.particleMap,
+						task.staticParticles,
+						task.staticParticlesHashMap.Ptr(),
+						task.dt,
+						&task.particleBehaviourParameters,
+						task.triangles.Count(),
+						(Triangle*)task.triangles.Ptr(),
+						task.triangleHashMap.Empty() ? 0 : task.triangleHashMap.Count() - 1,
+						task.triangleHashMap.Ptr(),
+						task.triangleMap.Ptr()
+					);
+
+					if (dynamicsHashHistogram != nullptr)
+						CountParticleHash(dynamicsHashHistogram, task.outputParticleStreams.hash[i], hashHistogramEpoch);
+					});
+			}
+			else
+			{
+				forEachParticle([&](uintMem i) {
+					task.updateParticleDynamicsAoS(
+						i,
+						dynamicParticleCount,
+						task.dynamicParticlesHashMap.Count() - 1,
+						staticParticleCount,
+						task.staticParticlesHashMap.Count() - 1,
+						task.inputParticles,
+						task.outputParticles,
+						task.dynamicParticlesHashMap.Ptr(),
+						task.particleMap,
+						task.staticParticles,
+						task.staticParticlesHashMap.Ptr(),
+						task.dt,
+						&task.particleBehaviourParameters,
+						task.triangles.Count(),
+						(Triangle*)task.triangles.Ptr(),
+						task.triangleHashMap.Empty() ? 0 : task.triangleHashMap.Count() - 1,
+						task.triangleHashMap.Ptr(),
+						task.triangleMap.Ptr()
+					);
+
+					if (dynamicsHashHistogram != nullptr)
+						CountParticleHash(dynamicsHashHistogram, task.outputParticles[i].hash, hashHistogramEpoch);
+					});
+			}
+
+			timer.SyncThreads(context);
 
 			if (context.GetThreadIndex() == 0)
 			{
 				task.inputParticles = nullptr;
+				task.inputParticleStreams = { };
 				task.inputParticlesLockGuard.Unlock({});
-
-#ifdef DEBUG_BUFFERS_CPU
-				SimulationEngine::DebugParticles(
-					ArrayView<DynamicParticle>(task.outputParticles, dynamicParticleCount),
-					task.particleBehaviourParameters.maxInteractionDistance,
-					task.dynamicParticlesHashMap.Count() - 1
-				);
-
-				Array<uint> hashMap;
-				hashMap.Resize(task.dynamicParticlesHashMap.Count());
-				for (uintMem i = 0; i < task.dynamicParticlesHashMap.Count(); ++i)
-					hashMap[i] = task.dynamicParticlesHashMap[i].load();
-
-				SimulationEngine::DebugPrePrefixSumHashes(
-					ArrayView<DynamicParticle>(task.outputParticles, dynamicParticleCount),
-					std::move(hashMap)
-				);
 			}
 
-			context.SyncThreads();
+			bool checkIntegrity = task.integrityCheckInterval != 0 && (task.firstStepIndex + i + 1) % task.integrityCheckInterval == 0;
 
-			if (context.GetThreadIndex() == 0)
+			//The Verlet lists only need the hash map when they are rebuilt at the beginning of the next step, so it is
+			//only rebuilt for that, for the reordering and for the integrity check
+			bool rebuildHashMap = true;
+			if (verletLists)
 			{
-#endif
+				timer.Begin(SimulationPhase::NeighbourLists);
 
-				if (task.hashMapGroupSums == nullptr)
-				{
-					uint32 valueSum = 0;
-					for (uintMem i = 0; i < task.dynamicParticlesHashMap.Count() - 1; ++i)
-					{
-						valueSum += task.dynamicParticlesHashMap[i];
-						task.dynamicParticlesHashMap[i] = valueSum;
-					}
-				}
+				if (!task.reorderParticles && VerletListsExpired(begin, end, task.outputParticleStreams, task))
+					task.verletListRebuildRequested = true;
+
+				timer.SyncThreads(context);
+
+				rebuildHashMap = task.verletListRebuildRequested || task.reorderParticles || checkIntegrity;
 			}
 
-			if (task.hashMapGroupSums != nullptr)
+			//The half neighbourhood and the cell blocked traversal update the particles in the order of the particle map
+			//and the dynamic scheduling in chunks of any thread, so the hashes of the particles of each thread are counted
+			//when the hash map is rebuilt
+			if (rebuildHashMap && task.particleSortKeys != nullptr)
+				SortDynamicParticles(context, task, timer, begin, end, task.firstStepIndex + i);
+			else if (rebuildHashMap && hashHistogram != nullptr)
+				RebuildDynamicParticlesHashMapFromHistograms(context, task, timer, begin, end, hashHistogramEpoch, !verletLists && (task.pairInteractionSums != nullptr || cellBlocked || dynamicScheduling));
+			else if (rebuildHashMap)
+				RebuildDynamicParticlesHashMap(context, task, timer, begin, end, hashBegin, hashEnd);
+
+			bool measureLocality = rebuildHashMap && !task.reorderParticles && task.reorderScatterCounts != nullptr;
+			if (measureLocality)
 			{
-				uint32 valueSum = 0;
-				for (uintMem i = hashBegin; i < hashEnd; ++i)
-				{
-					valueSum += task.dynamicParticlesHashMap[i];
-					task.dynamicParticlesHashMap[i] = valueSum;
-				}
-
-				for (uintMem i = context.GetThreadIndex(); i < context.GetThreadCount() - 1; ++i)
-					task.hashMapGroupSums[i] += valueSum;
+				timer.Begin(SimulationPhase::MeasureLocality);
 
-				context.SyncThreads();
+				task.reorderScatterCounts[context.GetThreadIndex()] = SimulationEngine::CountScatteredParticleMapEntries(task.particleMap, begin, end);
 
-				if (context.GetThreadIndex() != 0)
-				{
-					uintMem addition = task.hashMapGroupSums[context.GetThreadIndex() - 1];
-					for (uintMem i = hashBegin; i < hashEnd; ++i)
-						task.dynamicParticlesHashMap[i] += addition;
-				}
+				timer.SyncThreads(context);
 			}
 
-			if (context.GetThreadIndex() == 0)
+			if (checkIntegrity)
 			{
-				if (task.reorderParticles)
-				{
-					task.dynamicParticlesBufferManager.Advance();
-					task.orderedParticlesLockGuard = task.dynamicParticlesBufferManager.LockWrite(nullptr);
-					task.orderedParticles = (DynamicParticle*)task.orderedParticlesLockGuard.GetResource();
-				}
-			}
+				timer.Begin(SimulationPhase::IntegrityCheck);
 
-			context.SyncThreads();
+				uint64 errorCount = CheckDynamicParticlesIntegrity(
+					begin, end, hashBegin, hashEnd,
+					task.reorderParticles ? task.orderedParticles : task.outputParticles,
+					task.reorderParticles ? task.orderedParticleStreams : task.outputParticleStreams,
+					dynamicParticleCount,
+					task.dynamicParticlesHashMap.Ptr(),
+					task.dynamicParticlesHashMap.Count() - 1,
+					task.particleMap,
+					task.particleBehaviourParameters
+				);
 
-			if (task.reorderParticles)
-			{
-				for (uintMem i = begin; i < end; ++i)
-				{
-					Details::ReorderDynamicParticlesAndFinishHashMap(
-						i,
-						task.particleMap,
-						task.dynamicParticlesHashMap.Ptr(),
-						task.outputParticles,
-						task.orderedParticles,
-						dynamicParticleCount
-					);
-				}
-			}
-			else
-			{
-				for (uintMem i = begin; i < end; ++i)
-				{
-					Details::FillDynamicParticleMapAndFinishHashMap(
-						i,
-						task.particleMap,
-						task.dynamicParticlesHashMap.Ptr(),
-						task.outputParticles,
-						dynamicParticleCount
-					);
-				}
-			}
+				if (errorCount != 0)
+					task.integrityErrorCount += errorCount;
 
-			context.SyncThreads();
+				timer.SyncThreads(context);
+			}
 
 			if (context.GetThreadIndex() == 0)
 			{
-#ifdef DEBUG_BUFFERS_CPU
+				timer.Begin(SimulationPhase::UnlockBuffers);
 
+				if (checkIntegrity)
+					++task.integrityCheckedStepCount;
 
-				SimulationEngine::DebugHashAndParticleMap<std::atomic_uint32_t>(
-					ArrayView<DynamicParticle>(task.orderedParticles ? task.orderedParticles : task.outputParticles, dynamicParticleCount),
-					task.dynamicParticlesHashMap,
-					ArrayView<uint32>(task.particleMap, dynamicParticleCount)
-				);
-#endif
+				AccumulateReorderScatter(task, context.GetThreadCount(), measureLocality);
 
 				task.outputParticles = nullptr;
+				task.outputParticleStreams = { };
 				task.outputParticlesLockGuard.Unlock({});
 
 				if (task.reorderParticles)
 				{
+					//The lists store particle indices, which are changed by the reordering
+					task.verletListsValid = false;
+
 					task.orderedParticles = nullptr;
+					task.orderedParticleStreams = { };
 					task.orderedParticlesLockGuard.Unlock({});
 				}
 
@@ -348,15 +1809,79 @@ namespace SPH
 		}
 	}
 
+	//The scalar functions are the instantiations for the scene when 'sceneVariant' is set, otherwise the functions that
+	//select the instantiation for every particle. The vectorized functions check the scene in every call
+	static Details::UpdateParticlePressureFunction GetUpdateParticlePressureFunction(CPUInstructionSet instructionSet, bool sceneVariant, bool hasStaticParticles)
+	{
+		switch (instructionSet)
+		{
+		case CPUInstructionSet::AVX2: return Details::UpdateParticlePressureAVX2;
+		case CPUInstructionSet::AVX512: return Details::UpdateParticlePressureAVX512;
+		default:
+			if (sceneVariant)
+				return Details::GetUpdateParticlePressureVariant(hasStaticParticles);
+			return Details::UpdateParticlePressure;
+		}
+	}
+	static Details::UpdateParticleDynamicsFunction GetUpdateParticleDynamicsFunction(CPUInstructionSet instructionSet, bool sceneVariant, bool hasStaticParticles, bool hasTriangles)
+	{
+		switch (instructionSet)
+		{
+		case CPUInstructionSet::AVX2: return Details::UpdateParticleDynamicsAVX2;
+		case CPUInstructionSet::AVX512: return Details::UpdateParticleDynamicsAVX512;
+		default:
+			if (sceneVariant)
+				return Details::GetUpdateParticleDynamicsVariant(hasStaticParticles, hasTriangles);
+			return Details::UpdateParticleDynamics;
+		}
+	}
+	static Details::UpdateParticlePressureAoSFunction GetUpdateParticlePressureAoSFunction(bool sceneVariant, bool hasStaticParticles)
+	{
+		if (sceneVariant)
+			return Details::GetUpdateParticlePressureAoSVariant(hasStaticParticles);
+		return Details::UpdateParticlePressure;
+	}
+	static Details::UpdateParticleDynamicsAoSFunction GetUpdateParticleDynamicsAoSFunction(bool sceneVariant, bool hasStaticParticles, bool hasTriangles)
+	{
+		if (sceneVariant)
+			return Details::GetUpdateParticleDynamicsAoSVariant(hasStaticParticles, hasTriangles);
+		return Details::UpdateParticleDynamics;
+	}
+
 	SimulationEngineCPU::SimulationEngineCPU(uintMem threadCount) :
 		dynamicParticlesBufferManager(nullptr),
 		staticParticlesBufferManager(nullptr),
 		reorderParticlesElapsedTime(0),
 		reorderParticlesTimeInterval(FLT_MAX),
+		adaptiveReorder(false),
+		adaptiveReorderCost(0.5f),
+		reorderAccumulatedScatter(0),
 		parallelPartialSum(true),
+		denseGrid(false),
+		denseGridMaxCellsPerParticle(8),
+		halfNeighbourhood(false),
+		verletLists(false),
+		verletSkinDistance(0),
+		privateHashHistograms(false),
+		cellBlockedNeighbours(false),
+		specializeKernels(true),
+		dynamicSchedulingChunkSize(0),
+		pageSize(PageSize::Default),
+		sortParticles(false),
+		incrementalSort(false),
+		incrementalSortMaxMovedFraction(0.05f),
+		verletListsValid(false),
+		verletListRebuildRequested(false),
+		integrityCheckInterval(0),
+		simulatedStepCount(0),
+		integrityCheckedStepCount(0),
+		integrityErrorCount(0),
+		dynamicParticlesLayout(ParticleBufferLayout::ArrayOfStructs),
+		instructionSet(GetBestSupportedInstructionSet()),
 		simulationTime(0)
 	{
 		threadManager.AllocateThreads(threadCount);
+		phaseRecorder.Initialize(threadManager.ThreadCount(), (uintMem)SimulationPhase::Count);
 	}
 	SimulationEngineCPU::~SimulationEngineCPU()
 	{
@@ -378,18 +1903,74 @@ namespace SPH
 
 		threadManager.FinishTasks();
 
-		hashMapGroupSums.Clear();
+		prefixSumBlockSums.Clear();
 		dynamicParticlesHashMap.Clear();
 		particleMap.Clear();
+		hashHistograms.Clear();
+		cellNeighbourCandidateStreams.Clear();
+		cellNeighbourCandidateIndices.Clear();
+		particleSortKeys.Clear();
+		particleSortIndices.Clear();
+		particleSortDigitCounts.Clear();
+		particleSortBuckets.Clear();
+		particleSortMovedKeys.Clear();
+		particleSortMovedIndices.Clear();
+		particleSortMovedCounts.Clear();
+		particleSortFirstUnmoved.Clear();
+		particleSortStatistics = { };
+		pairInteractionSums.Clear();
+		pairContributionIndices.Clear();
+		pairContributionValues.Clear();
+		groupedPairContributionIndices.Clear();
+		groupedPairContributionValues.Clear();
+		pairContributionOffsets.Clear();
+
+		verletListStorage.Clear();
+		verletListRanges.Clear();
+		verletListReferencePositions.Clear();
+		verletListsValid = false;
+		verletListRebuildRequested = false;
+		verletListStatistics = { };
+
+		phaseRecorder.Reset();
+
+		integrityCheckInterval = 0;
+		simulatedStepCount = 0;
+		integrityCheckedStepCount = 0;
+		integrityErrorCount = 0;
 
 		staticParticlesHashMap.Clear();
 
+		triangles.Clear();
+		triangleHashMap.Clear();
+		triangleMap.Clear();
+
 		particleBehaviourParameters = { };
 
 		reorderParticlesElapsedTime = 0.0f;
 		reorderParticlesTimeInterval = FLT_MAX;
+		adaptiveReorder = false;
+		adaptiveReorderCost = 0.5f;
+		reorderScatterCounts.Clear();
+		reorderAccumulatedScatter = 0;
+		reorderStatistics = { };
 
 		parallelPartialSum = false;
+		denseGrid = false;
+		denseGridMaxCellsPerParticle = 8;
+		halfNeighbourhood = false;
+		verletLists = false;
+		verletSkinDistance = 0;
+		privateHashHistograms = false;
+		cellBlockedNeighbours = false;
+		specializeKernels = true;
+		dynamicSchedulingChunkSize = 0;
+		pageSize = PageSize::Default;
+		sortParticles = false;
+		incrementalSort = false;
+		incrementalSortMaxMovedFraction = 0.05f;
+
+		dynamicParticlesLayout = ParticleBufferLayout::ArrayOfStructs;
 
 		simulationTime = 0;
 	}
@@ -399,23 +1980,162 @@ namespace SPH
 
 		auto parameters = scene.GetSystemParameters();
 		parameters.ParseParameter("reorderTimeInterval", reorderParticlesTimeInterval);
+		parameters.ParseParameter("adaptiveReorder", adaptiveReorder);
+		parameters.ParseParameter("adaptiveReorderCost", adaptiveReorderCost);
 		parameters.ParseParameter("parallelPartialSum", parallelPartialSum);
+		parameters.ParseParameter("denseGrid", denseGrid);
+		parameters.ParseParameter("denseGridMaxCellsPerParticle", denseGridMaxCellsPerParticle);
+		parameters.ParseParameter("halfNeighbourhood", halfNeighbourhood);
+		parameters.ParseParameter("verletLists", verletLists);
+		parameters.ParseParameter("privateHashHistograms", privateHashHistograms);
+		parameters.ParseParameter("cellBlockedNeighbours", cellBlockedNeighbours);
+		parameters.ParseParameter("specializeKernels", specializeKernels);
+
+		bool dynamicScheduling = false;
+		uint64 dynamicSchedulingChunkSize = 64;
+		parameters.ParseParameter("dynamicScheduling", dynamicScheduling);
+		parameters.ParseParameter("dynamicSchedulingChunkSize", dynamicSchedulingChunkSize);
+		parameters.ParseParameter("sortParticles", sortParticles);
+		parameters.ParseParameter("incrementalSort", incrementalSort);
+		parameters.ParseParameter("incrementalSortMaxMovedFraction", incrementalSortMaxMovedFraction);
+		parameters.ParseParameter("integrityCheckInterval", integrityCheckInterval);
+
+		bool spinningThreadBarrier = true;
+		parameters.ParseParameter("spinningThreadBarrier", spinningThreadBarrier);
+		threadManager.SetBarrierType(spinningThreadBarrier ? ThreadBarrierType::SpinAndWait : ThreadBarrierType::ConditionVariable);
+
+		bool structOfArrays = false;
+		parameters.ParseParameter("structOfArrays", structOfArrays);
+		dynamicParticlesLayout = structOfArrays ? ParticleBufferLayout::StructOfArrays : ParticleBufferLayout::ArrayOfStructs;
+
+		if (halfNeighbourhood && !structOfArrays)
+		{
+			Debug::Logger::LogWarning("Client", "The half neighbourhood traversal is only implemented for the StructOfArrays layout. The full neighbourhood is traversed instead");
+			halfNeighbourhood = false;
+		}
+
+		if (verletLists && !structOfArrays)
+		{
+			Debug::Logger::LogWarning("Client", "The Verlet lists are only implemented for the StructOfArrays layout. The neighbours are searched every step instead");
+			verletLists = false;
+		}
+
+		if (verletLists && halfNeighbourhood)
+		{
+			Debug::Logger::LogWarning("Client", "The Verlet lists and the half neighbourhood traversal can't be used together. The Verlet lists are used");
+			halfNeighbourhood = false;
+		}
+
+		if (cellBlockedNeighbours && !structOfArrays)
+		{
+			Debug::Logger::LogWarning("Client", "The cell blocked traversal is only implemented for the StructOfArrays layout. It isn't used");
+			cellBlockedNeighbours = false;
+		}
+
+		if (cellBlockedNeighbours && (verletLists || halfNeighbourhood))
+		{
+			Debug::Logger::LogWarning("Client", "The cell blocked traversal can't be used together with the Verlet lists or the half neighbourhood traversal. It isn't used");
+			cellBlockedNeighbours = false;
+		}
+
+		if (dynamicScheduling && (verletLists || halfNeighbourhood))
+		{
+			Debug::Logger::LogWarning("Client", "The dynamic scheduling can't be used together with the Verlet lists or the half neighbourhood traversal. The particles are split statically between the threads");
+			dynamicScheduling = false;
+		}
+
+		if (dynamicScheduling)
+			this->dynamicSchedulingChunkSize = std::max<uint64>(dynamicSchedulingChunkSize, 1);
+
+		if (sortParticles && verletLists)
+		{
+			Debug::Logger::LogWarning("Client", "The particles can't be sorted every step with the Verlet lists, the lists would be rebuilt every step. They are reordered every \"reorderTimeInterval\" instead");
+			sortParticles = false;
+		}
+
+		if (incrementalSort && !sortParticles)
+		{
+			Debug::Logger::LogWarning("Client", "The incremental sorting is only used when the particles are sorted every step with the \"sortParticles\" parameter");
+			incrementalSort = false;
+		}
+
+		if (adaptiveReorder && sortParticles)
+		{
+			Debug::Logger::LogWarning("Client", "The adaptive reordering isn't needed when the particles are sorted every step. It isn't used");
+			adaptiveReorder = false;
+		}
+
+		if (sortParticles && privateHashHistograms)
+		{
+			Debug::Logger::LogWarning("Client", "The private hash histograms aren't needed when the particles are sorted every step. They aren't used");
+			privateHashHistograms = false;
+		}
+
+		uint64 pageSizeIndex = 0;
+		if (parameters.ParseParameter("pageSize", pageSizeIndex))
+		{
+			if (pageSizeIndex > (uint64)PageSize::Huge)
+			{
+				Debug::Logger::LogWarning("Client", "The \"pageSize\" parameter must be between 0 and 3. The default pages are used");
+				pageSizeIndex = 0;
+			}
+
+			pageSize = (PageSize)pageSizeIndex;
+		}
+
+		uint64 threadAffinity = 0;
+		if (parameters.ParseParameter("threadAffinity", threadAffinity))
+		{
+			if (threadAffinity > (uint64)ThreadAffinityPolicy::Scatter)
+			{
+				Debug::Logger::LogWarning("Client", "The \"threadAffinity\" parameter must be 0, 1 or 2. The threads aren't pinned");
+				threadAffinity = 0;
+			}
+
+			SetThreadAffinity((ThreadAffinityPolicy)threadAffinity);
+		}
+
+		bool simdKernels = true;
+		if (parameters.ParseParameter("simdKernels", simdKernels))
+			SetInstructionSet(simdKernels ? GetBestSupportedInstructionSet() : CPUInstructionSet::Scalar);
 
 		particleBehaviourParameters = parameters.particleBehaviourParameters;
 		//TODO calculate this somewhere else
 		particleBehaviourParameters.smoothingKernelConstant = SmoothingKernelConstant(parameters.particleBehaviourParameters.maxInteractionDistance);
 		particleBehaviourParameters.selfDensity = parameters.particleBehaviourParameters.particleMass * SmoothingKernelD0(0, parameters.particleBehaviourParameters.maxInteractionDistance) * particleBehaviourParameters.smoothingKernelConstant;
 
+		bool hilbertCurve = false;
+		parameters.ParseParameter("hilbertCurve", hilbertCurve);
+		particleBehaviourParameters.cellCurve = hilbertCurve ? 1 : 0;
+
+		verletSkinDistance = particleBehaviourParameters.maxInteractionDistance * 0.2f;
+		parameters.ParseParameter("verletSkinDistance", verletSkinDistance);
+
+		if (verletSkinDistance < 0 || verletSkinDistance > particleBehaviourParameters.maxInteractionDistance)
+		{
+			Debug::Logger::LogWarning("Client", "The Verlet skin distance must be between 0 and the max interaction distance. It is clamped");
+			verletSkinDistance = std::clamp(verletSkinDistance, 0.0f, particleBehaviourParameters.maxInteractionDistance);
+		}
+
 		this->dynamicParticlesBufferManager = &dynamicParticlesBufferManager;
 		this->staticParticlesBufferManager = &staticParticlesBufferManager;
 
-		if (parallelPartialSum)
-			hashMapGroupSums = Array<std::atomic_uint32_t>(threadManager.ThreadCount());
+		prefixSumBlockSums.Resize(threadManager.ThreadCount());
+
+		if (adaptiveReorder)
+			reorderScatterCounts.Resize(threadManager.ThreadCount());
+
+		if (cellBlockedNeighbours)
+		{
+			cellNeighbourCandidateStreams.Resize(threadManager.ThreadCount());
+			cellNeighbourCandidateIndices.Resize(threadManager.ThreadCount());
+		}
 
 		InitializeStaticParticles(scene, staticParticlesBufferManager);
 		InitializeDynamicParticles(scene, dynamicParticlesBufferManager);
 
 		triangles = scene.GetMesh().CreateTriangleArray();
+		GenerateTriangleHashMap(triangles, triangleHashMap, triangleMap);
 	}
 	void SimulationEngineCPU::Update(float deltaTime, uint simulationSteps)
 	{
@@ -428,6 +2148,9 @@ namespace SPH
 		if (dynamicParticlesBufferManager->GetParticleCount() == 0)
 			return;
 
+		bool hasStaticParticles = staticParticlesBufferManager->GetParticleCount() != 0;
+		bool hasTriangles = !triangles.Empty();
+
 		if (threadManager.TryEnqueueTask(SimulateParticlesTimeStep, SimulateParticlesTimeStepTask{
 			.dynamicParticlesBufferManager = *dynamicParticlesBufferManager,
 			.staticParticlesBufferManager = *staticParticlesBufferManager,
@@ -436,26 +2159,333 @@ namespace SPH
 			.staticParticlesHashMap = staticParticlesHashMap,
 			.particleMap = particleMap.Ptr(),
 			.triangles = triangles,
-			.hashMapGroupSums = hashMapGroupSums.Ptr(),
+			.triangleHashMap = triangleHashMap,
+			.triangleMap = triangleMap,
+			.prefixSumBlockSums = parallelPartialSum ? prefixSumBlockSums.Ptr() : nullptr,
 			.simulationSteps = simulationSteps,
 			.dt = deltaTime,
-			.reorderParticles = reorderParticlesElapsedTime > reorderParticlesTimeInterval,
+			.reorderParticles = false,
+			.reorderElapsedTime = reorderParticlesElapsedTime,
+			.reorderTimeInterval = reorderParticlesTimeInterval,
+			.reorderScatterCounts = reorderScatterCounts.Empty() ? nullptr : reorderScatterCounts.Ptr(),
+			.adaptiveReorderCost = adaptiveReorderCost,
+			.reorderAccumulatedScatter = reorderAccumulatedScatter,
+			.reorderStatistics = reorderStatistics,
+			.updateParticlePressure = GetUpdateParticlePressureFunction(instructionSet, specializeKernels, hasStaticParticles),
+			.updateParticleDynamics = GetUpdateParticleDynamicsFunction(instructionSet, specializeKernels, hasStaticParticles, hasTriangles),
+			.updateParticlePressureAoS = GetUpdateParticlePressureAoSFunction(specializeKernels, hasStaticParticles),
+			.updateParticleDynamicsAoS = GetUpdateParticleDynamicsAoSFunction(specializeKernels, hasStaticParticles, hasTriangles),
+			.pairInteractionSums = pairInteractionSums.Empty() ? nullptr : pairInteractionSums.Ptr(),
+			.pairContributionIndices = pairContributionIndices,
+			.pairContributionValues = pairContributionValues,
+			.groupedPairContributionIndices = groupedPairContributionIndices,
+			.groupedPairContributionValues = groupedPairContributionValues,
+			.pairContributionOffsets = pairContributionOffsets,
+			.hashHistograms = hashHistograms,
+			.cellNeighbourCandidateStreams = cellNeighbourCandidateStreams,
+			.cellNeighbourCandidateIndices = cellNeighbourCandidateIndices,
+			.dynamicSchedulingChunkSize = dynamicSchedulingChunkSize,
+			.particleSortKeys = particleSortKeys.Empty() ? nullptr : particleSortKeys.Ptr(),
+			.particleSortIndices = particleSortIndices.Empty() ? nullptr : particleSortIndices.Ptr(),
+			.particleSortDigitCounts = particleSortDigitCounts.Empty() ? nullptr : particleSortDigitCounts.Ptr(),
+			.particleSortBuckets = particleSortBuckets.Empty() ? nullptr : particleSortBuckets.Ptr(),
+			.particleSortMovedKeys = particleSortMovedKeys.Empty() ? nullptr : particleSortMovedKeys.Ptr(),
+			.particleSortMovedIndices = particleSortMovedIndices.Empty() ? nullptr : particleSortMovedIndices.Ptr(),
+			.particleSortMovedCapacity = particleSortMovedKeys.Count() / 2,
+			.particleSortMovedCounts = particleSortMovedCounts.Empty() ? nullptr : particleSortMovedCounts.Ptr(),
+			.particleSortFirstUnmoved = particleSortFirstUnmoved.Empty() ? nullptr : particleSortFirstUnmoved.Ptr(),
+			.particleSortStatistics = particleSortStatistics,
+			.verletListStorage = verletListStorage,
+			.verletListRanges = verletListRanges,
+			.verletListReferencePositions = verletListReferencePositions,
+			.verletListsValid = verletListsValid,
+			.verletListRebuildRequested = verletListRebuildRequested,
+			.verletListStatistics = verletListStatistics,
+			.verletSkinDistance = verletSkinDistance,
+			.phaseRecorder = phaseRecorder,
+			.integrityCheckInterval = integrityCheckInterval,
+			.firstStepIndex = simulatedStepCount,
+			.integrityCheckedStepCount = integrityCheckedStepCount,
+			.integrityErrorCount = integrityErrorCount,
 			.inputParticlesLockGuard = ResourceLockGuard(),
 			.inputParticles = nullptr,
+			.inputParticleStreams = { },
 			.outputParticlesLockGuard = ResourceLockGuard(),
 			.outputParticles = nullptr,
+			.outputParticleStreams = { },
 			.orderedParticlesLockGuard = ResourceLockGuard(),
 			.orderedParticles = nullptr,
+			.orderedParticleStreams = { },
 			.staticParticlesLockGuard = ResourceLockGuard(),
 			.staticParticles = nullptr
 			}))
 		{
 			simulationTime += deltaTime * simulationSteps;
+			simulatedStepCount += simulationSteps;
+		}
+	}
+	void SimulationEngineCPU::FinishUpdates()
+	{
+		threadManager.FinishTasks();
+	}
+	SimulationStatistics SimulationEngineCPU::GetStatistics()
+	{
+		return phaseRecorder.GetStatistics(simulationPhaseNames);
+	}
+	void SimulationEngineCPU::ResetStatistics()
+	{
+		phaseRecorder.Reset();
+		threadManager.ResetParallelForStatistics();
+	}
+	IntegrityCheckStatistics SimulationEngineCPU::GetIntegrityCheckStatistics() const
+	{
+		return { integrityCheckedStepCount, integrityErrorCount.load() };
+	}
+	void SimulationEngineCPU::SetThreadAffinity(ThreadAffinityPolicy policy, ArrayView<uint32> processors)
+	{
+		threadManager.SetThreadAffinityPolicy(policy, processors);
+	}
+	void SimulationEngineCPU::SetInstructionSet(CPUInstructionSet instructionSet)
+	{
+		if (!IsInstructionSetSupported(instructionSet))
+		{
+			Debug::Logger::LogWarning("Client", "The selected instruction set is not supported by the CPU. The best supported one is used instead");
+			instructionSet = GetBestSupportedInstructionSet();
+		}
+
+		this->instructionSet = instructionSet;
+	}
+	bool SimulationEngineCPU::IsInstructionSetSupported(CPUInstructionSet instructionSet)
+	{
+		switch (instructionSet)
+		{
+		case CPUInstructionSet::Scalar: return true;
+		case CPUInstructionSet::AVX2: return Details::IsAVX2Supported();
+		case CPUInstructionSet::AVX512: return Details::IsAVX512Supported();
+		default: return false;
+		}
+	}
+	CPUInstructionSet SimulationEngineCPU::GetBestSupportedInstructionSet()
+	{
+		if (Details::IsAVX512Supported())
+			return CPUInstructionSet::AVX512;
+		if (Details::IsAVX2Supported())
+			return CPUInstructionSet::AVX2;
+		return CPUInstructionSet::Scalar;
+	}
+	NeighbourSearchStatistics SimulationEngineCPU::ComputeNeighbourSearchStatistics()
+	{
+		NeighbourSearchStatistics statistics;
+
+		if (dynamicParticlesBufferManager == nullptr || dynamicParticlesHashMap.Empty())
+			return statistics;
+
+		uintMem dynamicParticleCount = dynamicParticlesBufferManager->GetParticleCount();
+		uintMem staticParticleCount = staticParticlesBufferManager->GetParticleCount();
+		uintMem dynamicBucketCount = dynamicParticlesHashMap.Count() - 1;
+		uintMem staticBucketCount = staticParticlesHashMap.Empty() ? 0 : staticParticlesHashMap.Count() - 1;
+
+		statistics.dynamicParticleCount = dynamicParticleCount;
+		statistics.dynamicBucketCount = dynamicBucketCount;
+		statistics.staticBucketCount = staticBucketCount;
+
+		ResourceLockGuard dynamicParticlesLockGuard = dynamicParticlesBufferManager->LockRead(nullptr);
+		DynamicParticle* dynamicParticles;
+		Details::DynamicParticleStreams dynamicParticleStreams;
+		GetDynamicParticles(dynamicParticlesLockGuard, *dynamicParticlesBufferManager, dynamicParticles, dynamicParticleStreams);
+
+		ResourceLockGuard staticParticlesLockGuard;
+		const StaticParticle* staticParticles = nullptr;
+		if (staticParticleCount != 0)
+		{
+			staticParticlesLockGuard = staticParticlesBufferManager->LockRead(nullptr);
+			staticParticles = (const StaticParticle*)staticParticlesLockGuard.GetResource();
+		}
+
+		auto getPosition = [&](uintMem index) {
+			if (dynamicParticles != nullptr)
+				return dynamicParticles[index].position;
+			return Vec3f(dynamicParticleStreams.positionX[index], dynamicParticleStreams.positionY[index], dynamicParticleStreams.positionZ[index]);
+			};
+
+		float maxInteractionDistanceSqr = particleBehaviourParameters.maxInteractionDistance * particleBehaviourParameters.maxInteractionDistance;
+
+		bool halfNeighbourhoodUsed = IsHalfNeighbourhoodUsed();
+
+		//The particles are visited in the particle map order, the half neighbourhood traversal depends on it
+		for (uintMem sortedIndex = 0; sortedIndex < dynamicParticleCount; ++sortedIndex)
+		{
+			uint32 i = particleMap[sortedIndex];
+			Vec3f position = getPosition(i);
+
+			uint32 buckets[27];
+			uint32 bucketCount = halfNeighbourhoodUsed ?
+				Details::GetUniqueNeighbourCellBuckets(position.x, position.y, position.z, dynamicBucketCount, &particleBehaviourParameters, buckets) :
+				Details::GetNeighbourCellBuckets(position.x, position.y, position.z, dynamicBucketCount, &particleBehaviourParameters, buckets);
+
+			for (uint32 j = 0; j < bucketCount; ++j)
+				for (uint32 k = halfNeighbourhoodUsed ? std::max<uint32>(dynamicParticlesHashMap[buckets[j]], sortedIndex + 1) : dynamicParticlesHashMap[buckets[j]].load(); k < dynamicParticlesHashMap[buckets[j] + 1]; ++k)
+				{
+					uint32 index = particleMap[k];
+
+					if (index == i)
+						continue;
+
+					++statistics.dynamicCandidateCount;
+
+					Vec3f dir = getPosition(index) - position;
+					if (dir.DotProduct(dir) <= maxInteractionDistanceSqr)
+						++statistics.dynamicNeighbourCount;
+				}
+
+			if (staticParticleCount == 0)
+				continue;
+
+			bucketCount = Details::GetNeighbourCellBuckets(position.x, position.y, position.z, staticBucketCount, &particleBehaviourParameters, buckets);
+
+			for (uint32 j = 0; j < bucketCount; ++j)
+				for (uint32 k = staticParticlesHashMap[buckets[j]]; k < staticParticlesHashMap[buckets[j] + 1]; ++k)
+				{
+					++statistics.staticCandidateCount;
+
+					Vec3f dir = staticParticles[k].position - position;
+					if (dir.DotProduct(dir) <= maxInteractionDistanceSqr)
+						++statistics.staticNeighbourCount;
+				}
+		}
+
+		if (staticParticleCount != 0)
+			staticParticlesLockGuard.Unlock({});
+		dynamicParticlesLockGuard.Unlock({});
+
+		return statistics;
+	}
+	KernelComparison SimulationEngineCPU::CompareInstructionSetKernels(CPUInstructionSet instructionSet, float deltaTime)
+	{
+		KernelComparison comparison;
+
+		if (dynamicParticlesBufferManager == nullptr || dynamicParticlesHashMap.Empty() || dynamicParticlesLayout != ParticleBufferLayout::StructOfArrays)
+			return comparison;
+
+		if (!IsInstructionSetSupported(instructionSet))
+		{
+			Debug::Logger::LogWarning("Client", "The compared instruction set is not supported by the CPU");
+			return comparison;
+		}
 
-			reorderParticlesElapsedTime += deltaTime;
-			if (reorderParticlesElapsedTime > reorderParticlesTimeInterval)
-				reorderParticlesElapsedTime = 0;
+		uintMem dynamicParticleCount = dynamicParticlesBufferManager->GetParticleCount();
+		uintMem staticParticleCount = staticParticlesBufferManager->GetParticleCount();
+		uintMem dynamicBucketCount = dynamicParticlesHashMap.Count() - 1;
+		uintMem staticBucketCount = staticParticlesHashMap.Empty() ? 0 : staticParticlesHashMap.Count() - 1;
+
+		comparison.particleCount = dynamicParticleCount;
+
+		ResourceLockGuard dynamicParticlesLockGuard = dynamicParticlesBufferManager->LockRead(nullptr);
+		DynamicParticle* dynamicParticles;
+		Details::DynamicParticleStreams inputStreams;
+		GetDynamicParticles(dynamicParticlesLockGuard, *dynamicParticlesBufferManager, dynamicParticles, inputStreams);
+
+		ResourceLockGuard staticParticlesLockGuard;
+		const StaticParticle* staticParticles = nullptr;
+		if (staticParticleCount != 0)
+		{
+			staticParticlesLockGuard = staticParticlesBufferManager->LockRead(nullptr);
+			staticParticles = (const StaticParticle*)staticParticlesLockGuard.GetResource();
+		}
+
+		//Both outputs are separate StructOfArrays buffers so the particles of the engine stay unchanged
+		Array<float> scalarOutput;
+		Array<float> comparedOutput;
+		scalarOutput.Resize(dynamicParticleCount * 8);
+		comparedOutput.Resize(dynamicParticleCount * 8);
+		Details::DynamicParticleStreams scalarStreams = Details::GetDynamicParticleStreams(scalarOutput.Ptr(), dynamicParticleCount);
+		Details::DynamicParticleStreams comparedStreams = Details::GetDynamicParticleStreams(comparedOutput.Ptr(), dynamicParticleCount);
+
+		auto error = [](float value, float reference) {
+			return std::abs((double)value - reference) / std::max(1.0, std::abs((double)reference));
+			};
+
+		Details::UpdateParticlePressureFunction updateParticlePressure = GetUpdateParticlePressureFunction(instructionSet, specializeKernels, staticParticleCount != 0);
+		Details::UpdateParticleDynamicsFunction updateParticleDynamics = GetUpdateParticleDynamicsFunction(instructionSet, specializeKernels, staticParticleCount != 0, !triangles.Empty());
+
+		for (uintMem i = 0; i < dynamicParticleCount; ++i)
+		{
+			Details::UpdateParticlePressure(i, dynamicParticleCount, dynamicBucketCount, staticParticleCount, staticBucketCount, inputStreams, scalarStreams.pressure, dynamicParticlesHashMap.Ptr(), particleMap.Ptr(), staticParticles, staticParticlesHashMap.Ptr(), &particleBehaviourParameters);
+			updateParticlePressure(i, dynamicParticleCount, dynamicBucketCount, staticParticleCount, staticBucketCount, inputStreams, comparedStreams.pressure, dynamicParticlesHashMap.Ptr(), particleMap.Ptr(), staticParticles, staticParticlesHashMap.Ptr(), &particleBehaviourParameters);
+
+			comparison.pressureError = std::max(comparison.pressureError, error(comparedStreams.pressure[i], scalarStreams.pressure[i]));
+		}
+
+		memcpy(comparedStreams.pressure, scalarStreams.pressure, dynamicParticleCount * sizeof(float));
+
+		for (uintMem i = 0; i < dynamicParticleCount; ++i)
+		{
+			Details::UpdateParticleDynamics(i, dynamicParticleCount, dynamicBucketCount, staticParticleCount, staticBucketCount, inputStreams, scalarStreams, dynamicParticlesHashMap.Ptr(), particleMap.Ptr(), staticParticles, staticParticlesHashMap.Ptr(), deltaTime, &particleBehaviourParameters, triangles.Count(), (Triangle*)triangles.Ptr(), triangleHashMap.Empty() ? 0 : triangleHashMap.Count() - 1, triangleHashMap.Ptr(), triangleMap.Ptr());
+			updateParticleDynamics(i, dynamicParticleCount, dynamicBucketCount, staticParticleCount, staticBucketCount, inputStreams, comparedStreams, dynamicParticlesHashMap.Ptr(), particleMap.Ptr(), staticParticles, staticParticlesHashMap.Ptr(), deltaTime, &particleBehaviourParameters, triangles.Count(), (Triangle*)triangles.Ptr(), triangleHashMap.Empty() ? 0 : triangleHashMap.Count() - 1, triangleHashMap.Ptr(), triangleMap.Ptr());
+
+			comparison.positionError = std::max({ comparison.positionError,
+				error(comparedStreams.positionX[i], scalarStreams.positionX[i]),
+				error(comparedStreams.positionY[i], scalarStreams.positionY[i]),
+				error(comparedStreams.positionZ[i], scalarStreams.positionZ[i])
+				});
+			comparison.velocityError = std::max({ comparison.velocityError,
+				error(comparedStreams.velocityX[i], scalarStreams.velocityX[i]),
+				error(comparedStreams.velocityY[i], scalarStreams.velocityY[i]),
+				error(comparedStreams.velocityZ[i], scalarStreams.velocityZ[i])
+				});
+
+			if (comparedStreams.hash[i] != scalarStreams.hash[i])
+				++comparison.hashMismatchCount;
+		}
+
+		if (staticParticleCount != 0)
+			staticParticlesLockGuard.Unlock({});
+		dynamicParticlesLockGuard.Unlock({});
+
+		return comparison;
+	}
+	void SimulationEngineCPU::InitializeDenseGrid(ArrayView<StaticParticle> staticParticles, uintMem dynamicParticleCount)
+	{
+		if (staticParticles.Empty())
+		{
+			Debug::Logger::LogWarning("Client", "The dense grid needs static particles to bound the simulation. The hash map is used instead");
+			return;
+		}
+
+		Vec3f min = staticParticles[0].position;
+		Vec3f max = staticParticles[0].position;
+		for (auto& particle : staticParticles)
+		{
+			min = Vec3f(std::min(min.x, particle.position.x), std::min(min.y, particle.position.y), std::min(min.z, particle.position.z));
+			max = Vec3f(std::max(max.x, particle.position.x), std::max(max.y, particle.position.y), std::max(max.z, particle.position.z));
+		}
+
+		//The cells wrap around like they do in GetCell, so the subtraction gives the right size for negative positions too.
+		//One cell of padding on each side keeps the neighbourhood of every cell of the bounding box inside of the grid
+		Vec3u minCell = GetCell(min, particleBehaviourParameters.maxInteractionDistance) - Vec3u(1, 1, 1);
+		Vec3u size = GetCell(max, particleBehaviourParameters.maxInteractionDistance) - minCell + Vec3u(2, 2, 2);
+
+		uint64 cellCount = (uint64)size.x * size.y * size.z;
+
+		if (cellCount > (1 << 24))
+		{
+			Debug::Logger::LogWarning("Client", "The dense grid would have more than 2^24 cells. The hash map is used instead");
+			return;
+		}
+
+		//The clear and the prefix sum of every step scale with the cell count, while the hash map has 2 buckets per particle
+		if (cellCount > denseGridMaxCellsPerParticle * std::max<uintMem>(1, dynamicParticleCount))
+		{
+			Debug::Logger::LogWarning("Client", "The dense grid would have more than \"denseGridMaxCellsPerParticle\" cells per dynamic particle. The hash map is used instead");
+			return;
 		}
+
+		particleBehaviourParameters.gridOriginX = minCell.x;
+		particleBehaviourParameters.gridOriginY = minCell.y;
+		particleBehaviourParameters.gridOriginZ = minCell.z;
+		particleBehaviourParameters.gridSizeX = size.x;
+		particleBehaviourParameters.gridSizeY = size.y;
+		particleBehaviourParameters.gridSizeZ = size.z;
 	}
 	void SimulationEngineCPU::InitializeStaticParticles(SceneBlueprint& scene, ParticleBufferManager& staticParticlesBufferManager)
 	{
@@ -465,15 +2495,24 @@ namespace SPH
 		if (staticParticles.Empty())
 			return;
 
-		staticParticlesHashMap = Array<std::atomic_uint32_t>(staticParticles.Count() + 1);
-		staticParticles = GenerateHashMapAndReorderParticles(staticParticles, staticParticlesHashMap, particleBehaviourParameters.maxInteractionDistance);
+		if (denseGrid)
+			InitializeDenseGrid(staticParticles, scene.GetLayerParticleCount("dynamic"));
 
-		staticParticlesBufferManager.Allocate(sizeof(StaticParticle), staticParticles.Count(), staticParticles.Ptr(), 1);
+		//With the dense grid there is a bucket for every cell and one for all the cells outside of the grid
+		if (IsDenseGridUsed())
+			staticParticlesHashMap = Array<std::atomic_uint32_t>((uintMem)particleBehaviourParameters.gridSizeX * particleBehaviourParameters.gridSizeY * particleBehaviourParameters.gridSizeZ + 2);
+		else
+			staticParticlesHashMap = Array<std::atomic_uint32_t>(staticParticles.Count() + 1);
 
-#ifdef DEBUG_BUFFERS_CPU
-		DebugParticles<StaticParticle>(staticParticles, particleBehaviourParameters.maxInteractionDistance, staticParticlesHashMap.Count() - 1);
-		DebugHashAndParticleMap<std::atomic_uint32_t>(staticParticles, staticParticlesHashMap, particleBehaviourParameters.maxInteractionDistance);
-#endif
+		staticParticles = GenerateHashMapAndReorderParticles(staticParticles, staticParticlesHashMap, particleBehaviourParameters);
+
+		staticParticlesBufferManager.Allocate(sizeof(StaticParticle), staticParticles.Count(), staticParticles.Ptr(), 1, ParticleBufferLayout::ArrayOfStructs);
+
+		if (integrityCheckInterval != 0)
+		{
+			integrityErrorCount += DebugParticles<StaticParticle>(staticParticles, particleBehaviourParameters, staticParticlesHashMap.Count() - 1);
+			integrityErrorCount += DebugHashAndParticleMap<std::atomic_uint32_t>(staticParticles, staticParticlesHashMap, particleBehaviourParameters);
+		}
 	}
 	void SimulationEngineCPU::InitializeDynamicParticles(SceneBlueprint& scene, ParticleBufferManager& dynamicParticlesBufferManager)
 	{
@@ -483,12 +2522,75 @@ namespace SPH
 		if (dynamicParticles.Empty())
 			return;
 
-		dynamicParticlesHashMap = Array<std::atomic_uint32_t>(2 * dynamicParticles.Count() + 1);
+		if (IsDenseGridUsed())
+			dynamicParticlesHashMap = PageArray<std::atomic_uint32_t>((uintMem)particleBehaviourParameters.gridSizeX * particleBehaviourParameters.gridSizeY * particleBehaviourParameters.gridSizeZ + 2, pageSize);
+		else
+			dynamicParticlesHashMap = PageArray<std::atomic_uint32_t>(2 * dynamicParticles.Count() + 1, pageSize);
 		dynamicParticlesHashMap.Last() = (uint)dynamicParticles.Count();
 
-		particleMap.Resize(dynamicParticles.Count());
+		particleMap = PageArray<uint32>(dynamicParticles.Count(), pageSize);
+
+		//Small maps don't get large pages anyway
+		if (particleMap.GetPageSize() < pageSize && particleMap.Count() * sizeof(uint32) >= PageBuffer::GetPageBytes(PageSize::Large))
+			Debug::Logger::LogWarning("Client", "The pages of the \"pageSize\" parameter aren't available. Smaller pages are used instead");
+
+		if (privateHashHistograms && dynamicParticles.Count() > HashHistogramCountMask)
+			Debug::Logger::LogWarning("Client", "The private hash histograms need fewer than 2^24 dynamic particles. The hash map is built with atomics instead");
+		else if (privateHashHistograms)
+		{
+			hashHistograms.Resize(threadManager.ThreadCount());
+			for (auto& histogram : hashHistograms)
+				histogram.Resize(dynamicParticlesHashMap.Count() - 1);
+		}
+
+		if (sortParticles)
+		{
+			particleSortKeys.Resize(dynamicParticles.Count() * 2);
+			particleSortIndices.Resize(dynamicParticles.Count() * 2);
+			particleSortDigitCounts.Resize(threadManager.ThreadCount() * 256);
+			particleSortBuckets.Resize(dynamicParticles.Count() * 2);
+		}
+
+		if (incrementalSort)
+		{
+			uintMem movedCapacity = (uintMem)(std::clamp(incrementalSortMaxMovedFraction, 0.0f, 1.0f) * dynamicParticles.Count());
+			particleSortMovedKeys.Resize(std::max<uintMem>(movedCapacity, 1) * 2);
+			particleSortMovedIndices.Resize(std::max<uintMem>(movedCapacity, 1) * 2);
+			particleSortMovedCounts.Resize(threadManager.ThreadCount());
+			particleSortFirstUnmoved.Resize(threadManager.ThreadCount());
+		}
+
+		if (halfNeighbourhood)
+		{
+			pairInteractionSums.Resize(dynamicParticles.Count() * Details::PairInteractionSums::ValuesPerParticle);
+			pairContributionIndices.Resize(threadManager.ThreadCount());
+			pairContributionValues.Resize(threadManager.ThreadCount());
+			groupedPairContributionIndices.Resize(threadManager.ThreadCount());
+			groupedPairContributionValues.Resize(threadManager.ThreadCount());
+			pairContributionOffsets.Resize(threadManager.ThreadCount() * (threadManager.ThreadCount() + 1));
+		}
 
-		dynamicParticlesBufferManager.Allocate(sizeof(DynamicParticle), dynamicParticles.Count(), dynamicParticles.Ptr(), 3);
+		if (verletLists)
+		{
+			verletListStorage.Resize(threadManager.ThreadCount());
+			verletListRanges.Resize(dynamicParticles.Count() * 3);
+			verletListReferencePositions.Resize(dynamicParticles.Count() * 3);
+		}
+
+		//The particles are copied by the threads
+		if (pageSize != PageSize::Default)
+			dynamicParticlesBufferManager.SetPreferredPageSize(pageSize);
+		dynamicParticlesBufferManager.Allocate(sizeof(DynamicParticle), dynamicParticles.Count(), nullptr, 3, dynamicParticlesLayout);
+
+		threadManager.EnqueueTask(FirstTouchDynamicParticles, FirstTouchDynamicParticlesTask{
+				.particleBufferManager = dynamicParticlesBufferManager,
+				.particles = std::move(dynamicParticles),
+				.hashMap = dynamicParticlesHashMap,
+				.particleMap = particleMap.Ptr(),
+				.hashHistograms = hashHistograms,
+				.bufferLockGuard = ResourceLockGuard(),
+				.buffer = nullptr
+			});
 
 		threadManager.EnqueueTask(CalculateHashAndParticleMap, CalculateHashAndParticleMapTask {
 				.particleBufferManager = dynamicParticlesBufferManager,
@@ -496,10 +2598,19 @@ namespace SPH
 				.particleSize = sizeof(DynamicParticle),
 				.hashMap = dynamicParticlesHashMap,
 				.particleMap = particleMap.Ptr(),
+				.prefixSumBlockSums = prefixSumBlockSums.Ptr(),
+				.particleSortKeys = particleSortKeys.Empty() ? nullptr : particleSortKeys.Ptr(),
+				.particleSortIndices = particleSortIndices.Empty() ? nullptr : particleSortIndices.Ptr(),
+				.particleSortDigitCounts = particleSortDigitCounts.Empty() ? nullptr : particleSortDigitCounts.Ptr(),
+				.particleSortBuckets = particleSortBuckets.Empty() ? nullptr : particleSortBuckets.Ptr(),
 				.initialParticlesLockGuard = ResourceLockGuard(),
 				.initialParticles = nullptr,
+				.initialParticleStreams = { },
 				.finalParticlesLockGuard = ResourceLockGuard(),
 				.finalParticles = nullptr,
+				.finalParticleStreams = { },
+				.checkIntegrity = integrityCheckInterval != 0,
+				.integrityErrorCount = integrityErrorCount
 			});
 	}
 }
\ No newline at end of file
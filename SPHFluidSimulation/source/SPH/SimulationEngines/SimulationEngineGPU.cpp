@@ -3,10 +3,12 @@
 #include "SPH/Core/ParticleBufferManager.h"
 #include "SPH/SimulationEngines/SimulationEngineGPU.h"
 #include "SPH/OpenCL/OpenCLDebug.h"
-#include "SPH/OpenCL/PerformanceProfile.h"
 #include "SPH/OpenCL/EventWaitArray.h"
+#include <bit>
 
-#define DEBUG_BUFFERS_GPU
+//Measures the execution time of the kernels, see SimulationEngineGPU::GetStatistics. Reading the measurements waits for
+//every update to finish, so it's off by default
+//#define PROFILE_PHASES_GPU
 
 namespace SPH
 {
@@ -16,9 +18,8 @@ namespace SPH
 		Vec4f p2;
 		Vec4f p3;
 	};
-	static Array<OpenCLTriangle> GetOpenCLTriangles(const Graphics::BasicIndexedMesh& mesh)
+	static Array<OpenCLTriangle> GetOpenCLTriangles(ArrayView<Graphics::BasicIndexedMesh::Triangle> tris)
 	{
-		auto tris = mesh.CreateTriangleArray();
 		Array<OpenCLTriangle> out{ tris.Count() };
 		for (uintMem i = 0; i < tris.Count(); ++i)
 		{
@@ -112,23 +113,76 @@ namespace SPH
 			clReleaseMemObject(particleBehaviourParametersBuffer);
 			particleBehaviourParametersBuffer = nullptr;
 		}
+		if (occupiedBucketsBuffer != nullptr)
+		{
+			clReleaseMemObject(occupiedBucketsBuffer);
+			occupiedBucketsBuffer = nullptr;
+		}
+		if (occupiedBucketCountBuffer != nullptr)
+		{
+			clReleaseMemObject(occupiedBucketCountBuffer);
+			occupiedBucketCountBuffer = nullptr;
+		}
+		for (cl_mem& buffer : sortKeysBuffers)
+			if (buffer != nullptr)
+			{
+				clReleaseMemObject(buffer);
+				buffer = nullptr;
+			}
+		if (sortValuesBuffer != nullptr)
+		{
+			clReleaseMemObject(sortValuesBuffer);
+			sortValuesBuffer = nullptr;
+		}
 		if (triangles != nullptr)
 		{
 			clReleaseMemObject(triangles);
 			triangles = nullptr;
 		}
+		if (triangleHashMap != nullptr)
+		{
+			clReleaseMemObject(triangleHashMap);
+			triangleHashMap = nullptr;
+		}
+		if (triangleMap != nullptr)
+		{
+			clReleaseMemObject(triangleMap);
+			triangleMap = nullptr;
+		}
+
+		localMemoryTiling = false;
+		radixSort = false;
+		sortKeyBitCount = 0;
 
+		triangleCount = 0;
+		triangleHashMapSize = 0;
 
 		dynamicParticlesHashMapSize = 0;
 		staticParticlesHashMapSize = 0;
 
+		upDownSweepScan = false;
+		staticParticlesHashMapGroupSize = 0;
 		dynamicParticlesHashMapGroupSize = 0;
 
 		reorderElapsedTime = 0.0f;
 		reorderTimeInterval = FLT_MAX;
+		adaptiveReorder = false;
+		adaptiveReorderCost = 0.5f;
+		adaptiveReorderMeasureInterval = 8;
+		adaptiveReorderUnmeasuredStepCount = 0;
+		reorderAccumulatedScatter = 0;
+		reorderStatistics = { };
+		reorderParticleMapArray.Clear();
 
 		simulationTime = 0;
 
+		statistics = { };
+
+		integrityCheckInterval = 0;
+		simulatedStepCount = 0;
+		integrityCheckedStepCount = 0;
+		integrityErrorCount = 0;
+
 		initialized = false;
 	}
 	void SimulationEngineGPU::Initialize(SceneBlueprint& scene, ParticleBufferManager& dynamicParticlesBufferManager, ParticleBufferManager& staticParticlesBufferManager)
@@ -140,6 +194,14 @@ namespace SPH
 
 		auto parameters = scene.GetSystemParameters();
 		parameters.ParseParameter("reorderTimeInterval", reorderTimeInterval);
+		parameters.ParseParameter("adaptiveReorder", adaptiveReorder);
+		parameters.ParseParameter("adaptiveReorderCost", adaptiveReorderCost);
+		parameters.ParseParameter("adaptiveReorderMeasureInterval", adaptiveReorderMeasureInterval);
+		adaptiveReorderMeasureInterval = std::max<uint64>(adaptiveReorderMeasureInterval, 1);
+		parameters.ParseParameter("integrityCheckInterval", integrityCheckInterval);
+		parameters.ParseParameter("upDownSweepScan", upDownSweepScan);
+		parameters.ParseParameter("localMemoryTiling", localMemoryTiling);
+		parameters.ParseParameter("radixSort", radixSort);
 
 		particleBehaviourParameters = parameters.particleBehaviourParameters;
 		particleBehaviourParameters.smoothingKernelConstant = SmoothingKernelConstant(particleBehaviourParameters.maxInteractionDistance);
@@ -149,14 +211,33 @@ namespace SPH
 		InitializeStaticParticles(scene, staticParticlesBufferManager);
 		InitializeDynamicParticles(scene, dynamicParticlesBufferManager);
 
-		const auto& mesh = scene.GetMesh();
-		auto _triangles = GetOpenCLTriangles(mesh);
+		auto meshTriangles = scene.GetMesh().CreateTriangleArray();
+		auto _triangles = GetOpenCLTriangles(meshTriangles);
 		if (_triangles.Empty())
 			triangles = NULL;
 		else
+		{
+			Array<uint32> _triangleHashMap;
+			Array<uint32> _triangleMap;
+			GenerateTriangleHashMap(meshTriangles, _triangleHashMap, _triangleMap);
+
 			CL_CHECK_RET(triangles = clCreateBuffer(clContext, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(OpenCLTriangle) * _triangles.Count(), _triangles.Ptr(), &ret));
+			CL_CHECK_RET(triangleHashMap = clCreateBuffer(clContext, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(uint32) * _triangleHashMap.Count(), _triangleHashMap.Ptr(), &ret));
+			CL_CHECK_RET(triangleMap = clCreateBuffer(clContext, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(uint32) * _triangleMap.Count(), _triangleMap.Ptr(), &ret));
+
+			triangleHashMapSize = _triangleHashMap.Count() - 1;
+		}
 
 		triangleCount = _triangles.Count();
+
+		if (adaptiveReorder)
+			reorderParticleMapArray.Resize(dynamicParticlesBufferManager.GetParticleCount());
+
+#ifdef PROFILE_PHASES_GPU
+		phaseEvents.Resize(PhaseEventCapacity);
+		phaseEventCount = 0;
+#endif
+
 		initialized = true;
 	}
 	void SimulationEngineGPU::Update(float deltaTime, uint simulationStepCount)
@@ -170,8 +251,6 @@ namespace SPH
 		if (dynamicParticlesBufferManager->GetParticleCount() == 0)
 			return;
 
-		Array<PerformanceProfile<20>> performanceProfiles{ simulationStepCount };
-
 		cl::Event staticParticlesReadStartEvent;
 		auto staticParticlesLockGuard = staticParticlesBufferManager->LockRead(&staticParticlesReadStartEvent());
 		auto staticParticles = (cl_mem)staticParticlesLockGuard.GetResource();
@@ -190,65 +269,80 @@ namespace SPH
 			auto outputParticlesLockGuard = dynamicParticlesBufferManager->LockWrite(&writeLockAcquiredEvent);
 			cl_mem outputParticles = (cl_mem)outputParticlesLockGuard.GetResource();
 
-
-#ifdef DEBUG_BUFFERS_GPU
-			DebugDynamicParticles(clCommandQueue, debugParticlesArray, inputParticles, dynamicParticlesHashMapSize, particleBehaviourParameters.maxInteractionDistance);
-#endif
+			bool checkIntegrity = integrityCheckInterval != 0 && (simulatedStepCount + i + 1) % integrityCheckInterval == 0;
 
 			cl::Event updatePressureFinishedEvent;
-			kernels.EnqueueUpdateParticlesPressureKernel(clCommandQueue, dynamicParticlesHashMap, dynamicParticlesHashMapSize, staticParticlesHashMap, staticParticlesHashMapSize, particleMapBuffer, inputParticles, outputParticles, staticParticles, dynamicParticlesBufferManager->GetParticleCount(), staticParticlesBufferManager->GetParticleCount(), particleBehaviourParametersBuffer, EventWaitArray<3>{ readLockAcquiredEvent, writeLockAcquiredEvent, staticParticlesReadStartEvent  }, & updatePressureFinishedEvent());
+			if (localMemoryTiling)
+			{
+				cl::Event clearOccupiedBucketCountFinishedEvent;
+				uint32 zeroPattern = 0;
+				CL_CALL(clEnqueueFillBuffer(clCommandQueue, occupiedBucketCountBuffer, &zeroPattern, sizeof(zeroPattern), 0, sizeof(zeroPattern), 0, nullptr, &clearOccupiedBucketCountFinishedEvent()));
+
+				cl::Event listOccupiedBucketsFinishedEvent;
+				kernels.EnqueueListOccupiedBucketsKernel(clCommandQueue, occupiedBucketsBuffer, occupiedBucketCountBuffer, dynamicParticlesHashMap, particleMapBuffer, inputParticles, dynamicParticlesBufferManager->GetParticleCount(), EventWaitArray<2>{ readLockAcquiredEvent, clearOccupiedBucketCountFinishedEvent }, &listOccupiedBucketsFinishedEvent());
+
+				AddPhaseEvent("occupiedBuckets", listOccupiedBucketsFinishedEvent());
+
+				kernels.EnqueueUpdateParticlesPressureTiledKernel(clCommandQueue, dynamicParticlesHashMap, dynamicParticlesHashMapSize, staticParticlesHashMap, staticParticlesHashMapSize, particleMapBuffer, inputParticles, outputParticles, staticParticles, dynamicParticlesBufferManager->GetParticleCount(), staticParticlesBufferManager->GetParticleCount(), particleBehaviourParametersBuffer, occupiedBucketsBuffer, occupiedBucketCountBuffer, EventWaitArray<3>{ listOccupiedBucketsFinishedEvent, writeLockAcquiredEvent, staticParticlesReadStartEvent }, &updatePressureFinishedEvent());
+			}
+			else
+				kernels.EnqueueUpdateParticlesPressureKernel(clCommandQueue, dynamicParticlesHashMap, dynamicParticlesHashMapSize, staticParticlesHashMap, staticParticlesHashMapSize, particleMapBuffer, inputParticles, outputParticles, staticParticles, dynamicParticlesBufferManager->GetParticleCount(), staticParticlesBufferManager->GetParticleCount(), particleBehaviourParametersBuffer, EventWaitArray<3>{ readLockAcquiredEvent, writeLockAcquiredEvent, staticParticlesReadStartEvent  }, & updatePressureFinishedEvent());
 			staticParticlesReadStartEvent = cl::Event();
 			readLockAcquiredEvent = cl::Event();
 			writeLockAcquiredEvent = cl::Event();
 
-			performanceProfiles[i].AddPendingMeasurement("Update particle pressure kernel", updatePressureFinishedEvent());
+			AddPhaseEvent("pressure", updatePressureFinishedEvent());
 
 			cl::Event updateDynamicsFinishedEvent;
-			kernels.EnqueueUpdateParticlesDynamicsKernel(clCommandQueue, dynamicParticlesHashMap, dynamicParticlesHashMapSize, staticParticlesHashMap, staticParticlesHashMapSize, particleMapBuffer, inputParticles, outputParticles, staticParticles, dynamicParticlesBufferManager->GetParticleCount(), staticParticlesBufferManager->GetParticleCount(), particleBehaviourParametersBuffer, deltaTime, triangleCount, triangles, { &updatePressureFinishedEvent(), 1 }, &updateDynamicsFinishedEvent());
+			if (localMemoryTiling)
+				kernels.EnqueueUpdateParticlesDynamicsTiledKernel(clCommandQueue, dynamicParticlesHashMap, dynamicParticlesHashMapSize, staticParticlesHashMap, staticParticlesHashMapSize, particleMapBuffer, inputParticles, outputParticles, staticParticles, dynamicParticlesBufferManager->GetParticleCount(), staticParticlesBufferManager->GetParticleCount(), particleBehaviourParametersBuffer, deltaTime, triangleCount, triangles, triangleHashMapSize, triangleHashMap, triangleMap, occupiedBucketsBuffer, occupiedBucketCountBuffer, { &updatePressureFinishedEvent(), 1 }, &updateDynamicsFinishedEvent());
+			else
+				kernels.EnqueueUpdateParticlesDynamicsKernel(clCommandQueue, dynamicParticlesHashMap, dynamicParticlesHashMapSize, staticParticlesHashMap, staticParticlesHashMapSize, particleMapBuffer, inputParticles, outputParticles, staticParticles, dynamicParticlesBufferManager->GetParticleCount(), staticParticlesBufferManager->GetParticleCount(), particleBehaviourParametersBuffer, deltaTime, triangleCount, triangles, triangleHashMapSize, triangleHashMap, triangleMap, { &updatePressureFinishedEvent(), 1 }, &updateDynamicsFinishedEvent());
 			updatePressureFinishedEvent = cl::Event();
 
-			performanceProfiles[i].AddPendingMeasurement("Update particle dynamics kernel", updateDynamicsFinishedEvent());
+			AddPhaseEvent("dynamics", updateDynamicsFinishedEvent());
 
 			inputParticlesLockGuard.Unlock({ (void**)&updateDynamicsFinishedEvent(), 1 });
 
-#ifdef DEBUG_BUFFERS_GPU
-			DebugDynamicParticles(clCommandQueue, debugParticlesArray, outputParticles, dynamicParticlesHashMapSize, particleBehaviourParameters.maxInteractionDistance);
-#endif
-
-			cl::Event clearHashMapFinishedEvent;
-			uint32 zeroPattern = 0;
-			CL_CALL(clEnqueueFillBuffer(clCommandQueue, dynamicParticlesHashMap, &zeroPattern, sizeof(zeroPattern), 0, dynamicParticlesHashMapSize * sizeof(zeroPattern), 1, &updateDynamicsFinishedEvent(), &clearHashMapFinishedEvent()));
-			updateDynamicsFinishedEvent = cl::Event();
+			//The dynamics kernel already stored the new hashes, the sort writes the whole hash map from them
+			cl::Event partialSumFinishedEvent;
+			if (radixSort)
+				partialSumFinishedEvent = std::move(updateDynamicsFinishedEvent);
+			else
+			{
+				cl::Event clearHashMapFinishedEvent;
+				uint32 zeroPattern = 0;
+				CL_CALL(clEnqueueFillBuffer(clCommandQueue, dynamicParticlesHashMap, &zeroPattern, sizeof(zeroPattern), 0, dynamicParticlesHashMapSize * sizeof(zeroPattern), 1, &updateDynamicsFinishedEvent(), &clearHashMapFinishedEvent()));
+				updateDynamicsFinishedEvent = cl::Event();
 
-			performanceProfiles[i].AddPendingMeasurement("Clear hash map", clearHashMapFinishedEvent());
+				AddPhaseEvent("clearHashMap", clearHashMapFinishedEvent());
 
-			cl::Event incrementHashMapEventFinished;
-			kernels.EnqueueComputeDynamicParticlesHashAndPrepareHashMapKernel(clCommandQueue, dynamicParticlesHashMap, dynamicParticlesHashMapSize, outputParticles, dynamicParticlesBufferManager->GetParticleCount(), particleBehaviourParameters.maxInteractionDistance, { &clearHashMapFinishedEvent(), 1 }, &incrementHashMapEventFinished());
-			clearHashMapFinishedEvent = cl::Event();
+				cl::Event incrementHashMapEventFinished;
+				kernels.EnqueueComputeDynamicParticlesHashAndPrepareHashMapKernel(clCommandQueue, dynamicParticlesHashMap, dynamicParticlesHashMapSize, outputParticles, dynamicParticlesBufferManager->GetParticleCount(), particleBehaviourParameters.maxInteractionDistance, { &clearHashMapFinishedEvent(), 1 }, &incrementHashMapEventFinished());
+				clearHashMapFinishedEvent = cl::Event();
 
-			performanceProfiles[i].AddPendingMeasurement("Increment hash map kernel", incrementHashMapEventFinished());
+				AddPhaseEvent("countHashes", incrementHashMapEventFinished());
 
-#ifdef DEBUG_BUFFERS_GPU
-			CL_CALL(clFinish(clCommandQueue));
-			CL_CALL(clEnqueueReadBuffer(clCommandQueue, dynamicParticlesHashMap, CL_TRUE, 0, sizeof(uint32) * debugHashMapArray.Count(), debugHashMapArray.Ptr(), 0, nullptr, nullptr));
+				EnqueueHashMapScan(dynamicParticlesHashMap, dynamicParticlesHashMapSize, dynamicParticlesHashMapGroupSize, { &incrementHashMapEventFinished(), 1 }, &partialSumFinishedEvent());
+				incrementHashMapEventFinished = cl::Event();
 
-			DebugDynamicParticles(clCommandQueue, debugParticlesArray, outputParticles, dynamicParticlesHashMapSize, particleBehaviourParameters.maxInteractionDistance);
-#endif
+				AddPhaseEvent("prefixSum", partialSumFinishedEvent());
+			}
 
-			cl::Event partialSumFinishedEvent;
-			kernels.EnqueueInclusiveScanKernels(clCommandQueue, dynamicParticlesHashMap, dynamicParticlesHashMapSize, dynamicParticlesHashMapGroupSize, { &incrementHashMapEventFinished(), 1 }, &partialSumFinishedEvent());
-			incrementHashMapEventFinished = cl::Event();
+			bool reorderParticles;
+			if (adaptiveReorder)
+				reorderParticles = reorderAccumulatedScatter >= adaptiveReorderCost;
+			else
+			{
+				reorderParticles = reorderElapsedTime > reorderTimeInterval;
+				if (reorderParticles)
+					reorderElapsedTime -= reorderTimeInterval;
+			}
 
-#ifdef DEBUG_BUFFERS_GPU
-			CL_CALL(clFinish(clCommandQueue));
-			CL_CALL(clEnqueueReadBuffer(clCommandQueue, dynamicParticlesHashMap, CL_TRUE, 0, sizeof(uint32) * debugHashMapArray.Count(), debugHashMapArray.Ptr(), 0, nullptr, nullptr));
-#endif
-			
+			cl::Event sortFinishedEvent;
 			cl::Event computeParticleMapFinishedEvent;
-			if (reorderElapsedTime > reorderTimeInterval)
+			if (reorderParticles)
 			{
-				reorderElapsedTime -= reorderTimeInterval;
-
 				dynamicParticlesBufferManager->Advance();
 
 				cl::Event startIntermediateEvent;
@@ -256,7 +350,10 @@ namespace SPH
 				auto intermediateParticles = (cl_mem)intermediateParticlesLockGuard.GetResource();
 
 				EventWaitArray<2> computeParticleMapWaitEvents{ startIntermediateEvent, partialSumFinishedEvent };
-				kernels.EnqueueReorderDynamicParticlesAndFinishHashMapKernel(clCommandQueue, particleMapBuffer, dynamicParticlesHashMap, outputParticles, intermediateParticles, dynamicParticlesBufferManager->GetParticleCount(), computeParticleMapWaitEvents, &computeParticleMapFinishedEvent());
+				if (radixSort)
+					EnqueueSortDynamicParticles(outputParticles, intermediateParticles, dynamicParticlesBufferManager->GetParticleCount(), computeParticleMapWaitEvents, &sortFinishedEvent(), &computeParticleMapFinishedEvent());
+				else
+					kernels.EnqueueReorderDynamicParticlesAndFinishHashMapKernel(clCommandQueue, particleMapBuffer, dynamicParticlesHashMap, outputParticles, intermediateParticles, dynamicParticlesBufferManager->GetParticleCount(), computeParticleMapWaitEvents, &computeParticleMapFinishedEvent());
 				computeParticleMapWaitEvents.Release();
 
 				outputParticlesLockGuard.Unlock({ (void**)&computeParticleMapFinishedEvent(), 1 });
@@ -264,17 +361,30 @@ namespace SPH
 				std::swap(intermediateParticles, outputParticles);
 				std::swap(intermediateParticlesLockGuard, outputParticlesLockGuard);
 			}
+			else if (radixSort)
+				EnqueueSortDynamicParticles(outputParticles, nullptr, dynamicParticlesBufferManager->GetParticleCount(), { &partialSumFinishedEvent(), 1 }, &sortFinishedEvent(), &computeParticleMapFinishedEvent());
 			else
 			{
 				kernels.EnqueueFillDynamicParticleMapAndFinishHashMapKernel(clCommandQueue, particleMapBuffer, dynamicParticlesHashMap, outputParticles, dynamicParticlesBufferManager->GetParticleCount(), { &partialSumFinishedEvent(), 1 }, &computeParticleMapFinishedEvent());
 			}
 			partialSumFinishedEvent = cl::Event();
 
-			performanceProfiles[i].AddPendingMeasurement("Compute particle map kernel", computeParticleMapFinishedEvent());
+			if (radixSort)
+				AddPhaseEvent("sort", sortFinishedEvent());
+			sortFinishedEvent = cl::Event();
+
+			AddPhaseEvent("particleMap", computeParticleMapFinishedEvent());
+
+			AccumulateReorderScatter(reorderParticles, computeParticleMapFinishedEvent());
+
+			//The output buffers are read back once, after the step is finished, and checked on the host
+			if (checkIntegrity)
+			{
+				integrityErrorCount += DebugDynamicParticleHashAndParticleMap(clCommandQueue, debugParticlesArray, debugHashMapArray, debugParticleMapArray, outputParticles, dynamicParticlesHashMap, particleMapBuffer);
+				integrityErrorCount += SimulationEngine::DebugParticles<DynamicParticle>(debugParticlesArray, particleBehaviourParameters.maxInteractionDistance, dynamicParticlesHashMapSize);
+				++integrityCheckedStepCount;
+			}
 
-#ifdef DEBUG_BUFFERS_GPU
-			DebugDynamicParticleHashAndParticleMap(clCommandQueue, debugParticlesArray, debugHashMapArray, debugParticleMapArray, outputParticles, dynamicParticlesHashMap, particleMapBuffer);
-#endif
 			outputParticlesLockGuard.Unlock({ (void**)&computeParticleMapFinishedEvent(), 1 });
 
 			reorderElapsedTime += deltaTime;
@@ -289,7 +399,145 @@ namespace SPH
 		staticParticlesLockGuard.Unlock({ (void**)&updateEndEvent, 1 });
 		updateEndEvent = cl::Event();
 
+#ifdef PROFILE_PHASES_GPU
+		ReadPhaseEvents();
+
+		statistics.stepCount += simulationStepCount;
+#endif
+
 		simulationTime += deltaTime * simulationStepCount;		
+		simulatedStepCount += simulationStepCount;
+	}
+	void SimulationEngineGPU::FinishUpdates()
+	{
+		CL_CALL(clFinish(clCommandQueue));
+	}
+	SimulationStatistics SimulationEngineGPU::GetStatistics()
+	{
+		return statistics;
+	}
+	void SimulationEngineGPU::ResetStatistics()
+	{
+		statistics = { };
+	}
+	void SimulationEngineGPU::AccumulateReorderScatter(bool reorderParticles, cl_event particleMapFinishedEvent)
+	{
+		++reorderStatistics.stepCount;
+
+		if (reorderParticles)
+		{
+			++reorderStatistics.reorderCount;
+			reorderStatistics.lastScatteredFraction = 0;
+			reorderAccumulatedScatter = 0;
+			adaptiveReorderUnmeasuredStepCount = 0;
+			return;
+		}
+
+		if (!adaptiveReorder)
+			return;
+
+		if (++adaptiveReorderUnmeasuredStepCount >= adaptiveReorderMeasureInterval)
+		{
+			adaptiveReorderUnmeasuredStepCount = 0;
+
+			CL_CALL(clEnqueueReadBuffer(clCommandQueue, particleMapBuffer, CL_TRUE, 0, sizeof(uint32) * reorderParticleMapArray.Count(), reorderParticleMapArray.Ptr(), 1, &particleMapFinishedEvent, nullptr));
+
+			uint64 scatteredCount = SimulationEngine::CountScatteredParticleMapEntries(reorderParticleMapArray.Ptr(), 0, reorderParticleMapArray.Count());
+			reorderStatistics.lastScatteredFraction = (double)scatteredCount / (double)reorderParticleMapArray.Count();
+			reorderStatistics.maxScatteredFraction = std::max(reorderStatistics.maxScatteredFraction, reorderStatistics.lastScatteredFraction);
+			++reorderStatistics.measuredStepCount;
+		}
+
+		reorderAccumulatedScatter += reorderStatistics.lastScatteredFraction;
+	}
+	IntegrityCheckStatistics SimulationEngineGPU::GetIntegrityCheckStatistics() const
+	{
+		return { integrityCheckedStepCount, integrityErrorCount };
+	}
+	void SimulationEngineGPU::DetermineHashMapSize(uintMem targetHashMapSize, uintMem& hashMapSize, uintMem& hashMapGroupSize) const
+	{
+		hashMapSize = targetHashMapSize;
+		hashMapGroupSize = 0;
+
+		if (upDownSweepScan)
+			kernels.DetermineHashGroupSize(targetHashMapSize, hashMapGroupSize, hashMapSize);
+	}
+	void SimulationEngineGPU::EnqueueHashMapScan(cl_mem hashMap, uintMem hashMapSize, uintMem hashMapGroupSize, ArrayView<cl_event> waitEvents, cl_event* finishedEvent) const
+	{
+		if (upDownSweepScan)
+			kernels.EnqueueInclusiveScanKernels(clCommandQueue, hashMap, hashMapSize, hashMapGroupSize, waitEvents, finishedEvent);
+		else
+			kernels.EnqueueReduceThenScanKernels(clCommandQueue, hashMap, hashMapSize, waitEvents, finishedEvent);
+	}
+	void SimulationEngineGPU::EnqueueSortDynamicParticles(cl_mem particles, cl_mem sortedParticles, uintMem particleCount, ArrayView<cl_event> waitEvents, cl_event* sortFinishedEvent, cl_event* finishedEvent) const
+	{
+		//The values start in the buffer that makes the last pass write them into the particle map
+		cl_mem sortValuesBuffers[2] = { sortValuesBuffer, particleMapBuffer };
+		if (SimulationEngineGPUKernels::GetRadixSortPassCount(sortKeyBitCount) % 2 == 0)
+			std::swap(sortValuesBuffers[0], sortValuesBuffers[1]);
+
+		cl::Event prepareSortFinishedEvent;
+		kernels.EnqueuePrepareDynamicParticlesSortKernel(clCommandQueue, particles, sortKeysBuffers[0], sortValuesBuffers[0], particleCount, waitEvents, &prepareSortFinishedEvent());
+
+		uintMem sortedBufferIndex = kernels.EnqueueRadixSortKernels(clCommandQueue, sortKeysBuffers, sortValuesBuffers, particleCount, sortKeyBitCount, { &prepareSortFinishedEvent(), 1 }, sortFinishedEvent);
+
+		if (sortedParticles == nullptr)
+		{
+			kernels.EnqueueFinishSortedHashMapKernel(clCommandQueue, dynamicParticlesHashMap, dynamicParticlesHashMapSize, sortKeysBuffers[sortedBufferIndex], particleCount, { sortFinishedEvent, 1 }, finishedEvent);
+			return;
+		}
+
+		cl::Event finishHashMapFinishedEvent;
+		kernels.EnqueueFinishSortedHashMapKernel(clCommandQueue, dynamicParticlesHashMap, dynamicParticlesHashMapSize, sortKeysBuffers[sortedBufferIndex], particleCount, { sortFinishedEvent, 1 }, &finishHashMapFinishedEvent());
+
+		kernels.EnqueueGatherSortedDynamicParticlesKernel(clCommandQueue, particleMapBuffer, particles, sortedParticles, particleCount, { &finishHashMapFinishedEvent(), 1 }, finishedEvent);
+	}
+	void SimulationEngineGPU::AddPhaseEvent(StringView phase, cl_event event)
+	{
+#ifdef PROFILE_PHASES_GPU
+		//The events are read early instead of growing the array, which would allocate inside of an update
+		if (phaseEventCount == phaseEvents.Count())
+			ReadPhaseEvents();
+
+		CL_CALL(clRetainEvent(event));
+		phaseEvents[phaseEventCount++] = { phase, event };
+#endif
+	}
+	void SimulationEngineGPU::ReadPhaseEvents()
+	{
+		for (uintMem i = 0; i < phaseEventCount; ++i)
+		{
+			uint64 startTime = 0;
+			uint64 endTime = 0;
+
+			CL_CALL(clWaitForEvents(1, &phaseEvents[i].event));
+			CL_CALL(clGetEventProfilingInfo(phaseEvents[i].event, CL_PROFILING_COMMAND_START, sizeof(uint64), &startTime, nullptr));
+			CL_CALL(clGetEventProfilingInfo(phaseEvents[i].event, CL_PROFILING_COMMAND_END, sizeof(uint64), &endTime, nullptr));
+			CL_CALL(clReleaseEvent(phaseEvents[i].event));
+
+			AddPhaseTime(phaseEvents[i].phase, (endTime - startTime) * 1e-9);
+		}
+		phaseEventCount = 0;
+	}
+	void SimulationEngineGPU::AddPhaseTime(StringView name, double seconds)
+	{
+		PhaseStatistics* phase = nullptr;
+		for (auto& existingPhase : statistics.phases)
+			if (existingPhase.name == name)
+				phase = &existingPhase;
+
+		if (phase == nullptr)
+		{
+			phase = &*statistics.phases.AddBack();
+			phase->name = name;
+			phase->threadSeconds.Resize(1);
+			phase->threadSeconds[0] = 0;
+			phase->threadWaitSeconds.Resize(1);
+			phase->threadWaitSeconds[0] = 0;
+		}
+
+		++phase->callCount;
+		phase->threadSeconds[0] += seconds;
 	}
 	void SimulationEngineGPU::InitializeStaticParticles(SceneBlueprint& scene, ParticleBufferManager& staticParticlesBufferManager)
 	{
@@ -306,16 +554,16 @@ namespace SPH
 
 		staticParticlesCount = staticParticles.Count();
 
-		staticParticlesHashMapSize = staticParticlesCount;
-		kernels.DetermineHashGroupSize(staticParticlesHashMapSize, staticParticlesHashMapGroupSize, staticParticlesHashMapSize);
+		DetermineHashMapSize(staticParticlesCount, staticParticlesHashMapSize, staticParticlesHashMapGroupSize);
 
-#ifdef DEBUG_BUFFERS_GPU
-		debugStaticParticlesArray.Resize(staticParticlesCount);
-		debugStaticHashMapArray.Resize(staticParticlesHashMapSize + 1);
-#endif
+		if (integrityCheckInterval != 0)
+		{
+			debugStaticParticlesArray.Resize(staticParticlesCount);
+			debugStaticHashMapArray.Resize(staticParticlesHashMapSize + 1);
+		}
 
 		CL_CHECK_RET(staticParticlesHashMap = clCreateBuffer(clContext, CL_MEM_READ_WRITE, sizeof(uint32) * (staticParticlesHashMapSize + 1), nullptr, &ret))
-		staticParticlesBufferManager.Allocate(sizeof(StaticParticle), staticParticlesCount, nullptr, 1);
+		staticParticlesBufferManager.Allocate(sizeof(StaticParticle), staticParticlesCount, nullptr, 1, ParticleBufferLayout::ArrayOfStructs);
 
 		uint32 pattern0 = 0;
 		uint32 patternCount = staticParticlesCount;
@@ -334,7 +582,7 @@ namespace SPH
 
 		cl::Event scanFinishedEvent;
 		EventWaitArray<1> scanWaitEvents{ prepareHashMapFinishedEvent };
-		kernels.EnqueueInclusiveScanKernels(clCommandQueue, staticParticlesHashMap, staticParticlesHashMapSize, staticParticlesHashMapGroupSize, scanWaitEvents, &scanFinishedEvent());
+		EnqueueHashMapScan(staticParticlesHashMap, staticParticlesHashMapSize, staticParticlesHashMapGroupSize, scanWaitEvents, &scanFinishedEvent());
 
 		cl::Event lockAcquiredEvent;
 		ResourceLockGuard finalStaticParticlesLockGuard = staticParticlesBufferManager.LockWrite(&lockAcquiredEvent());
@@ -344,10 +592,11 @@ namespace SPH
 		EventWaitArray<2> reorderWaitEvents{ lockAcquiredEvent, scanFinishedEvent };
 		kernels.EnqueueReorderStaticParticlesAndFinishHashMapKernel(clCommandQueue, staticParticlesHashMap, staticParticlesHashMapSize, tempStaticParticles(), finalStaticParticles, staticParticlesCount, particleBehaviourParameters.maxInteractionDistance, reorderWaitEvents, &reorderFinishedEvent());
 
-#ifdef DEBUG_BUFFERS_GPU
-		DebugStaticParticles(clCommandQueue, debugStaticParticlesArray, finalStaticParticles, staticParticlesHashMapSize, particleBehaviourParameters.maxInteractionDistance);
-		DebugStaticParticleHashAndParticleMap(clCommandQueue, debugStaticParticlesArray, debugStaticHashMapArray, finalStaticParticles, staticParticlesHashMap, particleBehaviourParameters.maxInteractionDistance);
-#endif
+		if (integrityCheckInterval != 0)
+		{
+			integrityErrorCount += DebugStaticParticleHashAndParticleMap(clCommandQueue, debugStaticParticlesArray, debugStaticHashMapArray, finalStaticParticles, staticParticlesHashMap, particleBehaviourParameters.maxInteractionDistance);
+			integrityErrorCount += SimulationEngine::DebugParticles<StaticParticle>(debugStaticParticlesArray, particleBehaviourParameters.maxInteractionDistance, staticParticlesHashMapSize);
+		}
 		finalStaticParticlesLockGuard.Unlock({ reorderFinishedEvent() });
 
 		//We have to wait so that 'staticParticles' memory doesn't get freed
@@ -364,16 +613,31 @@ namespace SPH
 			if (dynamicParticles.Empty())
 				return;
 
-			dynamicParticlesBufferManager.Allocate(sizeof(DynamicParticle), dynamicParticles.Count(), dynamicParticles.Ptr(), 3);
+			dynamicParticlesBufferManager.Allocate(sizeof(DynamicParticle), dynamicParticles.Count(), dynamicParticles.Ptr(), 3, ParticleBufferLayout::ArrayOfStructs);
 			dynamicParticlesCount = dynamicParticles.Count();
 		}
 
-		dynamicParticlesHashMapSize = dynamicParticlesCount * 2;
-		kernels.DetermineHashGroupSize(dynamicParticlesHashMapSize, dynamicParticlesHashMapGroupSize, dynamicParticlesHashMapSize);
+		DetermineHashMapSize(dynamicParticlesCount * 2, dynamicParticlesHashMapSize, dynamicParticlesHashMapGroupSize);
 
 		CL_CHECK_RET(dynamicParticlesHashMap = clCreateBuffer(clContext, CL_MEM_READ_WRITE, sizeof(uint32) * (dynamicParticlesHashMapSize + 1), nullptr, &ret));
 		CL_CHECK_RET(particleMapBuffer = clCreateBuffer(clContext, CL_MEM_READ_WRITE, sizeof(uint32) * dynamicParticlesCount, nullptr, &ret));
 
+		if (localMemoryTiling)
+		{
+			CL_CHECK_RET(occupiedBucketsBuffer = clCreateBuffer(clContext, CL_MEM_READ_WRITE, sizeof(uint32) * dynamicParticlesCount, nullptr, &ret));
+			CL_CHECK_RET(occupiedBucketCountBuffer = clCreateBuffer(clContext, CL_MEM_READ_WRITE, sizeof(uint32), nullptr, &ret));
+		}
+
+		if (radixSort)
+		{
+			CL_CHECK_RET(sortKeysBuffers[0] = clCreateBuffer(clContext, CL_MEM_READ_WRITE, sizeof(uint32) * dynamicParticlesCount, nullptr, &ret));
+			CL_CHECK_RET(sortKeysBuffers[1] = clCreateBuffer(clContext, CL_MEM_READ_WRITE, sizeof(uint32) * dynamicParticlesCount, nullptr, &ret));
+			CL_CHECK_RET(sortValuesBuffer = clCreateBuffer(clContext, CL_MEM_READ_WRITE, sizeof(uint32) * dynamicParticlesCount, nullptr, &ret));
+
+			//Only the bits a hash can have are sorted
+			sortKeyBitCount = std::max<uint>((uint)std::bit_width(dynamicParticlesHashMapSize - 1), 1);
+		}
+
 		uint32 pattern0 = 0;
 		uint32 patternCount = dynamicParticlesCount;
 
@@ -391,9 +655,13 @@ namespace SPH
 		EventWaitArray<3> prepareHahsMapWaitEvents{ fillHashMapFinishedEvent1, fillHashMapFinishedEvent2, initialDynamicParticlesLockAcquiredEvent };
 		kernels.EnqueueComputeDynamicParticlesHashAndPrepareHashMapKernel(clCommandQueue, dynamicParticlesHashMap, dynamicParticlesHashMapSize, initialDynamicParticles, dynamicParticlesCount, particleBehaviourParameters.maxInteractionDistance, prepareHahsMapWaitEvents, &prepareHashMapFinishedEvent());
 
+		//The sort doesn't need the counts, it overwrites the hash map
 		cl::Event scanFinishedEvent;
-		EventWaitArray<1> scanWaitEvents{ prepareHashMapFinishedEvent };
-		kernels.EnqueueInclusiveScanKernels(clCommandQueue, dynamicParticlesHashMap, dynamicParticlesHashMapSize, dynamicParticlesHashMapGroupSize, scanWaitEvents, &scanFinishedEvent());
+		if (!radixSort)
+		{
+			EventWaitArray<1> scanWaitEvents{ prepareHashMapFinishedEvent };
+			EnqueueHashMapScan(dynamicParticlesHashMap, dynamicParticlesHashMapSize, dynamicParticlesHashMapGroupSize, scanWaitEvents, &scanFinishedEvent());
+		}
 
 		dynamicParticlesBufferManager.Advance();
 
@@ -402,18 +670,28 @@ namespace SPH
 		cl_mem finalDynamicParticles = (cl_mem)finalDynamicParticlesLockGuard.GetResource();
 
 		cl::Event reorderFinishedEvent;
-		EventWaitArray<2> reorderWaitEvents{ finalDynamicParticlesLockAcquiredEvent, scanFinishedEvent };
-		kernels.EnqueueReorderDynamicParticlesAndFinishHashMapKernel(clCommandQueue, particleMapBuffer, dynamicParticlesHashMap, initialDynamicParticles, finalDynamicParticles, dynamicParticlesCount, reorderWaitEvents, &reorderFinishedEvent());
+		if (radixSort)
+		{
+			EventWaitArray<2> sortWaitEvents{ finalDynamicParticlesLockAcquiredEvent, prepareHashMapFinishedEvent };
+			cl::Event sortFinishedEvent;
+			EnqueueSortDynamicParticles(initialDynamicParticles, finalDynamicParticles, dynamicParticlesCount, sortWaitEvents, &sortFinishedEvent(), &reorderFinishedEvent());
+		}
+		else
+		{
+			EventWaitArray<2> reorderWaitEvents{ finalDynamicParticlesLockAcquiredEvent, scanFinishedEvent };
+			kernels.EnqueueReorderDynamicParticlesAndFinishHashMapKernel(clCommandQueue, particleMapBuffer, dynamicParticlesHashMap, initialDynamicParticles, finalDynamicParticles, dynamicParticlesCount, reorderWaitEvents, &reorderFinishedEvent());
+		}
 
 
-#ifdef DEBUG_BUFFERS_GPU
-		debugParticlesArray.Resize(dynamicParticlesCount);
-		debugHashMapArray.Resize(dynamicParticlesHashMapSize + 1);
-		debugParticleMapArray.Resize(dynamicParticlesCount);
+		if (integrityCheckInterval != 0)
+		{
+			debugParticlesArray.Resize(dynamicParticlesCount);
+			debugHashMapArray.Resize(dynamicParticlesHashMapSize + 1);
+			debugParticleMapArray.Resize(dynamicParticlesCount);
 
-		DebugDynamicParticles(clCommandQueue, debugParticlesArray, finalDynamicParticles, dynamicParticlesHashMapSize, particleBehaviourParameters.maxInteractionDistance);
-		DebugDynamicParticleHashAndParticleMap(clCommandQueue, debugParticlesArray, debugHashMapArray, debugParticleMapArray, finalDynamicParticles, dynamicParticlesHashMap, particleMapBuffer);
-#endif
+			integrityErrorCount += DebugDynamicParticleHashAndParticleMap(clCommandQueue, debugParticlesArray, debugHashMapArray, debugParticleMapArray, finalDynamicParticles, dynamicParticlesHashMap, particleMapBuffer);
+			integrityErrorCount += SimulationEngine::DebugParticles<DynamicParticle>(debugParticlesArray, particleBehaviourParameters.maxInteractionDistance, dynamicParticlesHashMapSize);
+		}
 
 		initialDynamicParticlesLockGuard.Unlock({ (void**)&reorderFinishedEvent(), 1 });
 		finalDynamicParticlesLockGuard.Unlock({ (void**)&reorderFinishedEvent(), 1 });
@@ -429,31 +707,16 @@ namespace SPH
 
 		__debugbreak();
 	}
-#ifdef DEBUG_BUFFERS_GPU
-	void SimulationEngineGPU::DebugStaticParticles(cl_command_queue clCommandQueue, Array<StaticParticle>& tempBuffer, cl_mem particles, uintMem hashMapSize, float maxInteractionDistance)
-	{
-		CL_CALL(clFinish(clCommandQueue));
-		CL_CALL(clEnqueueReadBuffer(clCommandQueue, particles, CL_TRUE, 0, tempBuffer.Count() * sizeof(StaticParticle), tempBuffer.Ptr(), 0, nullptr, nullptr))
-
-		SimulationEngine::DebugParticles<StaticParticle>(tempBuffer, maxInteractionDistance, hashMapSize);
-	}
-	void SimulationEngineGPU::DebugDynamicParticles(cl_command_queue clCommandQueue, Array<DynamicParticle>& tempBuffer, cl_mem particles, uintMem hashMapSize, float maxInteractionDistance)
-	{
-		CL_CALL(clFinish(clCommandQueue));
-		CL_CALL(clEnqueueReadBuffer(clCommandQueue, particles, CL_TRUE, 0, tempBuffer.Count() * sizeof(DynamicParticle), tempBuffer.Ptr(), 0, nullptr, nullptr))
-
-		SimulationEngine::DebugParticles<DynamicParticle>(tempBuffer, maxInteractionDistance, hashMapSize);
-	}
-	void SimulationEngineGPU::DebugStaticParticleHashAndParticleMap(cl_command_queue clCommandQueue, Array<StaticParticle>& tempParticles, Array<uint32>& tempHashMap, cl_mem particles, cl_mem hashMap, float maxInteractionDistance)
+	uint64 SimulationEngineGPU::DebugStaticParticleHashAndParticleMap(cl_command_queue clCommandQueue, Array<StaticParticle>& tempParticles, Array<uint32>& tempHashMap, cl_mem particles, cl_mem hashMap, float maxInteractionDistance)
 	{
 		CL_CALL(clFinish(clCommandQueue));
 		CL_CALL(clEnqueueReadBuffer(clCommandQueue, hashMap, CL_FALSE, 0, sizeof(uint32) * tempHashMap.Count(), tempHashMap.Ptr(), 0, nullptr, nullptr));
 		CL_CALL(clEnqueueReadBuffer(clCommandQueue, particles, CL_FALSE, 0, sizeof(StaticParticle) * tempParticles.Count(), tempParticles.Ptr(), 0, nullptr, nullptr));
 		CL_CALL(clFinish(clCommandQueue));
 
-		SimulationEngine::DebugHashAndParticleMap<uint32>(tempParticles, tempHashMap, maxInteractionDistance);
+		return SimulationEngine::DebugHashAndParticleMap<uint32>(tempParticles, tempHashMap, maxInteractionDistance);
 	}
-	void SimulationEngineGPU::DebugDynamicParticleHashAndParticleMap(cl_command_queue clCommandQueue, Array<DynamicParticle>& tempParticles, Array<uint32>& tempHashMap, Array<uint32>& tempParticleMap, cl_mem particles, cl_mem hashMap, cl_mem particleMap)
+	uint64 SimulationEngineGPU::DebugDynamicParticleHashAndParticleMap(cl_command_queue clCommandQueue, Array<DynamicParticle>& tempParticles, Array<uint32>& tempHashMap, Array<uint32>& tempParticleMap, cl_mem particles, cl_mem hashMap, cl_mem particleMap)
 	{
 		CL_CALL(clFinish(clCommandQueue));
 		CL_CALL(clEnqueueReadBuffer(clCommandQueue, hashMap, CL_FALSE, 0, sizeof(uint32) * tempHashMap.Count(), tempHashMap.Ptr(), 0, nullptr, nullptr));
@@ -461,20 +724,6 @@ namespace SPH
 		CL_CALL(clEnqueueReadBuffer(clCommandQueue, particles, CL_FALSE, 0, sizeof(DynamicParticle) * tempParticles.Count(), tempParticles.Ptr(), 0, nullptr, nullptr));
 		CL_CALL(clFinish(clCommandQueue));
 
-		SimulationEngine::DebugHashAndParticleMap<uint32>(tempParticles, tempHashMap, tempParticleMap);
+		return SimulationEngine::DebugHashAndParticleMap<uint32>(tempParticles, tempHashMap, tempParticleMap);
 	}
-#else
-	void SimulationEngineGPU::DebugStaticParticles(cl_command_queue clCommandQueue, Array<StaticParticle>& tempBuffer, cl_mem particles, uintMem hashMapSize, float maxInteractionDistance)
-	{
-	}
-	void SimulationEngineGPU::DebugDynamicParticles(cl_command_queue clCommandQueue, Array<DynamicParticle>& tempBuffer, cl_mem particles, uintMem hashMapSize, float maxInteractionDistance)
-	{
-	}
-	void SimulationEngineGPU::DebugStaticParticleHashAndParticleMap(cl_command_queue clCommandQueue, Array<StaticParticle> tempParticles, Array<uint32> tempHashMap, cl_mem particles, cl_mem hashMap, float maxInteractionDistance)
-	{
-	}
-	void SimulationEngineGPU::DebugDynamicParticleHashAndParticleMap(cl_command_queue clCommandQueue, Array<DynamicParticle> tempParticles, Array<uint32> tempHashMap, Array<uint32> tempParticleMap, cl_mem particles, cl_mem hashMap, cl_mem particleMap)
-	{
-	}
-#endif
 }
\ No newline at end of file
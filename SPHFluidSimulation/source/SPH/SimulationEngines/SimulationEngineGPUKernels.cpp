@@ -3,10 +3,23 @@
 #include "SPH/OpenCL/OpenCLDebug.h"
 
 #include "SPH/Kernels/Kernels.h"
+#include <filesystem>
 
 namespace SPH
 {
-	static cl_program BuildOpenCLProgram(cl_context clContext, cl_device_id clDevice, ArrayView<String> sources, const Map<String, String>& values)
+	static String GetBuildOptions(const Map<String, String>& values)
+	{
+		String options = "-cl-std=CL2.0 -cl-kernel-arg-info";
+
+		for (auto& pair : values)
+			if (pair.value.Empty())
+				options += " -D " + pair.key;
+			else
+				options += " -D " + pair.key + "=" + pair.value;
+
+		return options;
+	}
+	static cl_program BuildOpenCLProgram(cl_context clContext, cl_device_id clDevice, ArrayView<StringView> sources, const String& options)
 	{
 		cl_int ret = 0;
 		Array<const char*> sourcePointers;
@@ -21,14 +34,6 @@ namespace SPH
 		auto program = clCreateProgramWithSource(clContext, sources.Count(), sourcePointers.Ptr(), sourceLengths.Ptr(), &ret);
 		CL_CHECK(program);
 
-		String options = "-cl-std=CL2.0 -cl-kernel-arg-info";
-
-		for (auto& pair : values)
-			if (pair.value.Empty())
-				options += " -D " + pair.key;
-			else
-				options += " -D " + pair.key + "=" + pair.value;
-
 		if ((ret = clBuildProgram(program, 1, &clDevice, options.Ptr(), nullptr, nullptr)) == CL_BUILD_PROGRAM_FAILURE)
 		{
 			uintMem logLength = 0;
@@ -44,6 +49,157 @@ namespace SPH
 
 		return program;
 	}
+
+	//Increased when the layout of the program cache files changes
+	static constexpr uint32 ProgramCacheFileVersion = 1;
+	static constexpr char ProgramCacheFileMagic[4] = { 'S', 'P', 'H', 'P' };
+
+	//A program cache file is this header followed by the program binary
+	struct ProgramCacheFileHeader
+	{
+		char magic[4];
+		uint32 version;
+		uint64 key;
+		double sourceBuildSeconds;
+		uint64 binarySize;
+	};
+
+	//64 bit FNV-1a
+	static constexpr uint64 HashOffsetBasis = 0xcbf29ce484222325;
+	static uint64 HashBytes(uint64 hash, const void* data, uintMem size)
+	{
+		for (uintMem i = 0; i < size; ++i)
+			hash = (hash ^ ((const unsigned char*)data)[i]) * 0x100000001b3;
+		return hash;
+	}
+	//The length is hashed too, so that moving characters from one string to the next changes the hash
+	static uint64 HashString(uint64 hash, StringView string)
+	{
+		uint64 length = string.Count();
+		hash = HashBytes(hash, &length, sizeof(length));
+		return HashBytes(hash, string.Ptr(), string.Count());
+	}
+	static String GetDeviceInfoString(cl_device_id device, cl_device_info info)
+	{
+		uintMem size = 0;
+		CL_CALL(clGetDeviceInfo(device, info, 0, nullptr, &size), String());
+		String string{ size };
+		CL_CALL(clGetDeviceInfo(device, info, size, string.Ptr(), nullptr), String());
+		return string;
+	}
+	//The file of a device is overwritten whenever its key changes, so the cache doesn't grow with every change of the
+	//kernels or the driver
+	static std::filesystem::path GetProgramCacheFilePath(cl_device_id clDevice)
+	{
+		uint64 deviceHash = HashString(HashString(HashOffsetBasis, GetDeviceInfoString(clDevice, CL_DEVICE_VENDOR)), GetDeviceInfoString(clDevice, CL_DEVICE_NAME));
+
+		char fileName[32];
+		snprintf(fileName, sizeof(fileName), "%016llx.bin", (unsigned long long)deviceHash);
+		return std::filesystem::path(SimulationEngineGPUKernels::ProgramCacheDirectory) / fileName;
+	}
+	static uint64 GetProgramCacheKey(cl_device_id clDevice, ArrayView<StringView> sources, const String& options)
+	{
+		uint64 key = HashBytes(HashOffsetBasis, &ProgramCacheFileVersion, sizeof(ProgramCacheFileVersion));
+
+		for (cl_device_info info : { CL_DEVICE_VENDOR, CL_DEVICE_NAME, CL_DEVICE_VERSION, CL_DRIVER_VERSION })
+			key = HashString(key, GetDeviceInfoString(clDevice, info));
+
+		key = HashString(key, options);
+
+		for (auto& source : sources)
+			key = HashString(key, source);
+
+		return key;
+	}
+	//Returns nullptr when the cache has no binary with the key or the driver rejects it, the program has to be built
+	//from the source then
+	static cl_program LoadCachedOpenCLProgram(cl_context clContext, cl_device_id clDevice, const std::filesystem::path& path, uint64 key, const String& options, double& sourceBuildSeconds)
+	{
+		File file{ Path(path.string().c_str()), FileAccessPermission::Read };
+
+		if (!file.IsOpen())
+			return nullptr;
+
+		ProgramCacheFileHeader header{ };
+		uintMem fileSize = file.GetSize();
+
+		if (fileSize < sizeof(header) || file.Read(&header, sizeof(header)) != sizeof(header) ||
+			memcmp(header.magic, ProgramCacheFileMagic, sizeof(header.magic)) != 0 || header.version != ProgramCacheFileVersion ||
+			header.key != key || header.binarySize == 0 || header.binarySize != fileSize - sizeof(header))
+		{
+			Debug::Logger::LogInfo("SPH Library", "The cached OpenCL program binary is stale. The program is built from the source");
+			return nullptr;
+		}
+
+		Array<unsigned char> binary((uintMem)header.binarySize);
+		if (file.Read(binary.Ptr(), binary.Count()) != binary.Count())
+			return nullptr;
+
+		const unsigned char* binaryPointer = binary.Ptr();
+		uintMem binarySize = binary.Count();
+		cl_int binaryStatus = CL_SUCCESS;
+		cl_int ret = CL_SUCCESS;
+		cl_program program = clCreateProgramWithBinary(clContext, 1, &clDevice, &binarySize, &binaryPointer, &binaryStatus, &ret);
+
+		if (ret != CL_SUCCESS || binaryStatus != CL_SUCCESS || clBuildProgram(program, 1, &clDevice, options.Ptr(), nullptr, nullptr) != CL_SUCCESS)
+		{
+			if (program != nullptr)
+				clReleaseProgram(program);
+
+			Debug::Logger::LogWarning("SPH Library", "The driver rejected the cached OpenCL program binary. The program is built from the source");
+			return nullptr;
+		}
+
+		sourceBuildSeconds = header.sourceBuildSeconds;
+		return program;
+	}
+	static void StoreCachedOpenCLProgram(cl_program program, cl_device_id clDevice, const std::filesystem::path& path, uint64 key, double sourceBuildSeconds)
+	{
+		//The program has a binary for every device of the context, only the one of 'clDevice' is built
+		cl_uint deviceCount = 0;
+		CL_CALL(clGetProgramInfo(program, CL_PROGRAM_NUM_DEVICES, sizeof(deviceCount), &deviceCount, nullptr), );
+		Array<cl_device_id> devices(deviceCount);
+		CL_CALL(clGetProgramInfo(program, CL_PROGRAM_DEVICES, sizeof(cl_device_id) * deviceCount, devices.Ptr(), nullptr), );
+		Array<uintMem> binarySizes(deviceCount);
+		CL_CALL(clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(uintMem) * deviceCount, binarySizes.Ptr(), nullptr), );
+
+		uintMem deviceIndex = 0;
+		while (deviceIndex < deviceCount && devices[deviceIndex] != clDevice)
+			++deviceIndex;
+
+		if (deviceIndex == deviceCount || binarySizes[deviceIndex] == 0)
+			return;
+
+		//The binaries of the entries that are nullptr aren't copied
+		Array<unsigned char> binary(binarySizes[deviceIndex]);
+		Array<unsigned char*> binaryPointers(deviceCount);
+		for (uintMem i = 0; i < deviceCount; ++i)
+			binaryPointers[i] = i == deviceIndex ? binary.Ptr() : nullptr;
+		CL_CALL(clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(unsigned char*) * deviceCount, binaryPointers.Ptr(), nullptr), );
+
+		std::error_code error;
+		std::filesystem::create_directories(path.parent_path(), error);
+
+		File file{ Path(path.string().c_str()), FileAccessPermission::Write, FileOpenParameters {
+			.openOption = FileOpenOptions::CreateAlways
+		} };
+
+		if (!file.IsOpen())
+		{
+			Debug::Logger::LogWarning("SPH Library", "Failed to store the OpenCL program binary in the program cache");
+			return;
+		}
+
+		ProgramCacheFileHeader header{ };
+		memcpy(header.magic, ProgramCacheFileMagic, sizeof(header.magic));
+		header.version = ProgramCacheFileVersion;
+		header.key = key;
+		header.sourceBuildSeconds = sourceBuildSeconds;
+		header.binarySize = binary.Count();
+
+		file.Write(&header, sizeof(header));
+		file.Write(binary.Ptr(), binary.Count());
+	}
 	static inline size_t RoundToMultiple(size_t value, size_t multiple)
 	{
 		return (value + multiple - 1) / multiple * multiple;
@@ -72,6 +228,9 @@ namespace SPH
 
 		clReleaseKernel(inclusiveScanUpPassKernel);
 		clReleaseKernel(inclusiveScanDownPassKernel);
+		clReleaseKernel(inclusiveScanReduceTilesKernel);
+		clReleaseKernel(inclusiveScanTileSumsKernel);
+		clReleaseKernel(inclusiveScanTilesKernel);
 		clReleaseKernel(prepareStaticParticlesHashMapKernel);
 		clReleaseKernel(reorderStaticParticlesAndFinishHashMapKernel);
 		clReleaseKernel(computeDynamicParticlesHashAndPrepareHashMapKernel);
@@ -79,6 +238,17 @@ namespace SPH
 		clReleaseKernel(fillDynamicParticleMapAndFinishHashMapKernel);
 		clReleaseKernel(updateParticlesPressureKernel);
 		clReleaseKernel(updateParticlesDynamicsKernel);
+		clReleaseKernel(listOccupiedBucketsKernel);
+		clReleaseKernel(updateParticlesPressureTiledKernel);
+		clReleaseKernel(updateParticlesDynamicsTiledKernel);
+		clReleaseKernel(radixSortHistogramKernel);
+		clReleaseKernel(radixSortScatterKernel);
+		clReleaseKernel(prepareDynamicParticlesSortKernel);
+		clReleaseKernel(finishSortedHashMapKernel);
+		clReleaseKernel(gatherSortedDynamicParticlesKernel);
+
+		clReleaseMemObject(reduceThenScanTileSums);
+		clReleaseMemObject(radixSortHistogram);
 	}
 	void SimulationEngineGPUKernels::EnqueueInclusiveScanKernels(cl_command_queue clCommandQueue, cl_mem hashMap, uintMem hashMapSize, uintMem dynamicParticlesHashMapGroupSize, ArrayView<cl_event> waitEvents, cl_event* finishedEvent) const
 	{
@@ -126,6 +296,136 @@ namespace SPH
 		*finishedEvent = waitEvent();
 		waitEvent() = nullptr;
 	}
+	void SimulationEngineGPUKernels::EnqueueReduceThenScanKernels(cl_command_queue clCommandQueue, cl_mem hashMap, uintMem hashMapSize, ArrayView<cl_event> waitEvents, cl_event* finishedEvent) const
+	{
+		uint64 size = hashMapSize;
+		uint64 tileCount = std::min<uint64>((size + reduceThenScanWorkGroupSize - 1) / reduceThenScanWorkGroupSize, MaxReduceThenScanTileCount);
+		uint64 tileSize = RoundToMultiple((size + tileCount - 1) / tileCount, reduceThenScanWorkGroupSize);
+		tileCount = (size + tileSize - 1) / tileSize;
+
+		uintMem tempMemorySize = reduceThenScanWorkGroupSize * sizeof(uint32);
+		size_t globalWorkOffset = 0;
+		size_t localWorkSize = reduceThenScanWorkGroupSize;
+		size_t globalWorkSize = tileCount * reduceThenScanWorkGroupSize;
+
+		cl::Event reduceFinishedEvent;
+		CL_CALL(clSetKernelArg(inclusiveScanReduceTilesKernel, 0, tempMemorySize, nullptr));
+		CL_CALL(clSetKernelArg(inclusiveScanReduceTilesKernel, 1, sizeof(cl_mem), &hashMap));
+		CL_CALL(clSetKernelArg(inclusiveScanReduceTilesKernel, 2, sizeof(uint64), &size));
+		CL_CALL(clSetKernelArg(inclusiveScanReduceTilesKernel, 3, sizeof(uint64), &tileSize));
+		CL_CALL(clSetKernelArg(inclusiveScanReduceTilesKernel, 4, sizeof(cl_mem), &reduceThenScanTileSums));
+		CL_CALL(clEnqueueNDRangeKernel(clCommandQueue, inclusiveScanReduceTilesKernel, 1, &globalWorkOffset, &globalWorkSize, &localWorkSize, waitEvents.Count(), waitEvents.Ptr(), &reduceFinishedEvent()));
+
+		cl::Event tileSumsFinishedEvent;
+		CL_CALL(clSetKernelArg(inclusiveScanTileSumsKernel, 0, tempMemorySize, nullptr));
+		CL_CALL(clSetKernelArg(inclusiveScanTileSumsKernel, 1, sizeof(cl_mem), &reduceThenScanTileSums));
+		CL_CALL(clSetKernelArg(inclusiveScanTileSumsKernel, 2, sizeof(uint64), &tileCount));
+		CL_CALL(clEnqueueNDRangeKernel(clCommandQueue, inclusiveScanTileSumsKernel, 1, &globalWorkOffset, &localWorkSize, &localWorkSize, 1, &reduceFinishedEvent(), &tileSumsFinishedEvent()));
+
+		CL_CALL(clSetKernelArg(inclusiveScanTilesKernel, 0, tempMemorySize, nullptr));
+		CL_CALL(clSetKernelArg(inclusiveScanTilesKernel, 1, sizeof(cl_mem), &hashMap));
+		CL_CALL(clSetKernelArg(inclusiveScanTilesKernel, 2, sizeof(uint64), &size));
+		CL_CALL(clSetKernelArg(inclusiveScanTilesKernel, 3, sizeof(uint64), &tileSize));
+		CL_CALL(clSetKernelArg(inclusiveScanTilesKernel, 4, sizeof(cl_mem), &reduceThenScanTileSums));
+		CL_CALL(clEnqueueNDRangeKernel(clCommandQueue, inclusiveScanTilesKernel, 1, &globalWorkOffset, &globalWorkSize, &localWorkSize, 1, &tileSumsFinishedEvent(), finishedEvent));
+	}
+	uintMem SimulationEngineGPUKernels::EnqueueRadixSortKernels(cl_command_queue clCommandQueue, const cl_mem keys[2], const cl_mem values[2], uintMem count, uint keyBitCount, ArrayView<cl_event> waitEvents, cl_event* finishedEvent) const
+	{
+		uint64 size = count;
+		uint64 tileCount = std::min<uint64>(std::max<uint64>((size + radixSortWorkGroupSize - 1) / radixSortWorkGroupSize, 1), MaxRadixSortTileCount);
+		uint64 tileSize = RoundToMultiple(std::max<uint64>((size + tileCount - 1) / tileCount, 1), radixSortWorkGroupSize);
+		tileCount = std::max<uint64>((size + tileSize - 1) / tileSize, 1);
+
+		uintMem tempMemorySize = radixSortWorkGroupSize * sizeof(uint32);
+		size_t globalWorkOffset = 0;
+		size_t localWorkSize = radixSortWorkGroupSize;
+		size_t globalWorkSize = tileCount * radixSortWorkGroupSize;
+
+		uintMem passCount = GetRadixSortPassCount(keyBitCount);
+		cl::Event waitEvent;
+
+		for (uintMem pass = 0; pass < passCount; ++pass)
+		{
+			uint shift = (uint)pass * RadixSortDigitBitCount;
+			cl_mem inKeys = keys[pass % 2];
+			cl_mem inValues = values[pass % 2];
+			cl_mem outKeys = keys[(pass + 1) % 2];
+			cl_mem outValues = values[(pass + 1) % 2];
+
+			cl::Event histogramFinishedEvent;
+			CL_CALL(clSetKernelArg(radixSortHistogramKernel, 0, sizeof(cl_mem), &inKeys), 0);
+			CL_CALL(clSetKernelArg(radixSortHistogramKernel, 1, sizeof(uint64), &size), 0);
+			CL_CALL(clSetKernelArg(radixSortHistogramKernel, 2, sizeof(uint64), &tileSize), 0);
+			CL_CALL(clSetKernelArg(radixSortHistogramKernel, 3, sizeof(uint), &shift), 0);
+			CL_CALL(clSetKernelArg(radixSortHistogramKernel, 4, sizeof(cl_mem), &radixSortHistogram), 0);
+			CL_CALL(clEnqueueNDRangeKernel(clCommandQueue, radixSortHistogramKernel, 1, &globalWorkOffset, &globalWorkSize, &localWorkSize, pass == 0 ? waitEvents.Count() : 1, pass == 0 ? waitEvents.Ptr() : &waitEvent(), &histogramFinishedEvent()), 0);
+
+			cl::Event scanFinishedEvent;
+			EnqueueReduceThenScanKernels(clCommandQueue, radixSortHistogram, RadixSortDigitCount * tileCount, { &histogramFinishedEvent(), 1 }, &scanFinishedEvent());
+
+			CL_CALL(clSetKernelArg(radixSortScatterKernel, 0, tempMemorySize, nullptr), 0);
+			CL_CALL(clSetKernelArg(radixSortScatterKernel, 1, tempMemorySize, nullptr), 0);
+			CL_CALL(clSetKernelArg(radixSortScatterKernel, 2, tempMemorySize, nullptr), 0);
+			CL_CALL(clSetKernelArg(radixSortScatterKernel, 3, sizeof(cl_mem), &inKeys), 0);
+			CL_CALL(clSetKernelArg(radixSortScatterKernel, 4, sizeof(cl_mem), &inValues), 0);
+			CL_CALL(clSetKernelArg(radixSortScatterKernel, 5, sizeof(cl_mem), &outKeys), 0);
+			CL_CALL(clSetKernelArg(radixSortScatterKernel, 6, sizeof(cl_mem), &outValues), 0);
+			CL_CALL(clSetKernelArg(radixSortScatterKernel, 7, sizeof(uint64), &size), 0);
+			CL_CALL(clSetKernelArg(radixSortScatterKernel, 8, sizeof(uint64), &tileSize), 0);
+			CL_CALL(clSetKernelArg(radixSortScatterKernel, 9, sizeof(uint), &shift), 0);
+			CL_CALL(clSetKernelArg(radixSortScatterKernel, 10, sizeof(cl_mem), &radixSortHistogram), 0);
+
+			waitEvent = cl::Event();
+			CL_CALL(clEnqueueNDRangeKernel(clCommandQueue, radixSortScatterKernel, 1, &globalWorkOffset, &globalWorkSize, &localWorkSize, 1, &scanFinishedEvent(), &waitEvent()), 0);
+		}
+
+		*finishedEvent = waitEvent();
+		waitEvent() = nullptr;
+
+		return passCount % 2;
+	}
+	void SimulationEngineGPUKernels::EnqueuePrepareDynamicParticlesSortKernel(cl_command_queue clCommandQueue, cl_mem particles, cl_mem keys, cl_mem values, uintMem particleCount, ArrayView<cl_event> waitEvents, cl_event* finishedEvent) const
+	{
+		uint64 targetGlobalWorkSize = particleCount;
+		CL_CALL(clSetKernelArg(prepareDynamicParticlesSortKernel, 0, sizeof(cl_mem), &particles));
+		CL_CALL(clSetKernelArg(prepareDynamicParticlesSortKernel, 1, sizeof(cl_mem), &keys));
+		CL_CALL(clSetKernelArg(prepareDynamicParticlesSortKernel, 2, sizeof(cl_mem), &values));
+		CL_CALL(clSetKernelArg(prepareDynamicParticlesSortKernel, 3, sizeof(uint64), &targetGlobalWorkSize));
+
+		size_t localWorkSize = prepareDynamicParticlesSortKernelWorkGroupSize;
+		size_t globalWorkOffset = 0;
+		size_t globalWorkSize = supportsNonUniformWorkGroups ? targetGlobalWorkSize : RoundToMultiple(targetGlobalWorkSize, localWorkSize);
+		CL_CALL(clEnqueueNDRangeKernel(clCommandQueue, prepareDynamicParticlesSortKernel, 1, &globalWorkOffset, &globalWorkSize, &localWorkSize, waitEvents.Count(), waitEvents.Ptr(), finishedEvent));
+	}
+	void SimulationEngineGPUKernels::EnqueueFinishSortedHashMapKernel(cl_command_queue clCommandQueue, cl_mem hashMap, uintMem hashMapSize, cl_mem sortedKeys, uintMem keyCount, ArrayView<cl_event> waitEvents, cl_event* finishedEvent) const
+	{
+		uint64 size = hashMapSize;
+		uint64 count = keyCount;
+		//One work item past the last key fills the buckets after it
+		uint64 targetGlobalWorkSize = keyCount + 1;
+		CL_CALL(clSetKernelArg(finishSortedHashMapKernel, 0, sizeof(cl_mem), &hashMap));
+		CL_CALL(clSetKernelArg(finishSortedHashMapKernel, 1, sizeof(uint64), &size));
+		CL_CALL(clSetKernelArg(finishSortedHashMapKernel, 2, sizeof(cl_mem), &sortedKeys));
+		CL_CALL(clSetKernelArg(finishSortedHashMapKernel, 3, sizeof(uint64), &count));
+
+		size_t localWorkSize = finishSortedHashMapKernelWorkGroupSize;
+		size_t globalWorkOffset = 0;
+		size_t globalWorkSize = supportsNonUniformWorkGroups ? targetGlobalWorkSize : RoundToMultiple(targetGlobalWorkSize, localWorkSize);
+		CL_CALL(clEnqueueNDRangeKernel(clCommandQueue, finishSortedHashMapKernel, 1, &globalWorkOffset, &globalWorkSize, &localWorkSize, waitEvents.Count(), waitEvents.Ptr(), finishedEvent));
+	}
+	void SimulationEngineGPUKernels::EnqueueGatherSortedDynamicParticlesKernel(cl_command_queue clCommandQueue, cl_mem particleMap, cl_mem inParticles, cl_mem outParticles, uintMem particleCount, ArrayView<cl_event> waitEvents, cl_event* finishedEvent) const
+	{
+		uint64 targetGlobalWorkSize = particleCount;
+		CL_CALL(clSetKernelArg(gatherSortedDynamicParticlesKernel, 0, sizeof(cl_mem), &particleMap));
+		CL_CALL(clSetKernelArg(gatherSortedDynamicParticlesKernel, 1, sizeof(cl_mem), &inParticles));
+		CL_CALL(clSetKernelArg(gatherSortedDynamicParticlesKernel, 2, sizeof(cl_mem), &outParticles));
+		CL_CALL(clSetKernelArg(gatherSortedDynamicParticlesKernel, 3, sizeof(uint64), &targetGlobalWorkSize));
+
+		size_t localWorkSize = gatherSortedDynamicParticlesKernelWorkGroupSize;
+		size_t globalWorkOffset = 0;
+		size_t globalWorkSize = supportsNonUniformWorkGroups ? targetGlobalWorkSize : RoundToMultiple(targetGlobalWorkSize, localWorkSize);
+		CL_CALL(clEnqueueNDRangeKernel(clCommandQueue, gatherSortedDynamicParticlesKernel, 1, &globalWorkOffset, &globalWorkSize, &localWorkSize, waitEvents.Count(), waitEvents.Ptr(), finishedEvent));
+	}
 	void SimulationEngineGPUKernels::EnqueuePrepareStaticParticlesHashMapKernel(cl_command_queue clCommandQueue, cl_mem hashMap, uintMem hashMapSize, cl_mem inParticles, uintMem particleCount, float maxInteractionDistance, ArrayView<cl_event> waitEvents, cl_event* finishedEvent) const
 	{
 		uint64 threadIDNull = 0;
@@ -231,7 +531,7 @@ namespace SPH
 		size_t globalWorkSize = supportsNonUniformWorkGroups ? targetGlobalWorkSize : RoundToMultiple(targetGlobalWorkSize, localWorkSize);
 		CL_CALL(clEnqueueNDRangeKernel(clCommandQueue, updateParticlesPressureKernel, 1, &globalWorkOffset, &globalWorkSize, &localWorkSize, waitEvents.Count(), waitEvents.Ptr(), finishedEvent));
 	}
-	void SimulationEngineGPUKernels::EnqueueUpdateParticlesDynamicsKernel(cl_command_queue clCommandQueue, cl_mem dynamicParticlesHashMap, uintMem dynamicParticlesHashMapSize, cl_mem staticParticlesHashMap, uintMem staticParticlesHashMapSize, cl_mem particleMap, cl_mem particleReadBuffer, cl_mem particleWriteBuffer, cl_mem staticParticlesBuffer, uintMem dynamicParticlesCount, uintMem staticParticlesCount, cl_mem particleBehaviourParameters, float deltaTime, uint64 triangleCount, cl_mem triangles, ArrayView<cl_event> waitEvents, cl_event* finishedEvent) const
+	void SimulationEngineGPUKernels::EnqueueUpdateParticlesDynamicsKernel(cl_command_queue clCommandQueue, cl_mem dynamicParticlesHashMap, uintMem dynamicParticlesHashMapSize, cl_mem staticParticlesHashMap, uintMem staticParticlesHashMapSize, cl_mem particleMap, cl_mem particleReadBuffer, cl_mem particleWriteBuffer, cl_mem staticParticlesBuffer, uintMem dynamicParticlesCount, uintMem staticParticlesCount, cl_mem particleBehaviourParameters, float deltaTime, uint64 triangleCount, cl_mem triangles, uint64 triangleHashMapSize, cl_mem triangleHashMap, cl_mem triangleMap, ArrayView<cl_event> waitEvents, cl_event* finishedEvent) const
 	{
 		const uint64 threadIDNull = 0;
 		uint64 targetGlobalWorkSize = dynamicParticlesCount;
@@ -251,12 +551,82 @@ namespace SPH
 		CL_CALL(clSetKernelArg(updateParticlesDynamicsKernel, 12, sizeof(cl_mem), &particleBehaviourParameters));
 		CL_CALL(clSetKernelArg(updateParticlesDynamicsKernel, 13, sizeof(uint64), &triangleCount));
 		CL_CALL(clSetKernelArg(updateParticlesDynamicsKernel, 14, sizeof(cl_mem), triangles == NULL ? nullptr : &triangles));
+		CL_CALL(clSetKernelArg(updateParticlesDynamicsKernel, 15, sizeof(uint64), &triangleHashMapSize));
+		CL_CALL(clSetKernelArg(updateParticlesDynamicsKernel, 16, sizeof(cl_mem), triangleHashMap == NULL ? nullptr : &triangleHashMap));
+		CL_CALL(clSetKernelArg(updateParticlesDynamicsKernel, 17, sizeof(cl_mem), triangleMap == NULL ? nullptr : &triangleMap));
 
 		size_t localWorkSize = updateParticlesDynamicsKernelWorkGroupSize;
 		size_t globalWorkOffset = 0;
 		size_t globalWorkSize = supportsNonUniformWorkGroups ? targetGlobalWorkSize : RoundToMultiple(targetGlobalWorkSize, localWorkSize);
 		CL_CALL(clEnqueueNDRangeKernel(clCommandQueue, updateParticlesDynamicsKernel, 1, &globalWorkOffset, &globalWorkSize, &localWorkSize, waitEvents.Count(), waitEvents.Ptr(), finishedEvent));
 	}
+	void SimulationEngineGPUKernels::EnqueueListOccupiedBucketsKernel(cl_command_queue clCommandQueue, cl_mem occupiedBuckets, cl_mem occupiedBucketCount, cl_mem dynamicParticlesHashMap, cl_mem particleMap, cl_mem particles, uintMem particleCount, ArrayView<cl_event> waitEvents, cl_event* finishedEvent) const
+	{
+		uint64 targetGlobalWorkSize = particleCount;
+		CL_CALL(clSetKernelArg(listOccupiedBucketsKernel, 0, sizeof(cl_mem), &occupiedBuckets));
+		CL_CALL(clSetKernelArg(listOccupiedBucketsKernel, 1, sizeof(cl_mem), &occupiedBucketCount));
+		CL_CALL(clSetKernelArg(listOccupiedBucketsKernel, 2, sizeof(cl_mem), &dynamicParticlesHashMap));
+		CL_CALL(clSetKernelArg(listOccupiedBucketsKernel, 3, sizeof(cl_mem), &particleMap));
+		CL_CALL(clSetKernelArg(listOccupiedBucketsKernel, 4, sizeof(cl_mem), &particles));
+		CL_CALL(clSetKernelArg(listOccupiedBucketsKernel, 5, sizeof(uint64), &targetGlobalWorkSize));
+
+		size_t localWorkSize = listOccupiedBucketsKernelWorkGroupSize;
+		size_t globalWorkOffset = 0;
+		size_t globalWorkSize = supportsNonUniformWorkGroups ? targetGlobalWorkSize : RoundToMultiple(targetGlobalWorkSize, localWorkSize);
+		CL_CALL(clEnqueueNDRangeKernel(clCommandQueue, listOccupiedBucketsKernel, 1, &globalWorkOffset, &globalWorkSize, &localWorkSize, waitEvents.Count(), waitEvents.Ptr(), finishedEvent));
+	}
+	void SimulationEngineGPUKernels::EnqueueUpdateParticlesPressureTiledKernel(cl_command_queue clCommandQueue, cl_mem dynamicParticlesHashMap, uintMem dynamicParticlesHashMapSize, cl_mem staticParticlesHashMap, uintMem staticParticlesHashMapSize, cl_mem particleMap, cl_mem particleReadBuffer, cl_mem particleWriteBuffer, cl_mem staticParticlesBuffer, uintMem dynamicParticlesCount, uintMem staticParticlesCount, cl_mem particleBehaviourParameters, cl_mem occupiedBuckets, cl_mem occupiedBucketCount, ArrayView<cl_event> waitEvents, cl_event* finishedEvent) const
+	{
+		CL_CALL(clSetKernelArg(updateParticlesPressureTiledKernel, 0, sizeof(uintMem), &dynamicParticlesHashMapSize));
+		CL_CALL(clSetKernelArg(updateParticlesPressureTiledKernel, 1, sizeof(uintMem), &staticParticlesCount));
+		CL_CALL(clSetKernelArg(updateParticlesPressureTiledKernel, 2, sizeof(uintMem), &staticParticlesHashMapSize));
+		CL_CALL(clSetKernelArg(updateParticlesPressureTiledKernel, 3, sizeof(cl_mem), &particleReadBuffer));
+		CL_CALL(clSetKernelArg(updateParticlesPressureTiledKernel, 4, sizeof(cl_mem), &particleWriteBuffer));
+		CL_CALL(clSetKernelArg(updateParticlesPressureTiledKernel, 5, sizeof(cl_mem), &dynamicParticlesHashMap));
+		CL_CALL(clSetKernelArg(updateParticlesPressureTiledKernel, 6, sizeof(cl_mem), &particleMap));
+		CL_CALL(clSetKernelArg(updateParticlesPressureTiledKernel, 7, sizeof(cl_mem), &staticParticlesBuffer));
+		CL_CALL(clSetKernelArg(updateParticlesPressureTiledKernel, 8, sizeof(cl_mem), &staticParticlesHashMap));
+		CL_CALL(clSetKernelArg(updateParticlesPressureTiledKernel, 9, sizeof(cl_mem), &particleBehaviourParameters));
+		CL_CALL(clSetKernelArg(updateParticlesPressureTiledKernel, 10, sizeof(cl_mem), &occupiedBuckets));
+		CL_CALL(clSetKernelArg(updateParticlesPressureTiledKernel, 11, sizeof(cl_mem), &occupiedBucketCount));
+		CL_CALL(clSetKernelArg(updateParticlesPressureTiledKernel, 12, tiledWorkGroupSize * sizeof(Vec4f), nullptr));
+		CL_CALL(clSetKernelArg(updateParticlesPressureTiledKernel, 13, tiledWorkGroupSize * sizeof(uint32), nullptr));
+
+		//There can't be more occupied buckets than particles
+		size_t localWorkSize = tiledWorkGroupSize;
+		size_t globalWorkOffset = 0;
+		size_t globalWorkSize = std::min(tiledWorkGroupCount, std::max<uintMem>(dynamicParticlesCount, 1)) * tiledWorkGroupSize;
+		CL_CALL(clEnqueueNDRangeKernel(clCommandQueue, updateParticlesPressureTiledKernel, 1, &globalWorkOffset, &globalWorkSize, &localWorkSize, waitEvents.Count(), waitEvents.Ptr(), finishedEvent));
+	}
+	void SimulationEngineGPUKernels::EnqueueUpdateParticlesDynamicsTiledKernel(cl_command_queue clCommandQueue, cl_mem dynamicParticlesHashMap, uintMem dynamicParticlesHashMapSize, cl_mem staticParticlesHashMap, uintMem staticParticlesHashMapSize, cl_mem particleMap, cl_mem particleReadBuffer, cl_mem particleWriteBuffer, cl_mem staticParticlesBuffer, uintMem dynamicParticlesCount, uintMem staticParticlesCount, cl_mem particleBehaviourParameters, float deltaTime, uint64 triangleCount, cl_mem triangles, uint64 triangleHashMapSize, cl_mem triangleHashMap, cl_mem triangleMap, cl_mem occupiedBuckets, cl_mem occupiedBucketCount, ArrayView<cl_event> waitEvents, cl_event* finishedEvent) const
+	{
+		CL_CALL(clSetKernelArg(updateParticlesDynamicsTiledKernel, 0, sizeof(uintMem), &dynamicParticlesHashMapSize));
+		CL_CALL(clSetKernelArg(updateParticlesDynamicsTiledKernel, 1, sizeof(uintMem), &staticParticlesCount));
+		CL_CALL(clSetKernelArg(updateParticlesDynamicsTiledKernel, 2, sizeof(uintMem), &staticParticlesHashMapSize));
+		CL_CALL(clSetKernelArg(updateParticlesDynamicsTiledKernel, 3, sizeof(cl_mem), &particleReadBuffer));
+		CL_CALL(clSetKernelArg(updateParticlesDynamicsTiledKernel, 4, sizeof(cl_mem), &particleWriteBuffer));
+		CL_CALL(clSetKernelArg(updateParticlesDynamicsTiledKernel, 5, sizeof(cl_mem), &dynamicParticlesHashMap));
+		CL_CALL(clSetKernelArg(updateParticlesDynamicsTiledKernel, 6, sizeof(cl_mem), &particleMap));
+		CL_CALL(clSetKernelArg(updateParticlesDynamicsTiledKernel, 7, sizeof(cl_mem), &staticParticlesBuffer));
+		CL_CALL(clSetKernelArg(updateParticlesDynamicsTiledKernel, 8, sizeof(cl_mem), &staticParticlesHashMap));
+		CL_CALL(clSetKernelArg(updateParticlesDynamicsTiledKernel, 9, sizeof(float), &deltaTime));
+		CL_CALL(clSetKernelArg(updateParticlesDynamicsTiledKernel, 10, sizeof(cl_mem), &particleBehaviourParameters));
+		CL_CALL(clSetKernelArg(updateParticlesDynamicsTiledKernel, 11, sizeof(uint64), &triangleCount));
+		CL_CALL(clSetKernelArg(updateParticlesDynamicsTiledKernel, 12, sizeof(cl_mem), triangles == NULL ? nullptr : &triangles));
+		CL_CALL(clSetKernelArg(updateParticlesDynamicsTiledKernel, 13, sizeof(uint64), &triangleHashMapSize));
+		CL_CALL(clSetKernelArg(updateParticlesDynamicsTiledKernel, 14, sizeof(cl_mem), triangleHashMap == NULL ? nullptr : &triangleHashMap));
+		CL_CALL(clSetKernelArg(updateParticlesDynamicsTiledKernel, 15, sizeof(cl_mem), triangleMap == NULL ? nullptr : &triangleMap));
+		CL_CALL(clSetKernelArg(updateParticlesDynamicsTiledKernel, 16, sizeof(cl_mem), &occupiedBuckets));
+		CL_CALL(clSetKernelArg(updateParticlesDynamicsTiledKernel, 17, sizeof(cl_mem), &occupiedBucketCount));
+		CL_CALL(clSetKernelArg(updateParticlesDynamicsTiledKernel, 18, tiledWorkGroupSize * sizeof(Vec4f), nullptr));
+		CL_CALL(clSetKernelArg(updateParticlesDynamicsTiledKernel, 19, tiledWorkGroupSize * sizeof(Vec4f), nullptr));
+		CL_CALL(clSetKernelArg(updateParticlesDynamicsTiledKernel, 20, tiledWorkGroupSize * sizeof(uint32), nullptr));
+
+		size_t localWorkSize = tiledWorkGroupSize;
+		size_t globalWorkOffset = 0;
+		size_t globalWorkSize = std::min(tiledWorkGroupCount, std::max<uintMem>(dynamicParticlesCount, 1)) * tiledWorkGroupSize;
+		CL_CALL(clEnqueueNDRangeKernel(clCommandQueue, updateParticlesDynamicsTiledKernel, 1, &globalWorkOffset, &globalWorkSize, &localWorkSize, waitEvents.Count(), waitEvents.Ptr(), finishedEvent));
+	}
 	void SimulationEngineGPUKernels::DetermineHashGroupSize(uintMem targetHashMapSize, uintMem& dynamicParticlesHashMapGroupSize, uintMem& hashMapSize) const
 	{
 		uintMem maxWorkGroupSize1 = 0;
@@ -289,15 +659,54 @@ namespace SPH
 		dynamicParticlesHashMapGroupSize = std::min(dynamicParticlesHashMapGroupSize, hashMapGroupSizeCapacity);
 		hashMapSize = std::pow(dynamicParticlesHashMapGroupSize, layerCount);
 	}
+	uintMem SimulationEngineGPUKernels::GetRadixSortPassCount(uint keyBitCount)
+	{
+		return (keyBitCount + RadixSortDigitBitCount - 1) / RadixSortDigitBitCount;
+	}
 	void SimulationEngineGPUKernels::Load()
 	{
-		program = BuildOpenCLProgram(clContext, clDevice, {
+		StringView sourceArray[]{
 			Kernels::compatibilityHeader,
 			Kernels::SPHKernelSource,
-			}, { {"CL_COMPILER"} });
+		};
+		ArrayView<StringView> sources(sourceArray, std::size(sourceArray));
+		String options = GetBuildOptions({ {"CL_COMPILER"} });
+
+		auto loadStart = std::chrono::steady_clock::now();
+
+		std::filesystem::path cacheFilePath = GetProgramCacheFilePath(clDevice);
+		uint64 cacheKey = GetProgramCacheKey(clDevice, sources, options);
+
+		program = LoadCachedOpenCLProgram(clContext, clDevice, cacheFilePath, cacheKey, options, programLoadStatistics.sourceBuildSeconds);
+		programLoadStatistics.loadedFromCache = program != nullptr;
+
+		if (program == nullptr)
+		{
+			auto buildStart = std::chrono::steady_clock::now();
+			program = BuildOpenCLProgram(clContext, clDevice, sources, options);
+			programLoadStatistics.sourceBuildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - buildStart).count();
+
+			cl_build_status buildStatus = CL_BUILD_ERROR;
+			if (program != nullptr)
+				clGetProgramBuildInfo(program, clDevice, CL_PROGRAM_BUILD_STATUS, sizeof(buildStatus), &buildStatus, nullptr);
+
+			if (buildStatus == CL_BUILD_SUCCESS)
+				StoreCachedOpenCLProgram(program, clDevice, cacheFilePath, cacheKey, programLoadStatistics.sourceBuildSeconds);
+		}
+
+		programLoadStatistics.loadSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - loadStart).count();
+
+		if (programLoadStatistics.loadedFromCache)
+			Debug::Logger::LogInfo("SPH Library", Format("Loaded the OpenCL program from the program cache in {} ms, building it from the source took {} ms",
+				programLoadStatistics.loadSeconds * 1000, programLoadStatistics.sourceBuildSeconds * 1000));
+		else
+			Debug::Logger::LogInfo("SPH Library", Format("Built the OpenCL program from the source in {} ms", programLoadStatistics.loadSeconds * 1000));
 
 		CL_CHECK_RET(inclusiveScanUpPassKernel = clCreateKernel(program, "InclusiveScanUpPass", &ret));
 		CL_CHECK_RET(inclusiveScanDownPassKernel = clCreateKernel(program, "InclusiveScanDownPass", &ret));
+		CL_CHECK_RET(inclusiveScanReduceTilesKernel = clCreateKernel(program, "InclusiveScanReduceTiles", &ret));
+		CL_CHECK_RET(inclusiveScanTileSumsKernel = clCreateKernel(program, "InclusiveScanTileSums", &ret));
+		CL_CHECK_RET(inclusiveScanTilesKernel = clCreateKernel(program, "InclusiveScanTiles", &ret));
 		CL_CHECK_RET(prepareStaticParticlesHashMapKernel = clCreateKernel(program, "PrepareStaticParticlesHashMap", &ret));
 		CL_CHECK_RET(reorderStaticParticlesAndFinishHashMapKernel = clCreateKernel(program, "ReorderStaticParticlesAndFinishHashMap", &ret));
 		CL_CHECK_RET(computeDynamicParticlesHashAndPrepareHashMapKernel = clCreateKernel(program, "ComputeDynamicParticlesHashAndPrepareHashMap", &ret));
@@ -305,6 +714,14 @@ namespace SPH
 		CL_CHECK_RET(fillDynamicParticleMapAndFinishHashMapKernel = clCreateKernel(program, "FillDynamicParticleMapAndFinishHashMap", &ret));
 		CL_CHECK_RET(updateParticlesPressureKernel = clCreateKernel(program, "UpdateParticlePressure", &ret));
 		CL_CHECK_RET(updateParticlesDynamicsKernel = clCreateKernel(program, "UpdateParticleDynamics", &ret));
+		CL_CHECK_RET(listOccupiedBucketsKernel = clCreateKernel(program, "ListOccupiedBuckets", &ret));
+		CL_CHECK_RET(updateParticlesPressureTiledKernel = clCreateKernel(program, "UpdateParticlePressureTiled", &ret));
+		CL_CHECK_RET(updateParticlesDynamicsTiledKernel = clCreateKernel(program, "UpdateParticleDynamicsTiled", &ret));
+		CL_CHECK_RET(radixSortHistogramKernel = clCreateKernel(program, "RadixSortHistogram", &ret));
+		CL_CHECK_RET(radixSortScatterKernel = clCreateKernel(program, "RadixSortScatter", &ret));
+		CL_CHECK_RET(prepareDynamicParticlesSortKernel = clCreateKernel(program, "PrepareDynamicParticlesSort", &ret));
+		CL_CHECK_RET(finishSortedHashMapKernel = clCreateKernel(program, "FinishSortedHashMap", &ret));
+		CL_CHECK_RET(gatherSortedDynamicParticlesKernel = clCreateKernel(program, "GatherSortedDynamicParticles", &ret));
 
 		CL_CALL(clGetKernelWorkGroupInfo(inclusiveScanUpPassKernel, clDevice, CL_KERNEL_WORK_GROUP_SIZE, sizeof(uintMem), &inclusiveScanUpPassKernelWorkGroupSize, nullptr));
 		CL_CALL(clGetKernelWorkGroupInfo(inclusiveScanDownPassKernel, clDevice, CL_KERNEL_WORK_GROUP_SIZE, sizeof(uintMem), &inclusiveScanDownPassKernelWorkGroupSize, nullptr));
@@ -315,12 +732,58 @@ namespace SPH
 		CL_CALL(clGetKernelWorkGroupInfo(fillDynamicParticleMapAndFinishHashMapKernel, clDevice, CL_KERNEL_WORK_GROUP_SIZE, sizeof(uintMem), &fillDynamicParticleMapAndFinishHashMapKernelWorkGroupSize, nullptr));
 		CL_CALL(clGetKernelWorkGroupInfo(updateParticlesPressureKernel, clDevice, CL_KERNEL_WORK_GROUP_SIZE, sizeof(uintMem), &updateParticlesPressureKernelWorkGroupSize, nullptr));
 		CL_CALL(clGetKernelWorkGroupInfo(updateParticlesDynamicsKernel, clDevice, CL_KERNEL_WORK_GROUP_SIZE, sizeof(uintMem), &updateParticlesDynamicsKernelWorkGroupSize, nullptr));
+		CL_CALL(clGetKernelWorkGroupInfo(listOccupiedBucketsKernel, clDevice, CL_KERNEL_WORK_GROUP_SIZE, sizeof(uintMem), &listOccupiedBucketsKernelWorkGroupSize, nullptr));
+		CL_CALL(clGetKernelWorkGroupInfo(prepareDynamicParticlesSortKernel, clDevice, CL_KERNEL_WORK_GROUP_SIZE, sizeof(uintMem), &prepareDynamicParticlesSortKernelWorkGroupSize, nullptr));
+		CL_CALL(clGetKernelWorkGroupInfo(finishSortedHashMapKernel, clDevice, CL_KERNEL_WORK_GROUP_SIZE, sizeof(uintMem), &finishSortedHashMapKernelWorkGroupSize, nullptr));
+		CL_CALL(clGetKernelWorkGroupInfo(gatherSortedDynamicParticlesKernel, clDevice, CL_KERNEL_WORK_GROUP_SIZE, sizeof(uintMem), &gatherSortedDynamicParticlesKernelWorkGroupSize, nullptr));
+
+		//A bucket usually holds a few dozen particles, larger groups would mostly idle while evaluating them
+		uintMem tiledMaxWorkGroupSize1 = 0;
+		uintMem tiledMaxWorkGroupSize2 = 0;
+		CL_CALL(clGetKernelWorkGroupInfo(updateParticlesPressureTiledKernel, clDevice, CL_KERNEL_WORK_GROUP_SIZE, sizeof(uintMem), &tiledMaxWorkGroupSize1, nullptr));
+		CL_CALL(clGetKernelWorkGroupInfo(updateParticlesDynamicsTiledKernel, clDevice, CL_KERNEL_WORK_GROUP_SIZE, sizeof(uintMem), &tiledMaxWorkGroupSize2, nullptr));
+		CL_CALL(clGetKernelWorkGroupInfo(updateParticlesDynamicsTiledKernel, clDevice, CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE, sizeof(uintMem), &tiledWorkGroupSize, nullptr));
+		tiledWorkGroupSize = std::max<uintMem>(std::min({ tiledWorkGroupSize, tiledMaxWorkGroupSize1, tiledMaxWorkGroupSize2 }), 1);
+
+		cl_uint computeUnitCount = 0;
+		CL_CALL(clGetDeviceInfo(clDevice, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(computeUnitCount), &computeUnitCount, nullptr));
+		tiledWorkGroupCount = std::max<uintMem>(computeUnitCount, 1) * 32;
+
+		//Every step of the work group scan has two barriers, larger groups only add steps
+		reduceThenScanWorkGroupSize = 256;
+		for (cl_kernel kernel : { inclusiveScanReduceTilesKernel, inclusiveScanTileSumsKernel, inclusiveScanTilesKernel })
+		{
+			uintMem workGroupSize = 0;
+			CL_CALL(clGetKernelWorkGroupInfo(kernel, clDevice, CL_KERNEL_WORK_GROUP_SIZE, sizeof(uintMem), &workGroupSize, nullptr));
+			reduceThenScanWorkGroupSize = std::min(reduceThenScanWorkGroupSize, workGroupSize);
+		}
+		reduceThenScanWorkGroupSize = std::max<uintMem>(reduceThenScanWorkGroupSize, 1);
+
+		//Same as for the scan, the scatter runs four work group scans per chunk
+		radixSortWorkGroupSize = 256;
+		for (cl_kernel kernel : { radixSortHistogramKernel, radixSortScatterKernel })
+		{
+			uintMem workGroupSize = 0;
+			CL_CALL(clGetKernelWorkGroupInfo(kernel, clDevice, CL_KERNEL_WORK_GROUP_SIZE, sizeof(uintMem), &workGroupSize, nullptr));
+			radixSortWorkGroupSize = std::min(radixSortWorkGroupSize, workGroupSize);
+		}
+		radixSortWorkGroupSize = std::max<uintMem>(radixSortWorkGroupSize, 1);
+
+		CL_CHECK_RET(reduceThenScanTileSums = clCreateBuffer(clContext, CL_MEM_READ_WRITE, sizeof(uint32) * MaxReduceThenScanTileCount, nullptr, &ret));
+		CL_CHECK_RET(radixSortHistogram = clCreateBuffer(clContext, CL_MEM_READ_WRITE, sizeof(uint32) * RadixSortDigitCount * MaxRadixSortTileCount, nullptr, &ret));
+
+		//The kernels of a cached binary are the ones described by the last build from the source
+		if (programLoadStatistics.loadedFromCache)
+			return;
 
 		File infoFile{ "OpenCLInfo.txt", FileAccessPermission::Write };
 
 		PrintDeviceInfo(clDevice, infoFile);
 		PrintKernelInfo(inclusiveScanUpPassKernel, clDevice, infoFile);
 		PrintKernelInfo(inclusiveScanDownPassKernel, clDevice, infoFile);
+		PrintKernelInfo(inclusiveScanReduceTilesKernel, clDevice, infoFile);
+		PrintKernelInfo(inclusiveScanTileSumsKernel, clDevice, infoFile);
+		PrintKernelInfo(inclusiveScanTilesKernel, clDevice, infoFile);
 		PrintKernelInfo(prepareStaticParticlesHashMapKernel, clDevice, infoFile);
 		PrintKernelInfo(reorderStaticParticlesAndFinishHashMapKernel, clDevice, infoFile);
 		PrintKernelInfo(computeDynamicParticlesHashAndPrepareHashMapKernel, clDevice, infoFile);
@@ -328,5 +791,13 @@ namespace SPH
 		PrintKernelInfo(fillDynamicParticleMapAndFinishHashMapKernel, clDevice, infoFile);
 		PrintKernelInfo(updateParticlesPressureKernel, clDevice, infoFile);
 		PrintKernelInfo(updateParticlesDynamicsKernel, clDevice, infoFile);
+		PrintKernelInfo(listOccupiedBucketsKernel, clDevice, infoFile);
+		PrintKernelInfo(updateParticlesPressureTiledKernel, clDevice, infoFile);
+		PrintKernelInfo(updateParticlesDynamicsTiledKernel, clDevice, infoFile);
+		PrintKernelInfo(radixSortHistogramKernel, clDevice, infoFile);
+		PrintKernelInfo(radixSortScatterKernel, clDevice, infoFile);
+		PrintKernelInfo(prepareDynamicParticlesSortKernel, clDevice, infoFile);
+		PrintKernelInfo(finishSortedHashMapKernel, clDevice, infoFile);
+		PrintKernelInfo(gatherSortedDynamicParticlesKernel, clDevice, infoFile);
 	}
 }
\ No newline at end of file